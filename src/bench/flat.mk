@@ -0,0 +1,4 @@
+BENCH_O=bench/main.o
+BENCH_H=pipe/graph-profile.h
+BENCH_CFLAGS=
+BENCH_LDFLAGS=-lm -rdynamic
@@ -0,0 +1,420 @@
+#include "qvk/qvk.h"
+#include "pipe/graph.h"
+#include "pipe/graph-profile.h"
+#include "pipe/global.h"
+#include "pipe/modules/api.h"
+#include "core/log.h"
+#include "core/threads.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// per module gpu benchmark. every module with a simple input -> output chain
+// is run on its own: i-mem (synthetic rgba f32 pixels) -> module -> o-null.
+// after a few warm-up runs, the timestamp queries of n recorded runs are
+// summed per kernel and written out as csv or json, one line per kernel and
+// resolution, so the numbers of two builds or two devices can be diffed.
+// with --compare, the results are also checked against an earlier json output
+// of the same device and regressions are reported per module and kernel.
+
+#define DT_BENCH_MAX_SIZES   8
+#define DT_BENCH_MAX_ITER  256
+#define DT_BENCH_MAX_KERNEL 32 // per module
+
+typedef struct dt_bench_kernel_t
+{
+  dt_token_t node, kernel;
+  double     ms[DT_BENCH_MAX_ITER];
+  uint64_t   bytes;            // read + written per run
+}
+dt_bench_kernel_t;
+
+// one line of a baseline json file
+typedef struct dt_bench_base_t
+{
+  char       device[256];
+  dt_token_t module, kernel;
+  int        wd, ht;
+  double     ms, mad;
+  int        seen;             // matched by a result of this run
+}
+dt_bench_base_t;
+
+typedef struct dt_bench_t
+{
+  int      size[DT_BENCH_MAX_SIZES][2];
+  int      num_sizes;
+  int      warmup, iter;
+  int      json, cnt;          // output format and number of lines written
+  FILE    *f;
+  char     device[256];
+  const char *filter;          // only this module, or 0
+  dt_bench_base_t *base;       // baseline to compare to, or 0
+  int      num_base;
+  double   threshold;          // relative slowdown to report
+  int      compared, regressed, improved;
+}
+dt_bench_t;
+
+static int
+compare_double(const void *a, const void *b)
+{
+  const double x = *(const double *)a, y = *(const double *)b;
+  return x < y ? -1 : x > y;
+}
+
+// only modules we can feed with one rgba image and read one image back
+static int
+dt_bench_module_ok(const dt_module_so_t *so)
+{
+  if(!so->has_inout_chain || so->read_source || so->write_sink) return 0;
+  for(int c=0;c<so->num_connectors;c++)
+  {
+    const dt_connector_t *cn = so->connector + c;
+    if(cn->type == dt_token("read") && cn->name != dt_token("input")) return 0; // would be unconnected
+  }
+  return 1;
+}
+
+static void
+dt_bench_fill(dt_graph_t *graph, int m0)
+{ // deterministic smooth gradient, so data dependent kernels do the same on every run
+  for(int n=0;n<graph->num_nodes;n++)
+  {
+    dt_node_t *node = graph->node + n;
+    if(!dt_node_source(node) || node->module != graph->module + m0) continue;
+    const dt_connector_t *c = node->connector;
+    for(int f=0;f<2;f++)
+    {
+      float *px = (float *)(graph->staging_mapped + c->offset_staging + f * c->stride_staging);
+      for(int j=0;j<c->roi.ht;j++) for(int i=0;i<c->roi.wd;i++)
+      {
+        float *p = px + 4*(j*c->roi.wd + i);
+        p[0] = i / (float)c->roi.wd;
+        p[1] = j / (float)c->roi.ht;
+        p[2] = 0.5f*(p[0] + p[1]);
+        p[3] = 1.0f;
+      }
+    }
+  }
+}
+
+// pull "key":value out of one object of our own json output. strings are
+// copied to str, numbers go to num. returns non-zero if the key is missing.
+static int
+dt_bench_json_get(const char *obj, const char *key, char *str, size_t len, double *num)
+{
+  char pat[64];
+  snprintf(pat, sizeof(pat), "\"%s\":", key);
+  const char *p = strstr(obj, pat);
+  if(!p) return 1;
+  p += strlen(pat);
+  if(str)
+  {
+    if(*p++ != '"') return 1;
+    const char *e = strchr(p, '"');
+    if(!e) return 1;
+    snprintf(str, len, "%.*s", (int)(e - p), p);
+  }
+  if(num) *num = atof(p);
+  return 0;
+}
+
+static int
+dt_bench_read_base(dt_bench_t *b, const char *filename)
+{
+  FILE *f = fopen(filename, "rb");
+  if(!f) return 1;
+  fseek(f, 0, SEEK_END);
+  const size_t len = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  char *buf = malloc(len+1);
+  buf[fread(buf, 1, len, f)] = 0;
+  fclose(f);
+  int max = 0;
+  for(char *p=strchr(buf, '{');p;p=strchr(p, '{'))
+  {
+    char *e = strchr(p, '}');
+    if(!e) break;
+    *e = 0; // the device name has no braces
+    if(b->num_base >= max) b->base = realloc(b->base, sizeof(b->base[0])*(max = MAX(256, 2*max)));
+    dt_bench_base_t *r = b->base + b->num_base;
+    memset(r, 0, sizeof(*r));
+    char module[32], kernel[32];
+    double wd, ht;
+    if(!dt_bench_json_get(p, "device", r->device, sizeof(r->device), 0) &&
+       !dt_bench_json_get(p, "module", module, sizeof(module), 0) &&
+       !dt_bench_json_get(p, "kernel", kernel, sizeof(kernel), 0) &&
+       !dt_bench_json_get(p, "width",  0, 0, &wd) &&
+       !dt_bench_json_get(p, "height", 0, 0, &ht) &&
+       !dt_bench_json_get(p, "ms",     0, 0, &r->ms))
+    {
+      dt_bench_json_get(p, "ms_mad", 0, 0, &r->mad); // older files don't have it
+      r->module = dt_token(module);
+      r->kernel = dt_token(kernel);
+      r->wd = wd;
+      r->ht = ht;
+      b->num_base++;
+    }
+    p = e+1;
+  }
+  free(buf);
+  return b->num_base == 0;
+}
+
+// a kernel regressed if its median got slower by more than the threshold, and
+// by more than three standard deviations of the noise of the two runs, as
+// estimated by the median absolute deviations.
+static void
+dt_bench_compare(
+    dt_bench_t              *b,
+    const dt_bench_kernel_t *k,
+    int                      wd,
+    int                      ht,
+    double                   med,
+    double                   mad)
+{
+  for(int i=0;i<b->num_base;i++)
+  {
+    dt_bench_base_t *r = b->base + i;
+    if(r->module != k->node || r->kernel != k->kernel || r->wd != wd || r->ht != ht ||
+       strcmp(r->device, b->device)) continue;
+    r->seen = 1;
+    b->compared++;
+    const double diff  = med - r->ms;
+    const double sigma = 1.4826 * sqrt(r->mad*r->mad + mad*mad);
+    if(fabs(diff) <= b->threshold * r->ms || fabs(diff) <= 3.0 * sigma) return;
+    if(diff > 0.0)
+    {
+      dt_log(s_log_cli|s_log_err, "regression %"PRItkn" %"PRItkn" %dx%d: %.4f ms -> %.4f ms (%+.1f%%)",
+          dt_token_str(k->node), dt_token_str(k->kernel), wd, ht, r->ms, med, 100.0 * diff / r->ms);
+      b->regressed++;
+    }
+    else b->improved++;
+    return;
+  }
+}
+
+static void
+dt_bench_write(
+    dt_bench_t              *b,
+    const dt_bench_kernel_t *k,
+    int                      wd,
+    int                      ht)
+{
+  double ms[DT_BENCH_MAX_ITER];
+  memcpy(ms, k->ms, sizeof(double)*b->iter);
+  qsort(ms, b->iter, sizeof(double), compare_double);
+  const double med = ms[b->iter/2], min = ms[0];
+  const double gbs = med > 0.0 ? k->bytes / (med * 1e6) : 0.0;
+  for(int i=0;i<b->iter;i++) ms[i] = fabs(ms[i] - med);
+  qsort(ms, b->iter, sizeof(double), compare_double);
+  const double mad = ms[b->iter/2]; // median absolute deviation
+  if(b->json)
+    fprintf(b->f, "%s  {\"device\":\"%s\",\"module\":\"%"PRItkn"\",\"kernel\":\"%"PRItkn"\","
+        "\"width\":%d,\"height\":%d,\"ms\":%.4f,\"ms_min\":%.4f,\"gb_per_s\":%.2f,\"ms_mad\":%.4f}",
+        b->cnt ? ",\n" : "", b->device, dt_token_str(k->node), dt_token_str(k->kernel), wd, ht, med, min, gbs, mad);
+  else
+    fprintf(b->f, "%s,%"PRItkn",%"PRItkn",%d,%d,%.4f,%.4f,%.2f,%.4f\n",
+        b->device, dt_token_str(k->node), dt_token_str(k->kernel), wd, ht, med, min, gbs, mad);
+  b->cnt++;
+  if(b->base) dt_bench_compare(b, k, wd, ht, med, mad);
+}
+
+// returns non-zero if the module could not be run at this size
+static int
+dt_bench_module(
+    dt_bench_t           *b,
+    const dt_module_so_t *so,
+    int                   wd,
+    int                   ht)
+{
+  dt_graph_t graph;
+  dt_graph_init(&graph);
+  static dt_bench_kernel_t kernel[DT_BENCH_MAX_KERNEL];
+  int cnt = 0, err = 1;
+  const int m0 = dt_module_add(&graph, dt_token("i-mem"),  dt_token("main"));
+  const int m1 = dt_module_add(&graph, so->name,           dt_token("main"));
+  const int m2 = dt_module_add(&graph, dt_token("o-null"), dt_token("main"));
+  if(m0 < 0 || m1 < 0 || m2 < 0) goto done;
+  int32_t *size = (int32_t *)dt_module_param_int(graph.module+m0, 0);
+  size[0] = wd; // width and height are consecutive params
+  size[1] = ht;
+  if(dt_module_connect(&graph, m0, dt_module_get_connector(graph.module+m0, dt_token("output")),
+                               m1, dt_module_get_connector(graph.module+m1, dt_token("input"))) ||
+     dt_module_connect(&graph, m1, dt_module_get_connector(graph.module+m1, dt_token("output")),
+                               m2, dt_module_get_connector(graph.module+m2, dt_token("input"))))
+    goto done;
+
+  const dt_graph_run_t alloc = s_graph_run_roi | s_graph_run_create_nodes | s_graph_run_alloc;
+  if(dt_graph_run(&graph, alloc) != VK_SUCCESS) goto done;
+  dt_bench_fill(&graph, m0);
+  if(dt_graph_run(&graph, s_graph_run_all & ~alloc) != VK_SUCCESS) goto done;
+
+  for(int it=0;it<b->warmup+b->iter;it++)
+  {
+    if(dt_graph_run(&graph, s_graph_run_record_cmd_buf | s_graph_run_wait_done) != VK_SUCCESS) goto done;
+    if(it < b->warmup) continue;
+    const int q = graph.ring_done;
+    if(dt_graph_profile_results(&graph, q) != VK_SUCCESS) goto done;
+    const dt_graph_query_t *qr = graph.query + q;
+    for(int k=0;k<cnt;k++) kernel[k].ms[it-b->warmup] = 0.0;
+    for(int i=0;i+1<qr->cnt;i+=2)
+    { // sum up all nodes of our module per kernel
+      dt_node_t *node = graph.node + qr->nid[i];
+      if(node->module != graph.module + m1) continue;
+      int k = 0;
+      for(;k<cnt;k++) if(kernel[k].node == node->name && kernel[k].kernel == node->kernel) break;
+      if(k == cnt)
+      {
+        if(cnt == DT_BENCH_MAX_KERNEL) continue;
+        memset(kernel+cnt, 0, sizeof(kernel[0]));
+        kernel[cnt].node   = node->name;
+        kernel[cnt++].kernel = node->kernel;
+      }
+      kernel[k].ms[it-b->warmup] += (qr->pool_results[i+1] - qr->pool_results[i]) * 1e-6 * qvk.ticks_to_nanoseconds;
+      if(it == b->warmup) kernel[k].bytes += dt_graph_profile_bytes(node, 0) + dt_graph_profile_bytes(node, 1);
+    }
+  }
+  for(int k=0;k<cnt;k++) dt_bench_write(b, kernel+k, wd, ht);
+  err = 0;
+done:
+  dt_graph_cleanup(&graph);
+  return err;
+}
+
+int main(int argc, char *argv[])
+{
+  dt_log_init(s_log_cli|s_log_err);
+  dt_log_init_arg(argc, argv);
+  dt_pipe_global_init();
+
+  dt_bench_t b = { .warmup = 3, .iter = 20, .f = stdout, .threshold = 0.05 };
+  const char *gpu_name = 0, *outfile = 0, *basefile = 0;
+  int gpu_id = -1;
+  for(int i=1;i<argc;i++)
+  {
+    if(!strcmp(argv[i], "--size") && i < argc-1 && b.num_sizes < DT_BENCH_MAX_SIZES)
+    {
+      if(sscanf(argv[++i], "%dx%d", b.size[b.num_sizes], b.size[b.num_sizes]+1) == 2 &&
+          b.size[b.num_sizes][0] > 0 && b.size[b.num_sizes][1] > 0)
+        b.num_sizes++;
+    }
+    else if(!strcmp(argv[i], "--iterations") && i < argc-1)
+      b.iter = CLAMP(atol(argv[++i]), 1, DT_BENCH_MAX_ITER);
+    else if(!strcmp(argv[i], "--warmup") && i < argc-1)
+      b.warmup = MAX(0, atol(argv[++i]));
+    else if(!strcmp(argv[i], "--module") && i < argc-1)
+      b.filter = argv[++i];
+    else if(!strcmp(argv[i], "--output") && i < argc-1)
+      outfile = argv[++i];
+    else if(!strcmp(argv[i], "--json"))
+      b.json = 1;
+    else if(!strcmp(argv[i], "--compare") && i < argc-1)
+      basefile = argv[++i];
+    else if(!strcmp(argv[i], "--threshold") && i < argc-1)
+      b.threshold = MAX(0.0, atof(argv[++i]) / 100.0);
+    else if(!strcmp(argv[i], "--device") && i < argc-1)
+      gpu_name = argv[++i];
+    else if(!strcmp(argv[i], "--device-id") && i < argc-1)
+      gpu_id = atol(argv[++i]);
+    else if(!strcmp(argv[i], "-d") && i < argc-1)
+      i++; // handled by dt_log_init_arg()
+    else
+    {
+      fprintf(stderr, "usage: vkdt-bench\n"
+      "    [-d verbosity]           set log verbosity (none,qvk,pipe,gui,db,cli,snd,perf,mem,err,all)\n"
+      "    [--size <wd>x<ht>]       resolution to test (can use multiple, default 1024x1024 and 6000x4000)\n"
+      "    [--iterations <n>]       timed runs per module and size (default 20)\n"
+      "    [--warmup <n>]           untimed runs before that (default 3)\n"
+      "    [--module <name>]        only benchmark this module\n"
+      "    [--output <file>]        write the results here instead of stdout\n"
+      "    [--json]                 write json instead of csv\n"
+      "    [--compare <file.json>]  report kernels that got slower than in this earlier --json output\n"
+      "    [--threshold <percent>]  minimum slowdown to report with --compare (default 5)\n"
+      "    [--device <gpu name>]    explicitly use this gpu if you have multiple\n"
+      "    [--device-id <gpu id>]   explicitly use this gpu id if you have multiple\n");
+      dt_pipe_global_cleanup();
+      exit(1);
+    }
+  }
+  if(!b.num_sizes)
+  {
+    b.size[0][0] = b.size[0][1] = 1024;
+    b.size[1][0] = 6000; b.size[1][1] = 4000;
+    b.num_sizes = 2;
+  }
+
+  if(basefile && dt_bench_read_base(&b, basefile))
+  {
+    dt_log(s_log_cli|s_log_err, "could not read any results from %s!", basefile);
+    dt_pipe_global_cleanup();
+    exit(1);
+  }
+
+  threads_global_init();
+  if(qvk_init(gpu_name, gpu_id)) exit(1);
+  VkPhysicalDeviceProperties prop;
+  vkGetPhysicalDeviceProperties(qvk.physical_device, &prop);
+  snprintf(b.device, sizeof(b.device), "%s", prop.deviceName);
+  for(char *c=b.device;*c;c++) if(*c == ',' || *c == '"') *c = ' ';
+
+  if(outfile && !(b.f = fopen(outfile, "wb")))
+  {
+    dt_log(s_log_cli|s_log_err, "could not open %s for writing!", outfile);
+    b.f = stdout;
+  }
+  if(b.json) fprintf(b.f, "[\n");
+  else fprintf(b.f, "device,module,kernel,width,height,ms,ms_min,gb_per_s,ms_mad\n");
+
+  int skipped = 0;
+  for(int m=0;m<dt_pipe.num_modules;m++)
+  {
+    dt_module_so_dlopen(dt_pipe.module + m); // need to know about read_source and write_sink
+    const dt_module_so_t *so = dt_pipe.module + m;
+    if(b.filter ? so->name != dt_token(b.filter) : !dt_bench_module_ok(so)) continue;
+    for(int s=0;s<b.num_sizes;s++)
+    {
+      if(dt_bench_module(&b, so, b.size[s][0], b.size[s][1]))
+      {
+        dt_log(s_log_cli, "skipping %"PRItkn", it does not run on rgba input", dt_token_str(so->name));
+        skipped++;
+        break;
+      }
+    }
+    fflush(b.f);
+  }
+  if(b.json) fprintf(b.f, "\n]\n");
+  if(b.f != stdout) fclose(b.f);
+  dt_log(s_log_cli, "%d result lines, %d modules skipped", b.cnt, skipped);
+
+  int ret = 0;
+  if(b.base)
+  { // kernels of the baseline that should have run but didn't count as regressions
+    for(int i=0;i<b.num_base;i++)
+    {
+      const dt_bench_base_t *r = b.base + i;
+      if(r->seen || strcmp(r->device, b.device) || (b.filter && r->module != dt_token(b.filter))) continue;
+      for(int s=0;s<b.num_sizes;s++) if(r->wd == b.size[s][0] && r->ht == b.size[s][1])
+      {
+        dt_log(s_log_cli|s_log_err, "regression %"PRItkn" %"PRItkn" %dx%d: did not run",
+            dt_token_str(r->module), dt_token_str(r->kernel), r->wd, r->ht);
+        b.regressed++;
+        break;
+      }
+    }
+    dt_log(s_log_cli, "compared %d kernels on %s: %d regressions, %d improvements beyond %.1f%%",
+        b.compared, b.device, b.regressed, b.improved, 100.0 * b.threshold);
+    if(!b.compared) dt_log(s_log_cli|s_log_err, "the baseline has no matching results for this device!");
+    ret = b.regressed || !b.compared;
+    free(b.base);
+  }
+
+  threads_global_cleanup();
+  dt_pipe_shader_cleanup();
+  dt_pipe_staging_cleanup();
+  qvk_cleanup();
+  dt_pipe_global_cleanup();
+  exit(ret);
+}
@@ -0,0 +1,113 @@
+#include "cli/autotune.h"
+#include "qvk/qvk.h"
+#include "pipe/global.h"
+#include "pipe/graph.h"
+#include "pipe/graph-profile.h"
+#include "pipe/modules/api.h"
+#include "core/log.h"
+
+#define DT_AUTOTUNE_RUNS    3   // keep the fastest of these per candidate
+#define DT_AUTOTUNE_KERNELS 256
+
+static const uint32_t dt_autotune_size[][2] = {
+  {8, 8}, {16, 8}, {8, 16}, {16, 16}, {32, 4}, {32, 8}, {64, 1}, {64, 2}, {64, 4}, {128, 1}, {32, 16}, {32, 32},
+};
+#define DT_AUTOTUNE_CANDIDATES (sizeof(dt_autotune_size)/sizeof(dt_autotune_size[0]))
+
+typedef struct dt_autotune_kernel_t
+{
+  dt_token_t node, kernel;
+  double     ms[DT_AUTOTUNE_CANDIDATES]; // fastest total time of all nodes running this kernel
+}
+dt_autotune_kernel_t;
+
+// sum up the gpu time of the tunable kernels over the last frame
+static int
+dt_autotune_collect(
+    dt_graph_t           *graph,
+    dt_autotune_kernel_t *k,
+    int                   cnt,
+    int                   cand,
+    double               *ms)
+{
+  dt_graph_query_t *q = graph->query + graph->ring_done;
+  if(!q->cnt || dt_graph_profile_results(graph, graph->ring_done) != VK_SUCCESS)
+    return cnt;
+  for(int i=0;i<cnt;i++) ms[i] = 0.0;
+  for(int i=0;i+1<q->cnt;i+=2)
+  {
+    dt_node_t *node = graph->node + q->nid[i];
+    if(node->type != s_node_compute || dt_node_source(node) || dt_node_sink(node)) continue;
+    if(!dt_pipe_shader_tunable(node->name, node->kernel)) continue;
+    int j = 0;
+    for(;j<cnt;j++) if(k[j].node == node->name && k[j].kernel == node->kernel) break;
+    if(j == cnt)
+    {
+      if(cnt == DT_AUTOTUNE_KERNELS) continue;
+      k[cnt] = (dt_autotune_kernel_t){ .node = node->name, .kernel = node->kernel };
+      for(int c=0;c<DT_AUTOTUNE_CANDIDATES;c++) k[cnt].ms[c] = -1.0; // not measured
+      ms[cnt++] = 0.0;
+    }
+    ms[j] += (q->pool_results[i+1] - q->pool_results[i]) * 1e-6 * qvk.ticks_to_nanoseconds;
+  }
+  for(int i=0;i<cnt;i++)
+    if(k[i].ms[cand] < 0.0 || ms[i] < k[i].ms[cand]) k[i].ms[cand] = ms[i];
+  return cnt;
+}
+
+int
+dt_cli_autotune(const dt_graph_export_t *param)
+{
+  VkPhysicalDeviceProperties prop;
+  vkGetPhysicalDeviceProperties(qvk.physical_device, &prop);
+  dt_graph_export_t p = *param;
+  p.output_cnt = 1;
+  p.output[0]  = (dt_graph_export_output_t){ .inst = dt_token("main"), .mod = dt_token("o-null"), .p_filename = "autotune" };
+  p.last_frame_only = 1;
+
+  static dt_autotune_kernel_t kernel[DT_AUTOTUNE_KERNELS];
+  double ms[DT_AUTOTUNE_KERNELS];
+  int cnt = 0, failed = 0;
+  dt_graph_t graph;
+  dt_graph_init(&graph);
+  for(int c=0;c<DT_AUTOTUNE_CANDIDATES && !failed;c++)
+  {
+    const uint32_t *size = dt_autotune_size[c];
+    if(size[0] * size[1] > prop.limits.maxComputeWorkGroupInvocations ||
+       size[0] > prop.limits.maxComputeWorkGroupSize[0] ||
+       size[1] > prop.limits.maxComputeWorkGroupSize[1]) continue;
+    dt_pipe.localsize_force[0] = size[0];
+    dt_pipe.localsize_force[1] = size[1];
+    for(int r=0;r<DT_AUTOTUNE_RUNS;r++)
+    { // the graph keeps the source uploads and pipelines of the same size between runs
+      if(dt_graph_export(&graph, &p) != VK_SUCCESS) { failed = 1; break; }
+      cnt = dt_autotune_collect(&graph, kernel, cnt, c, ms);
+      dt_graph_reset(&graph);
+    }
+  }
+  dt_pipe.localsize_force[0] = dt_pipe.localsize_force[1] = 0;
+  dt_graph_cleanup(&graph);
+  if(failed)
+  {
+    dt_log(s_log_cli|s_log_err, "could not run %s for autotuning!", p.p_cfgfile);
+    return 1;
+  }
+  if(!cnt)
+  {
+    dt_log(s_log_cli, "the graph has no tunable kernels");
+    return 0;
+  }
+
+  for(int i=0;i<cnt;i++)
+  {
+    int best = -1;
+    for(int c=0;c<DT_AUTOTUNE_CANDIDATES;c++)
+      if(kernel[i].ms[c] >= 0.0 && (best < 0 || kernel[i].ms[c] < kernel[i].ms[best])) best = c;
+    dt_pipe_localsize_set(kernel[i].node, kernel[i].kernel, dt_autotune_size[best]);
+    dt_log(s_log_cli, "%"PRItkn" %"PRItkn"\t%3ux%-3u %8.3f ms (8x8 %8.3f ms)",
+        dt_token_str(kernel[i].node), dt_token_str(kernel[i].kernel),
+        dt_autotune_size[best][0], dt_autotune_size[best][1],
+        kernel[i].ms[best], kernel[i].ms[0]);
+  }
+  return dt_pipe_localsize_write();
+}
@@ -0,0 +1,9 @@
+#pragma once
+#include "pipe/graph-export.h"
+
+// find the fastest work group size for every tunable compute kernel of the
+// graph in param (see DT_LOCAL_SIZE_TUNABLE): the graph is run with each
+// candidate size a few times, and the per node gpu timestamps decide. the
+// results are stored next to the pipeline cache and picked up by all later
+// runs on this device. returns non-zero on failure.
+int dt_cli_autotune(const dt_graph_export_t *param);
@@ -0,0 +1,107 @@
+#include "cli/bench.h"
+#include "qvk/qvk.h"
+#include "pipe/graph.h"
+#include "pipe/graph-profile.h"
+#include "pipe/modules/api.h"
+#include "core/core.h"
+#include "core/log.h"
+
+#include <stdlib.h>
+
+#define DT_BENCH_STAGES 12
+
+static const char *dt_bench_stage[DT_BENCH_STAGES] = {
+  "parse cfg", "modify roi", "create nodes", "alloc", "read source", "record",
+  "submit+wait", "gpu compute", "gpu download", "write sink", "other", "total",
+};
+
+static int
+compare_double(const void *a, const void *b)
+{
+  const double x = *(const double *)a, y = *(const double *)b;
+  return x < y ? -1 : x > y;
+}
+
+// gpu time of the last frame, kernels and sink downloads separately
+static void
+dt_bench_gpu(dt_graph_t *graph, double *compute, double *download)
+{
+  *compute = *download = 0.0;
+  const int q = graph->ring_done;
+  if(dt_graph_profile_results(graph, q) != VK_SUCCESS) return;
+  const dt_graph_query_t *qr = graph->query + q;
+  for(int i=0;i+1<qr->cnt;i+=2)
+  {
+    const double ms = (qr->pool_results[i+1] - qr->pool_results[i]) * 1e-6 * qvk.ticks_to_nanoseconds;
+    if(dt_node_sink(graph->node + qr->nid[i])) *download += ms;
+    else *compute += ms;
+  }
+}
+
+int
+dt_cli_bench(
+    const dt_graph_export_t *param,
+    int                      iterations,
+    double                   init_ms)
+{
+  iterations = MAX(1, iterations);
+  double *t = calloc(sizeof(double), DT_BENCH_STAGES * iterations);
+  dt_graph_export_t p = *param;
+  dt_graph_t graph;
+  dt_graph_init(&graph);
+  graph.pipeline_stats = 1;
+  double *gbs = calloc(sizeof(double), iterations);
+  dt_graph_profile_stats_t st = {0};
+  int err = 0;
+  for(int it=0;it<iterations;it++)
+  {
+    double *r = t + DT_BENCH_STAGES * it;
+    const double beg = dt_time();
+    if(dt_graph_export(&graph, &p) != VK_SUCCESS) { err = 1; break; }
+    dt_graph_sink_flush(&graph); // the last frame may still be written
+    r[11] = 1000.0*(dt_time() - beg);
+    const dt_graph_perf_t *pf = &graph.perf;
+    r[0] = pf->parse;  r[1] = pf->roi;    r[2] = pf->nodes; r[3] = pf->alloc;
+    r[4] = pf->upload; r[5] = pf->record; r[6] = pf->submit;
+    dt_bench_gpu(&graph, r+7, r+8);
+    dt_graph_profile_stats_results(&graph, graph.ring_done);
+    st = dt_graph_profile_stats(&graph, graph.ring_done);
+    gbs[it] = st.ms > 0.0 ? st.bytes / (st.ms * 1e6) : 0.0;
+    r[9]  = pf->sink;
+    r[10] = r[11];
+    for(int k=0;k<7;k++) r[10] -= r[k];
+    r[10] = MAX(0.0, r[10] - r[9]);
+    dt_graph_reset(&graph);
+  }
+  dt_graph_cleanup(&graph);
+  if(err)
+  {
+    dt_log(s_log_cli|s_log_err, "could not export %s!", p.p_cfgfile);
+    free(gbs);
+    free(t);
+    return 1;
+  }
+
+  // one line per stage, cold run and then the warm ones
+  double *s = malloc(sizeof(double) * iterations);
+  printf("# %s, %d iterations, all times in ms\n", p.p_cfgfile, iterations);
+  printf("%-14s %10s %10s %10s %10s\n", "stage", "first", "median", "min", "max");
+  printf("%-14s %10.3f %10s %10s %10s\n", "global init", init_ms, "-", "-", "-");
+  for(int k=0;k<DT_BENCH_STAGES;k++)
+  {
+    const int n = MAX(1, iterations-1);
+    for(int it=0;it<n;it++) s[it] = t[DT_BENCH_STAGES*(iterations > 1 ? it+1 : 0) + k];
+    qsort(s, n, sizeof(double), compare_double);
+    printf("%-14s %10.3f %10.3f %10.3f %10.3f\n", dt_bench_stage[k], t[k], s[n/2], s[0], s[n-1]);
+  }
+  // bytes are computed from the connectors, so this is a lower bound of the real traffic
+  const int n = MAX(1, iterations-1);
+  qsort(gbs + (iterations > 1), n, sizeof(double), compare_double);
+  printf("# kernels touch %.1f MB per run, median %.2f GB/s, %"PRIu64" invocations%s\n",
+      st.bytes / (1024.0*1024.0), gbs[(iterations > 1) + n/2], st.invocations,
+      qvk.pipeline_stats_supported ? "" : " (no pipeline statistics on this device)");
+  free(gbs);
+  free(s);
+  free(t);
+  return 0;
+}
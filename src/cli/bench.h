@@ -0,0 +1,10 @@
+#pragma once
+#include "pipe/graph-export.h"
+
+// export the graph in param iterations times and print how long every stage
+// took: cfg parsing, roi and node creation, allocation, read_source(),
+// recording, gpu time of the kernels and the sink downloads, and write_sink().
+// the first run is cold, i.e. it includes pipeline creation and source
+// decoding, the others reuse the caches of the graph. init_ms is the time
+// dt_pipe_global_init() took, to be printed along. returns non-zero on failure.
+int dt_cli_bench(const dt_graph_export_t *param, int iterations, double init_ms);
@@ -1,4 +1,4 @@
-CLI_O=cli/main.o
-CLI_H=
+CLI_O=cli/main.o cli/serve.o cli/autotune.o cli/bench.o
+CLI_H=cli/serve.h cli/autotune.h cli/bench.h
 CLI_CFLAGS=
 CLI_LDFLAGS=-rdynamic
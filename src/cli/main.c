@@ -3,12 +3,195 @@
 #include "pipe/graph-io.h"
 #include "pipe/graph-print.h"
 #include "pipe/graph-export.h"
+#include "pipe/graph-profile.h"
 #include "pipe/global.h"
 #include "pipe/modules/api.h"
 #include "core/log.h"
+#include "core/fs.h"
+#include "core/core.h"
+#include "core/threads.h"
+#include "core/trace.h"
 #include "core/version.h"
+#include "cli/serve.h"
+#include "cli/autotune.h"
+#include "cli/bench.h"
 
 #include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define DT_CLI_BATCH_THREADS 2 // one graph per work queue
+#define DT_CLI_MAX_DEVICES   8 // for --batch-devices
+
+typedef struct batch_job_t
+{ // one of these per worker thread, with its own graph on its own queue
+  dt_graph_t               graph;
+  const dt_graph_export_t *param;  // template for every image, shared
+  char                   **line;   // input cfg and optional output filename, shared
+  int                     *failed; // shared, counted under the mutex in job 0
+  threads_mutex_t         *mutex;
+  threads_mutex_t          mutex_storage;
+}
+batch_job_t;
+
+static void
+batch_job_work(uint32_t item, void *arg)
+{
+  batch_job_t *j = arg;
+  char infile[PATH_MAX], outfile[PATH_MAX], filename[20][PATH_MAX+10];
+  outfile[0] = 0;
+  if(sscanf(j->line[item], "%4095s %4095s", infile, outfile) < 1) return;
+  if(!outfile[0])
+  { // default to input file name without .cfg and extension, in the current directory
+    snprintf(outfile, sizeof(outfile), "%s", fs_basename(infile));
+    size_t len = strlen(outfile);
+    if(len > 4 && !strcmp(outfile+len-4, ".cfg")) outfile[len-=4] = 0;
+    char *dot = strrchr(outfile, '.');
+    if(dot && dot != outfile) *dot = 0;
+  }
+  dt_graph_export_t param = *j->param;
+  param.p_cfgfile = infile;
+  param.p_checkpoint = 0; // would be shared by all images
+  for(int i=0;i<param.output_cnt;i++)
+  { // additional outputs get their instance name appended
+    if(i == 0) snprintf(filename[i], sizeof(filename[i]), "%s", outfile);
+    else
+    { // renditions of the same instance are numbered
+      int first = 0;
+      while(first < i && param.output[first].inst != param.output[i].inst) first++;
+      if(first == i) snprintf(filename[i], sizeof(filename[i]), "%s_%"PRItkn, outfile, dt_token_str(param.output[i].inst));
+      else snprintf(filename[i], sizeof(filename[i]), "%s_%"PRItkn"%d", outfile, dt_token_str(param.output[i].inst), i);
+    }
+    param.output[i].p_filename = filename[i];
+    param.output[i].p_audio    = 0;
+  }
+  VkResult res = dt_graph_export(&j->graph, &param);
+  if(res != VK_SUCCESS)
+  {
+    dt_log(s_log_cli|s_log_err, "export of %s failed: %s", infile, qvk_result_to_string(res));
+    threads_mutex_lock(j->mutex);
+    (*j->failed)++;
+    threads_mutex_unlock(j->mutex);
+  }
+  else dt_log(s_log_cli, "[%u] exported %s", item, outfile);
+  dt_graph_reset(&j->graph);
+}
+
+static void
+batch_job_cleanup(void *arg)
+{
+  batch_job_t *j = arg;
+  dt_graph_cleanup(&j->graph);
+}
+
+// export all images in the list file (or stdin if "-"), keeping the device and
+// modules around. the graphs of the worker threads run on separate queues, so
+// reading sources and writing sinks on the cpu overlaps with compute of the others.
+// only every slices-th line starting at slice is exported, for one process per device.
+static int // returns the number of failed exports
+batch_export(
+    const char              *listfile,
+    const dt_graph_export_t *param,
+    int                      slice,
+    int                      slices)
+{
+  FILE *f = strcmp(listfile, "-") ? fopen(listfile, "rb") : stdin;
+  if(!f)
+  {
+    dt_log(s_log_cli|s_log_err, "could not open batch list %s!", listfile);
+    return 1;
+  }
+  int cnt = 0, max = 0, num = 0;
+  char **line = 0, buf[2*PATH_MAX+10];
+  while(fgets(buf, sizeof(buf), f))
+  {
+    char *c = buf;
+    while(*c == ' ' || *c == '\t') c++;
+    if(*c == '#' || *c == '\n' || *c == 0) continue;
+    if(num++ % slices != slice) continue;
+    c[strcspn(c, "\n")] = 0;
+    if(cnt >= max)
+    {
+      max = MAX(256, 2*max);
+      line = realloc(line, sizeof(char*)*max);
+    }
+    line[cnt++] = strdup(c);
+  }
+  if(f != stdin) fclose(f);
+
+  int failed = 0, taskid = -1;
+  batch_job_t *job = calloc(DT_CLI_BATCH_THREADS, sizeof(batch_job_t));
+  threads_mutex_init(&job[0].mutex_storage, 0);
+  for(int k=0;k<DT_CLI_BATCH_THREADS && cnt;k++)
+  {
+    dt_graph_init(&job[k].graph);
+    job[k].graph.queue       = k ? qvk.queue_work1 : qvk.queue_work0;
+    job[k].graph.queue_idx   = k ? qvk.queue_idx_work1 : qvk.queue_idx_work0;
+    job[k].graph.queue_mutex = k ? &qvk.queue_work1_mutex : &qvk.queue_work0_mutex;
+    job[k].param  = param;
+    job[k].line   = line;
+    job[k].failed = &failed;
+    job[k].mutex  = &job[0].mutex_storage;
+    int res = threads_task("export", cnt, taskid, job+k, batch_job_work, batch_job_cleanup);
+    if(res < 0)
+    { // no free task slot or all items picked already, go on with the workers we have
+      dt_graph_cleanup(&job[k].graph);
+      if(k == 0) failed = cnt;
+      break;
+    }
+    taskid = res;
+  }
+  if(taskid >= 0) threads_wait(taskid);
+  dt_log(s_log_cli, "exported %d/%d images", cnt - failed, cnt);
+  threads_mutex_destroy(&job[0].mutex_storage);
+  free(job);
+  for(int i=0;i<cnt;i++) free(line[i]);
+  free(line);
+  return failed;
+}
+
+// fork one batch export process per device id in the comma separated list.
+// vulkan and the thread pool are only initialised in the children, each
+// exports its own slice of the list. returns 0 in the parent once all children
+// are done, or 1 in the children with gpu_id and the slice set.
+static int
+batch_fork_devices(
+    const char *devices,
+    int        *gpu_id,
+    int        *slice,
+    int        *slices,
+    int        *failed)
+{
+  int id[DT_CLI_MAX_DEVICES], cnt = 0;
+  for(const char *c=devices;*c && cnt<DT_CLI_MAX_DEVICES;)
+  {
+    id[cnt++] = atol(c);
+    c += strcspn(c, ",");
+    if(*c == ',') c++;
+  }
+  pid_t pid[DT_CLI_MAX_DEVICES];
+  for(int k=0;k<cnt;k++)
+  {
+    pid[k] = fork();
+    if(pid[k] == 0)
+    {
+      *gpu_id = id[k];
+      *slice  = k;
+      *slices = cnt;
+      return 1;
+    }
+    if(pid[k] < 0) dt_log(s_log_cli|s_log_err, "could not start export process for device %d!", id[k]);
+  }
+  *failed = 0;
+  for(int k=0;k<cnt;k++)
+  {
+    int status = 0;
+    if(pid[k] < 0 || waitpid(pid[k], &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status))
+      (*failed)++;
+  }
+  dt_log(s_log_cli, "%d/%d device processes succeeded", cnt - *failed, cnt);
+  return 0;
+}
 
 int main(int argc, char *argv[])
 {
@@ -20,15 +203,23 @@ int main(int argc, char *argv[])
   // init global things, log and pipeline:
   dt_log_init(s_log_cli);
   dt_log_init_arg(argc, argv);
+  const double init_beg = dt_time();
   dt_pipe_global_init();
-  threads_global_init();
+  const double init_ms = 1000.0*(dt_time() - init_beg);
 
   int dump_nodes = 0;
   int output_cnt = 0;
   int config_start = 0; // start of arguments which are interpreted as additional config lines
   dt_graph_export_t param = {0};
   const char *gpu_name = 0;
-  int gpu_id = -1;
+  const char *batch = 0;
+  const char *profile = 0;
+  const char *batch_devices = 0;
+  const char *serve = 0;
+  const char *bake_lut = 0;
+  int autotune = 0;
+  int bench = 0, iterations = 10;
+  int gpu_id = -1, slice = 0, slices = 1;
   for(int i=0;i<argc;i++)
   {
     if(!strcmp(argv[i], "-g") && i < argc-1)
@@ -47,6 +238,12 @@ int main(int argc, char *argv[])
       param.output[output_cnt].p_audio = argv[++i];
     else if(!strcmp(argv[i], "--last-frame-only"))
       param.last_frame_only = 1;
+    else if(!strcmp(argv[i], "--frames") && i < argc-1)
+      sscanf(argv[++i], "%d:%d", &param.frame_beg, &param.frame_end);
+    else if(!strcmp(argv[i], "--checkpoint") && i < argc-1)
+      param.p_checkpoint = argv[++i];
+    else if(!strcmp(argv[i], "--checkpoint-every") && i < argc-1)
+      param.checkpoint_every = atol(argv[++i]);
     else if(!strcmp(argv[i], "--dump-modules"))
       param.dump_modules = 1;
     else if(!strcmp(argv[i], "--dump-nodes"))
@@ -57,44 +254,187 @@ int main(int argc, char *argv[])
       gpu_name = argv[++i];
     else if(!strcmp(argv[i], "--device-id") && i < argc-1)
       gpu_id = atol(argv[++i]);
+    else if(!strcmp(argv[i], "--batch") && i < argc-1)
+      batch = argv[++i];
+    else if(!strcmp(argv[i], "--batch-devices") && i < argc-1)
+      batch_devices = argv[++i];
+    else if(!strcmp(argv[i], "--serve") && i < argc-1)
+      serve = argv[++i];
+    else if(!strcmp(argv[i], "--profile") && i < argc-1)
+      profile = argv[++i];
+    else if(!strcmp(argv[i], "--bake-lut") && i < argc-3)
+    {
+      for(int k=0;k<2;k++)
+      { // module:instance
+        char buf[20] = {0};
+        snprintf(buf, sizeof(buf), "%s", argv[++i]);
+        char *inst = strchr(buf, ':');
+        if(inst) *inst++ = 0;
+        param.lut_chain[2*k+0] = dt_token(buf);
+        param.lut_chain[2*k+1] = dt_token(inst ? inst : "main");
+      }
+      bake_lut = argv[++i];
+    }
+    else if(!strcmp(argv[i], "--bench") && i < argc-1)
+      { bench = 1; param.p_cfgfile = argv[++i]; }
+    else if(!strcmp(argv[i], "--iterations") && i < argc-1)
+      iterations = atol(argv[++i]);
+    else if(!strcmp(argv[i], "--autotune"))
+      autotune = 1;
     else if(!strcmp(argv[i], "--config"))
     { config_start = i+1; break; }
   }
   param.output_cnt = MAX(1, output_cnt);
 
+  if(batch && batch_devices)
+  { // fork before anything starts threads or touches the device
+    if(!strcmp(batch, "-"))
+    {
+      dt_log(s_log_cli|s_log_err, "--batch-devices needs a list file, the processes can't share stdin!");
+      exit(1);
+    }
+    fflush(0);
+    int failed = 0;
+    if(!batch_fork_devices(batch_devices, &gpu_id, &slice, &slices, &failed))
+      exit(failed ? 1 : 0);
+    gpu_name = 0;
+  }
+
+  threads_global_init();
+  dt_trace_init();
   if(qvk_init(gpu_name, gpu_id)) exit(1);
 
-  if(!param.p_cfgfile)
+  if(!param.p_cfgfile && !batch && !serve)
   {
     fprintf(stderr, "usage: vkdt-cli -g <graph.cfg>\n"
     "    [-d verbosity]                set log verbosity (none,qvk,pipe,gui,db,cli,snd,perf,mem,err,all)\n"
     "    [--last-frame-only]           only write the last frame, not the intermediates\n"
+    "    [--frames <a>:<b>]            only write frames a to b-1 of an animation\n"
+    "    [--checkpoint <file>]         save the feedback state of an animation after the last frame and\n"
+    "                                  continue after the frame stored in it if it exists (not with --batch)\n"
+    "    [--checkpoint-every <n>]      also save the checkpoint every n frames\n"
     "    [--dump-modules|--dump-nodes] write graphvis dot files to stdout\n"
     "    [--quality <0-100>]           jpg output quality\n"
     "    [--width <x>]                 max output width\n"
     "    [--height <y>]                max output height\n"
     "    [--filename <f>]              output filename (without extension or frame number)\n"
-    "    [--format <fm>]               output format (o-jpg, o-bc1, o-pfm, ..)\n"
+    "    [--format <fm>]               output format (o-jpg, o-bc1, o-pfm, o-exr, o-jxl, o-avif, ..)\n"
     "    [--audio <file>]              dump output audio stream to this file, if any\n"
     "    [--output <inst>]             name the instance of the output to write (can use multiple)\n"
     "                                  this resets output specific options: quality, width, height, audio\n"
+    "                                  naming one instance again adds a rendition from the same run\n"
     "    [--device <gpu name>]         explicitly use this gpu if you have multiple\n"
     "    [--device-id <gpu id>]        explicitly use this gpu id if you have multiple\n"
+    "    [--batch <list>]              export all files in the list (- for stdin) instead of -g, one per line,\n"
+    "                                  optionally followed by the output filename (default: input basename)\n"
+    "    [--batch-devices <id,id,..>]  with --batch: one export process per gpu id, each takes every n-th line\n"
+    "    [--serve <socket>]            run as export server, one job line per connection on this unix socket\n"
+    "    [--profile <out.json>]        write gpu and cpu timings as chrome trace events (not with --batch)\n"
+    "    [--bake-lut <m:i> <m:i> <f>]  bake the pointwise modules from the first to the last module:instance\n"
+    "                                  of the -g graph into f.lut. --batch and --serve exports replace them\n"
+    "                                  by a lookup into it\n"
+    "    [--autotune]                  time the tunable kernels of the -g graph with different work group\n"
+    "                                  sizes and remember the fastest for this device\n"
+    "    [--bench <graph.cfg>]         export the graph a couple of times and print the time spent per stage\n"
+    "    [--iterations <n>]            number of exports for --bench (default 10)\n"
     "    [--config]                    everything after this will be interpreted as additional cfg lines\n"
         );
     threads_global_cleanup();
+    dt_pipe_shader_cleanup();
+    dt_pipe_staging_cleanup();
     qvk_cleanup();
     exit(1);
   }
 
+  param.extra_param_cnt = config_start ? argc - config_start : 0;
+  param.p_extra_param   = argv + config_start;
+
+  if(bake_lut)
+  { // bake the chain once on the -g graph, the exports below only look it up
+    dt_graph_export_t bake = param;
+    bake.p_lut      = bake_lut;
+    bake.lut_bake   = 1;
+    bake.output_cnt = 1;
+    bake.output[0]  = (dt_graph_export_output_t){ .inst = dt_token("main"), .p_filename = bake_lut };
+    dt_graph_t graph;
+    dt_graph_init(&graph);
+    VkResult res = param.p_cfgfile ? dt_graph_export(&graph, &bake) : VK_INCOMPLETE;
+    dt_graph_cleanup(&graph);
+    if(res != VK_SUCCESS) dt_log(s_log_cli|s_log_err, "could not bake %s.lut from the -g graph!", bake_lut);
+    else dt_log(s_log_cli, "baked %s.lut", bake_lut);
+    param.p_lut = bake_lut;
+    if(res != VK_SUCCESS || (!batch && !serve))
+    {
+      threads_global_cleanup();
+      dt_pipe_shader_cleanup();
+      dt_pipe_staging_cleanup();
+      qvk_cleanup();
+      exit(res != VK_SUCCESS);
+    }
+  }
+
+  if(autotune)
+  { // before the exports below, so they compile their pipelines with the tuned sizes
+    int failed = param.p_cfgfile ? dt_cli_autotune(&param) : 1;
+    if(!param.p_cfgfile) dt_log(s_log_cli|s_log_err, "--autotune needs a graph to run, pass it with -g!");
+    if(failed || (!batch && !serve))
+    {
+      threads_global_cleanup();
+      dt_pipe_shader_cleanup();
+      dt_pipe_staging_cleanup();
+      qvk_cleanup();
+      exit(failed ? 1 : 0);
+    }
+  }
+
+  if(bench)
+  {
+    int failed = dt_cli_bench(&param, iterations, init_ms);
+    threads_global_cleanup();
+    dt_pipe_shader_cleanup();
+    dt_pipe_staging_cleanup();
+    qvk_cleanup();
+    exit(failed ? 1 : 0);
+  }
+
+  if(serve)
+  {
+    int failed = dt_cli_serve(serve, &param);
+    threads_global_cleanup();
+    dt_pipe_shader_cleanup();
+    dt_pipe_staging_cleanup();
+    qvk_cleanup();
+    exit(failed ? 1 : 0);
+  }
+
+  if(batch)
+  {
+    int failed = batch_export(batch, &param, slice, slices);
+    threads_global_cleanup();
+    dt_pipe_shader_cleanup();
+    dt_pipe_staging_cleanup();
+    qvk_cleanup();
+    exit(failed ? 1 : 0);
+  }
+
   dt_graph_t graph;
   dt_graph_init(&graph);
+  graph.pipeline_stats = (dt_log_global.mask & s_log_perf) != 0;
 
-  param.extra_param_cnt = config_start ? argc - config_start : 0;
-  param.p_extra_param   = argv + config_start;
+  if(profile && !(graph.profile = fopen(profile, "wb")))
+    dt_log(s_log_cli|s_log_err, "could not open %s for writing!", profile);
+  dt_graph_profile_begin(&graph);
 
   VkResult res = dt_graph_export(&graph, &param);
 
+  if(graph.profile)
+  {
+    FILE *f = graph.profile;
+    dt_graph_profile_end(&graph);
+    fclose(f);
+    dt_log(s_log_cli, "wrote profile to %s", profile);
+  }
+
   if(param.output[0].p_audio)
   {
     dt_log(s_log_cli, "wrote audio channel to %s. to combine the streams, use something like", param.output[0].p_audio);
@@ -111,6 +451,8 @@ int main(int argc, char *argv[])
 
   dt_graph_cleanup(&graph);
   threads_global_cleanup();
+  dt_pipe_shader_cleanup();
+  dt_pipe_staging_cleanup();
   qvk_cleanup();
   exit(res);
 }
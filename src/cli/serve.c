@@ -0,0 +1,228 @@
+#include "cli/serve.h"
+#include "qvk/qvk.h"
+#include "pipe/graph.h"
+#include "pipe/graph-export.h"
+#include "pipe/modules/api.h"
+#include "core/log.h"
+#include "core/fs.h"
+#include "core/core.h"
+
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// long running export server: jobs come in over a unix domain socket, one
+// line per connection, and are answered with one line. every worker keeps
+// its graph (and thus the compiled pipelines and modules) warm between jobs
+// and submits to a work queue of its own.
+
+#define DT_SERVE_WORKERS  2   // one per work queue
+#define DT_SERVE_PENDING 64   // connections waiting for a worker
+#define DT_SERVE_WORDS   64   // max whitespace separated words per job line
+
+typedef struct dt_serve_t
+{
+  const dt_graph_export_t *param; // template from the command line
+  pthread_mutex_t mutex;
+  pthread_cond_t  cond;
+  int             fd[DT_SERVE_PENDING]; // ring buffer of accepted connections
+  int             beg, cnt;
+  int             quit;
+}
+dt_serve_t;
+
+typedef struct dt_serve_worker_t
+{
+  dt_serve_t *serve;
+  dt_graph_t  graph;
+  pthread_t   thread;
+}
+dt_serve_worker_t;
+
+static volatile sig_atomic_t dt_serve_quit = 0;
+static void dt_serve_signal(int sig) { dt_serve_quit = 1; }
+
+static void
+dt_serve_reply(int fd, const char *msg)
+{
+  size_t len = strlen(msg);
+  while(len)
+  {
+    ssize_t w = write(fd, msg, len);
+    if(w <= 0) break;
+    msg += w; len -= w;
+  }
+}
+
+// job line: <graph.cfg> [<output filename>] [extra cfg lines..]
+static void
+dt_serve_job(dt_serve_worker_t *w, int fd)
+{
+  char line[4*PATH_MAX], msg[2*PATH_MAX];
+  size_t len = 0;
+  while(len < sizeof(line)-1)
+  {
+    ssize_t r = read(fd, line+len, sizeof(line)-1-len);
+    if(r <= 0) break;
+    len += r;
+    if(memchr(line+len-r, '\n', r)) break;
+  }
+  line[len] = 0;
+  line[strcspn(line, "\r\n")] = 0;
+
+  char *word[DT_SERVE_WORDS];
+  int cnt = 0;
+  for(char *tok=strtok(line, " \t");tok&&cnt<DT_SERVE_WORDS;tok=strtok(0, " \t"))
+    word[cnt++] = tok;
+  if(!cnt)
+  {
+    dt_serve_reply(fd, "err empty job\n");
+    return;
+  }
+  // words containing a colon are cfg lines, the first other word after the cfg is the output
+  char outfile[PATH_MAX] = {0}, filename[20][PATH_MAX+10];
+  char *extra[2*DT_SERVE_WORDS];
+  dt_graph_export_t param = *w->serve->param;
+  int extra_cnt = 0;
+  for(int i=0;i<param.extra_param_cnt && extra_cnt<DT_SERVE_WORDS;i++)
+    extra[extra_cnt++] = param.p_extra_param[i];
+  for(int i=1;i<cnt;i++)
+  {
+    if(strchr(word[i], ':')) extra[extra_cnt++] = word[i];
+    else if(!outfile[0]) snprintf(outfile, sizeof(outfile), "%s", word[i]);
+  }
+  if(!outfile[0])
+  { // default to input file name without .cfg and extension
+    snprintf(outfile, sizeof(outfile), "%s", fs_basename(word[0]));
+    size_t len = strlen(outfile);
+    if(len > 4 && !strcmp(outfile+len-4, ".cfg")) outfile[len-=4] = 0;
+    char *dot = strrchr(outfile, '.');
+    if(dot && dot != outfile) *dot = 0;
+  }
+  param.p_cfgfile       = word[0];
+  param.extra_param_cnt = extra_cnt;
+  param.p_extra_param   = extra;
+  for(int i=0;i<param.output_cnt;i++)
+  { // additional outputs get their instance name appended
+    if(i == 0) snprintf(filename[i], sizeof(filename[i]), "%s", outfile);
+    else snprintf(filename[i], sizeof(filename[i]), "%s_%"PRItkn, outfile, dt_token_str(param.output[i].inst));
+    param.output[i].p_filename = filename[i];
+    param.output[i].p_audio    = 0;
+  }
+  double beg = dt_time();
+  VkResult res = dt_graph_export(&w->graph, &param);
+  dt_graph_reset(&w->graph);
+  if(res != VK_SUCCESS)
+  {
+    dt_log(s_log_cli|s_log_err, "export of %s failed: %s", word[0], qvk_result_to_string(res));
+    snprintf(msg, sizeof(msg), "err %s\n", qvk_result_to_string(res));
+  }
+  else
+  {
+    dt_log(s_log_cli, "exported %s in %.3fs", outfile, dt_time()-beg);
+    snprintf(msg, sizeof(msg), "ok %s\n", outfile);
+  }
+  dt_serve_reply(fd, msg);
+}
+
+static void*
+dt_serve_work(void *arg)
+{
+  dt_serve_worker_t *w = arg;
+  dt_serve_t *s = w->serve;
+  while(1)
+  {
+    pthread_mutex_lock(&s->mutex);
+    while(!s->cnt && !s->quit) pthread_cond_wait(&s->cond, &s->mutex);
+    if(!s->cnt)
+    {
+      pthread_mutex_unlock(&s->mutex);
+      break;
+    }
+    const int fd = s->fd[s->beg];
+    s->beg = (s->beg + 1) % DT_SERVE_PENDING;
+    s->cnt--;
+    pthread_mutex_unlock(&s->mutex);
+    dt_serve_job(w, fd);
+    close(fd);
+  }
+  return 0;
+}
+
+int
+dt_cli_serve(
+    const char              *sockname,
+    const dt_graph_export_t *param)
+{
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+  if(strlen(sockname) >= sizeof(addr.sun_path))
+  {
+    dt_log(s_log_cli|s_log_err, "socket name %s is too long!", sockname);
+    return 1;
+  }
+  snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", sockname);
+  int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  unlink(sockname);
+  if(sock < 0 || bind(sock, (struct sockaddr *)&addr, sizeof(addr)) || listen(sock, DT_SERVE_PENDING))
+  {
+    dt_log(s_log_cli|s_log_err, "could not listen on %s!", sockname);
+    if(sock >= 0) close(sock);
+    return 1;
+  }
+  struct sigaction sa = { .sa_handler = dt_serve_signal };
+  sigaction(SIGINT,  &sa, 0); // no SA_RESTART, so accept() returns
+  sigaction(SIGTERM, &sa, 0);
+  signal(SIGPIPE, SIG_IGN);   // clients may hang up before the reply
+
+  dt_serve_t serve = { .param = param };
+  pthread_mutex_init(&serve.mutex, 0);
+  pthread_cond_init(&serve.cond, 0);
+  dt_serve_worker_t worker[DT_SERVE_WORKERS] = {{0}};
+  for(int k=0;k<DT_SERVE_WORKERS;k++)
+  {
+    worker[k].serve = &serve;
+    dt_graph_init(&worker[k].graph);
+    worker[k].graph.queue       = k ? qvk.queue_work1 : qvk.queue_work0;
+    worker[k].graph.queue_idx   = k ? qvk.queue_idx_work1 : qvk.queue_idx_work0;
+    worker[k].graph.queue_mutex = k ? &qvk.queue_work1_mutex : &qvk.queue_work0_mutex;
+    pthread_create(&worker[k].thread, 0, dt_serve_work, worker+k);
+  }
+  dt_log(s_log_cli, "serving on %s", sockname);
+
+  while(!dt_serve_quit)
+  {
+    int fd = accept(sock, 0, 0);
+    if(fd < 0) continue;
+    pthread_mutex_lock(&serve.mutex);
+    if(serve.cnt == DT_SERVE_PENDING)
+    {
+      pthread_mutex_unlock(&serve.mutex);
+      dt_serve_reply(fd, "err busy\n");
+      close(fd);
+      continue;
+    }
+    serve.fd[(serve.beg + serve.cnt++) % DT_SERVE_PENDING] = fd;
+    pthread_cond_signal(&serve.cond);
+    pthread_mutex_unlock(&serve.mutex);
+  }
+
+  // finish the pending jobs, then shut down
+  pthread_mutex_lock(&serve.mutex);
+  serve.quit = 1;
+  pthread_cond_broadcast(&serve.cond);
+  pthread_mutex_unlock(&serve.mutex);
+  for(int k=0;k<DT_SERVE_WORKERS;k++)
+  {
+    pthread_join(worker[k].thread, 0);
+    dt_graph_cleanup(&worker[k].graph);
+  }
+  pthread_cond_destroy(&serve.cond);
+  pthread_mutex_destroy(&serve.mutex);
+  close(sock);
+  unlink(sockname);
+  dt_log(s_log_cli, "server shut down");
+  return 0;
+}
@@ -0,0 +1,10 @@
+#pragma once
+#include "pipe/graph-export.h"
+
+// run as export server on the unix domain socket sockname until SIGINT or
+// SIGTERM. every connection sends one job line
+//   <graph.cfg> [<output filename>] [extra cfg lines..]
+// and gets one line back, "ok <filename>" or "err <reason>". the options in
+// param are the template for every job. returns non-zero if the socket could
+// not be set up.
+int dt_cli_serve(const char *sockname, const dt_graph_export_t *param);
@@ -9,29 +9,69 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/sendfile.h>
+#include <sys/sysmacros.h>
 #include <errno.h>
 
+// copy without moving the data through user space. copy_file_range may
+// reflink or copy server side if both files live on the same file system,
+// across file systems this falls back to sendfile.
 static inline int // returns zero on success
 fs_copy(
     const char *dst,
     const char *src)
 {
-  ssize_t ret;
+  ssize_t ret = 0;
   struct stat sb;
   loff_t len = -1;
-  int fd0 = open(src, O_RDONLY), fd1 = -1;
+  int fd0 = open(src, O_RDONLY), fd1 = -1, fallback = 0;
   if(fd0 == -1 || fstat(fd0, &sb) == -1) goto copy_error;
   len = sb.st_size;
   if(sb.st_mode & S_IFDIR) { len = 0; goto copy_error; } // don't copy directories
   if(-1 == (fd1 = open(dst, O_CREAT | O_WRONLY | O_TRUNC, 0644))) goto copy_error;
-  do {
-    ret = sendfile(fd1, fd0, 0, len); // works on linux >= 2.6.33, else fd1 would need to be a socket
-  } while((len-=ret) > 0 && ret > 0);
+  posix_fadvise(fd0, 0, 0, POSIX_FADV_SEQUENTIAL);
+  while(len > 0)
+  { // both continue at the current file offsets, so switching over half way is fine
+    if(!fallback) ret = copy_file_range(fd0, 0, fd1, 0, len, 0);
+    if(!fallback && ret == -1 && (errno == EXDEV || errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP))
+    {
+      fallback = 1;
+      continue;
+    }
+    if(fallback) ret = sendfile(fd1, fd0, 0, len); // works on linux >= 2.6.33, else fd1 would need to be a socket
+    if(ret <= 0) break;
+    len -= ret;
+  }
 copy_error:
   // if(len != 0) fprintf(stderr, "[fs_copy] %s\n", strerror(errno));
   if(fd0 >= 0) close(fd0);
-  if(fd0 >= 0) close(fd1);
-  return len;
+  if(fd1 >= 0) close(fd1);
+  return len != 0;
+}
+
+// number of files to copy at the same time to keep the device holding path
+// busy: flash (cards, ssd) needs a few requests in flight for full speed,
+// spinning disks only lose time seeking between them.
+static inline int
+fs_copy_streams(
+    const char *path)
+{
+  struct stat sb;
+  if(stat(path, &sb)) return 1;
+  char fn[100];
+  snprintf(fn, sizeof(fn), "/sys/dev/block/%u:%u/queue/rotational", major(sb.st_dev), minor(sb.st_dev));
+  FILE *f = fopen(fn, "rb");
+  if(!f)
+  { // partitions find the queue on their parent device
+    snprintf(fn, sizeof(fn), "/sys/dev/block/%u:%u/../queue/rotational", major(sb.st_dev), minor(sb.st_dev));
+    f = fopen(fn, "rb");
+  }
+  int rotational = 0;
+  if(f)
+  {
+    if(fscanf(f, "%d", &rotational) != 1) rotational = 0;
+    fclose(f);
+  }
+  return rotational ? 1 : 4;
 }
 
 static inline int // returns zero on success
@@ -80,6 +120,16 @@ fs_homedir(
   snprintf(basedir, maxlen, "%s/.config/vkdt", getenv("HOME"));
 }
 
+static inline void  // ${XDG_CACHE_HOME}/vkdt or ${HOME}/.cache/vkdt
+fs_cachedir(
+    char *cachedir, // output will be copied here
+    size_t maxlen)  // allocation size
+{
+  const char *xdg = getenv("XDG_CACHE_HOME");
+  if(xdg && xdg[0]) snprintf(cachedir, maxlen, "%s/vkdt", xdg);
+  else snprintf(cachedir, maxlen, "%s/.cache/vkdt", getenv("HOME"));
+}
+
 static inline void  // returns the directory where the actual binary (not the symlink) resides
 fs_basedir(
     char *basedir,  // output will be copied here
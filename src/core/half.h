@@ -1,6 +1,13 @@
 #pragma once
 #include <stdint.h>
-// #include <xmmintrin.h>
+#include <stddef.h>
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define DT_HALF_F16C
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define DT_HALF_NEON
+#include <arm_neon.h>
+#endif
 
 // float->half variants.
 // by Fabian "ryg" Giesen.
@@ -105,6 +112,60 @@ static inline uint16_t float_to_half(float fi)
   return o.u;
 }
 
+// batch conversion of whole buffers. these use f16c (with runtime detection)
+// or neon if available, which round to nearest even, and fall back to the
+// scalar versions above otherwise.
+#ifdef DT_HALF_F16C
+__attribute__((target("avx,f16c")))
+static inline void _float_to_half_f16c(const float *in, uint16_t *out, size_t n)
+{
+  const size_t rem = n & 7, end = n - rem;
+  for(size_t i=0;i<end;i+=8)
+    _mm_storeu_si128((__m128i *)(out+i), _mm256_cvtps_ph(_mm256_loadu_ps(in+i), _MM_FROUND_TO_NEAREST_INT));
+  for(size_t i=0;i<rem;i++) out[end+i] = _cvtss_sh(in[end+i], _MM_FROUND_TO_NEAREST_INT);
+}
+
+__attribute__((target("avx,f16c")))
+static inline void _half_to_float_f16c(const uint16_t *in, float *out, size_t n)
+{
+  const size_t rem = n & 7, end = n - rem;
+  for(size_t i=0;i<end;i+=8)
+    _mm256_storeu_ps(out+i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(in+i))));
+  for(size_t i=0;i<rem;i++) out[end+i] = _cvtsh_ss(in[end+i]);
+}
+
+static inline int _half_have_f16c()
+{
+  static int have = -1;
+  if(have < 0) have = __builtin_cpu_supports("avx") && __builtin_cpu_supports("f16c");
+  return have;
+}
+#endif
+
+static inline void float_to_half_n(const float *in, uint16_t *out, size_t n)
+{
+#if defined(DT_HALF_F16C)
+  if(_half_have_f16c()) { _float_to_half_f16c(in, out, n); return; }
+#elif defined(DT_HALF_NEON)
+  size_t i = 0;
+  for(;i+4<=n;i+=4) vst1_u16(out+i, vreinterpret_u16_f16(vcvt_f16_f32(vld1q_f32(in+i))));
+  in += i; out += i; n -= i;
+#endif
+  for(size_t i=0;i<n;i++) out[i] = float_to_half(in[i]);
+}
+
+static inline void half_to_float_n(const uint16_t *in, float *out, size_t n)
+{
+#if defined(DT_HALF_F16C)
+  if(_half_have_f16c()) { _half_to_float_f16c(in, out, n); return; }
+#elif defined(DT_HALF_NEON)
+  size_t i = 0;
+  for(;i+4<=n;i+=4) vst1q_f32(out+i, vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(in+i))));
+  in += i; out += i; n -= i;
+#endif
+  for(size_t i=0;i<n;i++) out[i] = half_to_float(in[i]);
+}
+
 #if 0
 // round-half-up (same as ISPC)
 static inline __m128i float_to_half_sse(__m128 f)
@@ -1,5 +1,282 @@
 #include "core/log.h"
 
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <time.h>
+
 // provide storage for logger. this needs to be included into
 // all binary builds once (not into the libraries)
 dt_log_t dt_log_global;
+
+// the messages go through a bounded multi producer single consumer ring
+// (after dmitry vyukov): a producer claims a position by advancing tail and
+// publishes its slot by setting the sequence number to position+1. the writer
+// consumes in order and hands the slot back for the next lap. when there is
+// nothing to write it blocks on a condition variable, and producers only take
+// the lock to wake it up if it announced that it sleeps.
+#define DT_LOG_SLOTS     512
+#define DT_LOG_SLOT_SIZE 1024
+#define DT_LOG_SITES     256  // entries of the rate limiter
+#define DT_LOG_RATE      1000 // messages per call site and second
+
+typedef struct dt_log_slot_t
+{
+  atomic_uint_fast64_t seq;
+  uint32_t             len;
+  char                 buf[DT_LOG_SLOT_SIZE];
+}
+dt_log_slot_t;
+
+typedef struct dt_log_site_t
+{ // all access is atomic and relaxed, the counts don't need to be exact
+  const char *format; // identifies the call site
+  uint32_t    sec;    // the second cnt is about
+  uint32_t    cnt;    // messages in that second
+  uint32_t    muted;  // messages dropped since the site was last written
+}
+dt_log_site_t;
+
+typedef enum dt_log_state_t
+{
+  s_log_state_off      = 0, // no writer thread (yet, or in a forked child)
+  s_log_state_starting = 1,
+  s_log_state_running  = 2,
+  s_log_state_sync     = 3, // the thread could not be started
+}
+dt_log_state_t;
+
+static struct
+{
+  dt_log_slot_t        slot[DT_LOG_SLOTS];
+  atomic_uint_fast64_t tail;  // next position to claim
+  uint64_t             head;  // next position to write, guarded by out
+  dt_log_site_t        site[DT_LOG_SITES];
+  atomic_int           state; // dt_log_state_t
+  atomic_int           stop;
+  atomic_int           sleeping; // the writer waits on wake
+  pthread_t            writer;
+  pthread_mutex_t      out;   // serialises everything written to stdout
+  pthread_mutex_t      lock;  // guards the wait on wake
+  pthread_cond_t       wake;
+}
+dt_log_q = {
+  .out  = PTHREAD_MUTEX_INITIALIZER,
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+  .wake = PTHREAD_COND_INITIALIZER,
+};
+
+static int // write out the published messages in order, return how many
+dt_log_drain_locked()
+{
+  char buf[16384];
+  size_t len = 0;
+  int cnt = 0;
+  while(1)
+  {
+    dt_log_slot_t *s = dt_log_q.slot + dt_log_q.head % DT_LOG_SLOTS;
+    if(atomic_load_explicit(&s->seq, memory_order_acquire) != dt_log_q.head + 1) break;
+    if(len + s->len > sizeof(buf))
+    {
+      fwrite(buf, 1, len, stdout);
+      len = 0;
+    }
+    memcpy(buf + len, s->buf, s->len);
+    len += s->len;
+    atomic_store_explicit(&s->seq, dt_log_q.head + DT_LOG_SLOTS, memory_order_release);
+    dt_log_q.head++;
+    cnt++;
+  }
+  if(len) fwrite(buf, 1, len, stdout);
+  if(cnt) fflush(stdout);
+  return cnt;
+}
+
+void dt_log_flush()
+{
+  pthread_mutex_lock(&dt_log_q.out);
+  dt_log_drain_locked();
+  pthread_mutex_unlock(&dt_log_q.out);
+}
+
+static int // is the next slot published?
+dt_log_pending()
+{
+  pthread_mutex_lock(&dt_log_q.out);
+  const dt_log_slot_t *s = dt_log_q.slot + dt_log_q.head % DT_LOG_SLOTS;
+  const int ret = atomic_load(&s->seq) == dt_log_q.head + 1;
+  pthread_mutex_unlock(&dt_log_q.out);
+  return ret;
+}
+
+static void
+dt_log_wake()
+{
+  pthread_mutex_lock(&dt_log_q.lock);
+  pthread_cond_signal(&dt_log_q.wake);
+  pthread_mutex_unlock(&dt_log_q.lock);
+}
+
+static void *
+dt_log_work(void *arg)
+{
+  while(!atomic_load(&dt_log_q.stop))
+  {
+    pthread_mutex_lock(&dt_log_q.out);
+    const int cnt = dt_log_drain_locked();
+    pthread_mutex_unlock(&dt_log_q.out);
+    if(cnt) continue;
+    // announce the sleep before looking again, a producer publishing now
+    // either sees the flag or its slot is seen here (both sides are seq_cst)
+    pthread_mutex_lock(&dt_log_q.lock);
+    atomic_store(&dt_log_q.sleeping, 1);
+    if(!atomic_load(&dt_log_q.stop) && !dt_log_pending())
+      pthread_cond_wait(&dt_log_q.wake, &dt_log_q.lock);
+    atomic_store(&dt_log_q.sleeping, 0);
+    pthread_mutex_unlock(&dt_log_q.lock);
+  }
+  dt_log_flush();
+  return 0;
+}
+
+static void
+dt_log_stop()
+{ // at exit: write the rest
+  int running = s_log_state_running;
+  if(!atomic_compare_exchange_strong(&dt_log_q.state, &running, s_log_state_sync)) return;
+  atomic_store(&dt_log_q.stop, 1);
+  dt_log_wake();
+  pthread_join(dt_log_q.writer, 0);
+}
+
+static void
+dt_log_fork_child()
+{ // the writer thread didn't come with us, start over when the child logs
+  pthread_mutex_init(&dt_log_q.out, 0);
+  pthread_mutex_init(&dt_log_q.lock, 0);
+  pthread_cond_init(&dt_log_q.wake, 0);
+  atomic_store(&dt_log_q.sleeping, 0);
+  atomic_store(&dt_log_q.state, s_log_state_off);
+}
+
+static void
+dt_log_start()
+{
+  int off = s_log_state_off;
+  if(!atomic_compare_exchange_strong(&dt_log_q.state, &off, s_log_state_starting)) return;
+  static int registered = 0;
+  if(!registered)
+  {
+    atexit(dt_log_stop);
+    pthread_atfork(0, 0, dt_log_fork_child);
+    registered = 1;
+  }
+  for(int i=0;i<DT_LOG_SLOTS;i++) atomic_store(&dt_log_q.slot[i].seq, i);
+  atomic_store(&dt_log_q.tail, 0);
+  dt_log_q.head = 0;
+  atomic_store(&dt_log_q.stop, 0);
+  atomic_store(&dt_log_q.state,
+      pthread_create(&dt_log_q.writer, 0, dt_log_work, 0) ? s_log_state_sync : s_log_state_running);
+}
+
+static int // returns non-zero if the call site logs too much. muted counts what was dropped before
+dt_log_rate(const char *format, uint32_t *muted)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+  const uint32_t sec = ts.tv_sec;
+  dt_log_site_t *s = dt_log_q.site + ((uintptr_t)format >> 2) * 2654435761u % DT_LOG_SITES;
+  if(__atomic_load_n(&s->format, __ATOMIC_RELAXED) != format)
+  { // new site, or another one using the same entry
+    __atomic_store_n(&s->format, format, __ATOMIC_RELAXED);
+    __atomic_store_n(&s->cnt,   0, __ATOMIC_RELAXED);
+    __atomic_store_n(&s->muted, 0, __ATOMIC_RELAXED);
+  }
+  if(__atomic_exchange_n(&s->sec, sec, __ATOMIC_RELAXED) != sec)
+    __atomic_store_n(&s->cnt, 0, __ATOMIC_RELAXED);
+  if(__atomic_add_fetch(&s->cnt, 1, __ATOMIC_RELAXED) > DT_LOG_RATE)
+  {
+    __atomic_add_fetch(&s->muted, 1, __ATOMIC_RELAXED);
+    return 1;
+  }
+  *muted = __atomic_exchange_n(&s->muted, 0, __ATOMIC_RELAXED);
+  return 0;
+}
+
+static int // format the message into buf, returns the length it needs
+dt_log_format(char *buf, size_t size, const char *pre, const char *format, va_list args, uint32_t muted)
+{
+  size_t n = snprintf(buf, size, "%s ", pre);
+  n += vsnprintf(buf + (n < size ? n : size), n < size ? size - n : 0, format, args);
+  if(muted) n += snprintf(buf + (n < size ? n : size), n < size ? size - n : 0, " (%u more muted)", muted);
+  if(n + 1 < size) { buf[n] = '\n'; buf[n+1] = 0; }
+  return n + 1;
+}
+
+void dt_log_push(
+    dt_log_mask_t mask,
+    const char   *format,
+    va_list       args)
+{
+  const char *pre[] = {
+    "",
+    "[qvk]",
+    "[pipe]",
+    "[gui]",
+    "[db]",
+    "[cli]",
+    "[snd]",
+    "[perf]",
+    "[mem]",
+    "\e[31m[ERR]\e[0m",
+  };
+  uint32_t index = mask ? 32-__builtin_clz(mask) : 0;
+  if(index >= sizeof(pre)/sizeof(pre[0])) index = 0;
+
+  uint32_t muted = 0; // errors are never muted
+  if(!(mask & s_log_err) && dt_log_rate(format, &muted)) return;
+  if(atomic_load_explicit(&dt_log_q.state, memory_order_acquire) == s_log_state_off) dt_log_start();
+
+  if(!(mask & s_log_err) &&
+     atomic_load_explicit(&dt_log_q.state, memory_order_acquire) == s_log_state_running)
+  { // claim a slot
+    uint64_t pos = atomic_load_explicit(&dt_log_q.tail, memory_order_relaxed);
+    dt_log_slot_t *s = 0;
+    while(1)
+    {
+      s = dt_log_q.slot + pos % DT_LOG_SLOTS;
+      const int64_t diff = (int64_t)(atomic_load_explicit(&s->seq, memory_order_acquire) - pos);
+      if(diff == 0 && atomic_compare_exchange_weak_explicit(&dt_log_q.tail, &pos, pos+1,
+            memory_order_relaxed, memory_order_relaxed)) break;
+      if(diff < 0) { s = 0; break; } // full, the writer is behind
+      if(diff > 0) pos = atomic_load_explicit(&dt_log_q.tail, memory_order_relaxed);
+    }
+    if(s)
+    {
+      va_list copy;
+      va_copy(copy, args);
+      const int len = dt_log_format(s->buf, sizeof(s->buf), pre[index], format, copy, muted);
+      va_end(copy);
+      if(len < (int)sizeof(s->buf))
+      {
+        s->len = len;
+        atomic_store(&s->seq, pos+1);
+        if(atomic_load(&dt_log_q.sleeping)) dt_log_wake();
+        return;
+      }
+      // too long for the slot: publish it empty and write synchronously
+      s->len = 0;
+      atomic_store_explicit(&s->seq, pos+1, memory_order_release);
+    }
+  }
+
+  // errors, long messages, full queue: write the queue and then this right away
+  pthread_mutex_lock(&dt_log_q.out);
+  dt_log_drain_locked();
+  fprintf(stdout, "%s ", pre[index]);
+  vfprintf(stdout, format, args);
+  if(muted) fprintf(stdout, " (%u more muted)", muted);
+  fputc('\n', stdout);
+  fflush(stdout);
+  pthread_mutex_unlock(&dt_log_q.out);
+}
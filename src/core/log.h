@@ -100,34 +100,27 @@ dt_log_init(dt_log_mask_t verbose)
   dt_log_global.mask = verbose;
 }
 
+// queue a message for the writer thread, see log.c. don't call directly.
+void dt_log_push(dt_log_mask_t mask, const char *format, va_list args);
+
+// write out all queued messages now
+void dt_log_flush();
+
+// messages are formatted right here, but written to stdout by a background
+// thread so the caller never waits for the terminal. errors are written
+// synchronously. a call site (i.e. format string) logging more than 1000
+// messages per second is muted for the rest of that second.
 static inline void
 dt_log(
     dt_log_mask_t mask,
     const char *format,
     ...)
 {
-  const char *pre[] = {
-    "",
-    "[qvk]",
-    "[pipe]",
-    "[gui]",
-    "[db]",
-    "[cli]",
-    "[snd]",
-    "[perf]",
-    "[mem]",
-    "\e[31m[ERR]\e[0m",
-  };
-
   if(dt_log_global.mask & mask)
   {
-    char str[2048];
-    uint32_t index = mask ? 32-__builtin_clz(mask) : 0;
-    if(index > sizeof(pre)/sizeof(pre[0])) index = 0;
-    snprintf(str, sizeof(str), "%s %s\n", pre[index], format);
     va_list args;
     va_start(args, format);
-    vfprintf(stdout, str, args);
+    dt_log_push(mask, format, args);
     va_end(args);
   }
 }
@@ -8,6 +8,7 @@
 #include <string.h>
 #include <math.h>
 #include <float.h>
+#include "core/threads.h"
 
 // conjugate gradient solve:
 static inline double
@@ -134,6 +135,214 @@ dt_gauss_newton_cg(
   return resid;
 }
 
+// batched levenberg-marquardt for many small independent problems of the same size
+// (per patch or per camera fits). all arrays are structure of arrays: element
+// i of problem b is at [i*cnt + b], so the loops run over the problems with
+// unit stride and the compiler vectorises them. chunks of DT_SOLVE_BATCH
+// problems go to the thread pool, so core/threads.c needs to be linked.
+#define DT_SOLVE_BATCH 64
+
+typedef void (*dt_solve_batch_callback_t)(
+    const double *p,    // m x cnt parameters
+    double       *f,    // n x cnt function values
+    double       *J,    // m*n x cnt jacobians, df_j/dp_i of problem b at [(j*m+i)*cnt + b]
+    int           m,
+    int           n,
+    int           beg,  // only evaluate problems [beg, end)
+    int           end,
+    int           cnt,
+    void         *data);
+
+typedef struct dt_solve_batch_t
+{
+  dt_solve_batch_callback_t fJ_callback;
+  double       *p;      // m x cnt initial parameters, will be overwritten
+  const double *t;      // n x cnt target values
+  double       *f, *J;  // scratch memory for the callback
+  double       *resid;  // cnt squared residuals of the returned parameters
+  const double *lb;     // m lower bound constraints, shared by all problems
+  const double *ub;     // m upper bound constraints
+  int           m, n, cnt, num_it;
+  void         *data;
+}
+dt_solve_batch_t;
+
+// conjugate gradient for the problems [beg, end), as dt_conj_grad() but for a
+// problem that converged the step size goes to zero instead of returning.
+// this runs at most m steps.
+static inline void
+dt_conj_grad_batch(
+    const double *A,  // m*m x cnt
+    const double *b,  // m x cnt
+    double       *x,  // m x cnt
+    const int     m,
+    const int     beg,
+    const int     end,
+    const int     cnt)
+{
+  const int bc = end - beg;
+  double *r  = alloca(sizeof(double)*m*bc);
+  double *p  = alloca(sizeof(double)*m*bc);
+  double *Ap = alloca(sizeof(double)*m*bc);
+  double *rs0   = alloca(sizeof(double)*bc);
+  double *rsold = alloca(sizeof(double)*bc);
+  double *rsnew = alloca(sizeof(double)*bc);
+  double *alpha = alloca(sizeof(double)*bc);
+  double *live  = alloca(sizeof(double)*bc);
+  for(int j=0;j<m;j++) for(int k=0;k<bc;k++)
+  {
+    x[j*cnt+beg+k] = 0.0;
+    p[j*bc+k] = r[j*bc+k] = b[j*cnt+beg+k];
+  }
+  for(int k=0;k<bc;k++) { rsold[k] = 0.0; live[k] = 1.0; }
+  for(int j=0;j<m;j++) for(int k=0;k<bc;k++) rsold[k] += r[j*bc+k]*r[j*bc+k];
+  for(int k=0;k<bc;k++) rs0[k] = rsold[k];
+
+  for(int i=0;i<m;i++)
+  {
+    memset(Ap, 0, sizeof(double)*m*bc);
+    for(int j=0;j<m;j++) for(int l=0;l<m;l++) for(int k=0;k<bc;k++)
+      Ap[j*bc+k] += A[(m*j+l)*cnt+beg+k] * p[l*bc+k];
+    for(int k=0;k<bc;k++) alpha[k] = 0.0;
+    for(int j=0;j<m;j++) for(int k=0;k<bc;k++) alpha[k] += p[j*bc+k] * Ap[j*bc+k];
+    for(int k=0;k<bc;k++)
+    {
+      const double a = rsold[k] / alpha[k];
+      alpha[k] = (live[k] > 0.0 && a == a) ? a : 0.0;
+      rsnew[k] = 0.0;
+    }
+    for(int j=0;j<m;j++) for(int k=0;k<bc;k++)
+    {
+      x[j*cnt+beg+k] += alpha[k] * p[j*bc+k];
+      r[j*bc+k]      -= alpha[k] * Ap[j*bc+k];
+      rsnew[k]       += r[j*bc+k] * r[j*bc+k];
+    }
+    int done = 1;
+    for(int k=0;k<bc;k++)
+    { // unlike dt_conj_grad() the criterion is relative and the residual may
+      // go up on the way: the systems are small, and near the minimum b is too
+      if(!(alpha[k] != 0.0) || rsnew[k] <= 1e-24 * rs0[k]) live[k] = 0.0;
+      done &= live[k] == 0.0;
+      alpha[k] = live[k] > 0.0 ? rsnew[k] / rsold[k] : 0.0;
+      rsold[k] = live[k] > 0.0 ? rsnew[k] : rsold[k];
+    }
+    if(done) break;
+    for(int j=0;j<m;j++) for(int k=0;k<bc;k++)
+      p[j*bc+k] = r[j*bc+k] + alpha[k] * p[j*bc+k];
+  }
+}
+
+static inline void
+dt_levenberg_marquardt_batch_chunk(const dt_solve_batch_t *s, const int beg, const int end)
+{
+  const int m = s->m, n = s->n, cnt = s->cnt, bc = end - beg;
+  double *A  = alloca(sizeof(double)*m*m*bc); // Jt J at the best p. these are bc wide, not cnt
+  double *An = alloca(sizeof(double)*m*m*bc); // Jt J at the current p, damped for the solve
+  double *b  = alloca(sizeof(double)*m*bc);   // Jt r at the best p
+  double *bn = alloca(sizeof(double)*m*bc);
+  double *d  = alloca(sizeof(double)*m*bc);
+  double *bp = alloca(sizeof(double)*m*bc);   // best p seen so far
+  double *loss = alloca(sizeof(double)*bc);
+  double *best = alloca(sizeof(double)*bc);
+  double *lambda = alloca(sizeof(double)*bc); // damping
+  double *acc    = alloca(sizeof(double)*bc); // the current p is the best so far
+  for(int k=0;k<bc;k++) { best[k] = DBL_MAX; lambda[k] = 1e-3; }
+  for(int it=0;it<=s->num_it;it++)
+  {
+    s->fJ_callback(s->p, s->f, s->J, m, n, beg, end, cnt, s->data);
+    for(int k=0;k<bc;k++) loss[k] = 0.0;
+    for(int j=0;j<n;j++) for(int k=0;k<bc;k++)
+    {
+      const double r = s->t[j*cnt+beg+k] - s->f[j*cnt+beg+k];
+      loss[k] += r*r;
+    }
+    for(int k=0;k<bc;k++)
+    { // accept the step and trust the linearisation more, or go back and damp more
+      acc[k]    = loss[k] < best[k] ? 1.0 : 0.0;
+      best[k]   = acc[k] > 0.0 ? loss[k] : best[k];
+      lambda[k] = acc[k] > 0.0 ? fmax(lambda[k] * (1.0/3.0), 1e-12) : fmin(lambda[k] * 4.0, 1e12);
+    }
+    for(int i=0;i<m;i++) for(int k=0;k<bc;k++)
+      bp[i*bc+k] = acc[k] > 0.0 ? s->p[i*cnt+beg+k] : bp[i*bc+k];
+    if(it == s->num_it) break; // the last evaluation only checks the final step
+
+    // b = Jt r and A = Jt J, as in dt_gauss_newton_cg_step(), kept where accepted
+    memset(bn, 0, sizeof(double)*m*bc);
+    memset(An, 0, sizeof(double)*m*m*bc);
+    for(int j=0;j<n;j++) for(int i=0;i<m;i++) for(int k=0;k<bc;k++)
+      bn[i*bc+k] += s->J[(j*m+i)*cnt+beg+k] * (s->t[j*cnt+beg+k] - s->f[j*cnt+beg+k]);
+    for(int j=0;j<m;j++) for(int i=j;i<m;i++) for(int l=0;l<n;l++) for(int k=0;k<bc;k++)
+      An[(j*m+i)*bc+k] += s->J[(l*m+i)*cnt+beg+k] * s->J[(l*m+j)*cnt+beg+k];
+    for(int j=0;j<m;j++) for(int i=0;i<j;i++) for(int k=0;k<bc;k++)
+      An[(j*m+i)*bc+k] = An[(i*m+j)*bc+k];
+    for(int i=0;i<m;i++) for(int k=0;k<bc;k++)
+      b[i*bc+k] = acc[k] > 0.0 ? bn[i*bc+k] : b[i*bc+k];
+    for(int i=0;i<m*m;i++) for(int k=0;k<bc;k++)
+      A[i*bc+k] = acc[k] > 0.0 ? An[i*bc+k] : A[i*bc+k];
+
+    // (Jt J + lambda diag(Jt J)) delta = Jt r
+    memcpy(An, A, sizeof(double)*m*m*bc);
+    for(int i=0;i<m;i++) for(int k=0;k<bc;k++)
+      An[(i*m+i)*bc+k] *= 1.0 + lambda[k];
+    dt_conj_grad_batch(An, b, d, m, 0, bc, bc);
+    for(int i=0;i<m;i++) for(int k=0;k<bc;k++)
+      s->p[i*cnt+beg+k] = fmin(fmax(bp[i*bc+k] + d[i*bc+k], s->lb[i]), s->ub[i]);
+  }
+  for(int k=0;k<bc;k++)
+  {
+    for(int i=0;i<m;i++) s->p[i*cnt+beg+k] = bp[i*bc+k];
+    s->resid[beg+k] = best[k];
+  }
+}
+
+static inline void
+dt_levenberg_marquardt_batch_work(uint32_t beg, uint32_t end, void *arg)
+{ // the range may be larger than the grain, the scratch memory is per chunk
+  for(uint32_t c=beg;c<end;c+=DT_SOLVE_BATCH)
+    dt_levenberg_marquardt_batch_chunk(arg, c, c+DT_SOLVE_BATCH < end ? c+DT_SOLVE_BATCH : end);
+}
+
+// solve cnt problems with num_it levenberg-marquardt steps each. every
+// problem has its own damping and keeps the best parameters it has seen.
+// returns the largest squared residual.
+static inline double
+dt_levenberg_marquardt_batch(
+    dt_solve_batch_callback_t fJ_callback, // evaluates f and J for a range of problems
+    double       *p,      // m x cnt initial parameters, will be overwritten
+    const double *t,      // n x cnt target values
+    const int     m,      // number of parameters per problem
+    const int     n,      // number of data points per problem
+    const int     cnt,    // number of problems
+    const double *lb,     // m lower bound constraints
+    const double *ub,     // m upper bound constraints
+    const int     num_it, // number of iterations
+    double       *resid,  // cnt squared residuals, can be 0
+    void         *data)
+{
+  dt_solve_batch_t s = {
+    .fJ_callback = fJ_callback,
+    .p      = p,
+    .t      = t,
+    .f      = malloc(sizeof(double)*n*cnt),
+    .J      = malloc(sizeof(double)*n*m*cnt),
+    .resid  = resid ? resid : malloc(sizeof(double)*cnt),
+    .lb     = lb,
+    .ub     = ub,
+    .m      = m,
+    .n      = n,
+    .cnt    = cnt,
+    .num_it = num_it,
+    .data   = data,
+  };
+  threads_parallel_for(0, cnt, DT_SOLVE_BATCH, dt_levenberg_marquardt_batch_work, &s);
+  double max = 0.0;
+  for(int k=0;k<cnt;k++) max = fmax(max, s.resid[k]);
+  free(s.f);
+  free(s.J);
+  if(!resid) free(s.resid);
+  return max;
+}
+
 static inline double
 dt_adam(
     void (*f_callback)(double *p, double *f, int m, int n, void *data),
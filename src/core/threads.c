@@ -1,4 +1,5 @@
 #include "threads.h"
+#include "trace.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -11,6 +12,9 @@
 #include <sched.h>
 #include <time.h>
 #include <pthread.h>
+#ifdef __linux__
+  #include <dirent.h>
+#endif
 #ifdef _WIN64
   #include <Windows.h> 
 #endif
@@ -20,6 +24,7 @@ _Thread_local threads_tls_t thr_tls;
 
 typedef void (*threads_run_t)(uint32_t item, void *data);
 typedef void (*threads_free_t)(void *data);
+typedef void (*threads_range_t)(uint32_t begin, uint32_t end, void *data);
 
 typedef enum threads_task_state_t
 {
@@ -41,10 +46,39 @@ typedef struct threads_task_t
   threads_run_t   run;           // work function
   void           *data;          // user data to be passed to run function
   threads_free_t  free;          // optionally clean up user data
+  threads_prio_t  prio;
   char            desc[30];      // description for debugging
 }
 threads_task_t;
 
+// tasks are allocated in blocks as they are needed. blocks never move, so
+// task ids stay valid and workers can look at them without locking.
+#define THREADS_TASK_BLOCK      64
+#define THREADS_TASK_BLOCKS_MAX 64
+
+// parallel for loop, see threads_parallel_for()
+#define THREADS_PFOR_MAX 32
+typedef enum threads_pfor_state_t
+{
+  s_pfor_state_free    = 0,
+  s_pfor_state_initing = 1,
+  s_pfor_state_active  = 2,
+  s_pfor_state_closing = 3,
+}
+threads_pfor_state_t;
+
+typedef struct threads_pfor_t
+{
+  atomic_uint     state;         // threads_pfor_state_t
+  atomic_uint     next;          // next chunk to be claimed
+  atomic_uint     done;          // number of finished chunks
+  atomic_uint     users;         // helping threads looking at this slot
+  uint32_t        begin, end, grain, chunk_cnt;
+  threads_range_t run;
+  void           *data;
+}
+threads_pfor_t;
+
 typedef struct threads_t
 {
   uint32_t num_threads;
@@ -53,16 +87,102 @@ typedef struct threads_t
   // worker list
   pthread_t      *worker;
   uint32_t       *cpuid;
+  uint32_t        num_fast;      // workers 0..num_fast-1 run on the fastest cores
+  uint32_t        idle_fast;     // of these, the ones waiting for work. guarded by mutex_push
   // pool of tasks
-  uint32_t        task_max;
-  threads_task_t *task;
+  uint32_t        task_max;      // access atomically, grows by THREADS_TASK_BLOCK
+  threads_task_t *task_block[THREADS_TASK_BLOCKS_MAX];
+  uint32_t        pushed;        // counts wake ups, guarded by mutex_push
   pthread_cond_t  cond_task_done;
   pthread_cond_t  cond_task_push;
   pthread_mutex_t mutex_done;
   pthread_mutex_t mutex_push;
+  pthread_mutex_t mutex_grow;
+  // ranges of fine grained loops that idle threads can help with
+  threads_pfor_t  pfor[THREADS_PFOR_MAX];
 }
 threads_t;
 
+static inline threads_task_t *
+threads_task_get(uint32_t taskid)
+{
+  return thr.task_block[taskid / THREADS_TASK_BLOCK] + taskid % THREADS_TASK_BLOCK;
+}
+
+static inline uint32_t
+threads_task_cnt()
+{
+  return __atomic_load_n(&thr.task_max, __ATOMIC_ACQUIRE);
+}
+
+// wake up waiting workers, all of them or one
+static inline void
+threads_wake(int all)
+{
+  pthread_mutex_lock(&thr.mutex_push);
+  thr.pushed++;
+  if(all) pthread_cond_broadcast(&thr.cond_task_push);
+  else    pthread_cond_signal(&thr.cond_task_push);
+  pthread_mutex_unlock(&thr.mutex_push);
+}
+
+static inline void // claim and run chunks until there are none left
+threads_pfor_work(threads_pfor_t *p)
+{
+  while(1)
+  {
+    const uint32_t c = p->next++;
+    if(c >= p->chunk_cnt) break;
+    const uint32_t b = p->begin + c * p->grain;
+    const uint32_t e = b + p->grain < p->end ? b + p->grain : p->end;
+    p->run(b, e, p->data);
+    p->done++;
+  }
+}
+
+static inline int // help with all active parallel loops, return non-zero if any work was found
+threads_pfor_help()
+{
+  int found = 0;
+  for(int k=0;k<THREADS_PFOR_MAX;k++)
+  {
+    threads_pfor_t *p = thr.pfor + k;
+    if(p->state != s_pfor_state_active) continue;
+    p->users++;
+    // check again, the owner waits for users to leave before recycling the slot
+    if(p->state == s_pfor_state_active && p->next < p->chunk_cnt)
+    {
+      threads_pfor_work(p);
+      found = 1;
+    }
+    p->users--;
+  }
+  return found;
+}
+
+
+// claim a ready task. workers on the fastest cores look at interactive tasks
+// first, the others at background tasks, and leave interactive ones to an
+// idle fast worker if there is one.
+static threads_task_t *
+threads_task_pick(uint32_t tid)
+{
+  const int fast = tid < thr.num_fast;
+  for(int pass=0;pass<2;pass++)
+  {
+    const threads_prio_t prio = (pass == 0) == fast ? s_threads_prio_interactive : s_threads_prio_background;
+    if(!fast && prio == s_threads_prio_interactive && __atomic_load_n(&thr.idle_fast, __ATOMIC_RELAXED)) continue;
+    const uint32_t cnt = threads_task_cnt();
+    for(uint32_t k=0;k<cnt;k++)
+    { // brute force search for task
+      threads_task_t *task = threads_task_get(k);
+      if(task->tid != s_task_state_ready || task->prio != prio) continue;
+      uint32_t oldval = __sync_val_compare_and_swap(&task->tid, s_task_state_ready, tid);
+      if(oldval == s_task_state_ready) return task;
+    }
+  }
+  return 0;
+}
 
 // thread worker function
 void *threads_work(void *arg)
@@ -78,27 +198,36 @@ void *threads_work(void *arg)
   sched_setaffinity(0, sizeof(cpu_set_t), &set);
 #endif
 
+  const int fast = tid < thr.num_fast;
+  uint32_t seen = 0;
   while(1)
   {
-    pthread_mutex_lock(&thr.mutex_push);
-    pthread_cond_wait(&thr.cond_task_push, &thr.mutex_push);
-    pthread_mutex_unlock(&thr.mutex_push);
     if(thr.shutdown) break;
-    threads_task_t *task = 0;
-    for(int k=0;k<thr.task_max;k++)
-    { // brute force search for task
-      task = thr.task + k;
-      uint32_t oldval = __sync_val_compare_and_swap(&task->tid, s_task_state_ready, tid);
-      if(oldval == s_task_state_ready) break;
-      else task = 0;
+    while(threads_pfor_help()) ;
+    threads_task_t *task = threads_task_pick(tid);
+    if(task == 0)
+    { // sleep until something new is pushed
+      pthread_mutex_lock(&thr.mutex_push);
+      if(thr.pushed == seen && !thr.shutdown)
+      {
+        thr.idle_fast += fast;
+        pthread_cond_wait(&thr.cond_task_push, &thr.mutex_push);
+        thr.idle_fast -= fast;
+      }
+      seen = thr.pushed;
+      pthread_mutex_unlock(&thr.mutex_push);
+      continue;
     }
-    if(task == 0) continue; // wait for a bit more
+    threads_task_t *ref = threads_task_get(task->reftask);
+    const uint64_t trace_name = dt_trace_token(task->desc);
     while(1)
     { // work on this task
-      uint32_t item = thr.task[task->reftask].work_item++;
+      uint32_t item = ref->work_item++;
       if(item >= task->work_item_cnt) break;
+      dt_trace_begin(trace_name, item);
       task->run(item, task->data);
-      thr.task[task->reftask].done++;
+      dt_trace_end(trace_name, item);
+      ref->done++;
       if(thr.shutdown) break;
     }
     if(thr.shutdown) break; // don't recycle task. in fact don't clean up and leak whatever we still have (better than lockup)
@@ -107,7 +236,7 @@ void *threads_work(void *arg)
       // if we knew how many threads are working on this, we could test
       // the every-increasing work_item for > work_item_cnt + num_threads
       // and avoid the done pointer.
-      while(!thr.shutdown && (thr.task[task->reftask].done < task->work_item_cnt)) sched_yield();
+      while(!thr.shutdown && (ref->done < task->work_item_cnt)) sched_yield();
       if(thr.shutdown) break; // don't clean up, we didn't wait for everybody!
       task->free(task->data); // every thread gets the callback, they coordinate who cleans task->data
     }
@@ -134,8 +263,10 @@ void threads_global_cleanup()
   pthread_cond_destroy(&thr.cond_task_push);
   pthread_mutex_destroy(&thr.mutex_done);
   pthread_mutex_destroy(&thr.mutex_push);
+  pthread_mutex_destroy(&thr.mutex_grow);
   free(thr.cpuid);
-  free(thr.task);
+  for(int b=0;b<THREADS_TASK_BLOCKS_MAX;b++) free(thr.task_block[b]);
+  memset(thr.task_block, 0, sizeof(thr.task_block));
   free(thr.worker);
 }
 
@@ -143,19 +274,16 @@ static inline void
 threads_task_print(
     int taskid)
 {
-  if(taskid >= (int)thr.task_max || taskid < 0) return;
+  if(taskid >= (int)threads_task_cnt() || taskid < 0) return;
+  const threads_task_t *task = threads_task_get(taskid), *ref = threads_task_get(task->reftask);
   fprintf(stderr, "[threads] task %d '%s' items picked,done/total: %u,%u / %u, ref %d\n",
-      taskid, thr.task[taskid].desc,
-      thr.task[thr.task[taskid].reftask].work_item,
-      thr.task[thr.task[taskid].reftask].done,
-      thr.task[thr.task[taskid].reftask].work_item_cnt,
-      thr.task[taskid].reftask);
+      taskid, task->desc, ref->work_item, ref->done, ref->work_item_cnt, task->reftask);
 }
 
 static inline void
 threads_task_print_all()
 {
-  for(int t=0;t<thr.task_max;t++)
+  for(uint32_t t=0;t<threads_task_cnt();t++)
     threads_task_print(t);
 }
 
@@ -165,37 +293,81 @@ threads_task_print_all()
 // -2 argument error, run function is zero or no work to be done cnt <= item
 // -3 invalid taskid
 // or >= 0: the new task id
-int threads_task(
-    const char *desc,
-    uint32_t    work_item_cnt,
-    int         taskid,
-    void       *data,
-    void      (*run)(uint32_t item, void *data),
-    void      (*free)(void*))
+static int // claim a recyclable task, return its id or -1
+threads_task_claim()
 {
-  if(taskid >= (int)thr.task_max) return -3;
-  if(run == 0 || work_item_cnt == 0) return -2;
-  if(taskid >= 0 && thr.task[taskid].work_item_cnt <= thr.task[taskid].work_item) return -2;
-  threads_task_t *task = 0;
-  for(int k=0;k<thr.task_max;k++)
+  const uint32_t cnt = threads_task_cnt();
+  for(uint32_t k=0;k<cnt;k++)
   { // brute force search for task
-    task = thr.task + k;
-    uint32_t oldval = __sync_val_compare_and_swap(&task->tid, s_task_state_recycle, s_task_state_initing);
-    if(oldval == s_task_state_recycle) break;
-    else task = 0;
+    uint32_t oldval = __sync_val_compare_and_swap(&threads_task_get(k)->tid, s_task_state_recycle, s_task_state_initing);
+    if(oldval == s_task_state_recycle) return k;
   }
-  if(task == 0)
+  return -1;
+}
+
+// add a block of tasks, unless somebody else did since we looked at cnt tasks.
+// returns non-zero if there is no more room.
+static int
+threads_task_grow(uint32_t cnt)
+{
+  int res = 0;
+  pthread_mutex_lock(&thr.mutex_grow);
+  const uint32_t b = cnt / THREADS_TASK_BLOCK;
+  if(thr.task_max == cnt)
+  {
+    threads_task_t *block = b < THREADS_TASK_BLOCKS_MAX ? malloc(sizeof(threads_task_t)*THREADS_TASK_BLOCK) : 0;
+    if(block)
+    {
+      memset(block, 0, sizeof(threads_task_t)*THREADS_TASK_BLOCK);
+      for(int k=0;k<THREADS_TASK_BLOCK;k++) block[k].tid = s_task_state_recycle;
+      thr.task_block[b] = block;
+      __atomic_store_n(&thr.task_max, cnt + THREADS_TASK_BLOCK, __ATOMIC_RELEASE);
+    }
+    else res = 1;
+  }
+  pthread_mutex_unlock(&thr.mutex_grow);
+  return res;
+}
+
+// push task
+// return:
+// -1 no more recyclable tasks, too many tasks running
+// -2 argument error, run function is zero or no work to be done cnt <= item
+// -3 invalid taskid
+// or >= 0: the new task id
+static int
+threads_task_push(
+    threads_prio_t prio,
+    const char    *desc,
+    uint32_t       work_item_cnt,
+    int            taskid,
+    void          *data,
+    void         (*run)(uint32_t item, void *data),
+    void         (*free)(void*))
+{
+  if(taskid >= (int)threads_task_cnt()) return -3;
+  if(run == 0 || work_item_cnt == 0) return -2;
+  if(taskid >= 0 && threads_task_get(taskid)->work_item_cnt <= threads_task_get(taskid)->work_item) return -2;
+  int id = -1;
+  while(1)
+  {
+    const uint32_t cnt = threads_task_cnt();
+    if((id = threads_task_claim()) >= 0 || threads_task_grow(cnt)) break;
+  }
+  if(id < 0)
   {
     fprintf(stderr, "[threads] no more free tasks!\n");
     threads_task_print_all();
     return -1;
   }
+  threads_task_t *task = threads_task_get(id);
   // set all required entries on task
   task->run  = run;
   task->free = free;
   task->data = data;
+  task->prio = prio;
   task->work_item_cnt = work_item_cnt;
-  task->reftask = taskid >= 0 ? taskid : task - thr.task;
+  task->reftask = taskid >= 0 ? taskid : id;
   task->work_item = 0;
   task->done = 0;
   (void)snprintf(task->desc, sizeof(task->desc), "%s", desc);
@@ -206,17 +378,84 @@ int threads_task(
 #ifdef NDEBUG
   (void)oldval;
 #endif
-  // wake up one thread by signaling the condition
-  pthread_mutex_lock(&thr.mutex_push);
-  pthread_cond_signal(&thr.cond_task_push);
-  pthread_mutex_unlock(&thr.mutex_push);
+  // wake up one thread, or all for interactive tasks so that an idle fast one picks it up
+  threads_wake(prio == s_threads_prio_interactive);
   return task->reftask; // return taskid of original job we're working on
 }
 
+int threads_task(
+    const char *desc,
+    uint32_t    work_item_cnt,
+    int         taskid,
+    void       *data,
+    void      (*run)(uint32_t item, void *data),
+    void      (*free)(void*))
+{
+  return threads_task_push(s_threads_prio_interactive, desc, work_item_cnt, taskid, data, run, free);
+}
+
+int threads_task_background(
+    const char *desc,
+    uint32_t    work_item_cnt,
+    int         taskid,
+    void       *data,
+    void      (*run)(uint32_t item, void *data),
+    void      (*free)(void*))
+{
+  return threads_task_push(s_threads_prio_background, desc, work_item_cnt, taskid, data, run, free);
+}
+
+void threads_parallel_for(
+    uint32_t        begin,
+    uint32_t        end,
+    uint32_t        grain,
+    threads_range_t run,
+    void           *data)
+{
+  if(end <= begin) return;
+  if(grain == 0) grain = 1;
+  const uint32_t chunk_cnt = (end - begin + grain - 1) / grain;
+  threads_pfor_t *p = 0;
+  if(chunk_cnt > 1 && thr.num_threads > 1 && !thr.shutdown)
+    for(int k=0;k<THREADS_PFOR_MAX;k++)
+    {
+      uint32_t expected = s_pfor_state_free;
+      if(atomic_compare_exchange_strong(&thr.pfor[k].state, &expected, s_pfor_state_initing))
+      {
+        p = thr.pfor + k;
+        break;
+      }
+    }
+  if(!p)
+  { // no pool or all slots busy: the caller does everything
+    run(begin, end, data);
+    return;
+  }
+  p->begin = begin;
+  p->end   = end;
+  p->grain = grain;
+  p->chunk_cnt = chunk_cnt;
+  p->run   = run;
+  p->data  = data;
+  p->next  = 0;
+  p->done  = 0;
+  p->state = s_pfor_state_active;
+  // wake up idle workers. the ones that are busy won't hear this, which is fine:
+  // the calling thread works on the range too, so this never waits for them.
+  threads_wake(1);
+  threads_pfor_work(p);
+  while(p->done < chunk_cnt)
+    if(!threads_pfor_help()) sched_yield(); // help nested loops of the chunks still running
+  p->state = s_pfor_state_closing;
+  while(p->users) sched_yield();
+  p->state = s_pfor_state_free;
+}
+
 void threads_wait(int taskid)
 {
-  if(taskid < 0 || taskid >= thr.task_max) return;
-  while(thr.task[taskid].done < thr.task[taskid].work_item_cnt)
+  if(taskid < 0 || taskid >= threads_task_cnt()) return;
+  const threads_task_t *task = threads_task_get(taskid);
+  while(task->done < task->work_item_cnt)
   {
     struct timespec ts;
     clock_gettime(CLOCK_REALTIME, &ts);
@@ -229,6 +468,75 @@ void threads_wait(int taskid)
   }
 }
 
+#ifdef __linux__
+static uint32_t
+threads_read_uint(const char *fmt, uint32_t cpu)
+{
+  char fn[256];
+  uint32_t val = 0;
+  snprintf(fn, sizeof(fn), fmt, cpu);
+  FILE *f = fopen(fn, "rb");
+  if(!f) return 0;
+  if(fscanf(f, "%u", &val) != 1) val = 0;
+  fclose(f);
+  return val;
+}
+
+typedef struct threads_cpu_t
+{
+  uint32_t cpu, capacity, sibling, node;
+}
+threads_cpu_t;
+
+static int
+threads_cpu_compare(const void *a, const void *b)
+{ // fastest cores first, then one thread per core before the hyperthreads, node by node
+  const threads_cpu_t *ca = a, *cb = b;
+  if(ca->capacity != cb->capacity) return ca->capacity > cb->capacity ? -1 : 1;
+  if(ca->sibling  != cb->sibling)  return ca->sibling  < cb->sibling  ? -1 : 1;
+  if(ca->node     != cb->node)     return ca->node     < cb->node     ? -1 : 1;
+  return ca->cpu < cb->cpu ? -1 : ca->cpu > cb->cpu;
+}
+#endif
+
+// order the workers by the cores they are pinned to. on hybrid cpus the
+// performance cores come first and interactive tasks go to them (see
+// threads_task_pick()), on multi socket machines threads of the same node
+// get adjacent ids.
+static void
+threads_topology()
+{
+#ifdef __linux__
+  threads_cpu_t *cpu = malloc(sizeof(threads_cpu_t)*thr.num_threads);
+  for(uint32_t k=0;k<thr.num_threads;k++)
+  {
+    cpu[k] = (threads_cpu_t){ .cpu = k };
+    cpu[k].capacity = threads_read_uint("/sys/devices/system/cpu/cpu%u/cpu_capacity", k);
+    if(!cpu[k].capacity) // x86 doesn't have capacities, the max frequency tells p- and e-cores apart
+      cpu[k].capacity = threads_read_uint("/sys/devices/system/cpu/cpu%u/cpufreq/cpuinfo_max_freq", k);
+    // the first thread of a core is listed first among its siblings
+    cpu[k].sibling = threads_read_uint("/sys/devices/system/cpu/cpu%u/topology/thread_siblings_list", k) != k;
+    char dn[256];
+    snprintf(dn, sizeof(dn), "/sys/devices/system/cpu/cpu%u", k);
+    DIR *dp = opendir(dn);
+    struct dirent *ep;
+    if(dp) while((ep = readdir(dp)))
+      if(!strncmp(ep->d_name, "node", 4) && ep->d_name[4] >= '0' && ep->d_name[4] <= '9')
+        cpu[k].node = atoi(ep->d_name + 4);
+    if(dp) closedir(dp);
+  }
+  qsort(cpu, thr.num_threads, sizeof(cpu[0]), threads_cpu_compare);
+  thr.num_fast = 0;
+  for(uint32_t k=0;k<thr.num_threads;k++)
+  {
+    thr.cpuid[k] = cpu[k].cpu;
+    // within 5% of the fastest counts as fast, turbo bins differ a bit between p-cores
+    if(20ul*cpu[k].capacity >= 19ul*cpu[0].capacity) thr.num_fast = k+1;
+  }
+  free(cpu);
+#endif
+}
+
 void threads_global_init()
 {
 #ifdef _WIN64
@@ -239,16 +547,17 @@ void threads_global_init()
   thr.num_threads = sysconf(_SC_NPROCESSORS_ONLN);
 #endif
   thr.shutdown = 0;
-  thr.task_max = thr.num_threads * 10;
-  thr.task     = malloc(sizeof(threads_task_t)*thr.task_max);
+  thr.pushed   = 0;
+  thr.task_max = 0;
   thr.cpuid    = malloc(sizeof(uint32_t)*thr.num_threads);
-  thr.worker   = malloc(sizeof(pthread_t)*thr.num_threads);
-
-  for(int k=0;k<thr.task_max;k++)
-    thr.task[k].tid = s_task_state_recycle;
+  pthread_mutex_init(&thr.mutex_grow, 0);
+  while(threads_task_cnt() < thr.num_threads * 10 && !threads_task_grow(threads_task_cnt())) ;
+  memset(thr.pfor, 0, sizeof(thr.pfor));
 
   for(int k=0;k<thr.num_threads;k++)
     thr.cpuid[k] = k; // default init
+  thr.num_fast = thr.num_threads;
+  threads_topology();
 
   const char *def_file = "affinity";
   const char *filename = def_file;
@@ -279,6 +588,7 @@ void threads_global_init()
       fgetc(f); // read newline
       thr.cpuid[k++] = cpu1;
     }
+    thr.num_fast = thr.num_threads; // the file says it all
     if(k < thr.num_threads)
       fprintf(stderr, "[threads] not enough entries in your affinity file `%s'! (%d/%d threads)\n", filename, k, thr.num_threads);
     fclose(f);
@@ -301,9 +611,7 @@ void threads_shutdown()
   pthread_mutex_lock(&thr.mutex_done);
   pthread_cond_broadcast(&thr.cond_task_done);
   pthread_mutex_unlock(&thr.mutex_done);
-  pthread_mutex_lock(&thr.mutex_push);
-  pthread_cond_broadcast(&thr.cond_task_push);
-  pthread_mutex_unlock(&thr.mutex_push);
+  threads_wake(1);
 }
 
 int threads_shutting_down()
@@ -319,13 +627,15 @@ int threads_num()
 // returns zero if the task is done
 int threads_task_running(int taskid)
 {
-  if(taskid < 0 || taskid >= thr.task_max) return 0;
-  return thr.task[taskid].done < thr.task[taskid].work_item_cnt;
+  if(taskid < 0 || taskid >= threads_task_cnt()) return 0;
+  const threads_task_t *task = threads_task_get(taskid);
+  return task->done < task->work_item_cnt;
 }
 
 // returns a progress indicator
 float threads_task_progress(int taskid)
 {
-  if(taskid < 0 || taskid >= thr.task_max) return 0.0f;
-  return thr.task[taskid].done / (float) thr.task[taskid].work_item_cnt;
+  if(taskid < 0 || taskid >= threads_task_cnt()) return 0.0f;
+  const threads_task_t *task = threads_task_get(taskid);
+  return task->done / (float) task->work_item_cnt;
 }
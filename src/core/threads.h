@@ -27,6 +27,13 @@ extern _Thread_local threads_tls_t thr_tls;
 void threads_global_init();
 void threads_global_cleanup();
 
+typedef enum threads_prio_t
+{
+  s_threads_prio_interactive = 0, // someone waits for it, runs on the fastest cores
+  s_threads_prio_background  = 1, // picked up when no interactive task is waiting
+}
+threads_prio_t;
+
 // push a new task (task < threads_num()) with given function and argument.
 // one task is going to be worked on by one thread. if you want multiple threads
 // do the same job, call this multiple times and pass the same work_item
@@ -40,6 +47,29 @@ threads_task(
     void      (*run)(uint32_t item, void *data),
     void      (*free)(void*));  // this is called only at the very end to clean up (for every thread working on a job)
 
+// the same as threads_task(), but for work nobody waits for (thumbnails,
+// exports, file operations). efficiency cores pick these first.
+int
+threads_task_background(
+    const char *desc,
+    uint32_t    work_item_cnt,
+    int         taskid,
+    void       *data,
+    void      (*run)(uint32_t item, void *data),
+    void      (*free)(void*));
+
+// run the function on [begin, end), split into chunks of grain items which are
+// claimed one by one by the calling thread and any idle worker. this blocks
+// until the whole range is done, and may be called from inside task run
+// functions and from within other parallel loops. without a thread pool the
+// caller simply runs everything itself.
+void threads_parallel_for(
+    uint32_t begin,
+    uint32_t end,
+    uint32_t grain,
+    void   (*run)(uint32_t begin, uint32_t end, void *data),
+    void    *data);
+
 // returns zero if the task is done
 int threads_task_running(int taskid);
 
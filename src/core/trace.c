@@ -0,0 +1,185 @@
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+typedef struct dt_trace_ev_t
+{
+  uint64_t ts;   // monotonic nanoseconds
+  uint64_t name; // token
+  uint64_t arg;  // user argument, lowest bit of ts marks an end event
+}
+dt_trace_ev_t;
+
+// single producer (the owning thread), any number of readers
+typedef struct dt_trace_ring_t
+{
+  atomic_uint_fast64_t head;  // number of events ever written
+  atomic_int           owned; // a live thread writes here
+  uint32_t             tid;   // index in the ring list, used as thread id in the dump
+  dt_trace_ev_t        ev[DT_TRACE_RING_SIZE];
+}
+dt_trace_ring_t;
+
+static dt_trace_ring_t *rings[DT_TRACE_MAX_THREADS];
+static atomic_uint      ring_cnt;
+static pthread_mutex_t  ring_mutex = PTHREAD_MUTEX_INITIALIZER; // only taken when threads come and go
+static pthread_key_t    ring_key;
+static pthread_once_t   ring_once = PTHREAD_ONCE_INIT;
+static _Thread_local dt_trace_ring_t *ring_tls;
+static _Thread_local int              ring_none; // out of rings, don't try again
+static volatile sig_atomic_t dump_requested;
+static atomic_uint      dump_cnt;
+
+static void
+ring_release(void *r)
+{ // thread exits: the next new thread may continue in this ring
+  atomic_store(&((dt_trace_ring_t *)r)->owned, 0);
+}
+
+static void
+ring_key_init()
+{
+  pthread_key_create(&ring_key, ring_release);
+}
+
+static dt_trace_ring_t *
+ring_acquire()
+{
+  pthread_once(&ring_once, ring_key_init);
+  dt_trace_ring_t *r = 0;
+  pthread_mutex_lock(&ring_mutex);
+  const uint32_t cnt = atomic_load(&ring_cnt);
+  for(uint32_t i=0;i<cnt&&!r;i++)
+    if(!atomic_load(&rings[i]->owned)) r = rings[i];
+  if(!r && cnt < DT_TRACE_MAX_THREADS)
+  {
+    r = calloc(1, sizeof(*r));
+    if(r)
+    {
+      r->tid = cnt;
+      rings[cnt] = r;
+      atomic_store(&ring_cnt, cnt+1); // publish after the pointer is in place
+    }
+  }
+  if(r) atomic_store(&r->owned, 1);
+  pthread_mutex_unlock(&ring_mutex);
+  if(r) pthread_setspecific(ring_key, r);
+  return r;
+}
+
+void
+dt_trace_event(uint64_t name, uint64_t arg, int end)
+{
+  dt_trace_ring_t *r = ring_tls;
+  if(!r)
+  {
+    if(ring_none) return;
+    r = ring_tls = ring_acquire();
+    if(!r) { ring_none = 1; return; }
+  }
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  const uint64_t h = atomic_load_explicit(&r->head, memory_order_relaxed);
+  dt_trace_ev_t *e = r->ev + (h & (DT_TRACE_RING_SIZE-1));
+  e->ts   = ((t.tv_sec * 1000000000ul + t.tv_nsec) & ~1ul) | (end ? 1 : 0);
+  e->name = name;
+  e->arg  = arg;
+  atomic_store_explicit(&r->head, h+1, memory_order_release);
+}
+
+static void
+trace_signal_handler(int sig)
+{
+  dump_requested = 1;
+}
+
+void
+dt_trace_init()
+{
+  struct sigaction sa = {0};
+  sa.sa_handler = trace_signal_handler;
+  sa.sa_flags = SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGUSR1, &sa, 0);
+}
+
+void
+dt_trace_request_dump()
+{
+  dump_requested = 1;
+}
+
+const char *
+dt_trace_poll()
+{
+  static char filename[256];
+  if(!dump_requested) return 0;
+  dump_requested = 0;
+  snprintf(filename, sizeof(filename), "/tmp/vkdt-trace-%d-%u.json", (int)getpid(), atomic_fetch_add(&dump_cnt, 1));
+  if(dt_trace_dump(filename)) return 0;
+  return filename;
+}
+
+uint64_t
+dt_trace_now()
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1000000000ul + t.tv_nsec;
+}
+
+int
+dt_trace_write(FILE *f, int cnt, uint64_t t0)
+{
+  dt_trace_ev_t *ev = malloc(sizeof(dt_trace_ev_t)*DT_TRACE_RING_SIZE);
+  if(!ev) return cnt;
+  const int pid = getpid();
+  const uint32_t num_rings = atomic_load(&ring_cnt);
+  for(uint32_t i=0;i<num_rings;i++)
+  {
+    dt_trace_ring_t *r = rings[i];
+    // copy without stopping the writer, then drop whatever it may have
+    // overwritten in the meantime:
+    const uint64_t h0 = atomic_load_explicit(&r->head, memory_order_acquire);
+    const uint64_t n0 = h0 < DT_TRACE_RING_SIZE ? h0 : DT_TRACE_RING_SIZE;
+    for(uint64_t k=h0-n0;k<h0;k++) ev[k-(h0-n0)] = r->ev[k & (DT_TRACE_RING_SIZE-1)];
+    const uint64_t h1 = atomic_load_explicit(&r->head, memory_order_acquire);
+    const uint64_t skip = h1 - h0 >= n0 ? n0 : h1 - h0;
+    fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":\"thread %u\"}}",
+        cnt++ ? ",\n" : "", pid, r->tid, r->tid);
+    for(uint64_t k=skip;k<n0;k++)
+    {
+      if((ev[k].ts & ~1ul) < t0) continue;
+      char name[9] = {0};
+      for(int c=0;c<8;c++)
+      {
+        char ch = (ev[k].name >> (8*c)) & 0xff;
+        if(!ch) break;
+        name[c] = (ch < 32 || ch == '"' || ch == '\\' || ch > 126) ? '_' : ch;
+      }
+      fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"pid\":%d,\"tid\":%u,\"ts\":%.3f,\"args\":{\"arg\":%lu}}",
+          name, (ev[k].ts & 1) ? 'E' : 'B', pid, r->tid, ((ev[k].ts & ~1ul) - t0) * 1e-3, (unsigned long)ev[k].arg);
+    }
+  }
+  free(ev);
+  return cnt;
+}
+
+int
+dt_trace_dump(const char *filename)
+{
+  FILE *f = fopen(filename, "wb");
+  if(!f) return 1;
+  fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  dt_trace_write(f, 0, 0);
+  fprintf(f, "\n]}\n");
+  fclose(f);
+  return 0;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+
+// always-on binary trace of begin/end events. every thread writes into its
+// own ring buffer without locks, only the last DT_TRACE_RING_SIZE events per
+// thread are kept. the rings can be dumped at any time as chrome trace event
+// json (chrome://tracing or https://ui.perfetto.dev), for instance after a
+// stall in production by sending SIGUSR1 to the process.
+
+#define DT_TRACE_RING_SIZE   4096 // events per thread, power of two
+#define DT_TRACE_MAX_THREADS 128  // threads beyond this are not traced
+
+// pack up to eight characters into a name, same layout as dt_token_t
+static inline uint64_t
+dt_trace_token(const char *s)
+{
+  uint64_t t = 0;
+  for(int i=0;i<8&&s[i];i++) t |= ((uint64_t)(uint8_t)s[i]) << (8*i);
+  return t;
+}
+
+// record an event for the calling thread. name is a dt_token_t or the
+// result of dt_trace_token(), arg is shown next to it (frame, item, ..).
+void dt_trace_event(uint64_t name, uint64_t arg, int end);
+
+static inline void dt_trace_begin(uint64_t name, uint64_t arg) { dt_trace_event(name, arg, 0); }
+static inline void dt_trace_end  (uint64_t name, uint64_t arg) { dt_trace_event(name, arg, 1); }
+
+// install the SIGUSR1 handler which requests a dump
+void dt_trace_init();
+
+// write all rings to the given file, returns non-zero on failure.
+// this is safe to call while other threads keep tracing.
+int dt_trace_dump(const char *filename);
+
+// append the events of all rings from time t0 on to an open chrome trace
+// json, with timestamps relative to t0. cnt is the number of events already in
+// the file (for the separators), returns the new count.
+int dt_trace_write(FILE *f, int cnt, uint64_t t0);
+
+// the clock of the events: CLOCK_MONOTONIC in nanoseconds
+uint64_t dt_trace_now();
+
+// ask for a dump to /tmp/vkdt-trace-<pid>-<n>.json at the next dt_trace_poll().
+// this is what the signal handler does, and is safe to call from anywhere.
+void dt_trace_request_dump();
+
+// call this regularly from a thread where file i/o is fine. if a dump was
+// requested, writes it and returns the file name, zero otherwise.
+const char *dt_trace_poll();
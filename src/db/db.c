@@ -5,6 +5,8 @@
 #include "pipe/graph-defaults.h"
 #include "stringpool.h"
 #include "exif.h"
+#include "hash.h"
+#include "core/threads.h"
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -15,6 +17,11 @@
 #include <time.h>
 #include <fcntl.h>
 #include <ctype.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <limits.h>
+
+static void sorted_reset(dt_db_t *db);
 
 void
 dt_db_init(dt_db_t *db)
@@ -28,20 +35,110 @@ dt_db_init(dt_db_t *db)
   db->collection_sort = s_prop_filename;
 }
 
-void
-dt_db_cleanup(dt_db_t *db)
+static void
+db_write_back(dt_db_t *db)
 {
   char dbname[1040];
   snprintf(dbname, sizeof(dbname), "%s/vkdt.db", db->dirname);
   // do not write if opened single image:
-  if(db->image_cnt > 1) dt_db_write(db, dbname, 0);
+  if(db->image_cnt > 1 && db->dirname[0] && !dt_db_write(db, dbname, 0)) db->journal_cnt = 0;
+}
+
+void
+dt_db_cleanup(dt_db_t *db)
+{
+  db_write_back(db);
   dt_stringpool_cleanup(&db->sp_filename);
+  sorted_reset(db);
   free(db->collection);
   free(db->selection);
   free(db->image);
   memset(db, 0, sizeof(*db));
 }
 
+// modification time of the directory, and of the tag index which is appended
+// to in place. 0 if it's gone.
+static int64_t
+db_recent_stamp(const char *dirname, int tag_index)
+{
+  char fn[1100];
+  struct stat st;
+  if(stat(dirname, &st)) return 0;
+  int64_t stamp = st.st_mtim.tv_sec * 1000000000ll + st.st_mtim.tv_nsec;
+  snprintf(fn, sizeof(fn), "%s/tag.idx", dirname);
+  if(tag_index && !stat(fn, &st))
+    stamp = MAX(stamp, st.st_mtim.tv_sec * 1000000000ll + st.st_mtim.tv_nsec) ^ st.st_size;
+  return stamp;
+}
+
+void
+dt_db_recent_stash(
+    dt_db_recent_t *recent,
+    dt_db_t        *db)
+{
+  if(!db->dirname[0] || !db->image_cnt)
+  { // nothing worth keeping
+    dt_db_cleanup(db);
+    return;
+  }
+  db_write_back(db);
+  if(recent->cnt == DT_DB_RECENT_MAX) dt_db_cleanup(recent->db + --recent->cnt);
+  memmove(recent->db+1,    recent->db,    sizeof(recent->db[0])*recent->cnt);
+  memmove(recent->stamp+1, recent->stamp, sizeof(recent->stamp[0])*recent->cnt);
+  recent->db[0]    = *db;
+  recent->stamp[0] = db_recent_stamp(db->dirname, db->tag_index);
+  recent->cnt++;
+  memset(db, 0, sizeof(*db));
+}
+
+int
+dt_db_recent_restore(
+    dt_db_recent_t  *recent,
+    dt_db_t         *db,
+    dt_thumbnails_t *thumbnails,
+    const char      *dirname)
+{
+  char dir[sizeof(db->dirname)];
+  snprintf(dir, sizeof(dir), "%s", dirname);
+  size_t len = strlen(dir);
+  if(len > 1 && dir[len-1] == '/') dir[len-1] = 0;
+  int i = 0;
+  for(;i<recent->cnt;i++) if(!strcmp(recent->db[i].dirname, dir)) break;
+  if(i == recent->cnt) return 1;
+
+  dt_db_t r = recent->db[i];
+  const int64_t stamp = recent->stamp[i];
+  recent->cnt--;
+  memmove(recent->db+i,    recent->db+i+1,    sizeof(recent->db[0])*(recent->cnt-i));
+  memmove(recent->stamp+i, recent->stamp+i+1, sizeof(recent->stamp[0])*(recent->cnt-i));
+  if(!stamp || stamp != db_recent_stamp(r.dirname, r.tag_index))
+  { // files came or went, list the directory again
+    dt_db_cleanup(&r);
+    return 1;
+  }
+  dt_db_cleanup(db);
+  *db = r;
+  for(uint32_t k=0;k<db->image_cnt;k++)
+  { // keep the thumbnails whose slots still hold our image
+    uint32_t *t = &db->image[k].thumbnail;
+    if(*t == 0) continue;
+    char filename[1024];
+    dt_db_image_path(db, k, filename, sizeof(filename));
+    if(*t < thumbnails->thumb_max && thumbnails->thumb[*t].hash == hash64(filename))
+      thumbnails->thumb[*t].imgid = k;
+    else *t = 0;
+  }
+  dt_log(s_log_db, "[db] restored %s with %u images", db->dirname, db->image_cnt);
+  return 0;
+}
+
+void
+dt_db_recent_cleanup(dt_db_recent_t *recent)
+{
+  for(int i=0;i<recent->cnt;i++) dt_db_cleanup(recent->db + i);
+  recent->cnt = 0;
+}
+
 static int
 compare_id(const void *a, const void *b, void *arg)
 {
@@ -68,43 +165,83 @@ compare_rating(const void *a, const void *b, void *arg)
 
 static int
 compare_labels(const void *a, const void *b, void *arg)
-{
+{ // ignore the selection bit, as the collection order does
   dt_db_t *db = arg;
   const uint32_t *ia = a, *ib = b;
-  return db->image[ia[0]].labels - db->image[ib[0]].labels;
+  return (db->image[ia[0]].labels & 0x7fffu) - (db->image[ib[0]].labels & 0x7fffu);
 }
 
 static int
 compare_createdate(const void *a, const void *b, void *arg)
-{ // you ask for complicated sort, you get slow and stupid.
-  // we don't store the date in the db, since there is in general no clear 1:1 mapping
-  // between images and cfg file/graph. also, loading a directory becomes painfully slow
-  // when initialising metadata during ingestion.
+{ // exif is cached in the images, see dt_db_update_exif()
   dt_db_t *db = arg;
   const uint32_t *ia = a, *ib = b;
-  char cda[20] = {0}, cdb[20] = {0};
-  char fna[1024], fnb[1024], *aa = fna, *bb = fnb;
-  char fna2[1024], fnb2[1024];
-  dt_db_image_path(db, ia[0], fna, sizeof(fna));
-  dt_db_image_path(db, ib[0], fnb, sizeof(fnb));
-  size_t off;
-  off = readlink(fna, fna2, sizeof(fna2));
-  if(off != -1) aa = fna2;
-  else off = strnlen(fna, sizeof(fna));
-  if(off > 4) aa[off - 4] = 0;
-  else aa[off] = 0;
-
-  off = readlink(fnb, fnb2, sizeof(fnb2));
-  if(off != -1) bb = fnb2;
-  else off = strnlen(fnb, sizeof(fnb));
-  if(off > 4) bb[off - 4] = 0;
-  else bb[off] = 0;
-
-  char model[32];
-  dt_db_exif_mini(aa, cda, model, sizeof(model));
-  dt_db_exif_mini(bb, cdb, model, sizeof(model));
-
-  return strcmp(cda, cdb);
+  const uint64_t ca = db->image[ia[0]].createdate, cb = db->image[ib[0]].createdate;
+  return ca < cb ? -1 : ca > cb;
+}
+
+static uint64_t // identify the version of a file the exif data has been read from
+image_exif_key(const struct stat *sb)
+{
+  return (((uint64_t)sb->st_mtim.tv_sec) << 24) ^ (uint64_t)sb->st_size;
+}
+
+// there is in general no clear 1:1 mapping between cfg files and images, we
+// follow symlinks and strip the .cfg suffix to find the file.
+int
+dt_db_update_exif(dt_db_t *db, uint32_t imgid)
+{
+  dt_image_t *img = db->image + imgid;
+  char fn[1024], fn2[1024], *ff = fn;
+  dt_db_image_path(db, imgid, fn, sizeof(fn));
+  ssize_t off = readlink(fn, fn2, sizeof(fn2)-1);
+  if(off != -1) ff = fn2;
+  else off = strnlen(fn, sizeof(fn));
+  if(off > 4) ff[off - 4] = 0;
+  else ff[off] = 0;
+
+  struct stat sb;
+  if(stat(ff, &sb)) return 0; // keep whatever we had
+  const uint64_t key = image_exif_key(&sb);
+  if(img->exif_key == key) return 0;
+  dt_db_exif_t exif;
+  dt_db_exif_read(ff, &exif);
+  memcpy(img->model, exif.model, sizeof(img->model));
+  memcpy(img->lens,  exif.lens,  sizeof(img->lens));
+  img->exposure     = exif.exposure;
+  img->aperture     = exif.aperture;
+  img->iso          = exif.iso;
+  img->focal_length = exif.focal_length;
+  img->createdate = 0; // YYYYMMDDhhmmss as a number
+  for(int i=0;i<19&&exif.createdate[i];i++)
+    if(exif.createdate[i] >= '0' && exif.createdate[i] <= '9')
+      img->createdate = 10*img->createdate + exif.createdate[i] - '0';
+  img->exif_key = key;
+  return 1;
+}
+
+typedef struct update_exif_t
+{
+  dt_db_t *db;
+  int      changed;
+}
+update_exif_t;
+
+static void
+update_exif(uint32_t beg, uint32_t end, void *data)
+{
+  update_exif_t *u = data;
+  int changed = 0;
+  for(uint32_t k=beg;k<end;k++) changed |= dt_db_update_exif(u->db, k);
+  if(changed) __atomic_store_n(&u->changed, 1, __ATOMIC_RELAXED);
+}
+
+int
+dt_db_update_exif_all(dt_db_t *db)
+{ // every image writes only its own fields, and the files are read independently
+  update_exif_t u = { .db = db };
+  threads_parallel_for(0, db->image_cnt, 16, update_exif, &u);
+  return u.changed;
 }
 
 static int
@@ -127,19 +264,218 @@ image_init(dt_image_t *img)
   memset(img, 0, sizeof(*img));
 }
 
+static void
+sorted_reset(dt_db_t *db)
+{
+  for(int p=0;p<=s_prop_filetype;p++) free(db->sorted[p]);
+  memset(db->sorted, 0, sizeof(db->sorted));
+  db->sorted_valid = 0;
+}
+
+static void // stable counting sort of the filename order by a small integer key
+sorted_bucket(dt_db_t *db, dt_db_property_t prop, const uint32_t *in)
+{
+  uint32_t cnt[257] = {0};
+  uint32_t *out = db->sorted[prop];
+#define SORT_KEY(I) (prop == s_prop_rating ?\
+    (db->image[I].rating > 5 ? 0 : 6 - db->image[I].rating) :\
+    MIN(db->image[I].labels & 0x7fffu, 255))
+  for(uint32_t k=0;k<db->image_cnt;k++) cnt[SORT_KEY(in[k])+1]++;
+  for(int b=1;b<257;b++) cnt[b] += cnt[b-1];
+  for(uint32_t k=0;k<db->image_cnt;k++) out[cnt[SORT_KEY(in[k])]++] = in[k];
+#undef SORT_KEY
+}
+
+#define RADIX_CHUNK 16384 // keys per parallel work item
+
+typedef struct radix_t
+{
+  uint64_t *key, *key_tmp;
+  uint32_t *idx, *idx_tmp;
+  uint32_t  cnt;
+  uint32_t  shift;          // of the digit sorted by in this pass
+  uint32_t (*hist)[256];    // per chunk histogram, then scatter offsets
+  const dt_db_t   *db;      // for filling the keys:
+  dt_db_property_t prop;
+  uint32_t         off;     // byte offset into the filename
+}
+radix_t;
+
+static inline uint64_t
+filename_key(const char *s, uint32_t off)
+{ // the next eight bytes in big endian, so the numeric order is the strcmp() order
+  uint64_t k = 0;
+  for(int i=0;i<8&&s[off+i];i++) k |= ((uint64_t)(uint8_t)s[off+i]) << (56-8*i);
+  return k;
+}
+
+static void
+radix_keys(uint32_t beg, uint32_t end, void *data)
+{
+  radix_t *r = data;
+  for(uint32_t i=beg;i<end;i++)
+  {
+    const dt_image_t *img = r->db->image + r->idx[i];
+    if     (r->prop == s_prop_filename)   r->key[i] = filename_key(img->filename, r->off);
+    else if(r->prop == s_prop_createdate) r->key[i] = img->createdate;
+    else                                  r->key[i] = dt_graph_default_input_module(img->filename);
+  }
+}
+
+static void
+radix_hist(uint32_t beg, uint32_t end, void *data)
+{
+  radix_t *r = data;
+  for(uint32_t c=beg;c<end;c++)
+  {
+    uint32_t *h = r->hist[c];
+    memset(h, 0, sizeof(r->hist[0]));
+    const uint32_t e = MIN(r->cnt, (c+1)*RADIX_CHUNK);
+    for(uint32_t i=c*RADIX_CHUNK;i<e;i++) h[(r->key[i] >> r->shift) & 0xff]++;
+  }
+}
+
+static void
+radix_scatter(uint32_t beg, uint32_t end, void *data)
+{
+  radix_t *r = data;
+  for(uint32_t c=beg;c<end;c++)
+  {
+    uint32_t *o = r->hist[c];
+    const uint32_t e = MIN(r->cnt, (c+1)*RADIX_CHUNK);
+    for(uint32_t i=c*RADIX_CHUNK;i<e;i++)
+    {
+      const uint32_t j = o[(r->key[i] >> r->shift) & 0xff]++;
+      r->key_tmp[j] = r->key[i];
+      r->idx_tmp[j] = r->idx[i];
+    }
+  }
+}
+
+// fill the keys for r->idx and sort it by them: stable lsd radix sort with
+// eight bit digits, histogram and scatter run on chunks in parallel. digits
+// which are the same for all keys are skipped.
+static void
+radix_sort(radix_t *r)
+{
+  if(r->cnt < 2) return;
+  const uint32_t chunk_cnt = (r->cnt + RADIX_CHUNK - 1) / RADIX_CHUNK;
+  threads_parallel_for(0, r->cnt, RADIX_CHUNK, radix_keys, r);
+  uint64_t key_or = 0, key_and = -1ul;
+  for(uint32_t i=0;i<r->cnt;i++) { key_or |= r->key[i]; key_and &= r->key[i]; }
+  const uint64_t differ = key_or ^ key_and;
+  if(!differ) return;
+
+  uint64_t *key = r->key;
+  uint32_t *idx = r->idx;
+  uint64_t *key_tmp = malloc(sizeof(uint64_t)*r->cnt);
+  uint32_t *idx_tmp = malloc(sizeof(uint32_t)*r->cnt);
+  r->hist = malloc(sizeof(r->hist[0])*chunk_cnt);
+  r->key_tmp = key_tmp;
+  r->idx_tmp = idx_tmp;
+  for(int d=0;d<8;d++)
+  {
+    if(!((differ >> (8*d)) & 0xff)) continue;
+    r->shift = 8*d;
+    threads_parallel_for(0, chunk_cnt, 1, radix_hist, r);
+    uint32_t sum = 0;
+    for(int b=0;b<256;b++) for(uint32_t c=0;c<chunk_cnt;c++)
+    {
+      const uint32_t t = r->hist[c][b];
+      r->hist[c][b] = sum;
+      sum += t;
+    }
+    threads_parallel_for(0, chunk_cnt, 1, radix_scatter, r);
+    uint64_t *tk = r->key; r->key = r->key_tmp; r->key_tmp = tk;
+    uint32_t *ti = r->idx; r->idx = r->idx_tmp; r->idx_tmp = ti;
+  }
+  if(r->key != key)
+  {
+    memcpy(key, r->key, sizeof(uint64_t)*r->cnt);
+    memcpy(idx, r->idx, sizeof(uint32_t)*r->cnt);
+    r->key = key;
+    r->idx = idx;
+  }
+  free(key_tmp);
+  free(idx_tmp);
+  free(r->hist);
+  r->hist = 0;
+}
+
+// sort idx by filename: radix sort by the next eight bytes, then refine the
+// runs which share them. only short runs are left to strcmp().
+static void
+radix_sort_filename(const dt_db_t *db, uint32_t *idx, uint64_t *key, uint32_t cnt, uint32_t off)
+{
+  radix_t r = { .key = key, .idx = idx, .cnt = cnt, .db = db, .prop = s_prop_filename, .off = off };
+  radix_sort(&r);
+  for(uint32_t b=0,e;b<cnt;b=e)
+  {
+    for(e=b+1;e<cnt&&key[e]==key[b];e++) {}
+    if(e - b < 2 || !(key[b] & 0xff)) continue; // unique or all strings end here
+    if(e - b < 32) qsort_r(idx + b, e - b, sizeof(uint32_t), compare_filename, (void *)db);
+    else radix_sort_filename(db, idx + b, key + b, e - b, off + 8);
+  }
+}
+
+// return the permutation of all images sorted by the given property, or 0 for
+// no particular order. properties that don't change while looking at the
+// collection are sorted once, rating and labels are bucketed on top of the
+// filename order every time. create date and file type are radix sorted on
+// top of the filename order too, so ties are always sorted by filename.
+static const uint32_t *
+sorted_images(dt_db_t *db, dt_db_property_t prop)
+{
+  if(prop == s_prop_none || prop > s_prop_filetype) return 0;
+  if(prop == s_prop_rating || prop == s_prop_labels)
+  {
+    const uint32_t *fn = sorted_images(db, s_prop_filename);
+    if(!db->sorted[prop]) db->sorted[prop] = malloc(sizeof(uint32_t)*db->image_max);
+    sorted_bucket(db, prop, fn);
+    return db->sorted[prop];
+  }
+  if(db->sorted_valid & (1u<<prop)) return db->sorted[prop];
+  const uint32_t *fn = prop == s_prop_filename ? 0 : sorted_images(db, s_prop_filename);
+  if(!db->sorted[prop]) db->sorted[prop] = malloc(sizeof(uint32_t)*db->image_max);
+  uint32_t *s = db->sorted[prop];
+  uint64_t *key = malloc(sizeof(uint64_t)*MAX(1, db->image_cnt));
+  if(prop == s_prop_filename)
+  {
+    for(uint32_t k=0;k<db->image_cnt;k++) s[k] = k;
+    radix_sort_filename(db, s, key, db->image_cnt, 0);
+  }
+  else
+  {
+    memcpy(s, fn, sizeof(uint32_t)*db->image_cnt);
+    radix_t r = { .key = key, .idx = s, .cnt = db->image_cnt, .db = db, .prop = prop };
+    radix_sort(&r);
+  }
+  free(key);
+  db->sorted_valid |= 1u<<prop;
+  return s;
+}
+
 void
 dt_db_update_collection(dt_db_t *db)
 {
-  // filter
+  if(db->collection_filter == s_prop_createdate || db->collection_sort == s_prop_createdate)
+  {
+    if(dt_db_update_exif_all(db)) db->sorted_valid &= ~(1u<<s_prop_createdate);
+  }
+
+  // walk the images in sort order and filter in one pass
+  const uint32_t *order = sorted_images(db, db->collection_sort);
+  const char *filter_str = dt_token_str(db->collection_filter_val);
   db->collection_cnt = 0;
-  for(int k=0;k<db->image_cnt;k++)
+  for(uint32_t i=0;i<db->image_cnt;i++)
   {
+    const uint32_t k = order ? order[i] : i;
     switch(db->collection_filter)
     {
     case s_prop_none:
       break;
     case s_prop_filename:
-      if(!strstr(db->image[k].filename, dt_token_str(db->collection_filter_val))) continue;
+      if(!strstr(db->image[k].filename, filter_str)) continue;
       break;
     case s_prop_rating:
       if(!(db->image[k].rating >= db->collection_filter_val)) continue;
@@ -148,63 +484,26 @@ dt_db_update_collection(dt_db_t *db)
       if(!(db->image[k].labels & db->collection_filter_val)) continue;
       break;
     case s_prop_createdate:
-      // TODO: match beginning of filter val string
+    { // match leading digits, i.e. 2023 matches the year, 202306 june 2023
+      uint64_t cd = db->image[k].createdate;
+      if(!db->collection_filter_val) break;
+      while(cd > db->collection_filter_val) cd /= 10;
+      if(cd != db->collection_filter_val) continue;
       break;
+    }
     case s_prop_filetype:
       if(dt_graph_default_input_module(db->image[k].filename) != db->collection_filter_val) continue;
       break;
     }
     db->collection[db->collection_cnt++] = k;
   }
-  // TODO: use db/tests/parallel radix sort
-  switch(db->collection_sort)
-  {
-  case s_prop_none:
-    break;
-  case s_prop_filename:
-    qsort_r(db->collection, db->collection_cnt, sizeof(db->collection[0]), compare_filename, db);
-    break;
-  case s_prop_rating:
-    qsort_r(db->collection, db->collection_cnt, sizeof(db->collection[0]), compare_rating, db);
-    break;
-  case s_prop_labels:
-    qsort_r(db->collection, db->collection_cnt, sizeof(db->collection[0]), compare_labels, db);
-    break;
-  case s_prop_createdate:
-    qsort_r(db->collection, db->collection_cnt, sizeof(db->collection[0]), compare_createdate, db);
-    break;
-  case s_prop_filetype:
-    qsort_r(db->collection, db->collection_cnt, sizeof(db->collection[0]), compare_filetype, db);
-    break;
-  }
 }
 
-void dt_db_load_directory(
-    dt_db_t         *db,
-    dt_thumbnails_t *thumbnails,
-    const char      *dirname)
+static void
+db_alloc(dt_db_t *db, uint32_t image_max, uint32_t avg_len)
 {
-  uint32_t id = 0;
-  if(dt_thumbnails_load_one(thumbnails, "data/busybee.bc1", &id) != VK_SUCCESS)
-  {
-    dt_log(s_log_err|s_log_db, "could not load required thumbnail symbols!");
-    return;
-  }
-
-  DIR *dp = dirname ? opendir(dirname) : 0;
-  if(!dp)
-  {
-    dt_log(s_log_err|s_log_db, "could not open directory '%s'!", dirname);
-    return;
-  }
-  struct dirent *ep;
-  db->image_max = 0;
-  while((ep = readdir(dp)))
-  {
-    if(ep->d_type != DT_REG && ep->d_type != DT_LNK) continue;
-    if(!dt_db_accept_filename(ep->d_name)) continue;
-    db->image_max++;
-  }
+  sorted_reset(db);
+  db->image_max = image_max;
 
   db->image = malloc(sizeof(dt_image_t)*db->image_max);
   memset(db->image, 0, sizeof(dt_image_t)*db->image_max);
@@ -216,60 +515,228 @@ void dt_db_load_directory(
   db->selection = malloc(sizeof(uint32_t)*db->selection_max);
 
   // you would not believe how lengthy people name their files:
-  dt_stringpool_init(&db->sp_filename, db->collection_max, 50);
+  dt_stringpool_init(&db->sp_filename, db->collection_max, MAX(50, avg_len));
+}
 
+static void
+db_set_dirname(dt_db_t *db, const char *dirname)
+{
   snprintf(db->dirname, sizeof(db->dirname), "%s", dirname);
   char *c = db->dirname + strlen(db->dirname) - 1;
   if(*c == '/') *c = 0; // remove trailing '/'
+}
 
-  // the gui thread in main.c starts two background threads creating thumbnails, if needed.
-  // thumbnails_load_list() will load the created bc1, triggered in render.cc
-  rewinddir(dp);
-  char cfgfile[1500];
+// read the tag index of a tag collection in one go. the images are stored
+// with their absolute path (without .cfg), so nothing in the directory needs
+// to be listed or resolved. returns non-zero if there is no index.
+static int
+tag_index_read(dt_db_t *db, const char *dirname)
+{
+  char fn[1100];
+  snprintf(fn, sizeof(fn), "%s/tag.idx", dirname);
+  FILE *f = fopen(fn, "rb");
+  if(!f) return 1;
+  fseek(f, 0, SEEK_END);
+  const size_t size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  char *buf = malloc(size + 1);
+  if(!buf || fread(buf, 1, size, f) != size)
+  {
+    free(buf);
+    fclose(f);
+    return 1;
+  }
+  fclose(f);
+  buf[size] = 0;
+  uint32_t line_cnt = 1; // last line may come without newline
+  for(size_t i=0;i<size;i++) line_cnt += buf[i] == '\n';
+
+  db_alloc(db, line_cnt, size / MAX(1, line_cnt) + 1);
+  db_set_dirname(db, dirname);
+  db->tag_index = 1;
+  for(char *line = buf, *next; line < buf + size; line = next)
+  {
+    char *end = strchr(line, '\n');
+    if(!end) end = buf + size;
+    next = end + 1;
+    *end = 0;
+    // <hash64 of the cfg path> <absolute cfg path>
+    char *path = strchr(line, ' ');
+    if(!path || path[1] != '/' || db->image_cnt >= db->image_max) continue;
+    path++;
+    int len = end - path;
+    if(len > 4 && !strcasecmp(path + len - 4, ".cfg")) len -= 4;
+    const uint32_t imgid = db->image_cnt;
+    image_init(db->image + imgid);
+    if(dt_stringpool_get(&db->sp_filename, path, len, imgid, &db->image[imgid].filename) != imgid)
+      continue; // tagged twice or out of memory
+    db->image_cnt++;
+  }
+  free(buf);
+  return 0;
+}
+
+static int
+tag_index_write(const dt_db_t *db)
+{
+  char fn[1100], tmp[1100], cfg[PATH_MAX+100];
+  snprintf(fn,  sizeof(fn),  "%s/tag.idx", db->dirname);
+  snprintf(tmp, sizeof(tmp), "%s/tag.idx.tmp", db->dirname);
+  FILE *f = fopen(tmp, "wb");
+  if(!f) return 1;
+  for(uint32_t i=0;i<db->image_cnt;i++)
+    if(!dt_db_image_path(db, i, cfg, sizeof(cfg)))
+      fprintf(f, "%"PRIx64" %s\n", hash64(cfg), cfg);
+  fclose(f);
+  return rename(tmp, fn);
+}
+
+// a tag collection from before the index: replace the symlink names by the
+// absolute paths they point to (keeping the ratings just read from vkdt.db)
+// and write the index, so this directory is never listed again.
+static void
+tag_index_migrate(dt_db_t *db)
+{
+  char tags[1040];
+  int len = snprintf(tags, sizeof(tags), "%s/tags/", db->basedir);
+  if(strncmp(db->dirname, tags, len) || strchr(db->dirname + len, '/')) return;
+
+  dt_stringpool_t sp;
+  dt_stringpool_init(&sp, db->image_max, 256);
+  char fn[PATH_MAX+100], target[PATH_MAX];
+  uint32_t cnt = 0;
+  for(uint32_t i=0;i<db->image_cnt;i++)
+  {
+    dt_db_image_path(db, i, fn, sizeof(fn));
+    ssize_t tl = readlink(fn, target, sizeof(target)-1);
+    if(tl > 0 && target[0] == '/') target[tl] = 0;
+    else if(!realpath(fn, target)) continue; // dangling, the image is gone
+    tl = strlen(target);
+    if(tl > 4 && !strcasecmp(target + tl - 4, ".cfg")) tl -= 4;
+    if(dt_stringpool_get(&sp, target, tl, cnt, &db->image[i].filename) != cnt) continue;
+    db->image[cnt++] = db->image[i];
+  }
+  dt_stringpool_cleanup(&db->sp_filename);
+  db->sp_filename = sp;
+  db->image_cnt = cnt;
+  db->sorted_valid = 0;
+  db->tag_index = 1;
+  if(tag_index_write(db))
+    dt_log(s_log_err|s_log_db, "could not write tag index for '%s'", db->dirname);
+  else
+    dt_log(s_log_db, "migrated %u images of '%s' to a tag index", cnt, db->dirname);
+}
+
+int dt_db_scan_directory(
+    dt_db_t    *db,
+    const char *dirname)
+{
+  if(dirname && !tag_index_read(db, dirname))
+  {
+    char dbname[1040];
+    snprintf(dbname, sizeof(dbname), "%s/vkdt.db", db->dirname);
+    dt_db_read(db, dbname);
+    return 0;
+  }
+  DIR *dp = dirname ? opendir(dirname) : 0;
+  if(!dp)
+  {
+    dt_log(s_log_err|s_log_db, "could not open directory '%s'!", dirname);
+    return 1;
+  }
+  // read the directory only once and keep the names. the listing also tells us
+  // which images come with a .cfg already, so there is no need to stat() the
+  // files one by one, which is slow on network file systems.
   clock_t beg = clock();
+  struct dirent *ep;
+  const int dfd = dirfd(dp);
+  uint32_t name_cnt = 0, name_max = 0, *name_off = 0;
+  size_t names_len = 0, names_max = 0;
+  char *names = 0;
   while((ep = readdir(dp)))
   {
-    if(ep->d_type != DT_REG && ep->d_type != DT_LNK) continue;
+    if(ep->d_type == DT_UNKNOWN)
+    { // some file systems don't fill d_type
+      struct stat statbuf;
+      if(fstatat(dfd, ep->d_name, &statbuf, 0) || !S_ISREG(statbuf.st_mode)) continue;
+    }
+    else if(ep->d_type != DT_REG && ep->d_type != DT_LNK) continue;
     if(!dt_db_accept_filename(ep->d_name)) continue;
+    const size_t len = strlen(ep->d_name) + 1;
+    if(name_cnt == name_max)
+      name_off = realloc(name_off, sizeof(uint32_t)*(name_max = 2*name_max + 256));
+    if(names_len + len > names_max)
+      names = realloc(names, names_max = 2*names_max + 4096 + len);
+    name_off[name_cnt++] = names_len;
+    memcpy(names + names_len, ep->d_name, len);
+    names_len += len;
+  }
+  closedir(dp);
+  const uint32_t avg_len = names_len / MAX(1, name_cnt) + 1;
+  db_alloc(db, name_cnt, avg_len);
+  db_set_dirname(db, dirname);
 
-    const uint32_t imgid = db->image_cnt++;
-    image_init(db->image + imgid);
+  // index the listing to look up the .cfg files:
+  dt_stringpool_t sp_listing;
+  dt_stringpool_init(&sp_listing, name_cnt, avg_len);
+  for(uint32_t i=0;i<name_cnt;i++)
+    dt_stringpool_get(&sp_listing, names + name_off[i], strlen(names + name_off[i]), i, 0);
 
+  // the gui thread in main.c starts two background threads creating thumbnails, if needed.
+  // thumbnails_load_list() will load the created bc1, triggered in render.cc
+  char cfgfile[1500];
+  for(uint32_t i=0;i<name_cnt;i++)
+  {
+    const char *name = names + name_off[i];
     // now reject non-cfg files that have a cfg already:
-    int ep_len = strlen(ep->d_name);
+    int ep_len = strlen(name);
     if(ep_len > 4)
     {
-      snprintf(cfgfile, sizeof(cfgfile), "%s/%s", db->dirname, ep->d_name);
-      int len = strlen(cfgfile);
-      char *f2 = cfgfile + len - 4;
-      if(strcasecmp(f2, ".cfg"))
-      { // not a cfg itself
-        sprintf(f2+4, ".cfg"); // this would be the corresponding default cfg
-        struct stat statbuf = {0};
-        if(!stat(cfgfile, &statbuf))
-        { // skip this image, it already has a cfg associated with it, we'll load that:
-          db->image_cnt--;
-          continue;
-        }
+      if(strcasecmp(name + ep_len - 4, ".cfg"))
+      { // not a cfg itself, see whether the corresponding default cfg is in the listing
+        int len = snprintf(cfgfile, sizeof(cfgfile), "%s.cfg", name);
+        if(len < (int)sizeof(cfgfile) && dt_stringpool_get(&sp_listing, cfgfile, len, -1u, 0) != -1u)
+          continue; // skip this image, it already has a cfg associated with it, we'll load that
       }
       else ep_len -= 4; // remove '.cfg' suffix
     }
 
+    const uint32_t imgid = db->image_cnt++;
+    image_init(db->image + imgid);
+
     // add base filename to string pool
-    if(dt_stringpool_get(&db->sp_filename, ep->d_name, ep_len, imgid, &db->image[imgid].filename) == -1u)
+    if(dt_stringpool_get(&db->sp_filename, name, ep_len, imgid, &db->image[imgid].filename) == -1u)
     {
       dt_log(s_log_err|s_log_db, "failed to add filename to index! aborting import.");
       db->image_cnt--;
       break; // no use trying again
     }
   }
+  dt_stringpool_cleanup(&sp_listing);
+  free(names);
+  free(name_off);
   clock_t end = clock();
   dt_log(s_log_perf|s_log_db, "time to load images %2.3fs", (end-beg)/(double)CLOCKS_PER_SEC);
 
-  char dbname[256];
-  snprintf(dbname, sizeof(dbname), "%s/vkdt.db", dirname);
+  char dbname[1040];
+  snprintf(dbname, sizeof(dbname), "%s/vkdt.db", db->dirname);
   dt_db_read(db, dbname);
+  tag_index_migrate(db);
+  return 0;
+}
 
+void dt_db_load_directory(
+    dt_db_t         *db,
+    dt_thumbnails_t *thumbnails,
+    const char      *dirname)
+{
+  uint32_t id = 0;
+  if(dt_thumbnails_load_one(thumbnails, "data/busybee.bc1", &id) != VK_SUCCESS)
+  {
+    dt_log(s_log_err|s_log_db, "could not load required thumbnail symbols!");
+    return;
+  }
+  if(dt_db_scan_directory(db, dirname)) return;
   dt_db_update_collection(db);
 }
 
@@ -279,6 +746,7 @@ int dt_db_load_image(
     const char      *filename)
 {
   if(!dt_db_accept_filename(filename)) return 1;
+  sorted_reset(db);
   db->image_max = 1;
   int len = strnlen(filename, 2048);
   if(len > 4 && !strcasecmp(filename+len-4, ".cfg"))
@@ -484,6 +952,27 @@ int dt_db_read(dt_db_t *db, const char *filename)
         db->image[imgid].rating = num;
       else if(!strcasecmp(what, "labels"))
         db->image[imgid].labels = num;
+      else if(!strcasecmp(what, "exif"))
+        db->image[imgid].exif_key = num;
+      else if(!strcasecmp(what, "createdate"))
+        db->image[imgid].createdate = num;
+      else if(!strcasecmp(what, "model"))
+      { // the rest of the line, may contain spaces
+        const char *m = line + strlen(imgn) + strlen(what) + 2;
+        if((size_t)(m - line) < strlen(line)) snprintf(db->image[imgid].model, sizeof(db->image[imgid].model), "%s", m);
+      }
+      else if(!strcasecmp(what, "lens"))
+      {
+        const char *m = line + strlen(imgn) + strlen(what) + 2;
+        if((size_t)(m - line) < strlen(line)) snprintf(db->image[imgid].lens, sizeof(db->image[imgid].lens), "%s", m);
+      }
+      else if(!strcasecmp(what, "shot"))
+      { // exposure aperture iso focal length
+        dt_image_t *img = db->image + imgid;
+        const char *m = line + strlen(imgn) + strlen(what) + 2;
+        if((size_t)(m - line) < strlen(line))
+          sscanf(m, "%g %g %g %g", &img->exposure, &img->aperture, &img->iso, &img->focal_length);
+      }
       else
         dt_log(s_log_db|s_log_err, "no such property in line %u: '%s'", lno, line);
     }
@@ -508,62 +997,275 @@ int dt_db_write(const dt_db_t *db, const char *filename, int append)
   {
     if( db->image[i].rating          > 0) fprintf(f, "%s:rating:%u\n", db->image[i].filename, db->image[i].rating);
     if((db->image[i].labels&0x7fffu) > 0) fprintf(f, "%s:labels:%u\n", db->image[i].filename, db->image[i].labels & 0x7fffu); // mask selection bit
+    if(db->image[i].exif_key)
+    { // cached exif, valid as long as the file has the same mtime and size
+      fprintf(f, "%s:exif:%"PRIu64"\n%s:createdate:%"PRIu64"\n", db->image[i].filename, db->image[i].exif_key,
+          db->image[i].filename, db->image[i].createdate);
+      if(db->image[i].model[0]) fprintf(f, "%s:model:%s\n", db->image[i].filename, db->image[i].model);
+      if(db->image[i].lens[0])  fprintf(f, "%s:lens:%s\n",  db->image[i].filename, db->image[i].lens);
+      fprintf(f, "%s:shot:%g %g %g %g\n", db->image[i].filename, db->image[i].exposure,
+          db->image[i].aperture, db->image[i].iso, db->image[i].focal_length);
+    }
   }
   fclose(f);
   return 0;
 }
 
+int dt_db_journal(dt_db_t *db, const uint32_t *imgid, uint32_t cnt)
+{
+  if(db->image_cnt <= 1 || !db->dirname[0] || !cnt) return 0;
+  if(db->journal_cnt + 2*cnt > MAX(1024, 2*db->image_cnt))
+  { // compact
+    db_write_back(db);
+    return db->journal_cnt != 0;
+  }
+  char dbname[1040];
+  snprintf(dbname, sizeof(dbname), "%s/vkdt.db", db->dirname);
+  FILE *f = fopen(dbname, "ab");
+  if(!f) return 1;
+  for(uint32_t i=0;i<cnt;i++) if(imgid[i] < db->image_cnt)
+  {
+    const dt_image_t *img = db->image + imgid[i];
+    fprintf(f, "%s:rating:%u\n%s:labels:%u\n", img->filename, img->rating, img->filename, img->labels & 0x7fffu);
+    db->journal_cnt += 2;
+  }
+  return fclose(f) != 0;
+}
+
 int dt_db_image_path(const dt_db_t *db, const uint32_t imgid, char *fn, uint32_t maxlen)
 {
-  if(db->dirname[0])
+  if(db->dirname[0] && db->image[imgid].filename[0] != '/') // tag collections store absolute paths
     return snprintf(fn, maxlen, "%s/%s.cfg", db->dirname, db->image[imgid].filename) >= maxlen;
   else
     return snprintf(fn, maxlen, "%s.cfg", db->image[imgid].filename) >= maxlen;
 }
 
-// add image to named collection/tag
-// get image_path, get hash
-// create directory ~/.config/vkdt/tags/<tag>/ and link <hash> to our image path
-// use relative path names in link? still useful if ~/.config top level?
+// add image to named collection/tag:
+// create directory ~/.config/vkdt/tags/<tag>/ and append the hash and full
+// path of the image's cfg to the tag.idx file in there.
 int dt_db_add_to_collection(const dt_db_t *db, const uint32_t imgid, const char *cname)
 {
-  char filename[PATH_MAX+100];
+  char filename[PATH_MAX+100], realname[PATH_MAX];
   dt_db_image_path(db, imgid, filename, sizeof(filename));
+  if(!realpath(filename, realname)) // the cfg may not exist yet
+    snprintf(realname, sizeof(realname), "%s", filename);
+  if(realname[0] != '/') return 1; // the index needs absolute paths
 
-  uint64_t hash = hash64(filename);
   char dirname[1040];
   snprintf(dirname, sizeof(dirname), "%s/tags", db->basedir);
   fs_mkdir(dirname, 0755);
   snprintf(dirname, sizeof(dirname), "%s/tags/%s", db->basedir, cname);
   fs_mkdir(dirname, 0755); // ignore error, might exist already (which is fine)
-  char linkname[1040];
-  snprintf(linkname, sizeof(linkname), "%s/tags/%s/%lx.cfg", db->basedir, cname, hash);
-  int err = symlink(filename, linkname);
-  if(err) return 1;
+  char idxname[1100];
+  snprintf(idxname, sizeof(idxname), "%s/tag.idx", dirname);
+  FILE *f = fopen(idxname, "ab");
+  if(!f) return 1;
+  fprintf(f, "%"PRIx64" %s\n", hash64(realname), realname);
+  fclose(f);
+  return 0;
+}
+
+int dt_db_tag_export_symlinks(const char *basedir, const char *cname)
+{
+  char fn[1100], linkname[1100];
+  snprintf(fn, sizeof(fn), "%s/tags/%s/tag.idx", basedir, cname);
+  FILE *f = fopen(fn, "rb");
+  if(!f) return 1;
+  char line[PATH_MAX+30];
+  while(fgets(line, sizeof(line), f))
+  {
+    char *path = strchr(line, ' ');
+    if(!path) continue;
+    *path++ = 0;
+    path[strcspn(path, "\n")] = 0;
+    snprintf(linkname, sizeof(linkname), "%s/tags/%s/%s.cfg", basedir, cname, line);
+    if(symlink(path, linkname) && errno != EEXIST)
+      dt_log(s_log_err|s_log_db, "could not create symlink '%s'", linkname);
+  }
+  fclose(f);
+  return 0;
+}
+
+// copy the full .cfg paths of the selection into the job
+static void
+fileop_init(dt_db_t *db, dt_db_fileop_t *job, dt_db_fileop_op_t op, uint32_t skip)
+{
+  dt_db_fileop_cleanup(job);
+  job->op = op;
+  job->name_off = malloc(sizeof(uint32_t)*db->selection_cnt);
+  job->imgid    = malloc(sizeof(uint32_t)*db->selection_cnt);
+  size_t len = 0, max = 0;
+  char fn[PATH_MAX+100];
+  for(uint32_t i=0;i<db->selection_cnt;i++)
+  {
+    if(db->selection[i] == skip) continue;
+    if(dt_db_image_path(db, db->selection[i], fn, sizeof(fn))) continue;
+    const size_t l = strlen(fn) + 1;
+    if(len + l > max) job->names = realloc(job->names, max = 2*max + l + 4096);
+    memcpy(job->names + len, fn, l);
+    job->imgid[job->cnt] = db->selection[i];
+    job->name_off[job->cnt++] = len;
+    len += l;
+  }
+}
+
+static void
+fileop_delete(uint32_t item, void *data)
+{
+  dt_db_fileop_t *job = data;
+  char fullfn[PATH_MAX+100];
+  snprintf(fullfn, sizeof(fullfn), "%s", job->names + job->name_off[item]);
+  dt_log(s_log_db, "deleting `%s'", fullfn);
+  int err = unlink(fullfn);
+  // delete the file without .cfg postfix
+  size_t len = strnlen(fullfn, sizeof(fullfn));
+  fullfn[len-4] = 0;
+  dt_log(s_log_db, "deleting `%s'", fullfn);
+  unlink(fullfn); // not there for duplicates, which is fine
+  if(err) __atomic_add_fetch(&job->err, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&job->done, 1, __ATOMIC_RELEASE);
+  if(job->ufn) job->ufn();
+}
+
+static void
+fileop_duplicate(uint32_t item, void *data)
+{
+  dt_db_fileop_t *job = data;
+  const char *fullfn = job->names + job->name_off[item];
+  char fn[PATH_MAX+200];
+  int len = strlen(fullfn) - 4; // without .cfg
+  if(len > 3 && fullfn[len-3] == '_' && isdigit(fullfn[len-2]) && isdigit(fullfn[len-1]))
+    len -= 3; // remove _?? suffix
+
+  int k = 1;
+  for(;k<100;k++)
+  { // now append new index and claim the first free name. other items of this
+    // job may probe the same names concurrently, so create it exclusively:
+    if(snprintf(fn, sizeof(fn), "%.*s_%02d.cfg", len, fullfn, k) >= (int)sizeof(fn)) { k = 100; break; }
+    int fd = open(fn, O_CREAT | O_EXCL | O_WRONLY, 0644);
+    if(fd != -1) { close(fd); break; } // found empty slot
+    if(errno != EEXIST) { k = 100; break; }
+  }
+  if(k < 100)
+  {
+    dt_log(s_log_db, "creating duplicate `%s'", fn);
+    if(fs_copy(fn, fullfn))
+    { // that went wrong, try to copy default config:
+      char imgfn[PATH_MAX+100];
+      snprintf(imgfn, sizeof(imgfn), "%.*s", (int)strlen(fullfn) - 4, fullfn); // we'll work with the full file name, symlinks do not work
+      dt_token_t input_module = dt_graph_default_input_module(imgfn);
+      char defcfg[PATH_MAX+30];
+      snprintf(defcfg, sizeof(defcfg), "%s/default-darkroom.%" PRItkn, dt_pipe.basedir, dt_token_str(input_module));
+      fs_copy(fn, defcfg);
+      FILE *f = fopen(fn, "ab");
+      if(f)
+      { // cut away directory part and potential _XX duplicate id
+        imgfn[len] = 0;
+        fprintf(f, "param:%"PRItkn":main:filename:%s\n", dt_token_str(input_module), fs_basename(imgfn));
+        fclose(f);
+      }
+    }
+  }
+  else __atomic_add_fetch(&job->err, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&job->done, 1, __ATOMIC_RELEASE);
+  if(job->ufn) job->ufn();
+}
+
+static void
+fileop_paste(uint32_t item, void *data)
+{
+  dt_db_fileop_t *job = data;
+  const char *fullfn = job->names + job->name_off[item];
+  char dst[PATH_MAX];
+  if(!realpath(fullfn, dst)) // write through symlinks, the cfg may not exist yet
+    snprintf(dst, sizeof(dst), "%s", fullfn);
+  FILE *f = fopen(dst, "wb");
+  int err = !f;
+  if(f)
+  {
+    err |= fwrite(job->data, job->data_len, 1, f) != 1 && job->data_len;
+    char imgfn[PATH_MAX];
+    int len = strlen(dst) - 4; // without .cfg
+    snprintf(imgfn, sizeof(imgfn), "%.*s", len, dst);
+    if(len > 3 && imgfn[len-3] == '_' && isdigit(imgfn[len-2]) && isdigit(imgfn[len-1]))
+      imgfn[len-3] = 0; // remove _?? duplicate suffix
+    // the last line wins: point the input module to this image
+    const dt_token_t input_module = dt_graph_default_input_module(imgfn);
+    fprintf(f, "param:%"PRItkn":main:filename:%s\n", dt_token_str(input_module), fs_basename(imgfn));
+    err |= fclose(f) != 0;
+  }
+  if(err) __atomic_add_fetch(&job->err, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&job->done, 1, __ATOMIC_RELEASE);
+  if(job->ufn) job->ufn();
+}
+
+static int
+fileop_start(dt_db_fileop_t *job)
+{
+  if(!job->cnt)
+  {
+    dt_db_fileop_cleanup(job);
+    return 1;
+  }
+  static const char *name[] = { "delete", "duplicate", "paste" };
+  void (*work[])(uint32_t, void*) = { fileop_delete, fileop_duplicate, fileop_paste };
+  job->taskid = threads_task_background(name[job->op], job->cnt, -1, job, work[job->op], 0);
+  if(job->taskid < 0) // no thread pool or no free task, do it right here
+    for(uint32_t i=0;i<job->cnt;i++) work[job->op](i, job);
   return 0;
 }
 
+int dt_db_fileop_running(const dt_db_fileop_t *job)
+{
+  return job->cnt && __atomic_load_n(&job->done, __ATOMIC_ACQUIRE) < job->cnt;
+}
+
+float dt_db_fileop_progress(const dt_db_fileop_t *job)
+{
+  return job->cnt ? __atomic_load_n(&job->done, __ATOMIC_RELAXED) / (float)job->cnt : 1.0f;
+}
+
+void dt_db_fileop_cleanup(dt_db_fileop_t *job)
+{
+  void (*ufn)(void) = job->ufn;
+  free(job->names);
+  free(job->name_off);
+  free(job->imgid);
+  free(job->data);
+  memset(job, 0, sizeof(*job));
+  job->ufn = ufn;
+}
+
 void dt_db_remove_selected_images(
-    dt_db_t *db,
+    dt_db_t         *db,
     dt_thumbnails_t *thumbnails,
-    const int del)
+    dt_db_fileop_t  *job)
 {
   // sort selection array by id:
   qsort_r(db->selection, db->selection_cnt, sizeof(db->selection[0]), compare_id, db);
 
+  if(job && !db->tag_index)
+  { // the files go in the background, the names are copied before the images move around
+    fileop_init(db, job, s_fileop_delete, -1u);
+    fileop_start(job);
+  }
+
+  // remember where the images end up, to fix the sorted permutations afterwards
+  const uint32_t old_cnt = db->image_cnt;
+  uint32_t *orig = malloc(sizeof(uint32_t)*MAX(1, old_cnt));
+  for(uint32_t k=0;k<old_cnt;k++) orig[k] = k;
+
   // go through sorted list of imgid, largest id first:
   char fullfn[2048] = {0};
   for(int i=db->selection_cnt-1;i>=0;i--)
   {
-    if(del && !dt_db_image_path(db, db->selection[i], fullfn, sizeof(fullfn)))
-    { // delete the cfg if any
-      dt_log(s_log_db, "deleting `%s'", fullfn);
-      unlink(fullfn);
-      // delete the file without .cfg postfix
-      size_t len = strnlen(fullfn, sizeof(fullfn));
-      fullfn[len-4] = 0;
-      dt_log(s_log_db, "deleting `%s'", fullfn);
-      unlink(fullfn);
+    if(job && db->tag_index && !dt_db_image_path(db, db->selection[i], fullfn, sizeof(fullfn)))
+    { // deleting from a tag only removes the image from the tag (and the compatibility symlink)
+      char linkname[2100];
+      snprintf(linkname, sizeof(linkname), "%s/%"PRIx64".cfg", db->dirname, hash64(fullfn));
+      unlink(linkname);
+      snprintf(linkname, sizeof(linkname), "%s/%"PRIx64".cfg", db->dirname, hash64_legacy(fullfn));
+      unlink(linkname); // symlink from before the index
     }
     // swap this imgid with the last one in the db.
     // this will keep the db img list untouched up to here, so we can keep on doing this.
@@ -577,56 +1279,58 @@ void dt_db_remove_selected_images(
     if(keep_th != -1u) thumbnails->thumb[keep_th].imgid = gone;
     db->image[gone] = db->image[keep];
     db->image[keep].thumbnail = keep_th;
+    orig[gone] = orig[keep];
   }
 
+  if(job && db->tag_index && tag_index_write(db))
+    dt_log(s_log_err|s_log_db, "could not write tag index for '%s'", db->dirname);
+
+  // the sorted orders stay valid if we drop the removed images and rename the moved ones
+  uint32_t *newid = malloc(sizeof(uint32_t)*MAX(1, old_cnt));
+  for(uint32_t k=0;k<old_cnt;k++) newid[k] = -1u;
+  for(uint32_t k=0;k<db->image_cnt;k++) newid[orig[k]] = k;
+  for(int p=0;p<=s_prop_filetype;p++)
+  {
+    if(!(db->sorted_valid & (1u<<p))) continue;
+    uint32_t *s = db->sorted[p], cnt = 0;
+    for(uint32_t k=0;k<old_cnt;k++)
+      if(newid[s[k]] != -1u) s[cnt++] = newid[s[k]];
+  }
+  free(newid);
+  free(orig);
+
   // select none:
   db->selection_cnt = 0;
   // freshly filter and sort collection
   dt_db_update_collection(db);
 }
 
-void dt_db_duplicate_selected_images(dt_db_t *db)
+int dt_db_duplicate_selected_images(dt_db_t *db, dt_db_fileop_t *job)
 {
-  char fn[PATH_MAX+200], fullfn[PATH_MAX];
-  for(int i=0;i<db->selection_cnt;i++)
+  fileop_init(db, job, s_fileop_duplicate, -1u);
+  return fileop_start(job);
+}
+
+int dt_db_paste_history(dt_db_t *db, uint32_t imgid, dt_db_fileop_t *job)
+{
+  char filename[PATH_MAX+100], src[PATH_MAX];
+  if(imgid >= db->image_cnt || dt_db_image_path(db, imgid, filename, sizeof(filename)) ||
+     !realpath(filename, src)) return 1;
+  FILE *f = fopen(src, "rb");
+  if(!f) return 1;
+  fseek(f, 0, SEEK_END);
+  const size_t size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  uint8_t *data = malloc(MAX(1, size));
+  const int err = fread(data, 1, size, f) != size;
+  fclose(f);
+  if(err)
   {
-    struct stat sb;
-    const char *ifn = db->image[db->selection[i]].filename;
-    int len = strnlen(ifn, 2048);
-    if(len > 3 && ifn[len-3] == '_' && isdigit(ifn[len-2]) && isdigit(ifn[len-1]))
-      len -= 3; // remove _?? suffix
-
-    for(int k=1;k<100;k++)
-    { // now append new index and probe until that file doesn't exist
-      int err = 0;
-      if(db->dirname[0])
-        err = snprintf(fn, sizeof(fn), "%s/%.*s_%02d.cfg", db->dirname, len, ifn, k) >= sizeof(fn);
-      else
-        err = snprintf(fn, sizeof(fn), "%.*s_%02d.cfg", len, ifn, k) >= sizeof(fn);
-      if(err) goto next;
-      if(stat(fn, &sb) == -1) break; // found empty slot
-      if(k == 99) goto next; // give up
-    }
-    dt_log(s_log_db, "creating duplicate `%s'", fn);
-    if(!dt_db_image_path(db, db->selection[i], fullfn, sizeof(fullfn)) && fs_copy(fn, fullfn))
-    { // that went wrong, try to copy default config:
-      int len = strlen(fullfn); // we'll work with the full file name, symlinks do not work
-      assert(len > 4);
-      fullfn[len-4] = 0; // cut away ".cfg"
-      dt_token_t input_module = dt_graph_default_input_module(fullfn);
-      char defcfg[PATH_MAX+30];
-      snprintf(defcfg, sizeof(defcfg), "%s/default-darkroom.%" PRItkn, dt_pipe.basedir, dt_token_str(input_module));
-      fs_copy(fn, defcfg);
-      FILE *f = fopen(fn, "ab");
-      if(f)
-      { // cut away directory part and potential _XX duplicate id
-        if(fullfn[len-7] == '_' && isdigit(fullfn[len-5]) && isdigit(fullfn[len-6]))
-          fullfn[len-7] = 0;
-        char *c = fs_basename(fullfn);
-        fprintf(f, "param:%"PRItkn":main:filename:%s\n", dt_token_str(input_module), c);
-        fclose(f);
-      }
-    }
-next:;
+    free(data);
+    return 1;
   }
+  fileop_init(db, job, s_fileop_paste, imgid);
+  job->data     = data;
+  job->data_len = size;
+  return fileop_start(job);
 }
@@ -24,6 +24,14 @@ typedef struct dt_image_t
   uint32_t    thumbnail; // index into thumbnails->thumb[] or -1u
   uint16_t    rating;    // -1u reject 0 1 2 3 4 5 stars
   uint16_t    labels;    // each bit is one colour label flag, 1<<15 is selected bit
+  uint64_t    exif_key;  // mtime and size of the file the fields below were read from, 0 if never
+  uint64_t    createdate;// exif create date as YYYYMMDDhhmmss
+  char        model[32]; // exif maker and model
+  char        lens[32];  // exif lens model
+  float       exposure;  // exposure time in seconds
+  float       aperture;  // f-number
+  float       iso;
+  float       focal_length; // in mm
 }
 dt_image_t;
 
@@ -31,12 +39,15 @@ dt_image_t;
 typedef struct dt_stringpool_entry_t dt_stringpool_entry_t;
 typedef struct dt_stringpool_t
 {
-  uint32_t entry_max;
+  uint32_t entry_max;  // size of the hash table, power of two
+  uint32_t entry_cnt;  // number of strings in the pool
   dt_stringpool_entry_t *entry;
 
-  uint32_t buf_max;
+  uint32_t buf_max;    // size of the current block of string memory
   uint32_t buf_cnt;
   char *buf;
+  char   **block;      // previous full blocks, kept so pointers to the strings stay valid
+  uint32_t block_cnt;
 }
 dt_stringpool_t;
 
@@ -76,6 +87,7 @@ typedef struct dt_db_t
 
   // string pool for image file names
   dt_stringpool_t sp_filename;
+  int tag_index;                // images come from dirname/tag.idx and have absolute file names
 
   // TODO: light table edit history
 
@@ -84,6 +96,10 @@ typedef struct dt_db_t
   dt_db_property_t collection_filter;
   uint64_t         collection_filter_val;
 
+  // permutations of all images sorted by property, see dt_db_update_collection()
+  uint32_t *sorted[s_prop_filetype+1];
+  uint32_t  sorted_valid; // bitmask of properties with an up to date permutation
+
   // current query
   uint32_t *collection;
   uint32_t  collection_cnt;
@@ -97,13 +113,41 @@ typedef struct dt_db_t
   // currently selected image (when switching to darkroom mode, e.g.)
   uint32_t current_imgid;
   uint32_t current_colid;
+
+  uint32_t journal_cnt;         // lines appended to vkdt.db since it was last written in full
 }
 dt_db_t;
 
 void dt_db_init   (dt_db_t *db);
 void dt_db_cleanup(dt_db_t *db);
 
+// states of recently visited directories, kept in memory so that going back
+// to one doesn't list the directory and read its vkdt.db again.
+#define DT_DB_RECENT_MAX 4
+typedef struct dt_db_recent_t
+{
+  dt_db_t db[DT_DB_RECENT_MAX];    // most recent first
+  int64_t stamp[DT_DB_RECENT_MAX]; // modification time of the directory when it was stashed
+  int     cnt;
+}
+dt_db_recent_t;
+
+// move the state of db to the front of the list and write its vkdt.db. the
+// oldest entry is cleaned up if the list is full. leaves db zeroed.
+void dt_db_recent_stash(dt_db_recent_t *recent, dt_db_t *db);
+
 typedef struct dt_thumbnails_t dt_thumbnails_t;
+// move the state of dirname out of the list to db. returns non-zero if there
+// is none or the directory changed since. images whose thumbnail slots have
+// been taken by other images in the meantime are marked for reload.
+int dt_db_recent_restore(
+    dt_db_recent_t  *recent,
+    dt_db_t         *db,
+    dt_thumbnails_t *thumbnails,
+    const char      *dirname);
+
+void dt_db_recent_cleanup(dt_db_recent_t *recent);
+
 void dt_db_load_directory(
     dt_db_t         *db,
     dt_thumbnails_t *thumbnails,
@@ -114,6 +158,12 @@ int dt_db_load_image(
     dt_thumbnails_t *thumbnails,
     const char      *filename);
 
+// list the images of the directory and read its vkdt.db, but don't touch
+// thumbnails or the collection. return non-zero if the directory can't be opened.
+int dt_db_scan_directory(
+    dt_db_t    *db,
+    const char *dirname);
+
 static inline int
 dt_db_accept_filename(
     const char *f)
@@ -170,22 +220,79 @@ uint32_t dt_db_filename_colid(dt_db_t *db, const char *basename);
 int dt_db_read (dt_db_t *db, const char *filename);
 int dt_db_write(const dt_db_t *db, const char *filename, int append);
 
+// record the current rating and labels of the images right away, by appending
+// a line for each to vkdt.db. later lines win when reading, and the file is
+// written in full again once the appended lines outnumber the images.
+int dt_db_journal(dt_db_t *db, const uint32_t *imgid, uint32_t cnt);
+
+// make sure the exif fields of the image are valid. this costs a stat()
+// if the cached data is still good, else the file is read.
+// returns non-zero if anything changed.
+int dt_db_update_exif(dt_db_t *db, uint32_t imgid);
+
+// same for all images of the db, on the thread pool.
+int dt_db_update_exif_all(dt_db_t *db);
+
 // fill full file name with directory and extension.
 // return 0 on success, else the buffer was too small.
 int dt_db_image_path(const dt_db_t *db, const uint32_t imgid, char *fn, uint32_t maxlen);
 
-// add image to named collection
+// add image to named collection, i.e. append it to ~/.config/vkdt/tags/<cname>/tag.idx
 int dt_db_add_to_collection(const dt_db_t *db, const uint32_t imgid, const char *cname);
+// compatibility export for other tools: create the <hash>.cfg symlinks of all
+// images of the tag next to its tag.idx. vkdt itself only reads the index.
+int dt_db_tag_export_symlinks(const char *basedir, const char *cname);
 // after changing filter and sort criteria, update the collection array
 void dt_db_update_collection(dt_db_t *db);
-// remove selection from database. pass del=1 to physically delete from disk
-void dt_db_remove_selected_images(dt_db_t *db, dt_thumbnails_t *th, const int del);
+// file operations on the selection which run as a job in the thread pool.
+// the job keeps its own copy of the file names, so the db may change or be
+// reloaded while it runs.
+typedef enum dt_db_fileop_op_t
+{
+  s_fileop_delete    = 0,
+  s_fileop_duplicate = 1,
+  s_fileop_paste     = 2,
+}
+dt_db_fileop_op_t;
+
+typedef struct dt_db_fileop_t
+{
+  int       taskid;   // thread pool task
+  dt_db_fileop_op_t op;
+  uint32_t  cnt;      // number of files, 0 if the job is idle
+  uint32_t  done;     // number of files processed, access atomically
+  uint32_t  err;      // number of failures, access atomically
+  uint32_t *name_off; // offsets of the full .cfg paths
+  char     *names;
+  uint32_t *imgid;    // image ids of the files when the job started, may be freed if the db changes
+  uint8_t  *data;     // history to paste
+  size_t    data_len;
+  void    (*ufn)(void); // called from the worker after every file, if set, and kept by cleanup
+}
+dt_db_fileop_t;
+
+// remove selection from database. pass a job to also physically delete the
+// files from disk in the background (the job must be idle). the cached sort
+// orders are updated in place.
+void dt_db_remove_selected_images(dt_db_t *db, dt_thumbnails_t *th, dt_db_fileop_t *job);
 // sets the current image to given collection id. pass -1u to clear.
 void dt_db_current_set(dt_db_t *db, uint32_t colid);
-// duplicate selected images:
+// duplicate selected images in the background (the job must be idle):
 // this writes only new .cfg files next to the old ones, with _01 _02 etc suffixes added.
 // the reason why it doesn't update the db is because there may be thumbnailing processes
 // running that will need a restart and the collection management might need to resize the
-// internal storage anyways. this is all done at once by calling dt_gui_switch_collection,
-// which by separation of concerns also cares about the thumbnail creation (the db doesn't).
-void dt_db_duplicate_selected_images(dt_db_t *db);
+// internal storage anyways. this is all done at once by calling dt_gui_switch_collection
+// once the job is done, which by separation of concerns also cares about the thumbnail
+// creation (the db doesn't). returns non-zero if the job could not be started.
+int dt_db_duplicate_selected_images(dt_db_t *db, dt_db_fileop_t *job);
+// overwrite the .cfg files of the selection with the history of the given
+// image in the background (the job must be idle), pointing each to its own
+// input file. the image itself is skipped. returns non-zero if the job could
+// not be started.
+int dt_db_paste_history(dt_db_t *db, uint32_t imgid, dt_db_fileop_t *job);
+// returns 1 while the job works on its files
+int dt_db_fileop_running(const dt_db_fileop_t *job);
+// progress in [0,1]
+float dt_db_fileop_progress(const dt_db_fileop_t *job);
+// free the job after it is done, so it can be started again
+void dt_db_fileop_cleanup(dt_db_fileop_t *job);
@@ -0,0 +1,248 @@
+#include "dircache.h"
+#include "core/core.h"
+#include "core/log.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+typedef struct dircache_job_t
+{
+  dt_dircache_t *c;
+  int            slot;
+  char           path[PATH_MAX];
+}
+dircache_job_t;
+
+static int
+compare_name(const void *a, const void *b)
+{
+  return strcmp(((const dt_dircache_entry_t *)a)->name, ((const dt_dircache_entry_t *)b)->name);
+}
+
+// read the directory into a fresh entry array and name buffer
+static void
+dircache_read(
+    const char           *path,
+    uint32_t             *cnt_out,
+    dt_dircache_entry_t **ent_out,
+    char                **names_out)
+{
+  uint32_t cnt = 0, max = 0;
+  size_t len = 0, len_max = 0;
+  dt_dircache_entry_t *ent = 0;
+  char *names = 0;
+  DIR *dir = opendir(path);
+  for(struct dirent *d;dir && (d = readdir(dir));)
+  {
+    const size_t l = strlen(d->d_name) + 1;
+    if(cnt >= max)          ent   = realloc(ent,   sizeof(ent[0])*(max = MAX(256, 2*max)));
+    if(len + l > len_max)   names = realloc(names, len_max = MAX(4096, 2*len_max + l));
+    memcpy(names + len, d->d_name, l);
+    uint8_t type = d->d_type;
+    if(type == DT_UNKNOWN)
+    { // some network and fuse file systems don't tell us
+      struct stat sb;
+      if(!fstatat(dirfd(dir), d->d_name, &sb, 0))
+        type = S_ISDIR(sb.st_mode) ? DT_DIR : S_ISLNK(sb.st_mode) ? DT_LNK : DT_REG;
+    }
+    ent[cnt++] = (dt_dircache_entry_t){ .name = (const char *)len, .type = type };
+    len += l;
+  }
+  if(dir) closedir(dir);
+  for(uint32_t i=0;i<cnt;i++) ent[i].name = names + (size_t)ent[i].name; // names don't move any more
+  qsort(ent, cnt, sizeof(ent[0]), compare_name);
+  *cnt_out   = cnt;
+  *ent_out   = ent;
+  *names_out = names;
+}
+
+static void
+dircache_work(uint32_t item, void *arg)
+{
+  dircache_job_t *j = arg;
+  dt_dircache_list_t *l = j->c->list + j->slot;
+  uint32_t cnt;
+  dt_dircache_entry_t *ent;
+  char *names;
+  dircache_read(j->path, &cnt, &ent, &names);
+  threads_mutex_lock(&j->c->mutex);
+  free(l->pending_ent);
+  free(l->pending_names);
+  l->pending_cnt   = cnt;
+  l->pending_ent   = ent;
+  l->pending_names = names;
+  l->pending  = 1;
+  l->scanning = 0;
+  threads_mutex_unlock(&j->c->mutex);
+  if(j->c->ufn) j->c->ufn();
+}
+
+static void
+dircache_job_free(void *arg)
+{
+  free(arg);
+}
+
+static void
+dircache_scan(
+    dt_dircache_t *c,
+    int            slot)
+{
+  dt_dircache_list_t *l = c->list + slot;
+  dircache_job_t *j = malloc(sizeof(*j));
+  *j = (dircache_job_t){ .c = c, .slot = slot };
+  snprintf(j->path, sizeof(j->path), "%s", l->path);
+  l->scanning = 1;
+  l->dirty    = 0;
+  l->time     = dt_time();
+  if(threads_task("dirscan", 1, -1, j, dircache_work, dircache_job_free) < 0)
+  { // no thread pool or no free task, read it right here
+    dircache_work(0, j);
+    free(j);
+  }
+}
+
+static void
+dircache_free_list(
+    dt_dircache_t      *c,
+    dt_dircache_list_t *l)
+{
+  if(l->wd >= 0 && c->fd >= 0)
+  { // the watch is per inode, other lists may have reached it through a different path
+    int shared = 0;
+    for(int i=0;i<DT_DIRCACHE_SIZE;i++)
+      if(c->list + i != l && c->list[i].path[0] && c->list[i].wd == l->wd) shared = 1;
+    if(!shared) inotify_rm_watch(c->fd, l->wd);
+  }
+  free(l->ent);
+  free(l->names);
+  free(l->pending_ent);
+  free(l->pending_names);
+  memset(l, 0, sizeof(*l));
+  l->wd = -1;
+}
+
+// drain the inotify events and mark the affected lists
+static void
+dircache_poll(dt_dircache_t *c)
+{
+  if(c->fd < 0) return;
+  char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  ssize_t len;
+  while((len = read(c->fd, buf, sizeof(buf))) > 0)
+  {
+    for(char *p=buf;p<buf+len;)
+    {
+      const struct inotify_event *ev = (const struct inotify_event *)p;
+      for(int i=0;i<DT_DIRCACHE_SIZE;i++)
+      { // if the queue overflowed we don't know what changed
+        dt_dircache_list_t *l = c->list + i;
+        if(!l->path[0] || (l->wd != ev->wd && !(ev->mask & IN_Q_OVERFLOW))) continue;
+        l->dirty = 1;
+        if(ev->mask & IN_IGNORED) l->wd = -1; // directory went away, the watch is gone
+      }
+      p += sizeof(struct inotify_event) + ev->len;
+    }
+  }
+}
+
+void
+dt_dircache_init(dt_dircache_t *c)
+{
+  memset(c, 0, sizeof(*c));
+  threads_mutex_init(&c->mutex, 0);
+  c->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if(c->fd < 0) dt_log(s_log_db, "[dircache] no inotify, directory listings will be read every second");
+  for(int i=0;i<DT_DIRCACHE_SIZE;i++) c->list[i].wd = -1;
+}
+
+void
+dt_dircache_cleanup(dt_dircache_t *c)
+{
+  for(int i=0;i<DT_DIRCACHE_SIZE;i++)
+  { // jobs write to their list, wait for them unless the thread pool is gone already
+    while(!threads_shutting_down())
+    {
+      threads_mutex_lock(&c->mutex);
+      const int scanning = c->list[i].scanning;
+      threads_mutex_unlock(&c->mutex);
+      if(!scanning) break;
+      sched_yield();
+    }
+    dircache_free_list(c, c->list + i);
+  }
+  if(c->fd >= 0) close(c->fd);
+  c->fd = -1;
+  threads_mutex_destroy(&c->mutex);
+}
+
+const dt_dircache_list_t *
+dt_dircache_get(
+    dt_dircache_t *c,
+    const char    *path)
+{
+  dircache_poll(c);
+  int slot = -1, lru = -1;
+  threads_mutex_lock(&c->mutex);
+  for(int i=0;i<DT_DIRCACHE_SIZE;i++)
+  {
+    if(!strcmp(c->list[i].path, path)) { slot = i; break; }
+    if(c->list[i].scanning) continue; // can't evict lists which are being written to
+    if(lru < 0 || c->list[i].lru < c->list[lru].lru) lru = i;
+  }
+  threads_mutex_unlock(&c->mutex);
+  if(slot < 0)
+  { // not cached, replace the least recently used list
+    static const dt_dircache_list_t busy = { .wd = -1 };
+    if(lru < 0) return &busy; // all lists are being read, ask again later
+    dt_dircache_list_t *l = c->list + lru;
+    dircache_free_list(c, l);
+    snprintf(l->path, sizeof(l->path), "%s", path);
+    if(c->fd >= 0)
+      l->wd = inotify_add_watch(c->fd, path,
+          IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF);
+    slot = lru;
+  }
+  dt_dircache_list_t *l = c->list + slot;
+  l->lru = ++c->clock;
+
+  threads_mutex_lock(&c->mutex);
+  const int busy = l->scanning || l->pending;
+  threads_mutex_unlock(&c->mutex);
+  // without a watch we only notice changes by reading again
+  const double max_age = l->wd < 0 ? 1.0 : DT_DIRCACHE_MAX_AGE;
+  if(!busy && (!l->stamp || l->dirty || dt_time() - l->time > max_age))
+    dircache_scan(c, slot);
+
+  threads_mutex_lock(&c->mutex);
+  if(l->pending)
+  { // swap in the result of the last scan
+    free(l->ent);
+    free(l->names);
+    l->cnt   = l->pending_cnt;
+    l->ent   = l->pending_ent;
+    l->names = l->pending_names;
+    l->stamp = ++c->stamp;
+    l->pending_ent   = 0;
+    l->pending_names = 0;
+    l->pending = 0;
+  }
+  threads_mutex_unlock(&c->mutex);
+  return l;
+}
+
+void
+dt_dircache_invalidate(
+    dt_dircache_t *c,
+    const char    *path)
+{
+  for(int i=0;i<DT_DIRCACHE_SIZE;i++)
+    if(!strcmp(c->list[i].path, path)) c->list[i].dirty = 1;
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include "core/threads.h"
+#include <stdint.h>
+#include <limits.h>
+
+// cache of directory listings shared by the file browser and the filtered
+// lists in the gui. listings are read on the thread pool and kept until
+// inotify reports a change in the directory, so redrawing never touches the
+// file system. network shares don't report changes made by other machines,
+// so listings older than DT_DIRCACHE_MAX_AGE seconds are read again, too.
+// while a listing is read, the old one stays visible.
+
+#define DT_DIRCACHE_SIZE    16
+#define DT_DIRCACHE_MAX_AGE 10
+
+typedef struct dt_dircache_entry_t
+{
+  const char *name; // points into the names buffer of the list
+  uint8_t     type; // d_type, resolved by stat if the file system reports DT_UNKNOWN
+}
+dt_dircache_entry_t;
+
+typedef struct dt_dircache_list_t
+{
+  char                 path[PATH_MAX];
+  uint64_t             stamp;   // changes whenever ent changed, 0 if never read
+  uint32_t             cnt;     // number of entries, sorted by name
+  dt_dircache_entry_t *ent;
+  char                *names;
+
+  // internal state:
+  int                  wd;       // inotify watch descriptor or -1
+  int                  scanning; // a job is reading the directory
+  int                  dirty;    // inotify saw a change
+  double               time;     // when the directory was last read
+  uint64_t             lru;
+  uint32_t             pending_cnt; // result of the scan, swapped in by dt_dircache_get()
+  dt_dircache_entry_t *pending_ent;
+  char                *pending_names;
+  int                  pending;
+}
+dt_dircache_list_t;
+
+typedef struct dt_dircache_t
+{
+  int                fd;     // inotify, or -1 if not available
+  threads_mutex_t    mutex;  // guards scanning and the pending fields
+  uint64_t           clock;  // for lru
+  uint64_t           stamp;  // counter for list stamps
+  void             (*ufn)(void); // called from the worker after a scan, if set
+  dt_dircache_list_t list[DT_DIRCACHE_SIZE];
+}
+dt_dircache_t;
+
+void dt_dircache_init(dt_dircache_t *c);
+void dt_dircache_cleanup(dt_dircache_t *c);
+
+// return the cached listing of the directory, including . and .. and hidden
+// files. starts reading it in the background if it is not cached, changed, or
+// stale. the list is empty (stamp 0) until the first read finishes. the
+// pointers stay valid until the next call to this or dt_dircache_cleanup(), so
+// only call it from one thread (the gui).
+const dt_dircache_list_t *dt_dircache_get(dt_dircache_t *c, const char *path);
+
+// forget the cached listing, for instance after writing to the directory
+// without waiting for inotify.
+void dt_dircache_invalidate(dt_dircache_t *c, const char *path);
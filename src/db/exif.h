@@ -1,43 +1,204 @@
 #pragma once
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 #include <unistd.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
 
-// fake exif extraction unit. so far we extract the exif tag 0x9004 CreateDate (or similar)
-// admittedly the matching is a bit fuzzy, as you will observe:
-static inline int
-dt_db_exif_mini(
-    const char *filename,
-    char       *createdate,  // size is always 20
-    char       *model,
-    size_t      model_size)
+// metadata only exif reader for the db. maps the first few hundred kilobytes
+// of the file and walks the tiff directories (ifd0 and the exif ifd) found
+// there. most raw formats are tiff based, the others keep a tiff header close
+// to the start (jpeg app1, the jpeg preview of fuji raf, the cmt boxes of cr3).
+// the sensor data is never touched, so this is cheap enough to run on whole
+// folders from a thread pool.
+
+#define DT_DB_EXIF_MAP_SIZE (512u<<10)
+
+typedef struct dt_db_exif_t
+{
+  char  createdate[20]; // "YYYY:MM:DD hh:mm:ss"
+  char  model[32];      // maker and model
+  char  lens[32];
+  float exposure;       // exposure time in seconds
+  float aperture;       // f-number
+  float iso;
+  float focal_length;   // in mm
+}
+dt_db_exif_t;
+
+typedef struct dt_db_exif_tiff_t
+{
+  const uint8_t *buf;   // mapped file
+  size_t         len;
+  size_t         base;  // offsets in the tiff are relative to its header
+  int            be;    // big endian
+  int            date;  // priority of the date we found so far
+  char           make[32];
+}
+dt_db_exif_tiff_t;
+
+static inline uint32_t
+_dt_db_exif_get(const dt_db_exif_tiff_t *t, size_t off, int bytes)
+{
+  if(t->base + off + bytes > t->len) return 0;
+  const uint8_t *p = t->buf + t->base + off;
+  uint32_t v = 0;
+  for(int i=0;i<bytes;i++) v |= (uint32_t)p[t->be ? bytes-1-i : i] << (8*i);
+  return v;
+}
+
+// pointer to the data of the ifd entry at off, with count elements of type.
+// 0 if it's outside the mapped part of the file.
+static inline const uint8_t *
+_dt_db_exif_data(const dt_db_exif_tiff_t *t, size_t off, uint32_t *data_off)
+{
+  static const int tsize[] = {0, 1, 1, 2, 4, 8, 1, 1, 2, 4, 8, 4, 8};
+  const uint32_t type = _dt_db_exif_get(t, off+2, 2), cnt = _dt_db_exif_get(t, off+4, 4);
+  if(type == 0 || type > 12 || cnt > t->len) return 0;
+  const uint64_t size = (uint64_t)tsize[type] * cnt;
+  *data_off = size <= 4 ? off + 8 : _dt_db_exif_get(t, off+8, 4);
+  if(t->base + *data_off + size > t->len) return 0;
+  return t->buf + t->base + *data_off;
+}
+
+static inline void
+_dt_db_exif_string(const dt_db_exif_tiff_t *t, size_t off, char *str, size_t str_size)
 {
-  FILE *f = fopen(filename, "rb");
-  if(!f) return 1;
+  uint32_t d;
+  const uint8_t *p = _dt_db_exif_data(t, off, &d);
+  if(!p || _dt_db_exif_get(t, off+2, 2) != 2) return;
+  size_t len = _dt_db_exif_get(t, off+4, 4);
+  while(len && (p[len-1] == 0 || p[len-1] == ' ')) len--; // trailing padding
+  if(!len) return;
+  snprintf(str, str_size, "%.*s", (int)len, (const char *)p);
+}
 
-  char buf[512];
+static inline float
+_dt_db_exif_number(const dt_db_exif_tiff_t *t, size_t off)
+{
+  uint32_t d;
+  if(!_dt_db_exif_data(t, off, &d)) return 0.0f;
+  switch(_dt_db_exif_get(t, off+2, 2))
+  {
+    case 3: return _dt_db_exif_get(t, d, 2);
+    case 4: return _dt_db_exif_get(t, d, 4);
+    case 5:
+    {
+      const uint32_t den = _dt_db_exif_get(t, d+4, 4);
+      return den ? _dt_db_exif_get(t, d, 4) / (float)den : 0.0f;
+    }
+    case 10:
+    {
+      const int32_t den = _dt_db_exif_get(t, d+4, 4);
+      return den ? (int32_t)_dt_db_exif_get(t, d, 4) / (float)den : 0.0f;
+    }
+    default: return 0.0f;
+  }
+}
 
-  fread(buf, sizeof(buf), 1, f);
-  fclose(f);
+static inline void
+_dt_db_exif_ifd(dt_db_exif_tiff_t *t, dt_db_exif_t *exif, uint32_t ifd, int depth)
+{
+  if(depth > 2 || !ifd) return;
+  const uint32_t cnt = _dt_db_exif_get(t, ifd, 2);
+  if(t->base + ifd + 2 + 12*(size_t)cnt > t->len) return;
+  for(uint32_t i=0;i<cnt;i++)
+  {
+    const size_t off = ifd + 2 + 12*i;
+    const uint32_t tag = _dt_db_exif_get(t, off, 2);
+    switch(tag)
+    {
+      case 0x010f: _dt_db_exif_string(t, off, t->make, sizeof(t->make)); break;
+      case 0x0110: _dt_db_exif_string(t, off, exif->model, sizeof(exif->model)); break;
+      case 0x0132:   // DateTime, only if there is nothing better
+      case 0x9004:   // CreateDate
+      case 0x9003:   // DateTimeOriginal
+      {
+        const int prio = tag == 0x9003 ? 3 : tag == 0x9004 ? 2 : 1;
+        char date[20] = {0};
+        _dt_db_exif_string(t, off, date, sizeof(date));
+        if(prio > t->date && date[4] == ':' && date[0] >= '0' && date[0] <= '9')
+        {
+          memcpy(exif->createdate, date, sizeof(date));
+          t->date = prio;
+        }
+        break;
+      }
+      case 0x829a: exif->exposure     = _dt_db_exif_number(t, off); break;
+      case 0x829d: exif->aperture     = _dt_db_exif_number(t, off); break;
+      case 0x8827: exif->iso          = _dt_db_exif_number(t, off); break;
+      case 0x920a: exif->focal_length = _dt_db_exif_number(t, off); break;
+      case 0xa434: _dt_db_exif_string(t, off, exif->lens, sizeof(exif->lens)); break;
+      case 0x8769: _dt_db_exif_ifd(t, exif, _dt_db_exif_get(t, off+8, 4), depth+1); break;
+    }
+  }
+}
 
+// walk the tiff with the header at base. returns non-zero if there is none.
+static inline int
+_dt_db_exif_tiff(dt_db_exif_tiff_t *t, dt_db_exif_t *exif, size_t base)
+{
+  if(base + 8 > t->len) return 1;
+  const uint8_t *h = t->buf + base;
+  if     (h[0] == 'I' && h[1] == 'I') t->be = 0;
+  else if(h[0] == 'M' && h[1] == 'M') t->be = 1;
+  else return 1;
+  t->base = base;
+  const uint32_t magic = _dt_db_exif_get(t, 2, 2);
+  if(magic != 42 && magic != 0x55 && magic != 0x4f52 && magic != 0x5352) return 1; // tiff rw2 orf
+  _dt_db_exif_ifd(t, exif, _dt_db_exif_get(t, 4, 4), 0);
+  return 0;
+}
+
+// tiff inside a jpeg app1 segment
+static inline int
+_dt_db_exif_jpeg(dt_db_exif_tiff_t *t, dt_db_exif_t *exif, size_t pos)
+{
+  if(pos + 4 > t->len || t->buf[pos] != 0xff || t->buf[pos+1] != 0xd8) return 1;
+  for(pos+=2;pos + 4 <= t->len && t->buf[pos] == 0xff;)
+  {
+    const uint8_t marker = t->buf[pos+1];
+    const size_t  len = (t->buf[pos+2] << 8) | t->buf[pos+3];
+    if(marker == 0xda || marker == 0xd9) break; // image data starts
+    if(marker == 0xe1 && pos + 10 <= t->len && !memcmp(t->buf+pos+4, "Exif\0\0", 6))
+      return _dt_db_exif_tiff(t, exif, pos + 10);
+    pos += 2 + len;
+  }
+  return 1;
+}
+
+// fake exif extraction for when there is no tiff structure. this matches the
+// create date (or similar) and makers we know, admittedly a bit fuzzy.
+static inline int
+_dt_db_exif_fuzzy(
+    const char   *buf,
+    size_t        len,
+    dt_db_exif_t *exif)
+{
   // scan for maker model as follows:
   // SONY..ILCE-7M3
   // FUJIFILM..X100F (not at position 0)
   // Canon.Canon MODEL (search for "Canon ")
   // NIKON CORPORATION...NIKON MODEL (discard the one with corporation)
-
-  for(int i=4;i<sizeof(buf)-20;i++)
-  { // check maker/model
+  char *model = exif->model;
+  const size_t model_size = sizeof(exif->model);
+  for(int i=4;i+32<len;i++)
+  { // check maker/model, the +32 leaves room for the strings
     if(!strncmp(buf+i, "SONY", 4))
-      i += 1 + snprintf(model, model_size, "Sony %s", buf+i+6);
+      i += 1 + snprintf(model, model_size, "Sony %.24s", buf+i+6);
     else if(!strncmp(buf+i, "FUJIFILM", 8))
-      i += 1 + snprintf(model, model_size, "Fujifilm %s", buf+i+10);
+      i += 1 + snprintf(model, model_size, "Fujifilm %.20s", buf+i+10);
     else if(!strncmp(buf+i, "Canon", 5))
-      i += 6 + snprintf(model, model_size, "%s", buf+i+6);
+      i += 6 + snprintf(model, model_size, "%.24s", buf+i+6);
     else if(!strncmp(buf+i, "NIKON CORP", 10))
       i += 18;
     else if(!strncmp(buf+i, "NIKON ", 6))
-      i += snprintf(model, model_size, "%s", buf+i);
+      i += snprintf(model, model_size, "%.24s", buf+i);
     else
     { // check for date string:
       if(buf[i+4] != ':') continue;
@@ -57,7 +218,7 @@ dt_db_exif_mini(
 
       if(NNUM(8)) continue;
       if(NNUM(9)) continue;
-      
+
       if(NNUM(11)) continue;
       if(NNUM(12)) continue;
 
@@ -68,18 +229,70 @@ dt_db_exif_mini(
       if(NNUM(18)) continue;
 #undef NNUM
 
-      memcpy(createdate, buf+i, 19);
-      createdate[19] = 0;
-      // fprintf(stderr, "create date %s model %s\n", createdate, model);
+      memcpy(exif->createdate, buf+i, 19);
+      exif->createdate[19] = 0;
       return 0;
     }
   }
-  struct stat statbuf;
-  if(!stat(filename, &statbuf))
-  {
-    struct tm result;
-    strftime(createdate, 20, "%Y:%m:%d %H:%M:%S", localtime_r(&statbuf.st_mtime, &result));
-  }
   return 1;
 }
 
+// fill exif from the file. returns non-zero if no create date was found, in
+// which case the date is the modification time of the file.
+static inline int
+dt_db_exif_read(
+    const char   *filename,
+    dt_db_exif_t *exif)
+{
+  memset(exif, 0, sizeof(*exif));
+  const int fd = open(filename, O_RDONLY);
+  if(fd == -1) return 1;
+  struct stat sb;
+  if(fstat(fd, &sb) || sb.st_size < 16) { close(fd); return 1; }
+  const size_t len = sb.st_size < DT_DB_EXIF_MAP_SIZE ? sb.st_size : DT_DB_EXIF_MAP_SIZE;
+  const uint8_t *buf = mmap(0, len, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(buf == MAP_FAILED) return 1;
+
+  dt_db_exif_tiff_t t = { .buf = buf, .len = len };
+  int err = _dt_db_exif_tiff(&t, exif, 0) && _dt_db_exif_jpeg(&t, exif, 0);
+  if(err && len > 88 && !memcmp(buf, "FUJIFILMCCD-RAW", 15))
+  { // raf: big endian offset of the embedded jpeg
+    const size_t jpg = ((size_t)buf[84]<<24) | (buf[85]<<16) | (buf[86]<<8) | buf[87];
+    err = _dt_db_exif_jpeg(&t, exif, jpg);
+  }
+  if(err && !memcmp(buf+4, "ftyp", 4))
+  { // cr3: the boxes CMT1 and CMT2 hold tiffs with ifd0 and the exif ifd
+    for(size_t i=8;i+12<len;i++)
+      if(buf[i] == 'C' && !memcmp(buf+i, "CMT", 3) && (buf[i+3] == '1' || buf[i+3] == '2'))
+        err &= _dt_db_exif_tiff(&t, exif, i + 4);
+  }
+
+  if(t.make[0])
+  { // prefix the maker, unless the model already has it. all caps are shouted.
+    char make[16];
+    size_t n = 0;
+    int shout = 1;
+    for(;t.make[n] && t.make[n] != ' ' && n < sizeof(make)-1;n++)
+      if((make[n] = t.make[n]) >= 'a' && make[n] <= 'z') shout = 0;
+    make[n] = 0;
+    for(size_t i=1;i<n&&n>3&&shout;i++)
+      if(make[i] >= 'A' && make[i] <= 'Z') make[i] += 'a' - 'A';
+    if(strncasecmp(exif->model, make, n))
+    {
+      const size_t m = strnlen(exif->model, sizeof(exif->model) - n - 2);
+      memmove(exif->model + n + 1, exif->model, m);
+      memcpy(exif->model, make, n);
+      exif->model[n] = m ? ' ' : 0;
+      exif->model[n + 1 + m] = 0;
+    }
+  }
+  if(err && !exif->createdate[0]) // formats we don't know
+    _dt_db_exif_fuzzy((const char *)buf, len < 512 ? len : 512, exif);
+  munmap((void *)buf, len);
+  if(exif->createdate[0]) return 0;
+
+  struct tm result;
+  strftime(exif->createdate, 20, "%Y:%m:%d %H:%M:%S", localtime_r(&sb.st_mtime, &result));
+  return 1;
+}
@@ -1,12 +1,18 @@
 DB_O=\
 db/db.o\
+db/dircache.o\
+db/library.o\
 db/rc.o\
 db/thumbnails.o
 DB_H=\
 db/db.h\
+db/dircache.h\
 db/exif.h\
 db/hash.h\
+db/library.h\
 db/thumbnails.h\
-db/stringpool.h
+db/thumbpack.h\
+db/stringpool.h\
+pipe/modules/o-bc1/bc1.h
 DB_CFLAGS=
-DB_LDFLAGS=
+DB_LDFLAGS=-lz
@@ -1,18 +1,124 @@
 #pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// 64-bit hash in the spirit of wyhash: the input is consumed 16 bytes at a time
+// and folded in with full 64x64->128 bit multiplications, so long absolute paths
+// cost a few cycles per word instead of per byte. good avalanche and collision
+// behaviour for cache keys (file names, parameter blobs), but not cryptographic.
+// the value depends on the byte order of the machine, so don't ship it around.
+
+typedef struct dt_hash_t
+{
+  uint64_t h;
+  uint64_t len;     // total bytes seen so far
+  uint8_t  buf[16]; // pending bytes which don't fill a block yet
+  uint32_t buf_cnt;
+}
+dt_hash_t;
+
+#define DT_HASH_P0 0xa0761d6478bd642full
+#define DT_HASH_P1 0xe7037ed1a0b428dbull
+#define DT_HASH_P2 0x8ebc6af09c88c6e3ull
+#define DT_HASH_P3 0x589965cc75374cc3ull
+
+static inline uint64_t
+_dt_hash_mum(uint64_t a, uint64_t b)
+{
+  const __uint128_t r = (__uint128_t)a * b;
+  return (uint64_t)r ^ (uint64_t)(r >> 64);
+}
 
-// quick hacky uncryptographic 64-bit hash from https://stackoverflow.com/questions/13325125/lightweight-8-byte-hash-function-algorithm
+static inline uint64_t
+_dt_hash_r8(const uint8_t *p)
+{
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline uint64_t
+_dt_hash_block(uint64_t h, const uint8_t *p)
+{
+  return _dt_hash_mum(_dt_hash_r8(p) ^ DT_HASH_P1, _dt_hash_r8(p+8) ^ h);
+}
+
+static inline void
+dt_hash_init(dt_hash_t *s, uint64_t seed)
+{
+  s->h = seed ^ _dt_hash_mum(seed ^ DT_HASH_P0, DT_HASH_P1);
+  s->len = 0;
+  s->buf_cnt = 0;
+}
+
+static inline void
+dt_hash_update(dt_hash_t *s, const void *data, size_t size)
+{
+  const uint8_t *p = (const uint8_t *)data;
+  s->len += size;
+  if(s->buf_cnt)
+  { // complete the pending block first
+    const size_t n = size < 16 - s->buf_cnt ? size : 16 - s->buf_cnt;
+    memcpy(s->buf + s->buf_cnt, p, n);
+    s->buf_cnt += n;
+    p += n;
+    size -= n;
+    if(s->buf_cnt < 16) return;
+    s->h = _dt_hash_block(s->h, s->buf);
+    s->buf_cnt = 0;
+  }
+  for(;size>=16;p+=16,size-=16) s->h = _dt_hash_block(s->h, p);
+  memcpy(s->buf, p, size);
+  s->buf_cnt = size;
+}
+
+static inline void
+dt_hash_update_u64(dt_hash_t *s, uint64_t v)
+{
+  dt_hash_update(s, &v, sizeof(v));
+}
+
+static inline uint64_t
+dt_hash_final(const dt_hash_t *s)
+{ // zero padded tail, the length tells apart inputs which only differ by trailing zeros
+  uint8_t tail[16] = {0};
+  memcpy(tail, s->buf, s->buf_cnt);
+  const uint64_t h = _dt_hash_block(s->h ^ DT_HASH_P2, tail);
+  return _dt_hash_mum(h ^ DT_HASH_P0, s->len ^ DT_HASH_P3);
+}
+
+static inline uint64_t
+dt_hash(const void *data, size_t size, uint64_t seed)
+{
+  dt_hash_t s;
+  dt_hash_init(&s, seed);
+  dt_hash_update(&s, data, size);
+  return dt_hash_final(&s);
+}
+
+// hash of the string up to the terminating zero or l bytes, whichever comes first
 static inline uint64_t
 hash64_l(const char *str, size_t l)
 {
-  uint64_t mix = 0;
-  const uint64_t mulp = 2654435789u;
-  mix ^= 104395301u;
-  for(size_t i=0;i<l&&*str;i++) mix += (*str++ * mulp) ^ (mix >> 23);
-  return mix ^ (mix << 37);
+  return dt_hash(str, strnlen(str, l), 0);
 }
 
 static inline uint64_t
 hash64(const char *str)
 {
-  return hash64_l(str, -1ul);
+  return dt_hash(str, strlen(str), 0);
+}
+
+// the byte by byte hash thumbnails used to be named with, only to find them
+// again under their old name (see dt_thumbnails_t). from
+// https://stackoverflow.com/questions/13325125/lightweight-8-byte-hash-function-algorithm
+static inline uint64_t
+hash64_legacy(const char *str)
+{
+  uint64_t mix = 0;
+  const uint64_t mulp = 2654435789u;
+  mix ^= 104395301u;
+  while(*str) mix += (*str++ * mulp) ^ (mix >> 23);
+  return mix ^ (mix << 37);
 }
@@ -0,0 +1,391 @@
+#include "library.h"
+#include "db.h"
+#include "hash.h"
+#include "stringpool.h"
+#include "thumbnails.h"
+#include "core/core.h"
+#include "core/log.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+typedef enum library_col_t
+{
+  s_col_rating = 0,
+  s_col_labels,
+  s_col_createdate,
+  s_col_exif_key,
+  s_col_hash,
+  s_col_path,
+  s_col_model,
+  s_col_lens,
+  s_col_shot,
+  s_col_paths,
+  s_col_cnt,
+}
+library_col_t;
+
+static size_t // compute offsets of all columns in the file, return file size
+library_layout(uint32_t cnt, uint64_t path_size, size_t off[s_col_cnt])
+{
+  const size_t size[s_col_cnt] = {
+    sizeof(uint16_t)*cnt, sizeof(uint16_t)*cnt, sizeof(uint64_t)*cnt, sizeof(uint64_t)*cnt,
+    sizeof(uint64_t)*cnt, sizeof(uint64_t)*cnt, 32*(size_t)cnt, 32*(size_t)cnt,
+    sizeof(float)*4*(size_t)cnt, path_size };
+  size_t pos = sizeof(dt_library_header_t);
+  for(int c=0;c<s_col_cnt;c++)
+  {
+    pos = (pos + 7) & ~(size_t)7;
+    off[c] = pos;
+    pos += size[c];
+  }
+  return pos;
+}
+
+typedef struct library_build_t
+{ // growing columns while walking the tree
+  dt_library_header_t header;
+  uint32_t  image_max;
+  uint16_t *rating, *labels;
+  uint64_t *createdate, *exif_key, *hash, *path;
+  char    (*model)[32], (*lens)[32];
+  float   (*shot)[4];
+  char     *paths;
+  uint64_t  paths_max;
+
+  const dt_library_t *old;    // previous index, to reuse exif data
+  uint32_t           *old_by_hash;
+}
+library_build_t;
+
+static int
+library_build_add(library_build_t *b, const dt_db_t *db, uint32_t imgid)
+{
+  char fn[1040];
+  if(snprintf(fn, sizeof(fn), "%s/%s", db->dirname, db->image[imgid].filename) >= (int)sizeof(fn)) return 1;
+  const size_t len = strlen(fn) + 1;
+  if(b->header.image_cnt == b->image_max)
+  {
+    b->image_max  = 2*b->image_max + 4096;
+    b->rating     = realloc(b->rating,     sizeof(uint16_t)*b->image_max);
+    b->labels     = realloc(b->labels,     sizeof(uint16_t)*b->image_max);
+    b->createdate = realloc(b->createdate, sizeof(uint64_t)*b->image_max);
+    b->exif_key   = realloc(b->exif_key,   sizeof(uint64_t)*b->image_max);
+    b->hash       = realloc(b->hash,       sizeof(uint64_t)*b->image_max);
+    b->path       = realloc(b->path,       sizeof(uint64_t)*b->image_max);
+    b->model      = realloc(b->model,      32*(size_t)b->image_max);
+    b->lens       = realloc(b->lens,       32*(size_t)b->image_max);
+    b->shot       = realloc(b->shot,       sizeof(float)*4*(size_t)b->image_max);
+  }
+  if(b->header.path_size + len > b->paths_max)
+    b->paths = realloc(b->paths, b->paths_max = 2*b->paths_max + (1<<20));
+  const uint32_t i = b->header.image_cnt++;
+  const dt_image_t *img = db->image + imgid;
+  b->rating[i]     = img->rating;
+  b->labels[i]     = img->labels & 0x7fffu; // mask selection bit
+  b->createdate[i] = img->createdate;
+  b->exif_key[i]   = img->exif_key;
+  memcpy(b->model[i], img->model, 32);
+  memcpy(b->lens[i],  img->lens,  32);
+  b->shot[i][0] = img->exposure;
+  b->shot[i][1] = img->aperture;
+  b->shot[i][2] = img->iso;
+  b->shot[i][3] = img->focal_length;
+  b->path[i] = b->header.path_size;
+  memcpy(b->paths + b->header.path_size, fn, len);
+  b->header.path_size += len;
+  dt_db_image_path(db, imgid, fn, sizeof(fn));
+  b->hash[i] = hash64(fn);
+  return 0;
+}
+
+static int
+compare_old_hash(const void *a, const void *b, void *arg)
+{
+  const dt_library_t *lib = arg;
+  const uint64_t ha = lib->hash[*(const uint32_t *)a], hb = lib->hash[*(const uint32_t *)b];
+  return ha < hb ? -1 : ha > hb;
+}
+
+static void // fill in exif from the previous index, if the directory doesn't have it in vkdt.db
+library_build_reuse(library_build_t *b, dt_db_t *db, uint32_t imgid)
+{
+  if(!b->old_by_hash || db->image[imgid].exif_key) return;
+  char fn[1040];
+  if(dt_db_image_path(db, imgid, fn, sizeof(fn))) return;
+  const uint64_t hash = hash64(fn);
+  const dt_library_t *old = b->old;
+  uint32_t lo = 0, hi = old->header->image_cnt;
+  while(lo < hi)
+  {
+    const uint32_t mid = lo + (hi - lo)/2;
+    if(old->hash[b->old_by_hash[mid]] < hash) lo = mid + 1;
+    else hi = mid;
+  }
+  for(;lo<old->header->image_cnt && old->hash[b->old_by_hash[lo]] == hash;lo++)
+  {
+    const uint32_t o = b->old_by_hash[lo];
+    const size_t dl = strlen(db->dirname);
+    const char *op = old->paths + old->path[o];
+    if(strncmp(op, db->dirname, dl) || op[dl] != '/' || strcmp(op+dl+1, db->image[imgid].filename)) continue;
+    db->image[imgid].exif_key   = old->exif_key[o];
+    db->image[imgid].createdate = old->createdate[o];
+    memcpy(db->image[imgid].model, old->model[o], 32);
+    memcpy(db->image[imgid].lens,  old->lens[o],  32);
+    db->image[imgid].model[31] = db->image[imgid].lens[31] = 0;
+    db->image[imgid].exposure     = old->shot[o][0];
+    db->image[imgid].aperture     = old->shot[o][1];
+    db->image[imgid].iso          = old->shot[o][2];
+    db->image[imgid].focal_length = old->shot[o][3];
+    return;
+  }
+}
+
+static int
+library_build_write(const library_build_t *b, const char *filename)
+{
+  char tmp[1040];
+  if(snprintf(tmp, sizeof(tmp), "%s.tmp", filename) >= (int)sizeof(tmp)) return 1;
+  FILE *f = fopen(tmp, "wb");
+  if(!f) return 1;
+  size_t off[s_col_cnt];
+  const uint32_t cnt = b->header.image_cnt;
+  library_layout(cnt, b->header.path_size, off);
+  const void *col[s_col_cnt] = { b->rating, b->labels, b->createdate, b->exif_key, b->hash, b->path, b->model, b->lens, b->shot, b->paths };
+  const size_t used[s_col_cnt] = {
+    sizeof(uint16_t)*cnt, sizeof(uint16_t)*cnt, sizeof(uint64_t)*cnt, sizeof(uint64_t)*cnt,
+    sizeof(uint64_t)*cnt, sizeof(uint64_t)*cnt, 32*(size_t)cnt, 32*(size_t)cnt,
+    sizeof(float)*4*(size_t)cnt, b->header.path_size };
+  const uint8_t zero[8] = {0};
+  int err = fwrite(&b->header, sizeof(b->header), 1, f) != 1;
+  size_t pos = sizeof(b->header);
+  for(int c=0;c<s_col_cnt&&!err;c++)
+  { // pad to the aligned column start
+    err |= fwrite(zero, 1, off[c] - pos, f) != off[c] - pos;
+    if(used[c]) err |= fwrite(col[c], 1, used[c], f) != used[c];
+    pos = off[c] + used[c];
+  }
+  err |= fclose(f) != 0;
+  if(err || rename(tmp, filename))
+  {
+    unlink(tmp);
+    return 1;
+  }
+  return 0;
+}
+
+int
+dt_library_build(const char *root, const char *filename)
+{
+  char *rootdir = root ? realpath(root, 0) : 0;
+  if(!rootdir)
+  {
+    dt_log(s_log_err|s_log_db, "[lib] could not open library root '%s'!", root);
+    return -1;
+  }
+  clock_t beg = clock();
+  library_build_t b = { .header = { .magic = DT_LIBRARY_MAGIC, .version = DT_LIBRARY_VERSION } };
+
+  dt_library_t old;
+  if(!dt_library_open(&old, filename) && old.header->image_cnt)
+  {
+    b.old = &old;
+    b.old_by_hash = malloc(sizeof(uint32_t)*old.header->image_cnt);
+    for(uint32_t i=0;i<old.header->image_cnt;i++) b.old_by_hash[i] = i;
+    qsort_r(b.old_by_hash, old.header->image_cnt, sizeof(uint32_t), compare_old_hash, &old);
+  }
+
+  // depth first walk with an explicit stack of directory names
+  uint32_t stack_cnt = 1, stack_max = 64;
+  char **stack = malloc(sizeof(char *)*stack_max);
+  stack[0] = rootdir;
+  while(stack_cnt)
+  {
+    char *dir = stack[--stack_cnt];
+    DIR *dp = opendir(dir);
+    if(!dp) { free(dir); continue; }
+    const int dfd = dirfd(dp);
+    struct dirent *ep;
+    while((ep = readdir(dp)))
+    { // no symlinks to directories, these may well be loops
+      if(ep->d_name[0] == '.') continue; // also skips hidden directories
+      int isdir = ep->d_type == DT_DIR;
+      if(ep->d_type == DT_UNKNOWN)
+      {
+        struct stat sb;
+        isdir = !fstatat(dfd, ep->d_name, &sb, AT_SYMLINK_NOFOLLOW) && S_ISDIR(sb.st_mode);
+      }
+      if(!isdir) continue;
+      char *sub = malloc(strlen(dir) + strlen(ep->d_name) + 2);
+      sprintf(sub, "%s/%s", dir, ep->d_name);
+      if(stack_cnt == stack_max) stack = realloc(stack, sizeof(char *)*(stack_max *= 2));
+      stack[stack_cnt++] = sub;
+    }
+    closedir(dp);
+
+    dt_db_t db;
+    memset(&db, 0, sizeof(db));
+    if(!dt_db_scan_directory(&db, dir) && db.image_cnt)
+    {
+      b.header.dir_cnt++;
+      for(uint32_t k=0;k<db.image_cnt;k++)
+        library_build_reuse(&b, &db, k);
+      dt_db_update_exif_all(&db); // only reads the files which changed
+      for(uint32_t k=0;k<db.image_cnt;k++)
+      {
+        if(library_build_add(&b, &db, k))
+          dt_log(s_log_err|s_log_db, "[lib] path too long in '%s'", db.dirname);
+      }
+    }
+    db.dirname[0] = 0; // don't write vkdt.db into the archive
+    dt_db_cleanup(&db);
+    free(dir);
+  }
+  free(stack);
+  free(b.old_by_hash);
+  if(b.old) dt_library_close(&old);
+
+  const int err = library_build_write(&b, filename);
+  free(b.rating); free(b.labels); free(b.createdate); free(b.exif_key);
+  free(b.hash); free(b.path); free(b.model); free(b.lens); free(b.shot); free(b.paths);
+  clock_t end = clock();
+  dt_log(s_log_perf|s_log_db, "[lib] indexed %u images in %u directories in %2.3fs",
+      b.header.image_cnt, b.header.dir_cnt, (end-beg)/(double)CLOCKS_PER_SEC);
+  if(err)
+  {
+    dt_log(s_log_err|s_log_db, "[lib] could not write '%s'!", filename);
+    return -1;
+  }
+  return b.header.image_cnt;
+}
+
+int
+dt_library_open(dt_library_t *lib, const char *filename)
+{
+  memset(lib, 0, sizeof(*lib));
+  int fd = open(filename, O_RDONLY);
+  if(fd == -1) return 1;
+  struct stat sb;
+  if(fstat(fd, &sb) || sb.st_size < (off_t)sizeof(dt_library_header_t)) { close(fd); return 1; }
+  void *data = mmap(0, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if(data == MAP_FAILED) return 1;
+  const dt_library_header_t *h = data;
+  size_t off[s_col_cnt];
+  if(h->magic != DT_LIBRARY_MAGIC || h->version != DT_LIBRARY_VERSION ||
+     library_layout(h->image_cnt, h->path_size, off) > (size_t)sb.st_size)
+  {
+    munmap(data, sb.st_size);
+    return 1;
+  }
+  const uint8_t *d = data;
+  lib->header     = h;
+  lib->rating     = (const uint16_t *)(d + off[s_col_rating]);
+  lib->labels     = (const uint16_t *)(d + off[s_col_labels]);
+  lib->createdate = (const uint64_t *)(d + off[s_col_createdate]);
+  lib->exif_key   = (const uint64_t *)(d + off[s_col_exif_key]);
+  lib->hash       = (const uint64_t *)(d + off[s_col_hash]);
+  lib->path       = (const uint64_t *)(d + off[s_col_path]);
+  lib->model      = (const char (*)[32])(d + off[s_col_model]);
+  lib->lens       = (const char (*)[32])(d + off[s_col_lens]);
+  lib->shot       = (const float (*)[4])(d + off[s_col_shot]);
+  lib->paths      = (const char *)(d + off[s_col_paths]);
+  lib->data       = data;
+  lib->data_size  = sb.st_size;
+  return 0;
+}
+
+void
+dt_library_close(dt_library_t *lib)
+{
+  if(lib->data) munmap(lib->data, lib->data_size);
+  memset(lib, 0, sizeof(*lib));
+}
+
+uint32_t
+dt_library_query(
+    const dt_library_t       *lib,
+    const dt_library_query_t *q,
+    uint32_t                 *id,
+    uint32_t                  id_max)
+{
+  if(!lib->header) return 0;
+  uint32_t cnt = 0;
+  // scan the narrow columns first, the strings only for the survivors
+  for(uint32_t i=0;i<lib->header->image_cnt;i++)
+  {
+    const uint16_t r = lib->rating[i];
+    if(r < q->rating || (q->rating && r > 5)) continue; // rejected images are 65535
+    if(q->labels && !(lib->labels[i] & q->labels)) continue;
+    if(q->createdate)
+    { // match leading digits, as the collection filter in db.c
+      uint64_t cd = lib->createdate[i];
+      while(cd > q->createdate) cd /= 10;
+      if(cd != q->createdate) continue;
+    }
+    if(q->model && !strstr(lib->model[i], q->model)) continue;
+    if(q->lens  && !strstr(lib->lens[i],  q->lens))  continue;
+    if(q->path  && !strstr(lib->paths + lib->path[i], q->path)) continue;
+    if(cnt < id_max) id[cnt] = i;
+    cnt++;
+  }
+  return cnt;
+}
+
+int
+dt_db_load_library(
+    dt_db_t            *db,
+    dt_thumbnails_t    *thumbnails,
+    const dt_library_t *lib,
+    const uint32_t     *id,
+    uint32_t            id_cnt)
+{
+  uint32_t busy = 0;
+  if(dt_thumbnails_load_one(thumbnails, "data/busybee.bc1", &busy) != VK_SUCCESS)
+  {
+    dt_log(s_log_err|s_log_db, "could not load required thumbnail symbols!");
+    return 1;
+  }
+  if(!lib->header || !id_cnt) return 1;
+  db->image_max = id_cnt;
+  db->image = calloc(sizeof(dt_image_t), db->image_max);
+  db->collection_max = db->image_max;
+  db->collection = malloc(sizeof(uint32_t)*db->collection_max);
+  db->selection_max = db->image_max;
+  db->selection = malloc(sizeof(uint32_t)*db->selection_max);
+  dt_stringpool_init(&db->sp_filename, id_cnt, lib->header->path_size / MAX(1, lib->header->image_cnt) + 1);
+  db->dirname[0] = 0; // full paths, like a single image
+
+  for(uint32_t k=0;k<id_cnt;k++)
+  {
+    const uint32_t i = id[k];
+    if(i >= lib->header->image_cnt) continue;
+    const char *fn = lib->paths + lib->path[i];
+    const uint32_t imgid = db->image_cnt;
+    dt_image_t *img = db->image + imgid;
+    if(dt_stringpool_get(&db->sp_filename, fn, strlen(fn), imgid, &img->filename) != imgid)
+      continue; // duplicate or out of memory
+    img->rating     = lib->rating[i];
+    img->labels     = lib->labels[i];
+    img->createdate = lib->createdate[i];
+    img->exif_key   = lib->exif_key[i];
+    memcpy(img->model, lib->model[i], sizeof(img->model));
+    memcpy(img->lens,  lib->lens[i],  sizeof(img->lens));
+    img->model[sizeof(img->model)-1] = img->lens[sizeof(img->lens)-1] = 0;
+    img->exposure     = lib->shot[i][0];
+    img->aperture     = lib->shot[i][1];
+    img->iso          = lib->shot[i][2];
+    img->focal_length = lib->shot[i][3];
+    db->image_cnt++;
+  }
+  dt_db_update_collection(db);
+  return 0;
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include "db.h"
+#include <stddef.h>
+
+// library index spanning a whole tree of directories. this stores all that is
+// known about the images of the tree column by column in one file, so it can
+// be memory mapped and queried without touching the directories again. a query
+// result can be loaded into a db (with full paths and without a directory) and
+// goes to dt_thumbnails_cache_list() just like a regular collection.
+// the thumbnail hash of an image is the same as when opening its directory,
+// so the thumbnails in the cache are shared.
+
+#define DT_LIBRARY_MAGIC   0x62696c64u // "dlib"
+#define DT_LIBRARY_VERSION 3
+
+typedef struct dt_library_header_t
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t image_cnt;
+  uint32_t dir_cnt;
+  uint64_t path_size;  // bytes of all null terminated paths
+}
+dt_library_header_t;
+
+typedef struct dt_library_t
+{
+  const dt_library_header_t *header;
+  const uint16_t *rating;     // columns of length header->image_cnt
+  const uint16_t *labels;
+  const uint64_t *createdate;
+  const uint64_t *exif_key;
+  const uint64_t *hash;       // hash64() of the full .cfg name, the key into the thumbnail cache
+  const uint64_t *path;       // offset into paths
+  const char    (*model)[32];
+  const char    (*lens)[32];
+  const float   (*shot)[4];   // exposure time, f-number, iso, focal length
+  const char     *paths;      // full file names without .cfg suffix
+
+  void  *data;                // mapped file
+  size_t data_size;
+}
+dt_library_t;
+
+typedef struct dt_library_query_t
+{
+  uint16_t    rating;         // minimum rating
+  uint16_t    labels;         // match any of these labels, 0 to ignore
+  uint64_t    createdate;     // leading digits of the create date, e.g. 2025 for the year, 0 to ignore
+  const char *path;           // substring of the path, 0 to ignore
+  const char *model;          // substring of the camera model, 0 to ignore
+  const char *lens;           // substring of the lens model, 0 to ignore
+}
+dt_library_query_t;
+
+// walk the tree below root and write a fresh index to filename.
+// returns the number of images, or -1 on error.
+int dt_library_build(const char *root, const char *filename);
+
+// map the index file. returns non-zero on error.
+int  dt_library_open (dt_library_t *lib, const char *filename);
+void dt_library_close(dt_library_t *lib);
+
+// write the indices of all images matching the query to id, up to id_max.
+// returns the number of matches, which may be larger than id_max.
+uint32_t dt_library_query(
+    const dt_library_t       *lib,
+    const dt_library_query_t *query,
+    uint32_t                 *id,
+    uint32_t                  id_max);
+
+// load the given library images into a fresh db (after dt_db_init()).
+// returns non-zero on error.
+int dt_db_load_library(
+    dt_db_t            *db,
+    dt_thumbnails_t    *thumbnails,
+    const dt_library_t *lib,
+    const uint32_t     *id,
+    uint32_t            id_cnt);
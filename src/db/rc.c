@@ -19,20 +19,15 @@ dt_rc_cleanup(
 {
   // free all allocated string values.
   // for this find all strings in string pool:
-  for(int i=0;i<rc->sp.buf_max;)
+  for(uint32_t e=0;e<rc->sp.entry_max;e++)
   {
-    int len = strlen(rc->sp.buf+i);
-    // read string
-    if(!strncmp(rc->sp.buf+i, "str", 3))
+    const char *key = rc->sp.entry[e].buf;
+    const uint32_t pos = rc->sp.entry[e].val;
+    if(key && !strncmp(key, "str", 3) && pos < rc->data_max)
     {
-      uint32_t pos = dt_stringpool_get(&rc->sp, rc->sp.buf+i, len, -1u, 0);
-      if(pos != -1u && pos < rc->data_max)
-      {
-        free(rc->data[pos]);
-        rc->data[pos] = 0;
-      }
+      free(rc->data[pos]);
+      rc->data[pos] = 0;
     }
-    i += len+1; // eat terminating 0, too
   }
   free(rc->data);
   rc->data_cnt = rc->data_max = 0;
@@ -191,23 +186,17 @@ dt_rc_write(
 {
   FILE *f = fopen(filename, "wb");
   if(!f) return -1;
-  for(int i=0;i<rc->sp.buf_max;)
-  {
-    int len = strlen(rc->sp.buf+i);
-    if(len)
-    { // query value of this string:
-      uint32_t pos = dt_stringpool_get(&rc->sp, rc->sp.buf+i, len, -1u, 0);
-      if(pos != -1u && pos < rc->data_max)
-      {
-        if(!strncmp(rc->sp.buf+i, "flt", 3))
-          fprintf(f, "%s:%g\n", rc->sp.buf+i, *(float *)(rc->data+pos));
-        else if(!strncmp(rc->sp.buf+i, "int", 3))
-          fprintf(f, "%s:%d\n", rc->sp.buf+i, *(int *)(rc->data+pos));
-        else if(!strncmp(rc->sp.buf+i, "str", 3))
-          fprintf(f, "%s:%s\n", rc->sp.buf+i, rc->data[pos]);
-      }
-    }
-    i += len+1; // eat terminating 0, too
+  for(uint32_t e=0;e<rc->sp.entry_max;e++)
+  { // query value of this string:
+    const char *key = rc->sp.entry[e].buf;
+    const uint32_t pos = rc->sp.entry[e].val;
+    if(!key || !key[0] || pos >= rc->data_max) continue;
+    if(!strncmp(key, "flt", 3))
+      fprintf(f, "%s:%g\n", key, *(float *)(rc->data+pos));
+    else if(!strncmp(key, "int", 3))
+      fprintf(f, "%s:%d\n", key, *(int *)(rc->data+pos));
+    else if(!strncmp(key, "str", 3))
+      fprintf(f, "%s:%s\n", key, rc->data[pos]);
   }
   fclose(f);
   return 0;
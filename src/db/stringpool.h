@@ -11,25 +11,31 @@
 // store hashtable string -> id (e.g. for database to associate file names with imageid)
 // store null-terminated strings themselves in a compact memory layout (locality of reference)
 
+// the hash table is open addressed with linear probing and doubles in size when
+// it is 3/4 full. the strings live in blocks of memory that are never moved, so
+// pointers handed out as dedup strings stay valid until cleanup or reset.
+
 typedef struct dt_stringpool_entry_t
 {
-  uint32_t next; // -1u no next, else: next index
+  uint32_t hash; // lower bits of the string hash, to rehash and to compare quickly
   uint32_t val;
-  char    *buf;  // null terminated
+  char    *buf;  // null terminated, 0 for an empty slot
 }
 dt_stringpool_entry_t;
 
 static inline void
 dt_stringpool_init(
     dt_stringpool_t *sp,
-    uint32_t num_entries, // number of entries. will add some extra.
+    uint32_t num_entries, // expected number of entries, the pool will grow beyond that if needed
     uint32_t avg_len)     // assume average string length. filenames straight from cam are 12.
 {
-  num_entries += num_entries; // add slack
-  size_t buf_size = num_entries * (uint64_t)avg_len;
+  uint32_t entry_max = 16;
+  while(entry_max < num_entries + num_entries/2 + 1) entry_max *= 2; // stay below 3/4 load
+  size_t buf_size = num_entries * (uint64_t)(avg_len+1);
+  if(buf_size < 1024) buf_size = 1024;
   memset(sp, 0, sizeof(*sp));
-  sp->entry_max = num_entries;
-  sp->entry     = (dt_stringpool_entry_t *)calloc(sizeof(dt_stringpool_entry_t), num_entries);
+  sp->entry_max = entry_max;
+  sp->entry     = (dt_stringpool_entry_t *)calloc(sizeof(dt_stringpool_entry_t), entry_max);
   sp->buf       = (char *)calloc(buf_size, 1);
   sp->buf_max   = buf_size;
   sp->buf_cnt   = 0;
@@ -38,8 +44,12 @@ dt_stringpool_init(
 static inline void
 dt_stringpool_cleanup(dt_stringpool_t *sp)
 {
+  for(uint32_t b=0;b<sp->block_cnt;b++) free(sp->block[b]);
+  free(sp->block);
   free(sp->entry);
   free(sp->buf);
+  sp->block = 0;
+  sp->block_cnt = 0;
   sp->entry = 0;
   sp->buf   = 0;
 }
@@ -47,11 +57,59 @@ dt_stringpool_cleanup(dt_stringpool_t *sp)
 static inline void
 dt_stringpool_reset(dt_stringpool_t *sp)
 {
+  for(uint32_t b=0;b<sp->block_cnt;b++) free(sp->block[b]);
+  sp->block_cnt = 0;
+  sp->entry_cnt = 0;
   memset(sp->entry, 0, sizeof(dt_stringpool_entry_t)*sp->entry_max);
   memset(sp->buf,   0, sp->buf_max);
   sp->buf_cnt = 0;
 }
 
+static inline uint32_t
+_dt_stringpool_hash(const char *str, uint32_t sl)
+{
+  const uint64_t h = hash64_l(str, sl);
+  return h ^ (h >> 32);
+}
+
+static inline int // double the size of the hash table, return non-zero on failure
+_dt_stringpool_grow_entries(dt_stringpool_t *sp)
+{
+  const uint32_t entry_max = 2*sp->entry_max;
+  if(entry_max < sp->entry_max) return 1;
+  dt_stringpool_entry_t *entry = (dt_stringpool_entry_t *)calloc(sizeof(dt_stringpool_entry_t), entry_max);
+  if(!entry) return 1;
+  for(uint32_t i=0;i<sp->entry_max;i++)
+  {
+    if(!sp->entry[i].buf) continue;
+    uint32_t j = sp->entry[i].hash & (entry_max-1);
+    while(entry[j].buf) j = (j+1) & (entry_max-1);
+    entry[j] = sp->entry[i];
+  }
+  free(sp->entry);
+  sp->entry     = entry;
+  sp->entry_max = entry_max;
+  return 0;
+}
+
+static inline int // start a new block for string bytes of at least the given size
+_dt_stringpool_grow_buf(dt_stringpool_t *sp, uint32_t size)
+{
+  uint64_t buf_max = 2*(uint64_t)sp->buf_max;
+  if(buf_max < size) buf_max = size;
+  if(buf_max > 0xffffffffu) buf_max = 0xffffffffu;
+  if(buf_max < size) return 1;
+  char  *buf   = (char *)calloc(buf_max, 1);
+  char **block = (char **)realloc(sp->block, sizeof(char *)*(sp->block_cnt+1));
+  if(!buf || !block) { free(buf); if(block) sp->block = block; return 1; }
+  sp->block = block;
+  sp->block[sp->block_cnt++] = sp->buf; // keep the old strings alive
+  sp->buf     = buf;
+  sp->buf_max = buf_max;
+  sp->buf_cnt = 0;
+  return 0;
+}
+
 // return primary key (may be different to what was passed in case it was already there)
 static inline uint32_t
 dt_stringpool_get(
@@ -61,44 +119,43 @@ dt_stringpool_get(
     uint32_t         val,   // primary key to associate with the string, in case it's not been inserted before. pass -1u if you don't want to insert. will return old primary key if the string already exists.
     const char     **dedup) // deduplicated string from pool, or 0
 {
-  uint64_t j = hash64_l(str, sl);
-  const int step = 7919; // large prime number. up to entry_max < this we will always step through all entries in the list then.
+  const uint32_t h = _dt_stringpool_hash(str, sl);
+  uint32_t j = h & (sp->entry_max-1);
   while(1)
   {
-    j = j % sp->entry_max;
     dt_stringpool_entry_t *entry = sp->entry + j;
-    if(entry->buf)
-    { // entry already taken
-      if(!strncmp(entry->buf, str, sl) && (entry->buf[sl] == 0))
-      {
-        if(dedup) *dedup = entry->buf;
-        return entry->val; // this is us, we have been inserted before
-      }
-      // else jump to next candidate
-      if(entry->next == -1u)
-      {
-        if(val == -1u) return -1u; // no modifying entries if no insertion planned
-        entry->next = j + step;
-      }
-      j = entry->next;
-    }
-    else
-    { // free entry found, allocate string:
-      if(val == -1u) return -1u; // no insert requested
-      if(sp->buf_cnt + sl >= sp->buf_max)
-      {
-        fprintf(stderr, "[stringpool] ran out of memory!\n");
-        return -1u; // would need +one for null terminator
-      }
-      entry->buf   = sp->buf + sp->buf_cnt;
-      sp->buf_cnt += sl+1;
-      entry->next  = -1u;
-      entry->val   = val;
-      snprintf(entry->buf, sl+1, "%s", str);
+    if(!entry->buf) break;
+    if(entry->hash == h && !strncmp(entry->buf, str, sl) && (entry->buf[sl] == 0))
+    {
       if(dedup) *dedup = entry->buf;
-      return entry->val;
+      return entry->val; // this is us, we have been inserted before
     }
+    j = (j+1) & (sp->entry_max-1);
+  }
+  // free entry found, allocate string:
+  if(val == -1u) return -1u; // no insert requested
+  if(4*(uint64_t)(sp->entry_cnt+1) > 3*(uint64_t)sp->entry_max)
+  {
+    if(_dt_stringpool_grow_entries(sp))
+    {
+      fprintf(stderr, "[stringpool] ran out of memory!\n");
+      return -1u;
+    }
+    j = h & (sp->entry_max-1);
+    while(sp->entry[j].buf) j = (j+1) & (sp->entry_max-1);
+  }
+  if(sp->buf_cnt + (uint64_t)sl + 1 > sp->buf_max && _dt_stringpool_grow_buf(sp, sl+1))
+  {
+    fprintf(stderr, "[stringpool] ran out of memory!\n");
+    return -1u;
   }
-  // yes, as if you can reach here. good luck.
-  return val;
+  dt_stringpool_entry_t *entry = sp->entry + j;
+  entry->buf   = sp->buf + sp->buf_cnt;
+  sp->buf_cnt += sl+1;
+  entry->hash  = h;
+  entry->val   = val;
+  snprintf(entry->buf, sl+1, "%s", str);
+  sp->entry_cnt++;
+  if(dedup) *dedup = entry->buf;
+  return entry->val;
 }
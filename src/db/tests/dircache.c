@@ -0,0 +1,87 @@
+#include "dircache.h"
+#include "core/core.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <dirent.h>
+
+void dt_trace_event(uint64_t name, uint64_t arg, int end) {} // no tracing in here
+
+// ask for the listing until a read with a stamp different to the given one finished
+static const dt_dircache_list_t *
+wait_for(dt_dircache_t *c, const char *path, uint64_t stamp)
+{
+  const dt_dircache_list_t *l = 0;
+  for(int i=0;i<2000;i++)
+  {
+    l = dt_dircache_get(c, path);
+    if(l->stamp != stamp) return l;
+    usleep(1000);
+  }
+  return l;
+}
+
+static int
+has(const dt_dircache_list_t *l, const char *name, uint8_t type)
+{
+  for(uint32_t i=0;i<l->cnt;i++) if(!strcmp(l->ent[i].name, name)) return l->ent[i].type == type;
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  threads_global_init();
+  char dir[] = "/tmp/vkdt-dircache-XXXXXX", fn[100];
+  assert(mkdtemp(dir));
+  for(int i=0;i<100;i++)
+  {
+    snprintf(fn, sizeof(fn), "%s/img_%03d.raw", dir, 99-i);
+    fclose(fopen(fn, "wb"));
+  }
+  snprintf(fn, sizeof(fn), "%s/sub", dir);
+  assert(!mkdir(fn, 0755));
+
+  dt_dircache_t c;
+  dt_dircache_init(&c);
+  const dt_dircache_list_t *l = wait_for(&c, dir, 0);
+  assert(l->cnt == 103); // with . and ..
+  for(uint32_t i=1;i<l->cnt;i++) assert(strcmp(l->ent[i-1].name, l->ent[i].name) < 0);
+  assert(has(l, "sub", DT_DIR));
+  assert(has(l, "img_042.raw", DT_REG));
+
+  // unchanged directories are not read again
+  uint64_t stamp = l->stamp;
+  for(int i=0;i<10;i++) assert(dt_dircache_get(&c, dir)->stamp == stamp);
+
+  // new files are picked up through inotify (or the age limit)
+  snprintf(fn, sizeof(fn), "%s/new.jpg", dir);
+  fclose(fopen(fn, "wb"));
+  l = wait_for(&c, dir, stamp);
+  assert(l->cnt == 104 && has(l, "new.jpg", DT_REG));
+  stamp = l->stamp;
+  unlink(fn);
+  l = wait_for(&c, dir, stamp);
+  assert(l->cnt == 103 && !has(l, "new.jpg", DT_REG));
+
+  // more directories than slots evict the oldest listing
+  for(int i=0;i<DT_DIRCACHE_SIZE+2;i++)
+  {
+    snprintf(fn, sizeof(fn), "%s/sub%02d", dir, i);
+    mkdir(fn, 0755);
+    assert(wait_for(&c, fn, 0)->cnt == 2);
+  }
+  l = wait_for(&c, dir, 0);
+  assert(l->cnt == 103 + DT_DIRCACHE_SIZE + 2);
+
+  dt_dircache_cleanup(&c);
+  char cmd[200];
+  snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+  assert(!system(cmd));
+  threads_global_cleanup();
+  fprintf(stderr, "[dircache] all tests passed\n");
+  exit(0);
+}
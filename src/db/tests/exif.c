@@ -0,0 +1,138 @@
+#include "exif.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+// assemble a minimal tiff with ifd0 and an exif ifd, in either byte order
+typedef struct tiff_t
+{
+  uint8_t buf[1024];
+  int be;
+}
+tiff_t;
+
+static void
+put(tiff_t *t, uint32_t off, uint32_t v, int bytes)
+{
+  for(int i=0;i<bytes;i++) t->buf[off + (t->be ? bytes-1-i : i)] = (v >> (8*i)) & 0xff;
+}
+
+static uint32_t data_end = 512; // strings and rationals go here
+
+static void
+entry(tiff_t *t, uint32_t off, uint16_t tag, uint16_t type, uint32_t cnt, uint32_t v)
+{
+  put(t, off, tag, 2); put(t, off+2, type, 2); put(t, off+4, cnt, 4);
+  if(type == 3) put(t, off+8, v, 2);
+  else          put(t, off+8, v, 4);
+}
+
+static void
+entry_string(tiff_t *t, uint32_t off, uint16_t tag, const char *s)
+{
+  const uint32_t len = strlen(s) + 1;
+  if(len <= 4) { entry(t, off, tag, 2, len, 0); memcpy(t->buf + off + 8, s, len); return; }
+  entry(t, off, tag, 2, len, data_end);
+  memcpy(t->buf + data_end, s, len);
+  data_end += (len + 1) & ~1u;
+}
+
+static void
+entry_rational(tiff_t *t, uint32_t off, uint16_t tag, uint32_t num, uint32_t den)
+{
+  entry(t, off, tag, 5, 1, data_end);
+  put(t, data_end, num, 4); put(t, data_end+4, den, 4);
+  data_end += 8;
+}
+
+static void
+make_tiff(tiff_t *t, int be)
+{
+  memset(t, 0, sizeof(*t));
+  data_end = 512;
+  t->be = be;
+  t->buf[0] = t->buf[1] = be ? 'M' : 'I';
+  put(t, 2, 42, 2);
+  put(t, 4, 8, 4);
+  put(t, 8, 3, 2); // ifd0
+  entry_string(t, 10, 0x010f, "SONY");
+  entry_string(t, 22, 0x0110, "ILCE-7M3");
+  entry(t, 34, 0x8769, 4, 1, 100);
+  put(t, 100, 6, 2); // exif ifd
+  entry_rational(t, 102, 0x829a, 1, 250);
+  entry_rational(t, 114, 0x829d, 28, 10);
+  entry(t, 126, 0x8827, 3, 1, 400);
+  entry_string(t, 138, 0x9003, "2024:06:21 18:30:05");
+  entry_rational(t, 150, 0x920a, 35, 1);
+  entry_string(t, 162, 0xa434, "FE 35mm F1.8");
+}
+
+static void
+check(const dt_db_exif_t *exif)
+{
+  assert(!strcmp(exif->model, "Sony ILCE-7M3"));
+  assert(!strcmp(exif->lens, "FE 35mm F1.8"));
+  assert(!strcmp(exif->createdate, "2024:06:21 18:30:05"));
+  assert(fabsf(exif->exposure - 1.0f/250.0f) < 1e-6f);
+  assert(fabsf(exif->aperture - 2.8f) < 1e-6f);
+  assert(exif->iso == 400.0f);
+  assert(exif->focal_length == 35.0f);
+}
+
+int main(int argc, char *argv[])
+{
+  const char *fn = "exif-test.tmp";
+  dt_db_exif_t exif;
+  tiff_t t;
+  for(int be=0;be<2;be++)
+  { // plain tiff, as most raw formats
+    make_tiff(&t, be);
+    FILE *f = fopen(fn, "wb");
+    fwrite(t.buf, sizeof(t.buf), 1, f);
+    fclose(f);
+    assert(!dt_db_exif_read(fn, &exif));
+    check(&exif);
+  }
+
+  { // the same inside the app1 segment of a jpeg
+    make_tiff(&t, 1);
+    const uint8_t soi[] = { 0xff, 0xd8, 0xff, 0xe0, 0x00, 0x04, 0x00, 0x00 }; // some app0 first
+    const uint32_t len = sizeof(t.buf) + 8;
+    const uint8_t app1[] = { 0xff, 0xe1, len >> 8, len & 0xff, 'E', 'x', 'i', 'f', 0, 0 };
+    FILE *f = fopen(fn, "wb");
+    fwrite(soi, sizeof(soi), 1, f);
+    fwrite(app1, sizeof(app1), 1, f);
+    fwrite(t.buf, sizeof(t.buf), 1, f);
+    fclose(f);
+    assert(!dt_db_exif_read(fn, &exif));
+    check(&exif);
+  }
+
+  { // broken offsets must not read outside the file
+    make_tiff(&t, 0);
+    put(&t, 110, 0x7ffffff0, 4); // exposure time rational
+    FILE *f = fopen(fn, "wb");
+    fwrite(t.buf, sizeof(t.buf), 1, f);
+    fclose(f);
+    dt_db_exif_read(fn, &exif);
+    assert(exif.exposure == 0.0f && !strcmp(exif.lens, "FE 35mm F1.8"));
+    put(&t, 42, 0xfff0, 4);      // exif ifd
+    f = fopen(fn, "wb");
+    fwrite(t.buf, sizeof(t.buf), 1, f);
+    fclose(f);
+    dt_db_exif_read(fn, &exif);
+    assert(!strcmp(exif.model, "Sony ILCE-7M3") && exif.lens[0] == 0);
+  }
+
+  { // no tiff at all: the date falls back to the modification time
+    FILE *f = fopen(fn, "wb");
+    for(int i=0;i<1000;i++) fputc('x', f);
+    fclose(f);
+    assert(dt_db_exif_read(fn, &exif));
+    assert(strlen(exif.createdate) == 19 && exif.createdate[4] == ':');
+  }
+  unlink(fn);
+  return 0;
+}
@@ -0,0 +1,52 @@
+#include "hash.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+static int
+compare_u64(const void *a, const void *b)
+{
+  const uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+int main(int argc, char *argv[])
+{
+  // streaming in any split gives the same as hashing at once
+  const char *s = "/home/user/pictures/2024/holidays/with/a/long/path/IMG_12345.CR3.cfg";
+  const size_t n = strlen(s);
+  const uint64_t ref = dt_hash(s, n, 0);
+  assert(ref == hash64(s));
+  assert(ref == hash64_l(s, -1ul));
+  assert(dt_hash(s, 10, 0) == hash64_l(s, 10));
+  for(size_t a=0;a<=n;a++) for(size_t b=a;b<=n;b++)
+  {
+    dt_hash_t h;
+    dt_hash_init(&h, 0);
+    dt_hash_update(&h, s, a);
+    dt_hash_update(&h, s+a, b-a);
+    dt_hash_update(&h, s+b, n-b);
+    assert(dt_hash_final(&h) == ref);
+  }
+  // seed and trailing zeros make a difference
+  const char z[2] = {0};
+  assert(dt_hash(s, n, 1) != ref);
+  assert(dt_hash(z, 0, 0) != dt_hash(z, 1, 0));
+  assert(dt_hash(z, 1, 0) != dt_hash(z, 2, 0));
+
+  // no collisions among a million similar file names
+  const int cnt = 1<<20;
+  uint64_t *h = malloc(sizeof(uint64_t)*cnt);
+  char fn[256];
+  for(int i=0;i<cnt;i++)
+  {
+    snprintf(fn, sizeof(fn), "/home/user/pictures/2024/IMG_%07d.CR3.cfg", i);
+    h[i] = hash64(fn);
+  }
+  qsort(h, cnt, sizeof(uint64_t), compare_u64);
+  for(int i=1;i<cnt;i++) assert(h[i] != h[i-1]);
+  free(h);
+  fprintf(stderr, "[hash] all good\n");
+  exit(0);
+}
@@ -0,0 +1,80 @@
+#include "thumbpack.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+// write a fake bc1 thumbnail as o-bc1 would, with the blocks of mip level l set to val+l
+static void
+write_bc1(const char *dir, uint64_t hash, uint32_t wd, uint32_t ht, uint8_t val, uint32_t version)
+{
+  char fn[1100];
+  snprintf(fn, sizeof(fn), "%s/%lx.bc1", dir, hash);
+  gzFile f = gzopen(fn, "wb");
+  uint32_t header[4] = { 0x7a316362u, version, wd, ht };
+  gzwrite(f, header, sizeof(header));
+  const int levels = dt_bc1_levels(wd/4, ht/4, version);
+  uint8_t *buf = malloc(dt_bc1_size(wd/4, ht/4, 1));
+  for(int l=0;l<levels;l++)
+  {
+    const size_t size = 8*dt_bc1_blocks(wd/4, l)*dt_bc1_blocks(ht/4, l);
+    memset(buf, val+l, size);
+    gzwrite(f, buf, size);
+  }
+  gzclose(f);
+  free(buf);
+}
+
+static void
+check(dt_thumbpack_t *tp, uint64_t hash, uint32_t wd, uint32_t ht, uint8_t val, int want, int have)
+{
+  dt_thumbpack_entry_t *e = dt_thumbpack_find(tp, hash);
+  assert(e && e->wd == wd && e->ht == ht);
+  uint8_t *buf = malloc(dt_bc1_size(wd/4, ht/4, want));
+  int levels = want;
+  assert(!dt_thumbpack_read(tp, e, buf, &levels));
+  assert(levels == have);
+  size_t off = 0;
+  for(int l=0;l<levels;l++)
+    for(size_t i=0;i<8*dt_bc1_blocks(wd/4, l)*dt_bc1_blocks(ht/4, l);i++)
+      assert(buf[off++] == val+l);
+  free(buf);
+}
+
+int main(int argc, char *argv[])
+{
+  char dir[] = "/tmp/vkdt-thumbpack-XXXXXX";
+  assert(mkdtemp(dir));
+  dt_thumbpack_t tp;
+
+  assert(dt_bc1_levels(16, 8, 2) == 5 && dt_bc1_levels(100, 66, 2) == 8 && dt_bc1_levels(1, 1, 2) == 1);
+  assert(dt_bc1_size(5, 3, 3) == 8*(15 + 3*2 + 2*1));
+
+  write_bc1(dir, 0xc0ffee, 64, 32, 1, 2);
+  write_bc1(dir, 0x1337,   16, 16, 2, 1); // from before the mip chain
+  assert(dt_thumbpack_merge(dir) == 2);
+  assert(dt_thumbpack_merge(dir) == 0);
+  assert(!dt_thumbpack_open(&tp, dir));
+  check(&tp, 0xc0ffee, 64, 32, 1, 3, 3);
+  check(&tp, 0xc0ffee, 64, 32, 1, 9, 5);
+  check(&tp, 0x1337,   16, 16, 2, 3, 1);
+  assert(!dt_thumbpack_find(&tp, 0xdead));
+  dt_thumbpack_invalidate(&tp, 0x1337);
+  assert(!dt_thumbpack_find(&tp, 0x1337));
+  dt_thumbpack_close(&tp);
+
+  // replace one and add one, this compacts the data file
+  write_bc1(dir, 0xc0ffee, 8, 8, 3, 2);
+  write_bc1(dir, 0xbeef,   4, 4, 4, 2);
+  assert(dt_thumbpack_merge(dir) == 2);
+  assert(!dt_thumbpack_open(&tp, dir));
+  assert(tp.header->entry_cnt == 2 && tp.header->gen == 1 && tp.header->dead_size == 0);
+  check(&tp, 0xc0ffee, 8, 8, 3, 3, 2);
+  check(&tp, 0xbeef,   4, 4, 4, 3, 1);
+  dt_thumbpack_close(&tp);
+
+  char cmd[100];
+  snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+  if(system(cmd)) exit(1);
+  exit(0);
+}
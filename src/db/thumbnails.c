@@ -1,5 +1,6 @@
 #include "core/log.h"
 #include "core/fs.h"
+#include "core/trace.h"
 #include "db/db.h"
 #include "db/thumbnails.h"
 #include "db/hash.h"
@@ -9,6 +10,7 @@
 #include "pipe/graph-export.h"
 #include "pipe/modules/api.h"
 #include "pipe/dlist.h"
+#include "pipe/modules/o-bc1/bc1.h"
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -16,6 +18,7 @@
 #include <stdlib.h>
 #include <time.h>
 #include <errno.h>
+#include <limits.h>
 
 #if 0
 void
@@ -38,13 +41,48 @@ debug_test_list(
 }
 #endif
 
+// called by the memory budget from any thread, the pages are given back
+// by the gui thread in thumbnails_shrink()
+static void
+thumbnails_release(
+    void    *data,
+    uint32_t heap,
+    uint64_t size)
+{
+  dt_thumbnails_t *tn = data;
+  if(heap == tn->heap_index)
+    __atomic_store_n(&tn->release_size, size, __ATOMIC_RELEASE);
+}
+
+// move all mip levels of an atlas page to general layout
+static void
+thumbnails_barrier(
+    VkCommandBuffer cmd_buf,
+    VkImage         image,
+    VkImageLayout   old_layout)
+{
+  IMAGE_BARRIER(cmd_buf,
+      .image            = image,
+      .subresourceRange = {
+        .aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
+        .levelCount     = VK_REMAINING_MIP_LEVELS,
+        .layerCount     = 1,
+      },
+      .srcAccessMask    = VK_ACCESS_SHADER_WRITE_BIT|VK_ACCESS_TRANSFER_WRITE_BIT,
+      .dstAccessMask    = VK_ACCESS_SHADER_READ_BIT|VK_ACCESS_TRANSFER_READ_BIT,
+      .oldLayout        = old_layout,
+      .newLayout        = VK_IMAGE_LAYOUT_GENERAL);
+}
+
 VkResult
 dt_thumbnails_init(
     dt_thumbnails_t *tn,
     const int wd,
     const int ht,
     const int cnt,
-    const size_t heap_size)
+    size_t heap_size,
+    const int threads,
+    const char *subdir)
 {
   memset(tn, 0, sizeof(*tn));
 
@@ -52,6 +90,11 @@ dt_thumbnails_init(
   const char *home = getenv("HOME");
   snprintf(tn->cachedir, sizeof(tn->cachedir), "%s/.cache/vkdt", home);
   int err = fs_mkdir(tn->cachedir, 0755);
+  if(subdir && (!err || errno == EEXIST))
+  { // separate tier with its own files and pack
+    snprintf(tn->cachedir, sizeof(tn->cachedir), "%s/.cache/vkdt/%s", home, subdir);
+    err = fs_mkdir(tn->cachedir, 0755);
+  }
   if(err && errno != EEXIST)
   {
     dt_log(s_log_err|s_log_db, "could not create thumbnail cache directory!");
@@ -62,27 +105,76 @@ dt_thumbnails_init(
   tn->thumb_ht = ht,
   tn->thumb_max = cnt;
 
-  dt_graph_init(tn->graph + 0);
-  dt_graph_init(tn->graph + 1);
-  tn->graph[0].queue       =  qvk.queue_work0;
-  tn->graph[0].queue_idx   =  qvk.queue_idx_work0;
-  tn->graph[0].queue_mutex = &qvk.queue_work0_mutex;
-  tn->graph[1].queue       =  qvk.queue_work1;
-  tn->graph[1].queue_idx   =  qvk.queue_idx_work1;
-  tn->graph[1].queue_mutex = &qvk.queue_work1_mutex;
+  // fold the loose bc1 files of the last session into the packed cache and map it:
+  int merged = dt_thumbpack_merge(tn->cachedir);
+  if(merged > 0) dt_log(s_log_db, "[thm] packed %d thumbnails", merged);
+  else if(merged < 0) dt_log(s_log_db|s_log_err, "[thm] could not write the packed thumbnail cache");
+  dt_thumbpack_open(&tn->pack, tn->cachedir);
 
-  threads_mutex_init(tn->graph_lock + 0, 0);
-  threads_mutex_init(tn->graph_lock + 1, 0);
+  tn->graph_cnt = threads;
+  if(tn->graph_cnt <= 0)
+  { // decoding is cpu bound, so use many graphs, but only as many as fit comfortably into device memory
+    VkPhysicalDeviceMemoryProperties mem_prop;
+    vkGetPhysicalDeviceMemoryProperties(qvk.physical_device, &mem_prop);
+    uint64_t heap = 0;
+    for(int i=0;i<mem_prop.memoryHeapCount;i++)
+      if(mem_prop.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+        heap = MAX(heap, mem_prop.memoryHeaps[i].size);
+    const int mem_cnt = heap / 2 / (512ul<<20); // half the device for thumbnails, 512MB per graph
+    tn->graph_cnt = MIN(threads_num() / 2, mem_cnt);
+  }
+  tn->graph_cnt = CLAMP(tn->graph_cnt, 1, DT_THUMBNAILS_MAX_THREADS);
+  tn->graph      = malloc(sizeof(dt_graph_t)*tn->graph_cnt);
+  tn->graph_lock = malloc(sizeof(threads_mutex_t)*tn->graph_cnt);
+  for(int i=0;i<tn->graph_cnt;i++)
+  { // distribute over the two work queues, graphs sharing a queue share the mutex
+    dt_graph_init(tn->graph + i);
+    tn->graph[i].queue       = (i & 1) ?  qvk.queue_work1       :  qvk.queue_work0;
+    tn->graph[i].queue_idx   = (i & 1) ?  qvk.queue_idx_work1   :  qvk.queue_idx_work0;
+    tn->graph[i].queue_mutex = (i & 1) ? &qvk.queue_work1_mutex : &qvk.queue_work0_mutex;
+    threads_mutex_init(tn->graph_lock + i, 0);
+  }
+  if(cnt == 0) dt_log(s_log_db, "[thm] using %d threads to create thumbnails", tn->graph_cnt);
 
   // just creating bc1 files in the background, not actually used to serve
   // any thumbnails:
   if(cnt == 0) return VK_SUCCESS;
 
+  // leave room for the graphs and everybody else sharing the device:
+  tn->heap_index = qvk.mem_properties.memoryTypes[
+    qvk_get_memory_type(~0u, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)].heapIndex;
+  uint64_t budget, usage;
+  qvk_memory_budget(tn->heap_index, &budget, &usage);
+  const uint64_t avail = budget > usage ? (budget - usage)/2 : 0;
+  if(heap_size > avail)
+  {
+    dt_log(s_log_db|s_log_mem, "[thm] reducing thumbnail memory to %3.1f MB to fit the budget", avail/(1024.0*1024.0));
+    heap_size = avail;
+  }
+
+  // lay out the slots on as few atlas pages as the device allows:
+  VkPhysicalDeviceProperties dev_prop;
+  vkGetPhysicalDeviceProperties(qvk.physical_device, &dev_prop);
+  tn->slot_wd = 4*((tn->thumb_wd+3)/4);
+  tn->slot_ht = 4*((tn->thumb_ht+3)/4);
+  const uint32_t max_dim = 4*(dev_prop.limits.maxImageDimension2D/4);
+  tn->slots_x = MAX(1, max_dim / tn->slot_wd);
+  tn->slots_per_page = tn->slots_x * MAX(1, max_dim / tn->slot_ht);
+  tn->levels = 1; // as long as the slots of the next level start at a block boundary
+  while(tn->levels < DT_THUMBNAILS_MAX_LEVELS && !(tn->slot_wd % (4u<<tn->levels)) && !(tn->slot_ht % (4u<<tn->levels)))
+    tn->levels++;
+  const uint64_t slot_size = dt_bc1_size(tn->slot_wd/4, tn->slot_ht/4, tn->levels);
+  const uint64_t slot_cnt = MIN(heap_size / slot_size, (uint64_t)DT_THUMBNAILS_MAX_PAGES * tn->slots_per_page);
+  tn->thumb_max = MAX(3ul, MIN((uint64_t)tn->thumb_max, slot_cnt)); // busy bee and a minimal lru list
+  tn->page_cnt = (tn->thumb_max + tn->slots_per_page-1) / tn->slots_per_page;
+  tn->page_wd = tn->slot_wd * MIN(tn->slots_x, (uint32_t)tn->thumb_max);
+  tn->page_ht = tn->slot_ht * ((MIN(tn->slots_per_page, (uint32_t)tn->thumb_max) + tn->slots_x-1) / tn->slots_x);
+  if(tn->thumb_max < cnt)
+    dt_log(s_log_db, "[thm] only %d thumbnails fit into the heap", tn->thumb_max);
+
   tn->thumb = malloc(sizeof(dt_thumbnail_t)*tn->thumb_max);
   memset(tn->thumb, 0, sizeof(dt_thumbnail_t)*tn->thumb_max);
-  // need at least one extra slot to catch free block (if contiguous, else more)
-  // seems we sometimes get quite fragmented memory after long runs, be sure we can always split free memory:
-  dt_vkalloc_init(&tn->alloc, 3*tn->thumb_max, heap_size);
+  for(int k=0;k<tn->thumb_max;k++) tn->thumb[k].imgid = -1u; // all slots free
 
   // init lru list
   tn->lru = tn->thumb + 1; // [0] is special: busy bee
@@ -95,20 +187,20 @@ dt_thumbnails_init(
     tn->thumb[k].prev = tn->thumb+k-1;
   }
 
-  dt_log(s_log_db, "allocating %3.1f MB for thumbnails", heap_size/(1024.0*1024.0));
+  dt_log(s_log_db, "allocating %3.1f MB for thumbnails on %d pages of %ux%u",
+      heap_size/(1024.0*1024.0), tn->page_cnt, tn->page_wd, tn->page_ht);
 
-  // alloc dummy image to get memory type bits and something to display
   VkFormat format = VK_FORMAT_BC1_RGB_SRGB_BLOCK;
   VkImageCreateInfo images_create_info = {
     .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
     .imageType = VK_IMAGE_TYPE_2D,
     .format = format,
     .extent = {
-      .width  = 24,
-      .height = 24,
+      .width  = tn->page_wd,
+      .height = tn->page_ht,
       .depth  = 1
     },
-    .mipLevels             = 1,
+    .mipLevels             = tn->levels,
     .arrayLayers           = 1,
     .samples               = VK_SAMPLE_COUNT_1_BIT,
     .tiling                = VK_IMAGE_TILING_OPTIMAL,
@@ -121,32 +213,51 @@ dt_thumbnails_init(
     .pQueueFamilyIndices   = 0,
     .initialLayout         = VK_IMAGE_LAYOUT_UNDEFINED,
   };
+  VkImageViewCreateInfo images_view_create_info = {
+    .sType      = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+    .viewType   = VK_IMAGE_VIEW_TYPE_2D,
+    .format     = format,
+    .subresourceRange = {
+      .aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
+      .baseMipLevel   = 0,
+      .levelCount     = tn->levels,
+      .baseArrayLayer = 0,
+      .layerCount     = 1
+    },
+  };
 
-  VkImage img;
-  QVKR(vkCreateImage(qvk.device, &images_create_info, NULL, &img));
+  for(int p=0;p<tn->page_cnt;p++)
+    QVKR(vkCreateImage(qvk.device, &images_create_info, NULL, &tn->page[p].image));
   VkMemoryRequirements mem_req;
-  vkGetImageMemoryRequirements(qvk.device, img, &mem_req);
+  vkGetImageMemoryRequirements(qvk.device, tn->page[0].image, &mem_req);
   tn->memory_type_bits = mem_req.memoryTypeBits;
-  vkDestroyImage(qvk.device, img, VK_NULL_HANDLE);
+  tn->page_size = mem_req.size;
 
   VkMemoryAllocateInfo mem_alloc_info = {
     .sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-    .allocationSize  = heap_size,
+    .allocationSize  = mem_req.size,
     .memoryTypeIndex = qvk_get_memory_type(tn->memory_type_bits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
   };
-  QVKR(vkAllocateMemory(qvk.device, &mem_alloc_info, 0, &tn->vkmem));
+  tn->heap_index = qvk.mem_properties.memoryTypes[mem_alloc_info.memoryTypeIndex].heapIndex;
+  for(int p=0;p<tn->page_cnt;p++)
+  {
+    QVKR(vkAllocateMemory(qvk.device, &mem_alloc_info, 0, &tn->page[p].mem));
+    QVKR(vkBindImageMemory(qvk.device, tn->page[p].image, tn->page[p].mem, 0));
+    images_view_create_info.image = tn->page[p].image;
+    QVKR(vkCreateImageView(qvk.device, &images_view_create_info, NULL, &tn->page[p].image_view));
+  }
 
   // create descriptor pool (keep at least one for each type)
   VkDescriptorPoolSize pool_sizes[] = {{
     .type            = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-    .descriptorCount = tn->thumb_max,
+    .descriptorCount = 2*tn->page_cnt,
   }};
 
   VkDescriptorPoolCreateInfo pool_info = {
     .sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
     .poolSizeCount = LENGTH(pool_sizes),
     .pPoolSizes    = pool_sizes,
-    .maxSets       = tn->thumb_max,
+    .maxSets       = 2*tn->page_cnt,
   };
   QVKR(vkCreateDescriptorPool(qvk.device, &pool_info, 0, &tn->dset_pool));
 
@@ -170,9 +281,88 @@ dt_thumbnails_init(
     .descriptorSetCount = 1,
     .pSetLayouts = &tn->dset_layout,
   };
+  // the pages stay in general layout, so uploads never have to transition
+  // an image that the gui may be sampling at the same time.
+  VkDescriptorImageInfo img_info[2*DT_THUMBNAILS_MAX_PAGES];
+  VkWriteDescriptorSet  img_dset[2*DT_THUMBNAILS_MAX_PAGES];
+  for(int p=0;p<tn->page_cnt;p++) for(int s=0;s<2;s++)
+  {
+    QVKR(vkAllocateDescriptorSets(qvk.device, &dset_info, &tn->page[p].dset[s]));
+    img_info[2*p+s] = (VkDescriptorImageInfo) {
+      .sampler     = s ? qvk.tex_sampler_nearest : qvk.tex_sampler,
+      .imageView   = tn->page[p].image_view,
+      .imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+    };
+    img_dset[2*p+s] = (VkWriteDescriptorSet) {
+      .sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+      .dstSet          = tn->page[p].dset[s],
+      .dstBinding      = 0,
+      .dstArrayElement = 0,
+      .descriptorCount = 1,
+      .descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+      .pImageInfo      = img_info + 2*p+s,
+    };
+  }
+  vkUpdateDescriptorSets(qvk.device, 2*tn->page_cnt, img_dset, 0, NULL);
   for(int i=0;i<tn->thumb_max;i++)
-    QVKR(vkAllocateDescriptorSets(qvk.device, &dset_info, &tn->thumb[i].dset));
+    tn->thumb[i].dset = tn->page[i / tn->slots_per_page].dset[0];
 
+  // staging buffer and command buffer to upload thumbnails from the pack in batches
+  tn->staging_size = 32ul<<20;
+  VkBufferCreateInfo buffer_info = {
+    .sType       = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+    .size        = tn->staging_size,
+    .usage       = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+    .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+  };
+  QVKR(vkCreateBuffer(qvk.device, &buffer_info, 0, &tn->staging));
+  VkMemoryRequirements buf_mem_req;
+  vkGetBufferMemoryRequirements(qvk.device, tn->staging, &buf_mem_req);
+  VkMemoryAllocateInfo staging_alloc_info = {
+    .sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+    .allocationSize  = buf_mem_req.size,
+    .memoryTypeIndex = qvk_get_memory_type(buf_mem_req.memoryTypeBits,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT),
+  };
+  QVKR(vkAllocateMemory(qvk.device, &staging_alloc_info, 0, &tn->vkmem_staging));
+  QVKR(vkBindBufferMemory(qvk.device, tn->staging, tn->vkmem_staging, 0));
+  QVKR(vkMapMemory(qvk.device, tn->vkmem_staging, 0, VK_WHOLE_SIZE, 0, (void **)&tn->staging_mapped));
+
+  VkCommandPoolCreateInfo cmd_pool_create_info = {
+    .sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+    .queueFamilyIndex = tn->graph[0].queue_idx,
+    .flags            = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+  };
+  QVKR(vkCreateCommandPool(qvk.device, &cmd_pool_create_info, 0, &tn->command_pool));
+  VkCommandBufferAllocateInfo cmd_buf_alloc_info = {
+    .sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+    .commandPool        = tn->command_pool,
+    .level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+    .commandBufferCount = 1,
+  };
+  QVKR(vkAllocateCommandBuffers(qvk.device, &cmd_buf_alloc_info, &tn->command_buffer));
+  VkFenceCreateInfo fence_info = { .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
+  QVKR(vkCreateFence(qvk.device, &fence_info, 0, &tn->fence));
+
+  // move the atlas pages to general layout once:
+  VkCommandBuffer cmd_buf = tn->command_buffer;
+  VkCommandBufferBeginInfo begin_info = {
+    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+    .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+  };
+  QVKR(vkBeginCommandBuffer(cmd_buf, &begin_info));
+  for(int p=0;p<tn->page_cnt;p++)
+    thumbnails_barrier(cmd_buf, tn->page[p].image, VK_IMAGE_LAYOUT_UNDEFINED);
+  QVKR(vkEndCommandBuffer(cmd_buf));
+  VkSubmitInfo submit = {
+    .sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+    .commandBufferCount = 1,
+    .pCommandBuffers    = &cmd_buf,
+  };
+  QVKLR(tn->graph[0].queue_mutex, vkQueueSubmit(tn->graph[0].queue, 1, &submit, tn->fence));
+  QVKR(vkWaitForFences(qvk.device, 1, &tn->fence, VK_TRUE, UINT64_MAX));
+
+  qvk_budget_register(thumbnails_release, tn);
   return VK_SUCCESS;
 }
 
@@ -180,22 +370,64 @@ void
 dt_thumbnails_cleanup(
     dt_thumbnails_t *tn)
 {
-  for(int i=0;i<DT_THUMBNAILS_THREADS;i++)
+  for(int i=0;i<tn->graph_cnt;i++)
   {
     dt_graph_cleanup(tn->graph + i);
     pthread_mutex_destroy(tn->graph_lock + i);
   }
-  for(int i=0;i<tn->thumb_max;i++)
+  free(tn->graph);
+  free(tn->graph_lock);
+  tn->graph = 0;
+  tn->graph_lock = 0;
+  tn->graph_cnt = 0;
+  for(int p=0;p<tn->page_cnt;p++)
   {
-    if(tn->thumb[i].image)      vkDestroyImage    (qvk.device, tn->thumb[i].image,      0);
-    if(tn->thumb[i].image_view) vkDestroyImageView(qvk.device, tn->thumb[i].image_view, 0);
+    if(tn->page[p].image)      vkDestroyImage    (qvk.device, tn->page[p].image,      0);
+    if(tn->page[p].image_view) vkDestroyImageView(qvk.device, tn->page[p].image_view, 0);
+    if(tn->page[p].mem)        vkFreeMemory      (qvk.device, tn->page[p].mem,        0);
   }
+  if(tn->page_cnt) qvk_budget_unregister(tn);
+  tn->page_cnt = 0;
   free(tn->thumb);
   tn->thumb = 0;
   if(tn->dset_layout) vkDestroyDescriptorSetLayout(qvk.device, tn->dset_layout, 0);
   if(tn->dset_pool)   vkDestroyDescriptorPool     (qvk.device, tn->dset_pool,   0);
-  if(tn->vkmem)       vkFreeMemory                (qvk.device, tn->vkmem,       0);
-  dt_vkalloc_cleanup(&tn->alloc);
+  if(tn->fence)        vkDestroyFence      (qvk.device, tn->fence,         0);
+  if(tn->command_pool) vkDestroyCommandPool(qvk.device, tn->command_pool,  0);
+  if(tn->staging)      vkDestroyBuffer     (qvk.device, tn->staging,       0);
+  if(tn->vkmem_staging)vkFreeMemory        (qvk.device, tn->vkmem_staging, 0);
+  tn->staging = 0;
+  dt_thumbpack_close(&tn->pack);
+}
+
+// the name of the thumbnail of the given cfg in the cache. thumbnails used to
+// be named by hash64_legacy(), if the pack still has one under that name it is
+// written out as a loose file under the new name (the next merge folds it back
+// in) and the old entry is dropped.
+static uint64_t
+thumbnail_hash(
+    dt_thumbnails_t *tn,
+    const char      *filename)
+{
+  const uint64_t hash = hash64(filename);
+  if(!tn->pack.data || dt_thumbpack_find(&tn->pack, hash)) return hash;
+  dt_thumbpack_entry_t *e = dt_thumbpack_find(&tn->pack, hash64_legacy(filename));
+  if(!e || e->offset + e->size > tn->pack.data_size) return hash;
+  char bc1filename[PATH_MAX+100], tmpfilename[PATH_MAX+120];
+  snprintf(bc1filename, sizeof(bc1filename), "%s/%lx.bc1", tn->cachedir, hash);
+  if(!access(bc1filename, F_OK)) return hash; // rendered again in the meantime
+  snprintf(tmpfilename, sizeof(tmpfilename), "%s.XXXXXX", bc1filename);
+  const int fd = mkstemp(tmpfilename);
+  if(fd == -1) return hash;
+  const time_t mtime = e->mtime;
+  int ok = write(fd, tn->pack.data + e->offset, e->size) == (ssize_t)e->size;
+  const struct timespec times[2] = {{ .tv_sec = mtime }, { .tv_sec = mtime }};
+  ok &= !futimens(fd, times);
+  ok &= !close(fd);
+  if(ok && !rename(tmpfilename, bc1filename))
+    __atomic_store_n(&e->mtime, 0, __ATOMIC_RELAXED);
+  else unlink(tmpfilename);
+  return hash;
 }
 
 void
@@ -207,6 +439,8 @@ dt_thumbnails_invalidate(
   char bc1filename[1040];
   snprintf(bc1filename, sizeof(bc1filename), "%s/%lx.bc1", tn->cachedir, hash);
   unlink(bc1filename);
+  dt_thumbpack_invalidate(&tn->pack, hash);
+  dt_thumbpack_invalidate(&tn->pack, hash64_legacy(filename));
 }
 
 // process one image and write a .bc1 thumbnail
@@ -229,7 +463,7 @@ dt_thumbnails_cache_one(
   char cfgfilename[PATH_MAX+100];
   char deffilename[PATH_MAX+100];
   char bc1filename[PATH_MAX+100];
-  uint64_t hash = hash64(filename);
+  uint64_t hash = thumbnail_hash(tn, filename);
   snprintf(bc1filename, sizeof(bc1filename), "%s/%lx.bc1", tn->cachedir, hash);
   snprintf(cfgfilename, sizeof(cfgfilename), "%s", filename);
   snprintf(deffilename, sizeof(deffilename), "default.%"PRItkn, dt_token_str(input_module));
@@ -248,9 +482,10 @@ dt_thumbnails_cache_one(
     else return VK_INCOMPLETE;
   }
 
-  if(!stat(bc1filename, &statbuf))
-  { // check timestamp
-    tbc1 = statbuf.st_mtim.tv_sec;
+  dt_thumbpack_entry_t *e = dt_thumbpack_find(&tn->pack, hash);
+  if(e || !stat(bc1filename, &statbuf))
+  { // check timestamp. a valid pack entry means there is no loose file
+    tbc1 = e ? e->mtime : statbuf.st_mtim.tv_sec;
     if(tcfg && (tbc1 >= tcfg)) return VK_SUCCESS; // already up to date
   }
 
@@ -259,13 +494,15 @@ dt_thumbnails_cache_one(
   char *extrap[] = {
     "param:f2srgb:main:usemat:0", // write thumbnails as rec2020 with gamma
     "frames:1",                   // only render first frame of animation
+    "param:i-vid:main:still:1",   // videos seek to their poster frame instead
   };
   dt_graph_export_t param = {
-    .extra_param_cnt = 2,
+    .extra_param_cnt = input_module == dt_token("i-vid") ? 3 : 2,
     .p_extra_param   = extrap,
     .p_cfgfile       = cfgfilename,
     .p_defcfg        = deffilename,
     .input_module    = input_module,
+    .input_lod       = 1,
     .output_cnt      = 1,
     .output = {{
       .max_width  = tn->thumb_wd,
@@ -280,17 +517,77 @@ dt_thumbnails_cache_one(
   if(dt_graph_export(graph, &param) != VK_SUCCESS)
   {
     dt_log(s_log_db, "[thm] running the thumbnail graph failed on image '%s'!", filename);
+    if(e)
+    { // keep what we have in the pack, but don't try again
+      __atomic_store_n(&e->mtime, time(0), __ATOMIC_RELAXED);
+      return 4;
+    }
     // mark as dead
     snprintf(cfgfilename, sizeof(cfgfilename), "%s/data/bomb.bc1", dt_pipe.basedir);
-    link(cfgfilename, bc1filename);
+    if(link(cfgfilename, bc1filename) && errno == EEXIST)
+      utimensat(AT_FDCWD, bc1filename, 0, 0); // keep the embedded preview, but don't try again
     return 4;
   }
+  dt_thumbpack_invalidate(&tn->pack, hash); // the loose file is newer
   clock_t end = clock();
   dt_log(s_log_perf, "[thm] ran graph in %3.0fms", 1000.0*(end-beg)/CLOCKS_PER_SEC);
 
   return VK_SUCCESS;
 }
 
+// quick first pass: if there is no thumbnail and no cfg yet, extract the jpeg
+// preview embedded in the raw file. the bc1 is backdated to before the default
+// cfg so dt_thumbnails_cache_one() will still replace it by the processed render.
+// returns VK_SUCCESS only if a preview has been written.
+VkResult
+dt_thumbnails_cache_preview(
+    dt_graph_t      *graph,
+    dt_thumbnails_t *tn,
+    const char      *filename)
+{
+  if(dt_graph_default_input_module(filename) != dt_token("i-raw")) return VK_INCOMPLETE;
+  char bc1filename[PATH_MAX+100];
+  const uint64_t hash = thumbnail_hash(tn, filename);
+  snprintf(bc1filename, sizeof(bc1filename), "%s/%lx.bc1", tn->cachedir, hash);
+  struct stat statbuf = {0};
+  if(dt_thumbpack_find(&tn->pack, hash) ||
+     !stat(bc1filename, &statbuf) || !stat(filename, &statbuf)) return VK_INCOMPLETE; // got a thumbnail or a history
+  char deffilename[PATH_MAX+100];
+  if(snprintf(deffilename, sizeof(deffilename), "%s/default.i-raw", dt_pipe.basedir) >= PATH_MAX ||
+     stat(deffilename, &statbuf)) return VK_INCOMPLETE;
+  const time_t tcfg = statbuf.st_mtim.tv_sec;
+
+  dt_graph_reset(graph);
+  char *extrap[] = { "frames:1" };
+  dt_graph_export_t param = {
+    .extra_param_cnt = 1,
+    .p_extra_param   = extrap,
+    .p_cfgfile       = filename,
+    .p_defcfg        = "default.i-jpg",
+    .input_module    = dt_token("i-jpg"),
+    .input_lod       = 1,
+    .output_cnt      = 1,
+    .output = {{
+      .max_width  = tn->thumb_wd,
+      .max_height = tn->thumb_ht,
+      .mod        = dt_token("o-bc1"),
+      .inst       = dt_token("main"),
+      .p_filename = bc1filename,
+    }},
+  };
+  clock_t beg = clock();
+  if(dt_graph_export(graph, &param) != VK_SUCCESS)
+  { // no embedded preview, the full render will take care of it
+    unlink(bc1filename);
+    return VK_INCOMPLETE;
+  }
+  clock_t end = clock();
+  dt_log(s_log_perf, "[thm] extracted preview in %3.0fms", 1000.0*(end-beg)/CLOCKS_PER_SEC);
+  struct timespec t[2] = {{ .tv_sec = tcfg-1 }, { .tv_sec = tcfg-1 }};
+  utimensat(AT_FDCWD, bc1filename, t, 0);
+  return VK_SUCCESS;
+}
+
 typedef struct cache_coll_job_t
 {
   uint64_t stamp;
@@ -300,7 +597,12 @@ typedef struct cache_coll_job_t
   dt_thumbnails_t *tn;
   dt_db_t *db;
   uint32_t *coll;
+  uint32_t  cnt;
+  uint8_t  *queued;          // 2*cnt flags, shared between all threads: preview and full render still to do
+  threads_mutex_t *pick;     // guards queued
+  threads_mutex_t pick_storage;
   void    (*ufn)(void);
+  int       focused;         // coll is the collection the gui shows, cache_focus() applies
 }
 cache_coll_job_t;
 
@@ -312,7 +614,9 @@ static void thread_free_coll(void *arg)
   if(j->gid == 0)
   {
     pthread_mutex_destroy(&j->mutex_storage);
+    pthread_mutex_destroy(&j->pick_storage);
     free(j->coll);
+    free(j->queued);
     free(j);
   }
 }
@@ -322,14 +626,63 @@ dt_thumbnails_cache_abort(
     dt_thumbnails_t *tn)
 {
   tn->job_timestamp++;
-  for(int i=0;i<DT_THUMBNAILS_THREADS;i++)
+  for(int i=0;i<tn->graph_cnt;i++)
     threads_mutex_lock(tn->graph_lock+i);
   // now we hold all the locks at the same time. anyone picking up a lock after we return from here
   // will definitely see the new timestamp and abort immediately.
-  for(int i=0;i<DT_THUMBNAILS_THREADS;i++)
+  for(int i=0;i<tn->graph_cnt;i++)
     threads_mutex_unlock(tn->graph_lock+i);
 }
 
+void
+dt_thumbnails_cache_focus(
+    dt_thumbnails_t *tn,
+    uint32_t         beg,
+    uint32_t         end)
+{
+  __atomic_store_n(&tn->focus, ((uint64_t)end << 32) | beg, __ATOMIC_RELAXED);
+}
+
+static uint32_t // return the queued index closest to [beg, end) and its distance, or -1u
+cache_coll_nearest(
+    const uint8_t *queued,
+    uint32_t       cnt,
+    uint32_t       beg,
+    uint32_t       end,
+    uint32_t      *dist)
+{
+  for(uint32_t k=beg;k<end;k++) if(queued[k]) { *dist = 0; return k; }
+  for(uint32_t d=1;beg >= d || end-1+d < cnt;d++)
+  {
+    if(end-1+d < cnt && queued[end-1+d]) { *dist = d; return end-1+d; }
+    if(beg >= d && queued[beg-d])        { *dist = d; return beg-d; }
+  }
+  return -1u;
+}
+
+// the threads don't work on the items in order, they pick the most urgent
+// image w.r.t. the range currently visible in the gui. previews of a distance
+// come before the full render of the same distance. lists other than the
+// collection go front to back, their order is their priority.
+static uint32_t
+cache_coll_pick(
+    cache_coll_job_t *j)
+{
+  const uint64_t focus = j->focused ? __atomic_load_n(&j->tn->focus, __ATOMIC_RELAXED) : 1ul << 32;
+  const uint32_t beg = MIN((uint32_t)focus, j->cnt-1);
+  const uint32_t end = CLAMP((uint32_t)(focus >> 32), beg+1, j->cnt);
+  uint32_t d0 = -1u, d1 = -1u;
+  threads_mutex_lock(j->pick);
+  uint32_t p0 = cache_coll_nearest(j->queued,      j->cnt, beg, end, &d0);
+  uint32_t p1 = cache_coll_nearest(j->queued+j->cnt, j->cnt, beg, end, &d1);
+  uint32_t item = -1u;
+  if(p0 != -1u && (p1 == -1u || 2ul*d0 <= 2ul*d1+1)) item = p0;
+  else if(p1 != -1u) item = j->cnt + p1;
+  if(item != -1u) j->queued[item] = 0;
+  threads_mutex_unlock(j->pick);
+  return item;
+}
+
 static void
 thread_work_coll(
     uint32_t item, void *arg)
@@ -337,14 +690,36 @@ thread_work_coll(
   cache_coll_job_t *j = arg;
   threads_mutex_lock(j->tn->graph_lock+j->gid); // shield against potential overscheduling (call _cache_list() from the gui before the old one is done)
   if(j->stamp != j->tn->job_timestamp) goto abort; // job invalid/stale, will not be able to access db any more!
+  item = cache_coll_pick(j);  // every call processes one item, but not necessarily this one
+  if(item == -1u) goto abort;
   j->tn->graph[j->gid].io_mutex = j->mutex;
   char filename[1024];
+  // the first half of the items extracts embedded previews, the second half renders:
+  const int preview = item < j->cnt;
+  if(!preview) item -= j->cnt;
   dt_db_image_path(j->db, j->coll[item], filename, sizeof(filename));
-  (void) dt_thumbnails_cache_one(j->tn->graph + j->gid, j->tn, filename);
+  dt_trace_begin(dt_token(preview ? "preview" : "thumb"), j->coll[item]);
+  if(preview)
+  {
+    VkResult res = dt_thumbnails_cache_preview(j->tn->graph + j->gid, j->tn, filename);
+    dt_trace_end(dt_token("preview"), j->coll[item]);
+    if(res != VK_SUCCESS) goto done;
+  }
+  else
+  {
+    (void) dt_thumbnails_cache_one(j->tn->graph + j->gid, j->tn, filename);
+    dt_trace_end(dt_token("thumb"), j->coll[item]);
+  }
   // invalidate what we have in memory to trigger a reload:
   j->db->image[j->coll[item]].thumbnail = 0;
+  if(j->ufn)
+  { // only redraw if the gui shows it, the others are loaded when scrolled to
+    const uint64_t focus = __atomic_load_n(&j->tn->focus, __ATOMIC_RELAXED);
+    if(!j->focused || !focus || (item >= (uint32_t)focus && item < (uint32_t)(focus >> 32)))
+      j->ufn();
+  }
+done:
   j->tn->graph[j->gid].io_mutex = 0;
-  if(j->ufn) j->ufn();
 abort:
   threads_mutex_unlock(j->tn->graph_lock+j->gid);
 }
@@ -365,37 +740,48 @@ dt_thumbnails_cache_list(
 
   uint32_t *collection = malloc(sizeof(uint32_t) * imgid_cnt);
   memcpy(collection, imgid, sizeof(uint32_t) * imgid_cnt); // take copy because this thing changes
-  cache_coll_job_t *job = malloc(sizeof(cache_coll_job_t)*DT_THUMBNAILS_THREADS);
+  uint8_t *queued = malloc(2 * imgid_cnt);
+  memset(queued, 1, 2 * imgid_cnt);
+  cache_coll_job_t *job = malloc(sizeof(cache_coll_job_t)*tn->graph_cnt);
   int taskid = -1;
-  for(int k=0;k<DT_THUMBNAILS_THREADS;k++)
+  for(int k=0;k<MIN(tn->graph_cnt, imgid_cnt);k++)
   {
     if(k == 0)
     {
       job[0] = (cache_coll_job_t) {
         .stamp = tn->job_timestamp,
         .coll  = collection,
+        .cnt   = imgid_cnt,
         .gid   = k,
         .tn    = tn,
         .db    = db,
         .ufn   = updatefn,
+        .focused = imgid == db->collection,
       };
       threads_mutex_init(&job[0].mutex_storage, 0);
-      job[0].mutex = &job[0].mutex_storage;
+      threads_mutex_init(&job[0].pick_storage, 0);
+      job[0].mutex  = &job[0].mutex_storage;
+      job[0].pick   = &job[0].pick_storage;
+      job[0].queued = queued;
     }
     else job[k] = (cache_coll_job_t) {
       .stamp = tn->job_timestamp,
       .mutex = &job[0].mutex_storage,
+      .pick  = &job[0].pick_storage,
+      .queued = queued,
       .coll  = collection,
+      .cnt   = imgid_cnt,
       .gid   = k,
       .tn    = tn,
       .db    = db,
       .ufn   = updatefn,
+      .focused = imgid == db->collection,
     };
     // we only care about internal errors. if we call with stupid values,
     // it just does nothing and returns:
-    taskid = threads_task(
+    taskid = threads_task_background(
         "thumb",
-        imgid_cnt,
+        2*imgid_cnt,
         taskid,
         job+k,
         thread_work_coll,
@@ -414,6 +800,319 @@ dt_thumbnails_cache_collection(
   return dt_thumbnails_cache_list(tn, db, db->collection, db->collection_cnt, updatefn);
 }
 
+// grab the thumbnail slot from the lru list (if *thumb_index == -1u) and free
+// whatever it held before
+static dt_thumbnail_t *
+thumbnail_evict(
+    dt_thumbnails_t *tn,
+    uint32_t        *thumb_index)
+{
+  dt_thumbnail_t *th = 0;
+  if(*thumb_index == -1u)
+  { // allocate thumbnail from lru list
+    // threads_mutex_lock(&tn->lru_lock);
+    th = tn->lru;
+    tn->lru = tn->lru->next;             // move head
+    if(tn->mru == th) tn->mru = th->prev;// going to remove mru, need to move
+    DLIST_RM_ELEMENT(th);                // disconnect old head
+    tn->mru = DLIST_APPEND(tn->mru, th); // append to end and move tail
+    *thumb_index = th - tn->thumb;
+    // threads_mutex_unlock(&tn->lru_lock);
+  }
+  else th = tn->thumb + *thumb_index;
+
+  // the slot is fixed, uploading the new image to it is all the eviction we need:
+  th->imgid = -1u;
+  th->hash  = 0;
+  // keep dset and prev/next dlist pointers! (i.e. don't memset th)
+  return th;
+}
+
+// point the thumbnail to its slot on the atlas page for th->wd x th->ht
+// and return the texel offset of the slot
+static VkOffset3D
+thumbnail_slot(
+    dt_thumbnails_t *tn,
+    dt_thumbnail_t  *th)
+{
+  const uint32_t i = th - tn->thumb;
+  const dt_thumbnail_page_t *page = tn->page + i / tn->slots_per_page;
+  const uint32_t s = i % tn->slots_per_page;
+  const int32_t x = tn->slot_wd * (s % tn->slots_x), y = tn->slot_ht * (s / tn->slots_x);
+  th->dset   = page->dset[th->wd > 32 ? 0 : 1];
+  // stay half a texel inside so the linear filter doesn't see the neighbours:
+  th->uv0[0] = (x + 0.5f) / tn->page_wd;
+  th->uv0[1] = (y + 0.5f) / tn->page_ht;
+  th->uv1[0] = (x + th->wd - 0.5f) / tn->page_wd;
+  th->uv1[1] = (y + th->ht - 0.5f) / tn->page_ht;
+  return (VkOffset3D){ x, y, 0 };
+}
+
+// palette of a bc1 block, four colours if c0 > c1 as o-bc1 writes them
+static void
+bc1_palette(uint32_t c0, uint32_t c1, int pal[4][3])
+{
+  for(int k=0;k<2;k++)
+  {
+    const uint32_t c = k ? c1 : c0;
+    pal[k][0] = ((c >> 11) & 31) * 255 / 31;
+    pal[k][1] = ((c >>  5) & 63) * 255 / 63;
+    pal[k][2] = ( c        & 31) * 255 / 31;
+  }
+  for(int i=0;i<3;i++)
+  {
+    pal[2][i] = c0 > c1 ? (2*pal[0][i] + pal[1][i])/3 : (pal[0][i] + pal[1][i])/2;
+    pal[3][i] = c0 > c1 ? (pal[0][i] + 2*pal[1][i])/3 : 0;
+  }
+}
+
+static void
+bc1_decode(const uint8_t *b, int px[16][3])
+{
+  int pal[4][3];
+  bc1_palette(b[0] | (b[1] << 8), b[2] | (b[3] << 8), pal);
+  const uint32_t idx = b[4] | (b[5] << 8) | (b[6] << 16) | ((uint32_t)b[7] << 24);
+  for(int k=0;k<16;k++) memcpy(px[k], pal[(idx >> (2*k)) & 3], sizeof(px[k]));
+}
+
+static void
+bc1_encode(int px[16][3], uint8_t *b)
+{ // endpoints at the extremes of the luma, good enough for small mip levels
+  int lo = 0, hi = 0, luma[16];
+  for(int k=0;k<16;k++)
+  {
+    luma[k] = 2*px[k][0] + 5*px[k][1] + px[k][2];
+    if(luma[k] < luma[lo]) lo = k;
+    if(luma[k] > luma[hi]) hi = k;
+  }
+  uint32_t c[2];
+  for(int e=0;e<2;e++)
+  {
+    const int *q = px[e ? lo : hi];
+    c[e] = (((q[0]*31+127)/255) << 11) | (((q[1]*63+127)/255) << 5) | ((q[2]*31+127)/255);
+  }
+  if(c[0] < c[1]) { const uint32_t t = c[0]; c[0] = c[1]; c[1] = t; }
+  uint32_t idx = 0;
+  if(c[0] != c[1])
+  {
+    int pal[4][3];
+    bc1_palette(c[0], c[1], pal);
+    for(int k=0;k<16;k++)
+    {
+      int best = 0, bd = INT_MAX;
+      for(int p=0;p<4;p++)
+      {
+        const int d0 = px[k][0]-pal[p][0], d1 = px[k][1]-pal[p][1], d2 = px[k][2]-pal[p][2];
+        const int d = d0*d0 + d1*d1 + d2*d2;
+        if(d < bd) { bd = d; best = p; }
+      }
+      idx |= (uint32_t)best << (2*k);
+    }
+  }
+  const uint8_t out[8] = { c[0], c[0] >> 8, c[1], c[1] >> 8, idx, idx >> 8, idx >> 16, idx >> 24 };
+  memcpy(b, out, 8);
+}
+
+// halve a level of sx x sy bc1 blocks, for files written before the mip chain
+static void
+bc1_mip_down(
+    const uint8_t *src,
+    uint32_t       sx,
+    uint32_t       sy,
+    uint8_t       *dst)
+{
+  const uint32_t dx = dt_bc1_blocks(sx, 1), dy = dt_bc1_blocks(sy, 1);
+  for(uint32_t y=0;y<dy;y++) for(uint32_t x=0;x<dx;x++)
+  {
+    int in[4][16][3], out[16][3];
+    for(int k=0;k<4;k++) // the 2x2 blocks above, replicated at the border
+      bc1_decode(src + 8*(MIN(2*y+k/2, sy-1)*sx + MIN(2*x+(k&1), sx-1)), in[k]);
+    for(int j=0;j<4;j++) for(int i=0;i<4;i++)
+    {
+      const int k = 2*(j/2) + i/2, u = 2*(i&1), v = 2*(j&1);
+      for(int c=0;c<3;c++)
+        out[4*j+i][c] = (in[k][4*v+u][c] + in[k][4*v+u+1][c] + in[k][4*v+u+4][c] + in[k][4*v+u+5][c] + 2)/4;
+    }
+    bc1_encode(out, dst + 8*(y*dx + x));
+  }
+}
+
+#define DT_THUMBNAILS_BATCH 64
+typedef struct thumbnail_upload_t
+{
+  dt_thumbpack_entry_t *entry;       // read from the pack if set
+  const char           *filename;    // else read this bc1 file, or <cachedir>/<hash>.bc1 if 0
+  uint64_t              hash;
+  uint32_t             *thumb_index; // as in dt_thumbnails_load_one()
+  uint32_t              imgid;       // image the slot holds after the upload, or -1u
+  VkResult              res;         // output: VK_SUCCESS if the thumbnail has been uploaded
+}
+thumbnail_upload_t;
+
+// upload up to DT_THUMBNAILS_BATCH thumbnails through the staging buffer, recording
+// all copies into their atlas slots in one command buffer.
+static VkResult
+thumbnails_load_batch(
+    dt_thumbnails_t    *tn,
+    thumbnail_upload_t *up,
+    int                 cnt)
+{
+  assert(cnt <= DT_THUMBNAILS_BATCH);
+  VkCommandBufferBeginInfo begin_info = {
+    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+    .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+  };
+  VkSubmitInfo submit = {
+    .sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+    .commandBufferCount = 1,
+    .pCommandBuffers    = &tn->command_buffer,
+  };
+  VkCommandBuffer cmd_buf = tn->command_buffer;
+  const dt_graph_t *graph = tn->graph;
+  clock_t beg = clock();
+  int uploaded = 0;
+  for(int i=0;i<cnt;)
+  {
+    uint64_t staging_end = 0;
+    int recorded = 0;
+    uint32_t pages = 0; // bitmask of pages written to
+    QVKR(vkBeginCommandBuffer(cmd_buf, &begin_info));
+    for(;i<cnt;i++)
+    {
+      up[i].res = VK_INCOMPLETE;
+      uint32_t wd, ht, version = 0;
+      gzFile f = 0;
+      if(up[i].entry)
+      {
+        wd = up[i].entry->wd;
+        ht = up[i].entry->ht;
+      }
+      else
+      {
+        char filename[PATH_MAX+100];
+        if(up[i].filename) snprintf(filename, sizeof(filename), "%s", up[i].filename);
+        else snprintf(filename, sizeof(filename), "%s/%lx.bc1", tn->cachedir, up[i].hash);
+        uint32_t header[4] = {0};
+        f = gzopen(filename, "rb");
+        if(!f || gzread(f, header, sizeof(header)) != sizeof(header) ||
+           header[0] != dt_token("bc1z") || header[1] < 1 || header[1] > DT_BC1_VERSION)
+        {
+          if(f) gzclose(f);
+          continue;
+        }
+        version = header[1];
+        wd = header[2];
+        ht = header[3];
+      }
+      wd = 4*(wd/4);
+      ht = 4*(ht/4);
+      const uint32_t bx = wd/4, by = ht/4;
+      const uint64_t size = dt_bc1_size(bx, by, tn->levels);
+      if(!bx || !by || size > tn->staging_size || wd > tn->slot_wd || ht > tn->slot_ht)
+      {
+        if(f) gzclose(f);
+        continue;
+      }
+      if(staging_end + size > tn->staging_size)
+      { // submit what we have and come back
+        if(f) gzclose(f);
+        break;
+      }
+      dt_thumbnail_t *th = thumbnail_evict(tn, up[i].thumb_index);
+      th->wd = wd;
+      th->ht = ht;
+      uint8_t *staging = tn->staging_mapped + staging_end;
+      int levels = tn->levels, err;
+      if(f)
+      {
+        levels = MIN(levels, dt_bc1_levels(bx, by, version));
+        const int rd = dt_bc1_size(bx, by, levels);
+        err = gzread(f, staging, rd) != rd;
+        gzclose(f);
+      }
+      else err = dt_thumbpack_read(&tn->pack, up[i].entry, staging, &levels);
+      if(err) continue;
+      for(int l=levels;l<tn->levels;l++) // files from before the mip chain
+        bc1_mip_down(staging + dt_bc1_size(bx, by, l-1), dt_bc1_blocks(bx, l-1), dt_bc1_blocks(by, l-1), staging + dt_bc1_size(bx, by, l));
+      const int p = (th - tn->thumb) / tn->slots_per_page;
+      const VkOffset3D slot = thumbnail_slot(tn, th);
+      VkBufferImageCopy region[DT_THUMBNAILS_MAX_LEVELS];
+      for(int l=0;l<tn->levels;l++)
+        region[l] = (VkBufferImageCopy) {
+          .bufferOffset      = staging_end + dt_bc1_size(bx, by, l),
+          .imageSubresource  = { VK_IMAGE_ASPECT_COLOR_BIT, l, 0, 1 },
+          .imageOffset       = { slot.x >> l, slot.y >> l, 0 },
+          .imageExtent       = { 4*dt_bc1_blocks(bx, l), 4*dt_bc1_blocks(by, l), 1 },
+        };
+      vkCmdCopyBufferToImage(cmd_buf, tn->staging, tn->page[p].image, VK_IMAGE_LAYOUT_GENERAL, tn->levels, region);
+      pages |= 1u<<p;
+      th->imgid = up[i].imgid;
+      th->hash  = up[i].hash;
+      up[i].res = VK_SUCCESS;
+      staging_end += (size + 0xf) & ~0xful;
+      recorded++;
+    }
+    for(int p=0;p<tn->page_cnt;p++) if(pages & (1u<<p))
+      thumbnails_barrier(cmd_buf, tn->page[p].image, VK_IMAGE_LAYOUT_GENERAL);
+    QVKR(vkEndCommandBuffer(cmd_buf));
+    if(!recorded) continue;
+    QVKR(vkResetFences(qvk.device, 1, &tn->fence));
+    QVKLR(graph->queue_mutex, vkQueueSubmit(graph->queue, 1, &submit, tn->fence));
+    QVKR(vkWaitForFences(qvk.device, 1, &tn->fence, VK_TRUE, UINT64_MAX)); // staging is reused by the next batch
+    uploaded += recorded;
+  }
+  clock_t end = clock();
+  dt_log(s_log_perf, "[thm] uploaded %d thumbnails in %3.0fms", uploaded, 1000.0*(end-beg)/CLOCKS_PER_SEC);
+  return VK_SUCCESS;
+}
+
+static void
+thumbnails_load_list_flush(
+    dt_thumbnails_t    *tn,
+    thumbnail_upload_t *up,
+    int                 cnt)
+{
+  if(thumbnails_load_batch(tn, up, cnt) != VK_SUCCESS)
+    for(int i=0;i<cnt;i++) up[i].res = VK_INCOMPLETE;
+  for(int i=0;i<cnt;i++) if(up[i].res != VK_SUCCESS) *up[i].thumb_index = 0;
+}
+
+// free the last atlas pages if the memory budget asked for it. the slots on
+// them are dropped from the lru list, images still pointing there are reloaded.
+static void
+thumbnails_shrink(
+    dt_thumbnails_t *tn)
+{
+  const uint64_t size = __atomic_exchange_n(&tn->release_size, 0, __ATOMIC_ACQ_REL);
+  if(!size || tn->page_cnt <= 1) return;
+  const int drop = MIN(tn->page_cnt-1, (int)((size + tn->page_size-1) / tn->page_size));
+  QVKL(&qvk.queue_mutex, vkDeviceWaitIdle(qvk.device)); // the gui may still sample the pages
+  for(int p=tn->page_cnt-drop;p<tn->page_cnt;p++)
+  {
+    vkDestroyImageView(qvk.device, tn->page[p].image_view, 0);
+    vkDestroyImage    (qvk.device, tn->page[p].image,      0);
+    vkFreeMemory      (qvk.device, tn->page[p].mem,        0);
+    tn->page[p].image_view = 0;
+    tn->page[p].image      = 0;
+    tn->page[p].mem        = 0;
+  }
+  tn->page_cnt -= drop;
+  tn->thumb_max = MIN(tn->thumb_max, (int)(tn->page_cnt * tn->slots_per_page));
+  dt_thumbnail_t *last = 0;
+  for(dt_thumbnail_t *th = tn->lru, *next; th; th = next)
+  { // rebuild the lru list in order, without the dropped slots
+    next = th->next;
+    if(th - tn->thumb >= tn->thumb_max) continue;
+    th->prev = last;
+    th->next = 0;
+    if(last) last->next = th;
+    else tn->lru = th;
+    last = th;
+  }
+  tn->mru = last;
+  dt_log(s_log_db|s_log_mem, "[thm] released %d atlas pages, %d thumbnails left", drop, tn->thumb_max);
+}
+
 // 1) if db loads a directory, kick off thumbnail creation of directory in bg
 //    this step is the only thing in the non-gui thread
 // 2) for currently visible collection: batch-update lru and trigger thumbnail loading
@@ -430,18 +1129,32 @@ dt_thumbnails_load_list(
     uint32_t         beg,
     uint32_t         end)
 {
+  // collect all missing thumbnails and upload them in batches:
+  thumbnails_shrink(tn);
+  thumbnail_upload_t up[DT_THUMBNAILS_BATCH];
+  int up_cnt = 0;
   for(int k=beg;k<end;k++)
   { // for all images in given collection
     const uint32_t imgid = collection[k];
     if(imgid >= db->image_cnt) break; // safety first. this probably means this job is stale! big danger!
     dt_image_t *img = db->image + imgid;
-    if(img->thumbnail == 0)
-    { // not loaded
+    if(img->thumbnail == 0 || (img->thumbnail != -1u && img->thumbnail >= tn->thumb_max))
+    { // not loaded, or its slot has been released
       char filename[1024];
       dt_db_image_path(db, imgid, filename, sizeof(filename));  
       img->thumbnail = -1u;
-      if(dt_thumbnails_load_one(tn, filename, &img->thumbnail))
-        img->thumbnail = 0;
+      const uint64_t hash = thumbnail_hash(tn, filename);
+      up[up_cnt++] = (thumbnail_upload_t) {
+        .entry       = dt_thumbpack_find(&tn->pack, hash),
+        .hash        = hash,
+        .thumb_index = &img->thumbnail,
+        .imgid       = imgid,
+      };
+      if(up_cnt == DT_THUMBNAILS_BATCH)
+      {
+        thumbnails_load_list_flush(tn, up, up_cnt);
+        up_cnt = 0;
+      }
     }
     else if(img->thumbnail > 0 && img->thumbnail < tn->thumb_max)
     { // loaded, update lru
@@ -455,6 +1168,7 @@ dt_thumbnails_load_list(
       // threads_mutex_unlock(&tn->lru_lock);
     }
   }
+  if(up_cnt) thumbnails_load_list_flush(tn, up, up_cnt);
 }
 
 // load a previously cached thumbnail to a VkImage onto the GPU.
@@ -465,165 +1179,17 @@ dt_thumbnails_load_one(
     const char      *filename,
     uint32_t        *thumb_index)
 {
-  dt_graph_t *graph = tn->graph;
   char imgfilename[PATH_MAX+100] = {0};
+  thumbnail_upload_t up = { .filename = imgfilename, .thumb_index = thumb_index, .imgid = -1u };
   if(strncmp(filename, "data/", 5))
   { // only hash images that aren't straight from our resource directory:
     // TODO: make sure ./dir/file and dir//file etc turn out to be the same
-    uint64_t hash = hash64(filename);
-    snprintf(imgfilename, sizeof(imgfilename), "%s/%lx.bc1", tn->cachedir, hash);
+    up.hash  = thumbnail_hash(tn, filename);
+    up.entry = dt_thumbpack_find(&tn->pack, up.hash);
+    snprintf(imgfilename, sizeof(imgfilename), "%s/%lx.bc1", tn->cachedir, up.hash);
   }
   else snprintf(imgfilename, sizeof(imgfilename), "%s/%s", dt_pipe.basedir, filename);
-  struct stat statbuf = {0};
-  if(stat(imgfilename, &statbuf)) return VK_INCOMPLETE;
-
-  dt_graph_reset(graph);
-  int m0 = dt_module_add(graph, dt_token("i-bc1"), dt_token("01"));
-  int m1 = dt_module_add(graph, dt_token("thumb"), dt_token("main"));
-  dt_module_connect(graph, m0, 0, m1, 0);
-
-  dt_thumbnail_t *th = 0;
-  if(*thumb_index == -1u)
-  { // allocate thumbnail from lru list
-    // threads_mutex_lock(&tn->lru_lock);
-    th = tn->lru;
-    tn->lru = tn->lru->next;             // move head
-    if(tn->mru == th) tn->mru = th->prev;// going to remove mru, need to move
-    DLIST_RM_ELEMENT(th);                // disconnect old head
-    tn->mru = DLIST_APPEND(tn->mru, th); // append to end and move tail
-    *thumb_index = th - tn->thumb;
-    // threads_mutex_unlock(&tn->lru_lock);
-  }
-  else th = tn->thumb + *thumb_index;
-
-  // cache eviction:
-  // clean up memory in case there was something here:
-  if(th->image)      vkDestroyImage(qvk.device, th->image, VK_NULL_HANDLE);
-  if(th->image_view) vkDestroyImageView(qvk.device, th->image_view, VK_NULL_HANDLE);
-  th->image      = 0;
-  th->image_view = 0;
-  th->imgid      = -1u;
-  th->offset     = -1u;
-  if(th->mem)    dt_vkfree(&tn->alloc, th->mem);
-  th->mem        = 0;
-  // keep dset and prev/next dlist pointers! (i.e. don't memset th)
-
-  // set param for rawinput
-  // get module
-  dt_module_set_param_string(graph->module + m0, dt_token("filename"), imgfilename);
-
-  // run graph only up to roi computations to get size
-  // run all <= create nodes
-  dt_graph_run_t run = ~-(s_graph_run_create_nodes<<1);
-  if(dt_graph_run(graph, run) != VK_SUCCESS)
-  {
-    dt_log(s_log_err, "[thm] failed to run first half of graph!");
-    return VK_INCOMPLETE;
-  }
-
-  // now grab roi size from graph's main output node
-  th->wd = graph->module[m1].connector[0].roi.full_wd;
-  th->ht = graph->module[m1].connector[0].roi.full_ht;
-
-  VkFormat format = VK_FORMAT_BC1_RGB_SRGB_BLOCK;
-  VkImageCreateInfo images_create_info = {
-    .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
-    .imageType = VK_IMAGE_TYPE_2D,
-    .format = format,
-    .extent = {
-      .width  = th->wd,
-      .height = th->ht,
-      .depth  = 1
-    },
-    .mipLevels             = 1,
-    .arrayLayers           = 1,
-    .samples               = VK_SAMPLE_COUNT_1_BIT,
-    .tiling                = VK_IMAGE_TILING_OPTIMAL,
-    .usage                 =
-        VK_IMAGE_ASPECT_COLOR_BIT
-      | VK_IMAGE_USAGE_TRANSFER_DST_BIT
-      | VK_IMAGE_USAGE_SAMPLED_BIT,
-    .sharingMode           = VK_SHARING_MODE_EXCLUSIVE,
-    .queueFamilyIndexCount = 0,
-    .pQueueFamilyIndices   = 0,
-    .initialLayout         = VK_IMAGE_LAYOUT_UNDEFINED,
-  };
-
-  QVKR(vkCreateImage(qvk.device, &images_create_info, NULL, &th->image));
-  VkMemoryRequirements mem_req;
-  vkGetImageMemoryRequirements(qvk.device, th->image, &mem_req);
-  if(mem_req.memoryTypeBits != tn->memory_type_bits)
-    dt_log(s_log_qvk|s_log_err, "[thm] memory type bits don't match!");
-
-  dt_vkmem_t *mem = dt_vkalloc(&tn->alloc, mem_req.size, mem_req.alignment);
-  if(!mem)
-  {
-    dt_log(s_log_err, "[thm] no more thumbnail gpu memory allocation possible!\n");
-    return VK_INCOMPLETE; // probably fragmented memory
-  }
-  // TODO: if (!mem) we have not enough memory! need to handle this now (more cache eviction?)
-  // TODO: could do batch cleanup in case we need memory:
-  // walk lru list from front and kill all contents (see above)
-  // but leave list as it is
-
-  assert(mem);
-  th->mem    = mem;
-  th->offset = mem->offset;
-
-  VkImageViewCreateInfo images_view_create_info = {
-    .sType      = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
-    .viewType   = VK_IMAGE_VIEW_TYPE_2D,
-    .format     = format,
-    .subresourceRange = {
-      .aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
-      .baseMipLevel   = 0,
-      .levelCount     = 1,
-      .baseArrayLayer = 0,
-      .layerCount     = 1
-    },
-  };
-  VkDescriptorImageInfo img_info = {
-    .sampler       = th->wd > 32 ? qvk.tex_sampler : qvk.tex_sampler_nearest,
-    .imageLayout   = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-  };
-  VkWriteDescriptorSet img_dset = {
-    .sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-    .dstBinding      = 0,
-    .dstArrayElement = 0,
-    .descriptorCount = 1,
-    .descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-    .pImageInfo      = &img_info,
-  };
-
-  // bind image memory, create image view and descriptor set (used to display later on):
-  vkBindImageMemory(qvk.device, th->image, tn->vkmem, th->offset);
-  images_view_create_info.image = th->image;
-  QVKR(vkCreateImageView(qvk.device, &images_view_create_info, NULL, &th->image_view));
-
-  img_dset.dstSet    = th->dset;
-  img_info.imageView = th->image_view;
-  vkUpdateDescriptorSets(qvk.device, 1, &img_dset, 0, NULL);
-
-  // now run the rest of the graph and copy over VkImage
-  // let graph render into our thumbnail:
-  graph->thumbnail_image = tn->thumb[*thumb_index].image;
-  // these should already match, let's not mess with rounding errors:
-  // tn->graph.output_wd = th->wd;
-  // tn->graph.output_ht = th->ht;
-
-  clock_t beg = clock();
-  // run all the rest we didn't run above
-  if(dt_graph_run(graph, ~run) != VK_SUCCESS)
-  {
-    dt_log(s_log_err, "[thm] running the thumbnail graph failed on image '%s'!", imgfilename);
-    return VK_INCOMPLETE;
-  }
-  clock_t end = clock();
-  dt_log(s_log_perf, "[thm] ran graph in %3.0fms", 1000.0*(end-beg)/CLOCKS_PER_SEC);
-
-  // reset here too to make sure cleanup() is called on all modules.
-  // this releases file descriptors and webcams etc.
-  dt_graph_reset(graph);
-
-  return VK_SUCCESS;
+  if(!up.entry && access(imgfilename, R_OK)) return VK_INCOMPLETE;
+  if(thumbnails_load_batch(tn, &up, 1) != VK_SUCCESS) return VK_INCOMPLETE;
+  return up.res;
 }
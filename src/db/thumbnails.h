@@ -3,6 +3,7 @@
 #include "pipe/graph.h"
 #include "pipe/alloc.h"
 #include "core/threads.h"
+#include "db/thumbpack.h"
 
 #include <vulkan/vulkan.h>
 
@@ -17,46 +18,85 @@
 // create thumbnails and default history here
 // /<full path from root>/imgname.raw.cfg
 // ~/.cache/vkdt/imgnamehash.bc1
+// the bc1 files are folded into ~/.cache/vkdt/thumbs.idx and thumbs-<gen>.dat
+// on startup, see thumbpack.h.
 
 typedef struct dt_db_t dt_db_t;
 typedef struct dt_thumbnail_t
 {
-  VkDescriptorSet        dset;
-  VkImage                image;
-  VkImageView            image_view;
-  dt_vkmem_t            *mem;
-  uint64_t               offset;
+  VkDescriptorSet        dset;    // descriptor set of the atlas page, shared with all thumbnails on it
+  float                  uv0[2];  // texture coordinates of the thumbnail on its page
+  float                  uv1[2];
   struct dt_thumbnail_t *prev;    // dlist for lru cache
   struct dt_thumbnail_t *next;
   uint32_t               imgid;   // index into images->image[] or -1u
+  uint64_t               hash;    // of the cfg file name of the image in the slot, 0 if none
   uint32_t               wd;
   uint32_t               ht;
 }
 dt_thumbnail_t;
 
-#define DT_THUMBNAILS_THREADS 2
+// the thumbnails live in fixed slots of a few large bc1 atlas pages, slot i
+// belongs to thumbnail i. all thumbnails on a page share one descriptor set,
+// so the gui can draw a whole grid of them in one go.
+// the pages have mip levels, filled from the mip chain in the bc1 files, so
+// small zoom levels of the grid sample a matching level.
+typedef struct dt_thumbnail_page_t
+{
+  VkImage                image;
+  VkImageView            image_view;
+  VkDescriptorSet        dset[2];  // linear and nearest sampler (for tiny symbols)
+  VkDeviceMemory         mem;      // per page, so pages can be given back under memory pressure
+}
+dt_thumbnail_page_t;
+
+#define DT_THUMBNAILS_MAX_THREADS 16
+#define DT_THUMBNAILS_MAX_PAGES   16
+#define DT_THUMBNAILS_MAX_LEVELS  6
 typedef struct dt_thumbnails_t
 {
-  dt_graph_t            graph[DT_THUMBNAILS_THREADS];
-  threads_mutex_t       graph_lock[DT_THUMBNAILS_THREADS]; // needed for overscheduling thumbnail creation
+  dt_graph_t           *graph;        // one graph per worker thread, each decodes and renders one image at a time
+  threads_mutex_t      *graph_lock;   // needed for overscheduling thumbnail creation
+  int                   graph_cnt;
   uint64_t              job_timestamp;
 
   int                   thumb_wd;
   int                   thumb_ht;
 
-  dt_vkalloc_t          alloc;
   uint32_t              memory_type_bits;
-  VkDeviceMemory        vkmem;
+  uint32_t              heap_index;     // device heap the pages live on
+  uint64_t              release_size;   // bytes requested back by the memory budget, atomic
   VkDescriptorPool      dset_pool;
   VkDescriptorSetLayout dset_layout;
   dt_thumbnail_t       *thumb;
   int                   thumb_max;
 
+  dt_thumbnail_page_t   page[DT_THUMBNAILS_MAX_PAGES];
+  int                   page_cnt;
+  uint32_t              page_wd;        // size of an atlas page in texels
+  uint32_t              page_ht;
+  uint32_t              slot_wd;        // size of a slot on the page, thumb_wd x thumb_ht rounded up to bc1 blocks
+  uint32_t              slot_ht;
+  int                   levels;         // mip levels of the pages, the slots stay aligned to bc1 blocks on all of them
+  uint32_t              slots_x;        // slots per row and per page
+  uint32_t              slots_per_page;
+  uint64_t              page_size;      // device memory per page in bytes
+
   // threads_mutex_t       lru_lock; // currently not needed, only using lru cache in gui thread
   dt_thumbnail_t       *lru;   // least recently used thumbnail, delete this first
   dt_thumbnail_t       *mru;   // most  recently used thumbnail, append here
 
   char                  cachedir[1024];
+  uint64_t              focus;          // visible range end<<32|beg in the list passed to cache_list, set by the gui
+
+  dt_thumbpack_t        pack;           // packed bc1 files of previous sessions, memory mapped
+  VkBuffer              staging;        // host visible buffer to upload packed thumbnails in batches
+  VkDeviceMemory        vkmem_staging;
+  uint8_t              *staging_mapped;
+  uint64_t              staging_size;
+  VkCommandPool         command_pool;
+  VkCommandBuffer       command_buffer;
+  VkFence               fence;
 }
 dt_thumbnails_t;
 
@@ -67,7 +107,9 @@ VkResult dt_thumbnails_init(
     const int wd,            // max width of thumbnail
     const int ht,            // max height of thumbnail
     const int cnt,           // max number of thumbnails
-    const size_t heap_size); // max heap size in bytes (allocated on GPU)
+    const size_t heap_size,  // max heap size in bytes (allocated on GPU), limits the number of thumbnails
+    const int threads,       // number of graphs rendering in parallel, 0 to pick by cpu cores and device memory
+    const char *subdir);     // cache in ~/.cache/vkdt/<subdir> instead of ~/.cache/vkdt, or 0
 
 // free all resources
 void dt_thumbnails_cleanup(dt_thumbnails_t *tn);
@@ -76,13 +118,19 @@ void dt_thumbnails_cleanup(dt_thumbnails_t *tn);
 // this is a convenience wrapper around dt_thumbnails_cache_list().
 VkResult dt_thumbnails_cache_collection(dt_thumbnails_t *tn, dt_db_t *db, void (*ufn)(void));
 
-// create bc1 thumbnails for the given list, in background threads.
+// create bc1 thumbnails for the given list, in background threads. unless
+// the list is the collection, the images are processed in list order.
 VkResult dt_thumbnails_cache_list(
     dt_thumbnails_t *tn,               // thumbnail struct used to create the thumbnails (will not load thumbs here)
     dt_db_t         *db,               // database to map imageid to filename.
     const uint32_t  *imgid,            // imageids to cache in the background (will be copied for thread safety)
     uint32_t         imgid_cnt,        // number of image ids in list
-    void           (*updatefn)(void)); // function to call after every render (or 0)
+    void           (*updatefn)(void)); // function to call after every render in the focus range (or 0)
+
+// tell the background threads of dt_thumbnails_cache_list() which part of the
+// list is visible right now, [beg, end). the images closest to this range
+// are processed first. this is cheap and can be called every frame.
+void dt_thumbnails_cache_focus(dt_thumbnails_t *tn, uint32_t beg, uint32_t end);
 
 // create bc1 thumbnail only for given image
 // runs in this thread.
@@ -92,6 +140,15 @@ VkResult dt_thumbnails_cache_one(
     dt_thumbnails_t *tn,
     const char      *filename);
 
+// write the jpeg preview embedded in a raw file as thumbnail, if there is no
+// thumbnail and no cfg yet. it is dated such that dt_thumbnails_cache_one()
+// still replaces it by the processed render. runs in this thread, returns
+// VK_SUCCESS only if a preview has been written.
+VkResult dt_thumbnails_cache_preview(
+    dt_graph_t      *graph,
+    dt_thumbnails_t *tn,
+    const char      *filename);
+
 // abort the caching in background threads. blocks until we're sure we're safe
 // (may have to wait for a thumbnail or two to finish rendering).
 void dt_thumbnails_cache_abort( dt_thumbnails_t *tn);
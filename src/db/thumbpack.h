@@ -0,0 +1,331 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include "pipe/modules/o-bc1/bc1.h"
+
+// packed thumbnail cache. the loose <hash>.bc1 files written by o-bc1 are
+// folded into one pair of files in the cache directory:
+//   thumbs.idx        header followed by entries sorted by hash
+//   thumbs-<gen>.dat  the gzipped bc1 payloads, verbatim copies of the files
+// both are memory mapped, so looking up and reading a thumbnail costs no syscall.
+// the data file is append-only, compaction writes a new generation and the
+// index is replaced atomically by rename(2).
+
+typedef struct dt_thumbpack_header_t
+{
+  uint32_t magic;     // dt_token("thpk")
+  uint32_t version;
+  uint32_t entry_cnt;
+  uint32_t gen;       // generation of the data file
+  uint64_t data_size; // bytes in use in the data file
+  uint64_t dead_size; // bytes of data no longer referenced by the index
+}
+dt_thumbpack_header_t;
+
+typedef struct dt_thumbpack_entry_t
+{
+  uint64_t hash;      // hash64() of the cfg filename, same as the loose file name
+  uint64_t offset;    // byte offset of the .bc1 file in the data file
+  uint32_t size;      // byte size of the (compressed) .bc1 file
+  uint16_t wd, ht;    // dimensions from the bc1 header
+  int64_t  mtime;     // modification time of the loose file, 0 if invalidated
+}
+dt_thumbpack_entry_t;
+
+typedef struct dt_thumbpack_t
+{
+  dt_thumbpack_header_t *header;  // mapped index file, or 0
+  dt_thumbpack_entry_t  *entry;
+  size_t                 idx_size;
+  const uint8_t         *data;    // mapped data file
+  size_t                 data_size;
+}
+dt_thumbpack_t;
+
+#define DT_THUMBPACK_MAGIC   0x6b706874u // "thpk" as a dt_token_t
+#define DT_THUMBPACK_VERSION 1
+
+static inline int
+_dt_thumbpack_cmp(const void *a, const void *b)
+{
+  const dt_thumbpack_entry_t *ea = a, *eb = b;
+  return ea->hash < eb->hash ? -1 : ea->hash > eb->hash;
+}
+
+static inline void
+dt_thumbpack_close(dt_thumbpack_t *tp)
+{
+  if(tp->header) munmap(tp->header, tp->idx_size);
+  if(tp->data)   munmap((void *)tp->data, tp->data_size);
+  memset(tp, 0, sizeof(*tp));
+}
+
+static inline int // return 0 on success
+dt_thumbpack_open(
+    dt_thumbpack_t *tp,
+    const char     *cachedir)
+{
+  memset(tp, 0, sizeof(*tp));
+  char fn[1100];
+  snprintf(fn, sizeof(fn), "%s/thumbs.idx", cachedir);
+  struct stat sb;
+  int fd = open(fn, O_RDWR);
+  if(fd == -1) return 1;
+  if(fstat(fd, &sb) || sb.st_size < (off_t)sizeof(dt_thumbpack_header_t)) { close(fd); return 1; }
+  tp->idx_size = sb.st_size;
+  void *idx = mmap(0, tp->idx_size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if(idx == MAP_FAILED) { tp->idx_size = 0; return 1; }
+  tp->header = idx;
+  tp->entry  = (dt_thumbpack_entry_t *)(tp->header + 1);
+  if(tp->header->magic != DT_THUMBPACK_MAGIC || tp->header->version != DT_THUMBPACK_VERSION ||
+     sizeof(dt_thumbpack_header_t) + tp->header->entry_cnt * sizeof(dt_thumbpack_entry_t) > tp->idx_size)
+    goto error;
+  if(!tp->header->entry_cnt) return 0;
+
+  snprintf(fn, sizeof(fn), "%s/thumbs-%u.dat", cachedir, tp->header->gen);
+  fd = open(fn, O_RDONLY);
+  if(fd == -1) goto error;
+  if(fstat(fd, &sb) || sb.st_size < (off_t)tp->header->data_size) { close(fd); goto error; }
+  tp->data_size = sb.st_size;
+  void *data = mmap(0, tp->data_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if(data == MAP_FAILED) { tp->data_size = 0; goto error; }
+  tp->data = data;
+  return 0;
+error:
+  dt_thumbpack_close(tp);
+  return 1;
+}
+
+static inline dt_thumbpack_entry_t * // return the valid entry for hash, or 0
+dt_thumbpack_find(
+    const dt_thumbpack_t *tp,
+    uint64_t              hash)
+{
+  if(!tp->data) return 0;
+  uint32_t beg = 0, end = tp->header->entry_cnt;
+  while(beg < end)
+  {
+    const uint32_t mid = beg + (end - beg)/2;
+    if     (tp->entry[mid].hash < hash) beg = mid+1;
+    else if(tp->entry[mid].hash > hash) end = mid;
+    else return __atomic_load_n(&tp->entry[mid].mtime, __ATOMIC_RELAXED) ? tp->entry + mid : 0;
+  }
+  return 0;
+}
+
+static inline void // mark the entry as stale. the loose .bc1 file takes precedence from now on
+dt_thumbpack_invalidate(
+    dt_thumbpack_t *tp,
+    uint64_t        hash)
+{
+  dt_thumbpack_entry_t *e = dt_thumbpack_find(tp, hash);
+  if(e) __atomic_store_n(&e->mtime, 0, __ATOMIC_RELAXED);
+}
+
+static inline int // decompress the bc1 blocks of the entry to out, return 0 on success
+dt_thumbpack_read(
+    const dt_thumbpack_t       *tp,
+    const dt_thumbpack_entry_t *e,
+    uint8_t                    *out,
+    int                        *levels) // mip levels wanted, reduced to what the file has
+{
+  if(e->offset + e->size > tp->data_size) return 1;
+  uint32_t header[4];
+  z_stream z = {
+    .next_in   = (Bytef *)tp->data + e->offset,
+    .avail_in  = e->size,
+    .next_out  = (Bytef *)header,
+    .avail_out = sizeof(header),
+  };
+  if(inflateInit2(&z, 16+MAX_WBITS) != Z_OK) return 1;
+  int err = inflate(&z, Z_SYNC_FLUSH);
+  if((err != Z_OK && err != Z_STREAM_END) || z.avail_out) { inflateEnd(&z); return 1; }
+  const uint32_t bx = e->wd/4, by = e->ht/4;
+  const int have = dt_bc1_levels(bx, by, header[1]);
+  if(*levels > have) *levels = have;
+  z.next_out  = out;
+  z.avail_out = dt_bc1_size(bx, by, *levels);
+  err = inflate(&z, Z_FINISH);
+  inflateEnd(&z);
+  return z.avail_out || (err < 0 && err != Z_BUF_ERROR); // the gzip trailer may remain unchecked
+}
+
+// fold all loose <hash>.bc1 files in the cache directory into the pack and
+// delete them. compacts the data file if more than half of it is dead.
+// must not run while another process appends to the same pack.
+// returns the number of files merged or -1 on error.
+static inline int
+dt_thumbpack_merge(const char *cachedir)
+{
+  dt_thumbpack_t old;
+  const int have_old = !dt_thumbpack_open(&old, cachedir);
+  dt_thumbpack_header_t hdr = { .magic = DT_THUMBPACK_MAGIC, .version = DT_THUMBPACK_VERSION };
+  if(have_old) hdr = *old.header;
+
+  DIR *dp = opendir(cachedir);
+  if(!dp) { if(have_old) dt_thumbpack_close(&old); return -1; }
+  uint32_t new_cnt = 0, new_max = 0;
+  dt_thumbpack_entry_t *new_entry = 0;
+  char fn[1100];
+  FILE *dat = 0;
+  void *buf = 0;
+  size_t buf_size = 0;
+  struct dirent *ep;
+  while((ep = readdir(dp)))
+  {
+    char *end = 0;
+    uint64_t hash = strtoull(ep->d_name, &end, 16);
+    if(end == ep->d_name || strcmp(end, ".bc1")) continue;
+    snprintf(fn, sizeof(fn), "%s/%s", cachedir, ep->d_name);
+    struct stat sb;
+    if(stat(fn, &sb) || sb.st_size <= 0 || sb.st_size > (1l<<30)) continue;
+    uint32_t header[4] = {0};
+    gzFile gz = gzopen(fn, "rb");
+    if(!gz) continue;
+    int len = gzread(gz, header, sizeof(header));
+    gzclose(gz);
+    if(len != sizeof(header) || header[0] != 0x7a316362u /* bc1z */ || header[1] < 1 || header[1] > DT_BC1_VERSION ||
+       header[2] > 0xffff || header[3] > 0xffff) continue;
+    FILE *f = fopen(fn, "rb");
+    if(!f) continue;
+    if(buf_size < (size_t)sb.st_size) buf = realloc(buf, buf_size = sb.st_size);
+    size_t rd = fread(buf, 1, sb.st_size, f);
+    fclose(f);
+    if(rd != (size_t)sb.st_size) continue;
+    if(!dat)
+    {
+      snprintf(fn, sizeof(fn), "%s/thumbs-%u.dat", cachedir, hdr.gen);
+      if(!(dat = fopen(fn, "r+b")) && !(dat = fopen(fn, "w+b"))) break;
+      fseek(dat, hdr.data_size, SEEK_SET); // drop garbage from a previous crash
+    }
+    if(fwrite(buf, 1, sb.st_size, dat) != (size_t)sb.st_size) break;
+    if(new_cnt >= new_max) new_entry = realloc(new_entry, sizeof(dt_thumbpack_entry_t)*(new_max = 2*new_max+256));
+    new_entry[new_cnt++] = (dt_thumbpack_entry_t) {
+      .hash   = hash,
+      .offset = hdr.data_size,
+      .size   = sb.st_size,
+      .wd     = header[2],
+      .ht     = header[3],
+      .mtime  = sb.st_mtim.tv_sec,
+    };
+    hdr.data_size += sb.st_size;
+  }
+  closedir(dp);
+  free(buf);
+  if(dat && fclose(dat)) new_cnt = 0;
+  if(!new_cnt)
+  {
+    free(new_entry);
+    if(have_old) dt_thumbpack_close(&old);
+    return 0;
+  }
+  // merge sorted lists, the loose files win over what's in the pack
+  qsort(new_entry, new_cnt, sizeof(dt_thumbpack_entry_t), _dt_thumbpack_cmp);
+  uint64_t *merged = malloc(sizeof(uint64_t)*new_cnt);
+  for(uint32_t j=0;j<new_cnt;j++) merged[j] = new_entry[j].hash;
+  const uint32_t old_cnt = have_old ? old.header->entry_cnt : 0;
+  dt_thumbpack_entry_t *entry = malloc(sizeof(dt_thumbpack_entry_t)*(old_cnt + new_cnt));
+  uint32_t cnt = 0;
+  for(uint32_t i=0,j=0;i<old_cnt||j<new_cnt;)
+  {
+    if(i < old_cnt && (j >= new_cnt || old.entry[i].hash <= new_entry[j].hash))
+    {
+      if(!old.entry[i].mtime || (j < new_cnt && old.entry[i].hash == new_entry[j].hash))
+        hdr.dead_size += old.entry[i].size;
+      else entry[cnt++] = old.entry[i];
+      i++;
+    }
+    else
+    {
+      if(cnt && entry[cnt-1].hash == new_entry[j].hash) hdr.dead_size += entry[--cnt].size;
+      entry[cnt++] = new_entry[j++];
+    }
+  }
+  free(new_entry);
+
+  const uint32_t old_gen = hdr.gen;
+  if(hdr.dead_size > hdr.data_size / 2)
+  { // compaction: copy the live payloads into the next generation of the data file
+    dt_thumbpack_t cur = {0};
+    snprintf(fn, sizeof(fn), "%s/thumbs-%u.dat", cachedir, old_gen);
+    int fd = open(fn, O_RDONLY);
+    struct stat sb;
+    if(fd != -1 && !fstat(fd, &sb) && sb.st_size > 0)
+    {
+      cur.data_size = sb.st_size;
+      cur.data = mmap(0, cur.data_size, PROT_READ, MAP_SHARED, fd, 0);
+      if(cur.data == MAP_FAILED) cur.data = 0;
+    }
+    if(fd != -1) close(fd);
+    snprintf(fn, sizeof(fn), "%s/thumbs-%u.dat", cachedir, old_gen+1);
+    FILE *f = cur.data ? fopen(fn, "wb") : 0;
+    uint64_t off = 0;
+    int ok = !!f;
+    for(uint32_t i=0;ok&&i<cnt;i++)
+    {
+      ok = entry[i].offset + entry[i].size <= cur.data_size &&
+           fwrite(cur.data + entry[i].offset, 1, entry[i].size, f) == entry[i].size;
+      entry[i].offset = off;
+      off += entry[i].size;
+    }
+    if(f && fclose(f)) ok = 0;
+    if(cur.data) munmap((void *)cur.data, cur.data_size);
+    if(ok)
+    {
+      hdr.gen++;
+      hdr.data_size = off;
+      hdr.dead_size = 0;
+    }
+    else
+    { // keep the old index and the loose files, the appended data is dead weight
+      unlink(fn);
+      free(merged);
+      free(entry);
+      if(have_old) dt_thumbpack_close(&old);
+      return -1;
+    }
+  }
+  if(have_old) dt_thumbpack_close(&old);
+
+  hdr.entry_cnt = cnt;
+  char tmp[1100];
+  snprintf(tmp, sizeof(tmp), "%s/thumbs.idx.tmp", cachedir);
+  FILE *f = fopen(tmp, "wb");
+  int ok = f &&
+    fwrite(&hdr, sizeof(hdr), 1, f) == 1 &&
+    fwrite(entry, sizeof(dt_thumbpack_entry_t), cnt, f) == cnt;
+  if(f && fclose(f)) ok = 0;
+  free(entry);
+  snprintf(fn, sizeof(fn), "%s/thumbs.idx", cachedir);
+  if(!ok || rename(tmp, fn))
+  {
+    unlink(tmp);
+    free(merged);
+    return -1;
+  }
+  if(hdr.gen != old_gen)
+  {
+    snprintf(fn, sizeof(fn), "%s/thumbs-%u.dat", cachedir, old_gen);
+    unlink(fn);
+  }
+
+  // the index now references the merged files, remove them:
+  for(uint32_t j=0;j<new_cnt;j++)
+  {
+    snprintf(fn, sizeof(fn), "%s/%lx.bc1", cachedir, merged[j]);
+    unlink(fn);
+  }
+  free(merged);
+  return new_cnt;
+}
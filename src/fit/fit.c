@@ -15,6 +15,8 @@
 // this limits the number of module parameters to optimise for.
 // each parameter may hold an array of values though.
 #define OPT_MAX_PAR 20
+// maximum number of graphs evaluating the jacobian concurrently
+#define OPT_MAX_BATCH 8
 
 typedef struct opt_dat_t
 {
@@ -24,13 +26,19 @@ typedef struct opt_dat_t
   dt_token_t pid[OPT_MAX_PAR];  // parameter name
   uint32_t   cnt[OPT_MAX_PAR];  // number of elements in this parameter
   float     *par[OPT_MAX_PAR];  // cached pointer to start of param on graph
+  int        lay[OPT_MAX_PAR];  // first derivative image of this param on the loss input, or -1
+  float     *grad;              // gradient as computed by the loss module, if any
+  int        frame;             // animation frame to evaluate next
+  uint64_t   seed;              // state of the random number generator for this graph
 
   dt_graph_t graph;
 }
 opt_dat_t;
 
 static int user_abort = 0;
-static int frame = 0;
+static opt_dat_t *batch_dat = 0; // independent copies of the graph to evaluate the jacobian
+static int batch_cnt = 1;
+static int multi_start = 0;      // the copies run independent optimisations instead
 
 void print_state(int signal)
 {
@@ -45,7 +53,7 @@ void evaluate_f(double *p, double *f, int m, int n, void *data)
       dat->par[i][j] = *(p++);
 
   // apply animation as stochastic gradient descent:
-  dat->graph.frame = frame;
+  dat->graph.frame = dat->frame;
   dt_graph_apply_keyframes(&dat->graph);
   VkResult res = dt_graph_run(&dat->graph,
       s_graph_run_record_cmd_buf | 
@@ -70,38 +78,89 @@ double loss(double *p, void *data)
   return f;
 }
 
-static uint64_t seed = 90011; // random prime number
 static inline double
-xrand()
+xrand(uint64_t *seed)
 { // Algorithm "xor" from p. 4 of Marsaglia, "Xorshift RNGs"
-  seed ^= seed << 13;
-  seed ^= seed >> 17;
-  seed ^= seed << 5;
-  return seed / 4294967296.0;
+  *seed ^= *seed << 13;
+  *seed ^= *seed >> 17;
+  *seed ^= *seed << 5;
+  return *seed / 4294967296.0;
+}
+
+typedef struct opt_batch_t
+{ // finite differences to be evaluated, shared by all graphs
+  const double *p;  // current parameters
+  const double *h;  // step for every parameter
+  const int    *fd; // parameters that need finite differences
+  double       *f;  // output: unperturbed result followed by one perturbed per fd entry
+  double       *g;  // output: gradient from the unperturbed run, where available
+  int           m, n;
+  int           frame; // animation frame to evaluate
+}
+opt_batch_t;
+
+typedef struct opt_job_t
+{ // one worker thread, running on its own graph
+  opt_batch_t *b;
+  opt_dat_t   *dat;
+}
+opt_job_t;
+
+static void
+batch_work(uint32_t item, void *arg)
+{ // item 0 is the unperturbed evaluation
+  opt_job_t *j = arg;
+  const opt_batch_t *b = j->b;
+  double p2[b->m];
+  memcpy(p2, b->p, sizeof(p2));
+  if(item) p2[b->fd[item-1]] += b->h[b->fd[item-1]];
+  j->dat->frame = b->frame;
+  evaluate_f(p2, b->f + item*b->n, b->m, b->n, j->dat);
+  if(item || !j->dat->grad) return;
+  for(int i=1,k=0;i<j->dat->param_cnt;i++) // copy the exact derivatives of this run
+    for(int e=0;e<j->dat->cnt[i];e++,k++)
+      if(j->dat->lay[i] >= 0) b->g[k] = j->dat->grad[j->dat->lay[i]+e];
 }
 
 void evaluate_J(double *p, double *J, int m, int n, void *data)
 {
-  double p2[m], f1[n], f2[n];
-  memcpy(p2, p, sizeof(p2));
-  evaluate_f(p2, f1, m, n, data);
+  opt_dat_t *dat = data;
+  double h[m], g[m], *f = malloc(sizeof(double)*n*(m+1));
+  int fd[m], num_fd = 0;
+  for(int i=1,j=0;i<dat->param_cnt;i++) // parameters with derivative images need no extra runs
+    for(int e=0;e<dat->cnt[i];e++,j++)
+      if(n != 1 || !dat->grad || dat->lay[i] < 0) fd[num_fd++] = j;
   for(int j=0;j<m;j++)
   {
-    const double s = xrand() >= 0.5 ? 1.0 : -1.0;
-    const double h = s * (1e-10 + xrand()*1e-4);
-    // memcpy(p2, p, sizeof(p2));
-    // p2[j] = p[j] + h;
-    // evaluate_f(p2, f1, m, n, data);
-    memcpy(p2, p, sizeof(p2));
-    p2[j] = p[j] + h;
-    evaluate_f(p2, f2, m, n, data);
-    // for(int k=0;k<n;k++) J[m*k + j] = CLAMP((f1[k] - f2[k]) / (2.0*h), -1e10, 1e10);
-    for(int k=0;k<n;k++) J[m*k + j] = CLAMP((f2[k] - f1[k]) / h, -1e10, 1e10);
-    // for(int k=0;k<n;k++) J[m*k + j] += (1.0-2.0*xrand())*1e-8; // XXX DEBUG
-    // for(int k=0;k<n;k++) fprintf(stderr, "J[%d][%d] = %g\n", j, k, J[m*k+j]);
+    const double s = xrand(&dat->seed) >= 0.5 ? 1.0 : -1.0;
+    h[j] = s * (1e-10 + xrand(&dat->seed)*1e-4);
   }
-  opt_dat_t *dat = data;
-  frame = (frame + 1) % dat->graph.frame_cnt;
+  // the evaluations are independent. every worker grabs the next one and
+  // runs it on its own graph, so the submissions overlap on the device instead
+  // of waiting for one another:
+  opt_batch_t b = { .p = p, .h = h, .fd = fd, .f = f, .g = g, .m = m, .n = n, .frame = dat->frame };
+  opt_job_t job[OPT_MAX_BATCH];
+  int taskid = -1;
+  for(int k=0;k<batch_cnt && batch_cnt>1 && !multi_start && num_fd;k++)
+  {
+    job[k] = (opt_job_t){ .b = &b, .dat = batch_dat + k };
+    int res = threads_task("fit", num_fd+1, taskid, job+k, batch_work, 0);
+    if(res < 0) break; // all items picked or no more free slots, go on with what we have
+    taskid = res;
+  }
+  if(taskid >= 0) threads_wait(taskid);
+  else for(int i=0;i<=num_fd;i++)
+  { // single graph or no thread pool, evaluate here
+    job[0] = (opt_job_t){ .b = &b, .dat = dat };
+    batch_work(i, job);
+  }
+  if(num_fd < m) // exact gradient of the scalar loss
+    for(int j=0;j<m;j++) J[j] = CLAMP(g[j], -1e10, 1e10);
+  for(int i=0;i<num_fd;i++)
+    for(int k=0;k<n;k++) J[m*k + fd[i]] = CLAMP((f[n*(i+1)+k] - f[k]) / h[fd[i]], -1e10, 1e10);
+  // for(int j=0;j<m;j++) for(int k=0;k<n;k++) fprintf(stderr, "J[%d][%d] = %g\n", j, k, J[m*k+j]);
+  free(f);
+  dat->frame = (dat->frame + 1) % dat->graph.frame_cnt;
 }
 
 // init optimisation target as keyframe
@@ -196,6 +255,9 @@ init_param(
   }
   dat->par[p] = (float *)(graph->module[modid].param + pui->offset);
   dat->cnt[p] = pui->cnt;
+  dat->mod[p] = name;
+  dat->mid[p] = inst;
+  dat->pid[p] = parm;
     dt_log(s_log_cli, "initing param[%d] module:instance:param %"PRItkn":%"PRItkn":%"PRItkn,
         p,
         dt_token_str(name),
@@ -205,6 +267,159 @@ init_param(
   return 0;
 }
 
+typedef struct opt_conf_t
+{ // optimiser and its settings, shared by all starts
+  int     optimiser; // 0 gauss newton, 1 adam, 2 nelder mead
+  double  adam_eps, adam_beta1, adam_beta2, adam_alpha;
+  double *t, *lb, *ub;
+  int     m, n;
+}
+opt_conf_t;
+
+static double
+optimise(const opt_conf_t *c, opt_dat_t *dat, double *p)
+{
+  if(c->optimiser == 0)
+    return dt_gauss_newton_cg(evaluate_f, evaluate_J,
+        p, c->t, c->m, c->n, c->lb, c->ub, 400, dat);
+  else if(c->optimiser == 1)
+    return dt_adam(evaluate_f, evaluate_J,
+        p, c->t, c->m, c->n, c->lb, c->ub, 20000, dat,
+        c->adam_eps, c->adam_beta1, c->adam_beta2, c->adam_alpha,
+        &user_abort);
+  else if(c->optimiser == 2)
+    return dt_nelder_mead(p, c->m, 20000, loss, dat, &user_abort);
+  return DBL_MAX;
+}
+
+typedef struct opt_start_t
+{ // one start of the multi start optimisation
+  const opt_conf_t *conf;
+  double           *p;     // parameters for every start, m each
+  double           *resid; // final residual for every start
+  opt_dat_t        *dat;   // graph of this worker thread
+}
+opt_start_t;
+
+static void
+start_work(uint32_t item, void *arg)
+{
+  opt_start_t *s = arg;
+  s->resid[item] = optimise(s->conf, s->dat, s->p + item*s->conf->m);
+  dt_log(s_log_cli, "start %u: loss %g", item, s->resid[item]);
+}
+
+// run num independent optimisations on the copies of the graph. the first one
+// starts at p, the others at random perturbations of it. p is set to the best.
+static double
+optimise_multi(const opt_conf_t *c, opt_dat_t *dat, double *p, int num)
+{
+  const int m = c->m;
+  double *ps = malloc(sizeof(double)*num*m), *resid = malloc(sizeof(double)*num);
+  for(int k=0;k<num;k++)
+  {
+    resid[k] = DBL_MAX;
+    for(int i=0;i<m;i++)
+      ps[k*m+i] = k ? p[i] + (1.0-2.0*xrand(&dat->seed))*0.25*MAX(fabs(p[i]), 1e-2) : p[i];
+  }
+  opt_start_t job[OPT_MAX_BATCH];
+  int taskid = -1;
+  for(int k=0;k<batch_cnt;k++)
+  {
+    job[k] = (opt_start_t){ .conf = c, .p = ps, .resid = resid, .dat = dat+k };
+    int res = threads_task("fit", num, taskid, job+k, start_work, 0);
+    if(res < 0) break;
+    taskid = res;
+  }
+  if(taskid >= 0) threads_wait(taskid);
+  else for(int k=0;k<num;k++)
+  {
+    job[0] = (opt_start_t){ .conf = c, .p = ps, .resid = resid, .dat = dat };
+    start_work(k, job);
+  }
+  int best = 0;
+  for(int k=1;k<num;k++) if(resid[k] < resid[best]) best = k;
+  memcpy(p, ps + best*m, sizeof(double)*m);
+  const double r = resid[best];
+  dt_log(s_log_cli, "best of %d starts: %d", num, best);
+  free(ps);
+  free(resid);
+  return r;
+}
+
+// if the target is the loss of a loss module with derivative images connected, the
+// parameters of the module producing them get their gradient in the same run.
+// the derivative images are in order of the float parameters of this module.
+static void
+init_autodiff(opt_dat_t *dat)
+{
+  dt_graph_t *graph = &dat->graph;
+  dat->grad = 0;
+  for(int i=0;i<OPT_MAX_PAR;i++) dat->lay[i] = -1;
+  const int lm = dt_module_get(graph, dat->mod[0], dat->mid[0]);
+  if(lm < 0 || graph->module[lm].name != dt_token("loss") || dat->pid[0] != dt_token("loss")) return;
+  const dt_module_t *loss = graph->module + lm;
+  const int cd = dt_module_get_connector(loss, dt_token("dinput"));
+  const int ci = dt_module_get_connector(loss, dt_token("input"));
+  const int gp = dt_module_get_param(loss->so, dt_token("grad"));
+  if(cd < 0 || ci < 0 || gp < 0 || loss->connector[cd].connected_mi < 0 ||
+     loss->connector[cd].connected_mi != loss->connector[ci].connected_mi) return;
+  const dt_module_t *dm = graph->module + loss->connector[cd].connected_mi;
+  const int num = MIN(loss->so->param[gp]->cnt, MAX(1, loss->connector[cd].array_length));
+  for(int i=1;i<dat->param_cnt;i++)
+  {
+    if(dat->mod[i] != dm->name || dat->mid[i] != dm->inst) continue;
+    int off = 0;
+    for(int q=0;q<dm->so->num_params && dm->so->param[q]->name != dat->pid[i];q++)
+      if(dm->so->param[q]->type == dt_token("float")) off += dm->so->param[q]->cnt;
+    if(off + dat->cnt[i] <= num) dat->lay[i] = off;
+  }
+  dat->grad = (float *)(loss->param + loss->so->param[gp]->offset);
+  dt_log(s_log_cli, "using the derivatives of %"PRItkn":%"PRItkn" computed on the device",
+      dt_token_str(dm->name), dt_token_str(dm->inst));
+}
+
+// load the graph and find the parameters on it. graph k > 0 is an independent
+// copy to evaluate the jacobian in parallel, which runs on a work queue.
+static VkResult
+load_graph(
+    opt_dat_t  *dat,
+    int         k,
+    const char *graph_cfg,
+    int         argc,
+    char       *argv[],
+    int         config_start,
+    char      **parstr,
+    const int  *keyframe)
+{
+  const int param_cnt = dat->param_cnt ? dat->param_cnt : 1;
+  dat->param_cnt = 1;
+  dat->seed = 90011 + 1000*k; // random prime number, different sequence for every graph
+  dt_graph_init(&dat->graph);
+  if(k)
+  {
+    dat->graph.queue       = (k & 1) ? qvk.queue_work1 : qvk.queue_work0;
+    dat->graph.queue_idx   = (k & 1) ? qvk.queue_idx_work1 : qvk.queue_idx_work0;
+    dat->graph.queue_mutex = (k & 1) ? &qvk.queue_work1_mutex : &qvk.queue_work0_mutex;
+  }
+  VkResult err = dt_graph_read_config_ascii(&dat->graph, graph_cfg);
+  if(err) return err;
+
+  if(config_start)
+    for(int i=config_start;i<argc;i++)
+      if(dt_graph_read_config_line(&dat->graph, argv[i]))
+        dt_log(s_log_pipe|s_log_err, "failed to read extra params %d: '%s'", i - config_start, argv[i]);
+
+  dt_graph_disconnect_display_modules(&dat->graph);
+
+  // cache data pointers for target and parameters:
+  for(int i=0;i<param_cnt;i++)
+    if     ( keyframe[i] && init_keyframe(dat, parstr[i], i)) exit(1);
+    else if(!keyframe[i] && init_param   (dat, parstr[i], i)) exit(1);
+  init_autodiff(dat);
+  return VK_SUCCESS;
+}
+
 int main(int argc, char *argv[])
 {
   // init global things, log and pipeline:
@@ -213,8 +428,8 @@ int main(int argc, char *argv[])
   dt_pipe_global_init();
   threads_global_init();
 
-  opt_dat_t dat = {0};
-  dat.param_cnt = 1;
+  opt_dat_t *dat = calloc(OPT_MAX_BATCH, sizeof(opt_dat_t));
+  dat->param_cnt = 1;
 
   int config_start = 0; // start of arguments which are interpreted as additional config lines
   char *graph_cfg = 0;
@@ -222,6 +437,7 @@ int main(int argc, char *argv[])
   int keyframe[OPT_MAX_PAR] = {0};
   int optimiser = 0; // lu
   double adam_eps = 1e-8, adam_beta1 = 0.9, adam_beta2 = 0.999, adam_alpha = 0.01;
+  int num_starts = 1;
   for(int i=0;i<argc;i++)
   {
     if(!strcmp(argv[i], "-g") && i < argc-1)
@@ -229,11 +445,15 @@ int main(int argc, char *argv[])
     else if(!strcmp(argv[i], "--target"))
       parstr[0] = argv[++i];
     else if(!strcmp(argv[i], "--param"))
-      parstr[dat.param_cnt++] = argv[++i];
+      parstr[dat->param_cnt++] = argv[++i];
     else if(!strcmp(argv[i], "--keyframe"))
-    { keyframe[dat.param_cnt] = 1; parstr[dat.param_cnt++] = argv[++i]; }
+    { keyframe[dat->param_cnt] = 1; parstr[dat->param_cnt++] = argv[++i]; }
     else if(!strcmp(argv[i], "--adam") && i < argc-4)
     { optimiser = 1; adam_eps = atof(argv[++i]); adam_beta1 = atof(argv[++i]); adam_beta2 = atof(argv[++i]); adam_alpha = atof(argv[++i]); }
+    else if(!strcmp(argv[i], "--batch") && i < argc-1)
+      batch_cnt = atoi(argv[++i]);
+    else if(!strcmp(argv[i], "--multi-start") && i < argc-1)
+      num_starts = atoi(argv[++i]);
     else if(!strcmp(argv[i], "--nelder-mead"))
       optimiser = 2;
     else if(!strcmp(argv[i], "--config"))
@@ -242,7 +462,7 @@ int main(int argc, char *argv[])
 
   if(qvk_init(0, -1)) exit(1);
 
-  if(!graph_cfg || !dat.param_cnt)
+  if(!graph_cfg || !dat->param_cnt)
   {
     fprintf(stderr, "usage: vkdt-fit -g <graph.cfg>\n"
     "    [-d verbosity]                 set log verbosity (none,mem,perf,pipe,cli,err,all)\n"
@@ -251,55 +471,68 @@ int main(int argc, char *argv[])
     "    [--target m:i:p]               set the given module:inst:param as target for optimisation\n"
     "    [--adam eps beta1 beta2 alpha] set the parameters of the adam optimiser\n"
     "    [--nelder-mead]                use nelder mead optimiser\n"
+    "    [--batch k]                    evaluate the jacobian on k copies of the graph in parallel\n"
+    "    [--multi-start s]              run s optimisations from perturbed initial guesses in parallel, keep the best\n"
     "    [--config]                     everything after this will be interpreted as additional cfg lines\n"
         );
     threads_global_cleanup();
+    dt_pipe_shader_cleanup();
+    dt_pipe_staging_cleanup();
     qvk_cleanup();
     exit(1);
   }
 
-  dt_graph_init(&dat.graph);
-  VkResult err = dt_graph_read_config_ascii(&dat.graph, graph_cfg);
+  VkResult err = load_graph(dat, 0, graph_cfg, argc, argv, config_start, parstr, keyframe);
   if(err)
   {
     dt_log(s_log_err, "failed to load config file '%s'", graph_cfg);
-    dt_graph_cleanup(&dat.graph);
+    dt_graph_cleanup(&dat->graph);
     threads_global_cleanup();
+    dt_pipe_shader_cleanup();
+    dt_pipe_staging_cleanup();
     qvk_cleanup();
     exit(1);
   }
 
-  if(config_start)
-    for(int i=config_start;i<argc;i++)
-      if(dt_graph_read_config_line(&dat.graph, argv[i]))
-        dt_log(s_log_pipe|s_log_err, "failed to read extra params %d: '%s'", i - config_start, argv[i]);
-
-  dt_graph_disconnect_display_modules(&dat.graph);
-
-  // cache data pointers for target and parameters:
-  for(int i=0;i<dat.param_cnt;i++)
-    if     ( keyframe[i] && init_keyframe(&dat, parstr[i], i)) exit(1);
-    else if(!keyframe[i] && init_param   (&dat, parstr[i], i)) exit(1);
-
   int num_params = 0;
-  for(int i=1;i<dat.param_cnt;i++) num_params += dat.cnt[i];
-  int num_target = dat.cnt[0];
+  for(int i=1;i<dat->param_cnt;i++) num_params += dat->cnt[i];
+  int num_target = dat->cnt[0];
 
   if(adam_alpha > 0.0)
-    dat.cnt[0] = num_target = 1; // adam supports only a single scalar loss value
+    dat->cnt[0] = num_target = 1; // adam supports only a single scalar loss value
 
   double p[num_params], t[num_target];
   double *pp = p; // set initial parameters
-  for(int i=1;i<dat.param_cnt;i++)
-    for(int j=0;j<dat.cnt[i];j++)
-      *(pp++) = dat.par[i][j];
+  for(int i=1;i<dat->param_cnt;i++)
+    for(int j=0;j<dat->cnt[i];j++)
+      *(pp++) = dat->par[i][j];
   pp = t; // also set target from cfg file
   for(int j=0;j<num_target;j++)
-    *(pp++) = dat.par[0][j];
+    *(pp++) = dat->par[0][j];
 
   signal(SIGINT, print_state); // ctrl-c
 
-  dt_graph_run(&dat.graph, s_graph_run_all); // run once to init nodes
+  dt_graph_run(&dat->graph, s_graph_run_all); // run once to init nodes
+
+  // more copies of the graph to evaluate the jacobian with, on alternating queues:
+  batch_dat = dat;
+  multi_start = num_starts > 1;
+  if(multi_start) batch_cnt = num_starts; // one graph per start, as many as we can run at once
+  batch_cnt = CLAMP(MIN(batch_cnt, threads_num()), 1, OPT_MAX_BATCH);
+  for(int k=1;k<batch_cnt;k++)
+  {
+    dat[k].param_cnt = dat->param_cnt;
+    if(load_graph(dat+k, k, graph_cfg, argc, argv, config_start, parstr, keyframe))
+    {
+      dt_graph_cleanup(&dat[k].graph);
+      batch_cnt = k;
+      break;
+    }
+    dat[k].cnt[0] = dat->cnt[0];
+    dt_graph_run(&dat[k].graph, s_graph_run_all);
+  }
+  if(batch_cnt > 1) dt_log(s_log_cli, "%s on %d graphs",
+      multi_start ? "optimising" : "evaluating the jacobian", batch_cnt);
 
   // init lower and upper bounds
   double lb[num_params], ub[num_params];
@@ -314,27 +547,14 @@ int main(int argc, char *argv[])
   fprintf(stderr, "\n");
   // for(int i=7;i<num_params;i++) p[i] += 1e-5*(1.0-2.0*xrand()); // randomly perturb the initial guess
 
-  double resid = DBL_MAX;
-  if(optimiser == 0)
-  {
-    const int num_it = 400;
-    resid = dt_gauss_newton_cg(evaluate_f, evaluate_J,
-        p, t, num_params, num_target,
-        lb, ub, num_it, &dat);
-  }
-  else if(optimiser == 1)
-  {
-    const int num_it = 20000;
-    resid = dt_adam(evaluate_f, evaluate_J,
-        p, t, num_params, num_target,
-        lb, ub, num_it, &dat,
-        adam_eps, adam_beta1, adam_beta2, adam_alpha,
-        &user_abort);
-  }
-  else if(optimiser == 2)
-  {
-    resid = dt_nelder_mead(p, num_params, 20000, loss, &dat, &user_abort);
-  }
+  const opt_conf_t conf = {
+    .optimiser = optimiser,
+    .adam_eps = adam_eps, .adam_beta1 = adam_beta1, .adam_beta2 = adam_beta2, .adam_alpha = adam_alpha,
+    .t = t, .lb = lb, .ub = ub, .m = num_params, .n = num_target,
+  };
+  double resid = multi_start ?
+    optimise_multi(&conf, dat, p, num_starts) :
+    optimise(&conf, dat, p);
 
   fprintf(stderr, "post-opt params: ");
   for(int i=0;i<num_params;i++) fprintf(stderr, "%g ", p[i]);
@@ -342,15 +562,19 @@ int main(int argc, char *argv[])
   fprintf(stderr, "post-opt loss: %g", resid);
 
   pp = p;
-  for(int i=1;i<dat.param_cnt;i++) // [0] is the target parameter array
-    for(int j=0;j<dat.cnt[i];j++)
-      dat.par[i][j] = *(pp++);
+  for(int i=1;i<dat->param_cnt;i++) // [0] is the target parameter array
+    for(int j=0;j<dat->cnt[i];j++)
+      dat->par[i][j] = *(pp++);
 
   // output full cfg to stdout
-  dt_graph_write_config_ascii(&dat.graph, "/dev/stdout");
+  dt_graph_write_config_ascii(&dat->graph, "/dev/stdout");
 
-  dt_graph_cleanup(&dat.graph);
+  for(int k=0;k<batch_cnt;k++)
+    dt_graph_cleanup(&dat[k].graph);
+  free(dat);
   threads_global_cleanup();
+  dt_pipe_shader_cleanup();
+  dt_pipe_staging_cleanup();
   qvk_cleanup();
   exit(0);
 }
@@ -40,8 +40,20 @@ dt_gui_dr_anim_seek(int frame)
 {
   vkdt.graph_dev.frame = vkdt.state.anim_frame = CLAMP(frame, 0, vkdt.graph_dev.frame_cnt-1);
   vkdt.state.anim_no_keyframes = 0;  // (re-)enable keyframes
-  dt_graph_apply_keyframes(&vkdt.graph_dev); // rerun once
-  vkdt.graph_dev.runflags = s_graph_run_record_cmd_buf | s_graph_run_wait_done;
+  vkdt.graph_dev.runflags = s_graph_run_record_cmd_buf | s_graph_run_wait_done |
+    dt_graph_apply_keyframes(&vkdt.graph_dev); // rerun once, as much as check_params() asks for
+}
+
+// keyframes of the module were moved or deleted in the dopesheet. re-evaluate
+// the current frame and run only what check_params() asks for, as for any other
+// parameter change, instead of rebuilding the graph.
+static inline void
+dt_gui_dr_anim_keyframes_changed(dt_module_t *mod)
+{
+  dt_module_keyframes_changed(mod);
+  if(vkdt.state.anim_no_keyframes) return;
+  const dt_graph_run_t flags = dt_graph_apply_keyframes(&vkdt.graph_dev);
+  if(flags) vkdt.graph_dev.runflags |= flags | s_graph_run_wait_done;
 }
 
 static inline void
@@ -112,6 +124,7 @@ dt_gui_dr_next()
     if(next < vkdt.db.collection_cnt)
     {
       int err;
+      darkroom_keep_prefetch(1); // the image after this one is loaded in the background
       err = darkroom_leave(); // writes back thumbnails. maybe there'd be a cheaper way to invalidate.
       if(err) return;
       dt_db_selection_clear(&vkdt.db);
@@ -144,6 +157,7 @@ dt_gui_dr_prev()
     if(next >= 0)
     {
       int err;
+      darkroom_keep_prefetch(-1); // the image before this one is loaded in the background
       err = darkroom_leave(); // writes back thumbnails. maybe there'd be a cheaper way to invalidate.
       if(err) return;
       dt_db_selection_clear(&vkdt.db);
@@ -330,10 +344,13 @@ static inline void
 dt_gui_lt_duplicate()
 {
   if(!vkdt.db.selection_cnt) return; // no images selected
-  dt_db_duplicate_selected_images(&vkdt.db); // just create .cfg files, don't update db
-  char dir[PATH_MAX]; // reload directory:
-  snprintf(dir, sizeof(dir), "%s", vkdt.db.dirname);
-  dt_gui_switch_collection(dir);
+  if(dt_db_fileop_running(&vkdt.fileop))
+  {
+    dt_gui_notification("still busy with the last file operation!");
+    return;
+  }
+  // just create .cfg files, the directory is reloaded when the job is done (see render_lighttable.cc)
+  dt_db_duplicate_selected_images(&vkdt.db, &vkdt.fileop);
 }
 
 static inline int
@@ -377,11 +394,16 @@ dt_gui_rate(int rate)
     const uint32_t *sel = dt_db_selection_get(&vkdt.db);
     for(uint32_t i=0;i<vkdt.db.selection_cnt;i++)
       vkdt.db.image[sel[i]].rating = rate;
+    dt_db_journal(&vkdt.db, sel, vkdt.db.selection_cnt);
   }
   else if(vkdt.view_mode == s_view_darkroom)
   {
     const uint32_t ci = dt_db_current_imgid(&vkdt.db);
-    if(ci != -1u) vkdt.db.image[ci].rating = rate;
+    if(ci != -1u && vkdt.db.image[ci].rating != rate)
+    {
+      vkdt.db.image[ci].rating = rate;
+      dt_db_journal(&vkdt.db, &ci, 1);
+    }
   }
 }
 
@@ -393,11 +415,16 @@ dt_gui_label_unset(dt_image_label_t l)
     const uint32_t *sel = dt_db_selection_get(&vkdt.db);
     for(uint32_t i=0;i<vkdt.db.selection_cnt;i++)
       vkdt.db.image[sel[i]].labels &= ~l;
+    dt_db_journal(&vkdt.db, sel, vkdt.db.selection_cnt);
   }
   else if(vkdt.view_mode == s_view_darkroom)
   {
     const uint32_t ci = dt_db_current_imgid(&vkdt.db);
-    if(ci != -1u) vkdt.db.image[ci].labels &= ~l;
+    if(ci != -1u && (vkdt.db.image[ci].labels & l))
+    {
+      vkdt.db.image[ci].labels &= ~l;
+      dt_db_journal(&vkdt.db, &ci, 1);
+    }
   }
 }
 
@@ -409,11 +436,16 @@ dt_gui_label_set(dt_image_label_t l)
     const uint32_t *sel = dt_db_selection_get(&vkdt.db);
     for(uint32_t i=0;i<vkdt.db.selection_cnt;i++)
       vkdt.db.image[sel[i]].labels |= l;
+    dt_db_journal(&vkdt.db, sel, vkdt.db.selection_cnt);
   }
   else if(vkdt.view_mode == s_view_darkroom)
   {
     const uint32_t ci = dt_db_current_imgid(&vkdt.db);
-    if(ci != -1u) vkdt.db.image[ci].labels |= l;
+    if(ci != -1u && (vkdt.db.image[ci].labels & l) != l)
+    {
+      vkdt.db.image[ci].labels |= l;
+      dt_db_journal(&vkdt.db, &ci, 1);
+    }
   }
 }
 
@@ -425,11 +457,16 @@ dt_gui_label(int label)
     const uint32_t *sel = dt_db_selection_get(&vkdt.db);
     for(uint32_t i=0;i<vkdt.db.selection_cnt;i++)
       vkdt.db.image[sel[i]].labels ^= 1<<(label-1);
+    dt_db_journal(&vkdt.db, sel, vkdt.db.selection_cnt);
   }
   else if(vkdt.view_mode == s_view_darkroom)
   {
     const uint32_t ci = dt_db_current_imgid(&vkdt.db);
-    if(ci != -1u) vkdt.db.image[ci].labels ^= 1<<(label-1);
+    if(ci != -1u)
+    {
+      vkdt.db.image[ci].labels ^= 1<<(label-1);
+      dt_db_journal(&vkdt.db, &ci, 1);
+    }
   }
 }
 
@@ -41,6 +41,8 @@ dt_gui_lt_modals()
       const uint32_t *sel = dt_db_selection_get(&vkdt.db);
       for(uint32_t i=0;i<vkdt.db.selection_cnt;i++)
         dt_db_add_to_collection(&vkdt.db, sel[i], name);
+      if(dt_rc_get_int(&vkdt.rc, "gui/tag_symlinks", 0))
+        dt_db_tag_export_symlinks(vkdt.db.basedir, name);
       dt_gui_read_tags();
     }
   }
@@ -83,62 +85,15 @@ dt_gui_lt_paste_history()
     dt_gui_notification("need to copy first!");
     return;
   }
-  // TODO: background job
-  char filename[1024];
-  uint32_t cid = vkdt.wstate.copied_imgid;
-  dt_db_image_path(&vkdt.db, cid, filename, sizeof(filename));
-  char *src = realpath(filename, 0);
-  FILE *fin = fopen(src, "rb");
-  if(!fin)
-  { // also fails if src is 0
-    dt_gui_notification("could not open %s!", src);
-    return;
-  }
-  fseek(fin, 0, SEEK_END);
-  size_t fsize = ftell(fin);
-  fseek(fin, 0, SEEK_SET);
-  uint8_t *buf = (uint8_t*)malloc(fsize);
-  fread(buf, fsize, 1, fin);
-  fclose(fin);
-  // this only works if the copied source is "simple", i.e. cfg corresponds to exactly
-  // one input raw file that is appearing under param:i-raw:main:filename.
-  // it then copies the history to the selected images, replacing their filenames in the config.
-  const uint32_t *sel = dt_db_selection_get(&vkdt.db);
-  for(uint32_t i=0;i<vkdt.db.selection_cnt;i++)
+  if(dt_db_fileop_running(&vkdt.fileop))
   {
-    if(sel[i] == cid) continue; // don't copy to self
-    dt_db_image_path(&vkdt.db, sel[i], filename, sizeof(filename));
-    char dst[PATH_MAX];
-    realpath(filename, dst);
-    FILE *fout = fopen(dst, "wb");
-    if(fout)
-    {
-      fwrite(buf, fsize, 1, fout);
-      // replace (relative) image file name
-      char *fn = fs_basename(dst);
-      size_t len = strlen(fn);
-      if(len > 4)
-      {
-        fn[len-=4] = 0; // cut off .cfg
-        if(len > 4 && !strncasecmp(fn+len-4, ".mlv", 4))
-          fprintf(fout, "param:i-mlv:main:filename:%s\n", fn);
-        else if(len > 4 && !strncasecmp(fn+len-4, ".pfm", 4))
-          fprintf(fout, "param:i-pfm:main:filename:%s\n", fn);
-        else if(len > 4 && !strncasecmp(fn+len-4, ".jpg", 4))
-          fprintf(fout, "param:i-jpg:main:filename:%s\n", fn);
-        else
-          fprintf(fout, "param:i-raw:main:filename:%s\n", fn);
-      }
-      fclose(fout);
-    }
+    dt_gui_notification("still busy with the last file operation!");
+    return;
   }
-  free(buf);
-  free(src);
-  dt_thumbnails_cache_list(
-      &vkdt.thumbnail_gen,
-      &vkdt.db,
-      sel, vkdt.db.selection_cnt,
-      &glfwPostEmptyEvent);
+  // the cfg files are written in the background, the thumbnails are
+  // refreshed when the job is done (see render_lighttable.cc)
+  if(dt_db_paste_history(&vkdt.db, vkdt.wstate.copied_imgid, &vkdt.fileop) && vkdt.db.selection_cnt > 1)
+    dt_gui_notification("could not read the copied history!");
 }
 
 // scroll to top of collection
@@ -378,6 +333,8 @@ error:
     if(ok == 1)
     {
       dt_db_add_to_collection(&vkdt.db, vkdt.db.current_imgid, name);
+      if(dt_rc_get_int(&vkdt.rc, "gui/tag_symlinks", 0))
+        dt_db_tag_export_symlinks(vkdt.db.basedir, name);
       dt_gui_read_tags();
     }
   } // end BeginPopupModal assign tag
@@ -1,6 +1,7 @@
 #include "core/log.h"
 #include "core/fs.h"
 #include "core/core.h"
+#include "core/threads.h"
 #include "qvk/qvk.h"
 #include "gui/api.h"
 #include "gui/gui.h"
@@ -110,11 +111,65 @@ darkroom_keyboard(GLFWwindow *window, int key, int scancode, int action, int mod
   }
 }
 
+// the main display changes resolution by f (new image pixels per old one),
+// keep the view on the same part of the image.
+static void
+darkroom_rescale_view(float f)
+{
+  dt_image_widget_t *w = &vkdt.wstate.img_widget;
+  if(w->scale > 0.0f) w->scale /= f;
+  if(w->look_at_x != FLT_MAX) w->look_at_x *= f;
+  if(w->look_at_y != FLT_MAX) w->look_at_y *= f;
+}
+
+// switch the lod of the main display. this rebuilds the graph, the new roi is
+// picked up by modify_roi_in().
+static void
+darkroom_set_lod_scale(int lod)
+{
+  dt_graph_t *g = &vkdt.graph_dev;
+  const int old = MAX(1, g->lod_scale);
+  if(old == lod) return;
+  darkroom_rescale_view(old / (float)lod);
+  g->lod_scale = lod;
+  g->runflags = s_graph_run_all;
+}
+
+// with gui/lod > 1 the main display is processed at screen resolution. when
+// zooming in, double the processing resolution until one image pixel covers
+// at most one and a half screen pixels or the full resolution is reached, and
+// halve it again when zooming out. the graph is only rebuilt on zoom changes.
+static int
+darkroom_zoom_lod()
+{
+  if(vkdt.wstate.lod <= 1 || vkdt.wstate.dragging || vkdt.state.anim_playing ||
+     vkdt.graph_dev.runflags || vkdt.graph_dev.lod_scale > 1) return 0;
+  dt_node_t *md = dt_graph_get_display(&vkdt.graph_dev, dt_token("main"));
+  if(!md) return 0;
+  const dt_roi_t *r = &md->connector[0].roi;
+  const float scale = vkdt.wstate.img_widget.scale; // screen pixels per image pixel, or fit
+  int zoom = vkdt.wstate.lod_zoom;
+  if(scale <= 0.0f) zoom = 0;
+  else if(scale > 1.5f && r->scale > 1.0f && zoom < 8) zoom++;
+  else if(scale < 0.375f && zoom > 0) zoom--;
+  if(zoom == vkdt.wstate.lod_zoom) return 0;
+  const int wd = MIN((int)r->full_wd, (vkdt.state.center_wd << zoom) / (vkdt.wstate.lod-1));
+  const int ht = MIN((int)r->full_ht, (vkdt.state.center_ht << zoom) / (vkdt.wstate.lod-1));
+  const float s = MAX(r->full_wd / (float)wd, r->full_ht / (float)ht); // as modify_roi_in() will
+  darkroom_rescale_view(r->scale / s);
+  vkdt.wstate.lod_zoom = zoom;
+  vkdt.graph_dev.output_wd = wd;
+  vkdt.graph_dev.output_ht = ht;
+  vkdt.graph_dev.runflags = s_graph_run_all;
+  return 1;
+}
+
 void
 darkroom_process()
 {
   static int    start_frame = 0;           // frame we were when play was issued
   static struct timespec start_time = {0}; // start time of the same event
+  static int    audio_frame = 0;           // next frame to fetch audio samples for
 
   struct timespec beg;
   clock_gettime(CLOCK_REALTIME, &beg);
@@ -133,9 +188,12 @@ darkroom_process()
       {
         start_time  = beg;
         start_frame = vkdt.state.anim_frame;
+        audio_frame = start_frame;
       }
-      // compute current animation frame by time:
-      double dt = (double)(beg.tv_sec - start_time.tv_sec) + 1e-9*(beg.tv_nsec - start_time.tv_nsec);
+      // compute current animation frame by time. if we play sound, follow
+      // what is being heard, so the video waits for late audio and vice versa:
+      double dt = dt_snd_time(&vkdt.snd);
+      if(dt < 0.0) dt = (double)(beg.tv_sec - start_time.tv_sec) + 1e-9*(beg.tv_nsec - start_time.tv_nsec);
       vkdt.state.anim_frame = CLAMP(
           start_frame + MAX(0, vkdt.graph_dev.frame_rate * dt),
           0, (uint32_t)vkdt.graph_dev.frame_cnt-1);
@@ -149,10 +207,11 @@ darkroom_process()
       if(vkdt.state.anim_frame > vkdt.graph_dev.frame + 1)
         dt_log(s_log_snd, "frame drop warning, audio may stutter!");
       vkdt.graph_dev.frame = vkdt.state.anim_frame;
+      dt_graph_run_t kf_flags = s_graph_run_none;
       if(!vkdt.state.anim_no_keyframes)
-        dt_graph_apply_keyframes(&vkdt.graph_dev);
+        kf_flags = dt_graph_apply_keyframes(&vkdt.graph_dev);
       if(vkdt.graph_dev.frame_cnt == 0 || vkdt.state.anim_frame < vkdt.state.anim_max_frame+1)
-        vkdt.graph_dev.runflags = s_graph_run_record_cmd_buf;
+        vkdt.graph_dev.runflags = s_graph_run_record_cmd_buf | kf_flags;
     }
     if(vkdt.state.anim_frame == vkdt.graph_dev.frame_cnt - 1)
       dt_gui_dr_anim_stop(); // reached the end, stop.
@@ -162,9 +221,23 @@ darkroom_process()
     start_time = (struct timespec){0};
   }
 
+  // progressive refinement: while a widget is being dragged, process at coarse lod.
+  // since every run is waited for, no full resolution run is in flight by then.
+  // the full lod run is only issued once the interaction stopped.
+  int lod_change = darkroom_zoom_lod(); // view was rescaled already
+  if(!vkdt.state.anim_playing)
+  {
+    const int lod = vkdt.wstate.dragging ? vkdt.wstate.lod_drag : 1;
+    if(lod != MAX(1, vkdt.graph_dev.lod_scale) && (lod == 1 || vkdt.graph_dev.runflags))
+    {
+      darkroom_set_lod_scale(lod);
+      lod_change = 1;
+    }
+  }
+
   int reset_view = 0;
   dt_roi_t old_roi;
-  if(vkdt.graph_dev.runflags & s_graph_run_roi)
+  if(!lod_change && (vkdt.graph_dev.runflags & s_graph_run_roi))
   {
     reset_view = 1;
     dt_node_t *md = dt_graph_get_display(&vkdt.graph_dev, dt_token("main"));
@@ -181,8 +254,8 @@ darkroom_process()
       dt_image_reset_zoom(&vkdt.wstate.img_widget);
   }
 
-  if(vkdt.state.anim_playing && advance)
-  { // new frame for animations need new audio, too
+  if(vkdt.state.anim_playing && (advance || vkdt.snd.handle))
+  { // keep the audio queue filled ahead of the clock, the audio thread plays it
     dt_graph_t *g = &vkdt.graph_dev;
     for(int i=0;i<g->num_modules;i++)
     { // find first audio module, if any
@@ -190,8 +263,18 @@ darkroom_process()
       if(g->module[i].so->audio)
       {
         uint16_t *samples;
-        int cnt = g->module[i].so->audio(g->module+i, g->frame, &samples);
-        if(cnt > 0) dt_snd_play(&vkdt.snd, samples, cnt);
+        if(!vkdt.snd.handle)
+        { // no device, just keep the decoder going
+          g->module[i].so->audio(g->module+i, g->frame, &samples);
+          break;
+        }
+        while(audio_frame < g->frame_cnt && dt_snd_queued(&vkdt.snd) < vkdt.snd.sample_rate / 5)
+        {
+          int cnt = g->module[i].so->audio(g->module+i, audio_frame, &samples);
+          if(cnt <= 0) break; // nothing decoded yet
+          dt_snd_play(&vkdt.snd, samples, cnt);
+          audio_frame++;
+        }
         break;
       }
     }
@@ -203,18 +286,24 @@ darkroom_process()
   // dt_log(s_log_perf, "frame time %2.3fs", dt);
 }
 
-int
-darkroom_enter()
+// a second graph that loads and processes the image the user will probably
+// step to next, in the background on a work queue. it is swapped in by
+// darkroom_enter() if it matches the image.
+static struct
+{
+  dt_graph_t graph;
+  uint32_t   imgid;   // image in the graph, -1u if none
+  int        taskid;  // background job, or -1
+  int        dir;     // direction of the last step through the collection
+  int        keep;    // don't clean up during the next darkroom_leave()
+  VkResult   res;
+}
+prefetch = { .imgid = -1u, .taskid = -1, .dir = 1 };
+
+// load the history of the image or a default config into a fresh graph
+static int
+darkroom_load_graph(dt_graph_t *graph, uint32_t imgid)
 {
-  vkdt.state.anim_frame = 0;
-  dt_gui_dr_anim_stop();
-  dt_image_reset_zoom(&vkdt.wstate.img_widget);
-  vkdt.wstate.active_widget_modid = -1;
-  vkdt.wstate.active_widget_parid = -1;
-  vkdt.wstate.mapped = 0;
-  vkdt.wstate.selected = -1;
-  uint32_t imgid = dt_db_current_imgid(&vkdt.db);
-  if(imgid == -1u) return 1;
   char graph_cfg[PATH_MAX+100];
   dt_db_image_path(&vkdt.db, imgid, graph_cfg, sizeof(graph_cfg));
 
@@ -235,36 +324,132 @@ darkroom_enter()
     load_default = 1;
   }
 
-  dt_graph_init(&vkdt.graph_dev);
-  vkdt.graph_dev.gui_attached = 1;
-  dt_graph_history_init(&vkdt.graph_dev);
+  dt_graph_init(graph);
+  graph->gui_attached = 1;
+  if(vkdt.wstate.lod > 1)
+  { // process at screen resolution, as dt_gui_set_lod()
+    graph->output_wd = vkdt.state.center_wd / (vkdt.wstate.lod-1);
+    graph->output_ht = vkdt.state.center_ht / (vkdt.wstate.lod-1);
+  }
+  graph->ring_depth = CLAMP(dt_rc_get_int(&vkdt.rc, "gui/frames_in_flight", 3), 2, DT_GRAPH_MAX_RING);
+  // outputs of expensive modules for history jumps, see pipe/graph-modcache.h
+  graph->modcache_budget = (uint64_t)MAX(0, dt_rc_get_int(&vkdt.rc, "gui/modcache_mb", 512)) << 20;
+  if(dt_rc_get_int(&vkdt.rc, "gui/async_queue", 1))
+  { // histograms and other side branches run next to the main pipeline, see pipe/graph-async.h
+    graph->queue_async       = qvk.queue_work0;
+    graph->queue_async_mutex = &qvk.queue_work0_mutex;
+  }
+  dt_graph_history_init(graph);
 
-  if(dt_graph_read_config_ascii(&vkdt.graph_dev, graph_cfg))
+  if(dt_graph_read_config_ascii(graph, graph_cfg))
   {
     dt_log(s_log_err|s_log_gui, "could not load graph configuration from '%s'!", graph_cfg);
-    dt_graph_cleanup(&vkdt.graph_dev);
+    dt_graph_cleanup(graph);
     return 2;
   }
 
   if(load_default)
   {
-    dt_graph_set_searchpath(&vkdt.graph_dev, realimg);
+    dt_graph_set_searchpath(graph, realimg);
     char *basen = fs_basename(realimg); // cut away path so we can relocate more easily
-    int modid = dt_module_get(&vkdt.graph_dev, input_module, dt_token("main"));
+    int modid = dt_module_get(graph, input_module, dt_token("main"));
     if(modid < 0 ||
-       dt_module_set_param_string(vkdt.graph_dev.module + modid, dt_token("filename"),
+       dt_module_set_param_string(graph->module + modid, dt_token("filename"),
          basen))
     {
       dt_log(s_log_err|s_log_gui, "config '%s' has no valid input module!", graph_cfg);
-      dt_graph_cleanup(&vkdt.graph_dev);
+      dt_graph_cleanup(graph);
       return 3;
     }
   }
-  dt_graph_history_reset(&vkdt.graph_dev);
+  dt_graph_history_reset(graph);
+  return 0;
+}
 
-  if((vkdt.graph_res = dt_graph_run(&vkdt.graph_dev, s_graph_run_all)) != VK_SUCCESS)
-    dt_gui_notification("running the graph failed (%s)!",
-        qvk_result_to_string(vkdt.graph_res));
+static void
+prefetch_work(uint32_t item, void *data)
+{
+  dt_graph_t *g = &prefetch.graph;
+  prefetch.res = VK_INCOMPLETE;
+  if(darkroom_load_graph(g, prefetch.imgid))
+  {
+    prefetch.imgid = -1u;
+    return;
+  }
+  g->queue       = qvk.queue_work1; // same queue family as compute, so the graph can be swapped in
+  g->queue_idx   = qvk.queue_idx_work1;
+  g->queue_mutex = &qvk.queue_work1_mutex;
+  prefetch.res = dt_graph_run(g, s_graph_run_all | s_graph_run_wait_done);
+}
+
+static void
+prefetch_cleanup()
+{
+  if(prefetch.taskid >= 0) threads_wait(prefetch.taskid);
+  prefetch.taskid = -1;
+  if(prefetch.imgid != -1u)
+  {
+    dt_graph_cleanup(&prefetch.graph);
+    dt_graph_history_cleanup(&prefetch.graph);
+  }
+  prefetch.imgid = -1u;
+}
+
+// start loading the neighbour of the current image in the direction we're stepping
+static void
+prefetch_start()
+{
+  if(!dt_rc_get_int(&vkdt.rc, "gui/prefetch", 1) || vkdt.graph_dev.frame_cnt != 1) return;
+  const int64_t colid = dt_db_current_colid(&vkdt.db) + prefetch.dir;
+  if(colid < 0 || colid >= vkdt.db.collection_cnt) return;
+  prefetch.imgid  = vkdt.db.collection[colid];
+  prefetch.taskid = threads_task("prefetch", 1, -1, 0, prefetch_work, 0);
+  if(prefetch.taskid < 0) prefetch.imgid = -1u;
+}
+
+void
+darkroom_keep_prefetch(int dir)
+{
+  prefetch.dir  = dir;
+  prefetch.keep = 1;
+}
+
+int
+darkroom_enter()
+{
+  vkdt.state.anim_frame = 0;
+  dt_gui_dr_anim_stop();
+  dt_image_reset_zoom(&vkdt.wstate.img_widget);
+  vkdt.wstate.active_widget_modid = -1;
+  vkdt.wstate.active_widget_parid = -1;
+  vkdt.wstate.mapped = 0;
+  vkdt.wstate.selected = -1;
+  vkdt.wstate.dragging = 0;
+  vkdt.wstate.lod_zoom = 0;
+  uint32_t imgid = dt_db_current_imgid(&vkdt.db);
+  if(imgid == -1u) return 1;
+
+  if(prefetch.taskid >= 0) threads_wait(prefetch.taskid);
+  prefetch.taskid = -1;
+  if(prefetch.imgid == imgid && prefetch.res == VK_SUCCESS)
+  { // swap in the graph that is processed already
+    vkdt.graph_dev = prefetch.graph;
+    vkdt.graph_dev.queue       = qvk.queue_compute;
+    vkdt.graph_dev.queue_idx   = qvk.queue_idx_compute;
+    vkdt.graph_dev.queue_mutex = qvk.queue_compute == qvk.queue_graphics ? &qvk.queue_mutex : 0;
+    vkdt.graph_res = VK_SUCCESS;
+    prefetch.imgid = -1u;
+  }
+  else
+  {
+    prefetch_cleanup();
+    int err = darkroom_load_graph(&vkdt.graph_dev, imgid);
+    if(err) return err;
+
+    if((vkdt.graph_res = dt_graph_run(&vkdt.graph_dev, s_graph_run_all)) != VK_SUCCESS)
+      dt_gui_notification("running the graph failed (%s)!",
+          qvk_result_to_string(vkdt.graph_res));
+  }
 
   // nodes are only constructed after running once
   // (could run up to s_graph_run_create_nodes)
@@ -291,6 +476,7 @@ darkroom_enter()
   dt_gamepadhelp_set(dt_gamepadhelp_R2, "zoom in. while holding L2: toggle fullscreen");
   dt_gamepadhelp_set(dt_gamepadhelp_L3, "reset zoom");
   dt_gamepadhelp_set(dt_gamepadhelp_R3, "reset focussed control");
+  prefetch_start();
   return 0;
 }
 
@@ -312,11 +498,13 @@ darkroom_leave()
       &vkdt.thumbnail_gen,
       &vkdt.db,
       &imgid, 1,
-      &glfwPostEmptyEvent);
+      &dt_gui_wake_up);
 
   // TODO: repurpose instead of cleanup!
   dt_graph_cleanup(&vkdt.graph_dev);
   dt_graph_history_cleanup(&vkdt.graph_dev);
+  if(!prefetch.keep) prefetch_cleanup(); // leaving darkroom, not stepping to the next image
+  prefetch.keep = 0;
   vkdt.graph_res = VK_INCOMPLETE; // invalidate
   dt_gamepadhelp_clear();
   return 0;
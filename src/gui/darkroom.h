@@ -10,3 +10,5 @@ void darkroom_keyboard(GLFWwindow *window, int key, int scancode, int action, in
 void darkroom_pentablet_data(double x, double y, double z, double pressure, double pitch, double yaw, double roll);
 void darkroom_process();
 int  darkroom_leave();
+// stepping through the collection in direction dir, keep the prefetched graph
+void darkroom_keep_prefetch(int dir);
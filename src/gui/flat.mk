@@ -4,6 +4,7 @@ GUI_O=gui/gui.o\
       gui/render_lighttable.o\
       gui/render_darkroom.o\
       gui/render_nodes.o\
+      gui/render_perf.o\
       gui/darkroom.o\
       gui/main.o\
       gui/view.o\
@@ -18,6 +19,7 @@ GUI_H=gui/gui.h\
       gui/render.h\
       gui/render_view.hh\
       gui/render_darkroom.hh\
+      gui/render_perf.hh\
       gui/api.h\
       gui/api.hh\
       gui/hotkey.hh\
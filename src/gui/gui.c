@@ -4,6 +4,7 @@
 #include "core/threads.h"
 #include "render.h"
 #include "pipe/io.h"
+#include "pipe/global.h"
 #include "pipe/modules/api.h"
 
 #define GLFW_INCLUDE_VULKAN
@@ -104,6 +105,8 @@ int dt_gui_init()
   const char *gpu_name = dt_rc_get(&vkdt.rc, "qvk/device_name", "null");
   if(!strcmp(gpu_name, "null")) gpu_name = 0;
   int gpu_id = dt_rc_get_int(&vkdt.rc, "qvk/device_id", -1);
+  qvk.low_latency = dt_rc_get_int(&vkdt.rc, "gui/low_latency", 0);
+  qvk.hdr         = dt_rc_get_int(&vkdt.rc, "gui/hdr", 0);
   if(qvk_init(gpu_name, gpu_id))
   {
     dt_log(s_log_err|s_log_gui, "init vulkan failed");
@@ -298,6 +301,8 @@ void dt_gui_cleanup()
   if(vkdt.render_pass)
     vkDestroyRenderPass(qvk.device, vkdt.render_pass, 0);
   vkDestroyDescriptorPool(qvk.device, vkdt.descriptor_pool, 0);
+  dt_pipe_shader_cleanup();
+  dt_pipe_staging_cleanup();
   qvk_cleanup();
   glfwDestroyWindow(qvk.window);
   glfwTerminate();
@@ -339,12 +344,25 @@ VkResult dt_gui_render()
 
   // Submit command buffer
   vkCmdEndRenderPass(vkdt.command_buffer[i]);
-  VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  // also wait for the darkroom graph to finish the frame we are about to display.
+  // it may keep more frames in flight, and we don't want to block the cpu for it.
+  VkPipelineStageFlags wait_stage[] = {
+    VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+    VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT };
+  VkSemaphore wait_semaphore[] = { image_acquired_semaphore, vkdt.graph_dev.semaphore };
+  const uint64_t wait_value[] = { 0, vkdt.graph_dev.frame_value[vkdt.graph_dev.frame % DT_GRAPH_MAX_FRAMES] };
+  VkTimelineSemaphoreSubmitInfo timeline_info = {
+    .sType                   = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+    .waitSemaphoreValueCount = 2,
+    .pWaitSemaphoreValues    = wait_value,
+  };
+  const int wait_graph = vkdt.graph_dev.semaphore && wait_value[1];
   VkSubmitInfo sub_info = {
     .sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-    .waitSemaphoreCount   = 1,
-    .pWaitSemaphores      = &image_acquired_semaphore,
-    .pWaitDstStageMask    = &wait_stage,
+    .pNext                = wait_graph ? &timeline_info : 0,
+    .waitSemaphoreCount   = wait_graph ? 2 : 1,
+    .pWaitSemaphores      = wait_semaphore,
+    .pWaitDstStageMask    = wait_stage,
     .commandBufferCount   = 1,
     .pCommandBuffers      = vkdt.command_buffer+i,
     .signalSemaphoreCount = 1,
@@ -361,8 +379,15 @@ VkResult dt_gui_render()
 VkResult dt_gui_present()
 {
   VkSemaphore render_complete_semaphore = vkdt.sem_render_complete[vkdt.sem_index];
+  const uint64_t present_id = ++vkdt.present_id;
+  VkPresentIdKHR present_id_info = {
+    .sType          = VK_STRUCTURE_TYPE_PRESENT_ID_KHR,
+    .swapchainCount = 1,
+    .pPresentIds    = &present_id,
+  };
   VkPresentInfoKHR info = {
     .sType              = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
+    .pNext              = qvk.present_wait_supported ? &present_id_info : 0,
     .waitSemaphoreCount = 1,
     .pWaitSemaphores    = &render_complete_semaphore,
     .swapchainCount     = 1,
@@ -373,6 +398,15 @@ VkResult dt_gui_present()
   VkResult res = vkQueuePresentKHR(qvk.queue_graphics, &info);
   threads_mutex_unlock(&qvk.queue_mutex);
   vkdt.sem_index = (vkdt.sem_index + 1) % vkdt.image_count;
+  if(qvk.present_wait_supported && qvk.present_mode != VK_PRESENT_MODE_FIFO_KHR &&
+     vkdt.present_swap_chain == qvk.swap_chain && res == VK_SUCCESS)
+  { // mailbox and immediate don't block, so we'd render frames nobody sees. wait for the previous
+    // one to reach the screen, but never longer than a frame of the playing animation.
+    const double frame_rate = vkdt.state.anim_playing ? vkdt.graph_dev.frame_rate : 0.0;
+    const uint64_t timeout = frame_rate > 0.0 ? 1e9 / frame_rate : 100000000;
+    qvk.WaitForPresentKHR(qvk.device, qvk.swap_chain, present_id - 1, timeout);
+  }
+  vkdt.present_swap_chain = qvk.swap_chain; // ids of an old swapchain will never show
   return res;
 }
 
@@ -446,9 +480,13 @@ dt_gui_read_tags()
     {
       if(!strcmp(ep->d_name, "." )) continue;
       if(!strcmp(ep->d_name, "..")) continue;
-      struct stat buf;
-      snprintf(filename, sizeof(filename), "%s/tags/%s", vkdt.db.basedir, ep->d_name);
-      stat(filename, &buf);
+      struct stat buf = {0};
+      snprintf(filename, sizeof(filename), "%s/tags/%s/tag.idx", vkdt.db.basedir, ep->d_name);
+      if(stat(filename, &buf))
+      { // no index (yet), the directory has the time of the last symlink
+        snprintf(filename, sizeof(filename), "%s/tags/%s", vkdt.db.basedir, ep->d_name);
+        stat(filename, &buf);
+      }
       uint64_t t = buf.st_mtim.tv_sec;
       if(vkdt.tag_cnt < sizeof(vkdt.tag)/sizeof(vkdt.tag[0]))
       { // add
@@ -474,12 +512,17 @@ dt_gui_read_tags()
 void dt_gui_switch_collection(const char *dir)
 {
   vkdt.wstate.copied_imgid = -1u; // invalidate
+  free(vkdt.fileop.imgid); // a running job keeps its file names, but the ids are about this db
+  vkdt.fileop.imgid = 0;
   dt_thumbnails_cache_abort(&vkdt.thumbnail_gen); // this is essential since threads depend on db
-  dt_db_cleanup(&vkdt.db);
+  dt_thumbnails_cache_abort(&vkdt.previews);
+  for(int i=0;i<vkdt.previews.thumb_max;i++) vkdt.previews.thumb[i].imgid = -1u; // ids change with the collection
+  dt_db_recent_stash(&vkdt.db_recent, &vkdt.db);
   dt_db_init(&vkdt.db);
   QVKL(&qvk.queue_mutex, vkDeviceWaitIdle(qvk.device));
-  dt_db_load_directory(&vkdt.db, &vkdt.thumbnails, dir);
-  dt_thumbnails_cache_collection(&vkdt.thumbnail_gen, &vkdt.db, &glfwPostEmptyEvent);
+  if(dt_db_recent_restore(&vkdt.db_recent, &vkdt.db, &vkdt.thumbnails, dir))
+    dt_db_load_directory(&vkdt.db, &vkdt.thumbnails, dir);
+  dt_thumbnails_cache_collection(&vkdt.thumbnail_gen, &vkdt.db, &dt_gui_wake_up);
 
   // update recently used collection list:
   int32_t num = CLAMP(dt_rc_get_int(&vkdt.rc, "gui/ruc_num", 0), 0, 10);
@@ -499,6 +542,14 @@ void dt_gui_switch_collection(const char *dir)
   dt_rc_set_int(&vkdt.rc, "gui/ruc_num", MIN(j, 10));
 }
 
+void dt_gui_wake_up()
+{ // only the first call since the last frame needs an event, and only if the
+  // main loop is asleep. otherwise it sees the pending flag before waiting.
+  if(!__atomic_exchange_n(&vkdt.wstate.wake_pending, 1, __ATOMIC_SEQ_CST) &&
+      __atomic_load_n(&vkdt.wstate.wake_waiting, __ATOMIC_SEQ_CST))
+    glfwPostEmptyEvent();
+}
+
 void dt_gui_notification(const char *msg, ...)
 {
   va_list args;
@@ -1,6 +1,7 @@
 #pragma once
 #include "pipe/graph.h"
 #include "db/thumbnails.h"
+#include "db/dircache.h"
 #include "db/db.h"
 #include "db/rc.h"
 #include "snd/snd.h"
@@ -64,6 +65,9 @@ typedef struct dt_gui_wstate_t
   float   *mapped;
   int      grabbed;
   int      lod;
+  int      lod_zoom;            // with lod > 1, process at 2^lod_zoom times screen resolution
+  int      lod_drag;            // lod_scale of the graph while a widget is being dragged
+  int      dragging;            // a widget is being held this frame
   uint32_t copied_imgid;       // imgid copied for copy/paste
   float    connector[100][30][2];
   char    *module_names_buf;
@@ -81,6 +85,9 @@ typedef struct dt_gui_wstate_t
 
   int set_nav_focus;            // gamepad navigation delay to communicate between lighttable and darkroom
   int busy;                     // still busy for how many frames before stopping redraw?
+  int wake_pending;             // background work asked for a redraw (see dt_gui_wake_up())
+  int wake_waiting;             // main loop blocks in glfwWaitEvents() and needs an event
+  double wake_time;             // when the last frame started
 
   float fontsize;               // pixel size of currently loaded (regular) font
   int   show_gamepadhelp;       // show context sensitive gamepad help
@@ -112,13 +119,19 @@ typedef struct dt_gui_t
   uint32_t         sem_index;
   VkSemaphore      sem_image_acquired [DT_GUI_MAX_IMAGES];
   VkSemaphore      sem_render_complete[DT_GUI_MAX_IMAGES];
+  uint64_t         present_id;         // counts presented frames, for VK_KHR_present_wait
+  VkSwapchainKHR   present_swap_chain; // the swapchain the last id went to
 
   VkResult         graph_res;
   dt_graph_t       graph_dev;
 
   dt_db_t          db;            // image list and current query
+  dt_db_recent_t   db_recent;     // states of the last few directories
+  dt_db_fileop_t   fileop;        // deleting or duplicating the selection in the background
   dt_thumbnails_t  thumbnails;    // for light table mode
   dt_thumbnails_t  thumbnail_gen; // to generate thumbnails asynchronously
+  dt_thumbnails_t  previews;      // mid resolution tier for the full screen lighttable preview
+  dt_dircache_t    dircache;      // directory listings for the file browser and filtered lists
   dt_gui_view_t    view_mode;     // current view mode
 
   dt_snd_t         snd;           // connection to audio device
@@ -169,6 +182,12 @@ void dt_gui_switch_collection(const char *dir);
 // display a notification message overlay in the gui for some seconds
 void dt_gui_notification(const char *msg, ...);
 
+// ask for a redraw from a background thread (progress, finished thumbnails).
+// wake ups are coalesced: the gui draws at most DT_GUI_WAKE_HZ frames per
+// second for them, no matter how many items finish in between.
+#define DT_GUI_WAKE_HZ 30
+void dt_gui_wake_up();
+
 // lets the current input module grab the mouse, i.e. hide it from the rest of the gui
 void dt_gui_grab_mouse();
 
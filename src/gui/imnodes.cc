@@ -1529,6 +1529,18 @@ void DrawNode(ImNodesEditorContext& editor, const int node_idx)
     const ImNodeData& node = editor.Nodes.Pool[node_idx];
     ImGui::SetCursorPos(node.Origin + editor.Panning);
 
+    if (!node.Rect.Overlaps(GImNodes->CanvasRectScreenSpace))
+    {
+        // Off screen: links and hovering still need the pin positions, but there is nothing to
+        // draw.
+        for (int i = 0; i < node.PinIndices.size(); ++i)
+        {
+            ImPinData& pin = editor.Pins.Pool[node.PinIndices[i]];
+            pin.Pos = GetScreenSpacePinCoordinates(node.Rect, pin.AttributeRect, pin.Type);
+        }
+        return;
+    }
+
     const bool node_hovered =
         GImNodes->HoveredNodeIdx == node_idx &&
         editor.ClickInteraction.Type != ImNodesClickInteractionType_BoxSelection;
@@ -1608,9 +1620,30 @@ void DrawNode(ImNodesEditorContext& editor, const int node_idx)
     }
 }
 
+// Returns the points along the curve relative to P0, recomputing them only if the shape changed.
+const ImVector<ImVec2>& GetLinkTessellation(ImLinkData& link, const CubicBezier& cb, const int type)
+{
+    const ImVec2 delta = cb.P3 - cb.P0;
+    if (link.Tessellation.size() == cb.NumSegments + 1 && link.TessellationStartType == type &&
+        link.TessellationDelta.x == delta.x && link.TessellationDelta.y == delta.y)
+    {
+        return link.Tessellation;
+    }
+
+    link.Tessellation.resize(cb.NumSegments + 1);
+    link.TessellationDelta = delta;
+    link.TessellationStartType = type;
+    const float t_step = 1.0f / (float)cb.NumSegments;
+    for (int i = 0; i <= cb.NumSegments; ++i)
+    {
+        link.Tessellation[i] = EvalCubicBezier(t_step * i, cb.P0, cb.P1, cb.P2, cb.P3) - cb.P0;
+    }
+    return link.Tessellation;
+}
+
 void DrawLink(ImNodesEditorContext& editor, const int link_idx)
 {
-    const ImLinkData& link = editor.Links.Pool[link_idx];
+    ImLinkData&       link = editor.Links.Pool[link_idx];
     const ImPinData&  start_pin = editor.Pins.Pool[link.StartPinIdx];
     const ImPinData&  end_pin = editor.Pins.Pool[link.EndPinIdx];
 
@@ -1646,18 +1679,26 @@ void DrawLink(ImNodesEditorContext& editor, const int link_idx)
         link_color = link.ColorStyle.Hovered;
     }
 
-#if IMGUI_VERSION_NUM < 18000
-    GImNodes->CanvasDrawList->AddBezierCurve(
+    if (!GetContainingRectForCubicBezier(cubic_bezier).Overlaps(GImNodes->CanvasRectScreenSpace))
+    {
+        return;
+    }
+
+    const ImVector<ImVec2>& tessellation = GetLinkTessellation(link, cubic_bezier, start_pin.Type);
+    ImVector<ImVec2>&       points = GImNodes->LinkPoints;
+    points.resize(tessellation.size());
+    for (int i = 0; i < tessellation.size(); ++i)
+    {
+        points[i] = tessellation[i] + cubic_bezier.P0;
+    }
+
+#if IMGUI_VERSION_NUM < 18200
+    GImNodes->CanvasDrawList->AddPolyline(
+        points.Data, points.size(), link_color, false, GImNodes->Style.LinkThickness);
 #else
-    GImNodes->CanvasDrawList->AddBezierCubic(
+    GImNodes->CanvasDrawList->AddPolyline(
+        points.Data, points.size(), link_color, ImDrawFlags_None, GImNodes->Style.LinkThickness);
 #endif
-        cubic_bezier.P0,
-        cubic_bezier.P1,
-        cubic_bezier.P2,
-        cubic_bezier.P3,
-        link_color,
-        GImNodes->Style.LinkThickness,
-        cubic_bezier.NumSegments);
 }
 
 void BeginPinAttribute(
@@ -1860,7 +1901,7 @@ static void MiniMapDrawLink(ImNodesEditorContext& editor, const int link_idx)
         ScreenSpaceToMiniMapSpace(editor, start_pin.Pos),
         ScreenSpaceToMiniMapSpace(editor, end_pin.Pos),
         start_pin.Type,
-        GImNodes->Style.LinkLineSegmentsPerLength / editor.MiniMapScaling);
+        GImNodes->Style.LinkLineSegmentsPerLength);
 
     // It's possible for a link to be deleted in begin_link_interaction. A user
     // may detach a link, resulting in the link wire snapping to the mouse
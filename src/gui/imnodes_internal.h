@@ -194,7 +194,17 @@ struct ImLinkData
         ImU32 Base, Hovered, Selected;
     } ColorStyle;
 
-    ImLinkData(const int link_id) : Id(link_id), StartPinIdx(), EndPinIdx(), ColorStyle() {}
+    // Tessellated curve relative to its start point. Panning or moving both nodes doesn't change
+    // the shape, so the points are only recomputed when the end moves relative to the start.
+    ImVector<ImVec2> Tessellation;
+    ImVec2           TessellationDelta;
+    int              TessellationStartType;
+
+    ImLinkData(const int link_id)
+        : Id(link_id), StartPinIdx(), EndPinIdx(), ColorStyle(), Tessellation(),
+          TessellationDelta(), TessellationStartType(-1)
+    {
+    }
 };
 
 struct ImClickInteractionState
@@ -303,6 +313,7 @@ struct ImNodesContext
     ImVector<int> NodeIdxSubmissionOrder;
     ImVector<int> NodeIndicesOverlappingWithMouse;
     ImVector<int> OccludedPinIndices;
+    ImVector<ImVec2> LinkPoints; // scratch buffer to draw cached link tessellations
 
     // Canvas extents
     ImVec2 CanvasOriginScreenSpace;
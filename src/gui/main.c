@@ -7,6 +7,7 @@
 #include "db/thumbnails.h"
 #include "core/log.h"
 #include "core/signal.h"
+#include "core/trace.h"
 #include "core/version.h"
 #include "core/tools.h"
 #include "gui/gui.h"
@@ -27,6 +28,7 @@
 dt_gui_t vkdt = {0};
 
 int g_fullscreen = 0;
+static int g_input = 0; // an input callback ran since the main loop last waited
 
 // from a stackoverflow answer. get the monitor that currently covers most of
 // the window area.
@@ -127,6 +129,7 @@ toggle_fullscreen()
 static void
 key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
+  g_input = 1;
   const int grabbed = vkdt.wstate.grabbed;
   dt_view_keyboard(window, key, scancode, action, mods);
   if(!grabbed) // also don't pass on if we just ungrabbed
@@ -145,6 +148,7 @@ key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
 static void
 mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
 {
+  g_input = 1;
   dt_view_mouse_button(window, button, action, mods);
   if(!vkdt.wstate.grabbed)
     dt_gui_imgui_mouse_button(window, button, action, mods);
@@ -153,6 +157,7 @@ mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
 static void
 mouse_position_callback(GLFWwindow* window, double x, double y)
 {
+  g_input = 1;
   dt_view_mouse_position(window, x, y);
 }
 
@@ -165,6 +170,7 @@ window_close_callback(GLFWwindow* window)
 static void
 window_size_callback(GLFWwindow* window, int width, int height)
 {
+  g_input = 1;
   // window resized, need to rebuild our swapchain:
   dt_gui_recreate_swapchain();
   dt_gui_init_fonts();
@@ -179,6 +185,7 @@ window_pos_callback(GLFWwindow* window, int xpos, int ypos)
 static void
 char_callback(GLFWwindow* window, unsigned int c)
 {
+  g_input = 1;
   if(!vkdt.wstate.grabbed)
     dt_gui_imgui_character(window, c);
 }
@@ -186,6 +193,7 @@ char_callback(GLFWwindow* window, unsigned int c)
 static void
 scroll_callback(GLFWwindow *window, double xoff, double yoff)
 {
+  g_input = 1;
   dt_view_mouse_scrolled(window, xoff, yoff);
   if(!vkdt.wstate.grabbed)
     dt_gui_imgui_scrolled(window, xoff, yoff);
@@ -244,6 +252,7 @@ int main(int argc, char *argv[])
   dt_pipe_global_init();
   threads_global_init();
   dt_set_signal_handlers();
+  dt_trace_init();
 
   if(dt_gui_init())
   {
@@ -276,9 +285,16 @@ int main(int argc, char *argv[])
   // also we have a temporary thumbnails struct and background threads
   // to create thumbnails, if necessary.
   // only width/height will matter here
-  dt_thumbnails_init(&vkdt.thumbnail_gen, 400, 400, 0, 0);
-  dt_thumbnails_init(&vkdt.thumbnails, 400, 400, 3000, 1ul<<30);
+  dt_thumbnails_init(&vkdt.thumbnail_gen, 400, 400, 0, 0, dt_rc_get_int(&vkdt.rc, "gui/thumb_threads", 0), 0);
+  dt_thumbnails_init(&vkdt.thumbnails, 400, 400, 3000, 1ul<<30, 1, 0);
+  { // mid resolution tier for the full screen preview, rendered by its own background graph
+    const int size = CLAMP(dt_rc_get_int(&vkdt.rc, "gui/preview_size", 2048), 400, 8192);
+    const size_t heap = (size_t)CLAMP(dt_rc_get_int(&vkdt.rc, "gui/preview_heap_mb", 256), 16, 8192) << 20;
+    dt_thumbnails_init(&vkdt.previews, size, size, 64, heap, 1, "preview");
+  }
   dt_db_init(&vkdt.db);
+  dt_dircache_init(&vkdt.dircache);
+  vkdt.dircache.ufn = &dt_gui_wake_up; // redraw once a listing is read
   char *filename = 0;
   {
     char defpath[1024];
@@ -295,7 +311,7 @@ int main(int argc, char *argv[])
     vkdt.view_mode = s_view_lighttable;
     dt_db_load_directory(&vkdt.db, &vkdt.thumbnails, filename);
     dt_view_switch(s_view_lighttable);
-    dt_thumbnails_cache_collection(&vkdt.thumbnail_gen, &vkdt.db, &glfwPostEmptyEvent);
+    dt_thumbnails_cache_collection(&vkdt.thumbnail_gen, &vkdt.db, &dt_gui_wake_up);
   }
   else
   {
@@ -329,11 +345,22 @@ int main(int argc, char *argv[])
     // vkdt.graph_dev.runflags = s_graph_run_record_cmd_buf;
     if(vkdt.state.anim_playing) // should redraw because animation is playing?
       vkdt.wstate.busy = vkdt.state.anim_max_frame == -1 ? 3 : vkdt.state.anim_max_frame - vkdt.state.anim_frame + 1;
+    int idle = 0;
     if(vkdt.wstate.busy > 0) glfwPostEmptyEvent();
-    else vkdt.wstate.busy = 3;
+    else { vkdt.wstate.busy = 3; idle = 1; }
     // should probably consider this instead:
     // https://github.com/bvgastel/imgui/commits/imgui-2749
-    glfwWaitEvents();
+    g_input = 0;
+    __atomic_store_n(&vkdt.wstate.wake_waiting, 1, __ATOMIC_SEQ_CST);
+    if(__atomic_load_n(&vkdt.wstate.wake_pending, __ATOMIC_SEQ_CST))
+    { // background work wants a redraw. draw at most DT_GUI_WAKE_HZ frames
+      // per second for that, but input still wakes us up right away.
+      const double wait = 1.0/DT_GUI_WAKE_HZ - (dt_time() - vkdt.wstate.wake_time);
+      if(wait > 0.0) glfwWaitEventsTimeout(wait);
+      else glfwPollEvents();
+    }
+    else glfwWaitEvents();
+    __atomic_store_n(&vkdt.wstate.wake_waiting, 0, __ATOMIC_SEQ_CST);
     if(frame_limiter || (dt_log_global.mask & s_log_perf))
     { // artificially limit frames rate to frame_limiter milliseconds/frame as minimum.
       double end_rf = dt_time();
@@ -345,6 +372,11 @@ int main(int argc, char *argv[])
       }
       beg_rf = end_rf;
     }
+    // this frame shows everything background work finished so far. if that
+    // is all that happened, one frame does it, imgui has no input to settle.
+    if(__atomic_exchange_n(&vkdt.wstate.wake_pending, 0, __ATOMIC_SEQ_CST) && idle && !g_input)
+      vkdt.wstate.busy = 1;
+    vkdt.wstate.wake_time = dt_time();
 
     dt_gui_render_frame_imgui();
 
@@ -354,6 +386,8 @@ int main(int argc, char *argv[])
       dt_gui_recreate_swapchain();
 
     dt_view_process();
+    const char *trace = dt_trace_poll();
+    if(trace) dt_gui_notification("trace written to %s", trace);
     if(vkdt.graph_dev.gui_msg && vkdt.graph_dev.gui_msg[0]) dt_gui_notification(vkdt.graph_dev.gui_msg);
   }
   if(joystick_present) pthread_join(joystick_thread, 0);
@@ -368,8 +402,11 @@ out:
   threads_global_cleanup(); // join worker threads before killing their resources
   dt_thumbnails_cleanup(&vkdt.thumbnails);
   dt_thumbnails_cleanup(&vkdt.thumbnail_gen);
+  dt_thumbnails_cleanup(&vkdt.previews);
+  dt_dircache_cleanup(&vkdt.dircache);
   dt_gui_cleanup();
   dt_db_cleanup(&vkdt.db);
+  dt_db_recent_cleanup(&vkdt.db_recent);
   dt_pipe_global_cleanup();
   free(filename);
   exit(0);
@@ -191,6 +191,7 @@ extern "C" void dt_gui_init_fonts()
 extern "C" int dt_gui_init_imgui()
 {
   vkdt.wstate.lod = dt_rc_get_int(&vkdt.rc, "gui/lod", 1); // set finest lod by default
+  vkdt.wstate.lod_drag = CLAMP(dt_rc_get_int(&vkdt.rc, "gui/lod_drag", 4), 1, 16); // 1 switches it off
   // Setup Dear ImGui context
   ImGui::CreateContext();
   ImNodes::CreateContext();
@@ -279,6 +280,17 @@ extern "C" int dt_gui_init_imgui()
     if(qvk.surf_format.format == VK_FORMAT_A2R10G10B10_UNORM_PACK32 ||
        qvk.surf_format.format == VK_FORMAT_A2B10G10R10_UNORM_PACK32)
       bitdepth = 10;
+    if(qvk.surf_format.colorSpace == VK_COLOR_SPACE_EXTENDED_SRGB_LINEAR_EXT)
+    { // scRGB wants linear rec709 primaries, the compositor does the rest
+      const float rec2020_to_rec709[] = {
+         1.66022709, -0.58754775, -0.07283832,
+        -0.12455356,  1.13292608, -0.0083496,
+        -0.01815511, -0.100603  ,  1.11899813 };
+      for(int k=0;k<3;k++) gamma0[k] = gamma1[k] = 1.0f;
+      memcpy(rec2020_to_dspy0, rec2020_to_rec709, sizeof(rec2020_to_rec709));
+      memcpy(rec2020_to_dspy1, rec2020_to_rec709, sizeof(rec2020_to_rec709));
+      bitdepth = 16; // half floats don't need dithering
+    }
     ImGui_ImplVulkan_SetDisplayProfile(gamma0, rec2020_to_dspy0, gamma1, rec2020_to_dspy1, xpos1, bitdepth);
   }
 
@@ -5,6 +5,7 @@ extern "C"
 #include "pipe/modules/api.h"
 #include "pipe/graph-history.h"
 #include "pipe/graph-defaults.h"
+#include "core/trace.h"
 }
 #include "gui/render_view.hh"
 #include "gui/hotkey.hh"
@@ -86,11 +87,13 @@ static struct gui_state_data_t
 // goes here because the keyframe code depends on the above defines/hotkeys
 // could probably pass a function pointer instead.
 #include "gui/render_darkroom.hh"
+#include "gui/render_perf.hh"
 
 void dt_gui_set_lod(int lod)
 {
   // set graph output scale factor and
   // trigger complete pipeline rebuild
+  vkdt.wstate.lod_zoom = 0;
   if(lod > 1)
   {
     vkdt.graph_dev.output_wd = vkdt.state.center_wd / (lod-1);
@@ -281,6 +284,9 @@ abort:
     ImGui::PopStyleColor();
   } // end center view
 
+  dt_perf_sample();
+  if(vkdt.wstate.show_perf_overlay) dt_perf_render_panel();
+
   if(vkdt.wstate.dopesheet_view > 0.0f)
   { // draw dopesheet
     int win_x = vkdt.state.center_x,  win_y = vkdt.state.center_y + vkdt.state.center_ht - vkdt.wstate.dopesheet_view;
@@ -475,8 +481,8 @@ abort:
       {
         vkdt.graph_dev.frame = vkdt.state.anim_frame;
         vkdt.state.anim_no_keyframes = 0;  // (re-)enable keyframes
-        dt_graph_apply_keyframes(&vkdt.graph_dev); // rerun once
-        vkdt.graph_dev.runflags = s_graph_run_record_cmd_buf | s_graph_run_wait_done;
+        vkdt.graph_dev.runflags = s_graph_run_record_cmd_buf | s_graph_run_wait_done |
+          dt_graph_apply_keyframes(&vkdt.graph_dev); // rerun once
       }
       if(ImGui::IsItemHovered())
         dt_gui_set_tooltip("timeline navigation: set current frame.\n"
@@ -513,6 +519,8 @@ abort:
           ImHotKey::Edit(hk_darkroom, hk_darkroom_cnt, "edit hotkeys");
           if(ImGui::Button("toggle perf overlay", ImVec2(-1, 0)))
             vkdt.wstate.show_perf_overlay ^= 1;
+          if(ImGui::Button("dump trace", ImVec2(-1, 0)))
+            dt_trace_request_dump(); // written by the main loop
 
           if(ImGui::SliderInt("LOD", &vkdt.wstate.lod, 1, 16, "%d"))
           { // LOD switcher
@@ -623,6 +631,7 @@ abort:
      break;
   }
   dt_gui_dr_modals(); // draw modal windows for presets etc
+  vkdt.wstate.dragging = ImGui::IsAnyItemActive(); // darkroom_process() processes at coarse lod meanwhile
 }
 
 void render_darkroom_init()
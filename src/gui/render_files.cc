@@ -4,6 +4,8 @@ extern "C" {
 #include "gui/view.h"
 #include "core/fs.h"
 #include "core/strexpand.h"
+#include "db/hash.h"
+#include "pipe/graph.h"
 }
 #include "gui/render_view.hh"
 #include "gui/widget_filebrowser.hh"
@@ -34,6 +36,14 @@ void set_cwd(const char *dir, int up)
   dt_filebrowser_cleanup(&filebrowser); // make it re-read cwd
 }
 
+#define COPY_MAX_STREAMS 4
+#define COPY_BUFSIZE (4<<20)
+struct copy_job_t;
+struct copy_worker_t
+{ // every stream copies one file at a time and writes its thumbnail with its own graph
+  copy_job_t *job;
+  dt_graph_t graph;
+};
 struct copy_job_t
 { // copy contents of a folder
   char src[1000], dst[1000];
@@ -42,23 +52,82 @@ struct copy_job_t
   uint32_t move;  // set to non-zero to remove src after copy
   uint32_t abort;
   int taskid;
+  int workers;    // number of streams which did not clean up yet
+  copy_worker_t worker[COPY_MAX_STREAMS];
 };
-void copy_job_cleanup(void *arg)
-{ // task is done, every thread will call this (but we put only one)
-  copy_job_t *j = (copy_job_t *)arg;
+void copy_job_free(copy_job_t *j)
+{
   for(uint32_t i=0;i<j->cnt;i++) free(j->ent[i]);
   if(j->ent) free(j->ent);
+  j->ent = 0;
+}
+void copy_job_cleanup(void *arg)
+{ // task is done, every thread will call this with its worker, the last one frees the job
+  copy_worker_t *w = (copy_worker_t *)arg;
+  dt_graph_cleanup(&w->graph);
+  if(!__sync_sub_and_fetch(&w->job->workers, 1)) copy_job_free(w->job);
+}
+// moving deletes the original, so make sure the copy is good first: read the
+// source only once and hash it on the way, then compare to the copy as it is
+// read back from disk. returns zero on success.
+int copy_verified(const char *dst, const char *src)
+{
+  struct stat sb;
+  int fd0 = open(src, O_RDONLY), fd1 = -1, err = 1;
+  uint8_t *buf = (uint8_t *)malloc(COPY_BUFSIZE);
+  dt_hash_t h0, h1;
+  dt_hash_init(&h0, 0);
+  dt_hash_init(&h1, 0);
+  if(fd0 == -1 || !buf || fstat(fd0, &sb) == -1) goto copy_error;
+  if(sb.st_mode & S_IFDIR) { err = 0; goto copy_error; } // don't copy directories
+  if(-1 == (fd1 = open(dst, O_CREAT | O_RDWR | O_TRUNC, 0644))) goto copy_error;
+  posix_fadvise(fd0, 0, 0, POSIX_FADV_SEQUENTIAL);
+  for(ssize_t r;(r = read(fd0, buf, COPY_BUFSIZE));)
+  {
+    if(r < 0) goto copy_error;
+    dt_hash_update(&h0, buf, r);
+    for(ssize_t w=0,c;w<r;w+=c) if((c = write(fd1, buf+w, r-w)) <= 0) goto copy_error;
+  }
+  // drop the copy from the page cache, we want to see what landed on disk
+  if(fdatasync(fd1) || lseek(fd1, 0, SEEK_SET)) goto copy_error;
+  posix_fadvise(fd1, 0, 0, POSIX_FADV_DONTNEED);
+  for(ssize_t r;(r = read(fd1, buf, COPY_BUFSIZE));)
+  {
+    if(r < 0) goto copy_error;
+    dt_hash_update(&h1, buf, r);
+  }
+  err = h0.len != (uint64_t)sb.st_size || dt_hash_final(&h0) != dt_hash_final(&h1);
+copy_error:
+  if(fd0 >= 0) close(fd0);
+  if(fd1 >= 0) close(fd1);
+  free(buf);
+  return err;
 }
 void copy_job_work(uint32_t item, void *arg)
 {
-  copy_job_t *j = (copy_job_t *)arg;
+  copy_worker_t *w = (copy_worker_t *)arg;
+  copy_job_t *j = w->job;
   if(j->abort) return;
   char src[1300], dst[1300];
   snprintf(src, sizeof(src), "%s/%s", j->src, j->ent[item]->d_name);
   snprintf(dst, sizeof(dst), "%s/%s", j->dst, j->ent[item]->d_name);
-  if(fs_copy(dst, src)) j->abort = 2;
-  else if(j->move) fs_delete(src);
-  glfwPostEmptyEvent(); // redraw status bar
+  if(j->move ? copy_verified(dst, src) : fs_copy(dst, src))
+  {
+    j->abort = 2;
+    return;
+  }
+  if(j->move) fs_delete(src);
+  const size_t len = strlen(dst);
+  if(len > 4 && strcasecmp(dst+len-4, ".cfg") && dt_db_accept_filename(dst))
+  { // thumbnail while the other streams keep the card busy. raws only get their
+    // embedded preview here, the thumbnail workers replace it by the processed
+    // render once the collection is opened (and skip everything else).
+    char cfg[1310];
+    snprintf(cfg, sizeof(cfg), "%s.cfg", dst);
+    if(dt_thumbnails_cache_preview(&w->graph, &vkdt.thumbnail_gen, cfg) != VK_SUCCESS)
+      dt_thumbnails_cache_one(&w->graph, &vkdt.thumbnail_gen, cfg);
+  }
+  dt_gui_wake_up(); // redraw status bar
 }
 int copy_job(
     copy_job_t *j,
@@ -69,9 +138,27 @@ int copy_job(
   snprintf(j->src, sizeof(j->src), "%.*s", (int)sizeof(j->src)-1, src);
   snprintf(j->dst, sizeof(j->dst), "%.*s", (int)sizeof(j->dst)-1, dst);
   fs_mkdir(j->dst, 0777); // try and potentially fail to create destination directory
+  char rp[PATH_MAX]; // thumbnails are found by the canonical file name later on
+  if(realpath(j->dst, rp)) snprintf(j->dst, sizeof(j->dst), "%.*s", (int)sizeof(j->dst)-1, rp);
   j->cnt = scandir(src, &j->ent, 0, alphasort);
   if(j->cnt == -1u) return 2;
-  j->taskid = threads_task("copy", j->cnt, -1, j, copy_job_work, copy_job_cleanup);
+  const int streams = CLAMP(MIN(fs_copy_streams(j->src), fs_copy_streams(j->dst)), 1, MIN(COPY_MAX_STREAMS, (int)j->cnt));
+  j->taskid = -1;
+  j->workers = streams;
+  for(int k=0;k<streams;k++)
+  {
+    copy_worker_t *w = j->worker + k;
+    w->job = j;
+    dt_graph_init(&w->graph);
+    int res = threads_task_background("copy", j->cnt, j->taskid, w, copy_job_work, copy_job_cleanup);
+    if(res < 0)
+    { // no free task slot or all items picked already, go on with the streams we have
+      dt_graph_cleanup(&w->graph);
+      if(!__sync_sub_and_fetch(&j->workers, streams - k)) copy_job_free(j);
+      break;
+    }
+    j->taskid = res;
+  }
   return j->taskid;
 }
 
@@ -238,7 +325,7 @@ void render_files()
             dt_gui_set_tooltip("copy contents of %s\nto %s,\n%s",
                 filebrowser.cwd, pattern, copy_mode ? "delete original files after copying" : "keep original files");
         }
-        else if(job[k].cnt > 0 && threads_task_running(job[k].taskid))
+        else if(job[k].cnt > 0 && (threads_task_running(job[k].taskid) || job[k].workers))
         { // running
           if(ImGui::Button("abort")) job[k].abort = 1;
           ImGui::SameLine();
@@ -253,7 +340,7 @@ void render_files()
           }
           if(ImGui::IsItemHovered()) dt_gui_set_tooltip(
               job[k].abort == 1 ? "copy from %s aborted by user. click to reset" :
-             (job[k].abort == 2 ? "copy from %s incomplete. file system full?\nclick to reset" :
+             (job[k].abort == 2 ? "copy from %s incomplete. file system full or copy corrupt?\nclick to reset" :
               "copy from %s done. click to reset"),
              job[k].src);
           if(!job[k].abort)
@@ -319,7 +406,7 @@ void render_files()
     ImGui::Begin("files center", 0, ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoResize);
     dt_filebrowser(&filebrowser, 'f');
 
-    if(filebrowser.selected &&
+    if(filebrowser.selected[0] &&
       (ImGui::IsKeyPressed(ImGuiKey_GamepadFaceUp) ||
        ImGui::IsKeyPressed(ImGuiKey_Enter))) // triangle or enter
     { // open selected in lt without changing cwd
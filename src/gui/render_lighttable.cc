@@ -7,6 +7,7 @@ extern "C"
 #include "db/rc.h"
 #include "db/hash.h"
 #include "core/strexpand.h"
+#include "core/trace.h"
 #include "pipe/graph-defaults.h"
 }
 #include "gui/render_view.hh"
@@ -46,6 +47,7 @@ static ImHotKey::HotKey hk_lighttable[] = {
   {"label blue",      "toggle blue label",                          {ImGuiKey_F3}},
   {"label yellow",    "toggle yellow label",                        {ImGuiKey_F4}},
   {"label purple",    "toggle purple label",                        {ImGuiKey_F5}},
+  {"preview",         "toggle full screen preview of current image", {ImGuiKey_P}},
 };
 enum hotkey_names_t
 {
@@ -69,8 +71,63 @@ enum hotkey_names_t
   s_hotkey_label_3    = 17,
   s_hotkey_label_4    = 18,
   s_hotkey_label_5    = 19,
+  s_hotkey_preview    = 20,
 };
 
+struct lt_preview_t
+{ // full screen preview of the current image from the mid resolution tier vkdt.previews
+  int      on;
+  uint32_t imgid;  // image the background render has been requested for
+  int      gen;    // lt_preview_gen when we last tried to load it
+  int      frame;  // imgui frame the lighttable was last drawn
+};
+lt_preview_t lt_preview = {0, -1u, -1, -1};
+int lt_preview_gen = 0; // counts finished background renders
+
+void lt_preview_done()
+{ // called by the background threads of vkdt.previews
+  __atomic_add_fetch(&lt_preview_gen, 1, __ATOMIC_RELEASE);
+  dt_gui_wake_up();
+}
+
+uint32_t lt_preview_slot(uint32_t imgid)
+{ // the slot of vkdt.previews holding this image, or -1u
+  for(int i=1;i<vkdt.previews.thumb_max;i++)
+    if(vkdt.previews.thumb[i].imgid == imgid) return i;
+  return -1u;
+}
+
+void lighttable_hotkey_center(int hotkey)
+{ // lt hotkeys in same scope as center window (scroll)
+  switch(hotkey)
+  {
+    case s_hotkey_scroll_cur:
+      dt_gui_lt_scroll_current();
+      break;
+    case s_hotkey_scroll_end:
+      dt_gui_lt_scroll_bottom();
+      break;
+    case s_hotkey_scroll_top:
+      dt_gui_lt_scroll_top();
+      break;
+    case s_hotkey_duplicate:
+      dt_gui_lt_duplicate();
+      break;
+    case s_hotkey_rate_0: dt_gui_rate_0(); break;
+    case s_hotkey_rate_1: dt_gui_rate_1(); break;
+    case s_hotkey_rate_2: dt_gui_rate_2(); break;
+    case s_hotkey_rate_3: dt_gui_rate_3(); break;
+    case s_hotkey_rate_4: dt_gui_rate_4(); break;
+    case s_hotkey_rate_5: dt_gui_rate_5(); break;
+    case s_hotkey_label_1: dt_gui_label_1(); break;
+    case s_hotkey_label_2: dt_gui_label_2(); break;
+    case s_hotkey_label_3: dt_gui_label_3(); break;
+    case s_hotkey_label_4: dt_gui_label_4(); break;
+    case s_hotkey_label_5: dt_gui_label_5(); break;
+    default: break;
+  }
+}
+
 void render_lighttable_center(int hotkey)
 { // center image view
   { // assign star rating/colour labels via gamepad:
@@ -91,6 +148,7 @@ void render_lighttable_center(int hotkey)
           CLAMP(lbdir > 0 ? (vkdt.db.image[sel[i]].labels << 1) :
                             (vkdt.db.image[sel[i]].labels >> 1), 0, 8) : 1;
       }
+      if(rtdir || lbdir) dt_db_journal(&vkdt.db, sel, vkdt.db.selection_cnt);
     }
   }
   ImGuiStyle &style = ImGui::GetStyle();
@@ -116,6 +174,8 @@ void render_lighttable_center(int hotkey)
   clipper.Begin(lines, ht + 2*border + style.ItemSpacing.y);
   // a bit crude, but works: align thumbnail at pixel boundary:
   ImGui::GetCurrentWindow()->DC.CursorPos[0] = (int)ImGui::GetCurrentWindow()->DC.CursorPos[0];
+  // frames, images and decorations in separate channels, so the grid batches into few draws:
+  ImGui::GetWindowDrawList()->ChannelsSplit(3);
   while(clipper.Step())
   {
     dt_thumbnails_load_list(
@@ -124,13 +184,15 @@ void render_lighttable_center(int hotkey)
         vkdt.db.collection,
         MIN(clipper.DisplayStart * ipl, (int)vkdt.db.collection_cnt-1),
         MIN(clipper.DisplayEnd   * ipl, (int)vkdt.db.collection_cnt));
+    // let background thumbnail creation work on what we see first:
+    dt_thumbnails_cache_focus(&vkdt.thumbnail_gen, clipper.DisplayStart * ipl, clipper.DisplayEnd * ipl);
     for(int line=clipper.DisplayStart;line<clipper.DisplayEnd;line++)
     {
       int i = line * ipl;
       for(int k=0;k<ipl;k++)
       {
         uint32_t tid = vkdt.db.image[vkdt.db.collection[i]].thumbnail;
-        if(tid == -1u) tid = 0; // busybee
+        if(tid == -1u || tid >= (uint32_t)vkdt.thumbnails.thumb_max) tid = 0; // busybee
         if(vkdt.db.collection[i] == dt_db_current_imgid(&vkdt.db))
         {
           ImGui::PushStyleColor(ImGuiCol_Button, ImVec4(1.0, 1.0, 1.0, 1.0));
@@ -150,7 +212,8 @@ void render_lighttable_center(int hotkey)
             vkdt.db.collection[i],
             vkdt.thumbnails.thumb[tid].dset,
             ImVec2(w, h),
-            ImVec2(0,0), ImVec2(1,1),
+            ImVec2(vkdt.thumbnails.thumb[tid].uv0[0], vkdt.thumbnails.thumb[tid].uv0[1]),
+            ImVec2(vkdt.thumbnails.thumb[tid].uv1[0], vkdt.thumbnails.thumb[tid].uv1[1]),
             border,
             ImVec4(0.5f,0.5f,0.5f,1.0f),
             ImVec4(1.0f,1.0f,1.0f,1.0f),
@@ -208,34 +271,8 @@ void render_lighttable_center(int hotkey)
       }
     }
   }
-  // lt hotkeys in same scope as center window (scroll)
-  switch(hotkey)
-  {
-    case s_hotkey_scroll_cur:
-      dt_gui_lt_scroll_current();
-      break;
-    case s_hotkey_scroll_end:
-      dt_gui_lt_scroll_bottom();
-      break;
-    case s_hotkey_scroll_top:
-      dt_gui_lt_scroll_top();
-      break;
-    case s_hotkey_duplicate:
-      dt_gui_lt_duplicate();
-      break;
-    case s_hotkey_rate_0: dt_gui_rate_0(); break;
-    case s_hotkey_rate_1: dt_gui_rate_1(); break;
-    case s_hotkey_rate_2: dt_gui_rate_2(); break;
-    case s_hotkey_rate_3: dt_gui_rate_3(); break;
-    case s_hotkey_rate_4: dt_gui_rate_4(); break;
-    case s_hotkey_rate_5: dt_gui_rate_5(); break;
-    case s_hotkey_label_1: dt_gui_label_1(); break;
-    case s_hotkey_label_2: dt_gui_label_2(); break;
-    case s_hotkey_label_3: dt_gui_label_3(); break;
-    case s_hotkey_label_4: dt_gui_label_4(); break;
-    case s_hotkey_label_5: dt_gui_label_5(); break;
-    default: break;
-  }
+  ImGui::GetWindowDrawList()->ChannelsMerge();
+  lighttable_hotkey_center(hotkey);
   dt_gui_lt_scroll_basename(0); // clear basename scrolling state and set if it was requested
 
   // draw context sensitive help overlay
@@ -246,6 +283,13 @@ void render_lighttable_center(int hotkey)
 
 
 // export bg job stuff. put into api.hh?
+#define EXPORT_MAX_GRAPHS 4
+struct export_job_t;
+struct export_worker_t
+{ // every thread helping out with the job brings its own graph
+  export_job_t *job;
+  dt_graph_t graph;
+};
 struct export_job_t
 { // this memory belongs to the export thread and will not change behind its back.
   uint32_t *sel;
@@ -258,18 +302,24 @@ struct export_job_t
   uint8_t *pdata;
   uint32_t abort;
   int taskid;
-  dt_graph_t graph;
+  int workers; // number of workers which did not clean up yet
+  export_worker_t worker[EXPORT_MAX_GRAPHS];
 };
 void export_job_cleanup(void *arg)
-{ // task is done, every thread will call this (but we put only one)
-  export_job_t *j = (export_job_t *)arg;
+{ // task is done, every thread will call this with its worker, the last one frees the job
+  export_worker_t *w = (export_worker_t *)arg;
+  export_job_t *j = w->job;
+  dt_graph_cleanup(&w->graph);
+  if(__sync_sub_and_fetch(&j->workers, 1)) return;
   free(j->sel);
   free(j->pdata);
-  dt_graph_cleanup(&j->graph);
+  j->sel = 0;
+  j->pdata = 0;
 }
 void export_job_work(uint32_t item, void *arg)
 {
-  export_job_t *j = (export_job_t *)arg;
+  export_worker_t *w = (export_worker_t *)arg;
+  export_job_t *j = w->job;
   if(j->abort) return;
 
   char filename[PATH_MAX], infilename[PATH_MAX], filedir[PATH_MAX];
@@ -302,10 +352,24 @@ void export_job_work(uint32_t item, void *arg)
   param.output[0].mod        = j->output_module;
   param.output[0].p_pdata    = (char *)j->pdata;
   param.p_cfgfile = infilename;
-  if(dt_graph_export(&j->graph, &param))
+  if(dt_graph_export(&w->graph, &param))
     dt_gui_notification("export %s failed!\n", infilename);
-  dt_graph_reset(&j->graph);
-  glfwPostEmptyEvent(); // redraw status bar
+  dt_graph_reset(&w->graph); // keeps the modules, pipelines and source caches for the next image
+  dt_gui_wake_up(); // redraw status bar
+}
+static int
+export_job_graph_cnt(uint32_t cnt)
+{ // like vkdt-cli --batch, one graph per work queue if the memory budget allows
+  uint64_t avail = 0;
+  const VkPhysicalDeviceMemoryProperties *mp = &qvk.mem_properties;
+  for(uint32_t i=0;i<mp->memoryHeapCount;i++) if(mp->memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+  {
+    uint64_t budget, usage;
+    qvk_memory_budget(i, &budget, &usage);
+    avail = MAX(avail, budget > usage ? budget - usage : 0);
+  }
+  const int mem_cnt = avail / 2 / (1ul<<30); // leave half for the others, 1GB per full resolution export
+  return CLAMP(MIN(MIN(mem_cnt, threads_num() / 2), (int)cnt), 1, EXPORT_MAX_GRAPHS);
 }
 int export_job(
     export_job_t *j,
@@ -329,10 +393,42 @@ int export_job(
   size_t psize = dt_module_total_param_size(w->modid[w->format]);
   j->pdata = (uint8_t *)malloc(sizeof(uint8_t)*psize);
   memcpy(j->pdata, w->pdata[w->format], psize);
-  dt_graph_init(&j->graph);
   // TODO:
   // fs_mkdir(j->dst, 0777); // try and potentially fail to create destination directory
-  j->taskid = threads_task("export", j->cnt, -1, j, export_job_work, export_job_cleanup);
+  const int graph_cnt = export_job_graph_cnt(j->cnt);
+  j->taskid = -1;
+  j->workers = graph_cnt; // count down by the cleanup of every worker
+  for(int k=0;k<graph_cnt;k++)
+  { // the graphs take turns on the two work queues, so cpu side decoding and
+    // encoding of one image overlaps with the gpu processing another
+    export_worker_t *wk = j->worker + k;
+    wk->job = j;
+    dt_graph_init(&wk->graph);
+    wk->graph.queue       = (k & 1) ?  qvk.queue_work1       :  qvk.queue_work0;
+    wk->graph.queue_idx   = (k & 1) ?  qvk.queue_idx_work1   :  qvk.queue_idx_work0;
+    wk->graph.queue_mutex = (k & 1) ? &qvk.queue_work1_mutex : &qvk.queue_work0_mutex;
+    int res = threads_task_background("export", j->cnt, j->taskid, wk, export_job_work, export_job_cleanup);
+    if(res < 0)
+    { // no free task slot or all items picked already, go on with the workers we have
+      dt_graph_cleanup(&wk->graph);
+      if(k == 0)
+      {
+        free(j->sel);
+        free(j->pdata);
+        memset(j, 0, sizeof(*j));
+        return res;
+      }
+      if(!__sync_sub_and_fetch(&j->workers, graph_cnt - k))
+      { // the others are done already
+        free(j->sel);
+        free(j->pdata);
+        j->sel = 0;
+        j->pdata = 0;
+      }
+      break;
+    }
+    j->taskid = res;
+  }
   return j->taskid;
 }
 // end export bg job stuff
@@ -376,6 +472,8 @@ void render_lighttable_right_panel(int hotkey)
     if(ImGui::Button("hotkeys"))
       ImGui::OpenPopup("edit hotkeys");
     ImHotKey::Edit(hk_lighttable, sizeof(hk_lighttable)/sizeof(hk_lighttable[0]), "edit hotkeys");
+    if(ImGui::Button("dump trace"))
+      dt_trace_request_dump(); // written by the main loop
     ImGui::Unindent();
   }
 
@@ -389,13 +487,13 @@ void render_lighttable_right_panel(int hotkey)
     {
       vkdt.db.collection_sort = static_cast<dt_db_property_t>(sort_prop);
       dt_db_update_collection(&vkdt.db);
-      dt_thumbnails_cache_collection(&vkdt.thumbnail_gen, &vkdt.db, &glfwPostEmptyEvent);
+      dt_thumbnails_cache_collection(&vkdt.thumbnail_gen, &vkdt.db, &dt_gui_wake_up);
     }
     if(ImGui::Combo("filter", &filter_prop, dt_db_property_text))
     {
       vkdt.db.collection_filter = static_cast<dt_db_property_t>(filter_prop);
       dt_db_update_collection(&vkdt.db);
-      dt_thumbnails_cache_collection(&vkdt.thumbnail_gen, &vkdt.db, &glfwPostEmptyEvent);
+      dt_thumbnails_cache_collection(&vkdt.thumbnail_gen, &vkdt.db, &dt_gui_wake_up);
     }
     int filter_val = static_cast<int>(vkdt.db.collection_filter_val);
     if(filter_prop == s_prop_labels)
@@ -420,7 +518,7 @@ void render_lighttable_right_panel(int hotkey)
           filter_val ^= (1<<k);
           vkdt.db.collection_filter_val = static_cast<uint64_t>(filter_val);
           dt_db_update_collection(&vkdt.db);
-          dt_thumbnails_cache_collection(&vkdt.thumbnail_gen, &vkdt.db, &glfwPostEmptyEvent);
+          dt_thumbnails_cache_collection(&vkdt.thumbnail_gen, &vkdt.db, &dt_gui_wake_up);
         }
         if(ImGui::IsItemHovered())
           dt_gui_set_tooltip(k==0?"red":k==1?"green":k==2?"blue":k==3?"yellow":k==4?"purple":k==5?"video":"bracket");
@@ -437,7 +535,7 @@ void render_lighttable_right_panel(int hotkey)
       {
         filter_type[0] = 'i'; filter_type[1] = '-';
         dt_db_update_collection(&vkdt.db);
-        dt_thumbnails_cache_collection(&vkdt.thumbnail_gen, &vkdt.db, &glfwPostEmptyEvent);
+        dt_thumbnails_cache_collection(&vkdt.thumbnail_gen, &vkdt.db, &dt_gui_wake_up);
       }
       if(ImGui::IsItemHovered())
         dt_gui_set_tooltip("enter the responsible input module here, for instance\n"
@@ -452,8 +550,11 @@ void render_lighttable_right_panel(int hotkey)
       {
         vkdt.db.collection_filter_val = static_cast<uint64_t>(filter_val);
         dt_db_update_collection(&vkdt.db);
-        dt_thumbnails_cache_collection(&vkdt.thumbnail_gen, &vkdt.db, &glfwPostEmptyEvent);
+        dt_thumbnails_cache_collection(&vkdt.thumbnail_gen, &vkdt.db, &dt_gui_wake_up);
       }
+      if(filter_prop == s_prop_createdate && ImGui::IsItemHovered())
+        dt_gui_set_tooltip("leading digits of the create date YYYYMMDD,\n"
+                          "for instance 2023 or 202306 for june 2023");
     }
 
     if(ImGui::Button("open directory", size))
@@ -485,14 +586,15 @@ void render_lighttable_right_panel(int hotkey)
       if(((i & 3) != 3) && (i != vkdt.tag_cnt-1)) ImGui::SameLine();
     }
     ImGui::PopID();
-    // button to jump to original folder of selected image if it is a symlink
+    // button to jump to original folder of selected image if it is a symlink or comes from a tag index
     uint32_t main_imgid = dt_db_current_imgid(&vkdt.db);
     if(main_imgid != -1u)
     {
       dt_db_image_path(&vkdt.db, main_imgid, filename, sizeof(filename));
-      struct stat buf;
-      lstat(filename, &buf);
-      if(((buf.st_mode & S_IFMT)== S_IFLNK) && ImGui::Button("jump to original collection", ImVec2(-1, 0)))
+      struct stat buf = {0};
+      if(!vkdt.db.tag_index) lstat(filename, &buf);
+      if((vkdt.db.tag_index || (buf.st_mode & S_IFMT) == S_IFLNK) &&
+          ImGui::Button("jump to original collection", ImVec2(-1, 0)))
       {
         char *resolved = realpath(filename, 0);
         if(resolved)
@@ -517,6 +619,14 @@ void render_lighttable_right_panel(int hotkey)
     ImGui::Unindent();
   } // end collapsing header "recent collections"
 
+  if(dt_db_fileop_running(&vkdt.fileop))
+  { // deleting or duplicating in the background
+    const char *what[] = { "deleting", "duplicating", "pasting history" };
+    ImGui::Text("%s", what[vkdt.fileop.op]);
+    ImGui::SameLine();
+    ImGui::ProgressBar(dt_db_fileop_progress(&vkdt.fileop), ImVec2(-1, 0));
+  }
+
   if(vkdt.db.selection_cnt > 0 && ImGui::CollapsingHeader("selected images"))
   {
     ImGui::Indent();
@@ -547,7 +657,10 @@ void render_lighttable_right_panel(int hotkey)
       ImGui::SameLine();
       if(ImGui::Button("*really* delete image[s]", size))
       {
-        dt_db_remove_selected_images(&vkdt.db, &vkdt.thumbnails, 1);
+        if(dt_db_fileop_running(&vkdt.fileop))
+          dt_gui_notification("still busy with the last file operation!");
+        else
+          dt_db_remove_selected_images(&vkdt.db, &vkdt.thumbnails, &vkdt.fileop);
         really_delete = 0;
       }
       if(ImGui::IsItemHovered()) dt_gui_set_tooltip(
@@ -578,7 +691,7 @@ void render_lighttable_right_panel(int hotkey)
           &vkdt.thumbnail_gen,
           &vkdt.db,
           sel, vkdt.db.selection_cnt,
-          &glfwPostEmptyEvent);
+          &dt_gui_wake_up);
     }
 
     // ==============================================================
@@ -639,7 +752,7 @@ void render_lighttable_right_panel(int hotkey)
               &vkdt.thumbnail_gen,
               &vkdt.db,
               sel, 1,
-              &glfwPostEmptyEvent);
+              &dt_gui_wake_up);
           // stupid, but can't add by imgid (or else would be able to select images that you can't see in the current collection)
           int colid = dt_db_filename_colid(&vkdt.db, vkdt.db.image[sel[0]].filename);
           dt_db_selection_clear(&vkdt.db);
@@ -737,7 +850,7 @@ void render_lighttable_right_panel(int hotkey)
           &vkdt.thumbnail_gen,
           &vkdt.db,
           &main_imgid, 1,
-          &glfwPostEmptyEvent);
+          &dt_gui_wake_up);
     }
     if(ImGui::IsItemHovered()) dt_gui_set_tooltip(
         "align selected images for stacking");
@@ -754,24 +867,43 @@ void render_lighttable_right_panel(int hotkey)
     {
       text[0] = 0; text_end = text;
       const char *rccmd = dt_rc_get(&vkdt.rc, "gui/metadata/command", "/usr/bin/exiftool -l -createdate -aperture -shutterspeed -iso");
-      dt_sanitize_user_string((char*)rccmd); // be sure nothing evil is in here. we won't change the length so we don't care about const.
-      char cmd[PATH_MAX], imgpath[PATH_MAX];
-      snprintf(cmd, sizeof(cmd), "%s '", rccmd);
-      dt_db_image_path(&vkdt.db, vkdt.db.current_imgid, imgpath, sizeof(imgpath));
-      realpath(imgpath, cmd+strlen(cmd)); // use GNU extension: fill path even if it doesn't exist
-      size_t len = strnlen(cmd, sizeof(cmd));
-      if(len > 4)
+      if(!rccmd[0])
+      { // the exif the db reads itself, without running an external tool
+        dt_db_update_exif(&vkdt.db, vkdt.db.current_imgid);
+        const dt_image_t *img = vkdt.db.image + vkdt.db.current_imgid;
+        const uint64_t cd = img->createdate;
+        int len = snprintf(text, sizeof(text), "%s\n%s\n%04u-%02u-%02u %02u:%02u:%02u\n",
+            img->model, img->lens, (uint32_t)(cd/10000000000ul), (uint32_t)(cd/100000000ul%100), (uint32_t)(cd/1000000%100),
+            (uint32_t)(cd/10000%100), (uint32_t)(cd/100%100), (uint32_t)(cd%100));
+        if(img->exposure > 0.0f && img->exposure < 1.0f)
+          len += snprintf(text+len, sizeof(text)-len, "1/%.0fs ", 1.0f/img->exposure);
+        else if(img->exposure > 0.0f)
+          len += snprintf(text+len, sizeof(text)-len, "%.1fs ", img->exposure);
+        snprintf(text+len, sizeof(text)-len, "f/%.1f iso %.0f %.0fmm", img->aperture, img->iso, img->focal_length);
+        text_end = text + strnlen(text, sizeof(text));
+        imgid = vkdt.db.current_imgid;
+      }
+      else
       {
-        cmd[len-4] = '\''; // cut away .cfg
-        cmd[len-3] = 0;
-        FILE *f = popen(cmd, "r");
-        if(f)
+        dt_sanitize_user_string((char*)rccmd); // be sure nothing evil is in here. we won't change the length so we don't care about const.
+        char cmd[PATH_MAX], imgpath[PATH_MAX];
+        snprintf(cmd, sizeof(cmd), "%s '", rccmd);
+        dt_db_image_path(&vkdt.db, vkdt.db.current_imgid, imgpath, sizeof(imgpath));
+        realpath(imgpath, cmd+strlen(cmd)); // use GNU extension: fill path even if it doesn't exist
+        size_t len = strnlen(cmd, sizeof(cmd));
+        if(len > 4)
         {
-          len = fread(text, 1, sizeof(text), f);
-          while(!feof(f) && !ferror(f)) fgetc(f); // drain empty
-          text_end = text + len;
-          imgid = vkdt.db.current_imgid;
-          pclose(f);
+          cmd[len-4] = '\''; // cut away .cfg
+          cmd[len-3] = 0;
+          FILE *f = popen(cmd, "r");
+          if(f)
+          {
+            len = fread(text, 1, sizeof(text), f);
+            while(!feof(f) && !ferror(f)) fgetc(f); // drain empty
+            text_end = text + len;
+            imgid = vkdt.db.current_imgid;
+            pclose(f);
+          }
         }
       }
     }
@@ -805,7 +937,7 @@ void render_lighttable_right_panel(int hotkey)
         }
         if(ImGui::IsItemHovered()) dt_gui_set_tooltip("export current selection");
       }
-      else if(job[k].cnt > 0 && threads_task_running(job[k].taskid))
+      else if(job[k].cnt > 0 && (threads_task_running(job[k].taskid) || job[k].workers))
       { // running
         if(ImGui::Button("abort")) job[k].abort = 1;
         ImGui::SameLine();
@@ -829,7 +961,10 @@ void render_lighttable_right_panel(int hotkey)
     if(ImGui::IsKeyPressed(ImGuiKey_GamepadFaceRight)||
        ImGui::IsKeyPressed(ImGuiKey_Escape)||
        ImGui::IsKeyPressed(ImGuiKey_CapsLock))
-      dt_view_switch(s_view_files);
+    {
+      if(lt_preview.on) lt_preview.on = 0; // close the preview first
+      else dt_view_switch(s_view_files);
+    }
     if(ImGui::IsKeyPressed(ImGuiKey_Enter))
       if(dt_db_current_imgid(&vkdt.db) != -1u)
         dt_view_switch(s_view_darkroom);
@@ -839,19 +974,139 @@ void render_lighttable_right_panel(int hotkey)
   ImGui::End(); // lt right panel
 }
 
+void render_lighttable_preview(int hotkey)
+{ // full screen preview of the current image instead of the grid
+  ImGuiWindowFlags window_flags = ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoMove |
+    ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoBackground | ImGuiWindowFlags_NoScrollbar;
+  ImGui::SetNextWindowPos (ImVec2(
+        ImGui::GetMainViewport()->Pos.x + vkdt.state.center_x,
+        ImGui::GetMainViewport()->Pos.y + vkdt.state.center_y),  ImGuiCond_Always);
+  ImGui::SetNextWindowSize(ImVec2(vkdt.state.center_wd, vkdt.state.center_ht), ImGuiCond_Always);
+  ImGui::SetNextWindowViewport(ImGui::GetMainViewport()->ID);
+  ImGui::Begin("lighttable preview", 0, window_flags);
+
+  if(!dt_gui_imgui_input_blocked() && vkdt.db.collection_cnt)
+  { // step through the collection
+    const uint32_t colid = dt_db_current_colid(&vkdt.db);
+    int step = 0;
+    step -= ImGui::IsKeyPressed(ImGuiKey_LeftArrow)  || ImGui::IsKeyPressed(ImGuiKey_GamepadDpadLeft);
+    step += ImGui::IsKeyPressed(ImGuiKey_RightArrow) || ImGui::IsKeyPressed(ImGuiKey_GamepadDpadRight);
+    if(step && colid != -1u)
+    {
+      dt_db_selection_clear(&vkdt.db);
+      dt_db_selection_add(&vkdt.db, CLAMP((int)colid + step, 0, (int)vkdt.db.collection_cnt-1));
+    }
+  }
+
+  const uint32_t imgid = dt_db_current_imgid(&vkdt.db);
+  if(imgid < vkdt.db.image_cnt)
+  {
+    if(imgid != lt_preview.imgid)
+    { // render the current image first, then its neighbours in the background
+      const uint32_t colid = dt_db_current_colid(&vkdt.db);
+      uint32_t list[3] = {imgid}, cnt = 1;
+      if(colid != -1u && colid+1 < vkdt.db.collection_cnt) list[cnt++] = vkdt.db.collection[colid+1];
+      if(colid != -1u && colid > 0) list[cnt++] = vkdt.db.collection[colid-1];
+      dt_thumbnails_cache_list(&vkdt.previews, &vkdt.db, list, cnt, &lt_preview_done);
+      lt_preview.imgid = imgid;
+      lt_preview.gen   = -1;
+    }
+    const int gen = __atomic_load_n(&lt_preview_gen, __ATOMIC_ACQUIRE);
+    if(gen != lt_preview.gen)
+    { // (re)load whatever is in the cache by now, into the same slot if we had it
+      lt_preview.gen = gen;
+      char filename[PATH_MAX];
+      dt_db_image_path(&vkdt.db, imgid, filename, sizeof(filename));
+      uint32_t idx = lt_preview_slot(imgid);
+      if(dt_thumbnails_load_one(&vkdt.previews, filename, &idx) == VK_SUCCESS)
+        vkdt.previews.thumb[idx].imgid = imgid;
+    }
+
+    // draw the preview, or the small thumbnail until it is there:
+    const dt_thumbnail_t *th = 0;
+    const uint32_t idx = lt_preview_slot(imgid), tid = vkdt.db.image[imgid].thumbnail;
+    if(idx != -1u) th = vkdt.previews.thumb + idx;
+    else if(tid > 0 && tid < (uint32_t)vkdt.thumbnails.thumb_max) th = vkdt.thumbnails.thumb + tid;
+    if(th && th->wd && th->ht)
+    {
+      const float scale = MIN(vkdt.state.center_wd / (float)th->wd, vkdt.state.center_ht / (float)th->ht);
+      const float w = th->wd * scale, h = th->ht * scale;
+      ImGui::SetCursorPos(ImVec2((int)(0.5f*(vkdt.state.center_wd - w)), (int)(0.5f*(vkdt.state.center_ht - h))));
+      ImGui::Image(th->dset, ImVec2(w, h), ImVec2(th->uv0[0], th->uv0[1]), ImVec2(th->uv1[0], th->uv1[1]));
+      if(ImGui::IsItemHovered() && ImGui::IsMouseDoubleClicked(0))
+        dt_view_switch(s_view_darkroom);
+    }
+  }
+  lighttable_hotkey_center(hotkey);
+  ImGui::End(); // lt preview window
+}
+
+int compare_key(const void *a, const void *b)
+{
+  const uint64_t ka = *(const uint64_t *)a, kb = *(const uint64_t *)b;
+  return ka < kb ? -1 : ka > kb;
+}
+
+void fileop_refresh_thumbnails(const uint32_t *imgid, uint32_t cnt)
+{ // render the thumbnails in view first, then the ones closest to the view
+  uint32_t *colid = (uint32_t *)malloc(sizeof(uint32_t)*vkdt.db.image_cnt);
+  for(uint32_t i=0;i<vkdt.db.image_cnt;i++) colid[i] = -1u;
+  for(uint32_t i=0;i<vkdt.db.collection_cnt;i++) colid[vkdt.db.collection[i]] = i;
+  const uint64_t focus = __atomic_load_n(&vkdt.thumbnail_gen.focus, __ATOMIC_RELAXED);
+  const uint32_t beg = (uint32_t)focus, end = (uint32_t)(focus >> 32);
+  uint64_t *key = (uint64_t *)malloc(sizeof(uint64_t)*cnt);
+  uint32_t key_cnt = 0;
+  for(uint32_t i=0;i<cnt;i++) if(imgid[i] < vkdt.db.image_cnt)
+  { // distance to the visible range in the upper bits, image id in the lower
+    const uint32_t c = colid[imgid[i]];
+    const uint64_t dist = c == -1u ? -1u : c < beg ? beg - c : c >= end ? c - end + 1 : 0;
+    key[key_cnt++] = (dist << 32) | imgid[i];
+  }
+  qsort(key, key_cnt, sizeof(key[0]), compare_key);
+  uint32_t *list = (uint32_t *)colid; // reuse, we're done with the lookup
+  for(uint32_t i=0;i<key_cnt;i++) list[i] = (uint32_t)key[i];
+  if(key_cnt) dt_thumbnails_cache_list(&vkdt.thumbnail_gen, &vkdt.db, list, key_cnt, &dt_gui_wake_up);
+  free(key);
+  free(colid);
+}
+
+void fileop_poll()
+{ // finish a background deletion, duplication or paste
+  dt_db_fileop_t *job = &vkdt.fileop;
+  if(!job->cnt || dt_db_fileop_running(job)) return;
+  const char *what[] = { "delete", "duplicate", "paste history to" };
+  if(job->err) dt_gui_notification("could not %s %u images!", what[job->op], job->err);
+  if(job->op == s_fileop_paste && job->imgid) fileop_refresh_thumbnails(job->imgid, job->cnt);
+  const dt_db_fileop_op_t op = job->op;
+  dt_db_fileop_cleanup(job);
+  if(op == s_fileop_duplicate)
+  { // pick up the new .cfg files
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s", vkdt.db.dirname);
+    dt_gui_switch_collection(dir);
+  }
+}
+
 } // end anonymous namespace
 
 
 void render_lighttable()
 {
   int hotkey = ImHotKey::GetHotKey(hk_lighttable, sizeof(hk_lighttable)/sizeof(hk_lighttable[0]));
+  fileop_poll();
+  if(hotkey == s_hotkey_preview) lt_preview.on ^= 1;
+  if(hotkey == s_hotkey_preview || ImGui::GetFrameCount() != lt_preview.frame + 1)
+    lt_preview.imgid = -1u; // request again, coming back from darkroom the history may have changed
+  lt_preview.frame = ImGui::GetFrameCount();
   render_lighttable_right_panel(hotkey);
-  render_lighttable_center(hotkey);
+  if(lt_preview.on) render_lighttable_preview(hotkey);
+  else render_lighttable_center(hotkey);
 }
 
 void render_lighttable_init()
 {
   vkdt.wstate.copied_imgid = -1u; // reset to invalid
+  vkdt.fileop.ufn = &dt_gui_wake_up; // redraw the progress bar
   ImHotKey::Deserialise("lighttable", hk_lighttable, sizeof(hk_lighttable)/sizeof(hk_lighttable[0]));
 }
 
@@ -6,6 +6,7 @@ extern "C"
 #include "pipe/io.h"
 #include "pipe/graph-history.h"
 #include "pipe/graph-defaults.h"
+#include "pipe/graph-layout.h"
 #include "nodes.h"
 #include "db/hash.h"
 #include "core/fs.h"
@@ -18,6 +19,7 @@ extern "C"
 #include "widget_image.hh"
 #define KEYFRAME // empty define to disable hover/keyframe behaviour
 #include "render_darkroom.hh"
+#include "render_perf.hh"
 #include <stdint.h>
 
 static ImHotKey::HotKey hk_nodes[] = {
@@ -32,12 +34,25 @@ enum hotkey_names_t
   s_hotkey_module_add      = 1,
 };
 
+typedef struct nodes_layout_job_t
+{
+  dt_graph_layout_t layout; // snapshot of the graph, positions are written by the worker
+  uint64_t          hash;   // topology the layout was computed for
+  int               all;    // place all modules, not only the new ones
+  int               done;
+}
+nodes_layout_job_t;
+
 typedef struct gui_nodes_t
 {
   int do_layout;          // do initial auto layout
   int hotkey;
   int node_hovered_link;
   int dual_monitor;
+  int layout_all;         // user asked to lay out everything again
+  uint8_t layout_known[100]; // module has been placed in the editor
+  uint8_t layout_auto[100];  // module waits for the auto layout to place it
+  nodes_layout_job_t *layout_job; // running or finished layout, or 0
 }
 gui_nodes_t;
 gui_nodes_t nodes;
@@ -53,6 +68,8 @@ void render_nodes_module(dt_graph_t *g, int m)
     ImNodes::PushColorStyle(ImNodesCol_TitleBar, IM_COL32(10,10,10,255));
     ImNodes::PushColorStyle(ImNodesCol_TitleBarSelected, IM_COL32(10,10,10,255));
   }
+  else if(dt_perf_module_critical(m)) // most expensive path through the graph
+    ImNodes::PushColorStyle(ImNodesCol_TitleBar, IM_COL32(140,40,40,255));
   else
     ImNodes::PushColorStyle(ImNodesCol_TitleBar, IM_COL32(70,70,70,255));
   ImNodes::BeginNode(m);
@@ -60,6 +77,7 @@ void render_nodes_module(dt_graph_t *g, int m)
   ImNodes::BeginNodeTitleBar();
   ImGui::Text("%" PRItkn " %" PRItkn, dt_token_str(mod->name), dt_token_str(mod->inst));
   if(mod->disabled) ImGui::TextUnformatted("disabled");
+  else if(vkdt.wstate.show_perf_overlay) ImGui::Text("%.2f ms", dt_perf_module_time(m));
   ImNodes::EndNodeTitleBar();
 
   for(int c=0;c<mod->num_connectors;c++)
@@ -98,6 +116,113 @@ void render_nodes_module(dt_graph_t *g, int m)
   if(mod->disabled) for(int k=0;k<3;k++) ImNodes::PopColorStyle();
 }
 
+// place a module the first time it shows up: where the cfg says, or in a
+// temporary spot until the auto layout has found a place for it.
+static void render_nodes_place(dt_graph_t *g, int m, ImVec2 fallback)
+{
+  if(!g->module[m].name) { nodes.layout_known[m] = 0; return; }
+  if(nodes.layout_known[m] && !nodes.do_layout) return;
+  nodes.layout_known[m] = 1;
+  const dt_module_t *mod = g->module + m;
+  nodes.layout_auto[m] = mod->gui_x == 0 && mod->gui_y == 0;
+  ImNodes::SetNodeEditorSpacePos(m, nodes.layout_auto[m] ? fallback : ImVec2(mod->gui_x, mod->gui_y));
+}
+
+static uint64_t render_nodes_topology(const dt_graph_t *g)
+{
+  dt_hash_t h;
+  dt_hash_init(&h, g->num_modules);
+  for(uint32_t m=0;m<g->num_modules;m++)
+  {
+    dt_hash_update_u64(&h, g->module[m].name);
+    for(int c=0;c<g->module[m].num_connectors;c++)
+    {
+      const dt_connector_t *cn = g->module[m].connector + c;
+      dt_hash_update_u64(&h, ((uint64_t)(uint32_t)cn->connected_mi << 32) | (uint32_t)cn->connected_mc);
+    }
+  }
+  return dt_hash_final(&h);
+}
+
+static void render_nodes_layout_work(uint32_t item, void *arg)
+{
+  nodes_layout_job_t *job = (nodes_layout_job_t *)arg;
+  dt_graph_layout_run(&job->layout);
+  __atomic_store_n(&job->done, 1, __ATOMIC_RELEASE);
+  dt_gui_wake_up(); // apply it on the next frame
+}
+
+static void render_nodes_layout_apply(dt_graph_t *g, nodes_layout_job_t *job)
+{
+  const dt_graph_layout_t *l = &job->layout;
+  if(job->hash != render_nodes_topology(g)) return; // outdated, the next job will do
+  float off_all[2] = {0.0f};
+  int num_all = 0;
+  for(int m=0;m<l->num_vtx;m++)
+  { // where the placed modules are relative to the layout
+    if(l->skip[m] || nodes.layout_auto[m] || job->all) continue;
+    const ImVec2 pos = ImNodes::GetNodeGridSpacePos(m);
+    off_all[0] += pos.x - l->x[m];
+    off_all[1] += pos.y - l->y[m];
+    num_all++;
+  }
+  for(int k=0;k<2;k++) off_all[k] = num_all ? off_all[k] / num_all : l->gap;
+  for(int m=0;m<l->num_vtx;m++)
+  {
+    if(l->skip[m] || !(nodes.layout_auto[m] || job->all)) continue;
+    float off[2] = {0.0f};
+    int num = 0;
+    for(int e=0;e<l->num_edges && !job->all;e++)
+    { // land next to the placed neighbours, the rest of the graph may have been moved by hand
+      const int o = l->edge[2*e] == m ? l->edge[2*e+1] : l->edge[2*e+1] == m ? l->edge[2*e] : -1;
+      if(o < 0 || o == m || nodes.layout_auto[o]) continue;
+      const ImVec2 pos = ImNodes::GetNodeGridSpacePos(o);
+      off[0] += pos.x - l->x[o];
+      off[1] += pos.y - l->y[o];
+      num++;
+    }
+    for(int k=0;k<2;k++) off[k] = num ? off[k] / num : off_all[k];
+    ImNodes::SetNodeGridSpacePos(m, ImVec2(l->x[m] + off[0], l->y[m] + off[1]));
+    nodes.layout_auto[m] = 0;
+  }
+  if(job->all) ImNodes::EditorContextResetPanning(ImVec2(0, 0));
+}
+
+// collect finished layouts and start a new one if modules wait for a place.
+// the layout runs on the thread pool, large graphs don't block the gui.
+static void render_nodes_layout(dt_graph_t *g)
+{
+  nodes_layout_job_t *job = nodes.layout_job;
+  if(job)
+  {
+    if(!__atomic_load_n(&job->done, __ATOMIC_ACQUIRE)) return;
+    render_nodes_layout_apply(g, job);
+    dt_graph_layout_cleanup(&job->layout);
+    free(job);
+    nodes.layout_job = 0;
+  }
+  int want = nodes.layout_all;
+  for(uint32_t m=0;m<g->num_modules && !want;m++)
+    if(g->module[m].name && nodes.layout_auto[m]) want = 1;
+  if(!want) return;
+
+  job = (nodes_layout_job_t *)calloc(1, sizeof(*job));
+  dt_graph_layout_modules(&job->layout, g);
+  job->layout.gap = vkdt.state.center_ht * 0.03;
+  for(uint32_t m=0;m<g->num_modules;m++) if(!job->layout.skip[m])
+  { // nodes have been drawn by now, so we know their size
+    const ImVec2 dim = ImNodes::GetNodeDimensions(m);
+    job->layout.wd[m] = dim.x;
+    job->layout.ht[m] = dim.y;
+  }
+  job->hash = render_nodes_topology(g);
+  job->all  = nodes.layout_all;
+  nodes.layout_all = 0;
+  nodes.layout_job = job;
+  if(threads_task("layout", 1, -1, job, render_nodes_layout_work, 0) < 0)
+    render_nodes_layout_work(0, job); // no free slot, don't wait for one
+}
+
 void render_nodes_right_panel()
 {
   ImGui::SetNextWindowPos (ImVec2(
@@ -166,6 +291,8 @@ void render_nodes_right_panel()
           ImVec2 pos = ImNodes::GetNodeEditorSpacePos(m);
           ImVec2 dim = ImNodes::GetNodeDimensions(m);
           ImNodes::SetNodeEditorSpacePos(modid, ImVec2(pos.x, pos.y+1.2*dim.y));
+          vkdt.graph_dev.module[modid].gui_x = pos.x; // placed, keep it out of the auto layout
+          vkdt.graph_dev.module[modid].gui_y = pos.y+1.2*dim.y;
         }
         else
         {
@@ -209,6 +336,8 @@ void render_nodes_right_panel()
                   ImVec2 pos = ImNodes::GetNodeEditorSpacePos(nm[k]);
                   ImVec2 dim = ImNodes::GetNodeDimensions(nm[k]);
                   ImNodes::SetNodeEditorSpacePos(mab, ImVec2(pos.x-dim.x*1.2, pos.y));
+                  vkdt.graph_dev.module[mab].gui_x = pos.x-dim.x*1.2;
+                  vkdt.graph_dev.module[mab].gui_y = pos.y;
                 }
               }
             }
@@ -329,6 +458,12 @@ void render_nodes_right_panel()
       else if(!nodes.dual_monitor && ImGui::Button("dual monitor", ImVec2(-1, 0)))
         nodes.dual_monitor = 1;
     }
+    if(ImGui::Button("toggle perf overlay", ImVec2(-1, 0)))
+      vkdt.wstate.show_perf_overlay ^= 1;
+    if(ImGui::Button("auto layout", ImVec2(-1, 0)))
+      nodes.layout_all = 1;
+    if(ImGui::IsItemHovered())
+      dt_gui_set_tooltip("arrange all modules in layers from left to right");
     ImGui::Unindent();
   }
 
@@ -396,27 +531,13 @@ void render_nodes()
     mod_id[pos++] = mod_id[pos2];
     mod_id[pos2] = tmp;
     render_nodes_module(g, curr);
-    if(!g->module[curr].name) continue;
-    if(nodes.do_layout)
-    {
-      if(g->module[curr].gui_x == 0 && g->module[curr].gui_y == 0)
-        ImNodes::SetNodeEditorSpacePos(curr, ImVec2(nodew*(m+0.25), nodey));
-      else
-        ImNodes::SetNodeEditorSpacePos(curr, ImVec2(g->module[curr].gui_x, g->module[curr].gui_y));
-    }
+    render_nodes_place(g, curr, ImVec2(nodew*(m+0.25), nodey));
   }
 
   for(int m=pos;m<arr_cnt;m++)
   { // draw disconnected modules
     render_nodes_module(g, mod_id[m]);
-    if(!g->module[mod_id[m]].name) continue;
-    if(nodes.do_layout)
-    {
-      if(g->module[mod_id[m]].gui_x == 0 && g->module[mod_id[m]].gui_y == 0)
-        ImNodes::SetNodeEditorSpacePos(mod_id[m], ImVec2(nodew*(m+0.25-pos), 2*nodey));
-      else
-        ImNodes::SetNodeEditorSpacePos(mod_id[m], ImVec2(g->module[mod_id[m]].gui_x, g->module[mod_id[m]].gui_y));
-    }
+    render_nodes_place(g, mod_id[m], ImVec2(nodew*(m+0.25-pos), 2*nodey));
   }
   ImNodes::PopAttributeFlag();
 
@@ -446,6 +567,7 @@ void render_nodes()
   ImNodes::MiniMap(0.2f, ImNodesMiniMapLocation_TopRight);
   ImNodes::EndNodeEditor();
   ImNodes::PopStyleVar(3);
+  render_nodes_layout(g);
 
   int lid = 0, mid = -1;
   nodes.node_hovered_link = -1;
@@ -506,6 +628,8 @@ void render_nodes()
 
   if(nodes.do_layout) nodes.do_layout = 0;
 
+  dt_perf_sample();
+  if(vkdt.wstate.show_perf_overlay) dt_perf_render_panel();
   render_nodes_right_panel();
 
   switch(nodes.hotkey)
@@ -538,6 +662,9 @@ extern "C" int nodes_enter()
   nodes.do_layout = 1; // assume bad initial auto layout
   nodes.node_hovered_link = -1;
   nodes.do_layout = 2; // ask to read positions
+  nodes.layout_all = 0;
+  memset(nodes.layout_known, 0, sizeof(nodes.layout_known));
+  memset(nodes.layout_auto,  0, sizeof(nodes.layout_auto));
   // make sure we process once:
   vkdt.graph_dev.runflags = s_graph_run_record_cmd_buf;
   return 0;
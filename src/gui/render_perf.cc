@@ -0,0 +1,189 @@
+// the performance panel of darkroom mode and the node editor
+extern "C"
+{
+#include "gui/gui.h"
+#include "pipe/graph.h"
+#include "pipe/modules/api.h"
+#include "db/thumbnails.h"
+#include "qvk/qvk.h"
+}
+#include "gui/render_perf.hh"
+#include "imgui.h"
+#include <stdio.h>
+#include <string.h>
+
+namespace { // anonymous namespace
+
+#define PERF_RUNS    64  // history length
+#define PERF_MODULES 256 // modules beyond this are not tracked
+
+typedef struct perf_t
+{
+  uint64_t last_t0;                     // first time stamp of the last sampled run, to detect new ones
+  int      num_modules;                 // history is reset if the graph changes
+  int      run_cnt;
+  int      offset;                      // next slot in the ring buffers
+  float    total[PERF_RUNS];            // gpu time of the whole run in ms
+  float    ms[PERF_MODULES][PERF_RUNS]; // gpu time per module
+  float    avg[PERF_MODULES];
+  float    path[PERF_MODULES];          // cost of the most expensive path ending here
+  int      pred[PERF_MODULES];          // and the module it came from
+  uint8_t  state[PERF_MODULES];         // 0 not visited, 1 in progress, 2 done
+  uint8_t  critical[PERF_MODULES];
+}
+perf_t;
+perf_t perf;
+
+float
+path_cost(dt_graph_t *g, int m)
+{
+  if(perf.state[m] == 2) return perf.path[m];
+  perf.state[m] = 1;
+  float best = 0.0f;
+  perf.pred[m] = -1;
+  for(int c=0;c<g->module[m].num_connectors;c++)
+  {
+    const dt_connector_t *cn = g->module[m].connector + c;
+    const int mi = cn->connected_mi;
+    if(!dt_connector_input(cn) || mi < 0 || mi >= perf.num_modules || !g->module[mi].name) continue;
+    if(perf.state[mi] == 1) continue; // cycle via feedback connector, don't follow
+    const float cost = path_cost(g, mi);
+    if(cost > best || perf.pred[m] < 0)
+    {
+      best = cost;
+      perf.pred[m] = mi;
+    }
+  }
+  perf.path[m] = best + perf.avg[m];
+  perf.state[m] = 2;
+  return perf.path[m];
+}
+
+void
+heap_bar(const char *name, const dt_vkalloc_t *a)
+{
+  const double mb = 1.0/(1024.0*1024.0);
+  char text[128];
+  snprintf(text, sizeof(text), "%s %.0f/%.0f MB, peak %.0f MB", name, a->rss*mb, a->vmsize*mb, a->peak_rss*mb);
+  ImGui::ProgressBar(a->vmsize ? a->rss/(double)a->vmsize : 0.0f, ImVec2(-1, 0), text);
+}
+
+} // end anonymous namespace
+
+void dt_perf_sample()
+{
+  dt_graph_t *g = &vkdt.graph_dev;
+  g->read_queries = vkdt.wstate.show_perf_overlay;
+  if(!g->read_queries) return;
+  const dt_graph_query_t *q = g->query + g->ring_done;
+  if(!q->cnt || q->pool_results[0] == perf.last_t0) return;
+  perf.last_t0 = q->pool_results[0];
+
+  const int num_modules = MIN(g->num_modules, (uint32_t)PERF_MODULES);
+  if(num_modules != perf.num_modules)
+  {
+    memset(&perf, 0, sizeof(perf));
+    perf.last_t0 = q->pool_results[0];
+    perf.num_modules = num_modules;
+  }
+  const int s = perf.offset;
+  for(int m=0;m<num_modules;m++) perf.ms[m][s] = 0.0f;
+  for(uint32_t i=0;i+1<q->cnt;i+=2)
+  {
+    if(q->nid[i] >= g->num_nodes) continue;
+    const int m = g->node[q->nid[i]].module - g->module;
+    if(m < 0 || m >= num_modules) continue;
+    perf.ms[m][s] += (q->pool_results[i+1] - q->pool_results[i]) * 1e-6 * qvk.ticks_to_nanoseconds;
+  }
+  perf.total[s] = q->last_frame_duration;
+  perf.offset = (s + 1) % PERF_RUNS;
+  perf.run_cnt = MIN(perf.run_cnt + 1, PERF_RUNS);
+
+  for(int m=0;m<num_modules;m++)
+  {
+    float sum = 0.0f;
+    for(int r=0;r<perf.run_cnt;r++) sum += perf.ms[m][r];
+    perf.avg[m] = sum / perf.run_cnt;
+    perf.state[m] = perf.critical[m] = 0;
+  }
+  int end = -1;
+  for(int m=0;m<num_modules;m++)
+  {
+    if(!g->module[m].name) continue;
+    if(path_cost(g, m) > (end < 0 ? 0.0f : perf.path[end])) end = m;
+  }
+  for(int m=end;m>=0&&!perf.critical[m];m=perf.pred[m]) perf.critical[m] = 1;
+}
+
+float dt_perf_module_time(int m)
+{
+  if(m < 0 || m >= perf.num_modules) return 0.0f;
+  return perf.avg[m];
+}
+
+int dt_perf_module_critical(int m)
+{
+  if(!vkdt.wstate.show_perf_overlay || m < 0 || m >= perf.num_modules) return 0;
+  return perf.critical[m];
+}
+
+void dt_perf_render_panel()
+{
+  dt_graph_t *g = &vkdt.graph_dev;
+  ImGui::SetNextWindowPos(ImVec2(vkdt.state.center_x + 0.6f*vkdt.state.center_wd, vkdt.state.center_y), ImGuiCond_FirstUseEver);
+  ImGui::SetNextWindowSize(ImVec2(0.4f*vkdt.state.center_wd, 0.6f*vkdt.state.center_ht), ImGuiCond_FirstUseEver);
+  bool open = true;
+  if(!ImGui::Begin("performance", &open))
+  {
+    ImGui::End();
+    if(!open) vkdt.wstate.show_perf_overlay = 0;
+    return;
+  }
+
+  float sum = 0.0f, peak = 0.0f;
+  for(int r=0;r<perf.run_cnt;r++)
+  {
+    sum += perf.total[r];
+    peak = MAX(peak, perf.total[r]);
+  }
+  ImGui::Text("gpu %.2f ms last, %.2f ms average over %d runs",
+      perf.total[(perf.offset + PERF_RUNS-1) % PERF_RUNS], perf.run_cnt ? sum/perf.run_cnt : 0.0f, perf.run_cnt);
+
+  // modules sorted by their average time, critical path in the plot colour
+  int order[PERF_MODULES], cnt = 0;
+  for(int m=0;m<perf.num_modules;m++)
+  {
+    if(!g->module[m].name || perf.avg[m] <= 0.0f) continue;
+    int i = cnt++;
+    for(;i>0&&perf.avg[order[i-1]]<perf.avg[m];i--) order[i] = order[i-1];
+    order[i] = m;
+  }
+  const ImVec2 size(0.5f*ImGui::GetContentRegionAvail().x, ImGui::GetTextLineHeight());
+  for(int i=0;i<cnt;i++)
+  {
+    const int m = order[i];
+    char label[64];
+    snprintf(label, sizeof(label), "%" PRItkn " %" PRItkn " %6.2f ms",
+        dt_token_str(g->module[m].name), dt_token_str(g->module[m].inst), perf.avg[m]);
+    ImGui::PushID(m);
+    if(perf.critical[m]) ImGui::PushStyleColor(ImGuiCol_PlotHistogram, ImGui::GetColorU32(ImGuiCol_PlotHistogramHovered));
+    ImGui::PlotHistogram("", perf.ms[m], perf.run_cnt, perf.run_cnt < PERF_RUNS ? 0 : perf.offset, 0, 0.0f, peak, size);
+    if(perf.critical[m]) ImGui::PopStyleColor();
+    ImGui::SameLine();
+    ImGui::TextUnformatted(label);
+    ImGui::PopID();
+  }
+
+  ImGui::Separator();
+  heap_bar("images",  &g->heap);
+  heap_bar("buffers", &g->heap_ssbo);
+  heap_bar("staging", &g->heap_staging);
+  int used = 0;
+  for(int i=0;i<vkdt.thumbnails.thumb_max;i++) used += vkdt.thumbnails.thumb[i].imgid != -1u;
+  char text[128];
+  snprintf(text, sizeof(text), "thumbnails %d/%d, %.0f MB", used, vkdt.thumbnails.thumb_max,
+      vkdt.thumbnails.page_cnt * vkdt.thumbnails.page_size / (1024.0*1024.0));
+  ImGui::ProgressBar(vkdt.thumbnails.thumb_max ? used/(float)vkdt.thumbnails.thumb_max : 0.0f, ImVec2(-1, 0), text);
+  ImGui::End();
+  if(!open) vkdt.wstate.show_perf_overlay = 0;
+}
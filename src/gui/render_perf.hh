@@ -0,0 +1,17 @@
+#pragma once
+// performance panel: per module gpu times of the last runs, memory use of the
+// heaps and the critical path through the graph. the samples are taken from
+// the timestamp queries of vkdt.graph_dev, which are only read back while
+// the panel is shown (vkdt.wstate.show_perf_overlay).
+
+// call once per gui frame, picks up the timings of a new run, if any
+void dt_perf_sample();
+
+// draw the panel as a window on top of the center view
+void dt_perf_render_panel();
+
+// gpu milliseconds of module m averaged over the recorded runs
+float dt_perf_module_time(int m);
+
+// non-zero if module m lies on the most expensive path from a source to a sink
+int dt_perf_module_critical(int m);
@@ -29,6 +29,23 @@ inline float frame_to_screen(int f, dt_graph_t *g, ImRect bb)
   return CLAMP(bb.Min[0] + (bb.Max[0]-bb.Min[0]) * f / (float)g->frame_cnt, bb.Min[0], bb.Max[0]);
 }
 
+// left click on a line moves the animation time, keep the button pressed to
+// scrub. the line is the active item meanwhile, so render_darkroom() counts
+// this as dragging and darkroom_process() runs the frames at gui/lod_drag.
+inline void
+dt_dopesheet_scrub(ImGuiID id, dt_graph_t *g, const ImRect &bb, int on_key)
+{
+  if(ImGui::IsItemClicked(0))
+  {
+    dt_gui_dr_anim_seek(screen_to_frame(ImGui::GetMousePos().x, g, bb));
+    if(!on_key) ImGui::SetActiveID(id, ImGui::GetCurrentWindow()); // leave keyframes to be dragged
+  }
+  if(ImGui::GetActiveID() != id) return;
+  if(!ImGui::IsMouseDown(0)) { ImGui::ClearActiveID(); return; }
+  const int f = screen_to_frame(ImGui::GetMousePos().x, g, bb);
+  if(f != g->frame) dt_gui_dr_anim_seek(f);
+}
+
 inline float
 dt_draw_param_line(
     dt_module_t *mod,
@@ -57,8 +74,12 @@ dt_draw_param_line(
       {
         ImGui::ItemSize(bb);
         if (!ImGui::ItemAdd(bb, id)) return 0.0f;
-        if(ImGui::IsItemClicked(0)) // left click: move animation time
-          dt_gui_dr_anim_seek(screen_to_frame(ImGui::GetMousePos().x, mod->graph, bb));
+        int on_key = 0;
+        for(uint32_t j=k;j<mod->keyframe_cnt;j++)
+          if(mod->keyframe[j].param == mod->so->param[p]->name &&
+             fabsf(ImGui::GetMousePos().x - frame_to_screen(mod->keyframe[j].frame, mod->graph, bb)) <= ht/2.0)
+            on_key = 1;
+        dt_dopesheet_scrub(id, mod->graph, bb, on_key);
         ImGui::SameLine();
         char text[60];
         window->DrawList->AddRectFilled(bb.Min, bb.Max, ImGui::GetColorU32(ImGuiCol_Button));
@@ -89,10 +110,12 @@ dt_draw_param_line(
       { // drag finished
         mod->keyframe[k].frame = screen_to_frame(ImGui::GetMousePos().x, mod->graph, bb);
         drag_k = drag_mod = -1u;
+        dt_gui_dr_anim_keyframes_changed(mod);
       }
       if(ImGui::IsItemClicked(1))
       { // right click: delete this keyframe by copying the last one over it and decreasing keyframe_cnt
         mod->keyframe[k--] = mod->keyframe[--mod->keyframe_cnt];
+        dt_gui_dr_anim_keyframes_changed(mod);
       }
       ImGui::SameLine();
     }
@@ -201,8 +224,7 @@ dt_dopesheet()
     const ImRect bb(ImVec2(cp[0]+(int)(0.12*win_w), cp[1]), ImVec2(cp[0] + win_w, cp[1] + ht));
     ImGui::ItemSize(bb);
     ImGui::ItemAdd(bb, id);
-    if(ImGui::IsItemClicked(0)) // left click: move animation time
-      dt_gui_dr_anim_seek(screen_to_frame(ImGui::GetMousePos().x, &vkdt.graph_dev, bb));
+    dt_dopesheet_scrub(id, &vkdt.graph_dev, bb, 0);
     ImGui::SameLine();
     const char *text = "timeline";
     window->DrawList->AddRectFilled(bb.Min, bb.Max, ImGui::GetColorU32(ImGuiCol_Button));
@@ -7,9 +7,11 @@
 struct dt_filebrowser_widget_t
 {
   char cwd[PATH_MAX+100];  // current working directory
-  struct dirent **ent;     // cached directory entries
-  int ent_cnt;             // number of cached directory entries
-  const char *selected;    // points to selected file name ent->d_name
+  int *ent;                // filtered and sorted indices into the cached listing of cwd
+  int ent_cnt;             // number of filtered entries
+  uint64_t stamp;          // stamp of the listing ent was made from
+  char mode;               // mode ent was made for
+  char selected[260];      // selected file name or empty
   int selected_type;       // copy of d_type
 };
 
@@ -26,34 +28,20 @@ inline void
 dt_filebrowser_cleanup(
     dt_filebrowser_widget_t *w)
 {
-  for(int i=0;i<w->ent_cnt;i++)
-    free(w->ent[i]);
   free(w->ent);
   w->ent_cnt = 0;
   w->ent = 0;
-  w->selected = 0;
+  w->selected[0] = 0;
   w->selected_type = 0;
+  dt_dircache_invalidate(&vkdt.dircache, w->cwd);
 }
 
 namespace {
 
-int dt_filebrowser_sort_dir_first(const struct dirent **a, const struct dirent **b)
-{
-  if((*a)->d_type == DT_DIR && (*b)->d_type != DT_DIR) return 0;
-  if((*a)->d_type != DT_DIR && (*b)->d_type == DT_DIR) return 1;
-  return strcmp((*a)->d_name, (*b)->d_name);
-}
-
-int dt_filebrowser_filter_dir(const struct dirent *d)
-{
-  if(d->d_name[0] == '.' && d->d_name[1] != '.') return 0; // filter out hidden files
-  if(d->d_type != DT_DIR) return 0; // filter out non-dirs too
-  return 1;
-}
-
-int dt_filebrowser_filter_file(const struct dirent *d)
+int dt_filebrowser_filter(const dt_dircache_entry_t *d, const char mode)
 {
-  if(d->d_name[0] == '.' && d->d_name[1] != '.') return 0; // filter out hidden files
+  if(d->name[0] == '.' && d->name[1] != '.') return 0; // filter out hidden files
+  if(mode == 'd' && d->type != DT_DIR) return 0; // filter out non-dirs too
   return 1;
 }
 
@@ -65,18 +53,18 @@ dt_filebrowser(
     const char               mode) // 'f' or 'd'
 {
   if(w->cwd[0] == 0) w->cwd[0] = '/';
-  if(!w->ent)
-  { // no cached entries, scan directory:
-    w->ent_cnt = scandir(w->cwd, &w->ent,
-        mode == 'd' ?
-        &dt_filebrowser_filter_dir :
-        &dt_filebrowser_filter_file,
-        &dt_filebrowser_sort_dir_first);
-    if(w->ent_cnt == -1)
-    {
-      w->ent = 0;
-      w->ent_cnt = 0;
-    }
+  // the listing is read in the background and only when the directory changed:
+  const dt_dircache_list_t *l = dt_dircache_get(&vkdt.dircache, w->cwd);
+  if(!w->ent || w->stamp != l->stamp || w->mode != mode)
+  { // filter the new listing, directories first. it comes sorted by name.
+    w->ent = (int *)realloc(w->ent, sizeof(int)*MAX(1, l->cnt));
+    w->ent_cnt = 0;
+    for(int dir=1;dir>=0;dir--)
+      for(uint32_t i=0;i<l->cnt;i++)
+        if((l->ent[i].type == DT_DIR) == dir && dt_filebrowser_filter(l->ent+i, mode))
+          w->ent[w->ent_cnt++] = i;
+    w->stamp = l->stamp;
+    w->mode  = mode;
   }
 
   // print cwd
@@ -88,28 +76,29 @@ dt_filebrowser(
   ImGui::PushFont(dt_gui_imgui_get_font(1));
   for(int i=0;i<w->ent_cnt;i++)
   {
+    const dt_dircache_entry_t *e = l->ent + w->ent[i];
     if(i == 0 && ImGui::IsWindowAppearing()) ImGui::SetKeyboardFocusHere();
     char name[260];
     snprintf(name, sizeof(name), "%s %s",
-        w->ent[i]->d_name,
-        w->ent[i]->d_type == DT_DIR ? "/":"");
-    int selected = w->ent[i]->d_name == w->selected;
+        e->name,
+        e->type == DT_DIR ? "/":"");
+    int selected = !strcmp(e->name, w->selected);
     if(selected && ImGui::IsWindowAppearing()) ImGui::SetKeyboardFocusHere();
     int select = ImGui::Selectable(name, selected, ImGuiSelectableFlags_AllowDoubleClick|ImGuiSelectableFlags_DontClosePopups);
     select |= ImGui::IsItemFocused(); // has key/gamepad focus?
     if(select)
     {
-      w->selected = w->ent[i]->d_name; // mark as selected
-      w->selected_type = w->ent[i]->d_type;
+      snprintf(w->selected, sizeof(w->selected), "%s", e->name); // mark as selected
+      w->selected_type = e->type;
       if((ImGui::IsKeyPressed(ImGuiKey_GamepadFaceDown) ||
           ImGui::IsKeyPressed(ImGuiKey_Space) ||
           ImGui::IsMouseDoubleClicked(0)) && 
-          w->ent[i]->d_type == DT_DIR)
+          e->type == DT_DIR)
       { // directory double-clicked
         // change cwd by appending to the string
         int len = strnlen(w->cwd, sizeof(w->cwd));
         char *c = w->cwd;
-        if(!strcmp(w->ent[i]->d_name, ".."))
+        if(!strcmp(e->name, ".."))
         { // go up one dir
           c += len;
           *(--c) = 0;
@@ -117,10 +106,11 @@ dt_filebrowser(
         }
         else
         { // append dir name
-          snprintf(c+len, sizeof(w->cwd)-len-1, "%s/", w->ent[i]->d_name);
+          snprintf(c+len, sizeof(w->cwd)-len-1, "%s/", e->name);
         }
-        // and then clean up the dirent cache
+        // and then clean up the filtered entries
         dt_filebrowser_cleanup(w);
+        break; // the listing of the old cwd is not ours any more
       }
     }
   }
@@ -68,19 +68,21 @@ filteredlist(
   int ok = 0;
   int pick = -1, local = 0;
 #define FREE_ENT do {\
-  for(int i=0;i<ent_cnt;i++) free(ent[i]);\
-  for(int i=0;i<ent_local_cnt;i++) free(ent_local[i]);\
-  if(desc)       for(int i=0;i<ent_cnt;i++) free(desc[i]);\
-  if(desc_local) for(int i=0;i<ent_cnt;i++) free(desc_local[i]);\
+  if(desc)       for(int i=0;i<desc_cnt;i++) free(desc[i]);\
+  if(desc_local) for(int i=0;i<desc_local_cnt;i++) free(desc_local[i]);\
   free(desc); free(desc_local); \
-  desc = desc_local = 0; \
-  free(ent_local); ent_local = 0; ent_local_cnt = 0;\
-  free(ent); ent = 0; ent_cnt = 0; } while(0)
-  static struct dirent **ent = 0, **ent_local = 0;
-  static int ent_cnt = 0, ent_local_cnt = 0;
+  desc = desc_local = 0; desc_cnt = desc_local_cnt = 0;\
+  free(match); free(match_local); match = match_local = 0;\
+  match_cnt = match_local_cnt = 0; stamp = stamp_local = 0; } while(0)
+  // the listings are owned by the directory cache, we only keep what we derived from them:
   static char dirname[PATH_MAX+20];
   static char dirname_local[PATH_MAX+20];
   static char **desc = 0, **desc_local = 0;
+  static int desc_cnt = 0, desc_local_cnt = 0;
+  static uint64_t stamp = 0, stamp_local = 0;  // of the listings desc and match are made from
+  static int *match = 0, *match_local = 0;     // entries which pass the filter
+  static int match_cnt = 0, match_local_cnt = 0;
+  static char match_filter[256];               // filter string of the matches
   if(ImGui::IsWindowAppearing()) ImGui::SetKeyboardFocusHere();
   if(ImGui::InputText("filter", filter, 256, ImGuiInputTextFlags_EnterReturnsTrue))
     ok = 1;
@@ -94,48 +96,74 @@ filteredlist(
      ImGui::IsKeyPressed(ImGuiKey_CapsLock))
   { FREE_ENT; return 2; }
 
-  if(!ent_cnt)
-  { // open directory
-    if(dir)
+  static const dt_dircache_list_t empty = {};
+  const dt_dircache_list_t *l = &empty, *l_local = &empty;
+  if(dir)
+  {
+    snprintf(dirname, sizeof(dirname), dir, dt_pipe.basedir);
+    l = dt_dircache_get(&vkdt.dircache, dirname);
+  }
+  if(dir_local)
+  {
+    snprintf(dirname_local, sizeof(dirname_local), dir_local, vkdt.db.basedir);
+    l_local = dt_dircache_get(&vkdt.dircache, dirname_local);
+  }
+  // only narrow down the last matches if the filter got longer and the listings are the same
+  int incremental = match && match_local && stamp == l->stamp && stamp_local == l_local->stamp && strstr(filter, match_filter);
+  if(stamp != l->stamp || stamp_local != l_local->stamp)
+  { // new listings, read the descriptions again
+    if(desc)       for(int i=0;i<desc_cnt;i++) free(desc[i]);
+    if(desc_local) for(int i=0;i<desc_local_cnt;i++) free(desc_local[i]);
+    free(desc); free(desc_local);
+    desc = desc_local = 0;
+    desc_cnt = desc_local_cnt = 0;
+    if(l->cnt && (flags & s_filteredlist_descr_any))
     {
-      snprintf(dirname, sizeof(dirname), dir, dt_pipe.basedir);
-      ent_cnt = scandir(dirname, &ent, 0, alphasort);
-      if(ent_cnt == -1) ent_cnt = 0;
-      if(ent_cnt && (flags & s_filteredlist_descr_any))
-      {
-        desc = (char**)malloc(sizeof(char*)*ent_cnt);
-        for(int i=0;i<ent_cnt;i++)
-          desc[i] = filteredlist_get_heading(dirname, ent[i]->d_name);
-      }
+      desc = (char**)malloc(sizeof(char*)*(desc_cnt = l->cnt));
+      for(int i=0;i<desc_cnt;i++)
+        desc[i] = filteredlist_get_heading(dirname, l->ent[i].name);
     }
-    if(dir_local)
+    if(l_local->cnt && (flags & s_filteredlist_descr_any))
     {
-      snprintf(dirname_local, sizeof(dirname_local), dir_local, vkdt.db.basedir);
-      ent_local_cnt = scandir(dirname_local, &ent_local, 0, alphasort);
-      if(ent_local_cnt == -1) ent_local_cnt = 0;
-      if(ent_local_cnt && (flags & s_filteredlist_descr_any))
-      {
-        desc_local = (char**)malloc(sizeof(char*)*ent_local_cnt);
-        for(int i=0;i<ent_local_cnt;i++)
-          desc_local[i] = filteredlist_get_heading(dirname_local, ent_local[i]->d_name);
-      }
+      desc_local = (char**)malloc(sizeof(char*)*(desc_local_cnt = l_local->cnt));
+      for(int i=0;i<desc_local_cnt;i++)
+        desc_local[i] = filteredlist_get_heading(dirname_local, l_local->ent[i].name);
     }
-    else ent_local_cnt = 0;
+    stamp = l->stamp;
+    stamp_local = l_local->stamp;
+  }
+  if(!incremental || strcmp(filter, match_filter))
+  {
+#define MATCH(L, D, M) do {\
+  if(!incremental) {\
+    M = (int *)realloc(M, sizeof(int)*MAX(1, L->cnt));\
+    M##_cnt = 0;\
+    for(uint32_t i=0;i<L->cnt;i++) M[M##_cnt++] = i;\
+  }\
+  int cnt = 0;\
+  for(int k=0;k<M##_cnt;k++) { const int i = M[k];\
+    if((strstr(L->ent[i].name, filter) || (D && D[i] && strstr(D[i], filter)))\
+        && L->ent[i].name[0] != '.' && (!(flags & s_filteredlist_descr_req) || (D && D[i])))\
+      M[cnt++] = i; }\
+  M##_cnt = cnt; } while(0)
+    MATCH(l_local, desc_local, match_local);
+    MATCH(l, desc, match);
+#undef MATCH
+    snprintf(match_filter, sizeof(match_filter), "%s", filter);
   }
-
 
   ImGui::BeginChild("filteredlist-scrollpane", ImVec2(0.0f, 0.75f*vkdt.state.center_ht));
   ImGui::PushStyleVar(ImGuiStyleVar_ButtonTextAlign, ImVec2(0.0, 0.5));
-#define LIST(E, D, L) do { \
-  for(int i=0;i<E##_cnt;i++)\
-  if((strstr(E[i]->d_name, filter) || (D && D[i] && strstr(D[i], filter)))\
-      && E[i]->d_name[0] != '.' && (!(flags & s_filteredlist_descr_req) || (D && D[i]))) {\
+#define LIST(E, D, M, L) do { \
+  for(int k=0;k<M##_cnt;k++) { const int i = M[k];\
     if(pick < 0) { local = L; pick = i; } \
-    if(ImGui::Button((D && D[i]) ? D[i] : E[i]->d_name, ImVec2(-1, 0))) {\
+    ImGui::PushID(k + (L ? 0 : match_local_cnt));\
+    if(ImGui::Button((D && D[i]) ? D[i] : E->ent[i].name, ImVec2(-1, 0))) {\
       ok = 1; pick = i; local = L;\
-    } } } while(0)
-  LIST(ent_local, desc_local, 1);
-  LIST(ent, desc, 0);
+    }\
+    ImGui::PopID(); } } while(0)
+  LIST(l_local, desc_local, match_local, 1);
+  LIST(l, desc, match, 0);
 #undef LIST
   ImGui::PopStyleVar();
   ImGui::EndChild(); // scrollable list
@@ -154,14 +182,14 @@ filteredlist(
     if(flags & s_filteredlist_return_short)
     {
       if(pick < 0)   snprintf(retstr, retstr_len, "%.*s", retstr_len-1, filter);
-      else if(local) snprintf(retstr, retstr_len, "%.*s", retstr_len-1, ent_local[pick]->d_name);
-      else           snprintf(retstr, retstr_len, "%.*s", retstr_len-1, ent[pick]->d_name);
+      else if(local) snprintf(retstr, retstr_len, "%.*s", retstr_len-1, l_local->ent[pick].name);
+      else           snprintf(retstr, retstr_len, "%.*s", retstr_len-1, l->ent[pick].name);
     }
     else
     {
       if(pick < 0)   snprintf(retstr, retstr_len, "%.*s", retstr_len-1, filter);
-      else if(local) snprintf(retstr, retstr_len, "%.*s/%s", retstr_len-257, dirname_local, ent_local[pick]->d_name);
-      else           snprintf(retstr, retstr_len, "%.*s/%s", retstr_len-257, dirname, ent[pick]->d_name);
+      else if(local) snprintf(retstr, retstr_len, "%.*s/%s", retstr_len-257, dirname_local, l_local->ent[pick].name);
+      else           snprintf(retstr, retstr_len, "%.*s/%s", retstr_len-257, dirname, l->ent[pick].name);
     }
     FREE_ENT;
   }
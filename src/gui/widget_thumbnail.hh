@@ -75,7 +75,10 @@ inline void dt_draw_labels(float x, float y, float wd, uint16_t labels)
 
 namespace ImGui {
 
-// this is pretty much ImGui::ImageButton with a few custom hacks:
+// this is pretty much ImGui::ImageButton with a few custom hacks.
+// if the draw list has been split into three channels, frames, images and
+// decorations go to channels 0, 1, 2 respectively. thumbnails on the same
+// atlas page then end up in one draw command, no matter how many there are.
 inline uint32_t ThumbnailImage(
     uint32_t imgid,
     ImTextureID user_texture_id,
@@ -126,11 +129,15 @@ inline uint32_t ThumbnailImage(
 
   // Render
   const ImU32 col = GetColorU32((held && hovered) ? ImGuiCol_ButtonActive : hovered ? ImGuiCol_ButtonHovered : ImGuiCol_Button);
+  const int split = window->DrawList->_Splitter._Count == 3;
+  if(split) window->DrawList->ChannelsSetCurrent(0);
   RenderNavHighlight(bb, id);
   RenderFrame(bb.Min, bb.Max, col, true, ImClamp(padding, 0.0f, style.FrameRounding));
   if (bg_col.w > 0.0f)
     window->DrawList->AddRectFilled(image_bb.Min, image_bb.Max, GetColorU32(bg_col));
+  if(split) window->DrawList->ChannelsSetCurrent(1);
   window->DrawList->AddImage(user_texture_id, image_bb.Min, image_bb.Max, uv0, uv1, GetColorU32(tint_col));
+  if(split) window->DrawList->ChannelsSetCurrent(2);
 
   // render decorations (colour labels/stars/etc?)
   dt_draw_rating(bb.Min[0]+0.1*wd, bb.Min[1]+0.1*wd, 0.1*wd, rating);
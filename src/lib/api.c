@@ -0,0 +1,290 @@
+#include "lib/api.h"
+#include "qvk/qvk.h"
+#include "core/log.h"
+#include "core/threads.h"
+#include "pipe/global.h"
+#include "pipe/graph.h"
+#include "pipe/graph-io.h"
+#include "pipe/graph-export.h"
+#include "pipe/modules/api.h"
+
+#include <stdlib.h>
+#include <stdatomic.h>
+
+// implementation of the public api on top of dt_graph_t. a job runs
+// dt_graph_run() on the thread pool (so uploading sources and recording does
+// not block the caller) and completes when the timeline semaphore of the graph
+// reaches the value signalled by its submission.
+
+struct vkdt_graph_t
+{
+  dt_graph_t      graph;
+  dt_graph_run_t  run;  // passes needed by the next job
+  int             sink; // module id of the o-null sink holding the output
+  vkdt_job_t     *job;  // latest job, 0 if released
+};
+
+struct vkdt_job_t
+{
+  vkdt_graph_t   *graph;
+  dt_graph_run_t  run;
+  int             taskid;
+  atomic_int      done;   // dt_graph_run() returned
+  VkResult        res;
+  uint64_t        value;  // timeline value signalled by the submission
+  int             frame;
+};
+
+int
+vkdt_init(const char *gpu_name, int gpu_id)
+{
+  dt_log_init(s_log_err);
+  dt_pipe_global_init();
+  threads_global_init();
+  return qvk_init(gpu_name, gpu_id) != VK_SUCCESS;
+}
+
+void
+vkdt_cleanup(void)
+{
+  threads_global_cleanup();
+  dt_pipe_shader_cleanup();
+  dt_pipe_staging_cleanup();
+  qvk_cleanup();
+  dt_pipe_global_cleanup();
+}
+
+vkdt_graph_t *
+vkdt_graph_create(void)
+{
+  vkdt_graph_t *g = calloc(1, sizeof(*g));
+  dt_graph_init(&g->graph);
+  g->run  = s_graph_run_all;
+  g->sink = -1;
+  return g;
+}
+
+void
+vkdt_graph_destroy(vkdt_graph_t *g)
+{
+  if(!g) return;
+  if(g->job) vkdt_job_wait(g->job);
+  dt_graph_cleanup(&g->graph);
+  free(g);
+}
+
+static void
+wait_graph(vkdt_graph_t *g)
+{ // parameters may only change while no job is reading them
+  if(g->job) vkdt_job_wait(g->job);
+}
+
+// same as dt_graph_replace_display(), but keep linear f32 rgba for the caller
+static int
+replace_display(dt_graph_t *graph)
+{
+  const int mid = dt_module_get(graph, dt_token("display"), dt_token("main"));
+  if(mid < 0) return -1;
+  const int cid = dt_module_get_connector(graph->module+mid, dt_token("input"));
+  const int m0 = graph->module[mid].connector[cid].connected_mi;
+  const int o0 = graph->module[mid].connector[cid].connected_mc;
+  if(m0 < 0) return -1;
+  const int m1 = dt_module_add(graph, dt_token("o-null"), dt_token("main"));
+  if(m1 < 0) return -1;
+  const int i1 = dt_module_get_connector(graph->module+m1, dt_token("input"));
+  graph->module[m0].connector[o0].format = graph->module[m1].connector[i1].format = dt_token("f32");
+  graph->module[m0].connector[o0].chan   = graph->module[m1].connector[i1].chan   = dt_token("rgba");
+  CONN(dt_module_connect(graph, m0, o0, m1, i1));
+  dt_graph_disconnect_display_modules(graph);
+  return m1;
+}
+
+int
+vkdt_graph_load(vkdt_graph_t *g, const char *cfgfile)
+{
+  wait_graph(g);
+  if(dt_graph_load_config(&g->graph, cfgfile, 0, 0) != VK_SUCCESS) return 1;
+  g->sink = replace_display(&g->graph);
+  g->run  = s_graph_run_all;
+  if(g->sink < 0)
+  {
+    dt_log(s_log_err, "%s has no connected main display!", cfgfile);
+    return 2;
+  }
+  return 0;
+}
+
+int
+vkdt_graph_set_line(vkdt_graph_t *g, const char *line)
+{
+  wait_graph(g);
+  char buf[2048];
+  snprintf(buf, sizeof(buf), "%s", line);
+  if(dt_graph_read_config_line(&g->graph, buf)) return 1;
+  g->run = s_graph_run_all; // could be a connection, don't know
+  return 0;
+}
+
+int
+vkdt_graph_set_param_float(
+    vkdt_graph_t *g,
+    const char   *module,
+    const char   *instance,
+    const char   *param,
+    const float  *val,
+    int           cnt)
+{
+  wait_graph(g);
+  const int modid = dt_module_get(&g->graph, dt_token(module), dt_token(instance));
+  if(modid < 0) return 1;
+  dt_module_t *mod = g->graph.module + modid;
+  const int parid = dt_module_get_param(mod->so, dt_token(param));
+  if(parid < 0 || mod->so->param[parid]->type != dt_token("float")) return 2;
+  float *p = (float *)(mod->param + mod->so->param[parid]->offset);
+  cnt = MIN(cnt, mod->so->param[parid]->cnt);
+  float oldval = p[0];
+  memcpy(p, val, sizeof(float)*cnt);
+  dt_graph_run_t flags = s_graph_run_none;
+  if(mod->so->check_params) flags = mod->so->check_params(mod, parid, &oldval);
+  g->run |= s_graph_run_record_cmd_buf | flags;
+  return 0;
+}
+
+void
+vkdt_graph_set_max_size(vkdt_graph_t *g, int width, int height)
+{
+  wait_graph(g);
+  if(g->graph.output_wd == width && g->graph.output_ht == height) return;
+  g->graph.output_wd = width;
+  g->graph.output_ht = height;
+  g->run = s_graph_run_all;
+}
+
+static void
+fill_image(const dt_connector_t *c, vkdt_image_t *img)
+{
+  if(img) *img = (vkdt_image_t){
+    .width    = c->roi.wd,
+    .height   = c->roi.ht,
+    .channels = dt_connector_channels(c),
+    .bytes    = dt_connector_bytes_per_channel(c),
+    .stride   = dt_connector_bufsize(c, c->roi.wd, 1),
+    .format   = dt_connector_bytes_per_channel(c) == 4 ? "f32" : dt_connector_bytes_per_channel(c) == 2 ? "f16" : "ui8",
+  };
+}
+
+void *
+vkdt_graph_map_input(
+    vkdt_graph_t *g,
+    const char   *instance,
+    int           width,
+    int           height,
+    vkdt_image_t *img)
+{
+  wait_graph(g);
+  dt_graph_t *graph = &g->graph;
+  const int modid = dt_module_get(graph, dt_token("i-mem"), instance ? dt_token(instance) : dt_token("main"));
+  if(modid < 0) return 0;
+  dt_module_t *mod = graph->module + modid;
+  int32_t *size = (int32_t *)dt_module_param_int(mod, 0);
+  if(size[0] != width || size[1] != height)
+  { // width and height are consecutive params
+    size[0] = width;
+    size[1] = height;
+    g->run = s_graph_run_all;
+  }
+  const dt_graph_run_t alloc = s_graph_run_roi | s_graph_run_create_nodes | s_graph_run_alloc;
+  if(g->run & alloc)
+  { // staging memory needs to exist before we can hand it out
+    if(dt_graph_run(graph, g->run & alloc) != VK_SUCCESS) return 0;
+    g->run = (g->run & ~alloc) | s_graph_run_record_cmd_buf;
+  }
+  g->run |= s_graph_run_upload_source;
+  for(int n=0;n<graph->num_nodes;n++)
+  {
+    const dt_node_t *node = graph->node + n;
+    if(!dt_node_source(node) || node->module != mod) continue;
+    const dt_connector_t *c = node->connector;
+    fill_image(c, img);
+    return graph->staging_mapped + c->offset_staging + (graph->frame % 2) * c->stride_staging;
+  }
+  return 0;
+}
+
+static void
+job_work(uint32_t item, void *data)
+{
+  vkdt_job_t *job = data;
+  dt_graph_t *graph = &job->graph->graph;
+  job->res   = dt_graph_run(graph, job->run);
+  job->value = graph->semaphore_value;
+  atomic_store(&job->done, 1);
+}
+
+vkdt_job_t *
+vkdt_graph_submit(vkdt_graph_t *g)
+{
+  if(g->sink < 0) return 0;
+  wait_graph(g);
+  vkdt_job_t *job = calloc(1, sizeof(*job));
+  job->graph = g;
+  job->frame = g->graph.frame;
+  // the sink copy is always recorded, there is no write_sink() to wait for:
+  job->run   = (g->run | s_graph_run_record_cmd_buf) & ~(s_graph_run_download_sink | s_graph_run_wait_done);
+  g->run = s_graph_run_none;
+  g->job = job;
+  job->taskid = threads_task("vkdt job", 1, -1, job, job_work, 0);
+  if(job->taskid < 0) job_work(0, job); // no free slot, run here
+  return job;
+}
+
+int
+vkdt_job_poll(vkdt_job_t *job)
+{
+  if(!atomic_load(&job->done)) return 0;
+  if(job->res != VK_SUCCESS) return -1;
+  uint64_t value = 0;
+  if(vkGetSemaphoreCounterValue(qvk.device, job->graph->graph.semaphore, &value) != VK_SUCCESS) return -1;
+  return value >= job->value;
+}
+
+int
+vkdt_job_wait(vkdt_job_t *job)
+{
+  while(!atomic_load(&job->done))
+    threads_wait(job->taskid);
+  if(job->res != VK_SUCCESS) return 1;
+  VkSemaphoreWaitInfo wait_info = {
+    .sType          = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+    .semaphoreCount = 1,
+    .pSemaphores    = &job->graph->graph.semaphore,
+    .pValues        = &job->value,
+  };
+  return vkWaitSemaphores(qvk.device, &wait_info, UINT64_MAX) != VK_SUCCESS;
+}
+
+const void *
+vkdt_job_map_output(vkdt_job_t *job, vkdt_image_t *img)
+{
+  vkdt_graph_t *g = job->graph;
+  if(g->job != job || vkdt_job_poll(job) != 1) return 0; // not done or overwritten by a later job
+  dt_graph_t *graph = &g->graph;
+  for(int n=0;n<graph->num_nodes;n++)
+  {
+    dt_node_t *node = graph->node + n;
+    if(!dt_node_sink(node) || node->module != graph->module + g->sink) continue;
+    const dt_connector_t *c = node->connector;
+    fill_image(c, img);
+    return graph->staging_mapped + c->offset_staging + (job->frame % 2) * c->stride_staging;
+  }
+  return 0;
+}
+
+void
+vkdt_job_release(vkdt_job_t *job)
+{
+  if(!job) return;
+  vkdt_job_wait(job);
+  if(job->graph->job == job) job->graph->job = 0;
+  free(job);
+}
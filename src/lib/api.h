@@ -0,0 +1,99 @@
+#pragma once
+// public api for embedding vkdt in other applications. only this header is
+// needed to use it, all vkdt types stay opaque. link against libvkdt.so.
+//
+// typical use:
+//   vkdt_init(0, -1);
+//   vkdt_graph_t *g = vkdt_graph_create();
+//   vkdt_graph_load(g, "image.raw.cfg");
+//   vkdt_job_t *j = vkdt_graph_submit(g);   // returns immediately
+//   .. submit more jobs on other graphs, do other work ..
+//   vkdt_job_wait(j);
+//   vkdt_image_t img;
+//   const void *px = vkdt_job_map_output(j, &img);
+//   vkdt_job_release(j);
+//
+// jobs on different graphs run concurrently. jobs on the same graph run one
+// after another, submitting to a graph waits for its previous job first. the
+// output stays mapped until the next job is submitted to the same graph.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct vkdt_graph_t vkdt_graph_t;
+typedef struct vkdt_job_t   vkdt_job_t;
+
+typedef struct vkdt_image_t
+{
+  uint32_t    width, height;
+  uint32_t    channels;    // number of interleaved channels
+  uint32_t    bytes;       // bytes per channel
+  size_t      stride;      // bytes per row
+  const char *format;      // "ui8", "ui16", "f16" or "f32"
+}
+vkdt_image_t;
+
+// init the vulkan device and the thread pool. pass 0 and -1 to pick the device
+// from the config. returns 0 on success.
+int  vkdt_init(const char *gpu_name, int gpu_id);
+void vkdt_cleanup(void);
+
+vkdt_graph_t *vkdt_graph_create(void);
+void vkdt_graph_destroy(vkdt_graph_t *graph);
+
+// read a graph cfg. if the file isn't a cfg, it is loaded as an image using
+// the default darkroom cfg. the main display is replaced by a sink which keeps
+// the pixels in host visible memory. returns 0 on success.
+int vkdt_graph_load(vkdt_graph_t *graph, const char *cfgfile);
+
+// apply one line in the format of the cfg files, for instance
+// "param:exposure:01:exposure:1.5" or "connect:..". returns 0 on success.
+int vkdt_graph_set_line(vkdt_graph_t *graph, const char *line);
+
+// set cnt floats of the given parameter. returns 0 on success.
+int vkdt_graph_set_param_float(
+    vkdt_graph_t *graph,
+    const char   *module,
+    const char   *instance,
+    const char   *param,
+    const float  *val,
+    int           cnt);
+
+// bound the output size for the next job, 0 means full resolution.
+void vkdt_graph_set_max_size(vkdt_graph_t *graph, int width, int height);
+
+// map the staging memory of the i-mem source module of the given instance
+// (0 -> "main") to write width x height linear rgba f32 pixels into. waits
+// for the running job of the graph and allocates the graph if needed. the
+// pixels are uploaded by the next submit. returns 0 on error.
+void *vkdt_graph_map_input(
+    vkdt_graph_t *graph,
+    const char   *instance,
+    int           width,
+    int           height,
+    vkdt_image_t *img);
+
+// process the graph with the current parameters on the thread pool. returns a
+// handle to wait for, or 0 on error. only those passes which the changed
+// parameters require are run again.
+vkdt_job_t *vkdt_graph_submit(vkdt_graph_t *graph);
+
+// returns 1 if the job is done, 0 if it is still running and -1 on error.
+int vkdt_job_poll(vkdt_job_t *job);
+
+// block until the job is done. returns 0 on success.
+int vkdt_job_wait(vkdt_job_t *job);
+
+// pointer to the output pixels of a finished job, or 0. fills img if not 0.
+const void *vkdt_job_map_output(vkdt_job_t *job, vkdt_image_t *img);
+
+// wait for the job and free the handle.
+void vkdt_job_release(vkdt_job_t *job);
+
+#ifdef __cplusplus
+}
+#endif
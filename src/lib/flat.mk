@@ -0,0 +1,4 @@
+LIB_O=lib/api.o
+LIB_H=lib/api.h
+LIB_CFLAGS=
+LIB_LDFLAGS=
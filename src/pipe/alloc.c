@@ -6,11 +6,245 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <assert.h>
+#include <inttypes.h>
+
+// map size to first and second level index of the tlsf free lists
+static inline void
+tlsf_mapping(uint64_t size, int *fl, int *sl)
+{
+  if(size < DT_VKALLOC_SL_CNT)
+  { // small blocks all go to the first class
+    *fl = 0;
+    *sl = size;
+    return;
+  }
+  const int f = 63 - __builtin_clzll(size);
+  *fl = f - DT_VKALLOC_SL_LOG + 1;
+  *sl = (size >> (f - DT_VKALLOC_SL_LOG)) ^ DT_VKALLOC_SL_CNT;
+}
+
+static inline void
+tlsf_insert(dt_vkalloc_t *a, dt_vkmem_t *b)
+{
+  int fl, sl;
+  tlsf_mapping(b->size, &fl, &sl);
+  b->is_free = 1;
+  b->ref = 0;
+  a->bin[fl][sl] = DLIST_PREPEND(a->bin[fl][sl], b);
+  a->fl_bitmap     |= 1ul << fl;
+  a->sl_bitmap[fl] |= 1u  << sl;
+}
+
+static inline void
+tlsf_remove(dt_vkalloc_t *a, dt_vkmem_t *b)
+{
+  int fl, sl;
+  tlsf_mapping(b->size, &fl, &sl);
+  if(a->bin[fl][sl] == b) a->bin[fl][sl] = b->next;
+  DLIST_RM_ELEMENT(b);
+  if(!a->bin[fl][sl])
+  {
+    a->sl_bitmap[fl] &= ~(1u << sl);
+    if(!a->sl_bitmap[fl]) a->fl_bitmap &= ~(1ul << fl);
+  }
+  b->is_free = 0;
+}
+
+// find a free block of at least the given size, O(1)
+static inline dt_vkmem_t*
+tlsf_find(dt_vkalloc_t *a, uint64_t size)
+{ // round up to the next size class, so every block in there will fit
+  if(size >= DT_VKALLOC_SL_CNT)
+    size += (1ul << (63 - __builtin_clzll(size) - DT_VKALLOC_SL_LOG)) - 1;
+  int fl, sl;
+  tlsf_mapping(size, &fl, &sl);
+  uint32_t sl_map = a->sl_bitmap[fl] & (~0u << sl);
+  if(!sl_map)
+  {
+    const uint64_t fl_map = fl + 1 < DT_VKALLOC_FL_CNT ? a->fl_bitmap & (~0ul << (fl + 1)) : 0;
+    if(!fl_map) return 0;
+    fl = __builtin_ctzll(fl_map);
+    sl_map = a->sl_bitmap[fl];
+  }
+  sl = __builtin_ctz(sl_map);
+  return a->bin[fl][sl];
+}
+
+static inline void
+tlsf_recycle(dt_vkalloc_t *a, dt_vkmem_t *b)
+{
+  b->prev_phys = b->next_phys = 0;
+  b->is_free = 0;
+  a->unused = DLIST_PREPEND(a->unused, b);
+}
+
+// use [offset, offset+size) of the free block l, which has already been
+// removed from the free lists. the remainder goes back to the free lists.
+static inline dt_vkmem_t*
+tlsf_use(dt_vkalloc_t *a, dt_vkmem_t *l, uint64_t offset, uint64_t size)
+{
+  const uint64_t end = l->offset_orig + l->size;
+  assert(offset >= l->offset_orig && end >= offset + size);
+  if(end > offset + size)
+  {
+    assert(a->unused && "vkalloc: no more free slots!");
+    if(!a->unused)
+    {
+      tlsf_insert(a, l);
+      return 0;
+    }
+    dt_vkmem_t *r = a->unused;
+    a->unused = DLIST_REMOVE(a->unused, r); // remove first is O(1)
+    r->offset = r->offset_orig = offset + size;
+    r->size = end - r->offset_orig;
+    r->prev_phys = l;
+    r->next_phys = l->next_phys;
+    if(l->next_phys) l->next_phys->prev_phys = r;
+    else a->tail = r;
+    l->next_phys = r;
+    tlsf_insert(a, r);
+  }
+  // as for the linear allocator, the alignment gap stays with the block
+  l->offset = offset;
+  assert(size < 1ul<<48);
+  l->size = size;
+  l->ref = 1;
+  a->rss += l->size;
+  a->peak_rss = MAX(a->peak_rss, a->rss);
+  a->vmsize = MAX(a->vmsize, l->offset + l->size);
+  a->used = DLIST_PREPEND(a->used, l);
+  return l;
+}
+
+static dt_vkmem_t*
+tlsf_alloc(dt_vkalloc_t *a, uint64_t size, uint64_t alignment)
+{
+  dt_vkmem_t *l = tlsf_find(a, size + alignment - 1);
+  assert(l && "vkalloc: out of memory!");
+  if(!l) return 0;
+  tlsf_remove(a, l);
+  return tlsf_use(a, l, (l->offset_orig + (alignment-1)) & ~(alignment-1), size);
+}
+
+static dt_vkmem_t*
+tlsf_alloc_feedback(dt_vkalloc_t *a, uint64_t size, uint64_t alignment)
+{ // the physically last block is the only one that extends beyond vmsize
+  dt_vkmem_t *l = a->tail;
+  assert(l && l->is_free && "vkalloc: no free block at the end of the heap!");
+  if(!l || !l->is_free) return 0;
+  assert(l->offset_orig <= a->vmsize);
+  tlsf_remove(a, l);
+  if(l->offset_orig < a->vmsize)
+  { // keep the part before vmsize free, it may have been used before
+    assert(a->unused && "vkalloc: no more free slots!");
+    if(!a->unused)
+    {
+      tlsf_insert(a, l);
+      return 0;
+    }
+    dt_vkmem_t *f = a->unused;
+    a->unused = DLIST_REMOVE(a->unused, f); // remove first is O(1)
+    f->offset = f->offset_orig = l->offset_orig;
+    f->size = a->vmsize - l->offset_orig;
+    f->prev_phys = l->prev_phys;
+    f->next_phys = l;
+    if(l->prev_phys) l->prev_phys->next_phys = f;
+    l->prev_phys = f;
+    l->size -= f->size;
+    l->offset = l->offset_orig = a->vmsize;
+    tlsf_insert(a, f);
+  }
+  return tlsf_use(a, l, (a->vmsize + (alignment-1)) & ~(alignment-1), size);
+}
+
+static void
+tlsf_free(dt_vkalloc_t *a, dt_vkmem_t *mem)
+{
+  a->rss -= mem->size;
+  if(a->used == mem) a->used = mem->next;
+  DLIST_RM_ELEMENT(mem); // O(1) instead of DLIST_REMOVE
+  mem->size += mem->offset - mem->offset_orig; // include alignment gap again
+  mem->offset = mem->offset_orig;
+  dt_vkmem_t *t = mem->prev_phys;
+  if(t && t->is_free)
+  { // merge with before
+    tlsf_remove(a, t);
+    t->size += mem->size;
+    t->next_phys = mem->next_phys;
+    if(mem->next_phys) mem->next_phys->prev_phys = t;
+    else a->tail = t;
+    tlsf_recycle(a, mem);
+    mem = t;
+  }
+  t = mem->next_phys;
+  if(t && t->is_free)
+  { // merge with after
+    tlsf_remove(a, t);
+    mem->size += t->size;
+    mem->next_phys = t->next_phys;
+    if(t->next_phys) t->next_phys->prev_phys = mem;
+    else a->tail = mem;
+    tlsf_recycle(a, t);
+  }
+  tlsf_insert(a, mem);
+}
+
+static int
+tlsf_check(dt_vkalloc_t *a)
+{
+  uint64_t num_free = 0;
+  for(int fl=0;fl<DT_VKALLOC_FL_CNT;fl++) for(int sl=0;sl<DT_VKALLOC_SL_CNT;sl++)
+  {
+    dt_vkmem_t *l = a->bin[fl][sl];
+    if(((a->sl_bitmap[fl] >> sl) & 1) != (l != 0)) return 20;
+    if(l && l->prev) return 21;
+    for(;l;l=l->next)
+    {
+      int f, s;
+      tlsf_mapping(l->size, &f, &s);
+      if(f != fl || s != sl) return 22; // wrong size class
+      if(!l->is_free) return 23;
+      if(l->next && l->next->prev != l) return 24;
+      num_free++;
+    }
+    if(a->sl_bitmap[fl] && !((a->fl_bitmap >> fl) & 1)) return 25;
+  }
+  // walk the physical chain backwards from the tail and make sure it covers the heap
+  uint64_t num_phys = 0, end = a->heap_size;
+  for(dt_vkmem_t *l=a->tail;l;l=l->prev_phys)
+  {
+    if(l->offset + l->size != end) return 26; // gap or overlap
+    if(l->is_free && l->prev_phys && l->prev_phys->is_free) return 27; // not merged
+    if(l->prev_phys && l->prev_phys->next_phys != l) return 28;
+    end = l->offset_orig;
+    if(++num_phys > a->pool_size) return 29; // cycle
+  }
+  if(end != 0) return 30;
+  uint64_t num_used = DLIST_LENGTH(a->used);
+  uint64_t num_unused = DLIST_LENGTH(a->unused);
+  if(num_used + num_free != num_phys) return 31;
+  if(num_used + num_free + num_unused != a->pool_size)
+  {
+    fprintf(stderr, "used %lu free %lu unused %lu != %lu\n", num_used, num_free, num_unused, a->pool_size);
+    return 1;
+  }
+  uint64_t rss = 0, vmsize = 0;
+  for(dt_vkmem_t *l=a->used;l;l=l->next)
+  {
+    if(l->is_free) return 32;
+    vmsize = MAX(vmsize, l->offset+l->size);
+    rss += l->size;
+  }
+  if(vmsize > a->vmsize) return 7;
+  if(rss != a->rss) return 8;
+  return 0;
+}
 
 void
-dt_vkalloc_init(dt_vkalloc_t *a, uint64_t pool_size, uint64_t bytesize)
+dt_vkalloc_init(dt_vkalloc_t *a, uint64_t pool_size, uint64_t bytesize, dt_vkalloc_type_t type)
 {
   memset(a, 0, sizeof(*a));
+  a->type = type;
   a->heap_size = bytesize;
   a->pool_size = pool_size;
   a->vkmem_pool = malloc(sizeof(dt_vkmem_t)*a->pool_size);
@@ -29,12 +263,23 @@ dt_vkalloc_cleanup(dt_vkalloc_t *a)
 void
 dt_vkalloc_nuke(dt_vkalloc_t *a)
 {
+  if(a->trace) fprintf(a->trace, "n\n");
   memset(a->vkmem_pool, 0, sizeof(dt_vkmem_t)*a->pool_size); 
   a->free = a->used = a->unused = 0;
-  a->free = DLIST_PREPEND(a->free, a->vkmem_pool);
-  a->free->offset = 0;
-  a->free->offset_orig = 0;
-  a->free->size = a->heap_size;
+  a->tail = 0;
+  a->fl_bitmap = 0;
+  memset(a->sl_bitmap, 0, sizeof(a->sl_bitmap));
+  memset(a->bin, 0, sizeof(a->bin));
+  dt_vkmem_t *all = a->vkmem_pool;
+  all->offset = 0;
+  all->offset_orig = 0;
+  all->size = a->heap_size;
+  if(a->type == s_vkalloc_tlsf)
+  {
+    a->tail = all;
+    tlsf_insert(a, all);
+  }
+  else a->free = DLIST_PREPEND(a->free, all);
   for(int i=1;i<a->pool_size;i++)
     a->unused = DLIST_PREPEND(a->unused, a->vkmem_pool+i);
   a->peak_rss = a->rss = a->vmsize = 0ul;
@@ -46,10 +291,9 @@ dt_vkalloc_nuke(dt_vkalloc_t *a)
 // - use last entry in free list
 // - split potentially into three
 // - memory offset is vmsize + alignment
-dt_vkmem_t*
-dt_vkalloc_feedback(dt_vkalloc_t *a, uint64_t size, uint64_t alignment)
+static dt_vkmem_t*
+linear_alloc_feedback(dt_vkalloc_t *a, uint64_t size, uint64_t alignment)
 {
-  if(!alignment) alignment = 1;
   assert(!dt_vkalloc_check(a));
   // linear scan through free list O(n)
   dt_vkmem_t *l = a->free;
@@ -112,10 +356,9 @@ dt_vkalloc_feedback(dt_vkalloc_t *a, uint64_t size, uint64_t alignment)
   return mem;
 }
 
-dt_vkmem_t*
-dt_vkalloc(dt_vkalloc_t *a, uint64_t size, uint64_t alignment)
+static dt_vkmem_t*
+linear_alloc(dt_vkalloc_t *a, uint64_t size, uint64_t alignment)
 {
-  if(!alignment) alignment = 1;
   // linear scan through free list O(n)
   dt_vkmem_t *l = a->free;
   while(l)
@@ -163,6 +406,33 @@ dt_vkalloc(dt_vkalloc_t *a, uint64_t size, uint64_t alignment)
   return 0;
 }
 
+// the trace identifies blocks by their slot in the pool, see pipe/tests/allocbench.c
+static inline void
+trace_alloc(dt_vkalloc_t *a, char op, dt_vkmem_t *mem, uint64_t size, uint64_t alignment)
+{
+  if(a->trace && mem) fprintf(a->trace, "%c %td %"PRIu64" %"PRIu64"\n", op, mem - a->vkmem_pool, size, alignment);
+}
+
+dt_vkmem_t*
+dt_vkalloc_feedback(dt_vkalloc_t *a, uint64_t size, uint64_t alignment)
+{
+  if(!alignment) alignment = 1;
+  dt_vkmem_t *mem = a->type == s_vkalloc_tlsf ?
+    tlsf_alloc_feedback(a, size, alignment) : linear_alloc_feedback(a, size, alignment);
+  trace_alloc(a, 'b', mem, size, alignment);
+  return mem;
+}
+
+dt_vkmem_t*
+dt_vkalloc(dt_vkalloc_t *a, uint64_t size, uint64_t alignment)
+{
+  if(!alignment) alignment = 1;
+  dt_vkmem_t *mem = a->type == s_vkalloc_tlsf ?
+    tlsf_alloc(a, size, alignment) : linear_alloc(a, size, alignment);
+  trace_alloc(a, 'a', mem, size, alignment);
+  return mem;
+}
+
 void
 dt_vkfree(dt_vkalloc_t *a, dt_vkmem_t *mem)
 {
@@ -172,6 +442,12 @@ dt_vkfree(dt_vkalloc_t *a, dt_vkmem_t *mem)
     if(mem->ref) return; // don't free if still referenced
   }
   else return; // no ref count: already freed
+  if(a->trace) fprintf(a->trace, "f %td\n", mem - a->vkmem_pool);
+  if(a->type == s_vkalloc_tlsf)
+  {
+    tlsf_free(a, mem);
+    return;
+  }
   // remove from used list, put back to free list.
   a->rss -= mem->size;
   a->used = DLIST_REMOVE(a->used, mem);
@@ -219,6 +495,7 @@ dt_vkfree(dt_vkalloc_t *a, dt_vkmem_t *mem)
 int
 dt_vkalloc_check(dt_vkalloc_t *a)
 {
+  if(a->type == s_vkalloc_tlsf) return tlsf_check(a);
   // check list integrity:
   dt_vkmem_t *l = a->free;
   if(l)
@@ -333,3 +610,18 @@ dt_vkalloc_check(dt_vkalloc_t *a)
   return 0; // yay, we made it!
 }
 
+
+void
+dt_vkalloc_stats(dt_vkalloc_t *a, uint64_t *free_bytes, uint64_t *largest_free)
+{
+  *free_bytes = *largest_free = 0;
+  dt_vkmem_t *l = a->type == s_vkalloc_tlsf ? a->tail : a->free;
+  for(;l;l=(a->type == s_vkalloc_tlsf ? l->prev_phys : l->next))
+  {
+    if(a->type == s_vkalloc_tlsf && !l->is_free) continue;
+    if(l->offset_orig >= a->vmsize) continue;
+    uint64_t size = MIN(l->offset_orig + l->size, a->vmsize) - l->offset_orig;
+    *free_bytes += size;
+    *largest_free = MAX(*largest_free, size);
+  }
+}
@@ -1,26 +1,52 @@
 #pragma once
 #include <stdint.h>
+#include <stdio.h>
 
 // simple vulkan buffer memory allocator
-// for the node graph. single thread use, not optimised in any sense.
-// employs a free list and an allocation list, both allocation and free
-// are O(n). we hope to afford it because we'll use n~=10 buffers max.
+// for the node graph and the thumbnails. single thread use.
+// there are two flavours, selected at init time:
+// the linear one employs a sorted free list and an allocation list, both
+// allocation and free are O(n). this is fine for n~=10 buffers.
+// the tlsf (two level segregated fit) variant keeps free blocks in size
+// classes with a bitmap on top, allocation and free are O(1). use this
+// for large graphs with hundreds of buffers or thousands of thumbnails.
+
+#define DT_VKALLOC_FL_CNT 64 // first level: power of two size classes
+#define DT_VKALLOC_SL_LOG 5  // second level: linear subdivisions, log2
+#define DT_VKALLOC_SL_CNT (1<<DT_VKALLOC_SL_LOG)
+
+typedef enum dt_vkalloc_type_t
+{
+  s_vkalloc_linear = 0, // sorted free list, O(n)
+  s_vkalloc_tlsf   = 1, // segregated fit, O(1)
+}
+dt_vkalloc_type_t;
 
 typedef struct dt_vkmem_t
 {
   uint64_t offset;          // to be uploaded as uniform/push const
   uint64_t offset_orig;     // unaligned offset
-  uint64_t ref  : 16;       // reference count
-  uint64_t size : 48;       // only for us, the gpu will know what they asked for
+  uint64_t ref     : 15;    // reference count
+  uint64_t is_free :  1;    // tlsf only: block is in one of the free lists
+  uint64_t size    : 48;    // only for us, the gpu will know what they asked for
   struct dt_vkmem_t *prev;  // for alloced/free lists
   struct dt_vkmem_t *next;
+  struct dt_vkmem_t *prev_phys; // tlsf only: physically adjacent blocks
+  struct dt_vkmem_t *next_phys;
 }
 dt_vkmem_t;
 
 typedef struct dt_vkalloc_t
 {
+  dt_vkalloc_type_t type;
   dt_vkmem_t *used;
-  dt_vkmem_t *free;
+  dt_vkmem_t *free;         // linear only
+
+  // tlsf only: free lists for every size class, and bitmaps of non-empty lists
+  uint64_t    fl_bitmap;
+  uint32_t    sl_bitmap[DT_VKALLOC_FL_CNT];
+  dt_vkmem_t *bin[DT_VKALLOC_FL_CNT][DT_VKALLOC_SL_CNT];
+  dt_vkmem_t *tail;         // physically last block
 
   // fixed size pool of dt_vkmem_t to not fragment our real heap with this nonsense:
   uint64_t pool_size;
@@ -31,10 +57,12 @@ typedef struct dt_vkalloc_t
   uint64_t peak_rss;
   uint64_t rss;
   uint64_t vmsize; // <= necessary to stay within limits here!
+
+  FILE *trace;     // if set, every alloc, free and nuke is written here (not owned)
 }
 dt_vkalloc_t;
 
-void dt_vkalloc_init(dt_vkalloc_t *a, uint64_t pool_size, uint64_t bytesize);
+void dt_vkalloc_init(dt_vkalloc_t *a, uint64_t pool_size, uint64_t bytesize, dt_vkalloc_type_t type);
 void dt_vkalloc_cleanup(dt_vkalloc_t *a);
 
 // allocate memory
@@ -49,3 +77,8 @@ void dt_vkalloc_nuke(dt_vkalloc_t *a);
 
 // perform an (expensive) internal consistency check in O(n^2)
 int dt_vkalloc_check(dt_vkalloc_t *a);
+
+// fragmentation statistics in the address range [0, vmsize) in O(n): returns
+// the free bytes and the largest free block in there. 1-largest/free is zero
+// if the free memory is not fragmented.
+void dt_vkalloc_stats(dt_vkalloc_t *a, uint64_t *free_bytes, uint64_t *largest_free);
@@ -24,6 +24,10 @@ typedef enum dt_connector_flags_t
   s_conn_feedback      = 4,  // this connection is only in between frames (written frame 1 and read frame 2)
   s_conn_dynamic_array = 8,  // dynamically allocated array connector, contents can change during animation
   s_conn_protected     = 16, // flag this connector for rewrites/accumulation/don't overwrite with other buffers
+  s_conn_cached        = 32, // output is read downstream of the active module, keep resident for incremental runs
+  s_conn_deferred      = 64, // sink: write_sink() gets the result of an earlier frame, the run doesn't wait for the gpu
+  s_conn_compact       = 128,// rgba f16 output without alpha or negative values, packed to 32 bits with cfg precision:compact
+  s_conn_bind          = 256,// ssbo input holding the values of a parameter, see dt_module_bind()
 }
 dt_connector_flags_t;
 
@@ -81,6 +85,9 @@ typedef struct dt_connector_t
 
   // information about buffer dimensions transported here:
   dt_roi_t roi;
+  // inputs of nodes: region x, y, wd, ht of the connected output this node reads
+  // at most, all of it if wd == 0. nodes upstream skip the rest (see ab).
+  int32_t read_rect[4];
 
   // if the output/write connector holds an array and the entries have different size:
   uint32_t     *array_dim;        // or 0 if all have the same size of the roi
@@ -92,6 +99,15 @@ typedef struct dt_connector_t
 
   // buffer associated with this in case it connects nodes:
   uint64_t offset_staging, size_staging;
+  // if non-zero, sources hold a second staging slot at this offset for odd frames,
+  // so read_source() of the next frame can run while the gpu still copies this one.
+  uint64_t stride_staging;
+  // sources may set these in modify_roi_out() to write padded rows to staging
+  // memory: rows are staging_row_length pixels apart (>= roi.wd), and the
+  // image starts staging_skip pixels into the buffer. the upload picks out the
+  // roi, so read_source() can copy a pitched buffer in one go. 0 means packed.
+  uint32_t staging_row_length;
+  uint32_t staging_skip;
   // mem object for allocator:
   // while this may seem duplicate with offset/size, it may be freed already
   // and the offset and size are still valid for successive runs through the
@@ -111,6 +127,7 @@ typedef struct dt_connector_t
   // and makes use of the node->conn_image index list.
 
   VkBuffer      staging;     // for sources and sinks
+  VkDeviceMemory mem_external; // imported dma-buf backing the staging buffer of a source, or 0
 
   const char   *tooltip;     // tooltip extracted from docs
 }
@@ -150,6 +167,7 @@ dt_connector_error_str(const int err)
     case 10: return "channels do not match";
     case 11: return "format does not match";
     case 12: return "connection would be cyclic";
+    case 13: return "parameter can not be bound";
     default: return "";
   }
 }
@@ -2,49 +2,19 @@
 
 // detect cycles in the graph before actually performing the connection
 
-// recursive helper
-static inline int
-dt_connection_is_cyclic_rec(
-    dt_graph_t *g,
-    const int   mid,
-    int        *visited,
-    int        *stack,
-    const int   m0_extra)
-{
-  if(mid < 0) return 0;
-  if(!visited[mid])
-  {
-    visited[mid] = 1;
-    stack  [mid] = 1;
-    if(m0_extra >= 0)
-    { // test extra connection that is not actually on the graph yet:
-      if(!visited[m0_extra] && dt_connection_is_cyclic_rec(g, m0_extra, visited, stack, -1))
-        return 1;
-      else if(stack[m0_extra])
-        return 1;
-    }
-    for(int c=0;c<g->module[mid].num_connectors;c++)
-    {
-      dt_connector_t *cn = g->module[mid].connector+c;
-      if((cn->type == dt_token("read") || cn->type == dt_token("sink")) &&
-        !(cn->flags & s_conn_feedback))
-      { // don't visit feedback connectors, these don't constitute cycles
-        int m0 = cn->connected_mi;
-        if(m0 < 0) continue; // disconnected, may be fine
-        if(!visited[m0] && dt_connection_is_cyclic_rec(g, m0, visited, stack, -1))
-          return 1;
-        else if(stack[m0])
-          return 1;
-      }
-    }
-  }
-  stack[mid] = 0;
-  return 0;
-}
+// the modules are kept in a topological order: every (non-feedback) connection
+// leads from a lower to a higher position in graph->topo_module[]. appended
+// modules go to the end, removing connections never breaks the order. only a
+// new connection pointing backwards needs work: the modules in between are
+// swept once forward to find everything downstream of m1 and once backward to
+// find everything upstream of m0. if m0 is downstream of m1 the connection
+// closes a cycle. if not, the upstream set is moved in front of the downstream
+// set, reusing their positions (pearce and kelly 2006). the cost is bounded by
+// the number of modules between the two positions, not by the size of the graph.
 
 // we know the graph has no cycles.
-// the only one can occur due to the new connection
-// so we need to pull only on the m1 module
+// the only one can occur due to the new connection m0 -> m1.
+// returns 1 if it would close a cycle, otherwise makes room for it in the order.
 static inline int
 dt_connection_is_cyclic(
     dt_graph_t *g,
@@ -53,13 +23,56 @@ dt_connection_is_cyclic(
     const int   m1,
     const int   c1)
 {
-  int visited[200] = {0};
-  int stack  [200] = {0};
-  assert(g->num_modules < sizeof(visited)/sizeof(visited[0]));
-  // if(!visited[m1] &&// only testing one, cannot happen
-  // in the general case need to test for all modules
-  if(dt_connection_is_cyclic_rec(g, m1, visited, stack, m0))
-    return 1;
+  if(m0 < 0 || m1 < 0) return 0; // disconnecting is always fine
+  if(m0 == m1) return 1;
+  const int lb = g->module[m1].topo, ub = g->module[m0].topo;
+  if(ub < lb) return 0; // already in order
+
+  uint8_t mark[200] = {0}; // 1: downstream of m1, 2: upstream of m0, indexed by position-lb
+  assert(ub - lb < sizeof(mark)/sizeof(mark[0]));
+  mark[0] = 1;
+  for(int p=lb+1;p<=ub;p++)
+  { // forward: inputs come from lower positions, so one sweep sees all paths from m1
+    const dt_module_t *mod = g->module + g->topo_module[p];
+    for(int c=0;c<mod->num_connectors&&!mark[p-lb];c++)
+    {
+      const dt_connector_t *cn = mod->connector+c;
+      if((cn->type == dt_token("read") || cn->type == dt_token("sink")) &&
+         !(cn->flags & s_conn_feedback) && cn->connected_mi >= 0)
+      {
+        const int q = g->module[cn->connected_mi].topo;
+        if(q >= lb && q < p && mark[q-lb] == 1) mark[p-lb] = 1;
+      }
+    }
+  }
+  if(mark[ub-lb]) return 1; // m0 is downstream of m1
+
+  mark[ub-lb] = 2;
+  for(int p=ub;p>lb;p--)
+  { // backward: everything m0 pulls from between the two positions
+    if(mark[p-lb] != 2) continue;
+    const dt_module_t *mod = g->module + g->topo_module[p];
+    for(int c=0;c<mod->num_connectors;c++)
+    {
+      const dt_connector_t *cn = mod->connector+c;
+      if((cn->type == dt_token("read") || cn->type == dt_token("sink")) &&
+         !(cn->flags & s_conn_feedback) && cn->connected_mi >= 0)
+      {
+        const int q = g->module[cn->connected_mi].topo;
+        if(q > lb && q < p) mark[q-lb] = 2;
+      }
+    }
+  }
+
+  // upstream set first, then downstream set, each in their previous order:
+  int perm[200], cnt = 0;
+  for(int p=lb;p<=ub;p++) if(mark[p-lb] == 2) perm[cnt++] = g->topo_module[p];
+  for(int p=lb;p<=ub;p++) if(mark[p-lb] == 1) perm[cnt++] = g->topo_module[p];
+  for(int p=lb,k=0;p<=ub;p++) if(mark[p-lb])
+  {
+    g->topo_module[p] = perm[k];
+    g->module[perm[k++]].topo = p;
+  }
   return 0;
 }
 
@@ -17,7 +17,9 @@ pipe/draw.h\
 pipe/global.h\
 pipe/graph.h\
 pipe/graph-io.h\
+pipe/graph-layout.h\
 pipe/graph-print.h\
+pipe/graph-srccache.h\
 pipe/graph-export.h\
 pipe/graph-traverse.inc\
 pipe/modules/api.h\
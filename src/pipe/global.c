@@ -5,6 +5,8 @@
 #include "core/log.h"
 #include "core/fs.h"
 #include "modules/api.h"
+#include "qvk/qvk.h"
+#include "db/hash.h"
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -12,6 +14,7 @@
 #include <unistd.h>
 #include <dlfcn.h>
 #include <stdio.h>
+#include <errno.h>
 #include <locale.h>
 
 #ifdef __FreeBSD__
@@ -82,45 +85,68 @@ read_param_config_ascii(
   return p;
 }
 
+// dlopen the module's library and look up its callbacks. only done once a
+// graph instantiates the module, most modules are never used in a session.
+void
+dt_module_so_dlopen(dt_module_so_t *mod)
+{
+  if(__atomic_load_n(&mod->dlopened, __ATOMIC_ACQUIRE)) return;
+  threads_mutex_lock(&dt_pipe.shader_mutex);
+  if(!mod->dlopened)
+  {
+    char filename[3*PATH_MAX];
+    snprintf(filename, sizeof(filename), "%s/modules/%"PRItkn"/lib%"PRItkn".so", dt_pipe.basedir,
+        dt_token_str(mod->name), dt_token_str(mod->name));
+    struct stat statbuf;
+    if(!stat(filename, &statbuf))
+    {
+      mod->dlhandle = dlopen(filename, RTLD_LAZY | RTLD_LOCAL);
+      if(!mod->dlhandle)
+        dt_log(s_log_pipe|s_log_err, dlerror());
+    }
+    if(mod->dlhandle)
+    {
+      mod->create_nodes   = dlsym(mod->dlhandle, "create_nodes");
+      mod->modify_roi_out = dlsym(mod->dlhandle, "modify_roi_out");
+      mod->modify_roi_in  = dlsym(mod->dlhandle, "modify_roi_in");
+      mod->init           = dlsym(mod->dlhandle, "init");
+      mod->cleanup        = dlsym(mod->dlhandle, "cleanup");
+      mod->write_sink     = dlsym(mod->dlhandle, "write_sink");
+      mod->read_source    = dlsym(mod->dlhandle, "read_source");
+      mod->source_key     = dlsym(mod->dlhandle, "source_key");
+      mod->source_dmabuf  = dlsym(mod->dlhandle, "source_dmabuf");
+      mod->read_geo       = dlsym(mod->dlhandle, "read_geo");
+      mod->commit_params  = dlsym(mod->dlhandle, "commit_params");
+      mod->ui_callback    = dlsym(mod->dlhandle, "ui_callback");
+      mod->check_params   = dlsym(mod->dlhandle, "check_params");
+      mod->identity       = dlsym(mod->dlhandle, "identity");
+      mod->audio          = dlsym(mod->dlhandle, "audio");
+      mod->input          = dlsym(mod->dlhandle, "input");
+    }
+    __atomic_store_n(&mod->dlopened, 1, __ATOMIC_RELEASE);
+  }
+  threads_mutex_unlock(&dt_pipe.shader_mutex);
+}
+
+static inline int
+dt_module_so_skip(const char *dirname)
+{
+  return !strcmp(dirname, ".") || !strcmp(dirname, "..") || !strcmp(dirname, "shared");
+}
+
 static inline int
 dt_module_so_load(
     dt_module_so_t *mod,
     const char *dirname)
 {
-  if(!strcmp(dirname, ".") || !strcmp(dirname, "..") || !strcmp(dirname, "shared"))
-    return 1;
+  if(dt_module_so_skip(dirname)) return 1;
   memset(mod, 0, sizeof(*mod));
   mod->name = dt_token(dirname);
   char filename[3*PATH_MAX], line[PATH_MAX];
-  snprintf(filename, sizeof(filename), "%s/modules/%s/lib%s.so", dt_pipe.basedir, dirname, dirname);
-  mod->dlhandle = 0;
-  struct stat statbuf;
-  if(!stat(filename, &statbuf))
-  {
-    mod->dlhandle = dlopen(filename, RTLD_LAZY | RTLD_LOCAL);
-    if(!mod->dlhandle)
-      dt_log(s_log_pipe|s_log_err, dlerror());
-  }
-  if(mod->dlhandle)
-  {
-    mod->create_nodes   = dlsym(mod->dlhandle, "create_nodes");
-    mod->modify_roi_out = dlsym(mod->dlhandle, "modify_roi_out");
-    mod->modify_roi_in  = dlsym(mod->dlhandle, "modify_roi_in");
-    mod->init           = dlsym(mod->dlhandle, "init");
-    mod->cleanup        = dlsym(mod->dlhandle, "cleanup");
-    mod->write_sink     = dlsym(mod->dlhandle, "write_sink");
-    mod->read_source    = dlsym(mod->dlhandle, "read_source");
-    mod->read_geo       = dlsym(mod->dlhandle, "read_geo");
-    mod->commit_params  = dlsym(mod->dlhandle, "commit_params");
-    mod->ui_callback    = dlsym(mod->dlhandle, "ui_callback");
-    mod->check_params   = dlsym(mod->dlhandle, "check_params");
-    mod->audio          = dlsym(mod->dlhandle, "audio");
-    mod->input          = dlsym(mod->dlhandle, "input");
-  }
 
   // read default params:
   // read param name, type, cnt, default value + bounds
-  // allocate dynamically, this step here is not immediately perf critical
+  // allocate dynamically, the result is kept in the registry cache (see below)
   snprintf(filename, sizeof(filename), "%s/modules/%s/params", dt_pipe.basedir, dirname);
   FILE *f = fopen(filename, "rb");
   int i = 0;
@@ -390,9 +416,222 @@ compare_module_name(const void *a, const void *b)
   return strncmp(dt_token_str(ma->name), dt_token_str(mb->name), 8);
 }
 
+static inline int
+compare_dirname(const void *a, const void *b)
+{
+  return strcmp(a, b);
+}
+
+// the parsed metadata of all modules is kept in <cachedir>/modules.bin so
+// startup doesn't parse the ascii files of every module again. the cache is
+// valid as long as the stamp matches: a hash of the base directory and the
+// names, sizes and mtimes of all module directories and the files read above
+// (and the library, which changes whenever the modules are rebuilt).
+#define DT_REGISTRY_VERSION 1
+
+static uint64_t
+registry_stamp(char (*dirs)[64], int cnt)
+{
+  dt_hash_t h;
+  dt_hash_init(&h, DT_REGISTRY_VERSION);
+  dt_hash_update(&h, dt_pipe.basedir, strlen(dt_pipe.basedir));
+  const char *files[] = { "params", "params.ui", "ptooltips", "connectors", "ctooltips", 0 }; // 0 is the library
+  char filename[3*PATH_MAX];
+  for(int i=0;i<cnt;i++)
+  {
+    dt_hash_update(&h, dirs[i], strlen(dirs[i])+1);
+    for(int f=0;f<LENGTH(files);f++)
+    {
+      if(files[f]) snprintf(filename, sizeof(filename), "%s/modules/%s/%s", dt_pipe.basedir, dirs[i], files[f]);
+      else snprintf(filename, sizeof(filename), "%s/modules/%s/lib%s.so", dt_pipe.basedir, dirs[i], dirs[i]);
+      struct stat sb;
+      int64_t st[3] = {0};
+      if(!stat(filename, &sb)) st[0] = sb.st_mtim.tv_sec, st[1] = sb.st_mtim.tv_nsec, st[2] = sb.st_size;
+      dt_hash_update(&h, st, sizeof(st));
+    }
+  }
+  return dt_hash_final(&h);
+}
+
+static void
+registry_write_str(FILE *f, const char *str, size_t len)
+{
+  const uint32_t l = str ? len : -1u;
+  fwrite(&l, sizeof(l), 1, f);
+  if(str) fwrite(str, 1, len, f);
+}
+
+static size_t
+registry_combo_len(const char *data)
+{ // zero separated entries, terminated by two zeros
+  size_t len = 0;
+  while(data[len] || data[len+1]) len++;
+  return len+2;
+}
+
+static void
+registry_write(uint64_t stamp)
+{
+  char cachedir[PATH_MAX], filename[PATH_MAX+30], tmpname[PATH_MAX+40];
+  fs_cachedir(cachedir, sizeof(cachedir));
+  fs_mkdir(cachedir, 0755); // may exist already
+  snprintf(filename, sizeof(filename), "%s/modules.bin", cachedir);
+  snprintf(tmpname, sizeof(tmpname), "%s.XXXXXX", filename);
+  const int fd = mkstemp(tmpname);
+  if(fd == -1) return;
+  FILE *f = fdopen(fd, "wb");
+  if(!f) { close(fd); unlink(tmpname); return; }
+  const uint32_t header[] = { DT_REGISTRY_VERSION, dt_pipe.num_modules };
+  fwrite(&stamp, sizeof(stamp), 1, f);
+  fwrite(header, sizeof(header), 1, f);
+  for(int m=0;m<dt_pipe.num_modules;m++)
+  {
+    const dt_module_so_t *mod = dt_pipe.module + m;
+    const int32_t mh[] = { mod->has_inout_chain, mod->num_connectors, mod->num_params };
+    fwrite(&mod->name, sizeof(mod->name), 1, f);
+    fwrite(mh, sizeof(mh), 1, f);
+    for(int i=0;i<mod->num_connectors;i++)
+    {
+      const dt_connector_t *c = mod->connector + i;
+      const dt_token_t t[] = { c->name, c->type, c->chan, c->format };
+      fwrite(t, sizeof(t), 1, f);
+      registry_write_str(f, c->tooltip, c->tooltip ? strlen(c->tooltip) : 0);
+    }
+    for(int i=0;i<mod->num_params;i++)
+    {
+      const dt_ui_param_t *p = mod->param[i];
+      const dt_widget_descriptor_t *w = &p->widget;
+      const dt_token_t t[] = { p->name, p->type, w->type };
+      const int32_t v[] = { p->cnt, p->offset, w->grpid, w->mode, w->cntid };
+      const float r[] = { w->min, w->max };
+      fwrite(t, sizeof(t), 1, f);
+      fwrite(v, sizeof(v), 1, f);
+      fwrite(r, sizeof(r), 1, f);
+      fwrite(p->val, 1, dt_ui_param_size(p->type, p->cnt), f);
+      registry_write_str(f, w->data, w->data ? registry_combo_len(w->data) : 0);
+      registry_write_str(f, p->tooltip, p->tooltip ? strlen(p->tooltip) : 0);
+    }
+  }
+  int err = ferror(f);
+  err |= fclose(f);
+  if(err || rename(tmpname, filename)) unlink(tmpname);
+}
+
+typedef struct registry_reader_t
+{
+  const uint8_t *p, *end;
+  int err;
+}
+registry_reader_t;
+
+static inline void
+registry_read(registry_reader_t *r, void *dst, size_t len)
+{
+  if(r->err || (size_t)(r->end - r->p) < len) { r->err = 1; memset(dst, 0, len); return; }
+  memcpy(dst, r->p, len);
+  r->p += len;
+}
+
+static char *
+registry_read_str(registry_reader_t *r)
+{
+  uint32_t l;
+  registry_read(r, &l, sizeof(l));
+  if(r->err || l == -1u) return 0;
+  if((size_t)(r->end - r->p) < l) { r->err = 1; return 0; }
+  char *str = malloc(l+1);
+  memcpy(str, r->p, l);
+  str[l] = 0;
+  r->p += l;
+  return str;
+}
+
+// fill dt_pipe.module from the cache, returns non-zero if it is missing or stale
+static int
+registry_load(uint64_t stamp)
+{
+  char cachedir[PATH_MAX], filename[PATH_MAX+30];
+  fs_cachedir(cachedir, sizeof(cachedir));
+  snprintf(filename, sizeof(filename), "%s/modules.bin", cachedir);
+  size_t len = 0;
+  uint8_t *buf = 0;
+  FILE *f = fopen(filename, "rb");
+  if(!f) return 1;
+  fseek(f, 0, SEEK_END);
+  len = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  buf = malloc(len);
+  if(fread(buf, 1, len, f) != len) len = 0;
+  fclose(f);
+  registry_reader_t r = { .p = buf, .end = buf + len };
+  uint64_t s;
+  uint32_t header[2];
+  registry_read(&r, &s, sizeof(s));
+  registry_read(&r, header, sizeof(header));
+  if(r.err || s != stamp || header[0] != DT_REGISTRY_VERSION || header[1] > dt_pipe.num_modules)
+  {
+    free(buf);
+    return 1;
+  }
+  int m = 0;
+  for(;m<header[1] && !r.err;m++)
+  {
+    dt_module_so_t *mod = dt_pipe.module + m;
+    memset(mod, 0, sizeof(*mod));
+    int32_t mh[3];
+    registry_read(&r, &mod->name, sizeof(mod->name));
+    registry_read(&r, mh, sizeof(mh));
+    if(mh[1] < 0 || mh[1] > DT_MAX_CONNECTORS || mh[2] < 0 || mh[2] > LENGTH(mod->param)) { r.err = 1; break; }
+    mod->has_inout_chain = mh[0];
+    for(;mod->num_connectors<mh[1] && !r.err;mod->num_connectors++)
+    {
+      dt_connector_t *c = mod->connector + mod->num_connectors;
+      dt_token_t t[4];
+      registry_read(&r, t, sizeof(t));
+      c->name = t[0]; c->type = t[1]; c->chan = t[2]; c->format = t[3];
+      c->tooltip = registry_read_str(&r);
+    }
+    for(;mod->num_params<mh[2] && !r.err;)
+    {
+      dt_token_t t[3];
+      int32_t v[5];
+      float rg[2];
+      registry_read(&r, t, sizeof(t));
+      registry_read(&r, v, sizeof(v));
+      registry_read(&r, rg, sizeof(rg));
+      const size_t size = dt_ui_param_size(t[1], v[0]);
+      if(r.err || v[0] < 0 || (size_t)(r.end - r.p) < size) { r.err = 1; break; }
+      dt_ui_param_t *p = malloc(sizeof(*p) + size);
+      mod->param[mod->num_params++] = p;
+      p->name = t[0]; p->type = t[1]; p->cnt = v[0]; p->offset = v[1];
+      registry_read(&r, p->val, size);
+      p->widget = (dt_widget_descriptor_t) {
+        .type  = t[2],
+        .min   = rg[0],
+        .max   = rg[1],
+        .grpid = v[2],
+        .mode  = v[3],
+        .cntid = v[4],
+      };
+      p->widget.data = registry_read_str(&r);
+      p->tooltip     = registry_read_str(&r);
+    }
+  }
+  free(buf);
+  if(r.err)
+  { // truncated or garbage, parse the ascii files instead
+    for(int i=0;i<m;i++) dt_module_so_unload(dt_pipe.module + i);
+    return 1;
+  }
+  dt_pipe.num_modules = header[1];
+  return 0;
+}
+
 int dt_pipe_global_init()
 {
   memset(&dt_pipe, 0, sizeof(dt_pipe));
+  threads_mutex_init(&dt_pipe.shader_mutex, 0);
+  threads_mutex_init(&dt_pipe.staging_mutex, 0);
   (void)setlocale(LC_ALL, "C"); // make sure we write and parse floats correctly
   // setup search directory
   fs_basedir(dt_pipe.basedir, sizeof(dt_pipe.basedir));
@@ -406,25 +645,31 @@ int dt_pipe_global_init()
     dt_log(s_log_pipe, "[global init] cannot open modules directory!");
     return 1;
   }
-  int i = 0;
-  while((dp = readdir(fd)))
-    if(dp->d_type == DT_DIR) i++;
-  dt_pipe.num_modules = i;
-  dt_pipe.module = malloc(sizeof(dt_module_so_t)*dt_pipe.num_modules);
-  i = 0;
-  rewinddir(fd);
+  int cnt = 0, max = 0;
+  char (*dirs)[64] = 0;
   while((dp = readdir(fd)))
   {
-    if(dp->d_type == DT_DIR)
-    {
-      int err = dt_module_so_load(dt_pipe.module + i, dp->d_name);
-      if(!err) i++;
-    }
+    if(dp->d_type != DT_DIR || dt_module_so_skip(dp->d_name) || strlen(dp->d_name) >= sizeof(dirs[0])) continue;
+    if(cnt >= max) dirs = realloc(dirs, sizeof(dirs[0])*(max = MAX(128, 2*max)));
+    snprintf(dirs[cnt++], sizeof(dirs[0]), "%s", dp->d_name);
   }
-  dt_pipe.num_modules = i;
   closedir(fd);
-  // now sort modules alphabetically for convenience in gui later:
-  qsort(dt_pipe.module, dt_pipe.num_modules, sizeof(dt_pipe.module[0]), &compare_module_name);
+  qsort(dirs, cnt, sizeof(dirs[0]), &compare_dirname);
+  dt_pipe.num_modules = cnt;
+  dt_pipe.module = malloc(sizeof(dt_module_so_t)*MAX(1, cnt));
+  const uint64_t stamp = registry_stamp(dirs, cnt);
+  if(registry_load(stamp))
+  {
+    int i = 0;
+    for(int k=0;k<cnt;k++)
+      if(!dt_module_so_load(dt_pipe.module + i, dirs[k])) i++;
+    dt_pipe.num_modules = i;
+    // now sort modules alphabetically for convenience in gui later:
+    qsort(dt_pipe.module, dt_pipe.num_modules, sizeof(dt_pipe.module[0]), &compare_module_name);
+    registry_write(stamp);
+    dt_log(s_log_pipe, "[global init] parsed %d modules, wrote the registry cache", dt_pipe.num_modules);
+  }
+  free(dirs);
   return 0;
 }
 
@@ -433,5 +678,540 @@ void dt_pipe_global_cleanup()
   for(int i=0;i<dt_pipe.num_modules;i++)
     dt_module_so_unload(dt_pipe.module + i);
   free(dt_pipe.module);
+  free(dt_pipe.shader); // the vulkan objects are gone by now, see dt_pipe_shader_cleanup()
+  free(dt_pipe.localsize);
+  free(dt_pipe.nprof);
+  threads_mutex_destroy(&dt_pipe.shader_mutex);
+  threads_mutex_destroy(&dt_pipe.staging_mutex);
   memset(&dt_pipe, 0, sizeof(dt_pipe));
 }
+
+static inline void *
+read_file(const char *filename, size_t *len)
+{
+  FILE *f = fopen(filename, "rb");
+  if(!f)
+  {
+    dt_log(s_log_qvk|s_log_err, "failed to read shader '%s': %s!",
+        filename, strerror(errno));
+    return 0;
+  }
+  fseek(f, 0, SEEK_END);
+  const size_t filesize = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  char *file = malloc(filesize+1);
+
+  size_t rd = fread(file, sizeof(char), filesize, f);
+  file[filesize] = 0;
+  if(rd != filesize)
+  {
+    free(file);
+    file = 0;
+    fclose(f);
+    return 0;
+  }
+  if(len) *len = filesize;
+  fclose(f);
+  return file;
+}
+
+// does the spir-v declare the work group size via specialisation constants?
+// glslang emits local_size_x_id as an OpSpecConstantComposite decorated
+// BuiltIn WorkgroupSize, fixed sizes are OpConstantComposite or an execution mode.
+static int
+spirv_tunable(const uint32_t *code, size_t len)
+{
+  const size_t n = len / sizeof(uint32_t);
+  if(n < 5 || code[0] != 0x07230203u) return 0;
+  uint32_t wgs = 0;
+  for(size_t i=5;i<n;)
+  {
+    const uint32_t op = code[i] & 0xffff, wc = code[i] >> 16;
+    if(!wc || i + wc > n) return 0;
+    if(op == 71 && wc >= 4 && code[i+2] == 11 && code[i+3] == 25) // OpDecorate BuiltIn WorkgroupSize
+      wgs = code[i+1];
+    else if(op == 51 && wc >= 3 && wgs && code[i+2] == wgs)       // OpSpecConstantComposite
+      return 1;
+    i += wc;
+  }
+  return 0;
+}
+
+// collect the specialisation constants other than the work group size, by the
+// OpName of the constant decorated with SpecId (which glslang keeps, unless the
+// spir-v is stripped).
+static void
+spirv_spec(const uint32_t *code, size_t len, dt_pipe_shader_t *s)
+{
+  const size_t n = len / sizeof(uint32_t);
+  uint32_t target[DT_PIPE_MAX_SPEC];
+  s->spec_cnt = 0;
+  if(n < 5 || code[0] != 0x07230203u) return;
+  for(size_t i=5;i<n;)
+  {
+    const uint32_t op = code[i] & 0xffff, wc = code[i] >> 16;
+    if(!wc || i + wc > n) break;
+    if(op == 71 && wc >= 4 && code[i+2] == 1 && code[i+3] >= 2 && s->spec_cnt < DT_PIPE_MAX_SPEC)
+    { // OpDecorate SpecId
+      target[s->spec_cnt] = code[i+1];
+      s->spec_id[s->spec_cnt++] = code[i+3];
+    }
+    i += wc;
+  }
+  for(size_t i=5;i<n && s->spec_cnt;)
+  {
+    const uint32_t op = code[i] & 0xffff, wc = code[i] >> 16;
+    if(!wc || i + wc > n) break;
+    if(op == 5 && wc >= 3) // OpName
+      for(int k=0;k<s->spec_cnt;k++)
+        if(target[k] == code[i+1])
+        {
+          const char *name = (const char *)(code + i + 2);
+          if(strnlen(name, 4*(wc-2)) <= 8) s->spec_name[k] = dt_token(name);
+        }
+    i += wc;
+  }
+  int j = 0; // drop the constants we can't match to a parameter
+  for(int k=0;k<s->spec_cnt;k++)
+    if(s->spec_name[k])
+    {
+      s->spec_name[j] = s->spec_name[k];
+      s->spec_id[j++] = s->spec_id[k];
+    }
+  s->spec_cnt = j;
+}
+
+VkResult
+dt_pipe_shader_module(
+    dt_token_t      node,
+    dt_token_t      kernel,
+    const char     *type,
+    VkShaderModule *shader_module)
+{
+  const dt_token_t tt = dt_token(type);
+  VkResult res = VK_SUCCESS;
+  threads_mutex_lock(&dt_pipe.shader_mutex);
+  for(int i=0;i<dt_pipe.num_shaders;i++)
+  { // linear search is fine, we'll only have a few hundred of these
+    const dt_pipe_shader_t *s = dt_pipe.shader + i;
+    if(s->node == node && s->kernel == kernel && s->type == tt)
+    {
+      *shader_module = s->module;
+      threads_mutex_unlock(&dt_pipe.shader_mutex);
+      return s->module ? VK_SUCCESS : VK_ERROR_INVALID_EXTERNAL_HANDLE;
+    }
+  }
+
+  // not found, load from disk:
+  char filename[PATH_MAX+100] = {0};
+  snprintf(filename, sizeof(filename), "%s/modules/%"PRItkn"/%"PRItkn".%s.spv",
+      dt_pipe.basedir, dt_token_str(node), dt_token_str(kernel), type);
+
+  *shader_module = VK_NULL_HANDLE;
+  size_t len;
+  int tunable = 0;
+  dt_pipe_shader_t spec = {0};
+  void *data = read_file(filename, &len);
+  if(data)
+  {
+    tunable = tt == dt_token("comp") && spirv_tunable(data, len);
+    if(tt == dt_token("comp")) spirv_spec(data, len, &spec);
+    VkShaderModuleCreateInfo sm_info = {
+      .sType    = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+      .codeSize = len,
+      .pCode    = data
+    };
+    res = vkCreateShaderModule(qvk.device, &sm_info, 0, shader_module);
+    free(data);
+    if(res != VK_SUCCESS)
+    {
+      dt_log(s_log_qvk|s_log_err, "error %s creating shader module %s!", qvk_result_to_string(res), filename);
+      *shader_module = VK_NULL_HANDLE;
+      threads_mutex_unlock(&dt_pipe.shader_mutex);
+      return res; // don't remember this one, might be out of memory right now
+    }
+  }
+  else res = VK_ERROR_INVALID_EXTERNAL_HANDLE; // also remember missing files so we don't hit the disk again
+
+  if(dt_pipe.num_shaders >= dt_pipe.max_shaders)
+  {
+    dt_pipe.max_shaders = MAX(256, 2*dt_pipe.max_shaders);
+    dt_pipe.shader = realloc(dt_pipe.shader, sizeof(dt_pipe_shader_t)*dt_pipe.max_shaders);
+  }
+  dt_pipe.shader[dt_pipe.num_shaders++] = (dt_pipe_shader_t) {
+    .node   = node,
+    .kernel = kernel,
+    .type   = tt,
+    .module = *shader_module,
+    .tunable = tunable,
+  };
+  dt_pipe_shader_t *s = dt_pipe.shader + dt_pipe.num_shaders - 1;
+  s->spec_cnt = spec.spec_cnt;
+  memcpy(s->spec_name, spec.spec_name, sizeof(s->spec_name));
+  memcpy(s->spec_id,   spec.spec_id,   sizeof(s->spec_id));
+  threads_mutex_unlock(&dt_pipe.shader_mutex);
+  return res;
+}
+
+int
+dt_pipe_shader_exists(
+    dt_token_t node,
+    dt_token_t kernel)
+{
+  char filename[PATH_MAX+100] = {0};
+  snprintf(filename, sizeof(filename), "%s/modules/%"PRItkn"/%"PRItkn".comp.spv",
+      dt_pipe.basedir, dt_token_str(node), dt_token_str(kernel));
+  return access(filename, R_OK) == 0;
+}
+
+void dt_pipe_shader_cleanup()
+{ // all device objects we hold, before the device goes
+  threads_mutex_lock(&dt_pipe.shader_mutex);
+  for(int i=0;i<dt_pipe.num_shaders;i++)
+    if(dt_pipe.shader[i].module)
+      vkDestroyShaderModule(qvk.device, dt_pipe.shader[i].module, 0);
+  dt_pipe.num_shaders = 0;
+  threads_mutex_unlock(&dt_pipe.shader_mutex);
+}
+
+void dt_pipe_staging_cleanup()
+{
+  threads_mutex_lock(&dt_pipe.staging_mutex);
+  if(dt_pipe.staging_spare) vkFreeMemory(qvk.device, dt_pipe.staging_spare, 0); // unmaps, too
+  dt_pipe.staging_spare = 0;
+  dt_pipe.staging_spare_mapped = 0;
+  dt_pipe.staging_spare_size = 0;
+  threads_mutex_unlock(&dt_pipe.staging_mutex);
+}
+
+int
+dt_pipe_shader_tunable(
+    dt_token_t node,
+    dt_token_t kernel)
+{
+  VkShaderModule module;
+  if(dt_pipe_shader_module(node, kernel, "comp", &module) != VK_SUCCESS) return 0;
+  int tunable = 0;
+  threads_mutex_lock(&dt_pipe.shader_mutex);
+  for(int i=0;i<dt_pipe.num_shaders;i++)
+  {
+    const dt_pipe_shader_t *s = dt_pipe.shader + i;
+    if(s->node == node && s->kernel == kernel && s->type == dt_token("comp"))
+    {
+      tunable = s->tunable;
+      break;
+    }
+  }
+  threads_mutex_unlock(&dt_pipe.shader_mutex);
+  return tunable;
+}
+
+int
+dt_pipe_shader_spec(
+    dt_token_t node,
+    dt_token_t kernel,
+    dt_token_t name[DT_PIPE_MAX_SPEC],
+    uint32_t   id  [DT_PIPE_MAX_SPEC])
+{
+  VkShaderModule module;
+  if(dt_pipe_shader_module(node, kernel, "comp", &module) != VK_SUCCESS) return 0;
+  int cnt = 0;
+  threads_mutex_lock(&dt_pipe.shader_mutex);
+  for(int i=0;i<dt_pipe.num_shaders;i++)
+  {
+    const dt_pipe_shader_t *s = dt_pipe.shader + i;
+    if(s->node == node && s->kernel == kernel && s->type == dt_token("comp"))
+    {
+      cnt = s->spec_cnt;
+      memcpy(name, s->spec_name, sizeof(s->spec_name[0])*cnt);
+      memcpy(id,   s->spec_id,   sizeof(s->spec_id[0])*cnt);
+      break;
+    }
+  }
+  threads_mutex_unlock(&dt_pipe.shader_mutex);
+  return cnt;
+}
+
+// the sizes depend on the gpu, so the file name contains vendor and device id
+static void
+localsize_filename(char *filename, size_t maxlen)
+{
+  VkPhysicalDeviceProperties prop;
+  vkGetPhysicalDeviceProperties(qvk.physical_device, &prop);
+  char cachedir[PATH_MAX];
+  fs_cachedir(cachedir, sizeof(cachedir));
+  snprintf(filename, maxlen, "%s/localsize-%04x-%04x.txt", cachedir, prop.vendorID, prop.deviceID);
+}
+
+static dt_pipe_localsize_t *
+localsize_get(dt_token_t node, dt_token_t kernel)
+{ // call with the shader mutex held
+  for(int i=0;i<dt_pipe.num_localsize;i++)
+    if(dt_pipe.localsize[i].node == node && dt_pipe.localsize[i].kernel == kernel)
+      return dt_pipe.localsize + i;
+  if(dt_pipe.num_localsize >= dt_pipe.max_localsize)
+  {
+    dt_pipe.max_localsize = MAX(64, 2*dt_pipe.max_localsize);
+    dt_pipe.localsize = realloc(dt_pipe.localsize, sizeof(dt_pipe_localsize_t)*dt_pipe.max_localsize);
+  }
+  dt_pipe_localsize_t *l = dt_pipe.localsize + dt_pipe.num_localsize++;
+  *l = (dt_pipe_localsize_t){ .node = node, .kernel = kernel };
+  return l;
+}
+
+static void
+localsize_load()
+{ // call with the shader mutex held. lines are: node kernel x y
+  if(dt_pipe.localsize_loaded) return;
+  dt_pipe.localsize_loaded = 1;
+  char filename[PATH_MAX+30];
+  localsize_filename(filename, sizeof(filename));
+  FILE *f = fopen(filename, "rb");
+  if(!f) return;
+  char node[20], kernel[20];
+  uint32_t x, y;
+  while(fscanf(f, "%8s %8s %u %u", node, kernel, &x, &y) == 4)
+  {
+    if(x*y < 1 || x*y > 1024) continue;
+    dt_pipe_localsize_t *l = localsize_get(dt_token(node), dt_token(kernel));
+    l->size[0] = x;
+    l->size[1] = y;
+  }
+  fclose(f);
+  dt_log(s_log_pipe, "read %u tuned work group sizes from %s", dt_pipe.num_localsize, filename);
+}
+
+void
+dt_pipe_localsize(
+    dt_token_t node,
+    dt_token_t kernel,
+    uint32_t   size[2])
+{
+  size[0] = DT_LOCAL_SIZE_X;
+  size[1] = DT_LOCAL_SIZE_Y;
+  if(!dt_pipe_shader_tunable(node, kernel)) return;
+  threads_mutex_lock(&dt_pipe.shader_mutex);
+  if(dt_pipe.localsize_force[0])
+  {
+    size[0] = dt_pipe.localsize_force[0];
+    size[1] = dt_pipe.localsize_force[1];
+  }
+  else
+  {
+    localsize_load();
+    for(int i=0;i<dt_pipe.num_localsize;i++)
+    {
+      const dt_pipe_localsize_t *l = dt_pipe.localsize + i;
+      if(l->node == node && l->kernel == kernel && l->size[0])
+      {
+        size[0] = l->size[0];
+        size[1] = l->size[1];
+        break;
+      }
+    }
+  }
+  threads_mutex_unlock(&dt_pipe.shader_mutex);
+}
+
+void
+dt_pipe_localsize_set(
+    dt_token_t      node,
+    dt_token_t      kernel,
+    const uint32_t  size[2])
+{
+  threads_mutex_lock(&dt_pipe.shader_mutex);
+  localsize_load(); // keep the other entries
+  dt_pipe_localsize_t *l = localsize_get(node, kernel);
+  l->size[0] = size[0];
+  l->size[1] = size[1];
+  threads_mutex_unlock(&dt_pipe.shader_mutex);
+}
+
+int
+dt_pipe_localsize_write()
+{
+  char filename[PATH_MAX+30], dir[PATH_MAX+30];
+  localsize_filename(filename, sizeof(filename));
+  snprintf(dir, sizeof(dir), "%s", filename);
+  fs_dirname(dir);
+  fs_mkdir(dir, 0755); // may exist already
+  FILE *f = fopen(filename, "wb");
+  if(!f)
+  {
+    dt_log(s_log_pipe|s_log_err, "could not write %s!", filename);
+    return 1;
+  }
+  threads_mutex_lock(&dt_pipe.shader_mutex);
+  for(int i=0;i<dt_pipe.num_localsize;i++)
+  {
+    const dt_pipe_localsize_t *l = dt_pipe.localsize + i;
+    if(l->size[0]) fprintf(f, "%"PRItkn" %"PRItkn" %u %u\n",
+        dt_token_str(l->node), dt_token_str(l->kernel), l->size[0], l->size[1]);
+  }
+  threads_mutex_unlock(&dt_pipe.shader_mutex);
+  fclose(f);
+  return 0;
+}
+
+static int
+compare_nprof(const void *a, const void *b)
+{
+  const dt_pipe_nprof_t *na = a, *nb = b;
+  return na->key < nb->key ? -1 : na->key > nb->key;
+}
+
+static void
+nprof_load_dir(const char *dirname)
+{ // call with the shader mutex held
+  DIR *dp = opendir(dirname);
+  if(!dp) return;
+  struct dirent *ep;
+  while((ep = readdir(dp)))
+  {
+    const char *ext = strrchr(ep->d_name, '.');
+    if(!ext || strcmp(ext, ".nprof")) continue;
+    char filename[PATH_MAX+300];
+    snprintf(filename, sizeof(filename), "%s/%s", dirname, ep->d_name);
+    FILE *f = fopen(filename, "rb");
+    if(!f) continue;
+    float a = 0.0f, b = 0.0f;
+    const int num = fscanf(f, "%g %g", &a, &b);
+    fclose(f);
+    if(num != 2) continue;
+    const uint64_t key = hash64_l(ep->d_name, ext - ep->d_name);
+    int dup = 0; // the first directory wins
+    for(int i=0;i<dt_pipe.num_nprof&&!dup;i++) dup = dt_pipe.nprof[i].key == key;
+    if(dup) continue;
+    if((dt_pipe.num_nprof & (dt_pipe.num_nprof-1)) == 0) // grow at powers of two
+      dt_pipe.nprof = realloc(dt_pipe.nprof, sizeof(dt_pipe_nprof_t)*MAX(64, 2*dt_pipe.num_nprof));
+    dt_pipe.nprof[dt_pipe.num_nprof++] = (dt_pipe_nprof_t){ .key = key, .a = a, .b = b };
+  }
+  closedir(dp);
+}
+
+// the parsed profiles are cached in nprof.bin in the cache directory, so that
+// many processes starting at once (parallel cli workers) don't all open and
+// scan every profile file. the stamp covers names, mtimes and sizes as seen by
+// readdir and stat, the same way the module registry is validated.
+static uint64_t
+nprof_stamp(char (*dirs)[PATH_MAX+20], int cnt)
+{
+  dt_hash_t h;
+  dt_hash_init(&h, sizeof(dt_pipe_nprof_t));
+  char filename[PATH_MAX+300];
+  for(int i=0;i<cnt;i++)
+  {
+    dt_hash_update(&h, dirs[i], strlen(dirs[i])+1);
+    DIR *dp = opendir(dirs[i]);
+    if(!dp) continue;
+    struct dirent *ep;
+    while((ep = readdir(dp)))
+    { // readdir order is stable as long as the directory doesn't change
+      const char *ext = strrchr(ep->d_name, '.');
+      if(!ext || strcmp(ext, ".nprof")) continue;
+      snprintf(filename, sizeof(filename), "%s/%s", dirs[i], ep->d_name);
+      struct stat sb;
+      int64_t st[3] = {0};
+      if(!stat(filename, &sb)) st[0] = sb.st_mtim.tv_sec, st[1] = sb.st_mtim.tv_nsec, st[2] = sb.st_size;
+      dt_hash_update(&h, ep->d_name, strlen(ep->d_name)+1);
+      dt_hash_update(&h, st, sizeof(st));
+    }
+    closedir(dp);
+  }
+  return dt_hash_final(&h);
+}
+
+static int
+nprof_cache_read(uint64_t stamp)
+{
+  char cachedir[PATH_MAX], filename[PATH_MAX+30];
+  fs_cachedir(cachedir, sizeof(cachedir));
+  snprintf(filename, sizeof(filename), "%s/nprof.bin", cachedir);
+  FILE *f = fopen(filename, "rb");
+  if(!f) return 1;
+  uint64_t s = 0;
+  uint32_t cnt = 0;
+  int err = fread(&s, sizeof(s), 1, f) != 1 || fread(&cnt, sizeof(cnt), 1, f) != 1 || s != stamp;
+  if(!err && cnt)
+  {
+    dt_pipe.nprof = realloc(dt_pipe.nprof, sizeof(dt_pipe_nprof_t)*MAX(64, cnt));
+    err = fread(dt_pipe.nprof, sizeof(dt_pipe_nprof_t), cnt, f) != cnt;
+  }
+  fclose(f);
+  dt_pipe.num_nprof = err ? 0 : cnt;
+  return err;
+}
+
+static void
+nprof_cache_write(uint64_t stamp)
+{ // write to a temporary file and rename, concurrent readers see all or nothing
+  char cachedir[PATH_MAX], filename[PATH_MAX+30], tmpname[PATH_MAX+40];
+  fs_cachedir(cachedir, sizeof(cachedir));
+  fs_mkdir(cachedir, 0755); // may exist already
+  snprintf(filename, sizeof(filename), "%s/nprof.bin", cachedir);
+  snprintf(tmpname, sizeof(tmpname), "%s.XXXXXX", filename);
+  const int fd = mkstemp(tmpname);
+  if(fd == -1) return;
+  FILE *f = fdopen(fd, "wb");
+  if(!f) { close(fd); unlink(tmpname); return; }
+  fwrite(&stamp, sizeof(stamp), 1, f);
+  fwrite(&dt_pipe.num_nprof, sizeof(dt_pipe.num_nprof), 1, f);
+  fwrite(dt_pipe.nprof, sizeof(dt_pipe_nprof_t), dt_pipe.num_nprof, f);
+  int err = ferror(f);
+  err |= fclose(f);
+  if(err || rename(tmpname, filename)) unlink(tmpname);
+}
+
+static void
+nprof_load()
+{ // call with the shader mutex held
+  if(dt_pipe.nprof_loaded) return;
+  dt_pipe.nprof_loaded = 1;
+  dt_pipe.num_nprof = 0;
+  char dirname[3][PATH_MAX+20];
+  snprintf(dirname[0], sizeof(dirname[0]), "%s/nprof", dt_pipe.homedir);
+  snprintf(dirname[1], sizeof(dirname[1]), "%s/nprof", dt_pipe.basedir);
+  snprintf(dirname[2], sizeof(dirname[2]), "%s/data/nprof", dt_pipe.basedir);
+  const uint64_t stamp = nprof_stamp(dirname, 3);
+  if(!nprof_cache_read(stamp))
+  {
+    dt_log(s_log_pipe, "read %u noise profiles from the cache", dt_pipe.num_nprof);
+    return;
+  }
+  for(int i=0;i<3;i++) nprof_load_dir(dirname[i]);
+  if(dt_pipe.num_nprof) qsort(dt_pipe.nprof, dt_pipe.num_nprof, sizeof(dt_pipe.nprof[0]), compare_nprof);
+  nprof_cache_write(stamp);
+  dt_log(s_log_pipe, "read %u noise profiles", dt_pipe.num_nprof);
+}
+
+int
+dt_pipe_noise_profile(
+    const char *maker,
+    const char *model,
+    int         iso,
+    float      *a,
+    float      *b)
+{
+  char name[300];
+  snprintf(name, sizeof(name), "%s-%s-%d", maker, model, iso);
+  const dt_pipe_nprof_t k = { .key = hash64(name) };
+  threads_mutex_lock(&dt_pipe.shader_mutex);
+  nprof_load();
+  const dt_pipe_nprof_t *p = dt_pipe.num_nprof ?
+    bsearch(&k, dt_pipe.nprof, dt_pipe.num_nprof, sizeof(dt_pipe.nprof[0]), compare_nprof) : 0;
+  if(p)
+  {
+    *a = p->a;
+    *b = p->b;
+  }
+  threads_mutex_unlock(&dt_pipe.shader_mutex);
+  return p ? 0 : 1;
+}
+
+void
+dt_pipe_noise_profile_reset()
+{
+  threads_mutex_lock(&dt_pipe.shader_mutex);
+  dt_pipe.nprof_loaded = 0;
+  threads_mutex_unlock(&dt_pipe.shader_mutex);
+}
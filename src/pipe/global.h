@@ -4,7 +4,9 @@
 #include "params.h"
 #include "connector.h"
 #include "graph-fwd.h"
+#include "core/threads.h"
 #include <limits.h>
+#include <vulkan/vulkan.h>
 
 // static global structs to keep around for all instances of pipelines.
 // this queries the modules on startup, does the dlopen and expensive
@@ -24,6 +26,7 @@ typedef struct dt_read_geo_params_t
   uint32_t  *idx;     // mmapped index array
   float     *vtx;     // mmapped vertex array
   int16_t   *ext;     // mmapped extra data (normals, materials, texture ids, ..)
+  int        deform;  // output: set to 1 if only vertex positions changed since the last call, same counts and indices
 }
 dt_read_geo_params_t;
 
@@ -45,6 +48,8 @@ typedef void (*dt_module_modify_roi_out_t)(dt_graph_t *graph, dt_module_t *modul
 typedef void (*dt_module_modify_roi_in_t )(dt_graph_t *graph, dt_module_t *module);
 typedef void (*dt_module_write_sink_t) (dt_module_t *module, void *buf);
 typedef void (*dt_module_read_source_t)(dt_module_t *module, void *buf, dt_read_source_params_t *p);
+typedef uint64_t (*dt_module_source_key_t)(dt_module_t *module, dt_read_source_params_t *p);
+typedef int  (*dt_module_source_dmabuf_t)(dt_module_t *module, dt_read_source_params_t *p, uint64_t *size);
 typedef void (*dt_module_read_geo_t)(dt_module_t *module, dt_read_geo_params_t *p);
 typedef int  (*dt_module_init_t)    (dt_module_t *module);
 typedef void (*dt_module_cleanup_t )(dt_module_t *module);
@@ -53,6 +58,7 @@ typedef void (*dt_module_ui_callback_t)(dt_module_t *module, dt_token_t param);
 typedef int  (*dt_module_audio_t)(dt_module_t *module, const int frame, uint16_t **samples);
 typedef void (*dt_module_input_t)(dt_module_t *module, dt_module_input_event_t *e);
 typedef dt_graph_run_t (*dt_module_check_params_t)(dt_module_t *module, uint32_t parid, void *oldval);
+typedef int  (*dt_module_identity_t)(dt_module_t *module);
 
 // this is all the "class" info that is not bound to an instance and can be
 // read once on startup
@@ -60,8 +66,10 @@ typedef struct dt_module_so_t
 {
   dt_token_t name;
 
-  // for dlopen state
+  // for dlopen state. the library is only opened when a graph instantiates the
+  // module, see dt_module_so_dlopen(). until then the callbacks are all 0.
   void *dlhandle;
+  int   dlopened;
 
   // pass full image forward through pipe, init roi.full_{wd,ht}
   // this is also responsible of initing the img_params struct correctly
@@ -86,6 +94,11 @@ typedef struct dt_module_so_t
   // check whether a parameter update would cause a graph update or just a parameter update
   dt_module_check_params_t check_params;
 
+  // returns non-zero if the module passes its input through unchanged with the
+  // current parameters (optional). the graph then bypasses it as if disabled,
+  // and creates the nodes anew when the answer changes.
+  dt_module_identity_t identity;
+
   // returns a pointer to audio sample data (optional)
   dt_module_audio_t audio;
 
@@ -97,6 +110,15 @@ typedef struct dt_module_so_t
 
   // for source nodes, will be called before processing starts
   dt_module_read_source_t read_source;
+  // for static source nodes (optional): return a key identifying the content
+  // read_source() would write, or 0 if it must not be cached. if the key did
+  // not change, read_source() is skipped and a device copy is used instead.
+  dt_module_source_key_t  source_key;
+  // for sources that capture into device-shareable memory (optional): return a
+  // dma-buf fd (owned by the module) and its size. if the device can import it
+  // the staging buffer aliases it, and read_source() must not write to the
+  // mapped pointer (see dt_connector_t::mem_external).
+  dt_module_source_dmabuf_t source_dmabuf;
   // for sink nodes, will be called once processing ended
   dt_module_write_sink_t  write_sink;
 
@@ -115,6 +137,37 @@ typedef struct dt_module_so_t
 }
 dt_module_so_t;
 
+// one compiled spir-v kernel, as found in modules/<node>/<kernel>.<type>.spv
+typedef struct dt_pipe_shader_t
+{
+  dt_token_t     node;
+  dt_token_t     kernel;
+  dt_token_t     type;   // "comp" "vert" "tesc" "tese" "geom" "frag"
+  VkShaderModule module; // or VK_NULL_HANDLE if the file does not exist
+  int            tunable; // compute kernel takes its work group size from specialisation constants 0 and 1
+  int            spec_cnt; // specialisation constants from id 2 on, named after module parameters
+  dt_token_t     spec_name[DT_PIPE_MAX_SPEC];
+  uint32_t       spec_id  [DT_PIPE_MAX_SPEC];
+}
+dt_pipe_shader_t;
+
+// work group size of one tunable compute kernel, as found by vkdt-cli --autotune
+typedef struct dt_pipe_localsize_t
+{
+  dt_token_t node;
+  dt_token_t kernel;
+  uint32_t   size[2];
+}
+dt_pipe_localsize_t;
+
+// parameters of one noise profile file nprof/<maker>-<model>-<iso>.nprof
+typedef struct dt_pipe_nprof_t
+{
+  uint64_t key; // hash of the file name without extension
+  float    a, b;
+}
+dt_pipe_nprof_t;
+
 typedef struct dt_pipe_global_t
 {
   // this is the directory where the vkdt binary resides,
@@ -125,6 +178,36 @@ typedef struct dt_pipe_global_t
   char homedir[PATH_MAX]; // this is normally ${HOME}/.config/vkdt
   dt_module_so_t *module;
   uint32_t num_modules;
+
+  // shader modules are loaded lazily once and then shared by all graphs
+  // (including the ones in the thumbnail worker threads), hence the mutex.
+  // it also guards opening the module libraries.
+  dt_pipe_shader_t *shader;
+  uint32_t num_shaders, max_shaders;
+  threads_mutex_t shader_mutex;
+
+  // one staging block handed back by dt_graph_cleanup(), still mapped, for
+  // the next graph (export job, prefetch) to take over instead of allocating.
+  // guarded by its own mutex, freed in dt_pipe_staging_cleanup().
+  VkDeviceMemory  staging_spare;
+  uint8_t        *staging_spare_mapped;
+  size_t          staging_spare_size;
+  uint32_t        staging_spare_type;
+  threads_mutex_t staging_mutex;
+
+  // tuned work group sizes for the current device, read lazily from the cache
+  // directory next to the pipeline cache. guarded by the shader mutex, too.
+  dt_pipe_localsize_t *localsize;
+  uint32_t num_localsize, max_localsize;
+  int localsize_loaded;
+  uint32_t localsize_force[2]; // if non-zero, use this for all tunable kernels (autotuning)
+
+  // all noise profiles, sorted by key. read lazily once, so graphs of the
+  // thumbnail workers don't search the directories for every raw they load.
+  // guarded by the shader mutex, too.
+  dt_pipe_nprof_t *nprof;
+  uint32_t num_nprof;
+  int nprof_loaded;
 }
 dt_pipe_global_t;
 
@@ -136,6 +219,78 @@ int dt_pipe_global_init();
 // global cleanup:
 void dt_pipe_global_cleanup();
 
+// dlopen the library of the module and look up its callbacks, if not done yet.
+// thread safe, dt_module_add() calls it for every module it instantiates.
+void dt_module_so_dlopen(dt_module_so_t *mod);
+
+// return the cached shader module for the given kernel, load it from disk on first access.
+// the module is owned by the global struct, don't destroy it.
+VkResult dt_pipe_shader_module(
+    dt_token_t      node,
+    dt_token_t      kernel,
+    const char     *type,   // "comp" "vert" "tesc" "tese" "geom" "frag"
+    VkShaderModule *shader_module);
+
+// returns non-zero if the spir-v of the compute kernel is installed. kernels
+// listed in SPV_PENDING by their flat.mk are not built by default.
+int dt_pipe_shader_exists(
+    dt_token_t node,
+    dt_token_t kernel);
+
+// returns non-zero if the compute kernel declares its work group size via
+// DT_LOCAL_SIZE_TUNABLE and can thus run with any size.
+int dt_pipe_shader_tunable(
+    dt_token_t node,
+    dt_token_t kernel);
+
+// kernels can be compiled for the current value of an int or float parameter
+// of their module instead of branching on the uniform at run time, by
+// declaring a specialisation constant of the same name with id >= 2:
+//   layout(constant_id = 2) const int usemat = 1;
+// this returns the names and ids of these constants in the compute kernel.
+int dt_pipe_shader_spec(
+    dt_token_t node,
+    dt_token_t kernel,
+    dt_token_t name[DT_PIPE_MAX_SPEC],
+    uint32_t   id  [DT_PIPE_MAX_SPEC]);
+
+// fill the work group size to use for the compute kernel: the tuned one for
+// tunable kernels if there is any, DT_LOCAL_SIZE_X/Y otherwise.
+void dt_pipe_localsize(
+    dt_token_t node,
+    dt_token_t kernel,
+    uint32_t   size[2]);
+
+// remember the work group size of a tunable kernel, for this process.
+void dt_pipe_localsize_set(
+    dt_token_t      node,
+    dt_token_t      kernel,
+    const uint32_t  size[2]);
+
+// write all remembered work group sizes to the cache directory.
+// returns non-zero on failure.
+int dt_pipe_localsize_write();
+
+// look up the noise profile for the camera at the given iso in
+// ~/.config/vkdt/nprof/ and the nprof/ and data/nprof/ directories next to
+// the binary, in that order. the parsed profiles are shared between processes
+// through ~/.cache/vkdt/nprof.bin. returns non-zero if there is none.
+int dt_pipe_noise_profile(
+    const char *maker,
+    const char *model,
+    int         iso,
+    float      *a,
+    float      *b);
+
+// forget the noise profiles read so far, for instance after installing a new one.
+void dt_pipe_noise_profile_reset();
+
+// destroy all cached shader modules. needs to be called while the vulkan device is still alive.
+void dt_pipe_shader_cleanup();
+
+// free the staging block parked for the next graph. needs the vulkan device, too.
+void dt_pipe_staging_cleanup();
+
 // return total byte size of parameter storage
 static inline size_t
 dt_module_total_param_size(int soid)
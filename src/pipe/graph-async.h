@@ -0,0 +1,132 @@
+#pragma once
+#include "pipe/graph.h"
+#include "pipe/modules/api.h"
+#include "pipe/graph-barrier.h"
+
+// split the graph into the nodes the main display depends on and side branches
+// which don't feed it (histograms, waveforms, secondary displays). with a second
+// queue, the side branches run there while the main queue goes on with the rest
+// of the pipeline:
+//
+// main queue:  [ main nodes up to the fork ] [ main nodes after the fork ] [ join ]
+// async queue:                              \[ side nodes ]---------------/
+//
+// the fork is the last level producing an image read by a side node. side
+// outputs and the images read across the queues are kept resident, so the
+// allocator never lets two nodes on different queues alias memory.
+
+// node is pinned to the main queue, and so is everything upstream of it
+static inline int
+_dt_graph_async_anchor(
+    const dt_graph_t *graph,
+    dt_node_t        *node)
+{
+  if(dt_node_source(node)) return 1;
+  if(node->module->so->read_geo) return 1; // ray tracing builds its accel on the main queue
+  if(dt_node_sink(node) && (node->module->so->write_sink ||
+     (node->module->name == dt_token("display") && node->module->inst == dt_token("main"))))
+    return 1;
+  for(int c=0;c<node->num_connectors;c++)
+    if(node->connector[c].frames == 2 || (node->connector[c].flags & s_conn_dynamic_array))
+      return 1; // feedback crosses frames, dynamic arrays are rewritten outside the command buffer
+  return 0;
+}
+
+// sets node->async for all nodes and marks outputs crossing the queues
+// s_conn_cached. returns the number of side nodes, 0 if the graph isn't split.
+// call before allocating the outputs.
+static inline int
+dt_graph_async_split(
+    dt_graph_t     *graph,
+    const uint32_t *nodeid,
+    int             cnt)
+{
+  int side = 0, main_sink = 0;
+  for(int i=0;i<cnt;i++) graph->node[nodeid[i]].async = 1;
+  for(int i=cnt-1;i>=0;i--)
+  { // nodes are sorted upstream first, so all readers of a node have been seen here
+    dt_node_t *node = graph->node + nodeid[i];
+    if(_dt_graph_async_anchor(graph, node)) node->async = 0;
+    if(dt_node_sink(node) && node->module->name == dt_token("display") && node->module->inst == dt_token("main"))
+      main_sink = 1;
+    if(node->async) { side++; continue; }
+    for(int c=0;c<node->num_connectors;c++)
+      if(dt_connector_input(node->connector+c) && node->connector[c].connected_mi >= 0)
+        graph->node[node->connector[c].connected_mi].async = 0;
+  }
+  for(int i=0;i<cnt && side && main_sink;i++)
+  { // sinks read their input in a transfer layout, which can't be shared with the side queue
+    dt_node_t *node = graph->node + nodeid[i];
+    if(!dt_node_sink(node) || !node->module->so->write_sink || node->connector[0].connected_mi < 0) continue;
+    dt_node_t *up = graph->node + node->connector[0].connected_mi;
+    for(int j=0;j<cnt && side;j++)
+    {
+      dt_node_t *n = graph->node + nodeid[j];
+      for(int c=0;c<n->num_connectors && n->async;c++)
+        if(dt_connector_input(n->connector+c) && n->connector[c].connected_mi == up - graph->node &&
+           n->connector[c].connected_mc == node->connector[0].connected_mc)
+          side = 0;
+    }
+  }
+  if(!side || !main_sink)
+  {
+    for(int i=0;i<cnt;i++) graph->node[nodeid[i]].async = 0;
+    return 0;
+  }
+  for(int i=0;i<cnt;i++)
+  {
+    dt_node_t *node = graph->node + nodeid[i];
+    if(!node->async) continue;
+    for(int c=0;c<node->num_connectors;c++)
+    {
+      if(dt_connector_output(node->connector+c)) node->connector[c].flags |= s_conn_cached;
+      else if(node->connector[c].connected_mi >= 0)
+        graph->node[node->connector[c].connected_mi].connector[node->connector[c].connected_mc].flags |= s_conn_cached;
+    }
+  }
+  return side;
+}
+
+// last level of main nodes writing images read by side nodes
+static inline uint32_t
+dt_graph_async_fork(
+    const dt_graph_t *graph,
+    const uint32_t   *nodeid,
+    int               cnt)
+{
+  uint32_t fork = 0;
+  for(int i=0;i<cnt;i++)
+  {
+    dt_node_t *node = graph->node + nodeid[i];
+    if(!node->async) continue;
+    for(int c=0;c<node->num_connectors;c++)
+      if(dt_connector_input(node->connector+c) && node->connector[c].connected_mi >= 0 &&
+         !graph->node[node->connector[c].connected_mi].async)
+        fork = MAX(fork, graph->node[node->connector[c].connected_mi].level);
+  }
+  return fork;
+}
+
+// move the images read across the queues to the layout all readers expect,
+// so neither queue transitions them while the other one reads.
+static inline void
+dt_graph_async_fork_layouts(
+    dt_graph_t     *graph,
+    const uint32_t *nodeid,
+    int             cnt)
+{
+  for(int i=0;i<cnt;i++)
+  {
+    dt_node_t *node = graph->node + nodeid[i];
+    if(!node->async) continue;
+    for(int c=0;c<node->num_connectors;c++)
+    {
+      dt_connector_t *cn = node->connector+c;
+      if(!dt_connector_input(cn) || cn->connected_mi < 0 || dt_connector_ssbo(cn)) continue;
+      if(graph->node[cn->connected_mi].async) continue;
+      for(int k=0;k<MAX(1, cn->array_length);k++)
+        dt_graph_barrier_image(graph, dt_graph_connector_image(graph, node - graph->node, c, k, graph->frame),
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    }
+  }
+}
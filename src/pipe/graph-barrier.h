@@ -0,0 +1,220 @@
+#pragma once
+#include "pipe/graph.h"
+#include "pipe/modules/api.h"
+#include "pipe/graph-srccache.h"
+#include "qvk/qvk.h"
+
+// barriers between the nodes of the command buffer. nodes are recorded level by
+// level, every node depends only on nodes of lower levels. all image layout
+// transitions a level needs go into one pipeline barrier, which also makes all
+// memory written before visible. the nodes of one level then run without any
+// barrier between them, so independent branches of the graph overlap on the gpu.
+
+typedef struct dt_graph_barrier_t
+{
+  dt_connector_image_t *img;
+  VkImageLayout         old_layout, new_layout;
+}
+dt_graph_barrier_t;
+
+// queue a layout transition of the image for the next dt_graph_barrier_flush().
+// a second transition of the same image before that only changes the new layout.
+static inline void
+dt_graph_barrier_image(
+    dt_graph_t           *graph,
+    dt_connector_image_t *img,
+    VkImageLayout         layout)
+{
+  if(!img || !img->image || img->layout == layout) return;
+  uint32_t i = 0;
+  for(;i<graph->barrier_cnt;i++) if(graph->barrier[i].img == img) break;
+  if(i == graph->barrier_cnt)
+  {
+    if(graph->barrier_cnt >= graph->barrier_max)
+    {
+      graph->barrier_max = MAX(64, 2*graph->barrier_max);
+      graph->barrier = realloc(graph->barrier, sizeof(graph->barrier[0])*graph->barrier_max);
+    }
+    graph->barrier[graph->barrier_cnt++] = (dt_graph_barrier_t){ .img = img, .old_layout = img->layout };
+  }
+  graph->barrier[i].new_layout = layout;
+  img->layout = layout;
+}
+
+// record one barrier with all queued transitions and a global memory dependency
+static inline void
+dt_graph_barrier_flush(
+    dt_graph_t      *graph,
+    VkCommandBuffer  cmd_buf)
+{
+  const VkImageSubresourceRange range = {
+    .aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
+    .levelCount     = 1,
+    .layerCount     = 1,
+  };
+  uint32_t beg = 0;
+  do
+  { // in chunks, so everything fits on the stack
+    const uint32_t cnt = MIN(64, graph->barrier_cnt - beg);
+    if(qvk.synchronization2_supported)
+    {
+      const VkPipelineStageFlags2 src_stage = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT |
+        VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT;
+      const VkPipelineStageFlags2 dst_stage = src_stage | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT |
+        VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT;
+      const VkAccessFlags2 src_access = VK_ACCESS_2_SHADER_WRITE_BIT |
+        VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT;
+      const VkAccessFlags2 dst_access = src_access | VK_ACCESS_2_SHADER_READ_BIT |
+        VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_TRANSFER_READ_BIT |
+        VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT | // dispatch_indirect
+        VK_ACCESS_2_UNIFORM_READ_BIT;           // parameters bound to storage buffers
+      VkImageMemoryBarrier2 img[64];
+      for(uint32_t i=0;i<cnt;i++)
+        img[i] = (VkImageMemoryBarrier2) {
+          .sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+          .srcStageMask        = src_stage,
+          .srcAccessMask       = src_access,
+          .dstStageMask        = dst_stage,
+          .dstAccessMask       = dst_access,
+          .oldLayout           = graph->barrier[beg+i].old_layout,
+          .newLayout           = graph->barrier[beg+i].new_layout,
+          .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+          .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+          .image               = graph->barrier[beg+i].img->image,
+          .subresourceRange    = range,
+        };
+      const VkMemoryBarrier2 mem = {
+        .sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+        .srcStageMask  = src_stage,
+        .srcAccessMask = src_access,
+        .dstStageMask  = dst_stage,
+        .dstAccessMask = dst_access,
+      };
+      const VkDependencyInfo dep = {
+        .sType                   = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+        .memoryBarrierCount      = 1,
+        .pMemoryBarriers         = &mem,
+        .imageMemoryBarrierCount = cnt,
+        .pImageMemoryBarriers    = img,
+      };
+      qvk.CmdPipelineBarrier2KHR(cmd_buf, &dep);
+    }
+    else
+    {
+      const VkAccessFlags src_access = VK_ACCESS_SHADER_WRITE_BIT |
+        VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+      const VkAccessFlags dst_access = src_access | VK_ACCESS_SHADER_READ_BIT |
+        VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT |
+        VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT;
+      VkImageMemoryBarrier img[64];
+      for(uint32_t i=0;i<cnt;i++)
+        img[i] = (VkImageMemoryBarrier) {
+          .sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+          .srcAccessMask       = src_access,
+          .dstAccessMask       = dst_access,
+          .oldLayout           = graph->barrier[beg+i].old_layout,
+          .newLayout           = graph->barrier[beg+i].new_layout,
+          .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+          .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+          .image               = graph->barrier[beg+i].img->image,
+          .subresourceRange    = range,
+        };
+      const VkMemoryBarrier mem = {
+        .sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = src_access,
+        .dstAccessMask = dst_access,
+      };
+      const VkPipelineStageFlags stage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT |
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+      vkCmdPipelineBarrier(cmd_buf, stage, stage | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0,
+          1, &mem, 0, 0, cnt, img);
+    }
+    beg += cnt;
+  }
+  while(beg < graph->barrier_cnt);
+  graph->barrier_cnt = 0;
+  graph->barrier_mem = 0;
+}
+
+typedef struct dt_graph_barrier_access_t
+{
+  const void *img;      // identifies the image, pointer into conn_image_pool or the source cache
+  uint64_t    beg, end; // memory range
+  int         heap;     // 0 images, 1 storage buffers, 2 source cache
+  int         op;       // 0 write, 1 read in a shader, 2 read by a transfer (sinks)
+  uint32_t    level;
+}
+dt_graph_barrier_access_t;
+
+static inline void
+_dt_graph_barrier_access(
+    dt_graph_t                *graph,
+    const dt_node_t           *node,
+    int                        c,
+    dt_graph_barrier_access_t *a)
+{
+  const dt_connector_t *cn = node->connector + c;
+  const int nid = node - graph->node;
+  *a = (dt_graph_barrier_access_t){ .beg = -1ul,
+    .op = dt_connector_output(cn) ? 0 : (cn->type == dt_token("sink") && node->module->so->write_sink) ? 2 : 1 };
+  for(int f=0;f<2;f++) for(int k=0;k<MAX(1, cn->array_length);k++)
+  { // all frames and array elements, it's only for the dependencies
+    const dt_connector_image_t *img = dt_graph_connector_image(graph, nid, c, k, f);
+    if(!img) continue;
+    if(!a->img) a->img = img;
+    a->heap = img->buffer ? 1 : 0;
+    a->beg  = MIN(a->beg, img->offset);
+    a->end  = MAX(a->end, img->offset + img->size);
+  }
+}
+
+// assign levels to the nodes in order of execution: a node runs after the
+// nodes it reads from, after all earlier nodes whose memory it reuses (the
+// allocator hands out memory of images which have been read for the last time
+// earlier in this order), and after earlier readers of its inputs which need a
+// different layout. returns the number of levels.
+static inline uint32_t
+dt_graph_barrier_levels(
+    dt_graph_t     *graph,
+    const uint32_t *nodeid,
+    int             cnt)
+{
+  dt_graph_barrier_access_t *acc = malloc(sizeof(*acc)*(cnt*(DT_MAX_CONNECTORS+2)+1));
+  uint32_t acc_cnt = 0, levels = 0;
+  for(int i=0;i<cnt;i++)
+  {
+    dt_node_t *node = graph->node + nodeid[i];
+    const uint32_t beg = acc_cnt;
+    for(int c=0;c<node->num_connectors;c++)
+    {
+      if(node->conn_image[c] == -1u) continue;
+      if(dt_connector_input(node->connector+c) && node->connector[c].connected_mi < 0) continue;
+      _dt_graph_barrier_access(graph, node, c, acc + acc_cnt);
+      if(acc[acc_cnt].img) acc_cnt++;
+    }
+    if(node->srccache)
+    { // sources sharing a cached device copy take turns
+      const dt_graph_srccache_t *sc = graph->srccache + node->srccache - 1;
+      acc[acc_cnt++] = (dt_graph_barrier_access_t){ .img = &sc->img, .heap = 2 };
+    }
+    if(node->modcache)
+    { // so do module outputs copied to and from the cache, see graph-modcache.h
+      const dt_graph_srccache_t *mc = graph->modcache + node->modcache - 1;
+      acc[acc_cnt++] = (dt_graph_barrier_access_t){ .img = &mc->img, .heap = 2 };
+    }
+    uint32_t level = 0;
+    for(uint32_t j=beg;j<acc_cnt;j++) for(uint32_t k=0;k<beg;k++)
+    {
+      const dt_graph_barrier_access_t *a = acc + j, *b = acc + k;
+      if(a->heap != b->heap || b->level + 1 <= level) continue;
+      if(a->img == b->img ? (a->op && b->op && a->op == b->op) : (a->heap == 2 || a->end <= b->beg || b->end <= a->beg))
+        continue; // both read the same image in the same layout, or no overlap
+      level = b->level + 1;
+    }
+    for(uint32_t j=beg;j<acc_cnt;j++) acc[j].level = level;
+    node->level = level;
+    levels = MAX(levels, level + 1);
+  }
+  free(acc);
+  return levels;
+}
@@ -0,0 +1,128 @@
+#pragma once
+#include "pipe/graph.h"
+#include "pipe/modules/api.h"
+#include "pipe/graph-barrier.h"
+#include "qvk/qvk.h"
+
+// checkpoints of the state an animation carries from one frame to the next:
+// the images of all connectors with two frames (feedback). the file holds the
+// last frame that was computed and the contents of these images, so rendering
+// can go on with the next frame instead of starting over at frame 0:
+//
+// header:  "vkdtckpt" version frame count
+// entries: module instance kernel connector array-index frame size, data
+
+#define DT_GRAPH_CHECKPOINT_VERSION 1
+
+typedef struct dt_graph_checkpoint_header_t
+{
+  dt_token_t magic;
+  uint32_t   version;
+  int32_t    frame;    // last frame computed before the state was saved
+  uint32_t   cnt;      // number of entries
+  uint32_t   pad;
+}
+dt_graph_checkpoint_header_t;
+
+typedef struct dt_graph_checkpoint_entry_t
+{
+  dt_token_t mod, inst, kernel, conn;
+  uint32_t   k, f;     // array element and frame
+  uint32_t   wd, ht;   // image extent, 0 for storage buffers
+  uint64_t   size;     // bytes of data following the entry
+}
+dt_graph_checkpoint_entry_t;
+
+// collect all images carrying state across frames. returns the count and
+// fills up to max entries and images.
+static inline uint32_t
+dt_graph_checkpoint_entries(
+    dt_graph_t                  *graph,
+    dt_graph_checkpoint_entry_t *entry,
+    dt_connector_image_t       **img,
+    uint32_t                     max)
+{
+  uint32_t cnt = 0;
+  for(int n=0;n<graph->num_nodes;n++) for(int c=0;c<graph->node[n].num_connectors;c++)
+  {
+    dt_node_t *node = graph->node + n;
+    dt_connector_t *cn = node->connector + c;
+    if(!dt_connector_output(cn) || cn->frames != 2 || node->conn_image[c] == -1u) continue;
+    for(int f=0;f<2;f++) for(int k=0;k<MAX(1, cn->array_length);k++)
+    {
+      dt_connector_image_t *im = dt_graph_connector_image(graph, n, c, k, f);
+      if(!im || (!im->image && !im->buffer)) continue;
+      if(cnt < max)
+      {
+        const uint32_t wd = im->buffer ? 0 : im->wd ? im->wd : cn->roi.wd;
+        const uint32_t ht = im->buffer ? 0 : im->ht ? im->ht : cn->roi.ht;
+        entry[cnt] = (dt_graph_checkpoint_entry_t) {
+          .mod    = node->module->name,
+          .inst   = node->module->inst,
+          .kernel = node->kernel,
+          .conn   = cn->name,
+          .k = k, .f = f, .wd = wd, .ht = ht,
+          .size   = im->buffer ? im->size : dt_connector_bufsize(cn, wd, ht),
+        };
+        img[cnt] = im;
+      }
+      cnt++;
+    }
+  }
+  return cnt;
+}
+
+// record the copies between the images and a host visible buffer holding the
+// data of all entries one after another. leaves the images in their layouts,
+// or in the transfer layout if they didn't have one yet.
+static inline void
+dt_graph_checkpoint_record(
+    dt_graph_t                        *graph,
+    VkCommandBuffer                    cmd_buf,
+    VkBuffer                           buffer,
+    const dt_graph_checkpoint_entry_t *entry,
+    dt_connector_image_t             **img,
+    uint32_t                           cnt,
+    int                                upload) // copy from the buffer to the images
+{
+  const VkImageLayout transfer = upload ?
+    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL : VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  VkImageLayout *layout = malloc(sizeof(layout[0])*(cnt+1));
+  for(uint32_t i=0;i<cnt;i++)
+  {
+    layout[i] = img[i]->layout;
+    if(img[i]->image) dt_graph_barrier_image(graph, img[i], transfer);
+  }
+  graph->barrier_mem = 1;
+  dt_graph_barrier_flush(graph, cmd_buf);
+  uint64_t offset = 0;
+  for(uint32_t i=0;i<cnt;offset+=entry[i++].size)
+  {
+    if(img[i]->buffer)
+    {
+      const VkBufferCopy region = {
+        .srcOffset = upload ? offset : 0,
+        .dstOffset = upload ? 0 : offset,
+        .size      = entry[i].size,
+      };
+      if(upload) vkCmdCopyBuffer(cmd_buf, buffer, img[i]->buffer, 1, &region);
+      else       vkCmdCopyBuffer(cmd_buf, img[i]->buffer, buffer, 1, &region);
+    }
+    else
+    {
+      const VkBufferImageCopy region = {
+        .bufferOffset     = offset,
+        .imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },
+        .imageExtent      = { entry[i].wd, entry[i].ht, 1 },
+      };
+      if(upload) vkCmdCopyBufferToImage(cmd_buf, buffer, img[i]->image, transfer, 1, &region);
+      else       vkCmdCopyImageToBuffer(cmd_buf, img[i]->image, transfer, buffer, 1, &region);
+    }
+  }
+  for(uint32_t i=0;i<cnt;i++)
+    if(img[i]->image && layout[i] != VK_IMAGE_LAYOUT_UNDEFINED)
+      dt_graph_barrier_image(graph, img[i], layout[i]);
+  graph->barrier_mem = 1;
+  dt_graph_barrier_flush(graph, cmd_buf);
+  free(layout);
+}
@@ -1,5 +1,6 @@
 #include "core/log.h"
 #include "core/fs.h"
+#include "core/core.h"
 #include "pipe/global.h"
 #include "pipe/graph.h"
 #include "pipe/graph-io.h"
@@ -70,6 +71,26 @@ dt_graph_replace_display(
   return 0;
 }
 
+// add another display module as a sibling of the given one, reading the same
+// output. returns 0 on success.
+int
+dt_graph_branch_display(
+    dt_graph_t *graph,
+    dt_token_t  inst,     // instance of the display module to branch
+    dt_token_t  branch)   // instance of the new display module
+{
+  const int mid = dt_module_get(graph, dt_token("display"), inst);
+  if(mid < 0) return 1; // no display node by that name
+  const int cid = dt_module_get_connector(graph->module+mid, dt_token("input"));
+  const int m0 = graph->module[mid].connector[cid].connected_mi;
+  const int o0 = graph->module[mid].connector[cid].connected_mc;
+  if(m0 < 0) return 2; // display input not connected
+  const int m1 = dt_module_add(graph, dt_token("display"), branch);
+  if(m1 < 0) return 3;
+  CONN(dt_module_connect(graph, m0, o0, m1, dt_module_get_connector(graph->module+m1, dt_token("input"))));
+  return 0;
+}
+
 // disconnect all (remaining) display modules
 void
 dt_graph_disconnect_display_modules(
@@ -80,6 +101,121 @@ dt_graph_disconnect_display_modules(
       dt_module_remove(graph, m); // disconnect and reset/ignore
 }
 
+int
+dt_graph_lut_chain(
+    dt_graph_t *graph,
+    dt_token_t  first_mod,
+    dt_token_t  first_inst,
+    dt_token_t  last_mod,
+    dt_token_t  last_inst,
+    const char *lutfile,
+    int         bake)
+{
+  const int mf = dt_module_get(graph, first_mod, first_inst);
+  const int ml = dt_module_get(graph, last_mod,  last_inst);
+  if(mf < 0 || ml < 0) return 1; // no such modules
+  const int cf = dt_module_get_connector(graph->module+mf, dt_token("input"));
+  const int cl = dt_module_get_connector(graph->module+ml, dt_token("output"));
+  if(cf < 0 || cl < 0) return 2;
+  const int mu = graph->module[mf].connector[cf].connected_mi;
+  const int cu = graph->module[mf].connector[cf].connected_mc;
+  if(mu < 0) return 3; // chain input not connected
+
+  const int m1 = dt_module_add(graph, dt_token("lut3d"), dt_token("bake"));
+  if(m1 < 0) return 4;
+  const int i1 = dt_module_get_connector(graph->module+m1, dt_token("input"));
+  const int l1 = dt_module_get_connector(graph->module+m1, dt_token("lut"));
+  const int o1 = dt_module_get_connector(graph->module+m1, dt_token("output"));
+  if(bake)
+  { // upstream -> lattice -> chain -> o-lut. the other consumers of the chain are not run.
+    ((int32_t *)dt_module_param_int(graph->module+m1, 0))[0] = 1;
+    const int m2 = dt_module_add(graph, dt_token("o-lut"), dt_token("main"));
+    if(m2 < 0) return 4;
+    dt_module_set_param_string(graph->module+m2, dt_token("filename"), lutfile);
+    CONN(dt_module_connect(graph, mu, cu, m1, i1));
+    CONN(dt_module_connect(graph, m1, o1, mf, cf));
+    CONN(dt_module_connect(graph, ml, cl, m2, 0));
+    return 0;
+  }
+  // upstream -> lookup -> whatever consumed the output of the chain
+  const int m2 = dt_module_add(graph, dt_token("i-lut"), dt_token("bake"));
+  if(m2 < 0) return 4;
+  char filename[PATH_MAX];
+  snprintf(filename, sizeof(filename), "%s.lut", lutfile);
+  dt_module_set_param_string(graph->module+m2, dt_token("filename"), filename);
+  for(int m=0;m<graph->num_modules;m++) for(int c=0;c<graph->module[m].num_connectors;c++)
+  {
+    dt_connector_t *cn = graph->module[m].connector+c;
+    if(m != m1 && dt_connector_input(cn) && cn->connected_mi == ml && cn->connected_mc == cl)
+      CONN(dt_module_connect(graph, m1, o1, m, c));
+  }
+  CONN(dt_module_connect(graph, mu, cu, m1, i1));
+  CONN(dt_module_connect(graph, m2, 0,  m1, l1));
+  return 0;
+}
+
+// read the config file, or if it is an image (or a cfg next to an image
+// that does not exist yet), the default config wired to load this image.
+VkResult
+dt_graph_load_config(
+    dt_graph_t *graph,
+    const char *cfgfile,
+    const char *defcfg,
+    dt_token_t  input_module)
+{
+  if(!dt_graph_read_config_ascii(graph, cfgfile)) return VK_SUCCESS;
+  // well yes, loading default then. not an interesting message:
+  // dt_log(s_log_pipe, "could not open config file '%s'.", cfgfile);
+  if(input_module == 0)
+    input_module = dt_graph_default_input_module(cfgfile);
+  char graph_cfg[PATH_MAX+100];
+  if(defcfg)
+    snprintf(graph_cfg, sizeof(graph_cfg), "%s", defcfg);
+  else
+    snprintf(graph_cfg, sizeof(graph_cfg), "default-darkroom.%"PRItkn, dt_token_str(input_module));
+  dt_graph_read_config_ascii(graph, graph_cfg);
+  char imgfilename[PATH_MAX+100];
+  // follow link if this is a cfg in a tag collection:
+  ssize_t linklen = readlink(cfgfile, imgfilename, sizeof(imgfilename));
+  if(linklen == -1) snprintf(imgfilename, sizeof(imgfilename), "%s", cfgfile);
+  else imgfilename[linklen] = 0;
+  // reading the config will reset the search path. we'll repoint it to the
+  // actual image file, not the default cfg:
+  dt_graph_set_searchpath(graph, imgfilename);
+  int len = strlen(imgfilename);
+  assert(len > 4);
+  imgfilename[len-4] = 0; // cut away ".cfg"
+  char *basen = fs_basename(imgfilename); // cut away path so we can relocate more easily
+  int modid = dt_module_get(graph, input_module, dt_token("main"));
+  if(modid < 0 ||
+      dt_module_set_param_string(graph->module + modid, dt_token("filename"), basen))
+  {
+    dt_log(s_log_err, "config '%s' has no valid %"PRItkn" input module!", graph_cfg, dt_token_str(input_module));
+    return VK_INCOMPLETE;
+  }
+  return VK_SUCCESS;
+}
+
+// point the output modules to the file names for this frame of an animation
+static void
+export_frame(
+    dt_graph_t        *graph,
+    dt_graph_export_t *param,
+    dt_module_t      **mod_out,
+    int                frame)
+{
+  char filename[256];
+  for(int i=0;i<param->output_cnt;i++)
+  {
+    if(mod_out[i] == 0) continue; // not a known output module
+    if(param->output[i].p_filename)
+      snprintf(filename, sizeof(filename), "%s_%04d", param->output[i].p_filename, frame);
+    else
+      snprintf(filename, sizeof(filename), "%"PRItkn"_%04d", dt_token_str(param->output[i].inst), frame);
+    dt_module_set_param_string(mod_out[i], dt_token("filename"), filename);
+  }
+}
+
 VkResult
 dt_graph_export(
     dt_graph_t        *graph,  // graph to run, will overwrite filename param
@@ -87,45 +223,25 @@ dt_graph_export(
 {
   if(param->p_cfgfile)
   {
-    int err = dt_graph_read_config_ascii(graph, param->p_cfgfile);
-    if(err)
-    { // well yes, loading default then. not an interesting message:
-      // dt_log(s_log_pipe, "could not open config file '%s'.", param->p_cfgfile);
-      dt_token_t input_module = param->input_module;
-      if(param->input_module == 0)
-        input_module = dt_graph_default_input_module(param->p_cfgfile);
-      char graph_cfg[PATH_MAX+100];
-      if(param->p_defcfg)
-        snprintf(graph_cfg, sizeof(graph_cfg), "%s", param->p_defcfg);
-      else
-        snprintf(graph_cfg, sizeof(graph_cfg), "default-darkroom.%"PRItkn, dt_token_str(input_module));
-      err = dt_graph_read_config_ascii(graph, graph_cfg);
-      char imgfilename[PATH_MAX+100];
-      // follow link if this is a cfg in a tag collection:
-      ssize_t linklen = readlink(param->p_cfgfile, imgfilename, sizeof(imgfilename));
-      if(linklen == -1) snprintf(imgfilename, sizeof(imgfilename), "%s", param->p_cfgfile);
-      else imgfilename[linklen] = 0;
-      // reading the config will reset the search path. we'll repoint it to the
-      // actual image file, not the default cfg:
-      dt_graph_set_searchpath(graph, imgfilename);
-      int len = strlen(imgfilename);
-      assert(len > 4);
-      imgfilename[len-4] = 0; // cut away ".cfg"
-      char *basen = fs_basename(imgfilename); // cut away path so we can relocate more easily
-      int modid = dt_module_get(graph, input_module, dt_token("main"));
-      if(modid < 0 ||
-          dt_module_set_param_string(graph->module + modid, dt_token("filename"), basen))
-      {
-        dt_log(s_log_err, "config '%s' has no valid %"PRItkn" input module!", graph_cfg, dt_token_str(input_module));
-        return VK_INCOMPLETE;
-      }
-    }
+    const double beg = dt_time();
+    QVKR(dt_graph_load_config(graph, param->p_cfgfile, param->p_defcfg, param->input_module));
+    graph->perf.parse += 1000.0*(dt_time() - beg);
   }
 
   // dump original modules, i.e. with display modules
   if(param->dump_modules)
     dt_graph_print_modules(graph);
 
+  if(param->p_lut && dt_graph_lut_chain(graph, param->lut_chain[0], param->lut_chain[1],
+        param->lut_chain[2], param->lut_chain[3], param->p_lut, param->lut_bake))
+  {
+    dt_log(s_log_err, "could not %s the lut for the chain %"PRItkn":%"PRItkn" to %"PRItkn":%"PRItkn"!",
+        param->lut_bake ? "bake" : "apply",
+        dt_token_str(param->lut_chain[0]), dt_token_str(param->lut_chain[1]),
+        dt_token_str(param->lut_chain[2]), dt_token_str(param->lut_chain[3]));
+    return VK_INCOMPLETE;
+  }
+
   // find non-display non-input "main" module
   int found_main = 0;
   for(int m=0;m<graph->num_modules;m++)
@@ -144,14 +260,37 @@ dt_graph_export(
   if(!param->output[0].inst) param->output[0].inst = dt_token("main");
 
   // replace requested display node by export node:
+  int variant[20] = {0};
+  assert(param->output_cnt <= sizeof(variant)/sizeof(variant[0]));
   if(!found_main)
   {
+    // several outputs of the same instance are renditions of one image: each
+    // further one gets its own display branching off where the first one reads,
+    // so everything upstream runs once. the branches request the full
+    // resolution and all go through a resize module.
+    for(int i=1;i<param->output_cnt;i++)
+    {
+      int first = 0;
+      while(first < i && param->output[first].inst != param->output[i].inst) first++;
+      if(first == i) continue;
+      char name[9];
+      snprintf(name, sizeof(name), "%.5s%d", dt_token_str(param->output[i].inst), i);
+      const dt_token_t branch = dt_token(name);
+      if(dt_graph_branch_display(graph, param->output[i].inst, branch))
+      {
+        dt_log(s_log_err, "could not branch display node %"PRItkn"!", dt_token_str(param->output[i].inst));
+        return VK_INCOMPLETE;
+      }
+      param->output[i].inst = branch;
+      variant[first] = variant[i] = 1;
+    }
     int cnt = 0;
     for(;cnt<param->output_cnt;cnt++)
       if(dt_graph_replace_display(
             graph, param->output[cnt].inst, param->output[cnt].mod,
+            variant[cnt] || (
             ( param->output[cnt].mod != dt_token("o-bc1")) && // no hq thumbnails
-            ((param->output[cnt].max_width > 0) || (param->output[cnt].max_height > 0))))
+            ((param->output[cnt].max_width > 0) || (param->output[cnt].max_height > 0)))))
         break;
     if(cnt != param->output_cnt)
     {
@@ -193,7 +332,12 @@ dt_graph_export(
       // resampling nodes. this may be useful for more high quality resampling in the future.
       if(param->output[i].max_width  > 0) graph->output_wd = param->output[i].max_width;
       if(param->output[i].max_height > 0) graph->output_ht = param->output[i].max_height;
+      graph->input_lod = variant[i] ? 0 : param->input_lod; // the other renditions may be larger
     }
+    else if((param->output[i].max_width > 0 || param->output[i].max_height > 0) &&
+        graph->output_bound_cnt < (int)(sizeof(graph->output_bound)/sizeof(graph->output_bound[0])))
+      graph->output_bound[graph->output_bound_cnt++] = (dt_graph_output_bound_t){
+        .inst = param->output[i].inst, .wd = param->output[i].max_width, .ht = param->output[i].max_height };
     if(graph->frame_cnt > 1)
     {
       if(param->output[i].p_filename)
@@ -227,45 +371,53 @@ dt_graph_export(
   if(graph->frame_cnt > 1)
   {
     VkResult res = VK_SUCCESS;
-    dt_graph_apply_keyframes(graph);
-    dt_graph_run(graph, s_graph_run_all);
-    if(audio_f)
-    {
-      do {
-        audio_cnt = graph->module[audio_mod].so->audio(graph->module+audio_mod, 0, &audio_samples);
-        if(audio_cnt) fwrite(audio_samples, 2*sizeof(uint16_t), audio_cnt, audio_f);
-      } while(audio_cnt);
+    const int end = param->frame_end > 0 ? MIN(param->frame_end, graph->frame_cnt) : graph->frame_cnt;
+    const int beg = CLAMP(param->frame_beg, 0, end-1);
+    // continue after the last frame of a checkpoint within the range, if any
+    const int done = param->p_checkpoint ? dt_graph_checkpoint_frame(param->p_checkpoint) : -1;
+    int from = (done >= beg-1 && done < end-1) ? done+1 : beg, allocated = 0;
+    if(from > 0)
+    { // create the nodes to find out whether they carry state from earlier frames
+      graph->frame = from;
+      export_frame(graph, param, mod_out, from);
+      dt_graph_apply_keyframes(graph);
+      res = dt_graph_run(graph, s_graph_run_all & ~(s_graph_run_record_cmd_buf | s_graph_run_download_sink));
+      if(res != VK_SUCCESS) goto done;
+      allocated = 1;
+      const int restored = from == done+1 && dt_graph_checkpoint_read(graph, param->p_checkpoint) == done;
+      if(!restored && dt_graph_checkpoint_cnt(graph))
+      {
+        dt_log(s_log_pipe, "feedback needs all frames before %d, starting at frame 0", from);
+        from = 0;
+      }
     }
-    for(int f=1;f<graph->frame_cnt;f++)
+    for(int f=from;f<end;f++)
     {
       graph->frame = f;
-      for(int i=0;i<param->output_cnt;i++)
-      {
-        if(mod_out[i] == 0) continue; // not a known output module
-        if(param->output[i].p_filename)
-          snprintf(filename, sizeof(filename), "%s_%04d", param->output[i].p_filename, f);
-        else
-          snprintf(filename, sizeof(filename), "%"PRItkn"_%04d", dt_token_str(param->output[i].inst), f);
-        dt_module_set_param_string(
-            mod_out[i], dt_token("filename"),
-            filename);
-      }
-      dt_graph_apply_keyframes(graph);
-      res = dt_graph_run(graph,
-          s_graph_run_record_cmd_buf | 
-          ((!param->last_frame_only || (f == graph->frame_cnt-1)) ?
-          s_graph_run_download_sink : 0) |
-          s_graph_run_wait_done);
+      export_frame(graph, param, mod_out, f);
+      const dt_graph_run_t kf_flags = dt_graph_apply_keyframes(graph);
+      const int write = f >= beg && (!param->last_frame_only || f == end-1);
+      if(f == from && !allocated)
+        res = dt_graph_run(graph, s_graph_run_all & ~(write ? 0 : s_graph_run_download_sink));
+      else // write the sinks of this frame while the gpu works on the next one:
+        res = dt_graph_run(graph,
+            s_graph_run_record_cmd_buf | kf_flags | (f == from ? s_graph_run_upload_source : 0) |
+            (write ? s_graph_run_download_sink : 0) |
+            s_graph_run_async_sink);
       if(res != VK_SUCCESS) goto done;
-      if(audio_f)
+      if(audio_f && f >= beg)
       {
         do {
           audio_cnt = graph->module[audio_mod].so->audio(graph->module+audio_mod, f, &audio_samples);
           if(audio_cnt) fwrite(audio_samples, 2*sizeof(uint16_t), audio_cnt, audio_f);
         } while(audio_cnt);
       }
+      if(param->p_checkpoint && f >= beg &&
+         (f == end-1 || (param->checkpoint_every > 0 && (f+1) % param->checkpoint_every == 0)))
+        if((res = dt_graph_checkpoint_write(graph, param->p_checkpoint)) != VK_SUCCESS) goto done;
     }
 done:
+    dt_graph_sink_flush(graph);
     if(audio_f) fclose(audio_f);
     return res;
   }
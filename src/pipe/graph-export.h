@@ -13,17 +13,50 @@ dt_graph_replace_display(
     dt_token_t  mod,     // export module to insert, 0 -> "o-jpg"
     int         resize); // if this is non-zero, insert an explicit resize node
 
+// add a display module of instance branch, reading the same output as the
+// display module of instance inst. returns 0 on success.
+int
+dt_graph_branch_display(
+    dt_graph_t *graph,
+    dt_token_t  inst,
+    dt_token_t  branch);
+
 // disconnect all (remaining) display modules
 void
 dt_graph_disconnect_display_modules(
     dt_graph_t *graph);
 
+// replace a chain of pointwise modules (from the input of the first to the
+// output of the last) by a lookup into lutfile.lut, using the lut3d module. if
+// bake is set, rewire the graph to write this lut instead: the lattice points
+// go through the chain and into an o-lut module. returns 0 on success.
+int
+dt_graph_lut_chain(
+    dt_graph_t *graph,
+    dt_token_t  first_mod,
+    dt_token_t  first_inst,
+    dt_token_t  last_mod,
+    dt_token_t  last_inst,
+    const char *lutfile,  // without .lut extension
+    int         bake);
+
+// read the given cfg file into the graph. if it can't be read, it is taken to
+// be an image (or image.cfg) and the default cfg (or defcfg if set) is wired
+// to load it with the given input module (0 -> guess from the file name).
+VkResult
+dt_graph_load_config(
+    dt_graph_t *graph,
+    const char *cfgfile,
+    const char *defcfg,
+    dt_token_t  input_module);
+
 typedef struct dt_graph_export_output_t
 {
   int max_width;           // scale ROI request to fit inside this, if > 0
   int max_height;
   dt_token_t mod;          // o-bc1, o-jpg, o-pfm, .. ?
-  dt_token_t inst;         // instance name of sink to replace
+  dt_token_t inst;         // instance name of sink to replace. several outputs may name the same one,
+                           // these become renditions (say full size, web, thumbnail) of one pipeline run
   const char *p_filename;  // set filename param to this
   const char *p_audio;     // if set, write audio to this file
   const char *p_pdata;     // if set, overwrite params of output module
@@ -50,6 +83,14 @@ typedef struct dt_graph_export_t
 
   int          dump_modules;   // debug output: write module graph in dot format
   int          last_frame_only;// only write the very last frame of an animation
+  int          frame_beg;      // write only frames beg..end-1 of an animation
+  int          frame_end;      // 0 means up to the last frame
+  const char  *p_checkpoint;   // if set, save the feedback state here and resume from it, see dt_graph_checkpoint_write()
+  int          checkpoint_every;// save the checkpoint every so many frames, 0 only after the last one
+  int          input_lod;      // let input modules decode at reduced resolution, see dt_graph_input_lod()
+  const char  *p_lut;          // if set, replace the pointwise modules in lut_chain by a lookup into this lut
+  dt_token_t   lut_chain[4];   // module and instance of the first and the last module of the chain
+  int          lut_bake;       // write the lut for the chain to p_lut instead, see dt_graph_lut_chain()
 }
 dt_graph_export_t;
 
@@ -0,0 +1,131 @@
+#pragma once
+#include "pipe/graph.h"
+#include "pipe/modules/api.h"
+
+// fusion of chains of per-pixel modules into a single dispatch of the
+// shared/fuse kernel. the kernel applies the ops listed in its push constants
+// in order, so the full resolution images between the modules in the chain are
+// never written. the push constant words are: number of ops, then for every op
+// its id | module index << 8 followed by the raw params of the module.
+
+#define DT_GRAPH_FUSE_WORDS 32 // 128 bytes, the guaranteed push constant size
+
+typedef struct dt_graph_fuse_op_t
+{
+  dt_token_t  name;   // module name
+  uint32_t    op;     // op id as in shared/fuse.comp
+  uint32_t    words;  // number of param words the kernel expects
+}
+dt_graph_fuse_op_t;
+
+static const dt_graph_fuse_op_t dt_graph_fuse_ops[] = {
+  { dt_token("exposure"), 1, 1 },
+  { dt_token("grade"),    2, 9 },
+  { dt_token("vignette"), 3, 7 },
+  { dt_token("f2srgb"),   4, 1 },
+};
+
+// return the op id if the module can run inside a fused node, or 0
+static inline uint32_t
+dt_graph_fuse_op(dt_module_t *m)
+{
+  if(dt_module_bypassed(m) || m->so->create_nodes || m->so->commit_params || m->num_connectors != 2 ||
+     !dt_connector_input(m->connector) || !dt_connector_output(m->connector+1))
+    return 0;
+  for(int i=0;i<(int)(sizeof(dt_graph_fuse_ops)/sizeof(dt_graph_fuse_ops[0]));i++)
+    if(m->name == dt_graph_fuse_ops[i].name)
+      return m->param_size == 4*dt_graph_fuse_ops[i].words ? dt_graph_fuse_ops[i].op : 0;
+  return 0;
+}
+
+// number of push constant words in use by the fused node
+static inline uint32_t
+_dt_graph_fuse_end(const dt_graph_t *graph, const dt_node_t *node)
+{
+  uint32_t i = 1;
+  for(uint32_t k=0;k<node->push_constant[0];k++)
+    i += 1 + graph->module[node->push_constant[i] >> 8].param_size/4;
+  return i;
+}
+
+static inline void
+_dt_graph_fuse_append(dt_graph_t *graph, dt_node_t *node, dt_module_t *m, uint32_t op)
+{
+  uint32_t *w = node->push_constant;
+  uint32_t i = _dt_graph_fuse_end(graph, node);
+  w[i++] = op | ((uint32_t)(m - graph->module) << 8);
+  memcpy(w + i, m->param, m->param_size);
+  w[0]++;
+}
+
+// called from create_nodes() instead of creating the default node. returns 1 if the
+// module has been appended to the node of its upstream module, 0 if it needs a node
+// of its own. the active module is never appended, so that its input can stay
+// cached during incremental runs.
+static inline int
+dt_graph_fuse(dt_graph_t *graph, dt_module_t *module, int active_module)
+{
+  const uint32_t op = dt_graph_fuse_op(module);
+  if(!op || module - graph->module == active_module) return 0;
+  if(module->bind_cnt) return 0; // fused parameters are pushed from the cpu
+  if(!dt_pipe_shader_exists(dt_token("shared"), dt_token("fuse"))) return 0; // not built by default
+  const dt_connector_t *ci = module->connector, *co = module->connector+1;
+  if(ci->connected_mi < 0) return 0;
+  const int mi = ci->connected_mi, mc = ci->connected_mc;
+  dt_module_t *up = graph->module + mi;
+  const dt_connector_t *uo = up->connector + mc;
+  const int nid = uo->associated_i, nc = uo->associated_c;
+  if(nid < 0 || (uo->flags & s_conn_feedback) || (co->flags & s_conn_feedback)) return 0;
+  if(uo->roi.wd != co->roi.wd || uo->roi.ht != co->roi.ht ||
+     uo->format != co->format || uo->chan != co->chan) return 0;
+
+  dt_node_t *node = graph->node + nid;
+  const int fused = node->name == dt_token("shared") && node->kernel == dt_token("fuse");
+  const uint32_t up_op = fused ? 0 : dt_graph_fuse_op(up);
+  if(!fused && !(up_op && node->module == up && node->kernel == dt_token("main") &&
+        node->type == s_node_compute))
+    return 0;
+
+  // nobody else may read the intermediate image
+  for(int m=0;m<graph->num_modules;m++)
+  {
+    if(graph->module + m == module) continue;
+    for(int c=0;c<graph->module[m].num_connectors;c++)
+      if(dt_connector_input(graph->module[m].connector+c) &&
+         graph->module[m].connector[c].connected_mi == mi &&
+         graph->module[m].connector[c].connected_mc == mc)
+        return 0;
+  }
+
+  const uint32_t need = (fused ? _dt_graph_fuse_end(graph, node) : 2 + up->param_size/4)
+    + 1 + module->param_size/4;
+  if(need > DT_GRAPH_FUSE_WORDS) return 0;
+
+  if(!fused)
+  { // turn the node of the upstream module into a fused node
+    node->name   = dt_token("shared");
+    node->kernel = dt_token("fuse");
+    node->push_constant_size = DT_GRAPH_FUSE_WORDS*sizeof(uint32_t);
+    memset(node->push_constant, 0, sizeof(node->push_constant));
+    _dt_graph_fuse_append(graph, node, up, up_op);
+  }
+  _dt_graph_fuse_append(graph, node, module, op);
+  // downstream modules find the output image on the fused node
+  module->connector[1].associated_i = nid;
+  module->connector[1].associated_c = nc;
+  return 1;
+}
+
+// parameters may change without rebuilding the nodes, so copy them again
+// before the push constants are recorded.
+static inline void
+dt_graph_fuse_push(const dt_graph_t *graph, dt_node_t *node)
+{
+  uint32_t *w = node->push_constant;
+  for(uint32_t k=0,i=1;k<w[0];k++)
+  {
+    const dt_module_t *m = graph->module + (w[i++] >> 8);
+    memcpy(w + i, m->param, m->param_size);
+    i += m->param_size/4;
+  }
+}
@@ -1,6 +1,8 @@
 #pragma once
 
 #define DT_GRAPH_MAX_FRAMES 2
+#define DT_GRAPH_MAX_RING   4 // max command buffers in flight
+#define DT_PIPE_MAX_SPEC    8 // specialisation constants per kernel, other than the work group size
 typedef uint32_t dt_graph_run_t;
 typedef struct dt_module_t dt_module_t;
 typedef struct dt_node_t dt_node_t;
@@ -14,6 +16,7 @@ typedef enum dt_module_flags_t
   s_module_request_read_geo    = 4,
   s_module_request_dyn_array   = 8,
   s_module_request_all         = 16,
+  s_module_geo_dynamic         = 32, // geometry node reads new geo every frame: build fast, allow refits
 }
 dt_module_flags_t;
 
@@ -2,6 +2,20 @@
 #include "pipe/graph-io.h"
 #include "pipe/modules/api.h"
 
+// the history is a list of items in a growing pool. most items are cfg lines
+// as they would be read by dt_graph_read_config_line(). parameter changes are
+// stored as binary deltas instead: a short ascii label for the gui, followed
+// by the changed byte range of the parameter before and after the change.
+// going back and forth over parameter changes only copies these bytes, other
+// items replay the history from the start.
+
+typedef struct dt_graph_history_delta_t
+{
+  dt_token_t name, inst, param; // module and parameter, ids may be recycled
+  uint32_t   beg, end;          // changed byte range, old and new bytes follow the struct
+}
+dt_graph_history_delta_t;
+
 static inline void
 dt_graph_history_init(
     dt_graph_t *graph)
@@ -11,11 +25,63 @@ dt_graph_history_init(
   graph->history_item_max = 1000;
   graph->history_item_cur = 0;
   graph->history_item_end = 0;
-  graph->history_item = (char**)malloc(sizeof(char*) * (graph->history_item_max + 1));
+  graph->history_item  = (char**)malloc(sizeof(char*) * (graph->history_item_max + 1));
+  graph->history_delta = (dt_graph_history_delta_t**)calloc(sizeof(dt_graph_history_delta_t*), graph->history_item_max + 1);
+  graph->history_item[0] = graph->history_pool;
+  graph->history_shadow = (uint8_t*)malloc(graph->params_max);
+  graph->history_shadow_end = 0;
+}
+
+// the parameters are in sync with the history, remember them to compute the next delta
+static inline void
+_dt_graph_history_sync_shadow(
+    dt_graph_t *graph)
+{
+  memcpy(graph->history_shadow, graph->params_pool, graph->params_end);
+  graph->history_shadow_end = graph->params_end;
 }
 
+// make room for at least one more item with size bytes behind
+// history_item[history_item_end]. repoints the items if the pool moved.
 static inline int
-dt_graph_history_reset(
+_dt_graph_history_grow(
+    dt_graph_t *graph,
+    uint32_t    items,
+    size_t      size)
+{
+  if(graph->history_item_end + items >= graph->history_item_max)
+  {
+    uint32_t max = graph->history_item_max;
+    while(graph->history_item_end + items >= max) max *= 2;
+    char **hi = (char**)realloc(graph->history_item, sizeof(char*) * (max + 1));
+    dt_graph_history_delta_t **hd = (dt_graph_history_delta_t**)realloc(graph->history_delta, sizeof(dt_graph_history_delta_t*) * (max + 1));
+    if(hi) graph->history_item  = hi;
+    if(hd) graph->history_delta = hd;
+    if(!hi || !hd) return 1;
+    graph->history_item_max = max;
+  }
+  size_t used = graph->history_item[graph->history_item_end] - graph->history_pool;
+  if(used + size >= graph->history_max)
+  {
+    size_t max = graph->history_max;
+    while(used + size >= max) max *= 2;
+    if(max > UINT32_MAX) return 1;
+    char *pool = (char*)realloc(graph->history_pool, max);
+    if(!pool) return 1;
+    for(uint32_t i=0;i<=graph->history_item_end;i++)
+    {
+      graph->history_item[i] = pool + (graph->history_item[i] - graph->history_pool);
+      if(i < graph->history_item_end && graph->history_delta[i])
+        graph->history_delta[i] = (dt_graph_history_delta_t*)(pool + ((char*)graph->history_delta[i] - graph->history_pool));
+    }
+    graph->history_pool = pool;
+    graph->history_max  = max;
+  }
+  return 0;
+}
+
+static inline int
+_dt_graph_history_write_all(
     dt_graph_t *graph)
 {
   char *tmp, *max = graph->history_pool + graph->history_max;
@@ -24,7 +90,11 @@ dt_graph_history_reset(
   hi[0] = graph->history_pool;
   // this global block consists of more than one line. need to look for newlines after
   if(!(tmp = dt_graph_write_global_ascii(graph, hi[0], max-hi[0]))) return 1;
-  for(char *c=hi[0];c<tmp;c++) if(*c == '\n') hi[++i] = c+1;
+  for(char *c=hi[0];c<tmp;c++) if(*c == '\n')
+  {
+    if((uint32_t)i >= graph->history_item_max) return 1;
+    hi[++i] = c+1;
+  }
 
   // write all modules
   for(uint32_t m=0;m<graph->num_modules;m++,i+=(hi[i+1]!=hi[i]))
@@ -50,18 +120,44 @@ dt_graph_history_reset(
         return 1;
 
   graph->history_item_cur = graph->history_item_end = i;
+  for(int k=0;k<i;k++) graph->history_delta[k] = 0;
   for(char *c=graph->history_pool;c<graph->history_item[graph->history_item_end];c++)
     if(*c == '\n') *c = 0;
   return 0;
 }
 
+// replace the history by the current state of the graph
+static inline int
+dt_graph_history_reset(
+    dt_graph_t *graph)
+{
+  uint32_t items = 100; // global lines
+  for(uint32_t m=0;m<graph->num_modules;m++)
+    if(graph->module[m].name)
+      items += 1 + graph->module[m].num_connectors + graph->module[m].so->num_params + graph->module[m].keyframe_cnt;
+  graph->history_item_cur = graph->history_item_end = 0;
+  graph->history_item[0] = graph->history_pool;
+  if(_dt_graph_history_grow(graph, items, 0)) return 1;
+  while(_dt_graph_history_write_all(graph))
+  { // try again with twice the pool
+    graph->history_item_cur = graph->history_item_end = 0;
+    graph->history_item[0] = graph->history_pool;
+    if(_dt_graph_history_grow(graph, items, 2*(size_t)graph->history_max)) return 1;
+  }
+  _dt_graph_history_sync_shadow(graph);
+  return 0;
+}
+
 static inline void
 dt_graph_history_cleanup(
     dt_graph_t *graph)
 {
   graph->history_max = graph->history_item_max = graph->history_item_cur = graph->history_item_end = 0;
-  free(graph->history_item); graph->history_item = 0;
-  free(graph->history_pool); graph->history_pool = 0;
+  graph->history_shadow_end = 0;
+  free(graph->history_item);   graph->history_item = 0;
+  free(graph->history_delta);  graph->history_delta = 0;
+  free(graph->history_pool);   graph->history_pool = 0;
+  free(graph->history_shadow); graph->history_shadow = 0;
 }
 
 static inline int
@@ -69,16 +165,38 @@ _dt_graph_history_check_buf(
     dt_graph_t *graph,
     size_t      size)
 {
+  if(!graph->history_pool) return 1; // no history on this graph
   graph->history_item_end = graph->history_item_cur; // cut away the rest
-  if(graph->history_item_end >= graph->history_item_max)
-  { // TODO: resize and copy buffers
-    return 1;
-  }
-  if((size_t)(graph->history_pool + graph->history_max - graph->history_item[graph->history_item_end]) <= size)
-  { // TODO: resize and copy buffer, repoint history_item*
-    return 1;
-  }
-  return 0;
+  return _dt_graph_history_grow(graph, 1, size);
+}
+
+// finish an item of cfg lines written to history_item[i..]
+static inline void
+_dt_graph_history_commit(
+    dt_graph_t *graph,
+    uint32_t    end)
+{
+  for(uint32_t k=graph->history_item_end;k<end;k++) graph->history_delta[k] = 0;
+  graph->history_item_cur = graph->history_item_end = end;
+  _dt_graph_history_sync_shadow(graph); // the lines may have changed parameters
+}
+
+static inline void
+_dt_graph_history_apply_delta(
+    dt_graph_t                     *graph,
+    const dt_graph_history_delta_t *d,
+    int                             undo)
+{
+  const int modid = dt_module_get(graph, d->name, d->inst);
+  if(modid < 0) return;
+  const dt_module_t *mod = graph->module + modid;
+  const int parid = dt_module_get_param(mod->so, d->param);
+  if(parid < 0) return;
+  const uint8_t *val = (const uint8_t *)(d+1) + (undo ? 0 : d->end - d->beg);
+  const size_t off = mod->param + mod->so->param[parid]->offset - graph->params_pool;
+  memcpy(graph->params_pool + off + d->beg, val, d->end - d->beg);
+  if(off + d->end <= graph->history_shadow_end)
+    memcpy(graph->history_shadow + off + d->beg, val, d->end - d->beg);
 }
 
 // collect parameter change
@@ -90,24 +208,57 @@ dt_graph_history_append(
     double      throttle)  // throttle same modid,parid to 1 item per `throttle` seconds. pass 0.0 for always record.
 {
   static double write_time = 0.0; // does not need to go on graph, throttling is a gui thing.
-  int cnt = graph->module[modid].so->param[parid]->cnt; // this is way conservative (for instance for draw)
-  size_t psz = dt_ui_param_size(graph->module[modid].so->param[parid]->type, cnt);
-  if(_dt_graph_history_check_buf(graph, 40+psz)) return;
+  if(!graph->history_pool) return;
+  const dt_module_t *mod = graph->module + modid;
+  const dt_ui_param_t *p = mod->so->param[parid];
+  const uint8_t *val = mod->param + p->offset;
+  const size_t off = val - graph->params_pool;
+  const uint32_t psz = dt_ui_param_size(p->type, p->cnt);
+  if(off + psz > graph->history_shadow_end)
+  { // params of modules added behind the back of the history
+    memcpy(graph->history_shadow + graph->history_shadow_end, graph->params_pool + graph->history_shadow_end,
+        graph->params_end - graph->history_shadow_end);
+    graph->history_shadow_end = graph->params_end;
+  }
+  graph->history_item_end = graph->history_item_cur; // cut away the rest
+  double time = dt_time();
   int i = graph->history_item_end;
-  char *eop, **hi = graph->history_item, *max = graph->history_pool + graph->history_max;
-  if(hi[i] < (hi[i+1] = dt_graph_write_param_ascii(graph, modid, parid, hi[i], max - hi[i], &eop)))
-  {
-    *(hi[i+1]-1) = 0;
-    double time = dt_time();
-    if(throttle > 0.0 && i > 0 && !strncmp(hi[i-1], hi[i], eop-hi[i]) &&
-       time < write_time + throttle)
-    { // replace old item
-      memmove(hi[i-1], hi[i], hi[i+1]-hi[i]);
-      hi[i] = hi[i-1] + (hi[i+1]-hi[i]);
-    }
-    else graph->history_item_cur = ++graph->history_item_end; // now a valid new item
-    write_time = time;
+  const dt_graph_history_delta_t *d = i > 0 ? graph->history_delta[i-1] : 0;
+  if(throttle > 0.0 && d && time < write_time + throttle &&
+     d->name == mod->name && d->inst == mod->inst && d->param == p->name)
+  { // replace old item: roll back the shadow and record one combined delta
+    memcpy(graph->history_shadow + off + d->beg, d+1, d->end - d->beg);
+    graph->history_item_cur = graph->history_item_end = --i;
   }
+  write_time = time;
+
+  const uint8_t *old = graph->history_shadow + off;
+  uint32_t beg = 0, end = psz;
+  while(beg < end && val[beg]   == old[beg])   beg++;
+  while(end > beg && val[end-1] == old[end-1]) end--;
+  if(beg == end) { beg = 0; end = psz; } // record anyway, the change may have been synced already
+
+  const size_t label = 128; // truncated ascii of the new value, for display only
+  if(_dt_graph_history_check_buf(graph, label + 8 + sizeof(dt_graph_history_delta_t) + 2*(end-beg))) return;
+  char **hi = graph->history_item;
+  char *pos = dt_graph_write_param_ascii(graph, modid, parid, hi[i], label, 0);
+  if(pos && pos > hi[i]) *(pos-1) = 0;
+  else pos = hi[i] + snprintf(hi[i], label, "param:%"PRItkn":%"PRItkn":%"PRItkn":..",
+        dt_token_str(mod->name), dt_token_str(mod->inst), dt_token_str(p->name)) + 1;
+  pos = graph->history_pool + (((pos - graph->history_pool) + 7) & ~(size_t)7);
+  dt_graph_history_delta_t *nd = (dt_graph_history_delta_t *)pos;
+  nd->name  = mod->name;
+  nd->inst  = mod->inst;
+  nd->param = p->name;
+  nd->beg   = beg;
+  nd->end   = end;
+  uint8_t *dat = (uint8_t *)(nd+1);
+  memcpy(dat, old + beg, end-beg);
+  memcpy(dat + end-beg, val + beg, end-beg);
+  memcpy(graph->history_shadow + off + beg, val + beg, end-beg);
+  graph->history_delta[i] = nd;
+  hi[i+1] = (char *)(dat + 2*(end-beg));
+  graph->history_item_cur = ++graph->history_item_end; // now a valid new item
 }
 
 static inline void
@@ -119,7 +270,7 @@ dt_graph_history_module(
   int i = graph->history_item_end;
   char **hi = graph->history_item, *max = graph->history_pool + graph->history_max;
   if(hi[i] < (hi[i+1] = dt_graph_write_module_ascii(graph, modid, hi[i], max - hi[i])))
-  { *(hi[i+1]-1) = 0; graph->history_item_cur = ++graph->history_item_end; }
+  { *(hi[i+1]-1) = 0; _dt_graph_history_commit(graph, i+1); }
 }
 
 static inline void
@@ -131,7 +282,7 @@ dt_graph_history_connection(
   int i = graph->history_item_end;
   char **hi = graph->history_item, *max = graph->history_pool + graph->history_max;
   if(hi[i] < (hi[i+1] = dt_graph_write_connection_ascii(graph, modid, conid, hi[i], max - hi[i])))
-  { *(hi[i+1]-1) = 0; graph->history_item_cur = ++graph->history_item_end; }
+  { *(hi[i+1]-1) = 0; _dt_graph_history_commit(graph, i+1); }
 }
 
 static inline void
@@ -148,19 +299,20 @@ dt_graph_history_keyframe(
   int i = graph->history_item_end;
   char **hi = graph->history_item, *max = graph->history_pool + graph->history_max;
   if(hi[i] < (hi[i+1] = dt_graph_write_keyframe_ascii(graph, modid, keyid, hi[i], max - hi[i])))
-  { *(hi[i+1]-1) = 0; graph->history_item_cur = ++graph->history_item_end; }
+  { *(hi[i+1]-1) = 0; _dt_graph_history_commit(graph, i+1); }
 }
 
 static inline void
 dt_graph_history_global(
     dt_graph_t *graph)
 {
-  if(_dt_graph_history_check_buf(graph, 40)) return;
+  if(_dt_graph_history_check_buf(graph, 1000)) return;
+  if(_dt_graph_history_grow(graph, 20, 1000)) return; // a handful of lines
   int i = graph->history_item_end;
   char *tmp, **hi = graph->history_item, *max = graph->history_pool + graph->history_max;
   if(!(tmp = dt_graph_write_global_ascii(graph, hi[i], max-hi[i]))) return;
   for(char *c=hi[i];c<tmp;c++) if(*c == '\n') { hi[++i] = c+1; *c = 0; }
-  graph->history_item_cur = graph->history_item_end = i;
+  _dt_graph_history_commit(graph, i);
 }
 
 // append a line of cfg (as it comes from presets) straight to history
@@ -175,7 +327,7 @@ dt_graph_history_line(
   int i = graph->history_item_end;
   char **hi = graph->history_item, *max = graph->history_pool + graph->history_max;
   if(hi[i] < (hi[i+1] = strncpy(hi[i], line, max - hi[i]) + len))
-  { *(hi[i+1]-1) = 0; graph->history_item_cur = ++graph->history_item_end; }
+  { *(hi[i+1]-1) = 0; _dt_graph_history_commit(graph, i+1); }
 }
 
 // reset graph configuration to a certain point in history
@@ -185,7 +337,18 @@ dt_graph_history_set(
     int         item)
 {
   if(item < 0 || (uint32_t)item >= graph->history_item_end) return 1;
-  graph->history_item_cur = item+1;
+  const uint32_t cur = graph->history_item_cur, dst = item+1;
+  int deltas = 1; // only parameter changes in between?
+  for(uint32_t i=MIN(cur, dst);deltas&&i<MAX(cur, dst);i++)
+    if(!graph->history_delta[i]) deltas = 0;
+  if(deltas)
+  { // undo or redo the binary changes, no need to replay
+    for(uint32_t i=cur;i>dst;i--)  _dt_graph_history_apply_delta(graph, graph->history_delta[i-1], 1);
+    for(uint32_t i=cur;i<dst;i++)  _dt_graph_history_apply_delta(graph, graph->history_delta[i],   0);
+    graph->history_item_cur = dst;
+    return 0;
+  }
+  graph->history_item_cur = dst;
   // clean up all connections (they might potentially leave disconnected/broken
   // portions of graph otherwise).
   for(uint32_t m=0;m<graph->num_modules;m++)
@@ -201,8 +364,13 @@ dt_graph_history_set(
     }
   }
   for(uint32_t i=0;i<graph->history_item_cur;i++)
-    if(dt_graph_read_config_line(graph, graph->history_item[i]) < 0)
+  {
+    if(graph->history_delta[i])
+      _dt_graph_history_apply_delta(graph, graph->history_delta[i], 0);
+    else if(dt_graph_read_config_line(graph, graph->history_item[i]) < 0)
       return 1;
+  }
+  _dt_graph_history_sync_shadow(graph);
   return 0;
 }
 
@@ -4,8 +4,14 @@
 #include "pipe/io.h"
 #include "core/log.h"
 #include "core/fs.h"
+#include "db/hash.h"
 #include <libgen.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <inttypes.h>
+#include <dirent.h>
+#include <time.h>
 
 typedef enum dt_param_write_mode_t
 {
@@ -15,18 +21,110 @@ typedef enum dt_param_write_mode_t
 }
 dt_param_write_mode_t;
 
-// helper to the helpers reading parameters in full, subsets, or for keyframes.
+// binary cache of parsed configs. this is a sequence of records which replay
+// exactly what the ascii lines did, but parameter values are stored as the raw
+// bytes that end up in the params pool, so loading them is a memcpy.
+// the files are named after the path of the ascii cfg, so saving an edited
+// cfg replaces its entry. entries of cfg files which have been moved or
+// deleted are swept from the directory now and then.
+#define DT_CFG_BIN_MAGIC    0x67666362u // "bcfg"
+#define DT_CFG_BIN_VERSION  2
+#define DT_CFG_BIN_MIN_SIZE 4096        // smaller cfg files are parsed directly
+#define DT_CFG_BIN_PRUNE    (24*3600)   // seconds between sweeps over the cache directory
+
+typedef struct dt_cfg_bin_header_t
+{
+  uint32_t magic;
+  uint32_t version;
+  int64_t  src_mtime;   // modification time of the ascii file in ns
+  uint64_t src_size;    // and its size
+  uint64_t size;        // bytes of records following the header and the path
+  uint32_t path_len;    // bytes of the ascii file's path following the header, no terminating zero
+  uint32_t pad;
+}
+dt_cfg_bin_header_t;
+
+typedef enum dt_cfg_bin_cmd_t
+{
+  s_cfg_bin_module = 0,
+  s_cfg_bin_param,
+  s_cfg_bin_connect,
+  s_cfg_bin_feedback,
+  s_cfg_bin_frames,
+  s_cfg_bin_fps,
+  s_cfg_bin_precision,
+  s_cfg_bin_bind,
+}
+dt_cfg_bin_cmd_t;
+
+typedef struct dt_cfg_bin_rec_t
+{
+  uint32_t cmd;
+  uint32_t size;        // payload bytes following, padded to 8
+}
+dt_cfg_bin_rec_t;
+
+typedef struct dt_cfg_bin_module_t
+{
+  dt_token_t name, inst;
+  float x, y;
+}
+dt_cfg_bin_module_t;
+
+typedef struct dt_cfg_bin_param_t
+{
+  dt_token_t name, inst, parm;
+  int32_t beg, end, frame, mode;
+  // followed by the values
+}
+dt_cfg_bin_param_t;
+
+typedef struct dt_cfg_bin_bind_t
+{
+  dt_token_t tkn[6];    // as a connection, with the parameter instead of the input connector
+  uint32_t   word, pad;
+}
+dt_cfg_bin_bind_t;
+
+typedef struct dt_cfg_bin_t
+{ // records collected while parsing ascii
+  uint8_t *buf;
+  size_t   size, max;
+}
+dt_cfg_bin_t;
+
+static inline void * // append a record and return a pointer to its payload, or 0 if not recording
+cfg_bin_append(dt_cfg_bin_t *b, dt_cfg_bin_cmd_t cmd, uint32_t size)
+{
+  if(!b) return 0;
+  const uint32_t padded = (size + 7) & ~7u;
+  if(b->size + sizeof(dt_cfg_bin_rec_t) + padded > b->max)
+  {
+    b->max = 2*b->max + sizeof(dt_cfg_bin_rec_t) + padded + 4096;
+    b->buf = realloc(b->buf, b->max);
+  }
+  dt_cfg_bin_rec_t *rec = (dt_cfg_bin_rec_t *)(b->buf + b->size);
+  rec->cmd  = cmd;
+  rec->size = padded;
+  uint8_t *payload = (uint8_t *)(rec + 1);
+  memset(payload + size, 0, padded - size);
+  b->size += sizeof(dt_cfg_bin_rec_t) + padded;
+  return payload;
+}
+
+// find the parameter storage to write to, allocating a keyframe if frame >= 0.
+// returns 0 on success.
 static inline int
-read_param_values_ascii(
-    dt_graph_t *graph,
-    char       *line,
-    dt_token_t  name,
-    dt_token_t  inst,
-    dt_token_t  parm,
-    int         beg,
-    int         end,
-    int         frame,
-    dt_param_write_mode_t mode)
+param_target(
+    dt_graph_t           *graph,
+    dt_token_t            name,
+    dt_token_t            inst,
+    dt_token_t            parm,
+    int                   beg,
+    int                  *end,
+    int                   frame,
+    const dt_ui_param_t **pp,
+    uint8_t             **data)
 {
   int modid = dt_module_get(graph, name, inst);
   if(modid < 0 || modid > graph->num_modules)
@@ -43,13 +141,13 @@ read_param_values_ascii(
   }
   const dt_ui_param_t *p = graph->module[modid].so->param[parid];
   int cnt = p->cnt;
-  uint8_t *data = graph->module[modid].param + p->offset;
-  if(beg < 0 || beg >= cnt || end < 0 || end > cnt)
+  *data = graph->module[modid].param + p->offset;
+  if(beg < 0 || beg >= cnt || *end < 0 || *end > cnt)
   {
-    dt_log(s_log_err|s_log_pipe, "parameter bounds exceeded %"PRItkn" %d,%d > %d", dt_token_str(parm), beg, end, cnt);
+    dt_log(s_log_err|s_log_pipe, "parameter bounds exceeded %"PRItkn" %d,%d > %d", dt_token_str(parm), beg, *end, cnt);
     return 4;
   }
-  if(end == 0) end = cnt;
+  if(*end == 0) *end = cnt;
   if(frame >= 0)
   {
     int ki = -1;
@@ -65,31 +163,73 @@ read_param_values_ascii(
     graph->module[modid].keyframe[ki].frame = frame;
     graph->module[modid].keyframe[ki].param = parm;
     graph->module[modid].keyframe[ki].beg   = beg;
-    graph->module[modid].keyframe[ki].end   = end;
+    graph->module[modid].keyframe[ki].end   = *end;
     graph->module[modid].keyframe[ki].data  = graph->params_pool + graph->params_end;
     graph->params_end += dt_ui_param_size(p->type, p->cnt);
     assert(graph->params_end <= graph->params_max);
-    data = graph->module[modid].keyframe[ki].data;
+    *data = graph->module[modid].keyframe[ki].data;
   }
+  *pp = p;
+  return 0;
+}
+
+// helper to the helpers reading parameters in full, subsets, or for keyframes.
+static inline int
+read_param_values_ascii(
+    dt_graph_t *graph,
+    char       *line,
+    dt_token_t  name,
+    dt_token_t  inst,
+    dt_token_t  parm,
+    int         beg,
+    int         end,
+    int         frame,
+    dt_param_write_mode_t mode,
+    dt_cfg_bin_t *bin)
+{
+  const dt_ui_param_t *p = 0;
+  uint8_t *data = 0;
+  int err = param_target(graph, name, inst, parm, beg, &end, frame, &p, &data);
+  if(err) return err;
+  size_t bin_size = 0;
+  uint8_t *bin_val = 0;
   if(p->type == dt_token("float"))
   {
     float *block = (float *)data + beg;
+    if(bin) bin_size = sizeof(float)*(end-beg);
     if(mode == s_param_set)
       for(int i=beg;i<end;i++) *(block++) = dt_read_float(line, &line);
-    else if(mode == s_param_inc)
-      for(int i=beg;i<end;i++) *(block++) += dt_read_float(line, &line);
-    else if(mode == s_param_dec)
-      for(int i=beg;i<end;i++) *(block++) -= dt_read_float(line, &line);
+    else
+    { // record the increments, not the result
+      float *inc = bin ? malloc(bin_size) : 0;
+      for(int i=beg;i<end;i++)
+      {
+        float v = dt_read_float(line, &line);
+        if(inc) inc[i-beg] = v;
+        *(block++) += mode == s_param_inc ? v : -v;
+      }
+      bin_val = (uint8_t *)inc;
+    }
+    if(bin && !bin_val) bin_val = data + sizeof(float)*beg;
   }
   else if(p->type == dt_token("int"))
   {
     int32_t *block = (int32_t *)data + beg;
+    if(bin) bin_size = sizeof(int32_t)*(end-beg);
     if(mode == s_param_set)
       for(int i=beg;i<end;i++) *(block++) = dt_read_int(line, &line);
-    else if(mode == s_param_inc)
-      for(int i=beg;i<end;i++) *(block++) += dt_read_int(line, &line);
-    else if(mode == s_param_dec)
-      for(int i=beg;i<end;i++) *(block++) -= dt_read_int(line, &line);
+    else
+    {
+      int32_t *inc = bin ? malloc(bin_size) : 0;
+      for(int i=beg;i<end;i++)
+      {
+        int32_t v = dt_read_int(line, &line);
+        if(inc) inc[i-beg] = v;
+        *(block++) += mode == s_param_inc ? v : -v;
+      }
+      bin_val = (uint8_t *)inc;
+    }
+    if(bin && !bin_val) bin_val = data + sizeof(int32_t)*beg;
   }
   else if(p->type == dt_token("string"))
   {
@@ -98,22 +238,32 @@ read_param_values_ascii(
     do str[i++] = *(line++);
     while(line[0] && (i < end-1));
     str[i] = 0;
+    bin_size = i + 1 - beg;
+    bin_val  = data + beg;
   }
   else dt_log(s_log_err|s_log_pipe, "unknown param type %"PRItkn, dt_token_str(p->type));
+  dt_cfg_bin_param_t *rec = cfg_bin_append(bin, s_cfg_bin_param, sizeof(*rec) + bin_size);
+  if(rec)
+  {
+    *rec = (dt_cfg_bin_param_t){ name, inst, parm, beg, end, frame, mode };
+    if(bin_size) memcpy(rec + 1, bin_val, bin_size);
+  }
+  if(bin && mode != s_param_set && p->type != dt_token("string")) free(bin_val);
   return 0;
 }
 
 // helper to read parameters from config file
 static inline int
 read_param_ascii(
-    dt_graph_t *graph,
-    char       *line)
+    dt_graph_t   *graph,
+    char         *line,
+    dt_cfg_bin_t *bin)
 {
   // read module:instance:param:value x cnt
   dt_token_t name = dt_read_token(line, &line);
   dt_token_t inst = dt_read_token(line, &line);
   dt_token_t parm = dt_read_token(line, &line);
-  return read_param_values_ascii(graph, line, name, inst, parm, 0, 0, -1, s_param_set);
+  return read_param_values_ascii(graph, line, name, inst, parm, 0, 0, -1, s_param_set, bin);
 }
 
 // read only a subset of the parameters, given explicit indices for begin and end.
@@ -121,7 +271,8 @@ static inline int
 read_paramsub_ascii(
     dt_graph_t           *graph,
     char                 *line,
-    dt_param_write_mode_t mode)
+    dt_param_write_mode_t mode,
+    dt_cfg_bin_t         *bin)
 {
   // read module:instance:param:beg:end:value x cnt
   dt_token_t name = dt_read_token(line, &line);
@@ -129,14 +280,15 @@ read_paramsub_ascii(
   dt_token_t parm = dt_read_token(line, &line);
   int beg = dt_read_int(line, &line);
   int end = dt_read_int(line, &line);
-  return read_param_values_ascii(graph, line, name, inst, parm, beg, end, -1, mode);
+  return read_param_values_ascii(graph, line, name, inst, parm, beg, end, -1, mode, bin);
 }
 
 // helper to keyframe from config file
 static inline int
 read_keyframe_ascii(
-    dt_graph_t *graph,
-    char       *line)
+    dt_graph_t   *graph,
+    char         *line,
+    dt_cfg_bin_t *bin)
 {
   // read frame:module:instance:param:beg:end:value x cnt
   int frame = dt_read_int(line, &line);
@@ -145,36 +297,29 @@ read_keyframe_ascii(
   dt_token_t parm = dt_read_token(line, &line);
   uint32_t beg = dt_read_int(line, &line);
   uint32_t end = dt_read_int(line, &line);
-  return read_param_values_ascii(graph, line, name, inst, parm, beg, end, frame, s_param_set);
+  return read_param_values_ascii(graph, line, name, inst, parm, beg, end, frame, s_param_set, bin);
 }
 
-// helper to read a connection information from config file
+// connect two modules given by names
 static inline int
-read_connection_ascii(
-    dt_graph_t *graph,
-    char       *line,
-    int         extra_flags)
+read_connection(
+    dt_graph_t       *graph,
+    const dt_token_t *tkn,  // mod0 inst0 conn0 mod1 inst1 conn1
+    int               extra_flags)
 {
-  dt_token_t mod0  = dt_read_token(line, &line);
-  dt_token_t inst0 = dt_read_token(line, &line);
-  dt_token_t conn0 = dt_read_token(line, &line);
-  dt_token_t mod1  = dt_read_token(line, &line);
-  dt_token_t inst1 = dt_read_token(line, &line);
-  dt_token_t conn1 = dt_read_token(line, &line);
-
-  int modid0 = dt_module_get(graph, mod0, inst0);
-  int modid1 = dt_module_get(graph, mod1, inst1);
+  int modid0 = dt_module_get(graph, tkn[0], tkn[1]);
+  int modid1 = dt_module_get(graph, tkn[3], tkn[4]);
   if(modid0 <= -1 || modid1 <= -1 || modid0 >= graph->num_modules || modid1 >= graph->num_modules)
   {
     dt_log(s_log_pipe, "[read connect] "
         "%"PRItkn" %"PRItkn" %"PRItkn" %"PRItkn" %"PRItkn" %"PRItkn"",
-        dt_token_str(mod0), dt_token_str(inst0), dt_token_str(conn0),
-        dt_token_str(mod1), dt_token_str(inst1), dt_token_str(conn1));
+        dt_token_str(tkn[0]), dt_token_str(tkn[1]), dt_token_str(tkn[2]),
+        dt_token_str(tkn[3]), dt_token_str(tkn[4]), dt_token_str(tkn[5]));
     dt_log(s_log_pipe, "[read connect] no such modules %d %d", modid0, modid1);
     return 1;
   }
-  int conid0 = dt_module_get_connector(graph->module+modid0, conn0);
-  int conid1 = dt_module_get_connector(graph->module+modid1, conn1);
+  int conid0 = dt_module_get_connector(graph->module+modid0, tkn[2]);
+  int conid1 = dt_module_get_connector(graph->module+modid1, tkn[5]);
   int err = extra_flags & s_conn_feedback ?
     dt_module_feedback(graph, modid0, conid0, modid1, conid1) :
     dt_module_connect (graph, modid0, conid0, modid1, conid1);
@@ -182,8 +327,8 @@ read_connection_ascii(
   {
     dt_log(s_log_pipe, "[read connect] "
         "%"PRItkn" %"PRItkn" %"PRItkn" %"PRItkn" %"PRItkn" %"PRItkn,
-        dt_token_str(mod0), dt_token_str(inst0), dt_token_str(conn0),
-        dt_token_str(mod1), dt_token_str(inst1), dt_token_str(conn1));
+        dt_token_str(tkn[0]), dt_token_str(tkn[1]), dt_token_str(tkn[2]),
+        dt_token_str(tkn[3]), dt_token_str(tkn[4]), dt_token_str(tkn[5]));
     dt_log(s_log_pipe, "[read connect] connection failed: error %d: %s", err, dt_connector_error_str(err));
     dt_log(s_log_pipe, "[read connect] %"PRItkn":%"PRItkn" -> %"PRItkn":%"PRItkn,
         dt_token_str(graph->module[modid0].connector[conid0].chan),
@@ -199,16 +344,67 @@ read_connection_ascii(
   return 0;
 }
 
+// helper to read a connection information from config file
+static inline int
+read_connection_ascii(
+    dt_graph_t   *graph,
+    char         *line,
+    int           extra_flags,
+    dt_cfg_bin_t *bin)
+{
+  dt_token_t tkn[6];
+  for(int k=0;k<6;k++) tkn[k] = dt_read_token(line, &line);
+  int err = read_connection(graph, tkn, extra_flags);
+  dt_token_t *rec = cfg_bin_append(bin, extra_flags & s_conn_feedback ? s_cfg_bin_feedback : s_cfg_bin_connect, sizeof(tkn));
+  if(rec) memcpy(rec, tkn, sizeof(tkn));
+  return err;
+}
+
+// bind a parameter to a storage buffer written by another module
+static inline int
+read_bind(
+    dt_graph_t       *graph,
+    const dt_token_t *tkn,  // mod0 inst0 conn0 mod1 inst1 param
+    uint32_t          word)
+{
+  int modid0 = dt_module_get(graph, tkn[0], tkn[1]);
+  int modid1 = dt_module_get(graph, tkn[3], tkn[4]);
+  int conid0 = modid0 < 0 ? -1 : dt_module_get_connector(graph->module+modid0, tkn[2]);
+  int err = modid1 < 0 ? 1 : conid0 < 0 ? 8 : dt_module_bind(graph, modid0, conid0, modid1, tkn[5], word);
+  if(err)
+  {
+    dt_log(s_log_pipe, "[read bind] "
+        "%"PRItkn" %"PRItkn" %"PRItkn" %"PRItkn" %"PRItkn" %"PRItkn" %u",
+        dt_token_str(tkn[0]), dt_token_str(tkn[1]), dt_token_str(tkn[2]),
+        dt_token_str(tkn[3]), dt_token_str(tkn[4]), dt_token_str(tkn[5]), word);
+    dt_log(s_log_pipe, "[read bind] binding failed: error %d: %s", err, dt_connector_error_str(err));
+  }
+  return err;
+}
+
+static inline int
+read_bind_ascii(
+    dt_graph_t   *graph,
+    char         *line,
+    dt_cfg_bin_t *bin)
+{
+  dt_cfg_bin_bind_t b = {{0}};
+  for(int k=0;k<6;k++) b.tkn[k] = dt_read_token(line, &line);
+  b.word = dt_read_int(line, &line);
+  dt_cfg_bin_bind_t *rec = cfg_bin_append(bin, s_cfg_bin_bind, sizeof(b));
+  if(rec) *rec = b;
+  return read_bind(graph, b.tkn, b.word);
+}
+
 // helper to add a new module from config file
 static inline int
-read_module_ascii(
+read_module(
     dt_graph_t *graph,
-    char       *line)
+    dt_token_t  name,
+    dt_token_t  inst,
+    float       x,
+    float       y)
 {
-  dt_token_t name = dt_read_token(line, &line);
-  dt_token_t inst = dt_read_token(line, &line);
-  float x = dt_read_float(line, &line);
-  float y = dt_read_float(line, &line);
   // in case of failure:
   // discard module id, but remember error state (returns modid=-1)
   int modid = dt_module_add(graph, name, inst);
@@ -223,26 +419,294 @@ read_module_ascii(
   return 0;
 }
 
-int dt_graph_read_config_line(
-    dt_graph_t *graph,
-    char *c)
+static inline int
+read_module_ascii(
+    dt_graph_t   *graph,
+    char         *line,
+    dt_cfg_bin_t *bin)
+{
+  dt_token_t name = dt_read_token(line, &line);
+  dt_token_t inst = dt_read_token(line, &line);
+  float x = dt_read_float(line, &line);
+  float y = dt_read_float(line, &line);
+  dt_cfg_bin_module_t *rec = cfg_bin_append(bin, s_cfg_bin_module, sizeof(*rec));
+  if(rec) *rec = (dt_cfg_bin_module_t){ name, inst, x, y };
+  return read_module(graph, name, inst, x, y);
+}
+
+static inline int
+read_config_line(
+    dt_graph_t   *graph,
+    char         *c,
+    dt_cfg_bin_t *bin)
 {
   if(c[0] == '#') return 0;
   dt_token_t cmd = dt_read_token(c, &c);
-  if     (cmd == dt_token("module"))   return read_module_ascii(graph, c);
-  else if(cmd == dt_token("param"))    return read_param_ascii(graph, c);
-  else if(cmd == dt_token("paramsub")) return read_paramsub_ascii(graph, c, s_param_set);
-  else if(cmd == dt_token("paraminc")) return read_paramsub_ascii(graph, c, s_param_inc);
-  else if(cmd == dt_token("paramdec")) return read_paramsub_ascii(graph, c, s_param_dec);
-  else if(cmd == dt_token("keyframe")) return read_keyframe_ascii(graph, c);
-  else if(cmd == dt_token("connect"))  return read_connection_ascii(graph, c, 0);
-  else if(cmd == dt_token("feedback")) return read_connection_ascii(graph, c, s_conn_feedback);
-  else if(cmd == dt_token("frames"))   graph->frame_cnt  = atol(c); // does not fail
-  else if(cmd == dt_token("fps"))      graph->frame_rate = atof(c); // does not fail
+  if     (cmd == dt_token("module"))   return read_module_ascii(graph, c, bin);
+  else if(cmd == dt_token("param"))    return read_param_ascii(graph, c, bin);
+  else if(cmd == dt_token("paramsub")) return read_paramsub_ascii(graph, c, s_param_set, bin);
+  else if(cmd == dt_token("paraminc")) return read_paramsub_ascii(graph, c, s_param_inc, bin);
+  else if(cmd == dt_token("paramdec")) return read_paramsub_ascii(graph, c, s_param_dec, bin);
+  else if(cmd == dt_token("keyframe")) return read_keyframe_ascii(graph, c, bin);
+  else if(cmd == dt_token("connect"))  return read_connection_ascii(graph, c, 0, bin);
+  else if(cmd == dt_token("feedback")) return read_connection_ascii(graph, c, s_conn_feedback, bin);
+  else if(cmd == dt_token("bind"))     return read_bind_ascii(graph, c, bin);
+  else if(cmd == dt_token("frames"))
+  {
+    graph->frame_cnt = atol(c); // does not fail
+    int32_t *rec = cfg_bin_append(bin, s_cfg_bin_frames, sizeof(int32_t));
+    if(rec) *rec = graph->frame_cnt;
+  }
+  else if(cmd == dt_token("fps"))
+  {
+    graph->frame_rate = atof(c); // does not fail
+    float *rec = cfg_bin_append(bin, s_cfg_bin_fps, sizeof(float));
+    if(rec) *rec = graph->frame_rate;
+  }
+  else if(cmd == dt_token("precision"))
+  {
+    if     (!strncmp(c, "full", 4)) graph->precision = 1;
+    else if(!strncmp(c, "half", 4)) graph->precision = 0;
+    else if(!strncmp(c, "compact", 7)) graph->precision = -1;
+    else return 1;
+    int32_t *rec = cfg_bin_append(bin, s_cfg_bin_precision, sizeof(int32_t));
+    if(rec) *rec = graph->precision;
+  }
   else return 1;
   return 0;
 }
 
+int dt_graph_read_config_line(
+    dt_graph_t *graph,
+    char *c)
+{
+  return read_config_line(graph, c, 0);
+}
+
+static inline const dt_module_so_t *
+cfg_bin_so(dt_token_t name)
+{
+  for(int i=0;i<dt_pipe.num_modules;i++)
+    if(dt_pipe.module[i].name == name) return dt_pipe.module + i;
+  return 0;
+}
+
+// check that all modules and parameters in the records still look the same as
+// when they were written, so replaying can't fail half way through.
+static inline int
+cfg_bin_validate(const uint8_t *buf, size_t size)
+{
+  dt_token_t mod[2*128]; // graphs hold at most 100 modules
+  const dt_module_so_t *so[128];
+  int mod_cnt = 0;
+  for(size_t pos=0;pos<size;)
+  {
+    if(pos + sizeof(dt_cfg_bin_rec_t) > size) return 1;
+    const dt_cfg_bin_rec_t *rec = (const dt_cfg_bin_rec_t *)(buf + pos);
+    pos += sizeof(*rec) + rec->size;
+    if(pos > size) return 1;
+    if(rec->cmd == s_cfg_bin_module)
+    {
+      const dt_cfg_bin_module_t *m = (const dt_cfg_bin_module_t *)(rec+1);
+      if(rec->size < sizeof(*m) || mod_cnt >= 128) return 1;
+      if(!(so[mod_cnt] = cfg_bin_so(m->name))) return 1;
+      mod[2*mod_cnt] = m->name; mod[2*mod_cnt+1] = m->inst;
+      mod_cnt++;
+    }
+    else if(rec->cmd == s_cfg_bin_param)
+    {
+      const dt_cfg_bin_param_t *pr = (const dt_cfg_bin_param_t *)(rec+1);
+      if(rec->size < sizeof(*pr)) return 1;
+      int m = mod_cnt-1;
+      while(m >= 0 && (mod[2*m] != pr->name || mod[2*m+1] != pr->inst)) m--;
+      if(m < 0) return 1; // module from outside this file, the ascii path handles that
+      int parid = dt_module_get_param((dt_module_so_t *)so[m], pr->parm);
+      if(parid < 0) return 1;
+      const dt_ui_param_t *p = so[m]->param[parid];
+      if(pr->beg < 0 || pr->end <= pr->beg || pr->end > p->cnt) return 1;
+      const size_t vsize = rec->size - sizeof(*pr);
+      if(p->type == dt_token("string"))
+      { if(vsize < 1) return 1; }
+      else if(vsize < (size_t)4*(pr->end - pr->beg)) return 1;
+    }
+    else if(rec->cmd == s_cfg_bin_bind && rec->size < sizeof(dt_cfg_bin_bind_t)) return 1;
+    else if(rec->cmd > s_cfg_bin_bind) return 1;
+  }
+  return 0;
+}
+
+static inline void
+cfg_bin_replay(dt_graph_t *graph, const uint8_t *buf, size_t size)
+{
+  for(size_t pos=0;pos<size;)
+  {
+    const dt_cfg_bin_rec_t *rec = (const dt_cfg_bin_rec_t *)(buf + pos);
+    const void *payload = rec + 1;
+    pos += sizeof(*rec) + rec->size;
+    switch(rec->cmd)
+    {
+    case s_cfg_bin_module:
+    {
+      const dt_cfg_bin_module_t *m = payload;
+      read_module(graph, m->name, m->inst, m->x, m->y);
+      break;
+    }
+    case s_cfg_bin_param:
+    {
+      const dt_cfg_bin_param_t *pr = payload;
+      const dt_ui_param_t *p = 0;
+      uint8_t *data = 0;
+      int end = pr->end;
+      if(param_target(graph, pr->name, pr->inst, pr->parm, pr->beg, &end, pr->frame, &p, &data)) break;
+      if(p->type == dt_token("string"))
+      {
+        const size_t len = strnlen((const char *)(pr + 1), rec->size - sizeof(*pr));
+        memcpy(data + pr->beg, pr + 1, MIN(len + 1, (size_t)(end - pr->beg)));
+      }
+      else if(pr->mode == s_param_set)
+        memcpy(data + sizeof(float)*pr->beg, pr + 1, sizeof(float)*(end - pr->beg));
+      else if(p->type == dt_token("float"))
+      {
+        const float *v = (const float *)(pr + 1);
+        float *block = (float *)data + pr->beg;
+        for(int i=0;i<end-pr->beg;i++) block[i] += pr->mode == s_param_inc ? v[i] : -v[i];
+      }
+      else
+      {
+        const int32_t *v = (const int32_t *)(pr + 1);
+        int32_t *block = (int32_t *)data + pr->beg;
+        for(int i=0;i<end-pr->beg;i++) block[i] += pr->mode == s_param_inc ? v[i] : -v[i];
+      }
+      break;
+    }
+    case s_cfg_bin_connect:
+    case s_cfg_bin_feedback:
+      read_connection(graph, payload, rec->cmd == s_cfg_bin_feedback ? s_conn_feedback : 0);
+      break;
+    case s_cfg_bin_frames:
+      graph->frame_cnt = *(const int32_t *)payload;
+      break;
+    case s_cfg_bin_fps:
+      graph->frame_rate = *(const float *)payload;
+      break;
+    case s_cfg_bin_precision:
+      graph->precision = *(const int32_t *)payload;
+      break;
+    case s_cfg_bin_bind:
+    {
+      const dt_cfg_bin_bind_t *b = payload;
+      read_bind(graph, b->tkn, b->word);
+      break;
+    }
+    }
+  }
+}
+
+static inline int // file name of the binary cache for the given ascii cfg and its real path, 0 on success
+cfg_bin_filename(const char *filename, char *bin, size_t size, char *real)
+{
+  if(!realpath(filename, real)) return 1;
+  char cachedir[PATH_MAX];
+  fs_cachedir(cachedir, sizeof(cachedir));
+  int len = snprintf(bin, size, "%s/cfg/%"PRIx64".bcfg", cachedir, hash64(real));
+  return len >= (int)size;
+}
+
+static inline int // does the header match the ascii file?
+cfg_bin_fresh(const dt_cfg_bin_header_t *hdr, const struct stat *sb)
+{
+  return hdr->magic == DT_CFG_BIN_MAGIC && hdr->version == DT_CFG_BIN_VERSION &&
+     hdr->src_size  == (uint64_t)sb->st_size &&
+     hdr->src_mtime == sb->st_mtim.tv_sec * 1000000000ll + sb->st_mtim.tv_nsec;
+}
+
+static inline int // try to read the binary cache, return 0 on success
+cfg_bin_read(dt_graph_t *graph, const char *binfile, const struct stat *sb)
+{
+  FILE *f = fopen(binfile, "rb");
+  if(!f) return 1;
+  dt_cfg_bin_header_t hdr;
+  uint8_t *buf = 0;
+  if(fread(&hdr, sizeof(hdr), 1, f) != 1 || !cfg_bin_fresh(&hdr, sb) ||
+     hdr.path_len >= PATH_MAX || fseek(f, hdr.path_len, SEEK_CUR) ||
+     hdr.size > (1ul<<30) || !(buf = malloc(hdr.size)) ||
+     fread(buf, 1, hdr.size, f) != hdr.size ||
+     cfg_bin_validate(buf, hdr.size))
+  {
+    free(buf);
+    fclose(f);
+    return 1;
+  }
+  fclose(f);
+  cfg_bin_replay(graph, buf, hdr.size);
+  free(buf);
+  return 0;
+}
+
+static void
+cfg_bin_prune(const char *dir)
+{ // remove the entries of cfg files which are gone or changed since, at most once a day
+  char stamp[PATH_MAX+10];
+  snprintf(stamp, sizeof(stamp), "%s/.pruned", dir);
+  struct stat sb;
+  if(!stat(stamp, &sb) && time(0) - sb.st_mtime < DT_CFG_BIN_PRUNE) return;
+  FILE *f = fopen(stamp, "wb"); // claim this sweep
+  if(f) fclose(f);
+  DIR *d = opendir(dir);
+  if(!d) return;
+  struct dirent *e;
+  int cnt = 0;
+  while((e = readdir(d)))
+  {
+    const size_t len = strlen(e->d_name);
+    if(len < 5 || strcmp(e->d_name + len - 5, ".bcfg")) continue;
+    char file[PATH_MAX+300], src[PATH_MAX];
+    snprintf(file, sizeof(file), "%s/%s", dir, e->d_name);
+    dt_cfg_bin_header_t hdr;
+    int keep = 0;
+    if((f = fopen(file, "rb")))
+    {
+      keep = fread(&hdr, sizeof(hdr), 1, f) == 1 && hdr.path_len < sizeof(src) &&
+        fread(src, 1, hdr.path_len, f) == hdr.path_len;
+      fclose(f);
+    }
+    if(keep)
+    {
+      src[hdr.path_len] = 0;
+      keep = !stat(src, &sb) && cfg_bin_fresh(&hdr, &sb);
+    }
+    if(!keep && !unlink(file)) cnt++;
+  }
+  closedir(d);
+  if(cnt) dt_log(s_log_pipe, "[cfg] removed %d stale binary configs from the cache", cnt);
+}
+
+static inline void
+cfg_bin_write(const dt_cfg_bin_t *bin, const char *binfile, const char *real, const struct stat *sb)
+{
+  char dir[PATH_MAX], tmp[PATH_MAX+30];
+  snprintf(dir, sizeof(dir), "%s", binfile);
+  fs_dirname(dir);
+  fs_mkdir(dir, 0755); // may exist already
+  snprintf(tmp, sizeof(tmp), "%s.%lx", binfile, (unsigned long)pthread_self()); // thumbnail threads may race here
+  FILE *f = fopen(tmp, "wb");
+  if(!f) return;
+  dt_cfg_bin_header_t hdr = {
+    .magic     = DT_CFG_BIN_MAGIC,
+    .version   = DT_CFG_BIN_VERSION,
+    .src_mtime = sb->st_mtim.tv_sec * 1000000000ll + sb->st_mtim.tv_nsec,
+    .src_size  = sb->st_size,
+    .size      = bin->size,
+    .path_len  = strlen(real),
+  };
+  int err = fwrite(&hdr, sizeof(hdr), 1, f) != 1;
+  err |= fwrite(real, 1, hdr.path_len, f) != hdr.path_len;
+  if(bin->size) err |= fwrite(bin->buf, 1, bin->size, f) != bin->size;
+  err |= fclose(f) != 0;
+  if(err || rename(tmp, binfile)) unlink(tmp);
+  cfg_bin_prune(dir);
+}
+
 int dt_graph_set_searchpath(
     dt_graph_t *graph,
     const char *filename)
@@ -271,15 +735,18 @@ int dt_graph_set_searchpath(
 
 // TODO: rewrite this to work on a uint8_t * data pointer (same for write below)
 // TODO: also insert line start pointers (for history stack)
-// this is a public api function on the graph, it reads the full stack
+// this is a public api function on the graph, it reads the full stack.
+// larger files are cached in binary form in the cache directory, and read
+// from there if the ascii file did not change.
 int dt_graph_read_config_ascii(
     dt_graph_t *graph,
     const char *filename)
 {
+  char graph_cfg[PATH_MAX+100];
+  snprintf(graph_cfg, sizeof(graph_cfg), "%s", filename);
   FILE *f = fopen(filename, "rb");
   if(!f && filename[0] != '/')
   {
-    char graph_cfg[PATH_MAX+100];
     snprintf(graph_cfg, sizeof(graph_cfg), "%s/%s", dt_pipe.homedir, filename);
     f = fopen(graph_cfg, "rb");
     if(!f)
@@ -290,22 +757,41 @@ int dt_graph_read_config_ascii(
   }
   if(!f) return 1;
   dt_graph_set_searchpath(graph, filename);
+
+  struct stat sb;
+  char binfile[PATH_MAX], real[PATH_MAX];
+  const int cached = !fstat(fileno(f), &sb) && sb.st_size >= DT_CFG_BIN_MIN_SIZE &&
+    !cfg_bin_filename(graph_cfg, binfile, sizeof(binfile), real);
+  if(cached && !cfg_bin_read(graph, binfile, &sb))
+  {
+    fclose(f);
+    return 0;
+  }
+  dt_cfg_bin_t bin_storage = {0}, *bin = cached ? &bin_storage : 0;
+
   // needs to be large enough to hold 10000 vertices of drawn masks:
   char line[300000];
   uint32_t lno = 0;
+  int warn = 0;
   while(!feof(f))
   {
     fscanf(f, "%299999[^\n]", line);
     if(fgetc(f) == EOF) break; // read \n
     lno++;
     // > 0 are warnings, < 0 are fatal, 0 is success
-    if(dt_graph_read_config_line(graph, line) < 0) goto error;
+    int err = read_config_line(graph, line, bin);
+    if(err < 0) goto error;
+    if(err) warn = 1;
   }
   fclose(f);
+  // only cache files that loaded cleanly, the others may refer to modules we don't have
+  if(bin && !warn) cfg_bin_write(bin, binfile, real, &sb);
+  free(bin_storage.buf);
   return 0;
 error:
   dt_log(s_log_pipe|s_log_err, "failed in line %u: '%s'", lno, line);
   fclose(f);
+  free(bin_storage.buf);
   return 1;
 }
 
@@ -345,6 +831,22 @@ dt_graph_write_connection_ascii(
   dt_connector_t *c = graph->module[m].connector+i;
   if(!dt_connector_input(c)) return line; // refuse to serialise outgoing connections
   if(c->connected_mi == -1)  return line; // not connected
+  if(c->flags & s_conn_bind)
+  { // connector of a bound parameter, named after it
+    const dt_module_t *mod = graph->module + m;
+    for(int b=0;b<mod->bind_cnt;b++) if(mod->bind[b].mc == i)
+      WRITE("bind:"
+          "%"PRItkn":%"PRItkn":%"PRItkn":"
+          "%"PRItkn":%"PRItkn":%"PRItkn":%u\n",
+          dt_token_str(graph->module[c->connected_mi].name),
+          dt_token_str(graph->module[c->connected_mi].inst),
+          dt_token_str(graph->module[c->connected_mi].connector[c->connected_mc].name),
+          dt_token_str(mod->name),
+          dt_token_str(mod->inst),
+          dt_token_str(c->name),
+          mod->bind[b].word);
+    return line;
+  }
   WRITE("%s:"
       "%"PRItkn":%"PRItkn":%"PRItkn":"
       "%"PRItkn":%"PRItkn":%"PRItkn"\n",
@@ -453,6 +955,8 @@ dt_graph_write_global_ascii(
 {
   WRITE("frames:%d\n", graph->frame_cnt);
   WRITE("fps:%g\n",    graph->frame_rate);
+  if(graph->precision > 0) WRITE("precision:full\n");
+  if(graph->precision < 0) WRITE("precision:compact\n");
   return line;
 }
 #undef WRITE
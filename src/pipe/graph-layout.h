@@ -0,0 +1,321 @@
+#pragma once
+#include "pipe/graph.h"
+
+#include <float.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+// layered (sugiyama style) layout for the node editor. data flows from left
+// to right, every edge points to a later layer:
+//  1. layers by longest path from the sources. sources are pulled right up
+//     to their first consumer, so a late input doesn't start far left.
+//  2. edges spanning several layers get a dummy vertex in every layer they
+//     cross, so they can be routed between the vertices.
+//  3. vertices in a layer are sorted by the barycenter of their neighbours
+//     in the previous layer, sweeping back and forth to reduce crossings.
+//  4. every vertex moves towards the barycenter of its neighbours, then the
+//     layer is pushed apart so nothing overlaps.
+// feedback connectors are left out, they would close cycles. this only
+// touches the struct, so it can run on a worker thread on a snapshot of the
+// graph.
+
+typedef struct dt_graph_layout_t
+{
+  int      num_vtx;   // modules or nodes, vertex ids are their indices
+  int      num_edges;
+  int     *edge;      // pairs of source and destination vertex
+  uint8_t *skip;      // vertex doesn't exist (removed module), don't place it
+  float   *wd, *ht;   // size of the vertices, 1 unless the caller knows better
+  float   *x, *y;     // resulting position of the top left corner
+  float    gap;       // minimum space between rows, layers are twice as far apart
+}
+dt_graph_layout_t;
+
+static inline void
+dt_graph_layout_cleanup(dt_graph_layout_t *l)
+{
+  free(l->edge);
+  free(l->skip);
+  free(l->wd);
+  memset(l, 0, sizeof(*l));
+}
+
+static inline void
+dt_graph_layout_alloc(
+    dt_graph_layout_t *l,
+    int                num_vtx,
+    int                max_edges)
+{
+  memset(l, 0, sizeof(*l));
+  l->num_vtx = num_vtx;
+  l->edge = (int *)malloc(sizeof(int)*2*(max_edges+1));
+  l->skip = (uint8_t *)calloc(num_vtx+1, sizeof(uint8_t));
+  l->wd   = (float *)malloc(sizeof(float)*4*(num_vtx+1));
+  l->ht   = l->wd +   num_vtx+1;
+  l->x    = l->wd + 2*(num_vtx+1);
+  l->y    = l->wd + 3*(num_vtx+1);
+  for(int v=0;v<num_vtx;v++) l->wd[v] = l->ht[v] = 1.0f;
+  l->gap  = 0.5f;
+}
+
+// snapshot the module graph, vertex ids are module ids
+static inline void
+dt_graph_layout_modules(
+    dt_graph_layout_t *l,
+    const dt_graph_t  *graph)
+{
+  int max_edges = 0;
+  for(uint32_t m=0;m<graph->num_modules;m++) max_edges += graph->module[m].num_connectors;
+  dt_graph_layout_alloc(l, graph->num_modules, max_edges);
+  for(uint32_t m=0;m<graph->num_modules;m++)
+  {
+    const dt_module_t *mod = graph->module + m;
+    l->skip[m] = mod->name == 0;
+    if(l->skip[m]) continue;
+    for(int c=0;c<mod->num_connectors;c++)
+    {
+      const dt_connector_t *cn = mod->connector + c;
+      if(cn->type != dt_token("read") && cn->type != dt_token("sink")) continue; // inputs only
+      if(!dt_connected(cn) || (cn->flags & s_conn_feedback)) continue;
+      if(cn->connected_mi < 0 || cn->connected_mi >= (int)graph->num_modules) continue;
+      if(graph->module[cn->connected_mi].name == 0) continue;
+      l->edge[2*l->num_edges+0] = cn->connected_mi;
+      l->edge[2*l->num_edges+1] = m;
+      l->num_edges++;
+    }
+  }
+}
+
+// snapshot the node graph, vertex ids are node ids
+static inline void
+dt_graph_layout_nodes(
+    dt_graph_layout_t *l,
+    const dt_graph_t  *graph)
+{
+  int max_edges = 0;
+  for(uint32_t n=0;n<graph->num_nodes;n++) max_edges += graph->node[n].num_connectors;
+  dt_graph_layout_alloc(l, graph->num_nodes, max_edges);
+  for(uint32_t n=0;n<graph->num_nodes;n++)
+  {
+    const dt_node_t *node = graph->node + n;
+    for(int c=0;c<node->num_connectors;c++)
+    {
+      const dt_connector_t *cn = node->connector + c;
+      if(cn->type != dt_token("read") && cn->type != dt_token("sink")) continue; // inputs only
+      if(!dt_connected(cn) || (cn->flags & s_conn_feedback)) continue;
+      if(cn->connected_mi < 0 || cn->connected_mi >= (int)graph->num_nodes) continue;
+      l->edge[2*l->num_edges+0] = cn->connected_mi;
+      l->edge[2*l->num_edges+1] = n;
+      l->num_edges++;
+    }
+  }
+}
+
+static inline int
+_dt_graph_layout_cmp(const void *a, const void *b)
+{
+  return *(const int *)a - *(const int *)b;
+}
+
+// sort the vertices of one layer by key, stable. layers are small.
+static inline void
+_dt_graph_layout_sort(
+    int         *row,
+    int          cnt,
+    const float *key)
+{
+  for(int i=1;i<cnt;i++)
+  {
+    const int v = row[i];
+    int j = i;
+    for(;j>0 && key[row[j-1]] > key[v];j--) row[j] = row[j-1];
+    row[j] = v;
+  }
+}
+
+static inline void
+dt_graph_layout_run(dt_graph_layout_t *l)
+{
+  const int n = l->num_vtx;
+  if(n <= 0) return;
+  int *layer = (int *)calloc(n, sizeof(int));
+
+  // 1. longest path. the sweeps are bounded in case the edges close a cycle
+  // after all, such edges are ignored below.
+  int cyclic = 0;
+  for(int it=0,changed=1;changed;it++)
+  {
+    if(it >= n) { cyclic = 1; break; }
+    changed = 0;
+    for(int e=0;e<l->num_edges;e++)
+    {
+      const int s = l->edge[2*e], d = l->edge[2*e+1];
+      if(s == d || l->skip[s] || l->skip[d]) continue;
+      if(layer[d] < layer[s] + 1) { layer[d] = layer[s] + 1; changed = 1; }
+    }
+  }
+  if(cyclic)
+  { // the layers went up in circles, number the ones in use consecutively
+    int *sorted = (int *)malloc(sizeof(int)*n), num = 0;
+    memcpy(sorted, layer, sizeof(int)*n);
+    qsort(sorted, n, sizeof(int), _dt_graph_layout_cmp);
+    for(int v=0;v<n;v++) if(!num || sorted[num-1] != sorted[v]) sorted[num++] = sorted[v];
+    for(int v=0;v<n;v++)
+    { // binary search the rank in the unique values
+      int lo = 0, hi = num-1;
+      while(lo < hi)
+      {
+        const int mid = (lo + hi)/2;
+        if(sorted[mid] < layer[v]) lo = mid + 1;
+        else hi = mid;
+      }
+      layer[v] = lo;
+    }
+    free(sorted);
+  }
+  for(int v=0;v<n;v++)
+  {
+    int has_input = 0, first = INT_MAX;
+    for(int e=0;e<l->num_edges;e++)
+    {
+      if(l->edge[2*e] == l->edge[2*e+1]) continue;
+      if(l->edge[2*e+1] == v) has_input = 1;
+      if(l->edge[2*e]   == v) first = MIN(first, layer[l->edge[2*e+1]]);
+    }
+    if(!has_input && first != INT_MAX && first > 0) layer[v] = first - 1;
+  }
+
+  // 2. dummy vertices, and segments which only connect adjacent layers
+  int num_vtx = n, num_seg = 0, num_layers = 0;
+  for(int v=0;v<n;v++) if(!l->skip[v]) num_layers = MAX(num_layers, layer[v]+1);
+  for(int e=0;e<l->num_edges;e++)
+  {
+    const int s = l->edge[2*e], d = l->edge[2*e+1];
+    const int span = layer[d] - layer[s];
+    if(span <= 0 || l->skip[s] || l->skip[d]) continue;
+    num_vtx += span - 1;
+    num_seg += span;
+  }
+  int   *lay  = (int *)  malloc(sizeof(int)*num_vtx);
+  int   *seg  = (int *)  malloc(sizeof(int)*2*(num_seg+1));
+  int   *row  = (int *)  malloc(sizeof(int)*num_vtx);          // vertices grouped by layer
+  int   *beg  = (int *)  calloc(num_layers+2, sizeof(int));    // first index of a layer in row
+  float *key  = (float *)malloc(sizeof(float)*num_vtx);
+  float *pos  = (float *)malloc(sizeof(float)*num_vtx);        // index in the layer
+  float *sum  = (float *)malloc(sizeof(float)*num_vtx);
+  int   *cnt  = (int *)  malloc(sizeof(int)*num_vtx);
+  float *vht  = (float *)malloc(sizeof(float)*num_vtx);
+  float *vy   = (float *)malloc(sizeof(float)*num_vtx);
+  memcpy(lay, layer, sizeof(int)*n);
+  for(int v=0;v<n;v++) vht[v] = l->skip[v] ? 0.0f : l->ht[v];
+  int dummy = n;
+  num_seg = 0;
+  for(int e=0;e<l->num_edges;e++)
+  {
+    const int s = l->edge[2*e], d = l->edge[2*e+1];
+    const int span = layer[d] - layer[s];
+    if(span <= 0 || l->skip[s] || l->skip[d]) continue;
+    int prev = s;
+    for(int k=1;k<span;k++)
+    { // links are thin, dummies only need the gap around them
+      lay[dummy] = layer[s] + k;
+      vht[dummy] = 0.0f;
+      seg[2*num_seg+0] = prev;
+      seg[2*num_seg+1] = dummy;
+      num_seg++;
+      prev = dummy++;
+    }
+    seg[2*num_seg+0] = prev;
+    seg[2*num_seg+1] = d;
+    num_seg++;
+  }
+
+  // initial order within the layers by vertex id
+  for(int v=0;v<num_vtx;v++) if(v >= n || !l->skip[v]) beg[lay[v]+1]++;
+  for(int i=0;i<num_layers;i++) beg[i+1] += beg[i];
+  for(int i=0;i<num_layers;i++) cnt[i] = beg[i]; // fill position per layer
+  for(int v=0;v<num_vtx;v++) if(v >= n || !l->skip[v]) row[cnt[lay[v]]++] = v;
+  for(int i=0;i<num_layers;i++) for(int j=beg[i];j<beg[i+1];j++) pos[row[j]] = j - beg[i];
+
+  // 3. barycenter sweeps, even ones look left, odd ones look right
+  for(int it=0;it<8;it++)
+  {
+    const int down = !(it & 1);
+    for(int k=1;k<num_layers;k++)
+    {
+      const int i = down ? k : num_layers-1-k;
+      for(int j=beg[i];j<beg[i+1];j++) { sum[row[j]] = 0.0f; cnt[row[j]] = 0; }
+      for(int s=0;s<num_seg;s++)
+      {
+        const int a = seg[2*s], b = seg[2*s+1];
+        if( down && lay[b] == i) { sum[b] += pos[a]; cnt[b]++; }
+        if(!down && lay[a] == i) { sum[a] += pos[b]; cnt[a]++; }
+      }
+      for(int j=beg[i];j<beg[i+1];j++)
+      {
+        const int v = row[j];
+        key[v] = cnt[v] ? sum[v] / cnt[v] : pos[v];
+      }
+      _dt_graph_layout_sort(row + beg[i], beg[i+1] - beg[i], key);
+      for(int j=beg[i];j<beg[i+1];j++) pos[row[j]] = j - beg[i];
+    }
+  }
+
+  // 4. rows: stack the layers, then pull the vertices towards their neighbours
+  for(int i=0;i<num_layers;i++)
+  {
+    float y = 0.0f;
+    for(int j=beg[i];j<beg[i+1];j++) { vy[row[j]] = y; y += vht[row[j]] + l->gap; }
+  }
+  for(int it=0;it<8;it++)
+  {
+    const int down = !(it & 1);
+    for(int k=0;k<num_layers;k++)
+    {
+      const int i = down ? k : num_layers-1-k;
+      for(int j=beg[i];j<beg[i+1];j++) { sum[row[j]] = 0.0f; cnt[row[j]] = 0; }
+      for(int s=0;s<num_seg;s++)
+      { // both sides, centres
+        const int a = seg[2*s], b = seg[2*s+1];
+        if(lay[b] == i) { sum[b] += vy[a] + 0.5f*vht[a]; cnt[b]++; }
+        if(lay[a] == i) { sum[a] += vy[b] + 0.5f*vht[b]; cnt[a]++; }
+      }
+      float shift = 0.0f;
+      int   num = 0;
+      float bottom = -FLT_MAX;
+      for(int j=beg[i];j<beg[i+1];j++)
+      { // move to the wanted place but don't overlap the one above
+        const int v = row[j];
+        const float want = cnt[v] ? sum[v] / cnt[v] - 0.5f*vht[v] : vy[v];
+        vy[v] = MAX(want, bottom);
+        bottom = vy[v] + vht[v] + l->gap;
+        if(cnt[v]) { shift += want - vy[v]; num++; }
+      }
+      // everything was pushed down, move the whole layer back up on average
+      if(num) for(int j=beg[i];j<beg[i+1];j++) vy[row[j]] += shift / num;
+    }
+  }
+
+  // columns: every layer is as wide as its widest vertex
+  float x = 0.0f, y0 = FLT_MAX;
+  for(int i=0;i<num_layers;i++)
+  {
+    float wd = 0.0f;
+    for(int j=beg[i];j<beg[i+1];j++) if(row[j] < n)
+    {
+      l->x[row[j]] = x;
+      wd = MAX(wd, l->wd[row[j]]);
+    }
+    x += wd + 2.0f*l->gap;
+  }
+  for(int v=0;v<n;v++) if(!l->skip[v]) y0 = MIN(y0, vy[v]);
+  for(int v=0;v<n;v++)
+  {
+    if(l->skip[v]) l->x[v] = l->y[v] = 0.0f;
+    else l->y[v] = vy[v] - y0;
+  }
+
+  free(layer); free(lay); free(seg); free(row); free(beg);
+  free(key); free(pos); free(sum); free(cnt); free(vht); free(vy);
+}
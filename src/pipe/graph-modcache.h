@@ -0,0 +1,266 @@
+#pragma once
+#include "pipe/graph.h"
+#include "pipe/graph-srccache.h"
+#include "pipe/graph-barrier.h"
+#include "pipe/modules/api.h"
+#include "qvk/qvk.h"
+#include "db/hash.h"
+
+// device resident copies of the outputs of expensive modules (denoise,
+// demosaic, cnn), keyed by the parameters of the module and everything
+// upstream of it. jumping in the history or toggling a module rebuilds the
+// whole graph. if the output of such a module is still in the cache, the run
+// copies it into place and only processes what is downstream of it.
+// entries are filled by full runs which process the module anyway. the cache
+// is off unless modcache_budget is set, and only works for still images.
+
+static inline int
+_dt_graph_modcache_module(dt_token_t name)
+{
+  return name == dt_token("denoise") || name == dt_token("demosaic") || name == dt_token("cnn");
+}
+
+static inline void
+dt_graph_modcache_cleanup(dt_graph_t *graph)
+{ // device needs to be idle
+  for(int i=0;i<DT_GRAPH_MODCACHE_MAX;i++)
+    _dt_graph_srccache_free(graph->modcache + i);
+  graph->modcache_size = 0;
+}
+
+// key of the output of module m, over its parameters and the keys of its inputs.
+// zero if it depends on something we can't see (feedback, a previous frame)
+static inline uint64_t
+_dt_graph_modcache_key(dt_graph_t *graph, int m, uint64_t *key, uint8_t *done)
+{
+  if(done[m] == 2) return key[m];
+  if(done[m]) return 0; // cycle
+  done[m] = 1;
+  dt_module_t *mod = graph->module + m;
+  dt_hash_t h;
+  dt_hash_init(&h, mod->name);
+  dt_hash_update_u64(&h, mod->inst);
+  dt_hash_update_u64(&h, dt_module_bypassed(mod));
+  dt_hash_update(&h, mod->param, mod->param_size);
+  int ok = 1, inputs = 0;
+  for(int c=0;c<mod->num_connectors;c++)
+  {
+    dt_connector_t *cn = mod->connector+c;
+    if((cn->flags & s_conn_feedback) || cn->frames > 1) ok = 0;
+    if(dt_connector_input(cn))
+    {
+      inputs++;
+      const uint64_t k = cn->connected_mi >= 0 ? _dt_graph_modcache_key(graph, cn->connected_mi, key, done) : 1;
+      if(!k) ok = 0;
+      dt_hash_update_u64(&h, k);
+      dt_hash_update_u64(&h, cn->connected_mc);
+    }
+    else
+    {
+      dt_hash_update_u64(&h, ((uint64_t)cn->roi.wd << 32) | cn->roi.ht);
+      dt_hash_update_u64(&h, cn->format);
+      dt_hash_update_u64(&h, cn->chan);
+    }
+  }
+  if(!inputs)
+  { // sources find their files here
+    dt_hash_update(&h, graph->searchpath, strnlen(graph->searchpath, sizeof(graph->searchpath)));
+    dt_hash_update_u64(&h, graph->input_lod);
+  }
+  const uint64_t k = dt_hash_final(&h);
+  key[m] = ok ? (k ? k : 1) : 0;
+  done[m] = 2;
+  return key[m];
+}
+
+// mark all modules upstream of module m
+static inline void
+_dt_graph_modcache_up(dt_graph_t *graph, int m, uint8_t *up)
+{
+  dt_module_t *mod = graph->module + m;
+  for(int c=0;c<mod->num_connectors;c++)
+  {
+    dt_connector_t *cn = mod->connector+c;
+    if(!dt_connector_input(cn) || cn->connected_mi < 0 || up[cn->connected_mi]) continue;
+    up[cn->connected_mi] = 1;
+    _dt_graph_modcache_up(graph, cn->connected_mi, up);
+  }
+}
+
+// the node writing the only output of module m, if it can be cached
+static inline dt_node_t *
+_dt_graph_modcache_node(dt_graph_t *graph, int m)
+{
+  dt_module_t *mod = graph->module + m;
+  if(!_dt_graph_modcache_module(mod->name) || dt_module_bypassed(mod)) return 0;
+  int out = -1;
+  for(int c=0;c<mod->num_connectors;c++)
+    if(dt_connector_output(mod->connector+c))
+    {
+      if(out >= 0) return 0;
+      out = c;
+    }
+  if(out < 0) return 0;
+  dt_connector_t *cn = mod->connector + out;
+  if(dt_connector_ssbo(cn) || cn->array_length > 1 || cn->associated_i < 0 || cn->format == dt_token("yuv"))
+    return 0;
+  dt_node_t *node = graph->node + cn->associated_i;
+  if(node->module != mod || node->type != s_node_compute || node->async ||
+     node->connector[cn->associated_c].roi.wd != node->wd ||
+     node->connector[cn->associated_c].roi.ht != node->ht)
+    return 0;
+  return node;
+}
+
+// called before recording a full run. finds the most downstream module whose
+// output is in the cache and can stand in for everything upstream of it. in
+// that case recompute[] marks the modules which still need to run and the
+// index of the module is returned, -1 otherwise. all cached modules which run
+// get an entry to keep their output (node->modcache).
+static inline int
+dt_graph_modcache_plan(
+    dt_graph_t     *graph,
+    const uint32_t *nodeid,
+    int             cnt,
+    uint8_t        *recompute,  // modules which need to run if there is a cut
+    VkFormat      (*format)(const dt_connector_t *))
+{
+  uint64_t key[100] = {0};
+  uint8_t done[100] = {0};
+  assert(graph->num_modules <= 100);
+  graph->modcache_clock++;
+  for(int i=0;i<cnt;i++) graph->node[nodeid[i]].modcache = 0;
+  for(int m=0;m<graph->num_modules;m++)
+    if(graph->module[m].name) _dt_graph_modcache_key(graph, m, key, done);
+
+  int cut = -1, cut_up = -1, cut_entry = -1;
+  for(int m=0;m<graph->num_modules;m++)
+  {
+    if(!graph->module[m].name || !key[m] || !_dt_graph_modcache_node(graph, m)) continue;
+    int e = 0;
+    for(;e<DT_GRAPH_MODCACHE_MAX;e++) if(graph->modcache[e].key == key[m] && graph->modcache[e].valid) break;
+    if(e == DT_GRAPH_MODCACHE_MAX) continue;
+    uint8_t up[100] = {0};
+    _dt_graph_modcache_up(graph, m, up);
+    int num_up = 0;
+    for(int k=0;k<graph->num_modules;k++) num_up += up[k];
+    if(num_up <= cut_up) continue; // we want the one with the most work upstream
+
+    // everybody else has to read from the modules which run, or from this output
+    const dt_node_t *out = _dt_graph_modcache_node(graph, m);
+    int ok = 1;
+    for(int i=0;i<cnt && ok;i++)
+    {
+      dt_node_t *node = graph->node + nodeid[i];
+      const int nm = node->module - graph->module;
+      if(nm == m || up[nm])
+      { // a display upstream would show garbage
+        if(dt_node_sink(node)) ok = 0;
+        continue;
+      }
+      for(int c=0;c<node->num_connectors;c++)
+      {
+        dt_connector_t *cn = node->connector+c;
+        if(!dt_connector_input(cn) || cn->connected_mi < 0) continue;
+        const dt_node_t *src = graph->node + cn->connected_mi;
+        const int sm = src->module - graph->module;
+        if((sm == m || up[sm]) && (src != out || (cn->flags & s_conn_feedback))) ok = 0;
+      }
+    }
+    if(!ok) continue;
+    cut = m; cut_up = num_up; cut_entry = e;
+    for(int k=0;k<graph->num_modules;k++) recompute[k] = graph->module[k].name && k != m && !up[k];
+  }
+  if(cut >= 0)
+  {
+    graph->modcache[cut_entry].used = graph->modcache_clock;
+    _dt_graph_modcache_node(graph, cut)->modcache = cut_entry + 1;
+  }
+
+  for(int m=0;m<graph->num_modules;m++)
+  { // modules which run keep their output for next time
+    if(!graph->module[m].name || !key[m] || (cut >= 0 && !recompute[m])) continue;
+    dt_node_t *node = _dt_graph_modcache_node(graph, m);
+    if(!node) continue;
+    dt_connector_t *cn = graph->module[m].connector;
+    while(!dt_connector_output(cn)) cn++;
+    node->modcache = dt_graph_devcache_get(graph->modcache, DT_GRAPH_MODCACHE_MAX, &graph->modcache_size,
+        graph->modcache_budget, graph->modcache_budget, graph->modcache_clock, key[m],
+        format(cn), MAX(1, cn->roi.wd), MAX(1, cn->roi.ht));
+  }
+  if(cut >= 0)
+    dt_log(s_log_pipe, "reusing cached output of %"PRItkn" %"PRItkn,
+        dt_token_str(graph->module[cut].name), dt_token_str(graph->module[cut].inst));
+  return cut;
+}
+
+// the output connector of the node that goes into the cache
+static inline int
+_dt_graph_modcache_conn(dt_node_t *node)
+{
+  dt_connector_t *cn = node->module->connector;
+  while(!dt_connector_output(cn)) cn++;
+  return cn->associated_c;
+}
+
+// record the copy from the cache to the output of the node, in place of the
+// kernels of the module and everything upstream. layout == 1 for the layout phase.
+static inline void
+dt_graph_modcache_record(
+    dt_graph_t      *graph,
+    dt_node_t       *node,
+    int              layout,
+    VkCommandBuffer  cmd_buf)
+{
+  dt_graph_srccache_t *e = graph->modcache + node->modcache - 1;
+  const int c = _dt_graph_modcache_conn(node);
+  dt_connector_image_t *img = dt_graph_connector_image(graph, node - graph->node, c, 0, graph->frame);
+  if(layout)
+  {
+    node->dirty_rect[0] = node->dirty_rect[1] = 0;
+    node->dirty_rect[2] = node->wd; node->dirty_rect[3] = node->ht;
+    dt_graph_barrier_image(graph, img, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+    dt_graph_barrier_image(graph, &e->img, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+    return;
+  }
+  VkImageCopy region = {
+    .srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },
+    .dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },
+    .extent         = { node->connector[c].roi.wd, node->connector[c].roi.ht, 1 },
+  };
+  vkCmdCopyImage(cmd_buf,
+      e->img.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+      img->image,   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+  // made readable by the barrier in front of the next level
+  dt_graph_barrier_image(graph, img, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+}
+
+// after the kernels of the node have been recorded: copy its output to the
+// cache, unless it only wrote part of it
+static inline void
+dt_graph_modcache_store(
+    dt_graph_t      *graph,
+    dt_node_t       *node,
+    VkCommandBuffer  cmd_buf)
+{
+  dt_graph_srccache_t *e = graph->modcache + node->modcache - 1;
+  const int32_t *d = node->dirty_rect;
+  if(e->valid || (d[2] > 0 && d[3] > 0 && (d[2] < (int32_t)node->wd || d[3] < (int32_t)node->ht))) return;
+  const int c = _dt_graph_modcache_conn(node);
+  dt_connector_image_t *img = dt_graph_connector_image(graph, node - graph->node, c, 0, graph->frame);
+  const VkImageLayout layout = img->layout;
+  dt_graph_barrier_image(graph, img, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+  dt_graph_barrier_image(graph, &e->img, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+  dt_graph_barrier_flush(graph, cmd_buf); // wait for the kernel
+  VkImageCopy region = {
+    .srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },
+    .dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },
+    .extent         = { node->connector[c].roi.wd, node->connector[c].roi.ht, 1 },
+  };
+  vkCmdCopyImage(cmd_buf,
+      img->image,    VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+      e->img.image,  VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+  dt_graph_barrier_image(graph, img, layout);
+  dt_graph_barrier_image(graph, &e->img, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+  e->valid = 1;
+}
@@ -0,0 +1,107 @@
+#pragma once
+#include "pipe/graph.h"
+#include "pipe/graph-srccache.h"
+#include "pipe/modules/api.h"
+#include "pipe/raytrace.h"
+#include "qvk/qvk.h"
+
+// compute pipelines of the nodes, kept across dt_graph_reset(). the thumbnail
+// worker and batch export load one cfg after the other, mostly with the same
+// default topology, so the nodes of the next cfg find their pipelines here
+// instead of creating them again. the key covers everything that goes into
+// the descriptor set layout, the pipeline layout, and the shader
+// including its work group size and specialisation constants.
+// ownership moves between node and cache, only one of them destroys the objects.
+// note that reloading the shaders does not invalidate the cache.
+
+static inline uint64_t
+dt_graph_pipecache_key(
+    dt_graph_t *graph,
+    dt_node_t  *node)
+{
+  if(node->type != s_node_compute || dt_node_sink(node) || dt_node_source(node)) return 0;
+  dt_hash_t h;
+  dt_hash_init(&h, node->name);
+  dt_hash_update_u64(&h, node->kernel);
+  dt_hash_update_u64(&h, ((uint64_t)node->push_constant_size << 2) |
+      (node->push_dset << 1) | dt_raytrace_present(graph));
+  dt_hash_update_u64(&h, ((uint64_t)node->local_size[0] << 32) | node->local_size[1]);
+  for(int i=0;i<node->spec_cnt;i++)
+    dt_hash_update_u64(&h, ((uint64_t)node->spec_id[i] << 32) | node->spec[i]);
+  for(int i=0;i<node->num_connectors;i++)
+  {
+    dt_connector_t *c = node->connector+i;
+    const uint64_t type = dt_connector_ssbo(c) ? 0 : dt_connector_input(c) ? 1 : 2;
+    dt_hash_update_u64(&h, type | ((uint64_t)MAX(1, c->array_length) << 2) |
+        ((uint64_t)(c->format == dt_token("yuv")) << 40));
+  }
+  const uint64_t key = dt_hash_final(&h);
+  return key ? key : 1;
+}
+
+static inline void
+_dt_graph_pipecache_free(dt_graph_pipecache_t *e)
+{
+  vkDestroyPipelineLayout     (qvk.device, e->pipeline_layout, 0);
+  vkDestroyPipeline           (qvk.device, e->pipeline,        0);
+  vkDestroyDescriptorSetLayout(qvk.device, e->dset_layout,     0);
+  memset(e, 0, sizeof(*e));
+}
+
+static inline void
+dt_graph_pipecache_cleanup(dt_graph_t *graph)
+{ // device needs to be idle
+  for(int i=0;i<DT_GRAPH_PIPECACHE_MAX;i++)
+    if(graph->pipecache[i].key) _dt_graph_pipecache_free(graph->pipecache + i);
+}
+
+// hand the pipeline objects of a cached entry over to the node.
+// returns 0 if there is none, and the node needs to create them.
+static inline int
+dt_graph_pipecache_get(
+    dt_graph_t *graph,
+    dt_node_t  *node)
+{
+  const uint64_t key = dt_graph_pipecache_key(graph, node);
+  if(!key) return 0;
+  for(int i=0;i<DT_GRAPH_PIPECACHE_MAX;i++)
+  {
+    dt_graph_pipecache_t *e = graph->pipecache + i;
+    if(e->key != key) continue;
+    node->dset_layout     = e->dset_layout;
+    node->pipeline_layout = e->pipeline_layout;
+    node->pipeline        = e->pipeline;
+    memset(e, 0, sizeof(*e));
+    return 1;
+  }
+  return 0;
+}
+
+// take over the pipeline objects of the node before it goes away, evicting the
+// least recently stored entry if the cache is full. the objects of nodes that
+// can't be cached stay with the node.
+static inline void
+dt_graph_pipecache_put(
+    dt_graph_t *graph,
+    dt_node_t  *node)
+{
+  if(!node->pipeline) return;
+  const uint64_t key = dt_graph_pipecache_key(graph, node);
+  if(!key) return;
+  int slot = 0;
+  for(int i=0;i<DT_GRAPH_PIPECACHE_MAX;i++)
+  {
+    if(!graph->pipecache[i].key) { slot = i; break; }
+    if(graph->pipecache[i].used < graph->pipecache[slot].used) slot = i;
+  }
+  dt_graph_pipecache_t *e = graph->pipecache + slot;
+  if(e->key) _dt_graph_pipecache_free(e);
+  e->key             = key;
+  e->used            = ++graph->pipecache_clock;
+  e->dset_layout     = node->dset_layout;
+  e->pipeline_layout = node->pipeline_layout;
+  e->pipeline        = node->pipeline;
+  node->dset_layout     = 0;
+  node->pipeline_layout = 0;
+  node->pipeline        = 0;
+}
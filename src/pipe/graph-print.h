@@ -1,6 +1,8 @@
 #pragma once
 #include "pipe/graph.h"
+#include "pipe/graph-profile.h"
 #include "modules/api.h"
+#include <math.h>
 
 // this is not thread safe. but who would ever debug print
 // node graphs from multiple threads, right?
@@ -72,32 +74,74 @@ dt_graph_print_modules(
   fprintf(stdout, "}\n");
 }
 
+// colour for the i-th memory slot, spreading the hues by the golden ratio
+static inline const char*
+_pr_slot_colour(int i)
+{
+  static char tmp[20];
+  const double h = i * 0.618033988749895;
+  snprintf(tmp, sizeof(tmp), "%.3f 0.8 0.8", h - (int)h);
+  return tmp;
+}
+
+// print the nodes with the timings of the last completed run (graph->ring_done),
+// the dispatch size and the bytes written, filled redder the more gpu time they
+// took. edges are coloured by the memory the buffer lives in: same colour
+// means the same offset in the same heap, i.e. buffers aliased one after the
+// other. the width grows with the size of the buffer.
 static inline void
 dt_graph_print_nodes(
-    const dt_graph_t *graph)
+    dt_graph_t *graph)
 {
+  double ms[4000] = {0}, max_ms = 0.0, sum_ms = 0.0;
+  assert(graph->num_nodes <= sizeof(ms)/sizeof(ms[0]));
+  const dt_graph_query_t *qr = graph->query + graph->ring_done;
+  if(qr->cnt && dt_graph_profile_results(graph, graph->ring_done) == VK_SUCCESS)
+    for(int i=0;i+1<qr->cnt;i+=2)
+    {
+      const double t = (qr->pool_results[i+1] - qr->pool_results[i]) * 1e-6 * qvk.ticks_to_nanoseconds;
+      ms[qr->nid[i]] += t;
+      sum_ms += t;
+    }
+  for(int m=0;m<graph->num_nodes;m++) max_ms = MAX(max_ms, ms[m]);
+
   fprintf(stdout, "digraph nodes {\nnode [shape=record]\nrankdir=LR;\n");
+  fprintf(stdout, "label=\"gpu %.3f ms, peak memory images %.1f MB buffers %.1f MB staging %.1f MB\";\n",
+      sum_ms, graph->heap.peak_rss/(1024.0*1024.0), graph->heap_ssbo.peak_rss/(1024.0*1024.0),
+      graph->heap_staging.peak_rss/(1024.0*1024.0));
   // for all nodes, print all incoming edges (outgoing don't have module ids)
   for(int m=0;m<graph->num_nodes;m++)
   {
-    fprintf(stdout, "n%d_%s_%s [label=\"{{", m, _pr(graph->node[m].name), _pr(graph->node[m].kernel));
+    dt_node_t *node = graph->node + m;
+    fprintf(stdout, "n%d_%s_%s [label=\"{{", m, _pr(node->name), _pr(node->kernel));
     int num = 0;
-    for(int c=0;c<graph->node[m].num_connectors;c++) if(dt_connector_input(graph->node[m].connector+c)) num++;
-    for(int c=0;c<graph->node[m].num_connectors;c++) if(dt_connector_input(graph->node[m].connector+c))
+    for(int c=0;c<node->num_connectors;c++) if(dt_connector_input(graph->node[m].connector+c)) num++;
+    for(int c=0;c<node->num_connectors;c++) if(dt_connector_input(graph->node[m].connector+c))
     {
-      fprintf(stdout, "<%d> %s", c, _pr(graph->node[m].connector[c].name));
+      fprintf(stdout, "<%d> %s", c, _pr(node->connector[c].name));
       if(--num > 0) fprintf(stdout, "|");
     }
-    fprintf(stdout, "}|%s_%s|{", _pr(graph->node[m].name), _pr(graph->node[m].kernel));
+    fprintf(stdout, "}|%s_%s", _pr(node->name), _pr(node->kernel));
+    if(ms[m] > 0.0) fprintf(stdout, "\\n%.3f ms", ms[m]);
+    if(node->type == s_node_compute && !dt_node_source(node) && !dt_node_sink(node) && node->local_size[0])
+      fprintf(stdout, "\\n%ux%ux%u groups",
+          (node->wd + node->local_size[0] - 1) / node->local_size[0],
+          (node->ht + node->local_size[1] - 1) / node->local_size[1], node->dp);
+    else fprintf(stdout, "\\n%ux%ux%u", node->wd, node->ht, node->dp);
+    fprintf(stdout, "\\nout %.1f MB|{", dt_graph_profile_bytes(node, 1)/(1024.0*1024.0));
     num = 0;
-    for(int c=0;c<graph->node[m].num_connectors;c++) if(dt_connector_output(graph->node[m].connector+c)) num++;
-    for(int c=0;c<graph->node[m].num_connectors;c++) if(dt_connector_output(graph->node[m].connector+c))
+    for(int c=0;c<node->num_connectors;c++) if(dt_connector_output(graph->node[m].connector+c)) num++;
+    for(int c=0;c<node->num_connectors;c++) if(dt_connector_output(graph->node[m].connector+c))
     {
-      fprintf(stdout, "<%d> %s", c, _pr(graph->node[m].connector[c].name));
+      fprintf(stdout, "<%d> %s", c, _pr(node->connector[c].name));
       if(--num > 0) fprintf(stdout, "|");
     }
-    fprintf(stdout, "}}\"];\n");
+    fprintf(stdout, "}}\"");
+    if(max_ms > 0.0) fprintf(stdout, " style=filled fillcolor=\"0.000 %.3f 1.000\"", ms[m] / max_ms);
+    fprintf(stdout, "];\n");
   }
+  uint64_t slot[1024];
+  int num_slots = 0;
   for(int m=0;m<graph->num_nodes;m++)
   {
     for(int c=0;c<graph->node[m].num_connectors;c++)
@@ -106,15 +150,12 @@ dt_graph_print_nodes(
           graph->node[m].connector[c].type == dt_token("sink")) &&
           graph->node[m].connector[c].connected_mi >= 0)
       {
+        const int n0 = graph->node[m].connector[c].connected_mi, c0 = graph->node[m].connector[c].connected_mc;
         fprintf(stdout, "n%d_%s_%s:%d -> n%d_%s_%s:%d",
-            graph->node[m].connector[c].connected_mi,
-            _pr(graph->node[
-              graph->node[m].connector[c].connected_mi
-            ].name),
-            _pr(graph->node[
-              graph->node[m].connector[c].connected_mi
-            ].kernel),
-            graph->node[m].connector[c].connected_mc,
+            n0,
+            _pr(graph->node[n0].name),
+            _pr(graph->node[n0].kernel),
+            c0,
             m,
             _pr(graph->node[m].name),
             _pr(graph->node[m].kernel),
@@ -124,7 +165,18 @@ dt_graph_print_nodes(
         else if(graph->node[m].connector[c].flags & s_conn_feedback)
           fprintf(stdout, "[style=dashed]\n");
         else
-          fprintf(stdout, "\n");
+        {
+          dt_connector_t *cn = graph->node[n0].connector + c0;
+          const dt_connector_image_t *img = dt_graph_connector_image(graph, n0, c0, 0, 0);
+          if(!img || !img->mem) { fprintf(stdout, "\n"); continue; }
+          const uint64_t key = (img->offset << 1) | dt_connector_ssbo(cn); // the heaps are separate
+          int k = 0;
+          for(;k<num_slots;k++) if(slot[k] == key) break;
+          if(k == num_slots && num_slots < (int)LENGTH(slot)) slot[num_slots++] = key;
+          const double mb = dt_connector_bufsize(cn, cn->roi.wd, cn->roi.ht)/(1024.0*1024.0);
+          fprintf(stdout, "[color=\"%s\" penwidth=%.1f label=\"%.1f MB\"]\n",
+              _pr_slot_colour(k), 1.0 + log2(1.0 + mb), mb);
+        }
       }
     }
   }
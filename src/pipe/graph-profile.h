@@ -0,0 +1,183 @@
+#pragma once
+#include "pipe/graph.h"
+#include "pipe/modules/api.h"
+#include "qvk/qvk.h"
+#include "core/trace.h"
+#include <stdio.h>
+#include <inttypes.h>
+
+// write timestamp queries of the graph as chrome trace event json,
+// to be loaded by chrome://tracing or https://ui.perfetto.dev
+// usage: set graph->profile to an open file, call dt_graph_profile_begin(),
+// run the graph as often as you like, and finish by dt_graph_profile_end().
+// the gpu kernels end up in process 0, on the same time axis as the cpu
+// phases of core/trace.h (read_source, record, submit, write_sink, ..) which
+// are appended in the end.
+
+static inline void
+dt_graph_profile_begin(dt_graph_t *graph)
+{
+  if(!graph->profile) return;
+  graph->profile_cnt = 0;
+  graph->profile_t0  = dt_trace_now();
+  graph->profile_gpu_ref = graph->profile_cpu_ref = 0;
+  graph->pipeline_stats = 1; // invocations per kernel, if the device supports it
+  fprintf(graph->profile, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+      "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"args\":{\"name\":\"gpu\"}}");
+  graph->profile_cnt++;
+}
+
+// find a gpu timestamp and the CLOCK_MONOTONIC time it corresponds to. with
+// VK_EXT_calibrated_timestamps both are sampled together, so we do that for
+// every frame to follow any drift between the clocks. without it, the end of
+// the first frame we read back (query pool q) is assumed to be now, which
+// places the gpu work a little late but keeps the order of events.
+static inline void
+dt_graph_profile_calibrate(dt_graph_t *graph, int q)
+{
+  if(qvk.calibrated_timestamps_supported)
+  {
+    const VkCalibratedTimestampInfoEXT info[] = {{
+      .sType      = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT,
+      .timeDomain = VK_TIME_DOMAIN_DEVICE_EXT,
+    },{
+      .sType      = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT,
+      .timeDomain = VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT,
+    }};
+    uint64_t ts[2], deviation;
+    if(qvk.GetCalibratedTimestampsEXT(qvk.device, 2, info, ts, &deviation) == VK_SUCCESS)
+    {
+      graph->profile_gpu_ref = ts[0];
+      graph->profile_cpu_ref = ts[1];
+      return;
+    }
+  }
+  const dt_graph_query_t *qr = graph->query + q;
+  if(graph->profile_cpu_ref || !qr->cnt) return;
+  graph->profile_gpu_ref = qr->pool_results[qr->cnt-1];
+  graph->profile_cpu_ref = dt_trace_now();
+}
+
+static inline double // microseconds since dt_graph_profile_begin() for a gpu timestamp
+dt_graph_profile_us(const dt_graph_t *graph, uint64_t ts)
+{
+  const double ns = graph->profile_cpu_ref + ((int64_t)(ts - graph->profile_gpu_ref)) * (double)qvk.ticks_to_nanoseconds;
+  return (ns - graph->profile_t0) * 1e-3;
+}
+
+static inline uint64_t // bytes of all input or output connectors of the node
+dt_graph_profile_bytes(const dt_node_t *node, int output)
+{
+  uint64_t bytes = 0;
+  for(int c=0;c<node->num_connectors;c++)
+  {
+    const dt_connector_t *cn = node->connector+c;
+    if(output ? !dt_connector_output(cn) : !dt_connector_input(cn)) continue;
+    bytes += MAX(1, cn->array_length) * dt_connector_bufsize(cn, cn->roi.wd, cn->roi.ht);
+  }
+  return bytes;
+}
+
+// read back the timestamps of the completed query pool q. the graph only does
+// that by itself if perf logging or the profile is switched on.
+static inline VkResult
+dt_graph_profile_results(dt_graph_t *graph, int q)
+{
+  dt_graph_query_t *qr = graph->query + q;
+  if(!qr->cnt) return VK_SUCCESS;
+  return vkGetQueryPoolResults(qvk.device, qr->pool, 0, qr->cnt,
+      sizeof(qr->pool_results[0]) * qr->max, qr->pool_results, sizeof(qr->pool_results[0]),
+      VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+}
+
+// read back the pipeline statistics of the completed query pool q, if
+// graph->pipeline_stats is set. kernels which didn't record any (sources,
+// sinks, draw calls) stay unavailable, so this doesn't wait.
+static inline void
+dt_graph_profile_stats_results(dt_graph_t *graph, int q)
+{
+  dt_graph_query_t *qr = graph->query + q;
+  if(!graph->pipeline_stats || !qr->stats_pool || qr->cnt < 2) return;
+  vkGetQueryPoolResults(qvk.device, qr->stats_pool, 0, qr->cnt/2,
+      sizeof(uint64_t) * 2 * (qr->max/2), qr->stats_results, 2 * sizeof(uint64_t),
+      VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+}
+
+// compute shader invocations of the kernel of timestamp pair i, or zero if unknown
+static inline uint64_t
+dt_graph_profile_invocations(const dt_graph_t *graph, int q, int i)
+{
+  const dt_graph_query_t *qr = graph->query + q;
+  if(!graph->pipeline_stats || !qr->stats_results) return 0;
+  const uint64_t *s = qr->stats_results + 2*(i/2);
+  return s[1] ? s[0] : 0;
+}
+
+// gpu work of one run, aggregated over the kernels of query pool q
+typedef struct dt_graph_profile_stats_t
+{
+  double   ms;          // kernel time from the timestamps, without uploads and downloads
+  uint64_t bytes;       // read and written by the kernels, computed from connector rois and formats
+  uint64_t invocations; // compute shader invocations, if graph->pipeline_stats
+}
+dt_graph_profile_stats_t;
+
+// needs the results of pool q read back, and the nodes of the run still in place
+static inline dt_graph_profile_stats_t
+dt_graph_profile_stats(const dt_graph_t *graph, int q)
+{
+  dt_graph_profile_stats_t s = {0};
+  const dt_graph_query_t *qr = graph->query + q;
+  for(int i=0;i+1<qr->cnt;i+=2)
+  {
+    dt_node_t *node = graph->node + qr->nid[i];
+    if(dt_node_source(node) || dt_node_sink(node)) continue;
+    s.ms          += (qr->pool_results[i+1] - qr->pool_results[i]) * 1e-6 * qvk.ticks_to_nanoseconds;
+    s.bytes       += dt_graph_profile_bytes(node, 0) + dt_graph_profile_bytes(node, 1);
+    s.invocations += dt_graph_profile_invocations(graph, q, i);
+  }
+  return s;
+}
+
+// append the events of the completed query pool q (usually graph->ring_done)
+static inline void
+dt_graph_profile_frame(dt_graph_t *graph, int q)
+{
+  const dt_graph_query_t *qr = graph->query + q;
+  if(!graph->profile || !qr->cnt) return;
+  dt_graph_profile_calibrate(graph, q);
+  const double to_us = 1e-3 * qvk.ticks_to_nanoseconds;
+  for(int i=0;i+1<qr->cnt;i+=2)
+  {
+    dt_node_t *node = graph->node + qr->nid[i];
+    const int compute = !dt_node_source(node) && !dt_node_sink(node) && node->type != s_node_graphics;
+    fprintf(graph->profile, "%s{\"name\":\"%"PRItkn" %"PRItkn" %"PRItkn"\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":0,"
+        "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%d,\"workgroups\":[%u,%u,%u],\"bytes_read\":%"PRIu64",\"bytes_written\":%"PRIu64",\"invocations\":%"PRIu64"}}",
+        graph->profile_cnt++ ? ",\n" : "",
+        dt_token_str(qr->name[i]), dt_token_str(node->module->inst), dt_token_str(qr->kernel[i]),
+        compute ? "compute" : dt_node_source(node) ? "upload" : dt_node_sink(node) ? "download" : "draw",
+        dt_graph_profile_us(graph, qr->pool_results[i]),
+        (qr->pool_results[i+1] - qr->pool_results[i]) * to_us,
+        graph->frame,
+        compute ? (node->wd + node->local_size[0] - 1) / node->local_size[0] : 0,
+        compute ? (node->ht + node->local_size[1] - 1) / node->local_size[1] : 0,
+        compute ? node->dp : 0,
+        dt_graph_profile_bytes(node, 0),
+        dt_graph_profile_bytes(node, 1),
+        dt_graph_profile_invocations(graph, q, i));
+  }
+}
+
+// append the cpu side, write memory heap peaks and close the json
+static inline void
+dt_graph_profile_end(dt_graph_t *graph)
+{
+  if(!graph->profile) return;
+  graph->profile_cnt = dt_trace_write(graph->profile, graph->profile_cnt, graph->profile_t0);
+  const double mb = 1.0/(1024.0*1024.0);
+  fprintf(graph->profile, "%s{\"name\":\"memory\",\"ph\":\"C\",\"pid\":0,\"ts\":0,\"args\":{"
+      "\"images_peak_mb\":%g,\"buffers_peak_mb\":%g,\"staging_peak_mb\":%g}}\n]}\n",
+      graph->profile_cnt++ ? ",\n" : "",
+      graph->heap.peak_rss * mb, graph->heap_ssbo.peak_rss * mb, graph->heap_staging.peak_rss * mb);
+  graph->profile = 0;
+}
@@ -0,0 +1,157 @@
+#pragma once
+#include "pipe/graph.h"
+#include "pipe/modules/api.h"
+#include "qvk/qvk.h"
+#include "db/hash.h"
+
+// device resident copies of the outputs of static source nodes (luts, clut
+// tables, noise textures). these survive dt_graph_reset() and reallocations of
+// the graph's heaps, so if a source module reports the same content key again
+// (see source_key() in dt_module_so_t) read_source() is skipped and the cached
+// image is copied on the device instead of uploading from staging memory.
+
+#define DT_GRAPH_SRCCACHE_BUDGET    (128ul<<20) // total bytes per graph
+#define DT_GRAPH_SRCCACHE_MAX_ENTRY (32ul<<20)  // don't cache anything larger than this
+
+static inline void
+_dt_graph_srccache_free(dt_graph_srccache_t *e)
+{
+  if(e->img.image) vkDestroyImage(qvk.device, e->img.image, 0);
+  if(e->vkmem)     vkFreeMemory(qvk.device, e->vkmem, 0);
+  memset(e, 0, sizeof(*e));
+}
+
+static inline void
+dt_graph_srccache_cleanup(dt_graph_t *graph)
+{ // device needs to be idle
+  for(int i=0;i<DT_GRAPH_SRCCACHE_MAX;i++)
+    _dt_graph_srccache_free(graph->srccache + i);
+  graph->srccache_size = 0;
+}
+
+// find the entry with the given key in one of the device caches (this one or
+// graph-modcache.h), or make a new one, evicting the least recently used
+// entries which haven't been used at the current clock. returns 1 + index, or
+// 0 if the image doesn't fit. new entries have valid == 0.
+static inline int
+dt_graph_devcache_get(
+    dt_graph_srccache_t *cache,
+    int                  max,
+    uint64_t            *total,     // device memory of all entries
+    uint64_t             budget,
+    uint64_t             max_entry,
+    uint64_t             clock,
+    uint64_t             key,       // non-zero
+    VkFormat             format,
+    uint32_t             wd,
+    uint32_t             ht)
+{
+  for(int i=0;i<max;i++)
+  {
+    if(cache[i].key != key) continue;
+    cache[i].used = clock;
+    return i+1;
+  }
+
+  VkImageCreateInfo info = {
+    .sType         = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+    .imageType     = VK_IMAGE_TYPE_2D,
+    .format        = format,
+    .extent        = { wd, ht, 1 },
+    .mipLevels     = 1,
+    .arrayLayers   = 1,
+    .samples       = VK_SAMPLE_COUNT_1_BIT,
+    .tiling        = VK_IMAGE_TILING_OPTIMAL,
+    .usage         = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+    .sharingMode   = VK_SHARING_MODE_EXCLUSIVE,
+    .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+  };
+  VkImage image;
+  if(vkCreateImage(qvk.device, &info, 0, &image) != VK_SUCCESS) return 0;
+  VkMemoryRequirements req;
+  vkGetImageMemoryRequirements(qvk.device, image, &req);
+  if(req.size > max_entry)
+  {
+    vkDestroyImage(qvk.device, image, 0);
+    return 0;
+  }
+
+  // evict least recently used entries that are not needed by this run
+  int waited = 0, slot = -1;
+  while(1)
+  {
+    int lru = -1;
+    slot = -1;
+    for(int i=0;i<max;i++)
+    {
+      if(!cache[i].key) { if(slot < 0) slot = i; continue; }
+      if(cache[i].used == clock) continue;
+      if(lru < 0 || cache[i].used < cache[lru].used) lru = i;
+    }
+    if(slot >= 0 && *total + req.size <= budget) break;
+    if(lru < 0)
+    { // everything is in use by this run
+      vkDestroyImage(qvk.device, image, 0);
+      return 0;
+    }
+    if(!waited++) // previously recorded command buffers may still read the image
+      QVKL(&qvk.queue_mutex, vkDeviceWaitIdle(qvk.device));
+    *total -= cache[lru].size;
+    _dt_graph_srccache_free(cache + lru);
+  }
+
+  dt_graph_srccache_t *e = cache + slot;
+  VkMemoryAllocateInfo mem_info = {
+    .sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+    .allocationSize  = req.size,
+    .memoryTypeIndex = qvk_get_memory_type(req.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT),
+  };
+  if(vkAllocateMemory(qvk.device, &mem_info, 0, &e->vkmem) != VK_SUCCESS ||
+     vkBindImageMemory(qvk.device, image, e->vkmem, 0) != VK_SUCCESS)
+  {
+    if(e->vkmem) vkFreeMemory(qvk.device, e->vkmem, 0);
+    e->vkmem = 0;
+    vkDestroyImage(qvk.device, image, 0);
+    return 0;
+  }
+  e->key        = key;
+  e->size       = req.size;
+  e->used       = clock;
+  e->valid      = 0;
+  e->img.image  = image;
+  e->img.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+  *total += req.size;
+  return slot+1;
+}
+
+// return 1 + index of the cache entry for the output of the given source node,
+// or 0 if it can't be cached. a new entry has valid == 0 and needs to be filled
+// from staging memory when recording the command buffer.
+static inline int
+dt_graph_srccache_lookup(
+    dt_graph_t *graph,
+    dt_node_t  *node,
+    VkFormat    format)   // format of the output connector
+{
+  dt_connector_t *c = node->connector;
+  if(!node->module->so->source_key || dt_connector_ssbo(c) ||
+     c->array_length > 1 || c->stride_staging || c->format == dt_token("yuv"))
+    return 0;
+  dt_read_source_params_t p = { .node = node, .c = 0, .a = 0 };
+  const uint64_t content = node->module->so->source_key(node->module, &p);
+  if(!content) return 0;
+  // the parameters go into the key too, read_source() may depend on any of them
+  const uint32_t wd = MAX(1, c->roi.wd), ht = MAX(1, c->roi.ht);
+  dt_hash_t h;
+  dt_hash_init(&h, content);
+  dt_hash_update_u64(&h, node->module->so->name);
+  dt_hash_update_u64(&h, node->kernel);
+  dt_hash_update_u64(&h, ((uint64_t)wd << 32) | ht);
+  dt_hash_update_u64(&h, format);
+  dt_hash_update(&h, node->module->param, node->module->param_size);
+  uint64_t key = dt_hash_final(&h);
+  if(!key) key = 1; // zero marks a free entry
+
+  return dt_graph_devcache_get(graph->srccache, DT_GRAPH_SRCCACHE_MAX, &graph->srccache_size,
+      DT_GRAPH_SRCCACHE_BUDGET, DT_GRAPH_SRCCACHE_MAX_ENTRY, graph->srccache_clock, key, format, wd, ht);
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include "pipe/graph.h"
+#include "pipe/modules/api.h"
+
+// fusion of the geometric chain lens -> crop into a single dispatch of the
+// shared/warp kernel. both modules map output pixels to input coordinates, so
+// the kernel runs the crop mapping (crop window, rotation, perspective) and
+// feeds the result straight into the lens distortion, resampling the lens
+// input only once. the intermediate image is never written and the pixels are
+// not interpolated twice. the push constant words are:
+//  0.. 7 lens params (center, scale, squish, ca)
+//  8..27 crop committed params (mat3 H padded to 12, rotation, crop window)
+// 28..29 size of the lens output image (the crop input) as float
+// 30     module index of crop, the lens is the module of the node
+
+#define DT_GRAPH_WARP_WORDS 32
+
+// called from create_nodes() instead of creating the default node for crop.
+// returns 1 if the node of the lens module upstream has been turned into a
+// warp node that writes the crop output, 0 if crop needs a node of its own.
+static inline int
+dt_graph_warp(dt_graph_t *graph, dt_module_t *module, int active_module)
+{
+  if(module->name != dt_token("crop") || module - graph->module == active_module ||
+     module->num_connectors != 2 || module->committed_param_size != 20*sizeof(float))
+    return 0;
+  const dt_connector_t *ci = module->connector, *co = module->connector+1;
+  if(ci->connected_mi < 0 || (co->flags & s_conn_feedback)) return 0;
+  const int mi = ci->connected_mi, mc = ci->connected_mc;
+  dt_module_t *up = graph->module + mi;
+  if(up->name != dt_token("lens") || mi == active_module || dt_module_bypassed(up) ||
+     up->param_size != 8*sizeof(float))
+    return 0;
+  const dt_connector_t *uo = up->connector + mc;
+  const int nid = uo->associated_i, nc = uo->associated_c;
+  if(nid < 0 || (uo->flags & s_conn_feedback)) return 0;
+  if(uo->format != co->format || uo->chan != co->chan) return 0;
+  dt_node_t *node = graph->node + nid;
+  if(node->module != up || node->kernel != dt_token("main") || node->type != s_node_compute)
+    return 0;
+
+  // nobody else may read the intermediate image
+  for(int m=0;m<graph->num_modules;m++)
+  {
+    if(graph->module + m == module) continue;
+    for(int c=0;c<graph->module[m].num_connectors;c++)
+      if(dt_connector_input(graph->module[m].connector+c) &&
+         graph->module[m].connector[c].connected_mi == mi &&
+         graph->module[m].connector[c].connected_mc == mc)
+        return 0;
+  }
+
+  node->name   = dt_token("shared");
+  node->kernel = dt_token("warp");
+  node->wd     = co->roi.wd;
+  node->ht     = co->roi.ht;
+  node->dp     = 1;
+  node->push_constant_size = DT_GRAPH_WARP_WORDS*sizeof(uint32_t);
+  memset(node->push_constant, 0, sizeof(node->push_constant));
+  float *f = (float *)node->push_constant;
+  f[28] = uo->roi.wd;
+  f[29] = uo->roi.ht;
+  node->push_constant[30] = module - graph->module;
+  // the node now writes the crop output, downstream modules find it here
+  dt_connector_copy(graph, module, 1, nid, nc);
+  return 1;
+}
+
+// parameters may change without rebuilding the nodes, so copy them again
+// before the push constants are recorded.
+static inline void
+dt_graph_warp_push(const dt_graph_t *graph, dt_node_t *node)
+{
+  const dt_module_t *crop = graph->module + node->push_constant[30];
+  memcpy(node->push_constant,   node->module->param, 8*sizeof(float));
+  memcpy(node->push_constant+8, crop->committed_param, 20*sizeof(float));
+}
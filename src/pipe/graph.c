@@ -6,8 +6,19 @@
 #include "modules/api.h"
 #include "modules/localsize.h"
 #include "core/log.h"
+#include "core/fs.h"
+#include "core/trace.h"
 #include "qvk/qvk.h"
 #include "graph-print.h"
+#include "graph-profile.h"
+#include "graph-srccache.h"
+#include "graph-pipecache.h"
+#include "graph-fuse.h"
+#include "graph-warp.h"
+#include "graph-barrier.h"
+#include "graph-modcache.h"
+#include "graph-async.h"
+#include "graph-checkpoint.h"
 #ifdef DEBUG_MARKERS
 #include "db/stringpool.h"
 #endif
@@ -42,11 +53,25 @@ dt_graph_init(dt_graph_t *g)
   // allocate module and node buffers:
   g->max_modules = 100;
   g->module = calloc(sizeof(dt_module_t), g->max_modules);
+  g->topo_module = calloc(sizeof(int), g->max_modules);
   g->max_nodes = 4000;
   g->node = calloc(sizeof(dt_node_t), g->max_nodes);
-  dt_vkalloc_init(&g->heap, 16000, 1ul<<40); // bytesize doesn't matter
-  dt_vkalloc_init(&g->heap_ssbo, 8000, 1ul<<40);
-  dt_vkalloc_init(&g->heap_staging, 100, 1ul<<40);
+  dt_vkalloc_init(&g->heap, 16000, 1ul<<40, s_vkalloc_tlsf); // bytesize doesn't matter
+  dt_vkalloc_init(&g->heap_ssbo, 8000, 1ul<<40, s_vkalloc_tlsf);
+  dt_vkalloc_init(&g->heap_staging, 100, 1ul<<40, s_vkalloc_linear);
+  if(dt_log_global.mask & s_log_mem)
+  { // record allocation traces to replay them in pipe/tests/allocbench
+    static int graph_cnt = 0;
+    char cachedir[PATH_MAX], filename[PATH_MAX+50];
+    fs_cachedir(cachedir, sizeof(cachedir));
+    fs_mkdir(cachedir, 0755);
+    const int cnt = __sync_fetch_and_add(&graph_cnt, 1);
+    snprintf(filename, sizeof(filename), "%s/vkalloc-%d-%d-images.txt", cachedir, getpid(), cnt);
+    g->heap.trace = fopen(filename, "wb");
+    snprintf(filename, sizeof(filename), "%s/vkalloc-%d-%d-buffers.txt", cachedir, getpid(), cnt);
+    g->heap_ssbo.trace = fopen(filename, "wb");
+    dt_log(s_log_mem, "recording allocation traces to %s/vkalloc-%d-%d-*.txt", cachedir, getpid(), cnt);
+  }
   g->params_max = 16u<<20;
   g->params_end = 0;
   g->params_pool = calloc(sizeof(uint8_t), g->params_max);
@@ -66,18 +91,26 @@ dt_graph_init(dt_graph_t *g)
     .sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
     .commandPool        = g->command_pool,
     .level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-    .commandBufferCount = 2,
+    .commandBufferCount = DT_GRAPH_MAX_RING,
   };
   QVK(vkAllocateCommandBuffers(qvk.device, &cmd_buf_alloc_info, g->command_buffer));
-  VkFenceCreateInfo fence_info = {
-    .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-    .flags = VK_FENCE_CREATE_SIGNALED_BIT,
+  QVK(vkAllocateCommandBuffers(qvk.device, &cmd_buf_alloc_info, g->command_buffer_async));
+  QVK(vkAllocateCommandBuffers(qvk.device, &cmd_buf_alloc_info, g->command_buffer_join));
+  VkSemaphoreTypeCreateInfo semaphore_type_info = {
+    .sType         = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+    .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+    .initialValue  = 0,
+  };
+  VkSemaphoreCreateInfo semaphore_info = {
+    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+    .pNext = &semaphore_type_info,
   };
-  QVK(vkCreateFence(qvk.device, &fence_info, NULL, g->command_fence+0));
-  QVK(vkCreateFence(qvk.device, &fence_info, NULL, g->command_fence+1));
+  QVK(vkCreateSemaphore(qvk.device, &semaphore_info, NULL, &g->semaphore));
+  g->ring_depth = 3;
   g->float_atomics_supported = qvk.float_atomics_supported;
+  g->coopmat_supported       = qvk.coopmat_supported;
 
-  for(int i=0;i<2;i++)
+  for(int i=0;i<DT_GRAPH_MAX_RING;i++)
   {
     g->query[i].max = 2000;
     g->query[i].cnt = 0;
@@ -90,6 +123,19 @@ dt_graph_init(dt_graph_t *g)
     g->query[i].pool_results = malloc(sizeof(uint64_t)*g->query[i].max);
     g->query[i].name   = malloc(sizeof(dt_token_t)*g->query[i].max);
     g->query[i].kernel = malloc(sizeof(dt_token_t)*g->query[i].max);
+    g->query[i].nid    = malloc(sizeof(uint32_t)*g->query[i].max);
+    if(qvk.pipeline_stats_supported)
+    {
+      VkQueryPoolCreateInfo stats_pool_info = {
+        .sType      = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+        .queryType  = VK_QUERY_TYPE_PIPELINE_STATISTICS,
+        .queryCount = g->query[i].max/2,
+        // graphics statistics would require a graphics queue
+        .pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT,
+      };
+      QVK(vkCreateQueryPool(qvk.device, &stats_pool_info, NULL, &g->query[i].stats_pool));
+      g->query[i].stats_results = calloc(sizeof(uint64_t), 2*(g->query[i].max/2));
+    }
   }
 
   // grab default queue:
@@ -100,6 +146,73 @@ dt_graph_init(dt_graph_t *g)
 
   g->lod_scale = 1;
   g->active_module = -1;
+  g->last_active_module = -1;
+  g->cached_module = -1;
+}
+
+// hand the mapped staging block of a graph going away to the next one. only
+// one block is kept, the larger one.
+static void
+staging_park(dt_graph_t *g)
+{
+  if(!g->vkmem_staging) return;
+  threads_mutex_lock(&dt_pipe.staging_mutex);
+  if(dt_pipe.staging_spare_size < g->vkmem_staging_size)
+  {
+    if(dt_pipe.staging_spare) vkFreeMemory(qvk.device, dt_pipe.staging_spare, 0);
+    dt_pipe.staging_spare        = g->vkmem_staging;
+    dt_pipe.staging_spare_mapped = g->staging_mapped;
+    dt_pipe.staging_spare_size   = g->vkmem_staging_size;
+    dt_pipe.staging_spare_type   = g->vkmem_staging_type;
+  }
+  else vkFreeMemory(qvk.device, g->vkmem_staging, 0);
+  threads_mutex_unlock(&dt_pipe.staging_mutex);
+  g->vkmem_staging  = 0;
+  g->staging_mapped = 0;
+}
+
+// persistently mapped host memory for uploads and downloads of at least
+// heap_staging.vmsize. takes over the parked block of a previous graph if it
+// fits, else allocates with some headroom: video and batch exports ask for a
+// little more every now and then, and every new block means uploading the
+// sources again.
+static VkResult
+staging_alloc(dt_graph_t *g)
+{
+  const size_t need = g->heap_staging.vmsize;
+  const uint32_t type = qvk_get_memory_type(g->memory_type_bits_staging,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT |
+      VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+  threads_mutex_lock(&dt_pipe.staging_mutex);
+  if(dt_pipe.staging_spare && dt_pipe.staging_spare_size >= need && dt_pipe.staging_spare_type == type)
+  {
+    g->vkmem_staging      = dt_pipe.staging_spare;
+    g->staging_mapped     = dt_pipe.staging_spare_mapped;
+    g->vkmem_staging_size = dt_pipe.staging_spare_size;
+    g->vkmem_staging_type = type;
+    dt_pipe.staging_spare = 0;
+    dt_pipe.staging_spare_mapped = 0;
+    dt_pipe.staging_spare_size   = 0;
+    threads_mutex_unlock(&dt_pipe.staging_mutex);
+    return VK_SUCCESS;
+  }
+  threads_mutex_unlock(&dt_pipe.staging_mutex);
+  const size_t size = (need + need/4 + (1ul<<20) - 1) & ~((1ul<<20) - 1); // 25%, in MB
+  VkMemoryAllocateInfo mem_alloc_info_staging = {
+    .sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+    .allocationSize  = size,
+    .memoryTypeIndex = type,
+  };
+  VkResult res = vkAllocateMemory(qvk.device, &mem_alloc_info_staging, 0, &g->vkmem_staging);
+  if(res != VK_SUCCESS)
+  { // maybe the headroom was too much
+    mem_alloc_info_staging.allocationSize = need;
+    QVKR(vkAllocateMemory(qvk.device, &mem_alloc_info_staging, 0, &g->vkmem_staging));
+  }
+  QVKR(vkMapMemory(qvk.device, g->vkmem_staging, 0, VK_WHOLE_SIZE, 0, (void**)&g->staging_mapped));
+  g->vkmem_staging_size = mem_alloc_info_staging.allocationSize;
+  g->vkmem_staging_type = type;
+  return VK_SUCCESS;
 }
 
 void
@@ -109,7 +222,19 @@ dt_graph_cleanup(dt_graph_t *g)
 #ifdef DEBUG_MARKERS
   dt_stringpool_cleanup(&g->debug_markers);
 #endif
+  dt_graph_sink_flush(g);
+  free(g->sink_node);
+  free(g->sink_module);
+  free(g->sink_param);
+  g->sink_node = 0;
+  g->sink_module = 0;
+  g->sink_param = 0;
+  g->sink_cnt = 0;
+  g->sink_param_size = 0;
   QVKL(&qvk.queue_mutex, vkDeviceWaitIdle(qvk.device));
+  dt_graph_srccache_cleanup(g);
+  dt_graph_modcache_cleanup(g);
+  dt_graph_pipecache_cleanup(g);
   for(int i=0;i<g->num_modules;i++)
     if(g->module[i].name && g->module[i].so->cleanup)
       g->module[i].so->cleanup(g->module+i);
@@ -119,7 +244,13 @@ dt_graph_cleanup(dt_graph_t *g)
     g->module[i].keyframe_size = 0;
     g->module[i].keyframe_cnt = 0;
     g->module[i].keyframe = 0;
+    free(g->module[i].keyframe_index);
+    g->module[i].keyframe_index_size = 0;
+    g->module[i].keyframe_index_cnt = -1u;
+    g->module[i].keyframe_index = 0;
   }
+  if(g->heap.trace)      fclose(g->heap.trace);
+  if(g->heap_ssbo.trace) fclose(g->heap_ssbo.trace);
   dt_vkalloc_cleanup(&g->heap);
   dt_vkalloc_cleanup(&g->heap_ssbo);
   dt_vkalloc_cleanup(&g->heap_staging);
@@ -158,7 +289,9 @@ dt_graph_cleanup(dt_graph_t *g)
     {
       dt_connector_t *c = g->node[i].connector+j;
       if(c->staging) vkDestroyBuffer(qvk.device, c->staging, VK_NULL_HANDLE);
+      if(c->mem_external) vkFreeMemory(qvk.device, c->mem_external, 0);
       c->staging = 0;
+      c->mem_external = 0;
       if(c->array_alloc)
       { // free any potential residuals of dynamic allocation
         dt_vkalloc_cleanup(c->array_alloc);
@@ -189,62 +322,52 @@ dt_graph_cleanup(dt_graph_t *g)
   g->uniform_buffer = 0;
   vkFreeMemory(qvk.device, g->vkmem, 0);
   vkFreeMemory(qvk.device, g->vkmem_ssbo, 0);
-  vkFreeMemory(qvk.device, g->vkmem_staging, 0);
+  staging_park(g);
   vkFreeMemory(qvk.device, g->vkmem_uniform, 0);
   g->vkmem = g->vkmem_ssbo = g->vkmem_staging = g->vkmem_uniform = 0;
+  g->staging_mapped = 0;
+  g->uniform_mapped = 0;
   g->vkmem_size = g->vkmem_ssbo_size = g->vkmem_staging_size = g->vkmem_uniform_size = 0;
-  vkDestroyFence(qvk.device, g->command_fence[0], 0);
-  vkDestroyFence(qvk.device, g->command_fence[1], 0);
-  g->command_fence[0] = 0;
-  g->command_fence[1] = 0;
+  vkDestroySemaphore(qvk.device, g->semaphore, 0);
+  g->semaphore = 0;
+  g->semaphore_value = 0;
+  g->async_value = 0;
+  memset(g->ring_value,  0, sizeof(g->ring_value));
+  memset(g->frame_value, 0, sizeof(g->frame_value));
   if(g->command_pool != VK_NULL_HANDLE)
-    vkFreeCommandBuffers(qvk.device, g->command_pool, 2, g->command_buffer);
-  g->command_buffer[0] = g->command_buffer[1] = VK_NULL_HANDLE;
+  {
+    vkFreeCommandBuffers(qvk.device, g->command_pool, DT_GRAPH_MAX_RING, g->command_buffer);
+    vkFreeCommandBuffers(qvk.device, g->command_pool, DT_GRAPH_MAX_RING, g->command_buffer_async);
+    vkFreeCommandBuffers(qvk.device, g->command_pool, DT_GRAPH_MAX_RING, g->command_buffer_join);
+  }
+  memset(g->command_buffer, 0, sizeof(g->command_buffer));
+  memset(g->command_buffer_async, 0, sizeof(g->command_buffer_async));
+  memset(g->command_buffer_join,  0, sizeof(g->command_buffer_join));
   vkDestroyCommandPool(qvk.device, g->command_pool, 0);
   g->command_pool = 0;
   free(g->module);             g->module = 0;
+  free(g->topo_module);        g->topo_module = 0;
   free(g->node);               g->node = 0;
   free(g->params_pool);        g->params_pool = 0;
   free(g->conn_image_pool);    g->conn_image_pool = 0;
-  for(int i=0;i<2;i++)
+  free(g->barrier);            g->barrier = 0;
+  g->barrier_cnt = g->barrier_max = 0;
+  for(int i=0;i<DT_GRAPH_MAX_RING;i++)
   {
+    free(g->record_layout[i]);      g->record_layout[i] = 0;
+    g->record_key[i] = 0;
     vkDestroyQueryPool(qvk.device, g->query[i].pool, 0);
     g->query[i].pool = 0;
+    if(g->query[i].stats_pool) vkDestroyQueryPool(qvk.device, g->query[i].stats_pool, 0);
+    g->query[i].stats_pool = 0;
+    free(g->query[i].stats_results); g->query[i].stats_results = 0;
     free(g->query[i].pool_results); g->query[i].pool_results = 0;
     free(g->query[i].name);         g->query[i].name = 0;
     free(g->query[i].kernel);       g->query[i].kernel = 0;
+    free(g->query[i].nid);          g->query[i].nid = 0;
   }
 }
 
-static inline void *
-read_file(const char *filename, size_t *len)
-{
-  FILE *f = fopen(filename, "rb");
-  if(!f)
-  {
-    dt_log(s_log_qvk|s_log_err, "failed to read shader '%s': %s!",
-        filename, strerror(errno));
-    return 0;
-  }
-  fseek(f, 0, SEEK_END);
-  const size_t filesize = ftell(f);
-  fseek(f, 0, SEEK_SET);
-  char *file = malloc(filesize+1);
-
-  size_t rd = fread(file, sizeof(char), filesize, f);
-  file[filesize] = 0;
-  if(rd != filesize)
-  {
-    free(file);
-    file = 0;
-    fclose(f);
-    return 0;
-  }
-  if(len) *len = filesize;
-  fclose(f);
-  return file;
-}
-
 VkResult
 dt_graph_create_shader_module(
     dt_graph_t     *graph,
@@ -253,22 +376,9 @@ dt_graph_create_shader_module(
     const char     *type,
     VkShaderModule *shader_module)
 {
-  // create the compute shader stage
-  char filename[PATH_MAX+100] = {0};
-  snprintf(filename, sizeof(filename), "%s/modules/%"PRItkn"/%"PRItkn".%s.spv",
-      dt_pipe.basedir, dt_token_str(node), dt_token_str(kernel), type);
-
-  size_t len;
-  void *data = read_file(filename, &len);
-  if(!data) return VK_ERROR_INVALID_EXTERNAL_HANDLE;
-
-  VkShaderModuleCreateInfo sm_info = {
-    .sType    = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-    .codeSize = len,
-    .pCode    = data
-  };
-  QVKR(vkCreateShaderModule(qvk.device, &sm_info, 0, shader_module));
-  free(data);
+  // the shader modules are cached globally, we don't own them:
+  VkResult res = dt_pipe_shader_module(node, kernel, type, shader_module);
+  if(res != VK_SUCCESS) return res;
 #ifdef DEBUG_MARKERS
 #ifdef QVK_ENABLE_VALIDATION
   char name[100];
@@ -287,10 +397,64 @@ dt_graph_create_shader_module(
   return VK_SUCCESS;
 }
 
+// allocate device memory for the graph's images or buffers. if the device heap
+// is exhausted (huge panoramas, long image arrays on small gpus), fall back to
+// host memory that the device can access via pcie. this is slow, but the run
+// will succeed instead of failing. the same happens if the allocation would
+// exceed the memory budget, which is shared with thumbnails and other processes.
+static inline VkResult
+alloc_device_memory(
+    uint64_t        size,
+    uint32_t        type_bits,
+    VkMemoryAllocateFlags flags, // such as the device address bit for buffers
+    VkDeviceMemory *mem,
+    const char     *what)     // for log messages
+{
+  VkMemoryAllocateFlagsInfo allocation_flags = {
+    .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO,
+    .flags = flags,
+  };
+  VkMemoryAllocateInfo mem_alloc_info = {
+    .sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+    .pNext           = flags ? &allocation_flags : 0,
+    .allocationSize  = size,
+    .memoryTypeIndex = qvk_get_memory_type(type_bits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT),
+  };
+  const VkPhysicalDeviceMemoryProperties *mp = &qvk.mem_properties;
+  const uint32_t heap_index = mp->memoryTypes[mem_alloc_info.memoryTypeIndex].heapIndex;
+  const uint64_t heap_size = mp->memoryHeaps[heap_index].size;
+  const int in_budget = size <= heap_size && qvk_budget_reserve(heap_index, size);
+  VkResult res = VK_ERROR_OUT_OF_DEVICE_MEMORY;
+  if(in_budget)
+    res = vkAllocateMemory(qvk.device, &mem_alloc_info, 0, mem);
+  if(res != VK_ERROR_OUT_OF_DEVICE_MEMORY) return res;
+
+  for(uint32_t i=0;i<mp->memoryTypeCount;i++)
+  {
+    if(!(type_bits & (1u<<i))) continue;
+    const VkMemoryHeap *heap = mp->memoryHeaps + mp->memoryTypes[i].heapIndex;
+    if((heap->flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) || heap->size < size) continue;
+    dt_log(s_log_mem, "%s: %g MB do not fit the device heap of %g MB or its budget, falling back to host memory",
+        what, size/(1024.0*1024.0), heap_size/(1024.0*1024.0));
+    mem_alloc_info.memoryTypeIndex = i;
+    return vkAllocateMemory(qvk.device, &mem_alloc_info, 0, mem);
+  }
+  if(!in_budget && size <= heap_size)
+  { // no host heap to fall back to, try over budget
+    res = vkAllocateMemory(qvk.device, &mem_alloc_info, 0, mem);
+    if(res != VK_ERROR_OUT_OF_DEVICE_MEMORY) return res;
+  }
+  dt_log(s_log_mem|s_log_err, "%s: %g MB do not fit the device heap of %g MB!",
+      what, size/(1024.0*1024.0), heap_size/(1024.0*1024.0));
+  return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+}
+
 static inline VkFormat
 dt_connector_vkformat(const dt_connector_t *c)
 {
   const int len = dt_connector_channels(c);
+  if((c->flags & s_conn_compact) && c->format == dt_token("f16") && len == 4)
+    return VK_FORMAT_B10G11R11_UFLOAT_PACK32; // see alloc_outputs()
   if(c->format == dt_token("ui32") || c->format == dt_token("u32") || (c->format == dt_token("atom") && !qvk.float_atomics_supported))
   {
     switch(len)
@@ -347,6 +511,74 @@ dt_connector_vkformat(const dt_connector_t *c)
 }
 
 
+// rough memory footprint of one element of a dynamic array, aligned like the pool
+static inline uint64_t
+dynamic_array_element_size(const dt_connector_t *c, int k)
+{
+  const uint32_t wd = MAX(1, c->array_dim ? c->array_dim[2*k+0] : c->roi.wd);
+  const uint32_t ht = MAX(1, c->array_dim ? c->array_dim[2*k+1] : c->roi.ht);
+  return (dt_connector_bufsize(c, wd, ht) + 0xffff) & ~(uint64_t)0xffff;
+}
+
+// memory of all currently requested elements of a dynamic array
+static inline uint64_t
+dynamic_array_requested_size(const dt_connector_t *c)
+{
+  uint64_t size = 0;
+  if(c->array_req) for(int k=0;k<MAX(1,c->array_length);k++)
+    if(c->array_req[k]) size += dynamic_array_element_size(c, k);
+  return size;
+}
+
+// the pool only reserves what the requested elements need instead of the
+// worst case the module asks for in array_alloc_size. twice the size since
+// replaced elements stay alive until the other frame let go of them.
+static inline uint64_t
+dynamic_array_pool_size(const dt_connector_t *c)
+{
+  if(!c->array_req) return c->array_alloc_size;
+  const uint64_t size = 2*dynamic_array_requested_size(c) + (64ul<<20);
+  return MIN(size, c->array_alloc_size);
+}
+
+// returns non-zero if a module became an identity for its parameters or
+// stopped being one since the nodes were created. the nodes need to be
+// created anew then, bypassing it or not.
+static inline int
+module_bypass_changed(dt_graph_t *graph)
+{
+  for(int m=0;m<graph->num_modules;m++)
+  {
+    dt_module_t *mod = graph->module + m;
+    if(mod->name && mod->bypassed >= 0 && mod->so->identity && mod->bypassed != dt_module_bypassed(mod)) return 1;
+  }
+  return 0;
+}
+
+// returns non-zero if the requests of a dynamic array don't fit its pool
+// any more, but the pool could still grow. this needs a full run, the
+// module will request all elements again in create_nodes.
+static inline int
+dynamic_array_overflow(dt_graph_t *graph)
+{
+  for(int i=0;i<graph->num_nodes;i++) for(int j=0;j<graph->node[i].num_connectors;j++)
+  {
+    dt_connector_t *c = graph->node[i].connector + j;
+    if(!dt_connector_output(c) || !(c->flags & s_conn_dynamic_array)) continue;
+    if(!c->array_alloc || !c->array_mem || !c->array_req) continue;
+    if(c->array_mem->size >= c->array_alloc_size) continue; // can't grow
+    const uint64_t req = dynamic_array_requested_size(c);
+    if(req && req + c->array_alloc->rss > c->array_mem->size)
+    {
+      dt_log(s_log_pipe, "dynamic array %"PRItkn" %"PRItkn" needs %.1f MB more than its %.1f MB pool, growing",
+          dt_token_str(graph->node[i].module->name), dt_token_str(c->name),
+          (req + c->array_alloc->rss - c->array_mem->size)/(1024.0*1024.0), c->array_mem->size/(1024.0*1024.0));
+      return 1;
+    }
+  }
+  return 0;
+}
+
 static inline VkResult
 allocate_image_array_element(
     dt_graph_t        *graph,
@@ -463,7 +695,7 @@ allocate_image_array_element(
 
   assert(!(mem_req.alignment & (mem_req.alignment - 1)));
 
-  if(heap_offset == 0 && (c->frames == 2 || c->type == dt_token("source") || (c->flags & s_conn_protected))) // allocate protected memory, only in outer heap
+  if(heap_offset == 0 && (c->frames == 2 || c->type == dt_token("source") || (c->flags & (s_conn_protected | s_conn_cached)))) // allocate protected memory, only in outer heap
     img->mem = dt_vkalloc_feedback(heap, mem_req.size, mem_req.alignment);
   else
     img->mem = dt_vkalloc(heap, mem_req.size, mem_req.alignment);
@@ -471,6 +703,14 @@ allocate_image_array_element(
   //     "%"PRItkn" %"PRItkn,
   //     mem_req.size/(1024.0*1024.0), size/(1024.0*1024.0), dt_token_str(node->name), dt_token_str(c->name),
   //     dt_token_str(c->chan), dt_token_str(c->format));
+  if(!img->mem && heap_offset)
+  { // dynamic array pool is full. the next run will grow it, see dynamic_array_overflow()
+    dt_log(s_log_pipe|s_log_err, "dynamic array %"PRItkn" %"PRItkn" out of memory for element %d",
+        dt_token_str(node->module->name), dt_token_str(c->name), k);
+    vkDestroyImage(qvk.device, img->image, VK_NULL_HANDLE);
+    img->image = 0;
+    return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+  }
   assert(img->mem);
   img->offset = img->mem->offset + heap_offset;
   img->size   = img->mem->size;
@@ -482,39 +722,198 @@ allocate_image_array_element(
     img->mem->ref = c->connected_mi;
 
   // TODO: better and more general caching:
-  if(heap_offset == 0 && (c->type == dt_token("source") || (c->flags & s_conn_protected)))
+  if(heap_offset == 0 && (c->type == dt_token("source") || (c->flags & (s_conn_protected | s_conn_cached))))
     img->mem->ref++; // add one more so we can run the pipeline starting from after upload easily
 
   return VK_SUCCESS;
 }
 
+// let the staging buffer of a source connector alias the dma-buf the module
+// captures into, so there is no cpu copy per frame. returns VK_SUCCESS if the
+// buffer could be imported, anything else means regular staging memory is needed.
+static inline VkResult
+import_staging_dmabuf(dt_graph_t *graph, dt_node_t *node, dt_connector_t *c)
+{
+  if(!node->module->so->source_dmabuf || !qvk.dmabuf_supported) return VK_INCOMPLETE;
+  if(c->array_length > 1 || dt_connector_ssbo(c) || c->staging_row_length) return VK_INCOMPLETE;
+  uint64_t size = 0;
+  dt_read_source_params_t p = { .node = node, .c = c - node->connector };
+  const int fd = node->module->so->source_dmabuf(node->module, &p, &size);
+  if(fd < 0) return VK_INCOMPLETE;
+  if(size < dt_connector_bufsize(c, c->roi.wd, c->roi.ht)) return VK_INCOMPLETE;
+
+  VkExternalMemoryBufferCreateInfo ext_info = {
+    .sType       = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO,
+    .handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT,
+  };
+  VkBufferCreateInfo buffer_info = {
+    .sType       = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+    .pNext       = &ext_info,
+    .size        = size,
+    .usage       = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+    .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+  };
+  VkBuffer buffer;
+  if(vkCreateBuffer(qvk.device, &buffer_info, 0, &buffer) != VK_SUCCESS) return VK_INCOMPLETE;
+  VkMemoryRequirements req;
+  vkGetBufferMemoryRequirements(qvk.device, buffer, &req);
+  VkMemoryFdPropertiesKHR fd_prop = { .sType = VK_STRUCTURE_TYPE_MEMORY_FD_PROPERTIES_KHR };
+  const int dfd = dup(fd); // vulkan takes ownership of the fd on successful import
+  if(dfd < 0 ||
+     qvk.GetMemoryFdPropertiesKHR(qvk.device, VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT, dfd, &fd_prop) != VK_SUCCESS ||
+     !(fd_prop.memoryTypeBits & req.memoryTypeBits))
+    goto error;
+  VkImportMemoryFdInfoKHR import_info = {
+    .sType      = VK_STRUCTURE_TYPE_IMPORT_MEMORY_FD_INFO_KHR,
+    .handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT,
+    .fd         = dfd,
+  };
+  VkMemoryAllocateInfo mem_info = {
+    .sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+    .pNext           = &import_info,
+    .allocationSize  = size,
+    .memoryTypeIndex = qvk_get_memory_type(fd_prop.memoryTypeBits & req.memoryTypeBits, 0),
+  };
+  VkDeviceMemory mem;
+  if(vkAllocateMemory(qvk.device, &mem_info, 0, &mem) != VK_SUCCESS) goto error;
+  if(vkBindBufferMemory(qvk.device, buffer, mem, 0) != VK_SUCCESS)
+  {
+    vkFreeMemory(qvk.device, mem, 0);
+    vkDestroyBuffer(qvk.device, buffer, 0);
+    return VK_INCOMPLETE;
+  }
+  c->staging      = buffer;
+  c->mem_external = mem;
+  c->size_staging = size;
+  dt_log(s_log_pipe, "%"PRItkn" imports dma-buf as staging memory", dt_token_str(node->name));
+  return VK_SUCCESS;
+error:
+  if(dfd >= 0) close(dfd);
+  vkDestroyBuffer(qvk.device, buffer, 0);
+  dt_log(s_log_pipe, "%"PRItkn" could not import dma-buf, uploading via staging memory", dt_token_str(node->name));
+  return VK_INCOMPLETE;
+}
+
+// fill the specialisation constants of the node's compute kernel from the
+// current values of the module parameters of the same name.
+// returns non-zero if they changed.
+static int
+node_spec(dt_node_t *node)
+{
+  dt_token_t name[DT_PIPE_MAX_SPEC];
+  uint32_t id[DT_PIPE_MAX_SPEC], spec[DT_PIPE_MAX_SPEC], cnt = 0;
+  const int k = node->type == s_node_compute && !dt_node_source(node) && !dt_node_sink(node) ?
+    dt_pipe_shader_spec(node->name, node->kernel, name, id) : 0;
+  for(int i=0;i<k;i++)
+  {
+    const int p = dt_module_get_param(node->module->so, name[i]);
+    if(p < 0 || node->module->so->param[p]->type == dt_token("string")) continue; // keeps the default of the shader
+    memcpy(spec + cnt, node->module->param + node->module->so->param[p]->offset, sizeof(uint32_t));
+    id[cnt++] = id[i];
+  }
+  const int changed = cnt != node->spec_cnt ||
+    memcmp(spec, node->spec, sizeof(spec[0])*cnt) || memcmp(id, node->spec_id, sizeof(id[0])*cnt);
+  node->spec_cnt = cnt;
+  memcpy(node->spec,    spec, sizeof(spec[0])*cnt);
+  memcpy(node->spec_id, id,   sizeof(id[0])*cnt);
+  return changed;
+}
+
+static VkResult
+create_compute_pipeline(dt_graph_t *graph, dt_node_t *node)
+{
+  VkShaderModule shader_module;
+  QVKR(dt_graph_create_shader_module(graph, node->name, node->kernel, "comp", &shader_module));
+
+  // TODO: cache pipelines on module->so ?
+  // VkPipelineShaderStageRequiredSubgroupSizeCreateInfoEXT sub = {
+  //   .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_REQUIRED_SUBGROUP_SIZE_CREATE_INFO,
+  //   .requiredSubgroupSize = 32,
+  // };
+  // constant ids 0 and 1 are the work group size of DT_LOCAL_SIZE_TUNABLE kernels,
+  // the others come from the module parameters, see node_spec().
+  VkSpecializationMapEntry spec_entry[2+DT_PIPE_MAX_SPEC];
+  uint32_t spec_data[2+DT_PIPE_MAX_SPEC] = { node->local_size[0], node->local_size[1] };
+  uint32_t spec_cnt = 0;
+  if(dt_pipe_shader_tunable(node->name, node->kernel))
+    for(;spec_cnt<2;spec_cnt++) spec_entry[spec_cnt] = (VkSpecializationMapEntry) {
+      .constantID = spec_cnt, .offset = sizeof(uint32_t)*spec_cnt, .size = sizeof(uint32_t) };
+  for(int i=0;i<node->spec_cnt;i++)
+  {
+    spec_data[2+i] = node->spec[i];
+    spec_entry[spec_cnt++] = (VkSpecializationMapEntry) {
+      .constantID = node->spec_id[i], .offset = sizeof(uint32_t)*(2+i), .size = sizeof(uint32_t) };
+  }
+  const VkSpecializationInfo spec_info = {
+    .mapEntryCount = spec_cnt,
+    .pMapEntries   = spec_entry,
+    .dataSize      = sizeof(uint32_t)*(2+node->spec_cnt),
+    .pData         = spec_data,
+  };
+  VkPipelineShaderStageCreateInfo stage_info = {
+    .sType               = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+    .stage               = VK_SHADER_STAGE_COMPUTE_BIT,
+    .pSpecializationInfo = spec_cnt ? &spec_info : 0,
+    .pName               = "main", // arbitrary entry point symbols are supported by glslangValidator, but need extra compilation, too. i think it's easier to structure code via includes then.
+    .module              = shader_module,
+    // .pNext               = &sub,
+  };
+
+  // finally create the pipeline
+  VkComputePipelineCreateInfo pipeline_info = {
+    .sType  = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+    .flags  = VK_PIPELINE_CREATE_DISPATCH_BASE_BIT, // dirty regions dispatch a subset of the workgroups
+    .stage  = stage_info,
+    .layout = node->pipeline_layout
+  };
+  QVKR(vkCreateComputePipelines(qvk.device, qvk.pipeline_cache, 1, &pipeline_info, 0, &node->pipeline));
+  return VK_SUCCESS;
+}
+
 // allocate output buffers, also create vulkan pipeline and load spir-v portion
 // of the compute shader.
 static inline VkResult
 alloc_outputs(dt_graph_t *graph, dt_node_t *node)
 {
   const int f = graph->frame % 2;
+  // packed rgb (b10g11r11 ufloat) halves the memory of rgba f16 intermediates
+  // at the price of alpha, negative values and a few mantissa bits. only for
+  // outputs the module deems safe, and never for anything going through staging.
+  for(int i=0;i<node->num_connectors;i++)
+    if(graph->precision >= 0 || !qvk.packed_float_supported || dt_node_sink(node) || dt_node_source(node) ||
+       node->connector[i].array_length > 1 || (node->connector[i].flags & s_conn_feedback))
+      node->connector[i].flags &= ~s_conn_compact;
+  for(int n=0;n<graph->num_nodes;n++) if(dt_node_sink(graph->node+n))
+    for(int i=0;i<graph->node[n].num_connectors;i++)
+      if(graph->node[n].connector[i].connected_mi == node - graph->node && dt_connector_input(graph->node[n].connector+i))
+        node->connector[graph->node[n].connector[i].connected_mc].flags &= ~s_conn_compact; // downloaded as is
   // create descriptor bindings and pipeline:
   // we'll bind our buffers in the same order as in the connectors file.
   uint32_t drawn_connector_cnt = 0;
   uint32_t drawn_connector[DT_MAX_CONNECTORS];
   VkDescriptorSetLayoutBinding bindings[DT_MAX_CONNECTORS] = {{0}};
+  // compute nodes push their descriptors if the device can take all of them at once
+  uint32_t desc_cnt = 0;
+  for(int i=0;i<node->num_connectors;i++) desc_cnt += MAX(1, node->connector[i].array_length);
+  node->push_dset = qvk.push_descriptor_supported && desc_cnt <= qvk.max_push_descriptors &&
+    node->type == s_node_compute && !dt_node_sink(node) && !dt_node_source(node);
+  const int pool = !node->push_dset; // count descriptors allocated from the pool
   for(int i=0;i<node->num_connectors;i++)
   {
     bindings[i].binding = i;
     if(dt_connector_ssbo(node->connector+i))
     {
-      graph->dset_cnt_buffer += MAX(1, node->connector[i].array_length);
+      graph->dset_cnt_buffer += pool * MAX(1, node->connector[i].array_length);
       bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
     }
     else if(dt_connector_input(node->connector+i))
     {
-      graph->dset_cnt_image_read += MAX(1, node->connector[i].array_length);
+      graph->dset_cnt_image_read += pool * MAX(1, node->connector[i].array_length);
       bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
     }
     else
     {
-      graph->dset_cnt_image_write += MAX(1, node->connector[i].array_length);
+      graph->dset_cnt_image_write += pool * MAX(1, node->connector[i].array_length);
       bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
       if(node->type == s_node_graphics)
         drawn_connector[drawn_connector_cnt++] = i;
@@ -533,14 +932,16 @@ alloc_outputs(dt_graph_t *graph, dt_node_t *node)
     for(int i=0;i<drawn_connector_cnt;i++)
     {
       int k = drawn_connector[i];
+      // protected outputs keep what was drawn before, they are cleared explicitly when starting over
+      const int keep = node->connector[k].flags & s_conn_protected;
       attachment_desc[i] = (VkAttachmentDescription) {
         .format         = dt_connector_vkformat(node->connector+k),
         .samples        = VK_SAMPLE_COUNT_1_BIT,
-        .loadOp         = VK_ATTACHMENT_LOAD_OP_CLEAR, // VK_ATTACHMENT_LOAD_OP_DONT_CARE, // select on s_conn_clear flag?
+        .loadOp         = keep ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR,
         .storeOp        = VK_ATTACHMENT_STORE_OP_STORE,
         .stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
         .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
-        .initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED,
+        .initialLayout  = keep ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED,
         .finalLayout    = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
       };
       color_attachment[i] = (VkAttachmentReference) {
@@ -563,12 +964,23 @@ alloc_outputs(dt_graph_t *graph, dt_node_t *node)
     QVK(vkCreateRenderPass(qvk.device, &info, 0, &node->draw_render_pass));
   }
 
+  // tunable kernels may run with a different work group size on this device
+  if(node->type == s_node_compute && !dt_node_source(node) && !dt_node_sink(node))
+    dt_pipe_localsize(node->name, node->kernel, node->local_size);
+  else
+    node->local_size[0] = DT_LOCAL_SIZE_X, node->local_size[1] = DT_LOCAL_SIZE_Y;
+  node_spec(node);
+
+  // a compute node of an earlier cfg may have left all we need in the cache
+  dt_graph_pipecache_get(graph, node);
+
   // a sink needs a descriptor set (for display via imgui)
-  if(!dt_node_source(node))
+  if(!dt_node_source(node) && !node->dset_layout)
   {
     // create a descriptor set layout
     VkDescriptorSetLayoutCreateInfo dset_layout_info = {
       .sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+      .flags        = node->push_dset ? VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR : 0,
       .bindingCount = node->num_connectors,
       .pBindings    = bindings,
     };
@@ -578,7 +990,7 @@ alloc_outputs(dt_graph_t *graph, dt_node_t *node)
   // a sink or a source does not need a pipeline to be run.
   // note, however, that a sink does need a descriptor set, as we want to bind
   // it to imgui textures later on.
-  if(!(dt_node_sink(node) || dt_node_source(node)))
+  if(!(dt_node_sink(node) || dt_node_source(node)) && !node->pipeline)
   {
     // create the pipeline layout
     VkDescriptorSetLayout dset_layout[] = {
@@ -602,7 +1014,6 @@ alloc_outputs(dt_graph_t *graph, dt_node_t *node)
 
     if(drawn_connector_cnt)
     { // create rasterisation pipeline
-      // TODO: cache shader modules on global struct? (we'll reuse the draw kernels for all strokes)
       const int wd = node->connector[drawn_connector[0]].roi.wd;
       const int ht = node->connector[drawn_connector[0]].roi.ht;
       VkShaderModule shader_module_vert, shader_module_geom, shader_module_frag;
@@ -737,43 +1148,13 @@ alloc_outputs(dt_graph_t *graph, dt_node_t *node)
         .basePipelineIndex   = -1,
       };
 
-      QVKR(vkCreateGraphicsPipelines(qvk.device, VK_NULL_HANDLE,
+      QVKR(vkCreateGraphicsPipelines(qvk.device, qvk.pipeline_cache,
             1, &pipeline_info, NULL, &node->pipeline));
 
-      // TODO: keep cached for others
-      vkDestroyShaderModule(qvk.device, shader_module_vert, 0);
-      vkDestroyShaderModule(qvk.device, shader_module_frag, 0);
-      if(geom == VK_SUCCESS) vkDestroyShaderModule(qvk.device, shader_module_geom, 0);
     }
     else
     { // create the compute shader stage
-      VkShaderModule shader_module;
-      QVKR(dt_graph_create_shader_module(graph, node->name, node->kernel, "comp", &shader_module));
-
-      // TODO: cache pipelines on module->so ?
-      // VkPipelineShaderStageRequiredSubgroupSizeCreateInfoEXT sub = {
-      //   .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_REQUIRED_SUBGROUP_SIZE_CREATE_INFO,
-      //   .requiredSubgroupSize = 32,
-      // };
-      VkPipelineShaderStageCreateInfo stage_info = {
-        .sType               = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-        .stage               = VK_SHADER_STAGE_COMPUTE_BIT,
-        .pSpecializationInfo = 0,
-        .pName               = "main", // arbitrary entry point symbols are supported by glslangValidator, but need extra compilation, too. i think it's easier to structure code via includes then.
-        .module              = shader_module,
-        // .pNext               = &sub,
-      };
-
-      // finally create the pipeline
-      VkComputePipelineCreateInfo pipeline_info = {
-        .sType  = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
-        .stage  = stage_info,
-        .layout = node->pipeline_layout
-      };
-      QVKR(vkCreateComputePipelines(qvk.device, VK_NULL_HANDLE, 1, &pipeline_info, 0, &node->pipeline));
-
-      // we don't need the module any more
-      vkDestroyShaderModule(qvk.device, stage_info.module, 0);
+      QVKR(create_compute_pipeline(graph, node));
     }
   } // done with pipeline
 
@@ -799,7 +1180,8 @@ alloc_outputs(dt_graph_t *graph, dt_node_t *node)
           .size        = size,
           .usage       = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
                          VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
-                         VK_BUFFER_USAGE_TRANSFER_DST_BIT, 
+                         VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                         VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, // work group counts for dispatch_indirect
                       // VK_BUFFER_USAGE_VERTEX_BUFFER_BIT for draw nodes maybe?
           .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
         };
@@ -842,7 +1224,7 @@ alloc_outputs(dt_graph_t *graph, dt_node_t *node)
           }
           graph->memory_type_bits_ssbo = buf_mem_req.memoryTypeBits;
 
-          if(c->frames == 2) // allocate protected memory for feedback connectors
+          if(c->frames == 2 || (c->flags & s_conn_cached)) // allocate protected memory for feedback and cached connectors
             img->mem = dt_vkalloc_feedback(&graph->heap_ssbo, buf_mem_req.size, buf_mem_req.alignment);
           else
             img->mem = dt_vkalloc(&graph->heap_ssbo, buf_mem_req.size, buf_mem_req.alignment);
@@ -854,13 +1236,14 @@ alloc_outputs(dt_graph_t *graph, dt_node_t *node)
         // same node (as multiple places in the code e.g. using a single read_source call)
         c->offset_staging = img->mem->offset;
         c->size_staging   = size;
+        c->stride_staging = 0; // the gpu reads this directly, can't be double buffered
         // reference counting. we can't just do a ref++ here because we will
         // free directly after and wouldn't know which node later on still relies
         // on this buffer. hence we ran a reference counting pass before this, and
         // init the reference counter now accordingly:
         img->mem->ref = c->connected_mi;
 
-        if(c->type == dt_token("source"))
+        if(c->type == dt_token("source") || (c->flags & s_conn_cached))
           img->mem->ref++; // add one more so we can run the pipeline starting from after upload easily
       }
     }
@@ -897,18 +1280,32 @@ alloc_outputs(dt_graph_t *graph, dt_node_t *node)
                 graph, node, c, &graph->heap, 0, f, k));
       else
       { // in case of dynamic allocation, reserve a protected block and wait until later
-        c->array_mem = dt_vkalloc_feedback(&graph->heap, c->array_alloc_size, 0x10000); // this is shit and should probably get a fake alignment value for a fake image. amd requires this large one, nvidia can do one 0 less
+        const uint64_t size = dynamic_array_pool_size(c);
+        c->array_mem = dt_vkalloc_feedback(&graph->heap, size, 0x10000); // this is shit and should probably get a fake alignment value for a fake image. amd requires this large one, nvidia can do one 0 less
         c->array_alloc = calloc(sizeof(dt_vkalloc_t), 1);
-        dt_vkalloc_init(c->array_alloc, c->array_length * 2, c->array_alloc_size);
+        dt_vkalloc_init(c->array_alloc, c->array_length * 2, size, s_vkalloc_linear);
       }
 
       // allocate only one staging buffer for the whole array:
-      if(c->type == dt_token("source"))
+      if(c->type == dt_token("source") && import_staging_dmabuf(graph, node, c) == VK_SUCCESS)
+      { // the device reads the module's capture buffer directly
+        c->mem_staging    = 0;
+        c->offset_staging = 0;
+        c->stride_staging = 0;
+      }
+      else if(c->type == dt_token("source"))
       {
+        // animated single image sources get two staging slots, so reading the next frame
+        // doesn't have to wait for the gpu to finish copying the current one:
+        const uint64_t bufsize = c->staging_row_length ?
+          dt_connector_bufsize(c, c->staging_row_length,
+              c->roi.ht + (c->staging_skip + c->staging_row_length - 1) / c->staging_row_length) :
+          dt_connector_bufsize(c, c->roi.wd, c->roi.ht);
+        c->stride_staging = (graph->frame_cnt > 1 && c->array_length <= 1) ? (bufsize + 0xff) & ~0xffull : 0;
         // allocate staging buffer for uploading to the just allocated image
         VkBufferCreateInfo buffer_info = {
           .sType       = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-          .size        = dt_connector_bufsize(c, c->roi.wd, c->roi.ht),
+          .size        = c->stride_staging ? 2*c->stride_staging : bufsize,
           .usage       = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
           .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
         };
@@ -947,10 +1344,15 @@ alloc_outputs(dt_graph_t *graph, dt_node_t *node)
         node->conn_image[i] = graph->node[c->connected_mi].conn_image[c->connected_mc];
         if(c->type == dt_token("sink"))
         {
-          // allocate staging buffer for downloading from connected input
+          // allocate staging buffer for downloading from connected input.
+          // animations get two slots, so write_sink() can read one while the gpu fills the other.
+          // deferred sinks get one per command buffer in the ring, see read_deferred_sinks():
+          const uint64_t bufsize = dt_connector_bufsize(c, c->roi.wd, c->roi.ht);
+          const int slots = (c->flags & s_conn_deferred) ? DT_GRAPH_MAX_RING : graph->frame_cnt > 1 ? 2 : 1;
+          c->stride_staging = slots > 1 ? (bufsize + 0xff) & ~0xffull : 0;
           VkBufferCreateInfo buffer_info = {
             .sType       = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-            .size        = dt_connector_bufsize(c, c->roi.wd, c->roi.ht),
+            .size        = c->stride_staging ? slots*c->stride_staging : bufsize,
             .usage       = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
             .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
           };
@@ -1081,6 +1483,82 @@ alloc_outputs2(dt_graph_t *graph, dt_node_t *node)
   return VK_SUCCESS;
 }
 
+// fill the descriptor of array element k of a connector for frame f
+static inline void
+connector_descriptor(
+    dt_graph_t             *graph,
+    dt_node_t              *node,
+    dt_connector_t         *c,
+    int                     k,
+    int                     f,
+    VkDescriptorImageInfo  *img_info,
+    VkDescriptorBufferInfo *buf_info)
+{
+  if(dt_connector_output(c))
+  {
+    dt_connector_image_t *img = dt_graph_connector_image(graph,
+        node - graph->node, c - node->connector, k, MIN(f, c->frames-1));
+    if(dt_connector_ssbo(c))
+    { // storage buffer
+      buf_info->buffer = img->buffer;
+      buf_info->offset = 0;
+      buf_info->range  = img->size;
+      return;
+    }
+    if(!img->image_view) // for dynamic arrays maybe a lazy programmer left empty slots? set to tex 0:
+      img = dt_graph_connector_image(graph,
+          node - graph->node, c - node->connector, 0, MIN(f, c->frames-1));
+    img_info->sampler     = VK_NULL_HANDLE;
+    img_info->imageView   = img->image_view;
+    assert(img->image_view);
+    img_info->imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    return;
+  }
+  // point our inputs to their counterparts:
+  int frame = MIN(f, 
+    graph->node[c->connected_mi].connector[c->connected_mc].frames-1);
+  if(c->flags & s_conn_feedback)
+  { // feedback connections cross the frame wires:
+    frame = 1-f;
+    // this should be ensured during connection:
+    assert(c->frames == 2); 
+    assert(graph->node[c->connected_mi].connector[c->connected_mc].frames == 2);
+  }
+  dt_connector_image_t *img  = dt_graph_connector_image(graph,
+      node - graph->node, c - node->connector, k, frame);
+  if(!img->image_view) // for dynamic arrays maybe a lazy programmer left empty slots? set to tex 0:
+    img = dt_graph_connector_image(graph,
+        node - graph->node, c - node->connector, 0, frame);
+  if(dt_connector_ssbo(c))
+  { // storage buffer
+    buf_info->buffer = img->buffer;
+    buf_info->offset = 0;
+    buf_info->range  = img->size;
+  }
+  else
+  { // image buffer
+    // the image struct is shared between in and out connectors, but we 
+    // acces the frame either straight or crossed, depending on feedback mode.
+    if(c->format == dt_token("yuv"))
+      img_info->sampler   = 0; // needs immutable sampler
+    else if(c->type == dt_token("sink") || c->format == dt_token("ui32"))
+      img_info->sampler   = qvk.tex_sampler_nearest;
+    else
+      img_info->sampler   = qvk.tex_sampler;
+    img_info->imageView   = img->image_view;
+    assert(img->image_view);
+    img_info->imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  }
+}
+
+static inline VkDescriptorType
+connector_descriptor_type(dt_connector_t *c)
+{
+  if(dt_connector_ssbo(c))   return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  if(dt_connector_output(c)) return VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+  return VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+}
+
 // update descriptor sets
 static inline void
 write_descriptor_sets(
@@ -1089,140 +1567,32 @@ write_descriptor_sets(
     dt_connector_t *c,
     int             dyn_array)
 {
+  if(node->push_dset) return; // pushed when recording the command buffer
   VkDescriptorImageInfo  *img_info = alloca(sizeof(VkDescriptorImageInfo) *DT_GRAPH_MAX_FRAMES*MAX(1,c->array_length));
   VkDescriptorBufferInfo *buf_info = alloca(sizeof(VkDescriptorBufferInfo)*DT_GRAPH_MAX_FRAMES*MAX(1,c->array_length));
   VkWriteDescriptorSet    img_dset[DT_GRAPH_MAX_FRAMES] = {{0}};
   int cur_img = 0, cur_dset = 0, cur_buf = 0;
 
+  int fm = 0, fM = 0;
   if(dt_connector_output(c))
-  { // allocate our output buffers
-    if(!dyn_array && dt_connector_ssbo(c))
-    { // storage buffer
-      for(int f=0;f<DT_GRAPH_MAX_FRAMES;f++)
-      {
-        int ii = cur_buf;
-        for(int k=0;k<MAX(1,c->array_length);k++)
-        {
-          dt_connector_image_t *img = dt_graph_connector_image(graph,
-              node - graph->node, c - node->connector, k, MIN(f, c->frames-1));
-          int iii = cur_buf++;
-          buf_info[iii].buffer = img->buffer;
-          buf_info[iii].offset = 0;
-          buf_info[iii].range  = img->size;
-        }
-        int dset = cur_dset++;
-        img_dset[dset].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        img_dset[dset].dstSet          = node->dset[f];
-        img_dset[dset].dstBinding      = c - node->connector;
-        img_dset[dset].dstArrayElement = 0;
-        img_dset[dset].descriptorCount = MAX(c->array_length, 1);
-        img_dset[dset].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-        img_dset[dset].pBufferInfo     = buf_info + ii;
-      }
-    }
-    else
-    { // image buffer
-      // dynamic arrays will only initialise the descriptor set necessary for the current frame
-      // since the frames refer to the odd/even pipelines and not to feedback buffers used in the same
-      // command buffer:
-      const int c_dyn_array = c->flags & s_conn_dynamic_array;
-      int fm = c_dyn_array ? (graph->frame % 2) : 0;
-      int fM = c_dyn_array ? (graph->frame % 2) + 1 : DT_GRAPH_MAX_FRAMES;
-      if((!dyn_array && !c_dyn_array) || (dyn_array && c_dyn_array)) for(int f=fm;f<fM;f++)
-      {
-        int ii = cur_img;
-        for(int k=0;k<MAX(1,c->array_length);k++)
-        {
-          dt_connector_image_t *img = dt_graph_connector_image(graph,
-              node - graph->node, c - node->connector, k, MIN(f, c->frames-1));
-          if(!img->image_view) // for dynamic arrays maybe a lazy programmer left empty slots? set to tex 0:
-            img = dt_graph_connector_image(graph,
-                node - graph->node, c - node->connector, 0, MIN(f, c->frames-1));
-
-          int iii = cur_img++;
-          img_info[iii].sampler     = VK_NULL_HANDLE;
-          img_info[iii].imageView   = img->image_view;
-          assert(img->image_view);
-          img_info[iii].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
-        }
-        int dset = cur_dset++;
-        img_dset[dset].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        img_dset[dset].dstSet          = node->dset[f];
-        img_dset[dset].dstBinding      = c - node->connector;
-        img_dset[dset].dstArrayElement = 0;
-        img_dset[dset].descriptorCount = MAX(c->array_length, 1);
-        img_dset[dset].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-        img_dset[dset].pImageInfo      = img_info + ii;
-      }
+  { // dynamic arrays will only initialise the descriptor set necessary for the current frame
+    // since the frames refer to the odd/even pipelines and not to feedback buffers used in the same
+    // command buffer. storage buffers are never dynamic.
+    const int c_dyn_array = !dt_connector_ssbo(c) && (c->flags & s_conn_dynamic_array);
+    if(dt_connector_ssbo(c) ? !dyn_array : ((!dyn_array && !c_dyn_array) || (dyn_array && c_dyn_array)))
+    {
+      fm = c_dyn_array ? (graph->frame % 2) : 0;
+      fM = c_dyn_array ? (graph->frame % 2) + 1 : DT_GRAPH_MAX_FRAMES;
     }
   }
   else if(dt_connector_input(c))
-  { // point our inputs to their counterparts:
+  {
     const int c_dyn_array = (c->connected_mi >=0 && c->connected_mc >= 0) ? graph->node[c->connected_mi].connector[c->connected_mc].flags & s_conn_dynamic_array : 0;
     if(c->connected_mi >= 0 &&
       ((!dyn_array && !c_dyn_array) || (dyn_array && c_dyn_array)))
     {
-      int fm = c_dyn_array ? (graph->frame % 2) : 0;
-      int fM = c_dyn_array ? (graph->frame % 2) + 1 : DT_GRAPH_MAX_FRAMES;
-      for(int f=fm;f<fM;f++)
-      {
-        int ii = dt_connector_ssbo(c) ? cur_buf : cur_img;
-        for(int k=0;k<MAX(1,c->array_length);k++)
-        {
-          int frame = MIN(f, 
-            graph->node[c->connected_mi].connector[c->connected_mc].frames-1);
-          if(c->flags & s_conn_feedback)
-          { // feedback connections cross the frame wires:
-            frame = 1-f;
-            // this should be ensured during connection:
-            assert(c->frames == 2); 
-            assert(graph->node[c->connected_mi].connector[c->connected_mc].frames == 2);
-          }
-          dt_connector_image_t *img  = dt_graph_connector_image(graph,
-              node - graph->node, c - node->connector, k, frame);
-          if(!img->image_view) // for dynamic arrays maybe a lazy programmer left empty slots? set to tex 0:
-            img = dt_graph_connector_image(graph,
-                node - graph->node, c - node->connector, 0, frame);
-          if(dt_connector_ssbo(c))
-          { // storage buffer
-            int iii = cur_buf++;
-            buf_info[iii].buffer = img->buffer;
-            buf_info[iii].offset = 0;
-            buf_info[iii].range  = img->size;
-          }
-          else
-          { // image buffer
-            // the image struct is shared between in and out connectors, but we 
-            // acces the frame either straight or crossed, depending on feedback mode.
-            int iii = cur_img++;
-            if(c->format == dt_token("yuv"))
-              img_info[iii].sampler   = 0; // needs immutable sampler
-            else if(c->type == dt_token("sink") || c->format == dt_token("ui32"))
-              img_info[iii].sampler   = qvk.tex_sampler_nearest;
-            else
-              img_info[iii].sampler   = qvk.tex_sampler;
-            img_info[iii].imageView   = img->image_view;
-            assert(img->image_view);
-            img_info[iii].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-          }
-        }
-        int dset = cur_dset++;
-        img_dset[dset].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        img_dset[dset].dstSet          = node->dset[f];
-        img_dset[dset].dstBinding      = c - node->connector;
-        img_dset[dset].dstArrayElement = 0;
-        img_dset[dset].descriptorCount = MAX(c->array_length, 1);
-        if(dt_connector_ssbo(c))
-        {
-          img_dset[dset].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-          img_dset[dset].pBufferInfo     = buf_info + ii;
-        }
-        else
-        {
-          img_dset[dset].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-          img_dset[dset].pImageInfo      = img_info + ii;
-        }
-      }
+      fm = c_dyn_array ? (graph->frame % 2) : 0;
+      fM = c_dyn_array ? (graph->frame % 2) + 1 : DT_GRAPH_MAX_FRAMES;
     }
     else if(c->connected_mi < 0)
     { // sorry not connected, buffer will not be bound.
@@ -1232,10 +1602,64 @@ write_descriptor_sets(
           dt_token_str(node->kernel), dt_token_str(c->name));
     }
   }
+  for(int f=fm;f<fM;f++)
+  {
+    int ii = dt_connector_ssbo(c) ? cur_buf : cur_img;
+    for(int k=0;k<MAX(1,c->array_length);k++)
+    {
+      if(dt_connector_ssbo(c)) connector_descriptor(graph, node, c, k, f, 0, buf_info + cur_buf++);
+      else                     connector_descriptor(graph, node, c, k, f, img_info + cur_img++, 0);
+    }
+    int dset = cur_dset++;
+    img_dset[dset].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    img_dset[dset].dstSet          = node->dset[f];
+    img_dset[dset].dstBinding      = c - node->connector;
+    img_dset[dset].dstArrayElement = 0;
+    img_dset[dset].descriptorCount = MAX(c->array_length, 1);
+    img_dset[dset].descriptorType  = connector_descriptor_type(c);
+    if(dt_connector_ssbo(c)) img_dset[dset].pBufferInfo = buf_info + ii;
+    else                     img_dset[dset].pImageInfo  = img_info + ii;
+  }
   if(node->dset_layout && cur_dset)
     vkUpdateDescriptorSets(qvk.device, cur_dset, img_dset, 0, NULL);
 }
 
+// nodes with push_dset get the descriptors of set 1 recorded into the command
+// buffer, for the current frame. this needs no descriptor pool and no updates
+// when (dynamic) arrays change.
+static inline void
+push_descriptor_sets(
+    dt_graph_t      *graph,
+    dt_node_t       *node,
+    VkCommandBuffer  cmd_buf)
+{
+  const int f = graph->frame % 2;
+  int cnt = 0;
+  for(int i=0;i<node->num_connectors;i++) cnt += MAX(1, node->connector[i].array_length);
+  VkDescriptorImageInfo  *img_info = alloca(sizeof(VkDescriptorImageInfo) *cnt);
+  VkDescriptorBufferInfo *buf_info = alloca(sizeof(VkDescriptorBufferInfo)*cnt);
+  VkWriteDescriptorSet    write[DT_MAX_CONNECTORS];
+  int cur = 0, num = 0;
+  for(int i=0;i<node->num_connectors;i++)
+  {
+    dt_connector_t *c = node->connector+i;
+    if(dt_connector_input(c) && c->connected_mi < 0) continue; // logged during alloc
+    const int ii = cur;
+    for(int k=0;k<MAX(1,c->array_length);k++,cur++)
+      connector_descriptor(graph, node, c, k, f, img_info + cur, buf_info + cur);
+    write[num++] = (VkWriteDescriptorSet) {
+      .sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+      .dstBinding      = i,
+      .descriptorCount = MAX(c->array_length, 1),
+      .descriptorType  = connector_descriptor_type(c),
+      .pImageInfo      = dt_connector_ssbo(c) ? 0 : img_info + ii,
+      .pBufferInfo     = dt_connector_ssbo(c) ? buf_info + ii : 0,
+    };
+  }
+  if(num) qvk.CmdPushDescriptorSetKHR(cmd_buf, VK_PIPELINE_BIND_POINT_COMPUTE,
+      node->pipeline_layout, 1, num, write);
+}
+
 // initialise descriptor sets, bind staging buffer memory
 static inline VkResult
 alloc_outputs3(dt_graph_t *graph, dt_node_t *node)
@@ -1250,7 +1674,8 @@ alloc_outputs3(dt_graph_t *graph, dt_node_t *node)
       .descriptorSetCount = DT_GRAPH_MAX_FRAMES,
       .pSetLayouts = lo,
     };
-    QVKR(vkAllocateDescriptorSets(qvk.device, &dset_info, node->dset));
+    if(!node->push_dset) QVKR(vkAllocateDescriptorSets(qvk.device, &dset_info, node->dset));
+    else memset(node->dset, 0, sizeof(node->dset));
 
     // uniform descriptor
     VkDescriptorSetAllocateInfo dset_info_u = {
@@ -1259,59 +1684,32 @@ alloc_outputs3(dt_graph_t *graph, dt_node_t *node)
       .descriptorSetCount = 1,
       .pSetLayouts = &graph->uniform_dset_layout,
     };
-    QVKR(vkAllocateDescriptorSets(qvk.device, &dset_info_u, node->uniform_dset+0));
-    QVKR(vkAllocateDescriptorSets(qvk.device, &dset_info_u, node->uniform_dset+1));
-    VkDescriptorBufferInfo uniform_info[] = {{
-      .buffer      = graph->uniform_buffer,
-      .offset      = 0,
-      .range       = graph->uniform_global_size,
-    },{
-      .buffer      = graph->uniform_buffer,
-      .offset      = node->module->uniform_size ? node->module->uniform_offset : 0,
-      .range       = node->module->uniform_size ? node->module->uniform_size : graph->uniform_global_size,
-    },{
-      .buffer      = graph->uniform_buffer,
-      .offset      = graph->uniform_size,
-      .range       = graph->uniform_global_size,
-    },{
-      .buffer      = graph->uniform_buffer,
-      .offset      = graph->uniform_size + (node->module->uniform_size ? node->module->uniform_offset : 0),
-      .range       = node->module->uniform_size ? node->module->uniform_size : graph->uniform_global_size,
-    }};
-    VkWriteDescriptorSet buf_dset[] = {{
-      .sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-      .dstSet          = node->uniform_dset[0],
-      .dstBinding      = 0,
-      .dstArrayElement = 0,
-      .descriptorCount = 1,
-      .descriptorType  = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-      .pBufferInfo     = uniform_info+0,
-    },{
-      .sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-      .dstSet          = node->uniform_dset[0],
-      .dstBinding      = 1,
-      .dstArrayElement = 0,
-      .descriptorCount = 1,
-      .descriptorType  = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-      .pBufferInfo     = uniform_info+1,
-    },{
-      .sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-      .dstSet          = node->uniform_dset[1],
-      .dstBinding      = 0,
-      .dstArrayElement = 0,
-      .descriptorCount = 1,
-      .descriptorType  = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-      .pBufferInfo     = uniform_info+2,
-    },{
-      .sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-      .dstSet          = node->uniform_dset[1],
-      .dstBinding      = 1,
-      .dstArrayElement = 0,
-      .descriptorCount = 1,
-      .descriptorType  = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-      .pBufferInfo     = uniform_info+3,
-    }};
-    vkUpdateDescriptorSets(qvk.device, 4, buf_dset, 0, NULL);
+    VkDescriptorBufferInfo uniform_info[2*DT_GRAPH_MAX_RING];
+    VkWriteDescriptorSet   buf_dset[2*DT_GRAPH_MAX_RING];
+    for(int r=0;r<DT_GRAPH_MAX_RING;r++)
+    { // one uniform slot per command buffer in the ring
+      QVKR(vkAllocateDescriptorSets(qvk.device, &dset_info_u, node->uniform_dset+r));
+      uniform_info[2*r+0] = (VkDescriptorBufferInfo) {
+        .buffer      = graph->uniform_buffer,
+        .offset      = r * (uint64_t)graph->uniform_size,
+        .range       = graph->uniform_global_size,
+      };
+      uniform_info[2*r+1] = (VkDescriptorBufferInfo) {
+        .buffer      = graph->uniform_buffer,
+        .offset      = r * (uint64_t)graph->uniform_size + (node->module->uniform_size ? node->module->uniform_offset : 0),
+        .range       = node->module->uniform_size ? node->module->uniform_size : graph->uniform_global_size,
+      };
+      for(int b=0;b<2;b++) buf_dset[2*r+b] = (VkWriteDescriptorSet) {
+        .sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet          = node->uniform_dset[r],
+        .dstBinding      = b,
+        .dstArrayElement = 0,
+        .descriptorCount = 1,
+        .descriptorType  = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+        .pBufferInfo     = uniform_info+2*r+b,
+      };
+    }
+    vkUpdateDescriptorSets(qvk.device, 2*DT_GRAPH_MAX_RING, buf_dset, 0, NULL);
   }
 
   for(int i=0;i<node->num_connectors;i++)
@@ -1322,6 +1720,7 @@ alloc_outputs3(dt_graph_t *graph, dt_node_t *node)
   { // bind staging memory:
     dt_connector_t *c = node->connector+i;
     if(dt_connector_ssbo(c)) continue; // ssbo need no staging memory
+    if(c->mem_external) continue; // bound to the imported dma-buf already
     if(c->type == dt_token("source") || c->type == dt_token("sink"))
       vkBindBufferMemory(qvk.device, c->staging, graph->vkmem_staging, c->offset_staging);
   }
@@ -1432,7 +1831,7 @@ modify_roi_out(dt_graph_t *graph, dt_module_t *module)
   for(int i=0;i<module->num_connectors;i++)
   { // the default main input is wherever "main" came in,
     // but preferrably named "input"
-    if(!dt_connector_input(module->connector+i)) continue;
+    if(!dt_connector_input(module->connector+i) || (module->connector[i].flags & s_conn_bind)) continue;
     int mid = module->connector[i].connected_mi;
     if(mid < 0) continue;
     if(graph->module[mid].img_param.input_name == dt_token("main"))
@@ -1455,7 +1854,7 @@ modify_roi_out(dt_graph_t *graph, dt_module_t *module)
     if(dt_connector_input(c) && c->connected_mi >= 0 && c->connected_mc >= 0)
       c->roi = graph->module[c->connected_mi].connector[c->connected_mc].roi;
   }
-  if(!module->disabled && module->so->modify_roi_out)
+  if(!dt_module_bypassed(module) && module->so->modify_roi_out)
   {
     module->so->modify_roi_out(graph, module);
     // mark roi in of all outputs as uninitialised:
@@ -1522,7 +1921,7 @@ modify_roi_out(dt_graph_t *graph, dt_module_t *module)
 static void
 modify_roi_in(dt_graph_t *graph, dt_module_t *module)
 {
-  if(!module->disabled && module->so->modify_roi_in)
+  if(!dt_module_bypassed(module) && module->so->modify_roi_in)
   {
     module->so->modify_roi_in(graph, module);
   }
@@ -1541,7 +1940,14 @@ modify_roi_in(dt_graph_t *graph, dt_module_t *module)
       { // scale to fit into requested roi
         float scalex = graph->output_wd > 0 ? r->full_wd / (float) graph->output_wd : 1.0f;
         float scaley = graph->output_ht > 0 ? r->full_ht / (float) graph->output_ht : 1.0f;
-        r->scale = MAX(scalex, scaley);
+        r->scale = MAX(scalex, scaley) * MAX(1, graph->lod_scale);
+      }
+      else for(int b=0;b<graph->output_bound_cnt;b++) if(module->inst == graph->output_bound[b].inst)
+      { // other sinks only shrink, through the resize module in front of them
+        const dt_graph_output_bound_t *ob = graph->output_bound + b;
+        float scalex = ob->wd > 0 ? r->full_wd / (float) ob->wd : 1.0f;
+        float scaley = ob->ht > 0 ? r->full_ht / (float) ob->ht : 1.0f;
+        r->scale = MAX(1.0f, MAX(scalex, scaley));
       }
       r->wd = r->full_wd/r->scale;
       r->ht = r->full_ht/r->scale;
@@ -1572,8 +1978,10 @@ modify_roi_in(dt_graph_t *graph, dt_module_t *module)
       if(c->connected_mi >= 0 && c->connected_mc >= 0)
       {
         dt_roi_t *roi = &graph->module[c->connected_mi].connector[c->connected_mc].roi;
-        if(graph->module[c->connected_mi].connector[c->connected_mc].type == dt_token("source"))
-        { // sources don't negotiate their size, they just give what they have
+        if(graph->module[c->connected_mi].connector[c->connected_mc].type == dt_token("source") ||
+           (c->flags & s_conn_bind))
+        { // sources don't negotiate their size, they just give what they have.
+          // neither do the buffers parameters are bound to, we read a few words.
           roi->wd = roi->full_wd;
           roi->ht = roi->full_ht;
           if(roi->scale <= 0) roi->scale = 1.0; // mark as initialised, we force the resolution now
@@ -1588,7 +1996,7 @@ modify_roi_in(dt_graph_t *graph, dt_module_t *module)
         else
           *roi = c->roi;
         // propagate flags:
-        graph->module[c->connected_mi].connector[c->connected_mc].flags |= c->flags;
+        graph->module[c->connected_mi].connector[c->connected_mc].flags |= c->flags & ~s_conn_bind;
         // make sure we use the same array size as the data source. this is when the array_length depends on roi_out
         c->array_length = graph->module[c->connected_mi].connector[c->connected_mc].array_length;
       }
@@ -1602,186 +2010,298 @@ void dt_token_print(dt_token_t t)
   fprintf(stderr, "token: %"PRItkn"\n", dt_token_str(t));
 }
 
-static VkResult
-record_command_buffer(dt_graph_t *graph, dt_node_t *node, int runflag)
+// find the region of the outputs of this node which changed in an incremental run.
+// nodes can opt in by declaring their support and by keeping their outputs in
+// protected memory, so the pixels outside the region are still valid. the rect
+// is the union of the dirty regions of the inputs, expanded by the support.
+static void
+dirty_region(dt_graph_t *graph, dt_node_t *node, int incremental, int active_module)
 {
-  VkCommandBuffer cmd_buf = graph->command_buffer[graph->frame % 2];
-
-  // sanity check: are all input connectors bound?
+  int32_t *d = node->dirty_rect;
+  d[0] = d[1] = 0; d[2] = node->wd; d[3] = node->ht; // everything, the default
+  if(!incremental || !node->dirty_support || node->type == s_node_graphics ||
+      node->module - graph->module == active_module) return;
+  int32_t r[4] = { node->wd, node->ht, 0, 0 }; // bounding box x0 y0 x1 y1
   for(int i=0;i<node->num_connectors;i++)
-    if(dt_connector_input(node->connector+i))
-      if(node->connector[i].connected_mi == -1)
+  {
+    dt_connector_t *c = node->connector+i;
+    if(c->roi.wd != node->wd || c->roi.ht != node->ht || c->array_length > 1 || dt_connector_ssbo(c)) return;
+    if(dt_connector_output(c))
+    { // previous content needs to be there
+      if(!(c->flags & s_conn_protected) || (c->flags & (s_conn_feedback | s_conn_clear)) || c->frames > 1 ||
+         dt_graph_connector_image(graph, node-graph->node, i, 0, graph->frame)->layout == VK_IMAGE_LAYOUT_UNDEFINED)
+        return;
+      continue;
+    }
+    if(c->connected_mi < 0) return;
+    const int32_t *di = graph->node[c->connected_mi].dirty_rect;
+    if(di[2] <= 0 || di[3] <= 0) continue; // input unchanged
+    r[0] = MIN(r[0], di[0]);       r[1] = MIN(r[1], di[1]);
+    r[2] = MAX(r[2], di[0]+di[2]); r[3] = MAX(r[3], di[1]+di[3]);
+  }
+  const int32_t s = node->dirty_support - 1;
+  r[0] = MAX(r[0]-s, 0);        r[1] = MAX(r[1]-s, 0);
+  r[2] = MIN(r[2]+s, node->wd); r[3] = MIN(r[3]+s, node->ht);
+  d[0] = r[0]; d[1] = r[1];
+  d[2] = MAX(0, r[2]-r[0]); d[3] = MAX(0, r[3]-r[1]);
+}
+
+// find the region of the outputs of every node which is read downstream, going
+// through the nodes in reverse order of execution. nodes which support dirty
+// regions read a neighbourhood of their own region of every input, clipped to
+// the read_rect of the input if there is one. everybody else needs all of
+// their inputs, and nodes nobody reads from in this run need all of their
+// outputs (the gui may display them).
+static void
+need_region(dt_graph_t *graph, const uint32_t *nodeid, int cnt)
+{
+  for(int i=0;i<cnt;i++) graph->node[nodeid[i]].need_rect[2] = -1; // nobody asked yet
+  for(int i=cnt-1;i>=0;i--)
+  {
+    dt_node_t *node = graph->node + nodeid[i];
+    int32_t *d = node->need_rect;
+    if(d[2] < 0) d[0] = d[1] = 0, d[2] = node->wd, d[3] = node->ht;
+    const int32_t s = node->dirty_support - 1;
+    for(int c=0;c<node->num_connectors;c++)
+    {
+      dt_connector_t *cn = node->connector+c;
+      if(!dt_connector_input(cn) || cn->connected_mi < 0) continue;
+      dt_node_t *up = graph->node + cn->connected_mi;
+      int32_t r[4] = { 0, 0, up->wd, up->ht }; // x0 y0 x1 y1, all of it by default
+      if(node->dirty_support && node->type == s_node_compute && !dt_node_sink(node) &&
+         cn->roi.wd == node->wd && cn->roi.ht == node->ht && cn->array_length <= 1 &&
+        !dt_connector_ssbo(cn) && !(cn->flags & s_conn_feedback))
       {
-        dt_log(s_log_err, "input %"PRItkn":%"PRItkn" not connected!",
-            dt_token_str(node->name), dt_token_str(node->connector[i].name));
-        return VK_INCOMPLETE;
+        r[0] = MAX(d[0]-s, 0);           r[1] = MAX(d[1]-s, 0);
+        r[2] = MIN(d[0]+d[2]+s, up->wd); r[3] = MIN(d[1]+d[3]+s, up->ht);
+        if(cn->read_rect[2] > 0)
+        {
+          r[0] = MAX(r[0], cn->read_rect[0]);
+          r[1] = MAX(r[1], cn->read_rect[1]);
+          r[2] = MIN(r[2], cn->read_rect[0] + cn->read_rect[2]);
+          r[3] = MIN(r[3], cn->read_rect[1] + cn->read_rect[3]);
+        }
+        r[2] = MAX(r[2], r[0]); r[3] = MAX(r[3], r[1]);
       }
+      int32_t *u = up->need_rect;
+      if(u[2] >= 0)
+      { // union with what the other nodes downstream need
+        r[0] = MIN(r[0], u[0]);      r[1] = MIN(r[1], u[1]);
+        r[2] = MAX(r[2], u[0]+u[2]); r[3] = MAX(r[3], u[1]+u[3]);
+      }
+      u[0] = r[0]; u[1] = r[1]; u[2] = r[2]-r[0]; u[3] = r[3]-r[1];
+    }
+  }
+}
+
+// restrict the region written by the node to what is read downstream, if it
+// writes its outputs pixel by pixel (declared by dirty_support).
+static void
+need_clip(dt_node_t *node)
+{
+  const int32_t *n = node->need_rect;
+  int32_t *d = node->dirty_rect;
+  if(!node->dirty_support || node->type != s_node_compute || dt_node_sink(node) || dt_node_source(node)) return;
+  if(n[2] >= (int32_t)node->wd && n[3] >= (int32_t)node->ht) return;
+  for(int i=0;i<node->num_connectors;i++)
+  {
+    dt_connector_t *c = node->connector+i;
+    if(dt_connector_output(c) && (c->roi.wd != node->wd || c->roi.ht != node->ht ||
+       c->array_length > 1 || dt_connector_ssbo(c) || (c->flags & (s_conn_feedback | s_conn_protected))))
+      return; // protected memory would keep stale pixels for the next incremental run
+  }
+  if(d[2] <= 0 || d[3] <= 0) return; // everything, see record_command_buffer()
+  const int32_t x0 = MAX(d[0], n[0]), y0 = MAX(d[1], n[1]);
+  const int32_t x1 = MIN(d[0]+d[2], n[0]+n[2]), y1 = MIN(d[1]+d[3], n[1]+n[3]);
+  if(x1 <= x0 || y1 <= y0) return; // keep it simple, nothing to be gained for empty regions
+  d[0] = x0; d[1] = y0; d[2] = x1-x0; d[3] = y1-y0;
+}
+
+// the phases of recording a node. all nodes of a level go through one phase
+// before the next starts, with barriers in between, see graph-barrier.h.
+typedef enum dt_record_phase_t
+{
+  s_record_layout = 0, // queue layout transitions
+  s_record_clear  = 1, // clear outputs which ask for it
+  s_record_work   = 2, // uploads, downloads, dispatch or draw
+}
+dt_record_phase_t;
+
+#define IMG_LAYOUT_QUEUE(img, nli) dt_graph_barrier_image(graph, img, VK_IMAGE_LAYOUT_ ## nli)
 
-  // runflag will be 1 if we ask to upload source explicitly (the first time around)
-  if((runflag == 0) && dt_node_source(node))
+static VkResult
+record_command_buffer(
+    dt_graph_t       *graph,
+    dt_node_t        *node,
+    int               runflag,
+    dt_record_phase_t phase,
+    VkCommandBuffer   cmd_buf)
+{
+  const int nid = node - graph->node;
+  const int f = graph->frame % 2;
+  const int r = graph->ring_slot;
+
+  if(phase == s_record_layout)
+  { // sanity check: are all input connectors bound?
+    for(int i=0;i<node->num_connectors;i++)
+      if(dt_connector_input(node->connector+i))
+        if(node->connector[i].connected_mi == -1)
+        {
+          dt_log(s_log_err, "input %"PRItkn":%"PRItkn" not connected!",
+              dt_token_str(node->name), dt_token_str(node->connector[i].name));
+          return VK_INCOMPLETE;
+        }
+  }
+
+  // runflag will be 1 if we ask to upload source explicitly (the first time around).
+  // it will also be 0 for nodes upstream of the active module, if their outputs are still resident.
+  if(runflag == 0)
   {
+    if(phase != s_record_layout) return VK_SUCCESS;
     for(int i=0;i<node->num_connectors;i++)
     { // this is completely retarded and just to make the layout match what we expect below
       if(!dt_connector_ssbo(node->connector+i) &&
           dt_connector_output(node->connector+i) &&
-         !(node->connector[i].flags & s_conn_dynamic_array))
+         !(node->connector[i].flags & s_conn_dynamic_array) &&
+         (dt_node_source(node) || (node->connector[i].flags & s_conn_cached)))
       {
         if(node->type == s_node_graphics)
-          IMG_LAYOUT(
-              dt_graph_connector_image(graph, node-graph->node, i, 0, graph->frame),
-              SHADER_READ_ONLY_OPTIMAL,
-              COLOR_ATTACHMENT_OPTIMAL);
+          IMG_LAYOUT_QUEUE(dt_graph_connector_image(graph, nid, i, 0, graph->frame), COLOR_ATTACHMENT_OPTIMAL);
         else for(int k=0;k<MAX(node->connector[i].array_length,1);k++)
-          IMG_LAYOUT(
-              dt_graph_connector_image(graph, node-graph->node, i, k, graph->frame),
-              SHADER_READ_ONLY_OPTIMAL,
-              GENERAL);
+          IMG_LAYOUT_QUEUE(dt_graph_connector_image(graph, nid, i, k, graph->frame), GENERAL);
       }
     }
     return VK_SUCCESS;
   }
-  // TODO: extend the runflag to only switch on modules *after* cached input/changed parameters
 
-  // special case for end of pipeline and thumbnail creation:
-  if(graph->thumbnail_image &&
-      node->name         == dt_token("thumb") &&
-      node->module->inst == dt_token("main"))
-  {
-    VkImageCopy cp = {
-      .srcSubresource = {
-        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-        .mipLevel = 0,
-        .baseArrayLayer = 0,
-        .layerCount = 1,
-      },
-      .srcOffset = {0},
-      .dstSubresource = {
-        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-        .mipLevel = 0,
-        .baseArrayLayer = 0,
-        .layerCount = 1,
-      },
-      .dstOffset = {0},
-      .extent = {
-        .width  = node->connector[0].roi.wd,
-        .height = node->connector[0].roi.ht,
-        .depth  = 1,
-      },
-    };
-    dt_connector_image_t *img = dt_graph_connector_image(graph,
-        node-graph->node, 0, 0, 0);
-    IMG_LAYOUT(img, UNDEFINED, TRANSFER_SRC_OPTIMAL);
-    BARRIER_IMG_LAYOUT(graph->thumbnail_image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-    vkCmdCopyImage(cmd_buf,
-        img->image,
-        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-        graph->thumbnail_image,
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-        1,
-        &cp);
-    BARRIER_IMG_LAYOUT(graph->thumbnail_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-    return VK_SUCCESS;
-  }
+  const int sink   = dt_node_sink(node) && node->module->so->write_sink;
+  const int source = !sink && dt_node_source(node) &&
+         !dt_connector_ssbo(node->connector+0) && // ssbo source nodes use staging memory and thus don't need a copy.
+         (node->connector[0].array_length <= 1);  // arrays share the staging buffer, are handled by iterating read_source()
+  dt_graph_srccache_t *sc = source && node->srccache ? graph->srccache + node->srccache - 1 : 0;
 
-  // barriers and image layout transformations:
-  // wait for our input images and transfer them to read only.
-  // also wait for our output buffers to be transferred into general layout.
-  // output is moved from UNDEFINED in the hope that the content can be discarded for
-  // increased efficiency in this case.
-  for(int i=0;i<node->num_connectors;i++)
+  if(phase == s_record_layout)
   {
-    // ssbo are not depending on image layouts and are also not cleared to zero:
-    if(dt_connector_ssbo(node->connector+i))
-    { // input buffers have a barrier
+    // raster kernels drawing into protected memory only add the vertices from draw_beg on,
+    // unless the image is fresh (undefined layout) and needs to be drawn from scratch.
+    uint32_t draw_beg = node->type == s_node_graphics ? node->draw_beg : 0;
+    for(int i=0;i<node->num_connectors && draw_beg;i++)
+      if(dt_connector_output(node->connector+i) && (!(node->connector[i].flags & s_conn_protected) ||
+          dt_graph_connector_image(graph, nid, i, 0, graph->frame)->layout == VK_IMAGE_LAYOUT_UNDEFINED))
+        draw_beg = 0;
+    node->draw_beg_rec = draw_beg;
+    if(node->type == s_node_graphics)
+    { // report what we draw to the nodes downstream
+      if(draw_beg) memcpy(node->dirty_rect, node->draw_area, sizeof(node->dirty_rect));
+      if(!draw_beg || node->draw_area[2] <= 0 || node->draw_area[3] <= 0)
+        node->dirty_rect[0] = node->dirty_rect[1] = 0, node->dirty_rect[2] = node->wd, node->dirty_rect[3] = node->ht;
+    }
+
+    // image layout transformations: inputs go to read only, outputs to general
+    // (or a transfer destination if they are cleared first). the barrier in
+    // front of the level waits for everything written before, storage buffers
+    // don't depend on layouts. outputs are moved from UNDEFINED in the hope that
+    // the content can be discarded for increased efficiency in this case.
+    for(int i=0;i<node->num_connectors;i++)
+    {
+      if(dt_connector_ssbo(node->connector+i)) continue;
       if(dt_connector_input(node->connector+i))
-        BARRIER_COMPUTE_BUFFER(
-              dt_graph_connector_image(graph, node-graph->node, i, 0,
-                (node->connector[i].flags & s_conn_feedback) ?
-                1-(graph->frame & 1) :
-                graph->frame)->buffer);
-      if(dt_connector_output(node->connector+i) && (node->connector[i].flags & s_conn_clear))
       {
-        VkBuffer buf = dt_graph_connector_image(graph, node-graph->node, i, 0,
-                (node->connector[i].flags & s_conn_feedback) ?
-                1-(graph->frame & 1) :
-                graph->frame)->buffer;
-        vkCmdFillBuffer(cmd_buf, buf, 0, VK_WHOLE_SIZE, 0);
-        BARRIER_COMPUTE_BUFFER(buf);
+        // this needs to prepare the frame we're actually reading.
+        // for feedback connections, this is crossed over.
+        if(!((node->connector[i].type == dt_token("sink")) && node->module->so->write_sink))
+        {
+          if(!(node->connector[i].flags & s_conn_dynamic_array))
+            for(int k=0;k<MAX(1,node->connector[i].array_length);k++)
+              IMG_LAYOUT_QUEUE(
+                dt_graph_connector_image(graph, nid, i, k,
+                  (node->connector[i].flags & s_conn_feedback) ?
+                  1-(graph->frame & 1) :
+                  graph->frame),
+                SHADER_READ_ONLY_OPTIMAL);
+        }
+        else
+          IMG_LAYOUT_QUEUE(dt_graph_connector_image(graph, nid, i, 0, graph->frame), TRANSFER_SRC_OPTIMAL);
+      }
+      else if(dt_connector_output(node->connector+i))
+      {
+        if(node->connector[i].flags & s_conn_clear)
+          IMG_LAYOUT_QUEUE(dt_graph_connector_image(graph, nid, i, 0, graph->frame), TRANSFER_DST_OPTIMAL);
+        else if(source && i == 0)
+          IMG_LAYOUT_QUEUE(dt_graph_connector_image(graph, nid, i, 0, graph->frame), TRANSFER_DST_OPTIMAL);
+        else if(node->type == s_node_graphics)
+          IMG_LAYOUT_QUEUE(dt_graph_connector_image(graph, nid, i, 0, graph->frame), COLOR_ATTACHMENT_OPTIMAL);
+        else if(!(node->connector[i].flags & s_conn_dynamic_array)) for(int k=0;k<MAX(node->connector[i].array_length,1);k++)
+          IMG_LAYOUT_QUEUE(dt_graph_connector_image(graph, nid, i, k, graph->frame), GENERAL);
       }
-      continue;
     }
-    if(dt_connector_input(node->connector+i))
+    if(sc && sc->valid) IMG_LAYOUT_QUEUE((&sc->img), TRANSFER_SRC_OPTIMAL);
+    else if(sc)         IMG_LAYOUT_QUEUE((&sc->img), TRANSFER_DST_OPTIMAL);
+    return VK_SUCCESS;
+  }
+
+  if(phase == s_record_clear)
+  { // in case clearing is requested, zero out the outputs
+    for(int i=0;i<node->num_connectors;i++)
     {
-      // this needs to prepare the frame we're actually reading.
-      // for feedback connections, this is crossed over.
-      if(!((node->connector[i].type == dt_token("sink")) && node->module->so->write_sink))
+      if(!dt_connector_output(node->connector+i) || !(node->connector[i].flags & s_conn_clear)) continue;
+      if(dt_connector_ssbo(node->connector+i))
       {
-        if(!(node->connector[i].flags & s_conn_dynamic_array))
-          for(int k=0;k<MAX(1,node->connector[i].array_length);k++)
-            IMG_LAYOUT(
-              dt_graph_connector_image(graph, node-graph->node, i, k,
+        VkBuffer buf = dt_graph_connector_image(graph, nid, i, 0,
                 (node->connector[i].flags & s_conn_feedback) ?
                 1-(graph->frame & 1) :
-                graph->frame),
-              GENERAL,
-              SHADER_READ_ONLY_OPTIMAL);
+                graph->frame)->buffer;
+        vkCmdFillBuffer(cmd_buf, buf, 0, VK_WHOLE_SIZE, 0);
+        graph->barrier_mem = 1;
+        continue;
       }
-      else
-        IMG_LAYOUT(
-            dt_graph_connector_image(graph, node-graph->node, i, 0, graph->frame),
-            GENERAL,
-            TRANSFER_SRC_OPTIMAL);
+      VkClearColorValue col = {{0}};
+      VkImageSubresourceRange range = {
+        .aspectMask      = VK_IMAGE_ASPECT_COLOR_BIT,
+        .baseMipLevel    = 0,
+        .levelCount      = 1,
+        .baseArrayLayer  = 0,
+        .layerCount      = 1
+      };
+      vkCmdClearColorImage(
+          cmd_buf,
+          dt_graph_connector_image(graph, nid, i, 0, graph->frame)->image,
+          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+          &col,
+          1,
+          &range);
+      if(node->type == s_node_graphics)
+        IMG_LAYOUT_QUEUE(dt_graph_connector_image(graph, nid, i, 0, graph->frame), COLOR_ATTACHMENT_OPTIMAL);
+      else for(int k=0;k<MAX(node->connector[i].array_length,1);k++)
+        IMG_LAYOUT_QUEUE(dt_graph_connector_image(graph, nid, i, k, graph->frame), GENERAL);
     }
-    else if(dt_connector_output(node->connector+i))
+    // copy parameters bound to storage buffers over the uniforms of this ring slot.
+    // every node of the module does it, so it happens before the first one runs.
+    const dt_module_t *mod = node->module;
+    for(int i=0;i<node->num_connectors && mod->bind_cnt;i++)
     {
-      // wait for layout transition on the output back to general:
-      if(node->connector[i].flags & s_conn_clear)
+      if(!(node->connector[i].flags & s_conn_bind) || !dt_connector_input(node->connector+i)) continue;
+      for(int b=0;b<mod->bind_cnt;b++)
       {
-        IMG_LAYOUT(
-            dt_graph_connector_image(graph, node-graph->node, i, 0, graph->frame),
-            UNDEFINED,//SHADER_READ_ONLY_OPTIMAL,
-            TRANSFER_DST_OPTIMAL);
-        // in case clearing is requested, zero out the image:
-        VkClearColorValue col = {{0}};
-        VkImageSubresourceRange range = {
-          .aspectMask      = VK_IMAGE_ASPECT_COLOR_BIT,
-          .baseMipLevel    = 0,
-          .levelCount      = 1,
-          .baseArrayLayer  = 0,
-          .layerCount      = 1
+        const dt_ui_param_t *p = mod->so->param[mod->bind[b].parid];
+        if(p->name != node->connector[i].name) continue;
+        const dt_connector_image_t *img = dt_graph_connector_image(graph, nid, i, 0, graph->frame);
+        const VkBufferCopy region = {
+          .srcOffset = sizeof(uint32_t) * (uint64_t)mod->bind[b].word,
+          .dstOffset = r * (uint64_t)graph->uniform_size + mod->uniform_offset + p->offset,
+          .size      = dt_ui_param_size(p->type, p->cnt),
         };
-        vkCmdClearColorImage(
-            cmd_buf,
-            dt_graph_connector_image(graph, node-graph->node, i, 0, graph->frame)->image,
-            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            &col,
-            1,
-            &range);
-        if(node->type == s_node_graphics)
-          IMG_LAYOUT(
-              dt_graph_connector_image(graph, node-graph->node, i, 0, graph->frame),
-              TRANSFER_DST_OPTIMAL,
-              COLOR_ATTACHMENT_OPTIMAL);
-        else for(int k=0;k<MAX(node->connector[i].array_length,1);k++)
-          IMG_LAYOUT(
-              dt_graph_connector_image(graph, node-graph->node, i, k, graph->frame),
-              TRANSFER_DST_OPTIMAL,
-              GENERAL);
-      }
-      else
-      {
-        if(node->type == s_node_graphics)
-          IMG_LAYOUT(
-              dt_graph_connector_image(graph, node-graph->node, i, 0, graph->frame),
-              UNDEFINED,//SHADER_READ_ONLY_OPTIMAL,
-              COLOR_ATTACHMENT_OPTIMAL);
-        else if(!(node->connector[i].flags & s_conn_dynamic_array)) for(int k=0;k<MAX(node->connector[i].array_length,1);k++)
-          IMG_LAYOUT(
-              dt_graph_connector_image(graph, node-graph->node, i, k, graph->frame),
-              UNDEFINED,//SHADER_READ_ONLY_OPTIMAL,
-              GENERAL);
+        if(!img || !img->buffer || region.srcOffset + region.size > img->size)
+        {
+          dt_log(s_log_err, "bound parameter %"PRItkn" of %"PRItkn" %"PRItkn" is out of the buffer!",
+              dt_token_str(p->name), dt_token_str(mod->name), dt_token_str(mod->inst));
+          continue;
+        }
+        vkCmdCopyBuffer(cmd_buf, img->buffer, graph->uniform_buffer, 1, &region);
+        graph->barrier_mem = 1;
       }
     }
+    return VK_SUCCESS;
   }
 
   const uint32_t wd = node->connector[0].roi.wd;
@@ -1795,14 +2315,13 @@ record_command_buffer(dt_graph_t *graph, dt_node_t *node, int runflag)
     .imageSubresource.layerCount = 1,
     .imageExtent = { wd, ht, 1 },
   },{
-    .bufferOffset = dt_graph_connector_image(graph, node-graph->node, 0, 0, graph->frame)->plane1_offset,
+    .bufferOffset = dt_graph_connector_image(graph, nid, 0, 0, graph->frame)->plane1_offset,
     .imageSubresource.aspectMask = VK_IMAGE_ASPECT_PLANE_1_BIT,
     .imageSubresource.layerCount = 1,
     .imageExtent = { wd / 2, ht / 2, 1 },
   }};
-  const int f = graph->frame % 2;
   const int yuv = node->connector[0].format == dt_token("yuv");
-  if(dt_node_sink(node) && node->module->so->write_sink)
+  if(sink)
   { // only schedule copy back if the node actually asks for it
     if(dt_connector_ssbo(node->connector+0))
     {
@@ -1811,48 +2330,79 @@ record_command_buffer(dt_graph_t *graph, dt_node_t *node, int runflag)
     }
     else
     {
+      const int deferred = node->connector[0].flags & s_conn_deferred;
+      for(int k=0;k<3;k++) regions[k].bufferOffset += (deferred ? r : f) * node->connector[0].stride_staging;
+      if(deferred) graph->deferred_mask |= 1u<<r;
       vkCmdCopyImageToBuffer(
           cmd_buf,
-          dt_graph_connector_image(graph, node-graph->node, 0, 0, graph->frame)->image,
+          dt_graph_connector_image(graph, nid, 0, 0, graph->frame)->image,
           VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
           node->connector[0].staging,
           yuv ? 2 : 1, yuv ? regions+1 : regions);
-      BARRIER_COMPUTE_BUFFER(node->connector[0].staging);
+      graph->barrier_mem = 1;
     }
   }
-  else if(dt_node_source(node) &&
-         !dt_connector_ssbo(node->connector+0) && // ssbo source nodes use staging memory and thus don't need a copy.
-         (node->connector[0].array_length <= 1))  // arrays share the staging buffer, are handled by iterating read_source()
+  else if(source)
   {
+    for(int k=0;k<3;k++) regions[k].bufferOffset += f * node->connector[0].stride_staging;
+    if(node->connector[0].staging_row_length && !yuv)
+    { // pitched source data
+      regions[0].bufferRowLength = node->connector[0].staging_row_length;
+      regions[0].bufferOffset   += dt_connector_bufsize(node->connector, node->connector[0].staging_skip, 1);
+    }
     // push profiler start
-    if(graph->query[f].cnt < graph->query[f].max)
+    if(graph->query[r].cnt < graph->query[r].max)
     {
       vkCmdWriteTimestamp(cmd_buf, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-          graph->query[f].pool, graph->query[f].cnt);
-      graph->query[f].name  [graph->query[f].cnt  ] = node->name;
-      graph->query[f].kernel[graph->query[f].cnt++] = node->kernel;
-    }
-    IMG_LAYOUT(
-        dt_graph_connector_image(graph, node-graph->node, 0, 0, graph->frame),
-        UNDEFINED,
-        TRANSFER_DST_OPTIMAL);
-    vkCmdCopyBufferToImage(
-        cmd_buf,
-        node->connector[0].staging,
-        dt_graph_connector_image(graph, node-graph->node, 0, 0, graph->frame)->image,
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-        yuv ? 2 : 1, yuv ? regions+1 : regions);
-    IMG_LAYOUT(
-        dt_graph_connector_image(graph, node-graph->node, 0, 0, graph->frame),
-        TRANSFER_DST_OPTIMAL,
-        SHADER_READ_ONLY_OPTIMAL);
+          graph->query[r].pool, graph->query[r].cnt);
+      graph->query[r].nid   [graph->query[r].cnt  ] = nid;
+      graph->query[r].name  [graph->query[r].cnt  ] = node->name;
+      graph->query[r].kernel[graph->query[r].cnt++] = node->kernel;
+    }
+    if(sc && sc->valid)
+    { // read_source() has been skipped, copy the device resident data
+      VkImageCopy region = {
+        .srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },
+        .dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },
+        .extent         = { wd, ht, 1 },
+      };
+      vkCmdCopyImage(
+          cmd_buf,
+          sc->img.image,
+          VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+          dt_graph_connector_image(graph, nid, 0, 0, graph->frame)->image,
+          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+          1, &region);
+    }
+    else
+    {
+      vkCmdCopyBufferToImage(
+          cmd_buf,
+          node->connector[0].staging,
+          dt_graph_connector_image(graph, nid, 0, 0, graph->frame)->image,
+          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+          yuv ? 2 : 1, yuv ? regions+1 : regions);
+      if(sc)
+      { // keep a device copy for the next upload
+        vkCmdCopyBufferToImage(
+            cmd_buf,
+            node->connector[0].staging,
+            sc->img.image,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            1, regions);
+        sc->valid = 1;
+      }
+    }
+    // made readable by the barrier in front of the next level
+    IMG_LAYOUT_QUEUE(dt_graph_connector_image(graph, nid, 0, 0, graph->frame), SHADER_READ_ONLY_OPTIMAL);
     // get a profiler timestamp:
-    if(graph->query[f].cnt < graph->query[f].max)
+    if(graph->query[r].cnt < graph->query[r].max)
     {
       vkCmdWriteTimestamp(cmd_buf, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-          graph->query[f].pool, graph->query[f].cnt);
-      graph->query[f].name  [graph->query[f].cnt  ] = node->name;
-      graph->query[f].kernel[graph->query[f].cnt++] = node->kernel;
+          graph->query[r].pool, graph->query[r].cnt);
+      graph->query[r].nid   [graph->query[r].cnt  ] = nid;
+      graph->query[r].name  [graph->query[r].cnt  ] = node->name;
+      graph->query[r].kernel[graph->query[r].cnt++] = node->kernel;
     }
   }
 
@@ -1860,13 +2410,17 @@ record_command_buffer(dt_graph_t *graph, dt_node_t *node, int runflag)
   if(!node->pipeline) return VK_SUCCESS;
 
   // push profiler start
-  if(graph->query[f].cnt < graph->query[f].max)
+  const uint32_t query_beg = graph->query[r].cnt;
+  if(graph->query[r].cnt < graph->query[r].max)
   {
     vkCmdWriteTimestamp(cmd_buf, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-        graph->query[f].pool, graph->query[f].cnt);
-    graph->query[f].name  [graph->query[f].cnt  ] = node->name;
-    graph->query[f].kernel[graph->query[f].cnt++] = node->kernel;
+        graph->query[r].pool, graph->query[r].cnt);
+    graph->query[r].nid   [graph->query[r].cnt  ] = nid;
+    graph->query[r].name  [graph->query[r].cnt  ] = node->name;
+    graph->query[r].kernel[graph->query[r].cnt++] = node->kernel;
   }
+  const int stats = graph->pipeline_stats && graph->query[r].stats_pool && graph->query[r].cnt > query_beg;
+  if(stats) vkCmdBeginQuery(cmd_buf, graph->query[r].stats_pool, query_beg/2, 0);
 
   // compute or graphics pipeline?
   int draw = -1;
@@ -1874,6 +2428,7 @@ record_command_buffer(dt_graph_t *graph, dt_node_t *node, int runflag)
     for(int k=0;k<node->num_connectors;k++)
       if(dt_connector_output(node->connector+k)) { draw = k; break; }
 
+  const uint32_t draw_beg = node->draw_beg_rec;
   if(draw != -1)
   {
     VkClearValue clear_color = { .color = { .float32 = { 0.0f, 0.0f, 0.0f, 1.0f } } };
@@ -1888,12 +2443,35 @@ record_command_buffer(dt_graph_t *graph, dt_node_t *node, int runflag)
       .clearValueCount   = 1,
       .pClearValues      = &clear_color
     };
+    if(draw_beg && node->draw_area[2] > 0 && node->draw_area[3] > 0)
+    {
+      render_pass_info.renderArea.offset = (VkOffset2D){ node->draw_area[0], node->draw_area[1] };
+      render_pass_info.renderArea.extent = (VkExtent2D){ node->draw_area[2], node->draw_area[3] };
+    }
     vkCmdBeginRenderPass(cmd_buf, &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
+    if(!draw_beg)
+    { // protected attachments are loaded, not cleared by the render pass
+      VkClearAttachment clear[DT_MAX_CONNECTORS];
+      uint32_t clear_cnt = 0, att = 0;
+      for(int k=0;k<node->num_connectors;k++)
+      {
+        if(!dt_connector_output(node->connector+k)) continue;
+        if(node->connector[k].flags & s_conn_protected)
+          clear[clear_cnt++] = (VkClearAttachment) {
+            .aspectMask      = VK_IMAGE_ASPECT_COLOR_BIT,
+            .colorAttachment = att,
+            .clearValue      = clear_color,
+          };
+        att++;
+      }
+      VkClearRect rect = { .rect = render_pass_info.renderArea, .baseArrayLayer = 0, .layerCount = 1 };
+      if(clear_cnt) vkCmdClearAttachments(cmd_buf, clear_cnt, clear, 1, &rect);
+    }
   }
 
   // combine all descriptor sets:
   VkDescriptorSet desc_sets[] = {
-    node->uniform_dset[f],
+    node->uniform_dset[r],
     node->dset[f],
     graph->rt[f].dset,
   };
@@ -1905,6 +2483,16 @@ record_command_buffer(dt_graph_t *graph, dt_node_t *node, int runflag)
     vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS,
       node->pipeline_layout, 0, desc_sets_cnt, desc_sets, 0, 0);
   }
+  else if(node->push_dset)
+  { // bind uniforms and raytracing, the images of set 1 are pushed
+    vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_COMPUTE, node->pipeline);
+    vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_COMPUTE,
+      node->pipeline_layout, 0, 1, desc_sets, 0, 0);
+    if(desc_sets_cnt > 2)
+      vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_COMPUTE,
+        node->pipeline_layout, 2, 1, desc_sets+2, 0, 0);
+    push_descriptor_sets(graph, node, cmd_buf);
+  }
   else
   {
     vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_COMPUTE, node->pipeline);
@@ -1913,15 +2501,34 @@ record_command_buffer(dt_graph_t *graph, dt_node_t *node, int runflag)
   }
 
   // update some buffers:
+  if(node->name == dt_token("shared") && node->kernel == dt_token("fuse"))
+    dt_graph_fuse_push(graph, node);
+  if(node->name == dt_token("shared") && node->kernel == dt_token("warp"))
+    dt_graph_warp_push(graph, node);
   if(node->push_constant_size)
     vkCmdPushConstants(cmd_buf, node->pipeline_layout,
         VK_SHADER_STAGE_ALL, 0, node->push_constant_size, node->push_constant);
 
-  if(draw == -1)
+  if(draw == -1 && node->dispatch_indirect)
+  { // the work group count has been written by a node upstream
+    const dt_connector_image_t *args = dt_graph_connector_image(graph, nid, node->dispatch_indirect-1, 0, graph->frame);
+    vkCmdDispatchIndirect(cmd_buf, args->buffer, 0);
+  }
+  else if(draw == -1 && node->dirty_rect[2] > 0 && node->dirty_rect[3] > 0 &&
+    (node->dirty_rect[2] < node->wd || node->dirty_rect[3] < node->ht))
+  { // only the workgroups covering the dirty region, the other pixels are kept from last time
+    const uint32_t lx = node->local_size[0], ly = node->local_size[1];
+    const uint32_t bx = node->dirty_rect[0] / lx;
+    const uint32_t by = node->dirty_rect[1] / ly;
+    const uint32_t ex = (node->dirty_rect[0] + node->dirty_rect[2] + lx - 1) / lx;
+    const uint32_t ey = (node->dirty_rect[1] + node->dirty_rect[3] + ly - 1) / ly;
+    vkCmdDispatchBase(cmd_buf, bx, by, 0, ex-bx, ey-by, node->dp);
+  }
+  else if(draw == -1)
   {
     vkCmdDispatch(cmd_buf,
-        (node->wd + DT_LOCAL_SIZE_X - 1) / DT_LOCAL_SIZE_X,
-        (node->ht + DT_LOCAL_SIZE_Y - 1) / DT_LOCAL_SIZE_Y,
+        (node->wd + node->local_size[0] - 1) / node->local_size[0],
+        (node->ht + node->local_size[1] - 1) / node->local_size[1],
          node->dp);
   }
   else
@@ -1929,18 +2536,20 @@ record_command_buffer(dt_graph_t *graph, dt_node_t *node, int runflag)
     const int pi = dt_module_get_param(node->module->so, dt_token("draw"));
     const int32_t *p_draw = dt_module_param_int(node->module, pi);
 
-    if(p_draw[0] > 0)
-      vkCmdDraw(cmd_buf, p_draw[0], 1, 0, 0);
+    if(p_draw[0] > (int32_t)draw_beg)
+      vkCmdDraw(cmd_buf, p_draw[0] - draw_beg, 1, draw_beg, 0);
     vkCmdEndRenderPass(cmd_buf);
   }
+  if(stats) vkCmdEndQuery(cmd_buf, graph->query[r].stats_pool, query_beg/2);
 
   // get a profiler timestamp:
-  if(graph->query[f].cnt < graph->query[f].max)
+  if(graph->query[r].cnt < graph->query[r].max)
   {
     vkCmdWriteTimestamp(cmd_buf, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-        graph->query[f].pool, graph->query[f].cnt);
-    graph->query[f].name  [graph->query[f].cnt  ] = node->name;
-    graph->query[f].kernel[graph->query[f].cnt++] = node->kernel;
+        graph->query[r].pool, graph->query[r].cnt);
+    graph->query[r].nid   [graph->query[r].cnt  ] = node - graph->node;
+    graph->query[r].name  [graph->query[r].cnt  ] = node->name;
+    graph->query[r].kernel[graph->query[r].cnt++] = node->kernel;
   }
   return VK_SUCCESS;
 }
@@ -1983,7 +2592,7 @@ count_references(dt_graph_t *graph, dt_node_t *node)
 // default callback for create nodes: pretty much copy the module.
 // does no vulkan work, just graph connections. shall not fail.
 static void
-create_nodes(dt_graph_t *graph, dt_module_t *module, uint64_t *uniform_offset)
+create_nodes(dt_graph_t *graph, dt_module_t *module, uint64_t *uniform_offset, int active_module)
 {
   for(int i=0;i<module->num_connectors;i++)
     module->connector[i].bypass_mi =
@@ -1997,7 +2606,8 @@ create_nodes(dt_graph_t *graph, dt_module_t *module, uint64_t *uniform_offset)
   const int nodes_begin = graph->num_nodes;
   // TODO: if roi size/scale does not match, insert resample node!
   // TODO: where? inside create_nodes? or we fix it afterwards?
-  if(module->disabled)
+  module->bypassed = dt_module_bypassed(module);
+  if(module->bypassed)
   {
     int mc_in = -1, mc_out = -1;
     for(int i=0;i<module->num_connectors;i++)
@@ -2014,6 +2624,12 @@ create_nodes(dt_graph_t *graph, dt_module_t *module, uint64_t *uniform_offset)
   {
     module->so->create_nodes(graph, module);
   }
+  else if(dt_graph_fuse(graph, module, active_module))
+  { // appended to the fused node of the upstream module, nothing to create
+  }
+  else if(dt_graph_warp(graph, module, active_module))
+  { // the lens node upstream resamples for us, nothing to create
+  }
   else
   {
     assert(graph->num_nodes < graph->max_nodes);
@@ -2023,7 +2639,7 @@ create_nodes(dt_graph_t *graph, dt_module_t *module, uint64_t *uniform_offset)
     *node = (dt_node_t) {
       .name           = module->name,
       .kernel         = dt_token("main"), // file name
-      .num_connectors = module->num_connectors,
+      .num_connectors = module->so->num_connectors, // bound parameters come in bind_nodes()
       .module         = module,
       .flags          = module->flags,    // propagate sink/source copy requests
       // make sure we don't follow garbage pointers. pure sink or source nodes
@@ -2053,8 +2669,9 @@ create_nodes(dt_graph_t *graph, dt_module_t *module, uint64_t *uniform_offset)
       node->dp = 1;
     }
 
-    for(int i=0;i<module->num_connectors;i++)
+    for(int i=0;i<node->num_connectors;i++)
       dt_connector_copy(graph, module, i, nodeid, i);
+    if(dt_graph_fuse_op(module)) node->dirty_support = 1; // per pixel
   }
 
   module->uniform_offset = u_offset;
@@ -2083,19 +2700,709 @@ create_nodes(dt_graph_t *graph, dt_module_t *module, uint64_t *uniform_offset)
   }
 }
 
+// shared kernels which only depend on their inputs and push constants
+static inline int
+node_pure(const dt_node_t *n)
+{
+  return n->name == dt_token("shared") && (
+      n->kernel == dt_token("down")  || n->kernel == dt_token("blur")  ||
+      n->kernel == dt_token("blurs") || n->kernel == dt_token("blurh") ||
+      n->kernel == dt_token("blurv") || n->kernel == dt_token("iir")   ||
+      n->kernel == dt_token("resample"));
+}
+
+static inline int
+node_same(dt_node_t *a, dt_node_t *b)
+{
+  if(a->kernel != b->kernel || a->wd != b->wd || a->ht != b->ht || a->dp != b->dp ||
+     a->num_connectors != b->num_connectors || a->push_constant_size != b->push_constant_size ||
+     memcmp(a->push_constant, b->push_constant, a->push_constant_size))
+    return 0;
+  for(int c=0;c<a->num_connectors;c++)
+  {
+    dt_connector_t *ca = a->connector+c, *cb = b->connector+c;
+    if(ca->type != cb->type || ca->chan != cb->chan || ca->format != cb->format ||
+       ca->roi.wd != cb->roi.wd || ca->roi.ht != cb->roi.ht ||
+       ca->array_length != cb->array_length || ca->flags != cb->flags ||
+       (ca->flags & (s_conn_feedback | s_conn_dynamic_array)))
+      return 0;
+    if(dt_connector_input(cb) &&
+      (ca->connected_mi < 0 || ca->connected_mi != cb->connected_mi || ca->connected_mc != cb->connected_mc))
+      return 0;
+  }
+  return 1;
+}
+
+// merge duplicate pure nodes, so modules working on the same input share
+// their pyramids and blurs. readers of the duplicate are repointed to the first
+// node, the duplicate is left unconnected and will not be reached by traversal.
+// this runs until no more merges happen, to catch whole chains of levels.
+static void
+dedup_nodes(dt_graph_t *graph)
+{
+  int merged = 1, cnt = 0;
+  while(merged)
+  {
+    merged = 0;
+    for(int j=0;j<graph->num_nodes;j++)
+    {
+      dt_node_t *b = graph->node + j;
+      if(!node_pure(b)) continue;
+      for(int i=0;i<j;i++)
+      {
+        if(!node_pure(graph->node+i) || !node_same(graph->node+i, b)) continue;
+        for(int n=0;n<graph->num_nodes;n++) for(int c=0;c<graph->node[n].num_connectors;c++)
+          if(dt_connector_input(graph->node[n].connector+c) && graph->node[n].connector[c].connected_mi == j)
+            graph->node[n].connector[c].connected_mi = i;
+        for(int m=0;m<graph->num_modules;m++) for(int c=0;c<graph->module[m].num_connectors;c++)
+          if(graph->module[m].connector[c].associated_i == j)
+            graph->module[m].connector[c].associated_i = i;
+        b->kernel = 0; // dead, never matches again
+        merged = 1;
+        cnt++;
+        break;
+      }
+    }
+  }
+  if(cnt) dt_log(s_log_pipe, "merged %d duplicate nodes", cnt);
+}
+
+// every kernel of a module reads its parameters, so all of them read the
+// buffers parameters are bound to as well, see dt_module_bind(). this makes
+// them run after the module writing the buffer, and the copy into the uniforms
+// is recorded in front of each of them.
+static void
+bind_nodes(dt_graph_t *graph)
+{
+  for(int ni=0;ni<graph->num_nodes;ni++)
+  {
+    dt_node_t *n = graph->node + ni;
+    dt_module_t *mod = n->module;
+    if(!mod || !mod->bind_cnt || node_pure(n) || dt_node_source(n) || dt_node_sink(n)) continue;
+    for(int b=0;b<mod->bind_cnt;b++)
+    {
+      const dt_connector_t *mc = mod->connector + mod->bind[b].mc;
+      if(mc->connected_mi < 0) continue;
+      const dt_module_t *src = graph->module + mc->connected_mi;
+      if(src->bypassed || src->connector[mc->connected_mc].associated_i < 0)
+      { // no nodes write the buffer, leave the parameter as it is
+        dt_log(s_log_pipe|s_log_err, "%"PRItkn" %"PRItkn" can't bind %"PRItkn" to %"PRItkn" %"PRItkn" %"PRItkn,
+            dt_token_str(mod->name), dt_token_str(mod->inst), dt_token_str(mc->name),
+            dt_token_str(src->name), dt_token_str(src->inst), dt_token_str(src->connector[mc->connected_mc].name));
+        continue;
+      }
+      const int c = n->num_connectors;
+      if(c >= DT_MAX_CONNECTORS)
+      {
+        dt_log(s_log_pipe|s_log_err, "too many connectors to bind %"PRItkn" on node %"PRItkn" %"PRItkn,
+            dt_token_str(mc->name), dt_token_str(n->name), dt_token_str(n->kernel));
+        continue;
+      }
+      n->connector[c] = (dt_connector_t){0};
+      dt_connector_copy(graph, mod, mod->bind[b].mc, ni, c);
+      n->connector[c].frames = 1;
+      n->conn_image[c] = -1;
+      n->num_connectors++;
+    }
+  }
+}
+
+// a buffer for the memory planner. fixed blocks keep their offset and live
+// through the whole graph (feedback, sources, protected and dynamic arrays).
+typedef struct dt_plan_buf_t
+{
+  uint64_t size, alignment, offset;
+  int      t0, t1;           // first and last position in the post-ordered node list
+  dt_connector_image_t *img; // or 0 for fixed blocks
+}
+dt_plan_buf_t;
+
+static int
+compare_plan_size(const void *a, const void *b)
+{
+  const dt_plan_buf_t *ba = a, *bb = b;
+  return ba->size < bb->size ? 1 : ba->size > bb->size ? -1 : 0;
+}
+
+static int
+compare_plan_offset(const void *a, const void *b)
+{
+  const dt_plan_buf_t *ba = *(dt_plan_buf_t *const *)a, *bb = *(dt_plan_buf_t *const *)b;
+  return ba->offset < bb->offset ? -1 : ba->offset > bb->offset ? 1 : 0;
+}
+
+// compute an explicit packing of all transient images (or storage buffers) of
+// the outer heap from their lifetime intervals in the post-ordered node list.
+// this places the largest buffers first, at the lowest offset that doesn't
+// overlap anything alive at the same time. the result is only used if it beats
+// the peak memory of the greedy allocation during traversal.
+static void
+plan_memory(dt_graph_t *graph, const uint32_t *nodeid, int cnt, int ssbo)
+{
+  dt_vkalloc_t *heap = ssbo ? &graph->heap_ssbo : &graph->heap;
+  const int max_buf = graph->conn_image_end; // every buffer has at least one image
+  int *t1 = malloc(sizeof(int)*graph->conn_image_end);
+  dt_plan_buf_t  *buf  = malloc(sizeof(dt_plan_buf_t)*max_buf);
+  dt_plan_buf_t **live = malloc(sizeof(dt_plan_buf_t*)*max_buf);
+
+  // outputs live from their node to the last node reading them. sinks and
+  // feedback inputs never free their buffers during traversal.
+  for(int i=0;i<cnt;i++)
+  {
+    dt_node_t *node = graph->node + nodeid[i];
+    for(int c=0;c<node->num_connectors;c++)
+    {
+      dt_connector_t *cn = node->connector+c;
+      if(dt_connector_output(cn) && node->conn_image[c] != -1)
+        for(int k=0;k<MAX(1,cn->array_length)*cn->frames;k++)
+          t1[node->conn_image[c]+k] = i;
+    }
+  }
+  for(int i=0;i<cnt;i++)
+  {
+    dt_node_t *node = graph->node + nodeid[i];
+    for(int c=0;c<node->num_connectors;c++)
+    {
+      dt_connector_t *cn = node->connector+c;
+      if(!dt_connector_input(cn) || cn->connected_mi < 0) continue;
+      dt_node_t *up = graph->node + cn->connected_mi;
+      dt_connector_t *out = up->connector + cn->connected_mc;
+      if(up->conn_image[cn->connected_mc] == -1) continue;
+      const int forever = cn->type == dt_token("sink") || (cn->flags & s_conn_feedback);
+      for(int k=0;k<MAX(1,out->array_length)*out->frames;k++)
+      {
+        int *t = t1 + up->conn_image[cn->connected_mc] + k;
+        *t = forever ? INT32_MAX : MAX(*t, i);
+      }
+    }
+  }
+
+  int num_buf = 0, num_fixed = 0;
+  for(int fixed=1;fixed>=0;fixed--) for(int i=0;i<cnt;i++)
+  { // collect fixed blocks first, then the ones we can move around
+    dt_node_t *node = graph->node + nodeid[i];
+    for(int c=0;c<node->num_connectors;c++)
+    {
+      dt_connector_t *cn = node->connector+c;
+      if(!dt_connector_output(cn) || node->conn_image[c] == -1) continue;
+      if(dt_connector_ssbo(cn) != ssbo) continue;
+      if(ssbo && cn->type == dt_token("source")) continue; // lives in staging memory
+      if(cn->flags & s_conn_dynamic_array)
+      { // one protected block in the outer heap for the whole array
+        if(fixed && cn->array_mem) buf[num_buf++] = (dt_plan_buf_t) {
+          .size = cn->array_mem->size, .offset = cn->array_mem->offset, .t0 = 0, .t1 = INT32_MAX };
+        continue;
+      }
+      const int is_fixed = cn->frames == 2 || cn->type == dt_token("source") ||
+        (cn->flags & (s_conn_protected | s_conn_cached)) || cn->format == dt_token("yuv");
+      if(is_fixed != fixed) continue;
+      for(int k=0;k<MAX(1,cn->array_length)*cn->frames;k++)
+      {
+        dt_connector_image_t *img = graph->conn_image_pool + node->conn_image[c] + k;
+        if(!img->image && !img->buffer) continue;
+        VkMemoryRequirements mem_req = { .size = img->size, .alignment = 1 };
+        if(cn->format != dt_token("yuv"))
+        { // storage buffers store the requested size only
+          if(ssbo) vkGetBufferMemoryRequirements(qvk.device, img->buffer, &mem_req);
+          else     vkGetImageMemoryRequirements (qvk.device, img->image,  &mem_req);
+        }
+        buf[num_buf++] = (dt_plan_buf_t) {
+          .size      = MAX(img->size, mem_req.size),
+          .alignment = MAX(1, mem_req.alignment),
+          .offset    = img->offset,
+          .t0        = fixed ? 0 : i,
+          .t1        = fixed ? INT32_MAX : t1[node->conn_image[c]+k],
+          .img       = fixed ? 0 : img,
+        };
+      }
+    }
+    if(fixed) num_fixed = num_buf;
+  }
+
+  qsort(buf + num_fixed, num_buf - num_fixed, sizeof(buf[0]), compare_plan_size);
+  uint64_t vmsize = 0;
+  for(int b=0;b<num_buf;b++)
+  {
+    if(b >= num_fixed)
+    { // find lowest offset that fits in between everything placed and alive at the same time
+      int num_live = 0;
+      for(int j=0;j<b;j++)
+        if(buf[j].t0 <= buf[b].t1 && buf[b].t0 <= buf[j].t1)
+          live[num_live++] = buf + j;
+      qsort(live, num_live, sizeof(live[0]), compare_plan_offset);
+      const uint64_t align = buf[b].alignment;
+      uint64_t offset = 0;
+      for(int j=0;j<num_live;j++)
+      {
+        if(offset + buf[b].size <= live[j]->offset) break;
+        offset = MAX(offset, (live[j]->offset + live[j]->size + align-1) & ~(align-1));
+      }
+      buf[b].offset = offset;
+    }
+    vmsize = MAX(vmsize, buf[b].offset + buf[b].size);
+  }
+
+  dt_log(s_log_mem, "%s: traversal peak %g MB, planned peak %g MB",
+      ssbo ? "buffers" : "images ", heap->vmsize/(1024.0*1024.0), vmsize/(1024.0*1024.0));
+  if(vmsize < heap->vmsize)
+  {
+    for(int b=num_fixed;b<num_buf;b++)
+      buf[b].img->offset = buf[b].offset;
+    heap->vmsize = vmsize;
+  }
+  free(t1);
+  free(buf);
+  free(live);
+}
+
+static VkResult
+wait_timeline(
+    dt_graph_t *graph,
+    uint64_t    value)
+{
+  if(!value) return VK_SUCCESS; // nothing submitted yet
+  VkSemaphoreWaitInfo wait_info = {
+    .sType          = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+    .semaphoreCount = 1,
+    .pSemaphores    = &graph->semaphore,
+    .pValues        = &value,
+  };
+  return vkWaitSemaphores(qvk.device, &wait_info, 1ul<<40);
+}
+
+static VkResult // submit to the queue after the timeline reached wait (if != 0) and signal the next value
+submit_timeline_queue(
+    dt_graph_t      *graph,
+    VkQueue          queue,
+    void            *mutex,
+    VkCommandBuffer *cmd_buf,
+    uint64_t         wait)
+{
+  const uint64_t value = graph->semaphore_value + 1;
+  const VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+  VkTimelineSemaphoreSubmitInfo timeline_info = {
+    .sType                     = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+    .waitSemaphoreValueCount   = wait ? 1 : 0,
+    .pWaitSemaphoreValues      = &wait,
+    .signalSemaphoreValueCount = 1,
+    .pSignalSemaphoreValues    = &value,
+  };
+  VkSubmitInfo submit = {
+    .sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+    .pNext                = &timeline_info,
+    .waitSemaphoreCount   = wait ? 1 : 0,
+    .pWaitSemaphores      = &graph->semaphore,
+    .pWaitDstStageMask    = &wait_stage,
+    .commandBufferCount   = cmd_buf ? 1 : 0,
+    .pCommandBuffers      = cmd_buf,
+    .signalSemaphoreCount = 1,
+    .pSignalSemaphores    = &graph->semaphore,
+  };
+  QVKLR(mutex, vkQueueSubmit(queue, 1, &submit, VK_NULL_HANDLE));
+  graph->semaphore_value = value;
+  return VK_SUCCESS;
+}
+
+static VkResult // submit and signal the next timeline value, graph->semaphore_value
+submit_timeline(
+    dt_graph_t      *graph,
+    VkCommandBuffer *cmd_buf)
+{
+  return submit_timeline_queue(graph, graph->queue, graph->queue_mutex, cmd_buf, 0);
+}
+
+// submit the command buffers of ring slot r. with side branches, these go to
+// queue_async after the main queue reached the fork, and an empty batch at the
+// end of the main queue joins both, see graph-async.h.
+static VkResult
+submit_ring(
+    dt_graph_t *graph,
+    int         r)
+{
+  if(!graph->async_cnt) return submit_timeline(graph, graph->command_buffer + r);
+  // the nodes before the fork overwrite what the last side branches read
+  QVKR(submit_timeline_queue(graph, graph->queue, graph->queue_mutex, graph->command_buffer + r, graph->async_value));
+  QVKR(submit_timeline_queue(graph, graph->queue_async, graph->queue_async_mutex,
+        graph->command_buffer_async + r, graph->semaphore_value));
+  graph->async_value = graph->semaphore_value;
+  QVKLR(graph->queue_mutex, vkQueueSubmit(graph->queue, 1, &(VkSubmitInfo){
+        .sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .commandBufferCount = 1,
+        .pCommandBuffers    = graph->command_buffer_join + r }, VK_NULL_HANDLE));
+  return submit_timeline_queue(graph, graph->queue, graph->queue_mutex, 0, graph->async_value);
+}
+
+// collect the sinks to be written for this frame, and take a snapshot of
+// their modules' parameters (such as the filename), which may change for the
+// next frame while the writer is still busy. results that write_sink() puts
+// into the parameters (pick, loss) end up in the snapshot.
+static void
+sink_job_setup(
+    dt_graph_t    *graph,
+    dt_graph_run_t run,
+    int            f)
+{
+  uint32_t cnt = 0;
+  size_t param_size = 0;
+  for(int n=0;n<graph->num_nodes;n++)
+  {
+    dt_node_t *node = graph->node + n;
+    if(!dt_node_sink(node) || !node->module->so->write_sink) continue;
+    if(node->connector[0].flags & s_conn_deferred) continue;
+    if(!(node->module->flags & s_module_request_write_sink) && !(run & s_graph_run_download_sink)) continue;
+    cnt++;
+    param_size += (dt_module_total_param_size(node->module->so - dt_pipe.module) + 15) & ~15;
+  }
+  if(cnt > graph->sink_cnt)
+  {
+    graph->sink_node   = realloc(graph->sink_node,   sizeof(uint32_t)    * cnt);
+    graph->sink_module = realloc(graph->sink_module, sizeof(dt_module_t) * cnt);
+  }
+  if(param_size > graph->sink_param_size)
+  {
+    graph->sink_param = realloc(graph->sink_param, param_size);
+    graph->sink_param_size = param_size;
+  }
+  graph->sink_cnt   = 0;
+  graph->sink_frame = f;
+  size_t off = 0;
+  for(int n=0;n<graph->num_nodes;n++)
+  {
+    dt_node_t *node = graph->node + n;
+    if(!dt_node_sink(node) || !node->module->so->write_sink) continue;
+    if(node->connector[0].flags & s_conn_deferred) continue;
+    if(!(node->module->flags & s_module_request_write_sink) && !(run & s_graph_run_download_sink)) continue;
+    const size_t size = dt_module_total_param_size(node->module->so - dt_pipe.module);
+    dt_module_t *mod = graph->sink_module + graph->sink_cnt;
+    *mod = *node->module;
+    mod->param = graph->sink_param + off;
+    memcpy(mod->param, node->module->param, size);
+    off += (size + 15) & ~15;
+    graph->sink_node[graph->sink_cnt++] = n;
+  }
+}
+
+static void
+sink_job_work(uint32_t item, void *data)
+{
+  dt_graph_t *graph = data;
+  if(wait_timeline(graph, graph->sink_value) != VK_SUCCESS)
+  {
+    dt_log(s_log_err|s_log_pipe, "failed to wait for the gpu, not writing sinks!");
+    return;
+  }
+  const double beg = dt_time();
+  for(uint32_t i=0;i<graph->sink_cnt;i++)
+  {
+    dt_connector_t *c = graph->node[graph->sink_node[i]].connector;
+    dt_trace_begin(graph->sink_module[i].name, graph->sink_frame);
+    graph->sink_module[i].so->write_sink(graph->sink_module + i,
+        graph->staging_mapped + c->offset_staging + graph->sink_frame * c->stride_staging);
+    dt_trace_end(graph->sink_module[i].name, graph->sink_frame);
+  }
+  graph->perf.sink += 1000.0*(dt_time() - beg); // only one writer at a time, see dt_graph_sink_flush()
+}
+
+// all sinks of the module defer their download (s_conn_deferred), so requesting
+// write_sink() does not make the run wait for the gpu. looks at the nodes of the
+// last run, a module without nodes yet is not deferred.
+static int
+module_sink_deferred(dt_graph_t *graph, const dt_module_t *mod)
+{
+  int cnt = 0;
+  for(int n=0;n<graph->num_nodes;n++)
+  {
+    dt_node_t *node = graph->node + n;
+    if(node->module != mod || !dt_node_sink(node)) continue;
+    if(!(node->connector[0].flags & s_conn_deferred)) return 0;
+    cnt++;
+  }
+  return cnt > 0;
+}
+
+// call write_sink() of the deferred sinks with the download of a complete frame
+// in the given ring slot. if the run waited for the gpu this is the frame just
+// rendered, otherwise the results arrive ring_depth-1 frames late.
+static void
+read_deferred_sinks(
+    dt_graph_t    *graph,
+    dt_graph_run_t run,
+    int            slot)
+{
+  const double beg = dt_time();
+  graph->deferred_mask &= ~(1u<<slot);
+  for(int n=0;n<graph->num_nodes;n++)
+  {
+    dt_node_t *node = graph->node + n;
+    if(!dt_node_sink(node) || !node->module->so->write_sink) continue;
+    if(!(node->connector[0].flags & s_conn_deferred)) continue;
+    if(!(node->module->flags & s_module_request_write_sink) && !(run & s_graph_run_download_sink)) continue;
+    dt_trace_begin(node->module->name, graph->frame);
+    node->module->so->write_sink(node->module, graph->staging_mapped +
+        node->connector[0].offset_staging + slot * node->connector[0].stride_staging);
+    dt_trace_end(node->module->name, graph->frame);
+  }
+  graph->perf.sink += 1000.0*(dt_time() - beg);
+}
+
+void
+dt_graph_sink_flush(dt_graph_t *graph)
+{
+  if(!graph->sink_task) return;
+  threads_wait(graph->sink_task - 1);
+  graph->sink_task = 0;
+}
+
+// run a one-off transfer between the images of the checkpoint entries and a
+// host visible buffer. on download, data receives the contents.
+static VkResult
+checkpoint_transfer(
+    dt_graph_t                        *graph,
+    const dt_graph_checkpoint_entry_t *entry,
+    dt_connector_image_t             **img,
+    uint32_t                           cnt,
+    uint8_t                           *data,
+    int                                upload)
+{
+  uint64_t size = 0;
+  for(uint32_t i=0;i<cnt;i++) size += entry[i].size;
+  if(!size) return VK_SUCCESS;
+  VkResult res = VK_SUCCESS;
+  VkBuffer buffer = 0;
+  VkDeviceMemory mem = 0;
+  VkCommandBuffer cmd_buf = 0;
+  void *mapped = 0;
+  VkBufferCreateInfo buffer_info = {
+    .sType       = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+    .size        = size,
+    .usage       = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+    .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+  };
+  if((res = vkCreateBuffer(qvk.device, &buffer_info, 0, &buffer)) != VK_SUCCESS) goto error;
+  VkMemoryRequirements mem_req;
+  vkGetBufferMemoryRequirements(qvk.device, buffer, &mem_req);
+  VkMemoryAllocateInfo mem_info = {
+    .sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+    .allocationSize  = mem_req.size,
+    .memoryTypeIndex = qvk_get_memory_type(mem_req.memoryTypeBits,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT),
+  };
+  if((res = vkAllocateMemory(qvk.device, &mem_info, 0, &mem)) != VK_SUCCESS) goto error;
+  if((res = vkBindBufferMemory(qvk.device, buffer, mem, 0)) != VK_SUCCESS) goto error;
+  if((res = vkMapMemory(qvk.device, mem, 0, VK_WHOLE_SIZE, 0, &mapped)) != VK_SUCCESS) goto error;
+  if(upload) memcpy(mapped, data, size);
+  VkCommandBufferAllocateInfo cmd_info = {
+    .sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+    .commandPool        = graph->command_pool,
+    .level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+    .commandBufferCount = 1,
+  };
+  if((res = vkAllocateCommandBuffers(qvk.device, &cmd_info, &cmd_buf)) != VK_SUCCESS) goto error;
+  VkCommandBufferBeginInfo begin_info = {
+    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+    .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+  };
+  if((res = wait_timeline(graph, graph->semaphore_value)) != VK_SUCCESS) goto error;
+  if((res = vkBeginCommandBuffer(cmd_buf, &begin_info)) != VK_SUCCESS) goto error;
+  dt_graph_checkpoint_record(graph, cmd_buf, buffer, entry, img, cnt, upload);
+  if((res = vkEndCommandBuffer(cmd_buf)) != VK_SUCCESS) goto error;
+  if((res = submit_timeline(graph, &cmd_buf)) != VK_SUCCESS) goto error;
+  if((res = wait_timeline(graph, graph->semaphore_value)) != VK_SUCCESS) goto error;
+  if(!upload) memcpy(data, mapped, size);
+  memset(graph->record_key, 0, sizeof(graph->record_key)); // the layouts may have changed
+error:
+  if(cmd_buf) vkFreeCommandBuffers(qvk.device, graph->command_pool, 1, &cmd_buf);
+  if(mapped)  vkUnmapMemory(qvk.device, mem);
+  if(buffer)  vkDestroyBuffer(qvk.device, buffer, 0);
+  if(mem)     vkFreeMemory(qvk.device, mem, 0);
+  return res;
+}
+
+VkResult
+dt_graph_checkpoint_write(
+    dt_graph_t *graph,
+    const char *filename)
+{
+  const uint32_t cnt = dt_graph_checkpoint_entries(graph, 0, 0, 0);
+  dt_graph_checkpoint_entry_t *entry = malloc(sizeof(*entry)*(cnt+1));
+  dt_connector_image_t **img = malloc(sizeof(*img)*(cnt+1));
+  dt_graph_checkpoint_entries(graph, entry, img, cnt);
+  uint64_t size = 0;
+  for(uint32_t i=0;i<cnt;i++) size += entry[i].size;
+  uint8_t *data = malloc(size+1);
+  VkResult res = checkpoint_transfer(graph, entry, img, cnt, data, 0);
+  char tmpname[PATH_MAX+10];
+  snprintf(tmpname, sizeof(tmpname), "%s.tmp", filename);
+  FILE *f = res == VK_SUCCESS ? fopen(tmpname, "wb") : 0;
+  if(f)
+  { // write next to it and rename, so an interrupted write leaves the last checkpoint intact
+    const dt_graph_checkpoint_header_t header = {
+      .magic   = dt_token("vkdtckpt"),
+      .version = DT_GRAPH_CHECKPOINT_VERSION,
+      .frame   = graph->frame,
+      .cnt     = cnt,
+    };
+    int ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    uint64_t offset = 0;
+    for(uint32_t i=0;i<cnt && ok;offset+=entry[i++].size)
+      ok = fwrite(entry+i, sizeof(entry[i]), 1, f) == 1 &&
+        (!entry[i].size || fwrite(data+offset, entry[i].size, 1, f) == 1);
+    ok = !fclose(f) && ok;
+    if(!ok || rename(tmpname, filename))
+    {
+      dt_log(s_log_err, "could not write checkpoint %s", filename);
+      res = VK_INCOMPLETE;
+    }
+  }
+  else if(res == VK_SUCCESS)
+  {
+    dt_log(s_log_err, "could not open checkpoint %s for writing", tmpname);
+    res = VK_INCOMPLETE;
+  }
+  free(data);
+  free(img);
+  free(entry);
+  return res;
+}
+
+uint32_t
+dt_graph_checkpoint_cnt(
+    dt_graph_t *graph)
+{
+  return dt_graph_checkpoint_entries(graph, 0, 0, 0);
+}
+
+int
+dt_graph_checkpoint_frame(
+    const char *filename)
+{
+  FILE *f = fopen(filename, "rb");
+  if(!f) return -1;
+  dt_graph_checkpoint_header_t header = {0};
+  const int ok = fread(&header, sizeof(header), 1, f) == 1 &&
+    header.magic == dt_token("vkdtckpt") && header.version == DT_GRAPH_CHECKPOINT_VERSION;
+  fclose(f);
+  return ok ? header.frame : -1;
+}
+
+int
+dt_graph_checkpoint_read(
+    dt_graph_t *graph,
+    const char *filename)
+{
+  FILE *f = fopen(filename, "rb");
+  if(!f) return -1;
+  int frame = -1;
+  const uint32_t cnt = dt_graph_checkpoint_entries(graph, 0, 0, 0);
+  dt_graph_checkpoint_entry_t *entry = malloc(sizeof(*entry)*(cnt+1));
+  dt_connector_image_t **img = malloc(sizeof(*img)*(cnt+1));
+  dt_graph_checkpoint_entries(graph, entry, img, cnt);
+  uint64_t size = 0;
+  for(uint32_t i=0;i<cnt;i++) size += entry[i].size;
+  uint8_t *data = malloc(size+1);
+  dt_graph_checkpoint_header_t header = {0};
+  if(fread(&header, sizeof(header), 1, f) != 1 ||
+     header.magic != dt_token("vkdtckpt") || header.version != DT_GRAPH_CHECKPOINT_VERSION ||
+     header.cnt != cnt) goto error;
+  uint64_t offset = 0;
+  for(uint32_t i=0;i<cnt;offset+=entry[i++].size)
+  { // the graph creates its nodes in the same order every time
+    dt_graph_checkpoint_entry_t e;
+    if(fread(&e, sizeof(e), 1, f) != 1 || memcmp(&e, entry+i, sizeof(e))) goto error;
+    if(e.size && fread(data+offset, e.size, 1, f) != 1) goto error;
+  }
+  if(checkpoint_transfer(graph, entry, img, cnt, data, 1) == VK_SUCCESS) frame = header.frame;
+error:
+  if(frame < 0) dt_log(s_log_err, "checkpoint %s doesn't match the graph", filename);
+  fclose(f);
+  free(data);
+  free(img);
+  free(entry);
+  return frame;
+}
+
+// the command buffer only depends on the nodes, their images and a few things
+// decided when recording it. parameters live in the uniform buffer, so if none
+// of these changed since the command buffer of this ring slot was recorded, it
+// can be submitted again as it is. returns 0 if the run has to record anyway.
+static uint64_t
+record_key(
+    dt_graph_t        *graph,
+    dt_graph_run_t     run,
+    dt_module_flags_t  module_flags,
+    int                dynamic_array,
+    int                incremental,
+    int                active_module,
+    const uint8_t     *dirty,
+    const uint32_t    *nodeid,
+    int                cnt)
+{
+  if((run & (s_graph_run_roi | s_graph_run_create_nodes | s_graph_run_alloc | s_graph_run_upload_source)) ||
+      module_flags || dynamic_array || dt_raytrace_present(graph)) return 0;
+  dt_hash_t h;
+  dt_hash_init(&h, graph->frame % 2);
+  const int32_t k[] = { incremental, active_module, graph->pipeline_stats, cnt, graph->conn_image_end };
+  dt_hash_update(&h, k, sizeof(k));
+  if(incremental) dt_hash_update(&h, dirty, graph->num_modules);
+  for(int i=0;i<cnt;i++)
+  {
+    dt_node_t *node = graph->node + nodeid[i];
+    if(node->name == dt_token("shared") && node->kernel == dt_token("fuse"))
+      dt_graph_fuse_push(graph, node); // fused nodes push their parameters
+    if(node->name == dt_token("shared") && node->kernel == dt_token("warp"))
+      dt_graph_warp_push(graph, node);
+    dt_hash_update(&h, nodeid+i, sizeof(nodeid[i]));
+    dt_hash_update(&h, &node->pipeline, sizeof(node->pipeline));
+    dt_hash_update(&h, node->push_constant, node->push_constant_size);
+    if(node->type == s_node_graphics && node->pipeline)
+    { // the number of vertices is a parameter
+      const int pi = dt_module_get_param(node->module->so, dt_token("draw"));
+      if(pi >= 0) dt_hash_update(&h, dt_module_param_int(node->module, pi), sizeof(int32_t));
+      dt_hash_update(&h, &node->draw_beg, sizeof(node->draw_beg));
+      dt_hash_update(&h, node->draw_area, sizeof(node->draw_area));
+    }
+  }
+  for(int i=0;i<graph->conn_image_end;i++)
+  { // barriers depend on the layouts we start with
+    const dt_connector_image_t *img = graph->conn_image_pool + i;
+    dt_hash_update(&h, &img->image,  sizeof(img->image));
+    dt_hash_update(&h, &img->buffer, sizeof(img->buffer));
+    dt_hash_update(&h, &img->layout, sizeof(img->layout));
+  }
+  const uint64_t key = dt_hash_final(&h);
+  return key ? key : 1;
+}
+
 VkResult dt_graph_run(
     dt_graph_t     *graph,
     dt_graph_run_t  run)
 {
   double clock_beg = dt_time();
+  graph->perf.runs++;
+  dt_trace_begin(dt_token("run"), graph->frame);
   dt_module_flags_t module_flags = 0;
-  const int f  = graph->frame % 2;     // recording this pipeline now
-  const int fp = (graph->frame+1) % 2; // waiting for the previous frame
+  const int f = graph->frame % 2;  // images and staging of this frame
+  const int r = graph->ring_slot;  // command buffer, uniforms and queries recording now
+
+  // a dynamic array pool ran full and needs to be reallocated larger:
+  if(!(run & s_graph_run_alloc) && dynamic_array_overflow(graph)) run |= s_graph_run_all;
+  // a module started or stopped passing its input through:
+  if(!(run & s_graph_run_create_nodes) && module_bypass_changed(graph)) run |= s_graph_run_all;
 
   if(run & s_graph_run_alloc)
+  { // reallocation may move the staging memory the writer reads
+    dt_graph_sink_flush(graph);
     QVKLR(&qvk.queue_mutex, vkDeviceWaitIdle(qvk.device));
+    graph->deferred_mask = 0;
+  }
+
+  QVKR(wait_timeline(graph, graph->ring_value[r])); // wait for last invocation of our command buffer, just in case
 
-  QVKR(vkWaitForFences(qvk.device, 1, &graph->command_fence[f], VK_TRUE, 1ul<<40)); // wait for last invocation of our command buffer, just in case
+  // the active module is only valid for this run, it has to be set again for the next one:
+  const int active_module = graph->active_module;
+  graph->active_module = -1;
+  uint8_t dirty[100] = {0}; // modules that need to be processed in an incremental run
+  int dirty_valid = 0, incremental = 0;
 
 { // module scope
   // find list of modules in post order
@@ -2116,17 +3423,74 @@ VkResult dt_graph_run(
     if(!strncmp(dt_token_str(graph->module[modid[i]].name), "i-", 2) &&
         graph->module[modid[i]].inst == dt_token("main"))
       main_input_module = modid[i];
-    module_flags |= graph->module[modid[i]].flags;
+    dt_module_flags_t flags = graph->module[modid[i]].flags;
+    if((flags & s_module_request_write_sink) && module_sink_deferred(graph, graph->module + modid[i]))
+      flags &= ~s_module_request_write_sink; // picked up after a later submission, see read_deferred_sinks()
+    module_flags |= flags;
   }
 
   // at least one module requested a full rebuild:
   if(module_flags & s_module_request_all) run |= s_graph_run_all;
 
-  // if synchronous upload/download is required, we can't interleave frames:
-  if((run & (s_graph_run_upload_source | s_graph_run_download_sink)) ||
-     (module_flags & (s_module_request_read_source | s_module_request_write_sink)))
+  // propagate the changed parameters of the active module downstream. everything
+  // else can keep its previous output, if the memory planning was aware of it.
+  if(active_module >= 0 && active_module < graph->num_modules && graph->frame_cnt <= 1)
+  {
+    dirty_valid = 1;
+    for(int i=0;i<cnt;i++)
+    {
+      dt_module_t *mod = graph->module + modid[i];
+      if(modid[i] == active_module || (mod->flags & (s_module_request_read_source | s_module_request_read_geo)))
+        dirty[modid[i]] = 1;
+      for(int c=0;c<mod->num_connectors;c++)
+      {
+        if(mod->connector[c].flags & s_conn_feedback) dirty_valid = 0; // would need the previous frame
+        if(dt_connector_input(mod->connector+c) && mod->connector[c].connected_mi >= 0 &&
+           dirty[mod->connector[c].connected_mi])
+          dirty[modid[i]] = 1;
+      }
+    }
+  }
+  if(dirty_valid && !(run & (s_graph_run_before_active | s_graph_run_roi | s_graph_run_create_nodes |
+          s_graph_run_alloc | s_graph_run_upload_source)) && (run & s_graph_run_record_cmd_buf))
+  {
+    if(graph->cached_module == active_module)
+      incremental = 1;
+    else if(graph->last_active_module == active_module)
+    { // interactively changing the same module again: plan memory to keep its inputs around
+      run |= s_graph_run_create_nodes | s_graph_run_alloc | s_graph_run_upload_source;
+      dt_log(s_log_pipe, "re-planning memory to start at module %"PRItkn" %"PRItkn,
+          dt_token_str(graph->module[active_module].name), dt_token_str(graph->module[active_module].inst));
+    }
+  }
+  graph->last_active_module = active_module;
+
+  // if synchronous upload/download is required, we can't interleave frames.
+  // sources with two staging slots can read the next frame while the gpu works on this one:
+  int sync_source = 0;
+  if(module_flags & s_module_request_read_source)
+    for(int n=0;n<graph->num_nodes;n++)
+      if(dt_node_source(graph->node+n) && (graph->node[n].module->flags & s_module_request_read_source))
+        sync_source |= !graph->node[n].connector[0].stride_staging;
+  // animated sinks can be written asynchronously, reading the staging slot of this frame
+  // while the next one renders. in this case the writer waits for the gpu instead of us.
+  // the export itself may run on the pool, make sure there is another thread to pick up the writer.
+  const int async_sink = (run & s_graph_run_async_sink) && !(run & s_graph_run_wait_done) &&
+    graph->frame_cnt > 1 && threads_num() > 1;
+  if(sync_source ||
+     (run & s_graph_run_upload_source) ||
+     (!async_sink && ((run & s_graph_run_download_sink) || (module_flags & s_module_request_write_sink))))
     run |= s_graph_run_wait_done;
 
+  // writing to per-frame (odd/even) staging, descriptor sets or geometry on the cpu requires the
+  // last frame of the same parity to be done. only re-recording with new uniforms (such as
+  // keyframed animations) can keep up to ring_depth frames in flight.
+  int sync_frame = (run & ~(s_graph_run_record_cmd_buf | s_graph_run_wait_done | s_graph_run_before_active)) || module_flags;
+  for(int n=0;n<graph->num_nodes && !sync_frame;n++)
+    for(int c=0;c<graph->node[n].num_connectors;c++)
+      if(graph->node[n].connector[c].flags & s_conn_dynamic_array) sync_frame = 1;
+  if(sync_frame) QVKR(wait_timeline(graph, graph->frame_value[f]));
+
   // only waiting for the gui thread to draw our output, and only
   // if we intend to clean it up behind their back
   if(graph->gui_attached &&
@@ -2165,6 +3529,8 @@ VkResult dt_graph_run(
   // execute after all inputs have been traversed:
   // "int curr" will be the current node
   // walk all inputs and determine roi on all outputs
+  double pass_beg = dt_time();
+  dt_trace_begin(dt_token("roi"), graph->frame);
   if(run & s_graph_run_roi)
   {
     if(main_input_module >= 0) // may set metadata required by others (such as find the right lut)
@@ -2189,6 +3555,10 @@ VkResult dt_graph_run(
       break; // we're good
     }
   }
+  graph->perf.roi += 1000.0*(dt_time() - pass_beg);
+  dt_trace_end(dt_token("roi"), graph->frame);
+  pass_beg = dt_time();
+  dt_trace_begin(dt_token("nodes"), graph->frame);
 
 
   // now we don't always want the full size buffer but are interested in a
@@ -2238,7 +3608,9 @@ VkResult dt_graph_run(
         dt_connector_t *c = graph->node[i].connector+j;
         c->associated_i = c->associated_c = -1;
         if(c->staging) vkDestroyBuffer(qvk.device, c->staging, VK_NULL_HANDLE);
+        if(c->mem_external) vkFreeMemory(qvk.device, c->mem_external, 0);
         c->staging = 0;
+        c->mem_external = 0;
       }
       vkDestroyPipelineLayout     (qvk.device, graph->node[i].pipeline_layout,  0);
       vkDestroyPipeline           (qvk.device, graph->node[i].pipeline,         0);
@@ -2257,13 +3629,15 @@ VkResult dt_graph_run(
     // we need two uint32, alignment is 64 bytes
     graph->uniform_global_size = qvk.uniform_alignment; // global data, aligned
     uint64_t uniform_offset = graph->uniform_global_size;
+    for(int m=0;m<graph->num_modules;m++) graph->module[m].bypassed = -1; // no nodes until created below
     // skip modules with uninited roi! (these are disconnected/dead code elimination cases)
     for(int i=cnt-1;i>=0;i--)
       if(graph->module[modid[i]].connector[0].roi.full_wd > 0)
         modify_roi_in(graph, graph->module+modid[i]);
     for(int i=0;i<cnt;i++)
       if(graph->module[modid[i]].connector[0].roi.full_wd > 0)
-        create_nodes(graph, graph->module+modid[i], &uniform_offset);
+        create_nodes(graph, graph->module+modid[i], &uniform_offset, active_module);
+    bind_nodes(graph);
     // make sure connectors are zero inited:
     memset(graph->conn_image_pool, 0, sizeof(dt_connector_image_t)*graph->conn_image_end);
     graph->uniform_size = uniform_offset;
@@ -2320,13 +3694,22 @@ VkResult dt_graph_run(
         }
       }
     }
+    dedup_nodes(graph);
   }
+  graph->perf.nodes += 1000.0*(dt_time() - pass_beg);
+  dt_trace_end(dt_token("nodes"), graph->frame);
 } // end scope, done with modules
 
   // if no more action than generating the output roi was requested, exit now:
-  if(run < s_graph_run_create_nodes<<1) return VK_SUCCESS;
+  if(run < s_graph_run_create_nodes<<1)
+  {
+    dt_trace_end(dt_token("run"), graph->frame);
+    return VK_SUCCESS;
+  }
 
 { // node scope
+  double alloc_beg = dt_time();
+  dt_trace_begin(dt_token("alloc"), graph->frame);
   int cnt = 0;
   dt_node_t *const arr = graph->node;
   const int arr_cnt = graph->num_nodes;
@@ -2357,6 +3740,35 @@ VkResult dt_graph_run(
     // this is needed for memory allocation later:
     for(int i=0;i<cnt;i++)
       count_references(graph, graph->node+nodeid[i]);
+    // keep the outputs read by the dirty part of the graph resident, so
+    // incremental runs can skip everything upstream of the active module:
+    graph->cached_module = -1;
+    for(int n=0;n<graph->num_nodes;n++)
+      for(int c=0;c<graph->node[n].num_connectors;c++)
+        graph->node[n].connector[c].flags &= ~s_conn_cached;
+    if(dirty_valid)
+    {
+      int cached = 1;
+      for(int i=0;i<cnt;i++)
+      {
+        dt_node_t *node = graph->node + nodeid[i];
+        if(!dirty[node->module - graph->module]) continue;
+        for(int c=0;c<node->num_connectors;c++)
+        {
+          if(!dt_connector_input(node->connector+c) || node->connector[c].connected_mi < 0) continue;
+          dt_node_t *up = graph->node + node->connector[c].connected_mi;
+          if(dirty[up->module - graph->module]) continue;
+          if(up->connector[node->connector[c].connected_mc].flags & s_conn_dynamic_array) cached = 0;
+          up->connector[node->connector[c].connected_mc].flags |= s_conn_cached;
+        }
+      }
+      if(cached) graph->cached_module = active_module;
+    }
+    // branches which don't feed the main display go to the second queue:
+    graph->async_cnt = 0;
+    if(graph->queue_async && graph->queue_async != graph->queue)
+      graph->async_cnt = dt_graph_async_split(graph, nodeid, cnt);
+    else for(int i=0;i<cnt;i++) graph->node[nodeid[i]].async = 0;
     // free pipeline resources if previously allocated anything:
     dt_vkalloc_nuke(&graph->heap);
     dt_vkalloc_nuke(&graph->heap_ssbo);
@@ -2364,7 +3776,7 @@ VkResult dt_graph_run(
     graph->dset_cnt_image_read = 0;
     graph->dset_cnt_image_write = 0;
     graph->dset_cnt_buffer = 0;
-    graph->dset_cnt_uniform = DT_GRAPH_MAX_FRAMES; // we have one global uniform for params, per frame
+    graph->dset_cnt_uniform = DT_GRAPH_MAX_RING; // we have one global uniform for params, per command buffer
     graph->memory_type_bits = ~0u;
     graph->memory_type_bits_ssbo = ~0u;
     graph->memory_type_bits_staging = ~0u;
@@ -2373,6 +3785,9 @@ VkResult dt_graph_run(
       QVKR(alloc_outputs(graph, graph->node+nodeid[i]));
       QVKR(free_inputs  (graph, graph->node+nodeid[i]));
     }
+    plan_memory(graph, nodeid, cnt, 0);
+    plan_memory(graph, nodeid, cnt, 1);
+    dt_raytrace_graph_plan_scratch(graph);
   }
 
   if(graph->heap.vmsize > graph->vkmem_size)
@@ -2385,17 +3800,12 @@ VkResult dt_graph_run(
       graph->vkmem = 0;
     }
     // image data to pass between nodes
-    VkMemoryAllocateInfo mem_alloc_info = {
-      .sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-      .allocationSize  = graph->heap.vmsize,
-      .memoryTypeIndex = qvk_get_memory_type(graph->memory_type_bits,
-          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
-    };
-    QVKR(vkAllocateMemory(qvk.device, &mem_alloc_info, 0, &graph->vkmem));
+    QVKR(alloc_device_memory(graph->heap.vmsize, graph->memory_type_bits, 0, &graph->vkmem, "images"));
     graph->vkmem_size = graph->heap.vmsize;
   }
 
-  if(graph->heap_ssbo.vmsize > graph->vkmem_ssbo_size)
+  if(graph->heap_ssbo.vmsize > graph->vkmem_ssbo_size ||
+    (dt_raytrace_present(graph) && !graph->vkmem_ssbo_address))
   {
     run |= s_graph_run_upload_source; // new mem means new source
     if(graph->vkmem_ssbo)
@@ -2404,15 +3814,12 @@ VkResult dt_graph_run(
       vkFreeMemory(qvk.device, graph->vkmem_ssbo, 0);
       graph->vkmem_ssbo = 0;
     }
-    // image data to pass between nodes
-    VkMemoryAllocateInfo mem_alloc_info = {
-      .sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-      .allocationSize  = graph->heap_ssbo.vmsize,
-      .memoryTypeIndex = qvk_get_memory_type(graph->memory_type_bits_ssbo,
-          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
-    };
-    QVKR(vkAllocateMemory(qvk.device, &mem_alloc_info, 0, &graph->vkmem_ssbo));
+    // buffers to pass between nodes, and the scratch memory for ray tracing accel builds
+    QVKR(alloc_device_memory(graph->heap_ssbo.vmsize, graph->memory_type_bits_ssbo,
+          dt_raytrace_present(graph) ? VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT : 0,
+          &graph->vkmem_ssbo, "buffers"));
     graph->vkmem_ssbo_size = graph->heap_ssbo.vmsize;
+    graph->vkmem_ssbo_address = dt_raytrace_present(graph);
   }
 
   if(graph->heap_staging.vmsize > graph->vkmem_staging_size)
@@ -2423,32 +3830,26 @@ VkResult dt_graph_run(
       QVKLR(&qvk.queue_mutex, vkDeviceWaitIdle(qvk.device));
       vkFreeMemory(qvk.device, graph->vkmem_staging, 0);
       graph->vkmem_staging = 0;
+      graph->staging_mapped = 0;
     }
     // staging memory to copy to and from device
-    VkMemoryAllocateInfo mem_alloc_info_staging = {
-      .sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-      .allocationSize  = graph->heap_staging.vmsize,
-      .memoryTypeIndex = qvk_get_memory_type(graph->memory_type_bits_staging,
-          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT |
-          VK_MEMORY_PROPERTY_HOST_CACHED_BIT)
-    };
-    QVKR(vkAllocateMemory(qvk.device, &mem_alloc_info_staging, 0, &graph->vkmem_staging));
-    graph->vkmem_staging_size = graph->heap_staging.vmsize;
+    QVKR(staging_alloc(graph));
   }
 
-  if(graph->vkmem_uniform_size < DT_GRAPH_MAX_FRAMES * graph->uniform_size)
+  if(graph->vkmem_uniform_size < DT_GRAPH_MAX_RING * graph->uniform_size)
   {
     if(graph->vkmem_uniform)
     {
       QVKLR(&qvk.queue_mutex, vkDeviceWaitIdle(qvk.device));
-      vkFreeMemory(qvk.device, graph->vkmem_uniform, 0);
+      vkFreeMemory(qvk.device, graph->vkmem_uniform, 0); // unmaps, too
       graph->vkmem_uniform = 0;
+      graph->uniform_mapped = 0;
     }
     // uniform data to pass parameters
     VkBufferCreateInfo buffer_info = {
       .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-      .size  = DT_GRAPH_MAX_FRAMES * graph->uniform_size,
-      .usage = // VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+      .size  = DT_GRAPH_MAX_RING * graph->uniform_size,
+      .usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | // bound parameters, see dt_module_bind()
         VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT|
         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT |
         VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
@@ -2481,8 +3882,9 @@ VkResult dt_graph_run(
           VK_MEMORY_PROPERTY_HOST_CACHED_BIT)
     };
     QVKR(vkAllocateMemory(qvk.device, &mem_alloc_info_uniform, 0, &graph->vkmem_uniform));
-    graph->vkmem_uniform_size = 2 * graph->uniform_size;
+    graph->vkmem_uniform_size = DT_GRAPH_MAX_RING * graph->uniform_size;
     vkBindBufferMemory(qvk.device, graph->uniform_buffer, graph->vkmem_uniform, 0);
+    QVKR(vkMapMemory(qvk.device, graph->vkmem_uniform, 0, VK_WHOLE_SIZE, 0, (void**)&graph->uniform_mapped));
   }
 
   if(run & s_graph_run_alloc)
@@ -2509,7 +3911,7 @@ VkResult dt_graph_run(
         .descriptorCount = 1+DT_GRAPH_MAX_FRAMES*graph->dset_cnt_buffer,
       }, {
         .type            = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-        .descriptorCount = 1+DT_GRAPH_MAX_FRAMES*2*graph->num_nodes,
+        .descriptorCount = 1+DT_GRAPH_MAX_RING*2*graph->num_nodes,
       }, {
         .type            = qvk.raytracing_supported ?
           VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR :
@@ -2524,7 +3926,8 @@ VkResult dt_graph_run(
         .maxSets       = DT_GRAPH_MAX_FRAMES*(
             graph->dset_cnt_image_read + graph->dset_cnt_image_write
           + graph->num_nodes
-          + graph->dset_cnt_buffer     + graph->dset_cnt_uniform),
+          + graph->dset_cnt_buffer)
+          + DT_GRAPH_MAX_RING*(graph->num_nodes + graph->dset_cnt_uniform),
       };
       vkDestroyDescriptorPool(qvk.device, graph->dset_pool, VK_NULL_HANDLE);
       graph->dset_pool = 0;
@@ -2615,6 +4018,9 @@ VkResult dt_graph_run(
     for(int i=0;i<cnt;i++) for(int j=0;j<graph->node[nodeid[i]].num_connectors;j++)
       write_descriptor_sets(graph, graph->node+nodeid[i], graph->node[nodeid[i]].connector + j, 1);
 
+  graph->perf.alloc += 1000.0*(dt_time() - alloc_beg);
+  dt_trace_end(dt_token("alloc"), graph->frame);
+
   // upload all source data to staging memory
   threads_mutex_t *mutex = 0;// graph->io_mutex; // no speed impact, maybe not needed
   if(mutex) threads_mutex_lock(mutex);
@@ -2623,8 +4029,9 @@ VkResult dt_graph_run(
      (run & s_graph_run_upload_source))
   {
     double upload_beg = dt_time();
-    uint8_t *mapped = 0;
-    QVKR(vkMapMemory(qvk.device, graph->vkmem_staging, 0, VK_WHOLE_SIZE, 0, (void**)&mapped));
+    dt_trace_begin(dt_token("upload"), graph->frame);
+    uint8_t *mapped = graph->staging_mapped;
+    graph->srccache_clock++;
     for(int n=0;n<graph->num_nodes;n++)
     { // for all source nodes:
       dt_node_t *node = graph->node + n;
@@ -2635,8 +4042,19 @@ VkResult dt_graph_run(
           int run_node = (node->flags & s_module_request_read_source) ||
                          (run & s_graph_run_upload_source);
           const int c = 0;
+          node->srccache = 0;
+          if(run_node && (run & s_graph_run_record_cmd_buf))
+          { // the command buffer will copy from the device copy if we have a valid one
+            node->srccache = dt_graph_srccache_lookup(graph, node, dt_connector_vkformat(node->connector));
+            if(node->srccache && graph->srccache[node->srccache-1].valid) continue;
+          }
           if(run_node || (dynamic_array && (node->connector[c].flags & s_conn_dynamic_array)))
-          {
+          { // array elements are packed into the staging buffer and copied in batches,
+            // so we only wait for the gpu once the staging buffer is full.
+            const size_t staging_size = dt_connector_bufsize(node->connector+c, node->connector[c].roi.wd, node->connector[c].roi.ht);
+            size_t batch_end = 0;
+            int batch_cnt = 0;
+            VkCommandBuffer cmd_buf = graph->command_buffer[r];
             for(int a=0;a<MAX(1,node->connector[c].array_length);a++)
             {
               if(node->connector[c].array_req)
@@ -2645,57 +4063,64 @@ VkResult dt_graph_run(
                 node->connector[c].array_req[a] = 0; // clear image load request
               }
               dt_read_source_params_t p = { .node = node, .c = c, .a = a };
-              node->module->so->read_source(node->module,
-                  mapped + node->connector[c].offset_staging, &p);
-              if(node->connector[c].array_length > 1)
+              if(node->connector[c].array_length <= 1)
               {
-                if(!dt_graph_connector_image(graph, node-graph->node, c, a, graph->frame)->image)
-                  continue;
-                vkUnmapMemory(qvk.device, graph->vkmem_staging);
-                const uint32_t wd = MAX(1, node->connector[c].array_dim ? node->connector[c].array_dim[2*a+0] : node->connector[c].roi.wd);
-                const uint32_t ht = MAX(1, node->connector[c].array_dim ? node->connector[c].array_dim[2*a+1] : node->connector[c].roi.ht);
-                VkBufferImageCopy regions[] = {{
-                  .imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-                  .imageSubresource.layerCount = 1,
-                  .imageExtent = { wd, ht, 1 },
-                },{
-                  .imageSubresource.aspectMask = VK_IMAGE_ASPECT_PLANE_0_BIT,
-                  .imageSubresource.layerCount = 1,
-                  .imageExtent = { wd, ht, 1 },
-                },{
-                  .bufferOffset = dt_graph_connector_image(graph, node-graph->node, c, a, graph->frame)->plane1_offset,
-                  .imageSubresource.aspectMask = VK_IMAGE_ASPECT_PLANE_1_BIT,
-                  .imageSubresource.layerCount = 1,
-                  .imageExtent = { wd / 2, ht / 2, 1 },
-                }};
-                const int yuv = node->connector[c].format == dt_token("yuv");
-                VkCommandBuffer cmd_buf = graph->command_buffer[f];
-                QVKR(vkBeginCommandBuffer(cmd_buf, &begin_info));
-                IMG_LAYOUT(
-                    dt_graph_connector_image(graph, node-graph->node, c, a, graph->frame),
-                    UNDEFINED,
-                    TRANSFER_DST_OPTIMAL);
-                vkCmdCopyBufferToImage(
-                    cmd_buf,
-                    node->connector[c].staging,
-                    dt_graph_connector_image(graph, node-graph->node, c, a, graph->frame)->image,
-                    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                    yuv ? 2 : 1, yuv ? regions+1 : regions);
-                IMG_LAYOUT(
-                    dt_graph_connector_image(graph, node-graph->node, c, a, graph->frame),
-                    TRANSFER_DST_OPTIMAL,
-                    SHADER_READ_ONLY_OPTIMAL);
+                dt_trace_begin(node->module->name, a);
+                node->module->so->read_source(node->module,
+                    mapped + node->connector[c].offset_staging + f * node->connector[c].stride_staging, &p);
+                dt_trace_end(node->module->name, a);
+                continue;
+              }
+              dt_connector_image_t *img = dt_graph_connector_image(graph, node-graph->node, c, a, graph->frame);
+              const uint32_t wd = MAX(1, node->connector[c].array_dim ? node->connector[c].array_dim[2*a+0] : node->connector[c].roi.wd);
+              const uint32_t ht = MAX(1, node->connector[c].array_dim ? node->connector[c].array_dim[2*a+1] : node->connector[c].roi.ht);
+              const size_t size = (dt_connector_bufsize(node->connector+c, wd, ht) + 0xff) & ~0xffull;
+              if(batch_cnt && batch_end + size > staging_size)
+              { // staging buffer is full, flush
                 QVKR(vkEndCommandBuffer(cmd_buf));
-                VkSubmitInfo submit = {
-                  .sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-                  .commandBufferCount = 1,
-                  .pCommandBuffers    = &cmd_buf,
-                };
-                vkResetFences(qvk.device, 1, &graph->command_fence[f]);
-                QVKLR(graph->queue_mutex, vkQueueSubmit(graph->queue, 1, &submit, graph->command_fence[f]));
-                QVKR(vkWaitForFences(qvk.device, 1, &graph->command_fence[f], VK_TRUE, 1ul<<40)); // wait inline on our lock because we share the staging buf
-                QVKR(vkMapMemory(qvk.device, graph->vkmem_staging, 0, VK_WHOLE_SIZE, 0, (void**)&mapped));
+                QVKR(submit_timeline(graph, &cmd_buf));
+                QVKR(wait_timeline(graph, graph->semaphore_value)); // wait inline on our lock because we share the staging buf
+                batch_end = batch_cnt = 0;
               }
+              dt_trace_begin(node->module->name, a);
+              node->module->so->read_source(node->module, mapped + node->connector[c].offset_staging + batch_end, &p);
+              dt_trace_end(node->module->name, a);
+              if(!img->image) continue;
+              VkBufferImageCopy regions[] = {{
+                .bufferOffset = batch_end,
+                .imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .imageSubresource.layerCount = 1,
+                .imageExtent = { wd, ht, 1 },
+              },{
+                .bufferOffset = batch_end,
+                .imageSubresource.aspectMask = VK_IMAGE_ASPECT_PLANE_0_BIT,
+                .imageSubresource.layerCount = 1,
+                .imageExtent = { wd, ht, 1 },
+              },{
+                .bufferOffset = batch_end + img->plane1_offset,
+                .imageSubresource.aspectMask = VK_IMAGE_ASPECT_PLANE_1_BIT,
+                .imageSubresource.layerCount = 1,
+                .imageExtent = { wd / 2, ht / 2, 1 },
+              }};
+              const int yuv = node->connector[c].format == dt_token("yuv");
+              if(!batch_cnt) QVKR(vkBeginCommandBuffer(cmd_buf, &begin_info));
+              graph->record_key[r] = 0; // overwritten the recording
+              IMG_LAYOUT(img, UNDEFINED, TRANSFER_DST_OPTIMAL);
+              vkCmdCopyBufferToImage(
+                  cmd_buf,
+                  node->connector[c].staging,
+                  img->image,
+                  VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                  yuv ? 2 : 1, yuv ? regions+1 : regions);
+              IMG_LAYOUT(img, TRANSFER_DST_OPTIMAL, SHADER_READ_ONLY_OPTIMAL);
+              batch_end += size;
+              batch_cnt++;
+            }
+            if(batch_cnt)
+            {
+              QVKR(vkEndCommandBuffer(cmd_buf));
+              QVKR(submit_timeline(graph, &cmd_buf));
+              QVKR(wait_timeline(graph, graph->semaphore_value));
             }
           }
         }
@@ -2704,38 +4129,151 @@ VkResult dt_graph_run(
               dt_token_str(node->name));
       }
     }
-    vkUnmapMemory(qvk.device, graph->vkmem_staging);
     double upload_end = dt_time();
     dt_log(s_log_perf, "upload source total:\t%8.3f ms", 1000.0*(upload_end-upload_beg));
+    graph->perf.upload += 1000.0*(upload_end-upload_beg);
+    dt_trace_end(dt_token("upload"), graph->frame);
   }
   if(mutex) threads_mutex_unlock(mutex);
 
-  if(run & s_graph_run_record_cmd_buf)
+  // a full run may find the output of an expensive module in the cache and
+  // only process what is downstream of it, see graph-modcache.h
+  uint8_t recompute[100] = {0};
+  int cut = -1;
+  if(graph->modcache_budget && graph->frame_cnt <= 1 &&
+     (run & s_graph_run_upload_source) && (run & s_graph_run_record_cmd_buf))
   {
-    QVKR(vkBeginCommandBuffer(graph->command_buffer[f], &begin_info));
-    graph->query[f].cnt = 0;
-    vkCmdResetQueryPool(graph->command_buffer[f], graph->query[f].pool, 0, graph->query[f].max);
+    cut = dt_graph_modcache_plan(graph, nodeid, cnt, recompute, dt_connector_vkformat);
+    if(cut >= 0 && graph->cached_module >= 0 && !recompute[graph->cached_module])
+      graph->cached_module = -1; // the inputs kept for it aren't computed in this run
+  }
+  else for(int i=0;i<cnt;i++) graph->node[nodeid[i]].modcache = 0;
+
+  if(run & s_graph_run_record_cmd_buf) for(int i=0;i<cnt;i++)
+  { // kernels specialised on a parameter need a new pipeline when it changed
+    dt_node_t *node = graph->node + nodeid[i];
+    if(!node->spec_cnt || !node->pipeline || !node_spec(node)) continue;
+    QVKR(wait_timeline(graph, graph->semaphore_value)); // the old one may still be in flight
+    vkDestroyPipeline(qvk.device, node->pipeline, 0);
+    node->pipeline = 0;
+    QVKR(create_compute_pipeline(graph, node));
+    memset(graph->record_key, 0, sizeof(graph->record_key)); // the handle may be the same
+  }
+  if(run & (s_graph_run_roi | s_graph_run_create_nodes | s_graph_run_alloc))
+    memset(graph->record_key, 0, sizeof(graph->record_key)); // nodes or images changed
+  const uint64_t key = (run & s_graph_run_record_cmd_buf) ?
+    record_key(graph, run, module_flags, dynamic_array, incremental, active_module, dirty, nodeid, cnt) : 0;
+  if(key && key == graph->record_key[r])
+  { // only parameters changed, submit the same commands again with the new uniforms
+    for(int i=0;i<graph->conn_image_end;i++)
+      graph->conn_image_pool[i].layout = graph->record_layout[r][i];
+    graph->deferred_mask |= graph->record_deferred[r];
+    dt_log(s_log_perf, "record command buffer:\t   reused");
+  }
+  else if(run & s_graph_run_record_cmd_buf)
+  {
+    begin_info.flags = key ? 0 : VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT; // may be submitted again
+    QVKR(vkBeginCommandBuffer(graph->command_buffer[r], &begin_info));
+    const uint32_t deferred = graph->deferred_mask & (1u<<r);
+    graph->deferred_mask &= ~(1u<<r); // find out whether this recording sets it
+    graph->query[r].cnt = 0;
+    vkCmdResetQueryPool(graph->command_buffer[r], graph->query[r].pool, 0, graph->query[r].max);
+    if(graph->pipeline_stats && graph->query[r].stats_pool)
+      vkCmdResetQueryPool(graph->command_buffer[r], graph->query[r].stats_pool, 0, graph->query[r].max/2);
     double rt_beg = dt_time();
+    dt_trace_begin(dt_token("record"), graph->frame);
     int run_all = run & s_graph_run_upload_source;
     int run_mod = module_flags & s_module_request_read_geo;
-    if(run_all || run_mod) QVKR(dt_raytrace_record_command_buffer_accel_build(graph));
+    if(run_all || run_mod || dt_raytrace_compact_pending(graph))
+      QVKR(dt_raytrace_record_command_buffer_accel_build(graph));
     double rt_end = dt_time();
     dt_log(s_log_perf, "create raytrace accel:\t%8.3f ms", 1000.0*(rt_end-rt_beg));
     rt_beg = rt_end;
-    for(int i=0;i<cnt;i++)
-      QVKR(record_command_buffer(graph, graph->node+nodeid[i], run_all ||
-          (graph->node[nodeid[i]].module->flags & s_module_request_read_source)));
+    need_region(graph, nodeid, cnt);
+    graph->barrier_cnt = graph->barrier_mem = 0;
+    const uint32_t levels = dt_graph_barrier_levels(graph, nodeid, cnt);
+    // with side branches, record main nodes up to the fork, the side nodes and
+    // the main nodes after the fork into three command buffers, see graph-async.h
+    const uint32_t fork = graph->async_cnt ? dt_graph_async_fork(graph, nodeid, cnt) : levels;
+    for(int b=0;b<(graph->async_cnt ? 3 : 1);b++)
+    {
+      VkCommandBuffer cmd_buf = b == 0 ? graph->command_buffer[r] : b == 1 ?
+        graph->command_buffer_async[r] : graph->command_buffer_join[r];
+      if(b) QVKR(vkBeginCommandBuffer(cmd_buf, &begin_info));
+      for(uint32_t l=0;l<levels;l++)
+      {
+        if((b == 0 && l > fork) || (b == 2 && l <= fork)) continue;
+        int empty = 1;
+        for(int i=0;i<cnt && empty;i++)
+          if(graph->node[nodeid[i]].level == l && graph->node[nodeid[i]].async == (b == 1)) empty = 0;
+        if(empty) continue;
+        for(int p=s_record_layout;p<=s_record_work;p++)
+        {
+          for(int i=0;i<cnt;i++)
+          {
+            dt_node_t *node = graph->node + nodeid[i];
+            if(node->level != l || node->async != (b == 1)) continue;
+            int runflag = dt_node_source(node) ? run_all || (node->module->flags & s_module_request_read_source) : 1;
+            if(incremental && !dirty[node->module - graph->module])
+            { // output still resident from last time
+              if(p == s_record_layout) memset(node->dirty_rect, 0, sizeof(node->dirty_rect));
+              runflag = 0;
+            }
+            else if(cut >= 0 && !recompute[node->module - graph->module] && !dt_node_source(node))
+            { // upstream of the cut, its output comes from the module cache
+              if(node->modcache)
+              {
+                if(p != s_record_clear) dt_graph_modcache_record(graph, node, p == s_record_layout, cmd_buf);
+                continue;
+              }
+              if(p == s_record_layout) memset(node->dirty_rect, 0, sizeof(node->dirty_rect));
+              runflag = 0;
+            }
+            else if(p == s_record_layout)
+            {
+              dirty_region(graph, node, incremental, active_module);
+              need_clip(node);
+            }
+            QVKR(record_command_buffer(graph, node, runflag, p, cmd_buf));
+            if(runflag && node->modcache && p == s_record_work)
+              dt_graph_modcache_store(graph, node, cmd_buf);
+          }
+          // wait for the levels before and then for the clears
+          if(p == s_record_layout || (p == s_record_clear && (graph->barrier_cnt || graph->barrier_mem)))
+            dt_graph_barrier_flush(graph, cmd_buf);
+        }
+      }
+      if(graph->async_cnt && b == 0) dt_graph_async_fork_layouts(graph, nodeid, cnt);
+      if(graph->barrier_cnt || graph->barrier_mem) dt_graph_barrier_flush(graph, cmd_buf);
+      if(b) QVKR(vkEndCommandBuffer(cmd_buf));
+    }
+    dt_log(s_log_perf, "barrier levels:\t%8u for %d nodes, %d on the side queue", levels, cnt, graph->async_cnt);
     rt_end = dt_time();
     dt_log(s_log_perf, "record command buffer:\t%8.3f ms", 1000.0*(rt_end-rt_beg));
-    QVKR(vkEndCommandBuffer(graph->command_buffer[f]));
+    graph->perf.record += 1000.0*(rt_end-rt_beg);
+    dt_trace_end(dt_token("record"), graph->frame);
+    QVKR(vkEndCommandBuffer(graph->command_buffer[r]));
+    graph->record_deferred[r] = graph->deferred_mask & (1u<<r);
+    graph->deferred_mask |= deferred;
+    graph->record_key[r] = 0;
+    VkImageLayout *layout = key ? realloc(graph->record_layout[r], sizeof(layout[0])*MAX(1, graph->conn_image_end)) : 0;
+    if(layout)
+    { // remember where the barriers leave the images
+      for(int i=0;i<graph->conn_image_end;i++) layout[i] = graph->conn_image_pool[i].layout;
+      graph->record_layout[r] = layout;
+      graph->record_key[r] = key;
+    }
   }
 } // end scope, done with nodes
 
   if(run & s_graph_run_alloc)
   {
-    dt_log(s_log_mem, "images : peak rss %g MB vmsize %g MB",
+    uint64_t free_bytes, largest_free;
+    dt_vkalloc_stats(&graph->heap, &free_bytes, &largest_free);
+    dt_log(s_log_mem, "images : peak rss %g MB vmsize %g MB fragmentation %.1f%%",
         graph->heap.peak_rss/(1024.0*1024.0),
-        graph->heap.vmsize  /(1024.0*1024.0));
+        graph->heap.vmsize  /(1024.0*1024.0),
+        free_bytes ? 100.0*(1.0 - largest_free/(double)free_bytes) : 0.0);
     dt_log(s_log_mem, "buffers: peak rss %g MB vmsize %g MB",
         graph->heap_ssbo.peak_rss/(1024.0*1024.0),
         graph->heap_ssbo.vmsize  /(1024.0*1024.0));
@@ -2744,76 +4282,96 @@ VkResult dt_graph_run(
         graph->heap_staging.vmsize  /(1024.0*1024.0));
   }
 
-  // now upload uniform data before submitting command buffer
+  // now upload uniform data before submitting command buffer. every command buffer in
+  // the ring has its own slot, which still holds what it was submitted with last time
+  // (the memory is host cached). only write the modules whose parameters differ from
+  // that, usually a few keyframed ones, and leave the rest of the slot alone.
 { // module traversal
   dt_module_t *const arr = graph->module;
   const int arr_cnt = graph->num_modules;
-  uint8_t *uniform_mem = 0;
-  QVKR(vkMapMemory(qvk.device, graph->vkmem_uniform, ((uint64_t)f) * graph->uniform_size,
-        graph->uniform_size, 0, (void**)&uniform_mem));
+  uint8_t *uniform_mem = graph->uniform_mapped + ((uint64_t)r) * graph->uniform_size;
   ((uint32_t *)uniform_mem)[0] = graph->frame;
   ((uint32_t *)uniform_mem)[1] = graph->frame_cnt;
+  size_t uniform_written = 0;
 #define TRAVERSE_POST \
   dt_module_t *mod = arr+curr;\
   if(mod->so->commit_params)\
     mod->so->commit_params(graph, mod);\
-  if(mod->committed_param_size)\
-    memcpy(uniform_mem + mod->uniform_offset, mod->committed_param, mod->committed_param_size);\
-  else if(mod->param_size)\
-    memcpy(uniform_mem + mod->uniform_offset, mod->param, mod->param_size);
+  const void *src = mod->committed_param_size ? mod->committed_param : mod->param;\
+  const size_t size = mod->committed_param_size ? mod->committed_param_size : mod->param_size;\
+  if(size && memcmp(uniform_mem + mod->uniform_offset, src, size))\
+  {\
+    memcpy(uniform_mem + mod->uniform_offset, src, size);\
+    uniform_written += size;\
+  }
 #include "graph-traverse.inc"
-  vkUnmapMemory(qvk.device, graph->vkmem_uniform);
+  dt_log(s_log_perf, "uniforms written:\t%8zu of %u bytes", uniform_written, graph->uniform_size);
 }
 
   double clock_end = dt_time();
   dt_log(s_log_perf, "record cmd buffer:\t%8.3f ms", 1000.0*(clock_end - clock_beg));
 
-  VkSubmitInfo submit = {
-    .sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-    .commandBufferCount = 1,
-    .pCommandBuffers    = &graph->command_buffer[f],
-  };
-
   if(run & s_graph_run_record_cmd_buf)
   {
-    vkResetFences(qvk.device, 1, &graph->command_fence[f]);
-    QVKLR(graph->queue_mutex, vkQueueSubmit(graph->queue, 1, &submit, graph->command_fence[f]));
-    if(run & s_graph_run_wait_done) // timeout in nanoseconds, 30 is about 1s
-      QVKR(vkWaitForFences(qvk.device, 1, &graph->command_fence[f], VK_TRUE, 1ul<<40)); // wait for our command buffer
+    const double submit_beg = dt_time();
+    dt_trace_begin(dt_token("submit"), graph->frame);
+    QVKR(submit_ring(graph, r));
+    graph->ring_value[r] = graph->frame_value[f] = graph->semaphore_value;
+    graph->ring_slot = (r + 1) % CLAMP(graph->ring_depth, 2, DT_GRAPH_MAX_RING);
+    if(run & s_graph_run_wait_done)
+    { // timeout in nanoseconds, 30 is about 1s
+      QVKR(wait_timeline(graph, graph->semaphore_value)); // wait for our command buffer
+      graph->ring_done = r;
+    }
     else
-      QVKR(vkWaitForFences(qvk.device, 1, &graph->command_fence[fp], VK_TRUE, 1ul<<40)); // wait for previous command buffer
+    { // keep ring_depth-1 frames in flight, wait for the oldest one (next slot to be recorded)
+      QVKR(wait_timeline(graph, graph->ring_value[graph->ring_slot]));
+      graph->ring_done = graph->ring_slot;
+    }
+    graph->perf.submit += 1000.0*(dt_time() - submit_beg);
+    dt_trace_end(dt_token("submit"), graph->frame);
   }
   
-  // XXX FIXME: this is a race condition for multi-frames. we'll need to wait until download is complete before starting the other command buffer!
-  // XXX FIXME: maybe lock the queue mutex around the whole block?
-  // XXX FIXME: may need an entirely different logic block for single frame?
   if((module_flags & s_module_request_write_sink) ||
      (run & s_graph_run_download_sink))
   {
-    for(int n=0;n<graph->num_nodes;n++)
-    { // for all sink nodes:
-      dt_node_t *node = graph->node + n;
-      if(dt_node_sink(node))
-      {
-        if(node->module->so->write_sink &&
-          ((node->module->flags & s_module_request_write_sink) ||
-           (run & s_graph_run_download_sink)))
+    dt_graph_sink_flush(graph); // at most one frame is being written at a time
+    if(async_sink)
+    { // hand the sinks of this frame to the writer
+      sink_job_setup(graph, run, f);
+      graph->sink_value = graph->semaphore_value;
+      const int taskid = graph->sink_cnt ? threads_task("write sink", 1, -1, graph, sink_job_work, 0) : -1;
+      if(taskid >= 0) graph->sink_task = taskid + 1;
+      else if(graph->sink_cnt) sink_job_work(0, graph); // no thread pool, write here
+    }
+    else
+    {
+      const double sink_beg = dt_time();
+      for(int n=0;n<graph->num_nodes;n++)
+      { // for all sink nodes:
+        dt_node_t *node = graph->node + n;
+        if(dt_node_sink(node))
         {
-          uint8_t *mapped = 0;
-          QVKR(vkMapMemory(qvk.device, graph->vkmem_staging, 0, VK_WHOLE_SIZE,
-                0, (void**)&mapped));
-          node->module->so->write_sink(node->module,
-              mapped + node->connector[0].offset_staging);
-          vkUnmapMemory(qvk.device, graph->vkmem_staging);
+          if(node->module->so->write_sink && !(node->connector[0].flags & s_conn_deferred) &&
+            ((node->module->flags & s_module_request_write_sink) ||
+             (run & s_graph_run_download_sink)))
+          {
+            dt_trace_begin(node->module->name, graph->frame);
+            node->module->so->write_sink(node->module, graph->staging_mapped +
+                node->connector[0].offset_staging + f * node->connector[0].stride_staging);
+            dt_trace_end(node->module->name, graph->frame);
+          }
         }
       }
+      graph->perf.sink += 1000.0*(dt_time() - sink_beg);
     }
   }
+  if(graph->deferred_mask & (1u<<graph->ring_done))
+    read_deferred_sinks(graph, run, graph->ring_done);
 
-  if(dt_log_global.mask & s_log_perf)
+  if((dt_log_global.mask & s_log_perf) || graph->profile || graph->read_queries)
   {
-    int q = fp;
-    if(run & s_graph_run_wait_done) q = f; // if we're synchronous, use the one we just waited for
+    const int q = graph->ring_done; // the latest one we waited for
     if(graph->query[q].cnt) // could store the results just once, but for separation of concerns they are part of the struct:
       QVKR(vkGetQueryPoolResults(qvk.device, graph->query[q].pool,
           0, graph->query[q].cnt,
@@ -2821,6 +4379,8 @@ VkResult dt_graph_run(
           graph->query[q].pool_results,
           sizeof(graph->query[q].pool_results[0]),
           VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+    dt_graph_profile_stats_results(graph, q);
+    if(run & s_graph_run_record_cmd_buf) dt_graph_profile_frame(graph, q);
 
     uint64_t accum_time = 0;
     dt_token_t last_name = 0;
@@ -2841,20 +4401,37 @@ VkResult dt_graph_run(
       }
       last_name = graph->query[q].name[i];
       // i think this is the most horrible line of printf i've ever written:
-      dt_log(s_log_perf, "%-*.*s %-*.*s:\t%8.3f ms",
-          8, 8, dt_token_str(graph->query[q].name  [i]),
-          8, 8, dt_token_str(graph->query[q].kernel[i]),
-          (graph->query[q].pool_results[i+1]-
-          graph->query[q].pool_results[i])* 1e-6 * qvk.ticks_to_nanoseconds);
+      const double ms = (graph->query[q].pool_results[i+1]-
+          graph->query[q].pool_results[i])* 1e-6 * qvk.ticks_to_nanoseconds;
+      dt_node_t *node = graph->node + graph->query[q].nid[i];
+      if(dt_node_source(node) || dt_node_sink(node))
+        dt_log(s_log_perf, "%-*.*s %-*.*s:\t%8.3f ms",
+            8, 8, dt_token_str(graph->query[q].name  [i]),
+            8, 8, dt_token_str(graph->query[q].kernel[i]), ms);
+      else if(dt_log_global.mask & s_log_perf) // bandwidth from the connector sizes, and invocations if we have pipeline statistics
+        dt_log(s_log_perf, "%-*.*s %-*.*s:\t%8.3f ms %8.2f GB/s %10"PRIu64" inv",
+            8, 8, dt_token_str(graph->query[q].name  [i]),
+            8, 8, dt_token_str(graph->query[q].kernel[i]), ms,
+            ms > 0.0 ? (dt_graph_profile_bytes(node, 0) + dt_graph_profile_bytes(node, 1)) / (ms * 1e6) : 0.0,
+            dt_graph_profile_invocations(graph, q, i));
     }
     if(graph->query[q].cnt)
     {
       graph->query[q].last_frame_duration = (graph->query[q].pool_results[graph->query[q].cnt-1]-graph->query[q].pool_results[0])*1e-6 * qvk.ticks_to_nanoseconds;
       dt_log(s_log_perf, "total time:\t%8.3f ms", graph->query[q].last_frame_duration);
+      if(dt_log_global.mask & s_log_perf)
+      {
+        const dt_graph_profile_stats_t st = dt_graph_profile_stats(graph, q);
+        dt_log(s_log_perf, "kernels:\t%8.3f ms %8.2f GB/s %10"PRIu64" inv",
+            st.ms, st.ms > 0.0 ? st.bytes / (st.ms * 1e6) : 0.0, st.invocations);
+      }
     }
   }
   // reset run flags:
   graph->runflags = 0;
+  dt_trace_end(dt_token("run"), graph->frame);
+  const char *trace = dt_trace_poll(); // someone sent SIGUSR1
+  if(trace) dt_log(s_log_pipe|s_log_perf, "trace written to %s", trace);
   return VK_SUCCESS;
 }
 
@@ -2903,17 +4480,26 @@ void dt_graph_reset(dt_graph_t *g)
 #ifdef DEBUG_MARKERS
   dt_stringpool_reset(&g->debug_markers);
 #endif
+  dt_graph_sink_flush(g);
+  for(int i=0;i<g->num_nodes;i++) // keep pipelines for the next cfg, before the raytracing state goes
+    dt_graph_pipecache_put(g, g->node+i);
   dt_raytrace_graph_reset(g);
   g->gui_attached = 0;
   g->gui_msg = 0;
-  g->active_module = 0;
+  g->active_module = -1;
+  g->last_active_module = -1;
+  g->cached_module = -1;
   g->lod_scale = 0;
   g->runflags = 0;
   g->frame = 0;
   g->output_wd = 0;
   g->output_ht = 0;
-  g->thumbnail_image = 0;
-  g->query[0].cnt = g->query[1].cnt = 0;
+  g->output_bound_cnt = 0;
+  g->input_lod = 0;
+  g->precision = 0;
+  memset(&g->perf, 0, sizeof(g->perf));
+  for(int i=0;i<DT_GRAPH_MAX_RING;i++) g->query[i].cnt = 0;
+  memset(g->record_key, 0, sizeof(g->record_key));
   g->params_end = 0;
   for(int i=0;i<g->num_modules;i++)
     if(g->module[i].name && g->module[i].so->cleanup)
@@ -2931,7 +4517,9 @@ void dt_graph_reset(dt_graph_t *g)
     {
       dt_connector_t *c = g->node[i].connector+j;
       if(c->staging) vkDestroyBuffer(qvk.device, c->staging, VK_NULL_HANDLE);
+      if(c->mem_external) vkFreeMemory(qvk.device, c->mem_external, 0);
       c->staging = 0;
+      c->mem_external = 0;
       if(c->array_alloc)
       { // free any potential residuals of dynamic allocation
         dt_vkalloc_cleanup(c->array_alloc);
@@ -2957,77 +4545,169 @@ void dt_graph_reset(dt_graph_t *g)
   g->num_modules = 0;
 }
 
+typedef struct dt_keyframe_sort_t
+{
+  uint32_t param, frame, id;
+}
+dt_keyframe_sort_t;
+
+static int
+dt_keyframe_sort_cmp(const void *a, const void *b)
+{
+  const dt_keyframe_sort_t *ka = a, *kb = b;
+  if(ka->param != kb->param) return ka->param < kb->param ? -1 : 1;
+  if(ka->frame != kb->frame) return (int)ka->frame < (int)kb->frame ? -1 : 1;
+  return ka->id < kb->id ? -1 : ka->id > kb->id;
+}
+
+// the index is laid out as
+//   keyframe_cnt     keyframe ids sorted by (param, frame, id)
+//   num_params + 1   begin of the range of every parameter in the above
+//   num_params       cursor: number of keyframes with frame <= g->frame on the last call
+// keyframes are appended (or overwritten at the same frame) by the gui, so the
+// count is enough to detect stale indices. editors which move or delete them
+// call dt_module_keyframes_changed().
+static uint32_t *
+dt_module_keyframe_index(dt_module_t *mod)
+{
+  const int np = mod->so->num_params, cnt = mod->keyframe_cnt;
+  if(mod->keyframe_index_cnt == cnt) return mod->keyframe_index;
+  mod->keyframe_index = dt_realloc(mod->keyframe_index, &mod->keyframe_index_size, sizeof(uint32_t)*(cnt + 2*np + 1));
+  uint32_t *idx = mod->keyframe_index, *pbeg = idx + cnt, *cur = pbeg + np + 1;
+  dt_keyframe_sort_t *tmp = malloc(sizeof(dt_keyframe_sort_t)*(cnt+1));
+  int n = 0;
+  for(int i=0;i<cnt;i++)
+  {
+    int parid = dt_module_get_param(mod->so, mod->keyframe[i].param);
+    if(parid < 0) continue;
+    tmp[n++] = (dt_keyframe_sort_t){ .param = parid, .frame = mod->keyframe[i].frame, .id = i };
+  }
+  qsort(tmp, n, sizeof(tmp[0]), dt_keyframe_sort_cmp);
+  for(int p=0,i=0;p<=np;p++)
+  {
+    while(i < n && tmp[i].param < p) i++;
+    pbeg[p] = i;
+  }
+  for(int i=0;i<n;i++) idx[i] = tmp[i].id;
+  for(int p=0;p<np;p++) cur[p] = pbeg[p];
+  free(tmp);
+  mod->keyframe_index_cnt = cnt;
+  return idx;
+}
+
 void
+dt_module_keyframes_changed(dt_module_t *mod)
+{
+  mod->keyframe_index_cnt = -1u;
+}
+
+dt_graph_run_t
 dt_graph_apply_keyframes(
     dt_graph_t *g)
 {
+  dt_graph_run_t flags = s_graph_run_none;
   for(int m=0;m<g->num_modules;m++)
   {
-    if(g->module[m].name == 0) continue; // skip deleted modules
-    dt_keyframe_t *kf = g->module[m].keyframe;
-    if(g->module[m].keyframe_cnt) for(int p=0;p<g->module[m].so->num_params;p++)
+    dt_module_t *mod = g->module + m;
+    if(mod->name == 0 || !mod->keyframe_cnt) continue; // skip deleted modules
+    dt_keyframe_t *kf = mod->keyframe;
+    const int np = mod->so->num_params;
+    uint32_t *idx = dt_module_keyframe_index(mod), *pbeg = idx + mod->keyframe_cnt, *cur = pbeg + np + 1;
+    for(int parid=0;parid<np;parid++)
     {
-      int ki = -1, kiM = -1; // find ki.f <= f < kiM.f
-      for(int i=0;i<g->module[m].keyframe_cnt;i++)
-      { // search for max frame smaller than current frame with same param
-        if(kf[i].param == g->module[m].so->param[p]->name)
-        {
-          if(ki == -1) ki = i; // always accept if we don't have any so far
-          else if(kf[ki].frame >  g->frame && kf[i].frame < kf[ki].frame) // if we only have an emergency frame so far use the <
-            ki = i;
-          else if(kf[ki].frame <= g->frame && kf[i].frame <= g->frame && kf[i].frame > kf[ki].frame) // if we have one that is actually lower the new one needs to be <= too
-            ki = i;
+      const uint32_t b = pbeg[parid], e = pbeg[parid+1];
+      if(b == e) continue; // no keyframe for this parameter
+      // find the position pos such that all keyframes before have frame <= g->frame.
+      // try the cursor and its successor first, playback is usually monotonic:
+#define KF_POS_OK(P) (((P) == b || kf[idx[(P)-1]].frame <= g->frame) && ((P) == e || kf[idx[P]].frame > g->frame))
+      uint32_t pos = cur[parid];
+      if(!KF_POS_OK(pos))
+      {
+        if(pos < e && KF_POS_OK(pos+1)) pos++;
+        else
+        { // binary search for the upper bound
+          uint32_t lo = b, hi = e;
+          while(lo < hi)
+          {
+            const uint32_t mid = lo + (hi-lo)/2;
+            if(kf[idx[mid]].frame <= g->frame) lo = mid+1;
+            else hi = mid;
+          }
+          pos = lo;
         }
       }
-      if(ki == -1) continue; // no keyframe for this parameter
-
-      for(int i=0;i<g->module[m].keyframe_cnt;i++)
-      { // now search for later frame to interpolate
-        if(kf[i].param == g->module[m].so->param[p]->name)
-          if(kf[i].frame > g->frame && (kiM == -1 || kf[kiM].frame > kf[i].frame)) kiM = i;
+#undef KF_POS_OK
+      cur[parid] = pos;
+      int ki, kiM = -1;
+      if(pos == b) ki = idx[b]; // all keyframes are later, use the first one without interpolation
+      else
+      { // the first of the ones at the latest frame <= g->frame, interpolate towards the next one
+        uint32_t k = pos-1;
+        while(k > b && kf[idx[k-1]].frame == kf[idx[k]].frame) k--;
+        ki = idx[k];
+        if(pos < e) kiM = idx[pos];
       }
-      if(kiM == ki) kiM = -1; // don't interpolate same frame
-      int parid = dt_module_get_param(g->module[m].so, g->module[m].so->param[p]->name);
-      const dt_ui_param_t *p = g->module[m].so->param[parid];
-      uint8_t *pdat = g->module[m].param + p->offset;
+
+      const dt_ui_param_t *p = mod->so->param[parid];
+      uint8_t *pdat = mod->param + p->offset;
       uint8_t *fdat = kf[ki].data;
       size_t els = dt_ui_param_size(p->type, 1);
-      const float t = (g->frame - kf[ki].frame)/(float)(kf[kiM].frame - kf[ki].frame);
-      if(kiM >= 0 && p->type == dt_token("float")) // TODO: don't search for kiM above in the other cases?
+      uint8_t oldval[256] = {0}; // first element of the old parameter, as the gui passes it to check_params()
+      memcpy(oldval, pdat, MIN(sizeof(oldval)-1, dt_ui_param_size(p->type, p->cnt)));
+      int changed = 0;
+      if(kiM >= 0 && p->type == dt_token("float"))
       { // interpolate generic floating point parameters
+        const float t = (g->frame - kf[ki].frame)/(float)(kf[kiM].frame - kf[ki].frame);
         float *dst = (float *)pdat, *src0 = (float *)fdat, *src1 = (float *)kf[kiM].data;
         for(int i=kf[ki].beg;i<kf[ki].end;i++)
-          dst[i] = t * src1[i-kf[ki].beg] + (1.0f-t) * src0[i-kf[ki].beg];
+        {
+          const float v = t * src1[i-kf[ki].beg] + (1.0f-t) * src0[i-kf[ki].beg];
+          if(dst[i] != v) { dst[i] = v; changed = 1; }
+        }
       }
       else if(kiM >= 0 && p->name == dt_token("draw"))
       { // interpolate drawn list of vertices
+        const float t = (g->frame - kf[ki].frame)/(float)(kf[kiM].frame - kf[ki].frame);
         uint32_t *dst = (uint32_t *)pdat, *src0 = (uint32_t *)fdat, *src1 = (uint32_t *)kf[kiM].data;
         int vcnt = MIN(src0[0], src1[0]); // can only interpolate what we have on both ends
+        if(dst[0] != vcnt) changed = 1;
         dst[0] = vcnt;
         dt_draw_vert_t *vd = (dt_draw_vert_t *)(dst +1);
         dt_draw_vert_t *v0 = (dt_draw_vert_t *)(src0+1);
         dt_draw_vert_t *v1 = (dt_draw_vert_t *)(src1+1);
         for(int i=0;i<vcnt;i++)
         {
+          dt_draw_vert_t v;
           if(dt_draw_eq(v0[i], dt_draw_endmarker()) ||
              dt_draw_eq(v1[i], dt_draw_endmarker()))
           { // use symmetric end markers
-            vd[i] = dt_draw_endmarker();
+            v = dt_draw_endmarker();
           }
           else
           { // interpolate properties
             // XXX FIXME: beg and end are currently not supported. once we have a "draw" type they should mean
             // XXX FIXME: vertex indices, i.e. this here would need to be v0[i - kf[ki].beg] and the loop above
             // XXX FIXME: would need to be MIN(vcnt, kf[ki].end-kf[ki].beg)
-            vd[i] = dt_draw_mix(v0[i], v1[i], t);
+            v = dt_draw_mix(v0[i], v1[i], t);
           }
+          if(memcmp(vd+i, &v, sizeof(v))) { vd[i] = v; changed = 1; }
         }
-        g->module[m].flags = s_module_request_read_source; // make sure the draw list is updated
+        if(changed) mod->flags = s_module_request_read_source; // make sure the draw list is updated
       }
       else
       { // apply directly
-        memcpy(pdat, fdat + els*kf[ki].beg, els*(kf[ki].end-kf[ki].beg));
+        const size_t off = els*kf[ki].beg, sz = els*(kf[ki].end-kf[ki].beg);
+        if(memcmp(pdat, fdat + off, sz))
+        {
+          memcpy(pdat, fdat + off, sz);
+          changed = 1;
+        }
       }
+      if(!changed) continue;
+      if(mod->so->check_params) flags |= mod->so->check_params(mod, parid, oldval);
+      flags |= s_graph_run_record_cmd_buf;
     }
   }
+  // only the passes, the caller decides about uploads, downloads and waiting:
+  return flags & (s_graph_run_roi | s_graph_run_create_nodes | s_graph_run_alloc | s_graph_run_record_cmd_buf);
 }
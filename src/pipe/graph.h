@@ -3,6 +3,7 @@
 #include "module.h"
 #include "alloc.h"
 #include "raytrace.h"
+#include <stdio.h>
 #ifdef DEBUG_MARKERS
 #include "db/db.h"         // for string pool type
 #endif
@@ -23,6 +24,31 @@ typedef struct dt_connector_image_t
 }
 dt_connector_image_t;
 
+#define DT_GRAPH_SRCCACHE_MAX 16
+typedef struct dt_graph_srccache_t
+{ // device copy of the output of a static source node, see graph-srccache.h
+  uint64_t              key;      // content key, 0 if the slot is free
+  uint64_t              size;     // bytes of device memory
+  uint64_t              used;     // value of srccache_clock when last used, for lru eviction
+  int                   valid;    // the image holds the data
+  VkDeviceMemory        vkmem;
+  dt_connector_image_t  img;      // image and layout
+}
+dt_graph_srccache_t;
+
+#define DT_GRAPH_MODCACHE_MAX 8 // entries with device copies of module outputs, see graph-modcache.h
+
+#define DT_GRAPH_PIPECACHE_MAX 256
+typedef struct dt_graph_pipecache_t
+{ // compute pipeline of a node, see graph-pipecache.h
+  uint64_t              key;      // node and binding layout, 0 if the slot is free
+  uint64_t              used;     // value of pipecache_clock when stored, for lru eviction
+  VkDescriptorSetLayout dset_layout;
+  VkPipelineLayout      pipeline_layout;
+  VkPipeline            pipeline;
+}
+dt_graph_pipecache_t;
+
 typedef struct dt_graph_query_t
 {
   uint32_t     max;
@@ -31,10 +57,37 @@ typedef struct dt_graph_query_t
   uint64_t    *pool_results;
   dt_token_t  *name;
   dt_token_t  *kernel;
+  uint32_t    *nid;                 // node that wrote the timestamp
   float        last_frame_duration; // for convenience the last frame time in milliseconds
+  VkQueryPool  stats_pool;          // pipeline statistics of the kernel of timestamp pair i at i/2, if supported
+  uint64_t    *stats_results;       // compute shader invocations and availability, per pair
 }
 dt_graph_query_t;
 
+// wall clock milliseconds spent in the passes of dt_graph_run(). they add up
+// over all runs since dt_graph_init() or dt_graph_reset(), see vkdt-cli --bench.
+typedef struct dt_graph_perf_t
+{
+  double parse;  // dt_graph_load_config(), if it went through dt_graph_export()
+  double roi;    // modify_roi_out()
+  double nodes;  // modify_roi_in() and create_nodes()
+  double alloc;  // memory, descriptor sets and pipelines
+  double upload; // read_source() into staging memory
+  double record; // command buffer recording
+  double submit; // submit and wait for the gpu
+  double sink;   // write_sink()
+  int    runs;
+}
+dt_graph_perf_t;
+
+// size to fit the sink of this instance into, as output_wd/ht does for "main"
+typedef struct dt_graph_output_bound_t
+{
+  dt_token_t inst;
+  int        wd, ht;
+}
+dt_graph_output_bound_t;
+
 // the graph is stored as list of modules and list of nodes.
 // these have connectors with detailed buffer information which
 // also hold the id to the other connected module or node. thus,
@@ -47,6 +100,7 @@ typedef struct dt_graph_t
 {
   dt_module_t *module;
   uint32_t num_modules, max_modules;
+  int *topo_module; // module ids in topological order, see cycles.h
 
   dt_node_t *node;
   uint32_t num_nodes, max_nodes;
@@ -56,11 +110,14 @@ typedef struct dt_graph_t
   uint8_t              *params_pool;
   uint32_t              params_end, params_max;
 
-  // store full history in this block:
+  // store full history in this block, grows as needed, see graph-history.h:
   char                 *history_pool;
   uint32_t              history_max;
-  char                **history_item;
+  char                **history_item;        // cfg lines, or labels of binary parameter changes
+  struct dt_graph_history_delta_t **history_delta; // binary parameter change of item i, or 0
   uint32_t              history_item_cur, history_item_end, history_item_max;
+  uint8_t              *history_shadow;      // params_pool as recorded by the history up to history_item_cur
+  uint32_t              history_shadow_end;  // valid bytes in history_shadow
 
   // memory pool for connector allocations
   dt_connector_image_t *conn_image_pool;
@@ -76,17 +133,47 @@ typedef struct dt_graph_t
   VkDeviceMemory        vkmem;
   VkDeviceMemory        vkmem_ssbo;
   VkDeviceMemory        vkmem_staging;
+  uint8_t              *staging_mapped;      // persistently mapped vkmem_staging
   VkDescriptorPool      dset_pool;
-  VkCommandBuffer       command_buffer[2];   // two per graph, to interleave cpu load, uploads and gpu compute
+  VkCommandBuffer       command_buffer[DT_GRAPH_MAX_RING]; // ring per graph, to interleave cpu load, uploads and gpu compute
+  VkCommandBuffer       command_buffer_async[DT_GRAPH_MAX_RING]; // side branches on queue_async, see graph-async.h
+  VkCommandBuffer       command_buffer_join[DT_GRAPH_MAX_RING];  // main nodes after the fork
   VkCommandPool         command_pool;
-  VkFence               command_fence[2];    // one per command buffer
+  VkSemaphore           semaphore;           // timeline semaphore, counts submissions
+  uint64_t              semaphore_value;     // value signalled by the latest submission
+  uint64_t              ring_value[DT_GRAPH_MAX_RING];   // value signalled by the last use of each command buffer
+  uint64_t              frame_value[DT_GRAPH_MAX_FRAMES]; // value of the last submission using odd/even images
+  uint32_t              ring_depth;          // number of frames in flight, 2..DT_GRAPH_MAX_RING
+  uint32_t              ring_slot;           // command buffer, uniform and query slot to record next
+  uint32_t              ring_done;           // slot of the latest frame known to be complete
+  uint32_t              deferred_mask;       // ring slots with downloads of s_conn_deferred sinks not yet read
+  uint64_t              record_key[DT_GRAPH_MAX_RING];      // what each command buffer was recorded from, 0 if it can't be submitted again
+  uint32_t              record_deferred[DT_GRAPH_MAX_RING]; // deferred_mask bits set by that recording
+  VkImageLayout        *record_layout[DT_GRAPH_MAX_RING];   // layouts of conn_image_pool after that recording
+  struct dt_graph_barrier_t *barrier;        // layout transitions waiting for the next barrier, see graph-barrier.h
+  uint32_t              barrier_cnt, barrier_max;
+  int                   barrier_mem;         // the next barrier is needed for buffer writes even without transitions
+  int                   sink_task;           // 1 + task id of the write_sink() job in flight, or 0
+  uint64_t              sink_value;          // timeline value the job waits for before reading staging
+  int                   sink_frame;          // odd/even staging slot the job reads
+  uint32_t              sink_cnt;            // number of sinks written by the job
+  uint32_t             *sink_node;           // sink nodes written by the job
+  dt_module_t          *sink_module;         // copies of their modules, with parameters as of the frame
+  uint8_t              *sink_param;          // storage for these parameters
+  size_t                sink_param_size;
   VkQueue               queue;
   void                 *queue_mutex;         // if this is set to != 0 will be locked when the queue is used
   uint32_t              queue_idx;
+  VkQueue               queue_async;         // optional second queue of the same family for side branches, or 0
+  void                 *queue_async_mutex;
+  int                   async_cnt;           // number of nodes running on queue_async
+  uint64_t              async_value;         // timeline value signalled by the last side branch submission
   int                   float_atomics_supported; // copy from qvk to pass down to modules
+  int                   coopmat_supported;       // same for cooperative matrices
 
   VkBuffer              uniform_buffer;      // uniform buffer shared between all nodes
   VkDeviceMemory        vkmem_uniform;
+  uint8_t              *uniform_mapped;      // vkmem_uniform, mapped for the lifetime of the allocation
   uint32_t              uniform_size;        // size of the total uniform buffer
   uint32_t              uniform_global_size; // size of the global section
   VkDescriptorSetLayout uniform_dset_layout; // same layout for all nodes
@@ -95,10 +182,32 @@ typedef struct dt_graph_t
 
   size_t                vkmem_size;          // allocation sizes to tell whether we need to re-alloc
   size_t                vkmem_ssbo_size;
-  size_t                vkmem_staging_size;
+  int                   vkmem_ssbo_address;  // vkmem_ssbo can hold buffers with device addresses (accel build scratch)
+  size_t                vkmem_staging_size;  // may be larger than heap_staging needs, see staging_alloc()
+  uint32_t              vkmem_staging_type;  // memory type index, to hand the block to another graph
   size_t                vkmem_uniform_size;
 
-  dt_graph_query_t      query[2];            // for odd and even command buffers, starting at half query_max
+  dt_graph_srccache_t   srccache[DT_GRAPH_SRCCACHE_MAX]; // kept across dt_graph_reset()
+  uint64_t              srccache_size;       // device memory of all cached sources
+  uint64_t              srccache_clock;      // counts source uploads
+
+  dt_graph_srccache_t   modcache[DT_GRAPH_MODCACHE_MAX]; // kept across dt_graph_reset()
+  uint64_t              modcache_size;       // device memory of all cached module outputs
+  uint64_t              modcache_budget;     // bytes the module cache may use, 0 disables it
+  uint64_t              modcache_clock;      // counts full runs
+
+  dt_graph_pipecache_t  pipecache[DT_GRAPH_PIPECACHE_MAX]; // kept across dt_graph_reset()
+  uint64_t              pipecache_clock;     // counts stored entries
+
+  dt_graph_query_t      query[DT_GRAPH_MAX_RING]; // one per command buffer
+  FILE                 *profile;             // if set, write timestamp queries as trace events here, see graph-profile.h
+  uint32_t              profile_cnt;         // number of events written so far
+  uint64_t              profile_t0;          // CLOCK_MONOTONIC ns at dt_graph_profile_begin(), to start the trace at zero
+  uint64_t              profile_gpu_ref;     // a gpu timestamp and the CLOCK_MONOTONIC ns at the same time,
+  uint64_t              profile_cpu_ref;     // see dt_graph_profile_calibrate()
+  dt_graph_perf_t       perf;                // cpu side timings of the passes
+  int                   read_queries;        // read back the timestamp queries after every run, for the gui
+  int                   pipeline_stats;      // also record pipeline statistics around every kernel, see graph-profile.h
 
   uint32_t              dset_cnt_image_read,  dset_cnt_image_read_alloc;
   uint32_t              dset_cnt_image_write, dset_cnt_image_write_alloc;
@@ -107,16 +216,21 @@ typedef struct dt_graph_t
 
   dt_graph_run_t        runflags;      // used to trigger next runflags/invalidate things
   int                   lod_scale;     // scale output down by this factor. default = 1.
-  int                   active_module; // currently active module, relevant for runflags
+  int                   active_module; // currently active module, relevant for runflags. reset to -1 after run
+  int                   last_active_module; // active module of the previous run
+  int                   cached_module; // memory is planned to keep the inputs of this module resident, or -1
 
   int                   frame;
   int                   frame_cnt;     // number of frames to compute
   double                frame_rate;    // frame rate (frames per second)
 
-  // scale output resolution to fit and copy the main display to the given buffer:
-  VkImage               thumbnail_image;
+  // scale output resolution to fit:
   int                   output_wd;
   int                   output_ht;
+  int                   output_bound_cnt; // further sinks with their own bounds, see dt_graph_export()
+  dt_graph_output_bound_t output_bound[20];
+  int                   input_lod;     // sources may decode at reduced resolution to fit output_wd/ht (thumbnails)
+  int                   precision;     // 0 half float intermediates where modules allow it, 1 full f32 (cfg precision:full), -1 also pack s_conn_compact outputs (precision:compact)
   void                 *io_mutex;      // if this is set to != 0 will be locked during read_source() calls
 
   int                   gui_attached;  // can't free the output images while still used etc.
@@ -135,12 +249,28 @@ void dt_graph_init(dt_graph_t *g);     // init
 void dt_graph_cleanup(dt_graph_t *g);  // cleanup, free memory
 void dt_graph_reset(dt_graph_t *g);    // lightweight reset, keep allocations
 
+// display and thumb sinks don't own an image, the node's input aliases the
+// output of the node upstream. the gui samples that directly, no copy involved.
 dt_node_t *dt_graph_get_display(dt_graph_t *g, dt_token_t  which);
 
 VkResult dt_graph_run(
     dt_graph_t     *graph,
     dt_graph_run_t  run);
 
+// wait for the write_sink() job of a run with s_graph_run_async_sink to finish
+void dt_graph_sink_flush(dt_graph_t *graph);
+
+// save the images carrying state from one frame to the next (feedback
+// connectors) together with graph->frame, see graph-checkpoint.h
+VkResult dt_graph_checkpoint_write(dt_graph_t *graph, const char *filename);
+// number of images which would go into a checkpoint, 0 if frames don't depend on earlier ones
+uint32_t dt_graph_checkpoint_cnt(dt_graph_t *graph);
+// return the frame stored in the checkpoint file, or -1
+int dt_graph_checkpoint_frame(const char *filename);
+// upload the state from the checkpoint into the allocated images of the graph.
+// returns the frame it was saved after, or -1 if it doesn't match the graph.
+int dt_graph_checkpoint_read(dt_graph_t *graph, const char *filename);
+
 void dt_token_print(dt_token_t t);
 
 VkResult dt_graph_create_shader_module(
@@ -161,10 +291,16 @@ dt_graph_connector_image(
 
 // apply all keyframes found in the module list and write to the modules parameters according to
 // the current frame in the graph (g->frame). floating point parameters will be interpolated.
-void
+// only parameters whose value changes are written. returns the passes these changes require,
+// as the modules' check_params() report them, or s_graph_run_none.
+dt_graph_run_t
 dt_graph_apply_keyframes(
     dt_graph_t *g);
 
+// keyframes of the module have been moved or deleted, rebuild the index
+// dt_graph_apply_keyframes() uses to look them up.
+void dt_module_keyframes_changed(dt_module_t *mod);
+
 static inline dt_token_t
 dt_node_get_instance(
     dt_node_t *node)
@@ -30,6 +30,10 @@ int dt_module_add(
       return -1;
     }
     modid = graph->num_modules++;
+    // new modules aren't connected yet, append to the topological order.
+    // recycled ones keep their position, it's as good as any.
+    graph->module[modid].topo = modid;
+    graph->topo_module[modid] = modid;
   }
 
   dt_module_t *mod = graph->module + modid;
@@ -41,6 +45,8 @@ int dt_module_add(
   mod->committed_param = 0;
   mod->flags = 0;
   mod->keyframe_cnt = 0;
+  mod->keyframe_index_cnt = -1u;
+  mod->bind_cnt = 0;
 
   // copy over initial info from module class:
   for(int i=0;i<dt_pipe.num_modules;i++)
@@ -48,6 +54,7 @@ int dt_module_add(
     if(name == dt_pipe.module[i].name)
     {
       mod->so = dt_pipe.module + i;
+      dt_module_so_dlopen(dt_pipe.module + i);
       // init params:
       mod->param_size = 0;
       if(mod->so->num_params)
@@ -139,6 +146,10 @@ int dt_module_remove(
   graph->module[modid].keyframe_size = 0;
   graph->module[modid].keyframe_cnt = 0;
   graph->module[modid].keyframe = 0;
+  free(graph->module[modid].keyframe_index);
+  graph->module[modid].keyframe_index_size = 0;
+  graph->module[modid].keyframe_index_cnt = -1u;
+  graph->module[modid].keyframe_index = 0;
   return 0;
 }
 
@@ -179,6 +190,49 @@ int dt_module_get_module_before(const dt_graph_t *graph, const dt_module_t *us,
   return us->connector[conn].connected_mi;
 }
 
+int dt_module_bind(
+    dt_graph_t *graph,
+    int         m0,
+    int         c0,
+    int         m1,
+    dt_token_t  param,
+    uint32_t    word)
+{
+  if(m1 < 0 || m1 >= graph->num_modules || graph->module[m1].name == 0) return 1;
+  if(m0 >= 0 && c0 < 0) return 8;
+  dt_module_t *mod = graph->module + m1;
+  const int parid = dt_module_get_param(mod->so, param);
+  // committed params are laid out differently in the uniforms
+  if(parid < 0 || mod->committed_param_size) return 13;
+  const dt_token_t type = mod->so->param[parid]->type;
+  if(type != dt_token("float") && type != dt_token("int")) return 13;
+  int b = 0;
+  for(;b<mod->bind_cnt;b++) if(mod->bind[b].parid == parid) break;
+  if(b == mod->bind_cnt)
+  { // add an input connector named after the parameter
+    if(m0 < 0) return 0; // nothing to disconnect
+    if(b >= DT_MODULE_MAX_BIND || mod->num_connectors >= DT_MAX_CONNECTORS-1 ||
+       dt_module_get_connector(mod, param) >= 0) return 13;
+    const int mc = mod->num_connectors++;
+    mod->connector[mc] = (dt_connector_t){
+      .name = param, .type = dt_token("read"), .chan = dt_token("ssbo"), .format = dt_token("*"),
+      .connected_mi = -1, .connected_mc = -1, .associated_i = -1, .associated_c = -1,
+      .bypass_mi = -1, .bypass_mc = -1, .array_length = 1,
+    };
+    mod->bind[mod->bind_cnt++] = (dt_module_bind_t){ .parid = parid, .mc = mc };
+  }
+  dt_module_bind_t *bd = mod->bind + b;
+  dt_connector_t *c = mod->connector + bd->mc;
+  bd->word = word;
+  // the connector has no counterpart in the module class, which disconnecting resets to:
+  int err = dt_module_connect(graph, -1, -1, m1, bd->mc);
+  c->chan   = dt_token("ssbo");
+  c->format = dt_token("*");
+  if(!err && m0 >= 0) err = dt_module_connect(graph, m0, c0, m1, bd->mc);
+  c->flags |= s_conn_bind;
+  return err;
+}
+
 void dt_module_reset_params(dt_module_t *mod)
 {
   if(mod->name == 0) return; // skip deleted modules
@@ -64,6 +64,18 @@ typedef struct dt_keyframe_t
 }
 dt_keyframe_t;
 
+// a parameter which is read from a storage buffer written earlier in the same
+// submission, instead of from the cpu. see dt_module_bind().
+typedef struct dt_module_bind_t
+{
+  int      parid;   // the parameter
+  int      mc;      // input connector on the module, named after the parameter
+  uint32_t word;    // the values start at this 32-bit word of the buffer
+}
+dt_module_bind_t;
+
+#define DT_MODULE_MAX_BIND 4
+
 // this is an instance of a module.
 typedef struct dt_module_t
 {
@@ -90,6 +102,8 @@ typedef struct dt_module_t
 
   int disabled;         // the ui may choose to switch off modules for a test/interaction.
                         // this can only be 1 if the so->has_inout_chain set.
+  int bypassed;         // the nodes were created passing input to output, see dt_module_bypassed(). -1 without nodes
+  int topo;             // position in the topological order of the graph, see cycles.h
 
   // parameters:
   // human facing parameters for gui + serialisation
@@ -102,6 +116,9 @@ typedef struct dt_module_t
   uint32_t       keyframe_cnt;  // number of keyframes
   uint64_t       keyframe_size; // allocation size
   dt_keyframe_t *keyframe;      // dynamically allocated keyframe array
+  uint32_t       keyframe_index_cnt;  // keyframe_cnt the index was built for, -1u to rebuild
+  uint64_t       keyframe_index_size; // allocation size
+  uint32_t      *keyframe_index;      // keyframes sorted by param and frame + per param ranges and cursors
 
   // these stay 0 unless inited by the module in init().
   // if the module implements commit_params(), it shall be used
@@ -110,6 +127,9 @@ typedef struct dt_module_t
   uint8_t *committed_param;
   int      committed_param_size;
 
+  dt_module_bind_t bind[DT_MODULE_MAX_BIND]; // parameters bound to storage buffers
+  int              bind_cnt;
+
   uint32_t uniform_offset; // offset into global uniform buffer
   uint32_t uniform_size;   // size of module params padded to 16 byte multiples
 
@@ -149,5 +169,21 @@ int dt_module_get_module_after(
     int               *c_out,      // buffer to store input connector ids
     int                max_cnt);   // size of the argument buffers
 
+// the graph passes the input of disabled modules and modules which are an
+// identity for their current parameters straight through to the output.
+static inline int
+dt_module_bypassed(dt_module_t *m)
+{
+  return m->disabled || (m->so->has_inout_chain && m->so->identity && m->so->identity(m));
+}
+
+// bind the float or int parameter of module m1 to the storage buffer written
+// by connector c0 of module m0, starting at the given 32-bit word. this adds
+// an input connector named after the parameter to m1, which makes m0 run
+// first. before the nodes of m1 run, the gpu copies the values over the
+// parameter in the uniforms, so they never go through the cpu. returns 0 or
+// an error as dt_module_connect(). m0 = -1 disconnects the binding again.
+int dt_module_bind(dt_graph_t *graph, int m0, int c0, int m1, dt_token_t param, uint32_t word);
+
 // reset all parameters to their defaults
 void dt_module_reset_params(dt_module_t *mod);
@@ -0,0 +1,54 @@
+#include "modules/api.h"
+
+// every side reads a bit more than it shows, so dragging the split around
+// does not have to run the graph upstream every time.
+static inline int
+ab_margin(int wd)
+{
+  return MAX(8, wd/16);
+}
+
+dt_graph_run_t
+check_params(
+    dt_module_t *module,
+    uint32_t     parid,
+    void        *oldval)
+{
+  const dt_graph_t *graph = module->graph;
+  const float split = dt_module_param_float(module, 0)[0];
+  for(int i=0;i<graph->num_nodes;i++)
+  { // compare to the regions our node was created with
+    const dt_node_t *node = graph->node + i;
+    if(node->module != module) continue;
+    const int x = split * node->wd;
+    const int32_t *ra = node->connector[0].read_rect, *rb = node->connector[1].read_rect;
+    if((ra[2] && x + 1 > ra[0] + ra[2]) || (rb[2] && x - 1 < rb[0]))
+      return s_graph_run_all; // need more of a branch than upstream computes
+  }
+  return s_graph_run_record_cmd_buf;
+}
+
+void
+create_nodes(
+    dt_graph_t  *graph,
+    dt_module_t *module)
+{
+  const float split = dt_module_param_float(module, 0)[0];
+  dt_roi_t *roi = &module->connector[2].roi;
+  const int id = dt_node_add(graph, module, "ab", "main",
+      roi->wd, roi->ht, 1, 0, 0, 3,
+      "input",  "read",  "*", "*", &module->connector[0].roi,
+      "inputb", "read",  "*", "*", &module->connector[1].roi,
+      "output", "write", "*", "*", roi);
+  for(int i=0;i<3;i++) dt_connector_copy(graph, module, i, id, i);
+  dt_node_t *node = graph->node + id;
+  node->dirty_support = 1; // per pixel
+  if(module->connector[0].roi.wd != roi->wd || module->connector[1].roi.wd != roi->wd) return;
+  // a is only visible left of the split and b right of it, let the nodes
+  // upstream skip the rest (see need_region() in graph.c)
+  const int x = split * roi->wd, m = ab_margin(roi->wd);
+  const int ax = MIN((int)roi->wd, MAX(0, x + m)), bx = MIN((int)roi->wd-1, MAX(0, x - m));
+  int32_t *ra = node->connector[0].read_rect, *rb = node->connector[1].read_rect;
+  ra[0] = 0;  ra[1] = 0; ra[2] = MAX(1, ax);           ra[3] = roi->ht;
+  rb[0] = bx; rb[1] = 0; rb[2] = roi->wd - bx; rb[3] = roi->ht;
+}
@@ -82,10 +82,14 @@ create_nodes(
   const char *fmt_img = "f16";// "ui8";
   const char *fmt_dst = "f16";// "ui8";
 
+  // without alignsrc we align to the previous frame of aligndst. its pyramid
+  // has been built during the last frame already, so we keep the levels in
+  // double buffered feedback connectors and only build one pyramid per frame.
+  const int temporal = !dt_connected(module->connector+2);
   int id_down[2][num_levels];
   uint32_t *blacki = (uint32_t *)img_param->black;
   uint32_t *whitei = (uint32_t *)img_param->white;
-  for(int k=0;k<2;k++)
+  for(int k=0;k<2-temporal;k++)
   {
     int pc[] = { blacki[0], blacki[1], blacki[2], blacki[3],
         whitei[0], whitei[1], whitei[2], whitei[3],
@@ -118,7 +122,10 @@ create_nodes(
         "output", "write", "y", fmt_dst, roi+i+1);
     graph->node[id_dist].connector[3].array_length = 25;
     CONN(dt_node_connect(graph, id_down[0][i], 1, id_dist, 0));
-    CONN(dt_node_connect(graph, id_down[1][i], 1, id_dist, 1));
+    if(temporal) // last frame's level
+      CONN(dt_node_feedback(graph, id_down[0][i], 1, id_dist, 1));
+    else
+      CONN(dt_node_connect(graph, id_down[1][i], 1, id_dist, 1));
     if(id_offset >= 0)
       CONN(dt_node_connect(graph, id_offset, 2, id_dist, 2));
     else // need to connect a dummy
@@ -146,7 +153,7 @@ create_nodes(
     if(id_offset >= 0)
       CONN(dt_node_connect(graph, id_offset, 2, id_merge, 1));
     else // need to connect a dummy
-      CONN(dt_node_connect(graph, id_down[1][i], 1, id_merge, 1));
+      CONN(dt_node_connect(graph, id_down[0][i], 1, id_merge, 1));
     // remember our merged output as offset for next finer scale:
     id_offset = id_merge;
     // id_offset is the final merged offset buffer on this level, ready to be
@@ -20,6 +20,7 @@ typedef enum
   s_graph_run_download_sink  = 1<<5, // final : download sink images
   s_graph_run_wait_done      = 1<<6, // wait for fence
   s_graph_run_before_active  = 1<<7, // run all modules, even before active_module
+  s_graph_run_async_sink     = 1<<8, // without wait_done: write_sink() on the thread pool while the gpu does the next frame
   s_graph_run_all = -1u,
 } dt_graph_run_constants_t;
 
@@ -50,6 +51,42 @@ dt_node_sink(dt_node_t *n)
   return n->connector[0].type == dt_token("sink");
 }
 
+// input modules which can decode at reduced resolution (such as jpeg dct
+// scaling) ask here in modify_roi_out() by which power of two they may scale
+// down, at most max_scale. this keeps at least twice the output resolution so
+// the final resampling still has something to work with. returns 1 for full
+// resolution, which is what all interactive graphs get.
+static inline int
+dt_graph_input_lod(
+    const dt_graph_t *graph,
+    uint32_t          full_wd,
+    uint32_t          full_ht,
+    int               max_scale)
+{
+  if(!graph->input_lod || graph->output_wd <= 0 || graph->output_ht <= 0) return 1;
+  const float fx = full_wd / (float)graph->output_wd, fy = full_ht / (float)graph->output_ht;
+  const float f = fx > fy ? fx : fy;
+  int s = 1;
+  while(2*s <= max_scale && 2*s*2 <= f) s *= 2;
+  return s;
+}
+
+// coarse previews (progressive refinement while dragging, thumbnails) may
+// trade quality for speed. 1:1 views and exports return 0 here.
+static inline int
+dt_graph_preview(const dt_graph_t *graph)
+{
+  return graph->lod_scale >= 2 || graph->input_lod;
+}
+
+// storage format for intermediate buffers which are fine in half float but
+// follow the precision policy of the graph (cfg `precision:full` for f32)
+static inline const char *
+dt_api_precision(const dt_graph_t *graph)
+{
+  return graph->precision > 0 ? "f32" : "f16";
+}
+
 #ifndef __cplusplus
 static inline void
 dt_connector_copy(
@@ -79,6 +116,8 @@ dt_connector_copy(
     c1->connected_mc = c0->connected_mc;
     c1->array_length = c0->array_length;
     c1->array_dim    = c0->array_dim;
+    c1->staging_row_length = c0->staging_row_length;
+    c1->staging_skip       = c0->staging_skip;
   }
 
   // node connectors need to know their counterparts.
@@ -447,6 +486,17 @@ dt_api_blur_sub(
   return nid_input;
 }
 
+// largest radius of the shared memory tiled separable kernels, see blur_head.glsl
+#define DT_API_BLUR_SEP_MAX 16
+
+// the tiled kernels are not built by default yet, see shared/flat.mk
+static inline int
+dt_api_blur_tiled()
+{
+  return dt_pipe_shader_exists(dt_token("shared"), dt_token("blurth")) &&
+         dt_pipe_shader_exists(dt_token("shared"), dt_token("blurtv"));
+}
+
 // create new nodes, connect to given input node + connector id, perform blur
 // of given pixel radius, return nodeid (output connector will be #1).
 // this uses separated h/v passes.
@@ -468,8 +518,9 @@ dt_api_blur_sep(
   const uint32_t ht = conn_input->roi.ht;
   const uint32_t dp = conn_input->array_length > 0 ? conn_input->array_length : 1;
   uint32_t *irad = (uint32_t *)&radius;
-  dt_token_t blurh = dt_token("blurh");
-  dt_token_t blurv = dt_token("blurv");
+  const int tiled = radius <= DT_API_BLUR_SEP_MAX && dt_api_blur_tiled();
+  dt_token_t blurh = dt_token(tiled ? "blurth" : "blurh");
+  dt_token_t blurv = dt_token(tiled ? "blurtv" : "blurv");
   dt_connector_t ci = {
     .name   = dt_token("input"),
     .type   = dt_token("read"),
@@ -517,17 +568,20 @@ dt_api_blur_sep(
     .push_constant = {irad[0]},
   };
   // interconnect nodes:
-  CONN(dt_node_connect(graph, nodeid_input,  connid_input, id_blurh, 0));
+  if(nodeid_input >= 0)
+    CONN(dt_node_connect(graph, nodeid_input,  connid_input, id_blurh, 0));
+  else
+    dt_connector_copy(graph, module, connid_input, id_blurh, 0);
   CONN(dt_node_connect(graph, id_blurh,      1,            id_blurv, 0));
   if(id_blur_in ) *id_blur_in  = id_blurh;
   if(id_blur_out) *id_blur_out = id_blurv;
   return id_blurv;
 }
 
-// generic blur, selecting some mix of separable/small/subsampled blur
-// to best reach the given radius goal
+// blur by radius using the subsampled cascade only and a separable blur for
+// the remainder. approximate, but cheap for very large radii.
 static inline int
-dt_api_blur(
+dt_api_blur_pyramid(
     dt_graph_t  *graph,
     dt_module_t *module,
     int          nodeid_input,
@@ -536,15 +590,6 @@ dt_api_blur(
     int         *id_blur_out,
     float        radius)        // 2 sigma of the requsted blur, in pixels
 {
-  if(radius < 2)
-    return dt_api_blur_3x3(graph, module, nodeid_input, connid_input,
-        id_blur_in, id_blur_out, 0.5f*radius);
-  if(radius == 2)
-    return dt_api_blur_5x5(graph, module, nodeid_input, connid_input, id_blur_in, id_blur_out);
-  // XXX DEBUG XXX frustratingly that is much faster even for relatively large blurs it seems
-  // TODO: probably go straight here for smaller radii
-    // return dt_api_blur_sep(graph, module, nodeid_input, connid_input,
-     //    id_blur_in, id_blur_out, radius);
   // let's separate the blur in several passes.
   // we'll do as many steps of subsampled blur as we can, because
   // these are fast.
@@ -606,6 +651,321 @@ dt_api_blur(
   }
 }
 
+// recursive gaussian blur (young and van vliet), constant cost per pixel
+// for any radius. this is a causal and an anti-causal pass over the rows,
+// followed by the same over the columns. one invocation per line, so this
+// is opt in until it has been benchmarked against dt_api_blur_pyramid().
+static inline int
+dt_api_blur_iir(
+    dt_graph_t  *graph,
+    dt_module_t *module,
+    int          nodeid_input,
+    int          connid_input,
+    int         *id_blur_in,
+    int         *id_blur_out,
+    float        radius)        // 2 sigma of the requested blur, in pixels
+{
+  if(!dt_pipe_shader_exists(dt_token("shared"), dt_token("iir"))) // not built by default
+    return dt_api_blur_pyramid(graph, module, nodeid_input, connid_input,
+        id_blur_in, id_blur_out, radius);
+  const dt_connector_t *conn_input = nodeid_input >= 0 ?
+    graph->node[nodeid_input].connector + connid_input :
+    module->connector + connid_input;
+  const uint32_t wd = conn_input->roi.wd;
+  const uint32_t ht = conn_input->roi.ht;
+  const uint32_t dp = conn_input->array_length > 0 ? conn_input->array_length : 1;
+  const float sigma = MAX(0.5f, 0.5f*radius);
+  const float q = sigma >= 2.5f ? 0.98711f*sigma - 0.96330f :
+    3.97156f - 4.14554f*sqrtf(1.0f - 0.26891f*sigma);
+  const float b0 = 1.57825f + 2.44413f*q + 1.4281f*q*q + 0.422205f*q*q*q;
+  const float b1 = 2.44413f*q + 2.85619f*q*q + 1.26661f*q*q*q;
+  const float b2 = -(1.4281f*q*q + 1.26661f*q*q*q);
+  const float b3 = 0.422205f*q*q*q;
+  struct { float coef[4]; int32_t dir, rev; } push = {
+    .coef = { 1.0f - (b1+b2+b3)/b0, b1/b0, b2/b0, b3/b0 } };
+  dt_connector_t ci = {
+    .name   = dt_token("input"),
+    .type   = dt_token("read"),
+    .chan   = conn_input->chan,
+    .format = conn_input->format,
+    .roi    = conn_input->roi,
+    .connected_mi = -1,
+    .array_length = conn_input->array_length,
+  };
+  dt_connector_t co = {
+    .name   = dt_token("output"),
+    .type   = dt_token("write"),
+    .chan   = conn_input->chan,
+    .format = conn_input->format,
+    .roi    = conn_input->roi,
+    .array_length = conn_input->array_length,
+  };
+  const uint32_t lines_per_group = DT_LOCAL_SIZE_X * DT_LOCAL_SIZE_Y;
+  int id[4];
+  for(int k=0;k<4;k++)
+  { // one invocation per line: rows for the first two passes, then columns
+    push.dir = k/2;
+    push.rev = k&1;
+    const uint32_t lines = push.dir ? wd : ht;
+    assert(graph->num_nodes < graph->max_nodes);
+    id[k] = graph->num_nodes++;
+    graph->node[id[k]] = (dt_node_t) {
+      .name   = dt_token("shared"),
+      .kernel = dt_token("iir"),
+      .module = module,
+      .wd     = DT_LOCAL_SIZE_X * ((lines + lines_per_group - 1) / lines_per_group),
+      .ht     = 1,
+      .dp     = dp,
+      .num_connectors = 2,
+      .connector = { ci, co },
+      .push_constant_size = sizeof(push),
+    };
+    memcpy(graph->node[id[k]].push_constant, &push, sizeof(push));
+    if(k) CONN(dt_node_connect(graph, id[k-1], 1, id[k], 0));
+  }
+  if(nodeid_input >= 0)
+    CONN(dt_node_connect(graph, nodeid_input, connid_input, id[0], 0));
+  else
+    dt_connector_copy(graph, module, connid_input, id[0], 0);
+  if(id_blur_in ) *id_blur_in  = id[0];
+  if(id_blur_out) *id_blur_out = id[3];
+  return id[3];
+}
+
+// box filter of 2*rad+1 pixels width, constant cost per pixel for any radius.
+// one pass over the rows, one over the columns, keeping the window sums as
+// running differences of the prefix sums of every line.
+static inline int
+dt_api_blur_box(
+    dt_graph_t  *graph,
+    dt_module_t *module,
+    int          nodeid_input,
+    int          connid_input,
+    int         *id_blur_in,
+    int         *id_blur_out,
+    int          rad)           // half width of the box, in pixels
+{
+  const dt_connector_t *conn_input = nodeid_input >= 0 ?
+    graph->node[nodeid_input].connector + connid_input :
+    module->connector + connid_input;
+  const uint32_t wd = conn_input->roi.wd;
+  const uint32_t ht = conn_input->roi.ht;
+  const uint32_t dp = conn_input->array_length > 0 ? conn_input->array_length : 1;
+  dt_connector_t ci = {
+    .name   = dt_token("input"),
+    .type   = dt_token("read"),
+    .chan   = conn_input->chan,
+    .format = conn_input->format,
+    .roi    = conn_input->roi,
+    .connected_mi = -1,
+    .array_length = conn_input->array_length,
+  };
+  dt_connector_t co = {
+    .name   = dt_token("output"),
+    .type   = dt_token("write"),
+    .chan   = conn_input->chan,
+    .format = conn_input->format,
+    .roi    = conn_input->roi,
+    .array_length = conn_input->array_length,
+  };
+  const uint32_t lines_per_group = DT_LOCAL_SIZE_X * DT_LOCAL_SIZE_Y;
+  int id[2];
+  for(int k=0;k<2;k++)
+  { // one invocation per line: rows first, then columns
+    const int32_t push[] = { CLAMP(rad, 0, (int)(k ? ht : wd)), k };
+    const uint32_t lines = k ? wd : ht;
+    assert(graph->num_nodes < graph->max_nodes);
+    id[k] = graph->num_nodes++;
+    graph->node[id[k]] = (dt_node_t) {
+      .name   = dt_token("shared"),
+      .kernel = dt_token("box"),
+      .module = module,
+      .wd     = DT_LOCAL_SIZE_X * ((lines + lines_per_group - 1) / lines_per_group),
+      .ht     = 1,
+      .dp     = dp,
+      .num_connectors = 2,
+      .connector = { ci, co },
+      .push_constant_size = sizeof(push),
+    };
+    memcpy(graph->node[id[k]].push_constant, push, sizeof(push));
+    if(k) CONN(dt_node_connect(graph, id[k-1], 1, id[k], 0));
+  }
+  if(nodeid_input >= 0)
+    CONN(dt_node_connect(graph, nodeid_input, connid_input, id[0], 0));
+  else
+    dt_connector_copy(graph, module, connid_input, id[0], 0);
+  if(id_blur_in ) *id_blur_in  = id[0];
+  if(id_blur_out) *id_blur_out = id[1];
+  return id[1];
+}
+
+// gaussian pyramid of half resolution levels using the shared down kernel.
+// level l+1 is on connector 1 of node id_level[l]. identical pyramids built on
+// the same input by different modules are merged into one after node creation.
+static inline int
+dt_api_pyramid(
+    dt_graph_t  *graph,
+    dt_module_t *module,
+    int          nodeid_input,  // pass -1 if the connector only exists on the module so far
+    int          connid_input,
+    const char  *format,        // storage format of the levels
+    int          numl,          // number of levels to create
+    int         *id_level)      // will be filled with numl node ids
+{
+  const dt_connector_t *conn_input = nodeid_input >= 0 ?
+    graph->node[nodeid_input].connector + connid_input :
+    module->connector + connid_input;
+  dt_roi_t roif = conn_input->roi, roic = roif;
+  for(int l=0;l<numl;l++)
+  {
+    roic.wd = (roif.wd+1)/2;
+    roic.ht = (roif.ht+1)/2;
+    id_level[l] = dt_node_add(graph, module, "shared", "down",
+        roic.wd, roic.ht, 1, 0, 0, 2,
+        "input",  "read",  "rgba", format, &roif,
+        "output", "write", "rgba", format, &roic);
+    if(l) CONN(dt_node_connect(graph, id_level[l-1], 1, id_level[l], 0));
+    roif = roic;
+  }
+  if(nodeid_input >= 0)
+    CONN(dt_node_connect(graph, nodeid_input, connid_input, id_level[0], 0));
+  else
+    dt_connector_copy(graph, module, connid_input, id_level[0], 0);
+  return id_level[numl-1];
+}
+
+// smooth hole filling by pull/push, using the shared pull and push kernels.
+// pixels with mask >= 0.5 are replaced by the upsampled average of the valid
+// ones around them, on as many half resolution levels as it takes. the mask is
+// the red channel of the mask connector, or the alpha channel of the rgba input
+// if nodeid_mask == -2. the filled result is on connector 3 of the returned
+// node, with the channels of the input in f16 and alpha set to one.
+static inline int
+dt_api_pullpush(
+    dt_graph_t  *graph,
+    dt_module_t *module,
+    int          nodeid_input,  // pass -1 if the connector only exists on the module so far
+    int          connid_input,
+    int          nodeid_mask,   // same for the mask, or -2 to use the alpha channel of the input
+    int          connid_mask)
+{
+  const dt_connector_t *conn_input = nodeid_input >= 0 ?
+    graph->node[nodeid_input].connector + connid_input :
+    module->connector + connid_input;
+  const char *chan = dt_token_str(conn_input->chan), *format = dt_token_str(conn_input->format);
+  const int alpha = nodeid_mask == -2;
+  const int max_nl = 15;
+  int id_pull[15], id_push[15], nl = 0;
+  dt_roi_t rf = conn_input->roi, rc = rf;
+  for(;nl<max_nl;nl++)
+  { // pull: all coarser levels hold the colour and the hole flag in alpha
+    rc.wd = (rf.wd-1)/2+1;
+    rc.ht = (rf.ht-1)/2+1;
+    rc.full_wd = (rc.full_wd-1)/2+1;
+    rc.full_ht = (rc.full_ht-1)/2+1;
+    const int pc[] = { nl, alpha };
+    id_pull[nl] = dt_node_add(graph, module, "shared", "pull", rc.wd, rc.ht, 1, sizeof(pc), pc, 3,
+        "input",  "read",  nl ? "rgba" : chan, nl ? "f16" : format, &rf,
+        "mask",   "read",  "*",    "*",   &rf,
+        "output", "write", "rgba", "f16", &rc);
+    id_push[nl] = dt_node_add(graph, module, "shared", "push", rf.wd, rf.ht, 1, sizeof(pc), pc, 4,
+        "fine",   "read",  nl ? "rgba" : chan, nl ? "f16" : format, &rf,
+        "coarse", "read",  "rgba", "f16", &rc,
+        "mask",   "read",  "*",    "*",   &rf,
+        "output", "write", nl ? "rgba" : chan, "f16", &rf);
+    if(nl)
+    { // the mask is only read on the finest level, bind something small
+      CONN(dt_node_connect(graph, id_pull[nl-1], 2, id_pull[nl], 0));
+      CONN(dt_node_connect(graph, id_pull[nl-1], 2, id_push[nl], 0));
+      CONN(dt_node_connect(graph, id_pull[nl-1], 2, id_pull[nl], 1));
+      CONN(dt_node_connect(graph, id_pull[nl-1], 2, id_push[nl], 2));
+      CONN(dt_node_connect(graph, id_push[nl],   3, id_push[nl-1], 1));
+    }
+    rf = rc;
+    if(rc.wd <= 2 || rc.ht <= 2 || nl+1 == max_nl) break;
+  }
+  // the coarsest level has no holes left (or nothing to fill them with)
+  CONN(dt_node_connect(graph, id_pull[nl], 2, id_push[nl], 1));
+
+  if(nodeid_input >= 0)
+  {
+    CONN(dt_node_connect(graph, nodeid_input, connid_input, id_pull[0], 0));
+    CONN(dt_node_connect(graph, nodeid_input, connid_input, id_push[0], 0));
+  }
+  else
+  {
+    dt_connector_copy(graph, module, connid_input, id_pull[0], 0);
+    dt_connector_copy(graph, module, connid_input, id_push[0], 0);
+  }
+  if(alpha)
+  { // dummy, the kernels read the alpha channel of the input
+    if(nodeid_input >= 0)
+    {
+      CONN(dt_node_connect(graph, nodeid_input, connid_input, id_pull[0], 1));
+      CONN(dt_node_connect(graph, nodeid_input, connid_input, id_push[0], 2));
+    }
+    else
+    {
+      dt_connector_copy(graph, module, connid_input, id_pull[0], 1);
+      dt_connector_copy(graph, module, connid_input, id_push[0], 2);
+    }
+  }
+  else if(nodeid_mask >= 0)
+  {
+    CONN(dt_node_connect(graph, nodeid_mask, connid_mask, id_pull[0], 1));
+    CONN(dt_node_connect(graph, nodeid_mask, connid_mask, id_push[0], 2));
+  }
+  else
+  {
+    dt_connector_copy(graph, module, connid_mask, id_pull[0], 1);
+    dt_connector_copy(graph, module, connid_mask, id_push[0], 2);
+  }
+  return id_push[0];
+}
+
+// generic blur, selecting some mix of separable/small/subsampled blur
+// to best reach the given radius goal
+static inline int
+dt_api_blur(
+    dt_graph_t  *graph,
+    dt_module_t *module,
+    int          nodeid_input,
+    int          connid_input,
+    int         *id_blur_in,
+    int         *id_blur_out,
+    float        radius)        // 2 sigma of the requsted blur, in pixels
+{
+  if(radius < 2)
+    return dt_api_blur_3x3(graph, module, nodeid_input, connid_input,
+        id_blur_in, id_blur_out, 0.5f*radius);
+  if(radius == 2)
+    return dt_api_blur_5x5(graph, module, nodeid_input, connid_input, id_blur_in, id_blur_out);
+  // the tiled separable kernels read every texel once per work group,
+  // without them the subsampled cascade is faster even for moderate radii.
+  if(radius <= DT_API_BLUR_SEP_MAX && dt_api_blur_tiled())
+    return dt_api_blur_sep(graph, module, nodeid_input, connid_input,
+        id_blur_in, id_blur_out, radius);
+  return dt_api_blur_pyramid(graph, module, nodeid_input, connid_input,
+      id_blur_in, id_blur_out, radius);
+}
+
+// the local means of the guided filter. small radii use the gaussian blurs,
+// large ones a box filter of the same variance, which costs the same for any
+// radius and is the mean the guided filter has been defined with anyways.
+static inline int
+dt_api_guided_mean(
+    dt_graph_t  *graph,
+    dt_module_t *module,
+    int          nodeid_input,
+    int          connid_input,
+    float        radius)        // 2 sigma of the requested blur, in pixels
+{
+  if(radius <= DT_API_BLUR_SEP_MAX)
+    return dt_api_blur(graph, module, nodeid_input, connid_input, 0, 0, radius);
+  return dt_api_blur_box(graph, module, nodeid_input, connid_input, 0, 0,
+      (int)(0.5f*radius*sqrtf(3.0f) + 0.5f));
+}
+
 // full guided filter:
 // input image      I (rgb) -> entry node [0]
 // input image      I (rgb) -> exit  node [0]
@@ -675,7 +1035,7 @@ dt_api_guided_filter_full(
   // mean_p  = blur(p)
   // corr_I  = blur(I*I)
   // corr_Ip = blur(I*p)
-  const int id_blur1 = dt_api_blur(graph, module, id_guided1, 2, 0, 0, radius_px);
+  const int id_blur1 = dt_api_guided_mean(graph, module, id_guided1, 2, radius_px);
 
   // var_I   = corr_I - mean_I*mean_I
   // cov_Ip  = corr_Ip - mean_I*mean_p
@@ -711,7 +1071,7 @@ dt_api_guided_filter_full(
   // this is the same as in the p=I case below:
   // mean_a = blur(a)
   // mean_b = blur(b)
-  const int id_blur = dt_api_blur(graph, module, id_guided2, 1, 0, 0, radius_px);
+  const int id_blur = dt_api_guided_mean(graph, module, id_guided2, 1, radius_px);
   // final kernel:
   // output = mean_a * I + mean_b
   assert(graph->num_nodes < graph->max_nodes);
@@ -820,7 +1180,7 @@ dt_api_guided_filter(
   // then connect 1x blur:
   // mean_I = blur(I)
   // corr_I = blur(I*I)
-  const int id_blur1 = dt_api_blur(graph, module, id_guided1, 1, 0, 0, radius_px);
+  const int id_blur1 = dt_api_guided_mean(graph, module, id_guided1, 1, radius_px);
 
   // connect to this node:
   // a = var_I / (var_I + eps)
@@ -848,7 +1208,7 @@ dt_api_guided_filter(
   // and blur once more:
   // mean_a = blur(a)
   // mean_b = blur(b)
-  const int id_blur = dt_api_blur(graph, module, id_guided2, 1, 0, 0, radius_px);
+  const int id_blur = dt_api_guided_mean(graph, module, id_guided2, 1, radius_px);
 
   // final kernel:
   // output = mean_a * I + mean_b
@@ -883,6 +1243,92 @@ dt_api_guided_filter(
   *exit_nodeid = id_guided3;
 }
 
+// conversion of linear rec2020 rgba to limited range y'cbcr planes for video
+// sinks, run by the shared yuv kernel. all planes go stacked into one single
+// channel ui8 (8 bits) or ui16 image, so the sink downloads the final layout.
+typedef struct dt_api_yuv_t
+{
+  uint32_t primaries; // 0 bt709, 1 bt2020
+  uint32_t trc;       // 0 bt709, 1 smpte2084 (pq), 2 hlg
+  uint32_t bits;      // 8 or 10
+  uint32_t chroma;    // 0 420, 1 422, 2 444
+  uint32_t nv;        // 420 only: semi-planar nv12 (8 bits) or p010 (10 bits) with interleaved chroma
+}
+dt_api_yuv_t;
+
+// byte offsets and dimensions of the y, u, v planes (u only for nv12/p010) in
+// the image written for the given even luma size. returns the pitch, which is
+// the same for all planes.
+static inline size_t
+dt_api_yuv_planes(
+    const dt_api_yuv_t *p,
+    int                 wd,
+    int                 ht,
+    size_t              offset[3],
+    int                 dim[6])
+{
+  const size_t bps = p->bits > 8 ? 2 : 1, pitch = bps * wd;
+  dim[0] = wd;
+  dim[1] = ht;
+  dim[2] = dim[4] = p->chroma == 2 ? wd : wd/2;
+  dim[3] = dim[5] = p->chroma == 0 ? ht/2 : ht;
+  offset[0] = 0;
+  offset[1] = ht * pitch;
+  offset[2] = p->chroma == 2 ? offset[1] + ht * pitch : offset[1] + bps * (wd/2);
+  if(p->chroma == 0 && p->nv) { dim[2] = wd; dim[4] = dim[5] = offset[2] = 0; }
+  return pitch;
+}
+
+// convert the given input to y'cbcr planes. the input is cropped to even size.
+// returns the node id, the planes are on output connector 1.
+static inline int
+dt_api_yuv(
+    dt_graph_t         *graph,
+    dt_module_t        *module,
+    int                 nodeid_input,
+    int                 connid_input,
+    const dt_api_yuv_t *p)
+{
+  const dt_connector_t *conn_input = nodeid_input >= 0 ?
+    graph->node[nodeid_input].connector + connid_input :
+    module->connector + connid_input;
+  const uint32_t wd = conn_input->roi.wd & ~1, ht = conn_input->roi.ht & ~1;
+  const uint32_t ht_yuv = p->chroma == 2 ? 3*ht : p->chroma == 1 ? 2*ht : ht + ht/2;
+  const dt_roi_t roi_yuv = { .full_wd = wd, .full_ht = ht_yuv, .wd = wd, .ht = ht_yuv, .scale = 1.0f };
+  assert(graph->num_nodes < graph->max_nodes);
+  const int id_yuv = graph->num_nodes++;
+  graph->node[id_yuv] = (dt_node_t) {
+    .name   = dt_token("shared"),
+    .kernel = dt_token("yuv"),
+    .module = module,
+    .wd     = wd/2,
+    .ht     = ht/2,
+    .dp     = 1,
+    .num_connectors = 2,
+    .connector = {{
+      .name   = dt_token("input"),
+      .type   = dt_token("read"),
+      .chan   = dt_token("rgba"),
+      .format = dt_token("f16"),
+      .roi    = conn_input->roi,
+      .connected_mi = -1,
+    },{
+      .name   = dt_token("output"),
+      .type   = dt_token("write"),
+      .chan   = dt_token("y"),
+      .format = p->bits > 8 ? dt_token("ui16") : dt_token("ui8"),
+      .roi    = roi_yuv,
+    }},
+    .push_constant_size = 6*sizeof(uint32_t),
+    .push_constant = { p->primaries, p->trc, p->bits, p->chroma, p->nv && p->chroma == 0, ht },
+  };
+  if(nodeid_input >= 0)
+    CONN(dt_node_connect(graph, nodeid_input, connid_input, id_yuv, 0));
+  else
+    dt_connector_copy(graph, module, connid_input, id_yuv, 0);
+  return id_yuv;
+}
+
 #endif // not defined cplusplus
 
 // return modid or -1
@@ -1281,4 +1727,45 @@ dt_api_radix_sort(
   if(id_radix_out) *id_radix_out = id_in;
   return id_in;
 }
+
+// run the compute node nodeid_sparse with a work group count that is only
+// known on the device, such as the number of items left after a compaction.
+// the first uint of the ssbo at nodeid_count:connid_count holds the item count
+// (at most max_items), which is turned into work groups of items_per_group
+// (the kernel's fixed work group size, say). the node gets an additional ssbo
+// input "indirect" and only runs these groups (vkCmdDispatchIndirect) in x,
+// the kernel needs to read the count itself to skip the tail of the last group.
+// returns the id of the node computing the work group count, or -1.
+static inline int
+dt_api_dispatch_indirect(
+    dt_graph_t  *graph,
+    dt_module_t *module,
+    int          nodeid_count,
+    int          connid_count,
+    int          nodeid_sparse,
+    uint32_t     items_per_group,
+    uint32_t     max_items)
+{
+  dt_node_t *node = graph->node + nodeid_sparse;
+  if(node->num_connectors >= DT_MAX_CONNECTORS) return -1;
+  dt_roi_t roi = { .wd = 3, .ht = 1, .full_wd = 3, .full_ht = 1 };
+  const int pc[] = { items_per_group, (max_items + items_per_group - 1) / items_per_group };
+  const int id_args = dt_node_add(graph, module, "shared", "indirect", 1, 1, 1, sizeof(pc), pc, 2,
+      "input",  "read",  "ssbo", "ui32", &roi,
+      "output", "write", "ssbo", "ui32", &roi);
+  if(id_args < 0) return -1;
+  const int c = node->num_connectors++;
+  node->connector[c] = (dt_connector_t) {
+    .name   = dt_token("indirect"),
+    .type   = dt_token("read"),
+    .chan   = dt_token("ssbo"),
+    .format = dt_token("ui32"),
+    .roi    = roi,
+    .connected_mi = -1,
+  };
+  node->dispatch_indirect = 1 + c;
+  CONN(dt_node_connect(graph, nodeid_count, connid_count, id_args, 0));
+  CONN(dt_node_connect(graph, id_args, 1, nodeid_sparse, c));
+  return id_args;
+}
 #endif
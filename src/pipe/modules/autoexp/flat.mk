@@ -0,0 +1 @@
+SPV_PENDING+=pipe/modules/autoexp/histsg.comp.spv pipe/modules/autoexp/lumsg.comp.spv
@@ -1,5 +1,15 @@
 #include "modules/api.h"
 
+void
+modify_roi_out(
+    dt_graph_t  *graph,
+    dt_module_t *module)
+{ // the metered luminance does not depend on the image size
+  module->connector[1].roi.full_wd = module->connector[0].roi.full_wd;
+  module->connector[1].roi.full_ht = module->connector[0].roi.full_ht;
+  module->connector[2].roi = (dt_roi_t){ .full_wd = 8, .full_ht = 8, .wd = 8, .ht = 8, .scale = 1.0f };
+}
+
 void
 create_nodes(
     dt_graph_t  *graph,
@@ -9,11 +19,14 @@ create_nodes(
   const int ht = module->connector[0].roi.ht;
   dt_roi_t hroi = (dt_roi_t){.wd = 16+1, .ht = 16 };
   dt_roi_t lroi = (dt_roi_t){.wd = 8, .ht = 8};
-  const int id_hist = dt_node_add(graph, module, "autoexp", "hist", (wd+15)/16 * DT_LOCAL_SIZE_X, (ht+15)/16 * DT_LOCAL_SIZE_Y, 1, 0, 0, 2,
+  // the reductions with subgroup arithmetic are not built by default yet, see flat.mk
+  const int sg = dt_pipe_shader_exists(dt_token("autoexp"), dt_token("histsg")) &&
+                 dt_pipe_shader_exists(dt_token("autoexp"), dt_token("lumsg"));
+  const int id_hist = dt_node_add(graph, module, "autoexp", sg ? "histsg" : "hist", (wd+15)/16 * DT_LOCAL_SIZE_X, (ht+15)/16 * DT_LOCAL_SIZE_Y, 1, 0, 0, 2,
       "input",  "read",  "*",    "*",   -1ul,
       "hist",   "write", "ssbo", "u32", &hroi);
 
-  const int id_lum = dt_node_add(graph, module, "autoexp", "lum", 1, 1, 1, 0, 0, 3,
+  const int id_lum = dt_node_add(graph, module, "autoexp", sg ? "lumsg" : "lum", 1, 1, 1, 0, 0, 3,
       "input",  "read",  "*",    "*",   -1ul,
       "hist",   "read",  "ssbo", "u32", -1ul,
       "lum",    "write", "ssbo", "f32", &lroi);
@@ -28,6 +41,7 @@ create_nodes(
   dt_connector_copy(graph, module, 0, id_lum,  0);
   dt_connector_copy(graph, module, 0, id_exp,  0);
   dt_connector_copy(graph, module, 1, id_exp,  3);
+  dt_connector_copy(graph, module, 2, id_lum,  2); // for parameters bound to the luminance
   dt_node_connect(graph,  id_hist, 1, id_lum,  1);
   dt_node_connect(graph,  id_hist, 1, id_exp,  1);
   dt_node_connect(graph,  id_lum,  2, id_exp,  2);
@@ -28,18 +28,12 @@ void create_nodes(dt_graph_t *graph, dt_module_t *module)
     const int loff = log2f(roif.full_wd / roif.wd);
     const int numl = maxnuml-loff;
     int id_down0[maxnuml], id_down1[maxnuml], id_up[maxnuml];
+    dt_api_pyramid(graph, module, -1, 0, "f16", numl, id_down0);
+    dt_api_pyramid(graph, module, -1, 1, "f16", numl, id_down1);
     for(int l=0;l<numl;l++)
     {
       roic.wd = (roif.wd+1)/2;
       roic.ht = (roif.ht+1)/2;
-      id_down0[l] = dt_node_add(graph, module, "eq", "down",
-          roic.wd, roic.ht, 1, 0, 0, 2,
-          "input",  "read",  "rgba", "f16", &roif,
-          "output", "write", "rgba", "f16", &roic);
-      id_down1[l] = dt_node_add(graph, module, "eq", "down",
-          roic.wd, roic.ht, 1, 0, 0, 2,
-          "input",  "read",  "rgba", "f16", &roif,
-          "output", "write", "rgba", "f16", &roic);
       id_up[l] = dt_node_add(graph, module, "blend", "up",
           roif.wd, roif.ht, 1, 0, 0, 6,
           "coarse0", "read",  "rgba", "f16", &roic,
@@ -50,15 +44,11 @@ void create_nodes(dt_graph_t *graph, dt_module_t *module)
           "output",  "write", "rgba", "f16", &roif);
       roif = roic;
     }
-    dt_connector_copy(graph, module, 0, id_down0[0], 0);
-    dt_connector_copy(graph, module, 1, id_down1[0], 0);
     dt_connector_copy(graph, module, 3, id_up[0],    5); // output
     dt_connector_copy(graph, module, 0, id_up[0],    1);
     dt_connector_copy(graph, module, 1, id_up[0],    3);
     for(int l=1;l<numl;l++)
     {
-      dt_node_connect(graph, id_down0[l-1], 1, id_down0[l], 0); // downsize more
-      dt_node_connect(graph, id_down1[l-1], 1, id_down1[l], 0);
       dt_node_connect(graph, id_down0[l-1], 1, id_up[l],    1); // fine for details during upsizing
       dt_node_connect(graph, id_down1[l-1], 1, id_up[l],    3);
       dt_node_connect(graph, id_down0[l-1], 1, id_up[l-1],  0); // coarse
@@ -78,5 +68,8 @@ void create_nodes(dt_graph_t *graph, dt_module_t *module)
         "mask",   "read",  "r",    "f16", &roif,
         "output", "write", "rgba", "f16", &roif);
     for(int k=0;k<4;k++) dt_connector_copy(graph, module, k, id_main, k);
+    // per pixel: keep the output around so local changes (brush strokes) only recompute the dirty region
+    graph->node[id_main].dirty_support = 1;
+    graph->node[id_main].connector[3].flags |= s_conn_protected;
   }
 }
@@ -0,0 +1,5 @@
+#pragma once
+// offsets are found per tile of this many grey pixels on every level
+#define DT_BURST_TILE 16
+// maximum number of pyramid levels, each is 4x smaller than the last
+#define DT_BURST_LEVELS 4
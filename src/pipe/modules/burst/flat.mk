@@ -0,0 +1,4 @@
+MOD_C=pipe/connector.c
+pipe/modules/burst/search.comp.spv:pipe/modules/burst/config.h
+pipe/modules/burst/merge.comp.spv :pipe/modules/burst/config.h
+pipe/modules/burst/libburst.so    :pipe/modules/burst/config.h
@@ -0,0 +1,125 @@
+#include "modules/api.h"
+#include "config.h"
+
+dt_graph_run_t
+check_params(
+    dt_module_t *module,
+    uint32_t     parid,
+    void        *oldval)
+{
+  if(parid == 0) // reference frame index goes to push constants
+    return s_graph_run_all;
+  return s_graph_run_record_cmd_buf; // minimal parameter upload to uniforms
+}
+
+// input connector:  array of raw frames of the same size, as loaded by i-raw with burst > 1
+// output connector: the merged raw, on the grid of the reference frame
+//
+// all frames go through the same nodes at once (dp = number of frames):
+// grey images at cfa block resolution, a pyramid of 4x downsampled levels,
+// tile-wise offset search coarse to fine against the reference, and a robust
+// weighted average of all frames in the raw domain.
+void
+create_nodes(
+    dt_graph_t  *graph,
+    dt_module_t *module)
+{
+  const dt_image_params_t *img_param = dt_module_get_input_img_param(graph, module, dt_token("input"));
+  if(!img_param) return;
+  const int num = MAX(1, module->connector[0].array_length);
+  const int ref = CLAMP(dt_module_param_int(module, 0)[0], 0, num-1);
+  const int block  = img_param->filters == 9u ? 3 : (img_param->filters == 0 ? 1 : 2);
+  const int period = img_param->filters == 9u ? 6 : block; // offsets need to keep the cfa colours
+  const char *chan = img_param->filters == 0 ? "rgba" : "rggb";
+
+  dt_roi_t roi_raw = module->connector[0].roi;
+  dt_roi_t roi[DT_BURST_LEVELS], roi_off[DT_BURST_LEVELS];
+  roi[0] = roi_raw;
+  roi[0].wd = (roi_raw.wd + block-1)/block;
+  roi[0].ht = (roi_raw.ht + block-1)/block;
+  int nl = 1;
+  for(;nl<DT_BURST_LEVELS;nl++)
+  {
+    if(roi[nl-1].wd < 8*DT_BURST_TILE || roi[nl-1].ht < 8*DT_BURST_TILE) break;
+    roi[nl] = roi[nl-1];
+    roi[nl].wd = (roi[nl].wd+3)/4;
+    roi[nl].ht = (roi[nl].ht+3)/4;
+  }
+  for(int l=0;l<nl;l++)
+  {
+    roi_off[l] = roi[l];
+    roi_off[l].wd = (roi[l].wd + DT_BURST_TILE-1)/DT_BURST_TILE;
+    roi_off[l].ht = (roi[l].ht + DT_BURST_TILE-1)/DT_BURST_TILE;
+  }
+
+  float noise_a = img_param->noise_a, noise_b = img_param->noise_b;
+  if(noise_a == 0.0f && noise_b == 0.0f)
+  { // no noise profile, assume unit gain and a little read noise
+    noise_a = 10.0f;
+    noise_b = 1.0f;
+  }
+  float black[4], white[4];
+  for(int k=0;k<4;k++)
+  {
+    black[k] = img_param->black[k];
+    white[k] = img_param->white[k];
+  }
+  uint32_t pc_grey[10];
+  memcpy(pc_grey+0, black, sizeof(black));
+  memcpy(pc_grey+4, white, sizeof(white));
+  pc_grey[8] = img_param->filters;
+  pc_grey[9] = block;
+
+  int id_lvl[DT_BURST_LEVELS];
+  id_lvl[0] = dt_node_add(graph, module, "burst", "grey", roi[0].wd, roi[0].ht, num,
+      sizeof(pc_grey), (const int *)pc_grey, 2,
+      "input",  "read",  chan, dt_token_str(module->connector[0].format), &roi_raw,
+      "output", "write", "y",  "f16", roi+0);
+  graph->node[id_lvl[0]].connector[1].array_length = num;
+  dt_connector_copy(graph, module, 0, id_lvl[0], 0);
+  for(int l=1;l<nl;l++)
+  {
+    id_lvl[l] = dt_node_add(graph, module, "burst", "down", roi[l].wd, roi[l].ht, num, 0, 0, 2,
+        "input",  "read",  "y", "f16", roi+l-1,
+        "output", "write", "y", "f16", roi+l);
+    graph->node[id_lvl[l]].connector[0].array_length = num;
+    graph->node[id_lvl[l]].connector[1].array_length = num;
+    CONN(dt_node_connect(graph, id_lvl[l-1], 1, id_lvl[l], 0));
+  }
+
+  int id_off = -1;
+  for(int l=nl-1;l>=0;l--)
+  { // coarse to fine, searching further on the coarsest level
+    const int pc[] = { ref, l == nl-1 ? 4 : 2, id_off >= 0 };
+    const int id_search = dt_node_add(graph, module, "burst", "search",
+        roi_off[l].wd, roi_off[l].ht, num, sizeof(pc), pc, 3,
+        "input",  "read",  "y",  "f16", roi+l,
+        "coarse", "read",  id_off >= 0 ? "rg" : "y", "f16", id_off >= 0 ? roi_off+l+1 : roi+l,
+        "offset", "write", "rg", "f16", roi_off+l);
+    for(int c=0;c<3;c++) graph->node[id_search].connector[c].array_length = num;
+    CONN(dt_node_connect(graph, id_lvl[l], 1, id_search, 0));
+    if(id_off >= 0) CONN(dt_node_connect(graph, id_off,    2, id_search, 1));
+    else            CONN(dt_node_connect(graph, id_lvl[l], 1, id_search, 1)); // dummy
+    id_off = id_search;
+  }
+
+  uint32_t pc_merge[14];
+  memcpy(pc_merge+0, black, sizeof(black));
+  memcpy(pc_merge+4, white, sizeof(white));
+  memcpy(pc_merge+8, &noise_a, sizeof(float));
+  memcpy(pc_merge+9, &noise_b, sizeof(float));
+  pc_merge[10] = img_param->filters;
+  pc_merge[11] = block;
+  pc_merge[12] = period;
+  pc_merge[13] = num;
+  const int id_merge = dt_node_add(graph, module, "burst", "merge", roi_raw.wd, roi_raw.ht, 1,
+      sizeof(pc_merge), (const int *)pc_merge, 3,
+      "input",  "read",  chan, dt_token_str(module->connector[0].format), &roi_raw,
+      "offset", "read",  "rg", "f16", roi_off+0,
+      "output", "write", chan, "f16", &roi_raw);
+  dt_connector_copy(graph, module, 0, id_merge, 0);
+  graph->node[id_merge].connector[1].array_length = num;
+  graph->node[id_merge].connector[1].flags = s_conn_smooth;
+  CONN(dt_node_connect(graph, id_off, 2, id_merge, 1));
+  dt_connector_copy(graph, module, 1, id_merge, 2);
+}
@@ -2,6 +2,13 @@
 #include <math.h>
 #include <stdlib.h>
 
+int
+identity(dt_module_t *module)
+{
+  const int pid = dt_module_get_param(module->so, dt_token("amount"));
+  return dt_module_param_float(module, pid)[0] == 0.0f;
+}
+
 void
 create_nodes(
     dt_graph_t  *graph,
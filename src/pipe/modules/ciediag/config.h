@@ -0,0 +1,7 @@
+#pragma once
+// every workgroup of the collect kernel looks at this many x this many blocks of input pixels
+#define DT_CIEDIAG_TILE 32
+// and counts them in a shared memory table of 2^this many bins first
+#define DT_CIEDIAG_BINS_LOG2 9
+// with subsampling, look at one pixel per block of up to this size
+#define DT_CIEDIAG_MAX_STRIDE 4
@@ -1,3 +1,5 @@
 MOD_LDFLAGS=-lm
 MOD_C=pipe/connector.c
 pipe/modules/ciediag/map.comp.spv: pipe/modules/shared.glsl
+pipe/modules/ciediag/collect.comp.spv: pipe/modules/ciediag/config.h pipe/modules/shared/bins.glsl
+pipe/modules/ciediag/libciediag.so: pipe/modules/ciediag/config.h
@@ -1,4 +1,16 @@
 #include "modules/api.h"
+#include "config.h"
+
+dt_graph_run_t
+check_params(
+    dt_module_t *module,
+    uint32_t     parid,
+    void        *oldval)
+{
+  if(parid == dt_module_get_param(module->so, dt_token("subsamp")))
+    return s_graph_run_all; // different number of workgroups
+  return s_graph_run_record_cmd_buf;
+}
 
 void modify_roi_in(
     dt_graph_t  *graph,
@@ -42,6 +54,12 @@ create_nodes(
     .flags  = s_conn_clear,
   };
 
+  // one workgroup per tile of input blocks. when subsampling, look at about
+  // one input pixel per bin of the diagram width:
+  const dt_roi_t *ri = &module->connector[0].roi, *ro = &module->connector[1].roi;
+  const int subsamp = dt_module_param_int(module, dt_module_get_param(module->so, dt_token("subsamp")))[0];
+  const int stride = subsamp ? CLAMP(ri->wd / MAX(1, ro->wd), 1, DT_CIEDIAG_MAX_STRIDE) : 1;
+  const int tile = DT_CIEDIAG_TILE * stride; // input pixels per tile
   assert(graph->num_nodes < graph->max_nodes);
   const int id_collect = graph->num_nodes++;
   dt_node_t *node_collect = graph->node + id_collect;
@@ -49,13 +67,15 @@ create_nodes(
     .name   = dt_token("ciediag"),
     .kernel = dt_token("collect"),
     .module = module,
-    .wd     = module->connector[0].roi.wd,
-    .ht     = module->connector[0].roi.ht,
+    .wd     = (ri->wd + tile-1) / tile * DT_LOCAL_SIZE_X,
+    .ht     = (ri->ht + tile-1) / tile * DT_LOCAL_SIZE_Y,
     .dp     = 1,
     .num_connectors = 2,
     .connector = {
       ci, co,
     },
+    .push_constant_size = sizeof(uint32_t),
+    .push_constant      = { stride },
   };
   ci.roi    = co.roi;
   ci.chan   = dt_token("r");
@@ -7,3 +7,9 @@
 #define DT_CNN_TILE_WD 20
 #define DT_CNN_TILE_HT 20
 #define DT_CNN_BORDER  2
+
+// tiles for the cooperative matrix kernel coop.comp. the width needs to be a
+// multiple of 16, the 16-channel f16 layer of (WD+2)x(HT+2) lives in shared memory.
+#define DT_CNN_COOP_TILE_WD 32
+#define DT_CNN_COOP_TILE_HT 16
+#define DT_CNN_COOP_BORDER  2
@@ -1,4 +1,6 @@
 MOD_LDFLAGS=-lm
 MOD_C=pipe/connector.c
 pipe/modules/cnn/cnn.comp.spv   :pipe/modules/cnn/config.h
+pipe/modules/cnn/coop.comp.spv  :pipe/modules/cnn/config.h
+SPV_PENDING+=pipe/modules/cnn/coop.comp.spv
 pipe/modules/cnn/libcnn.so      :pipe/modules/cnn/config.h
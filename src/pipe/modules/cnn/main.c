@@ -11,15 +11,18 @@ create_nodes(
 #if 1 // shared memory
   assert(graph->num_nodes < graph->max_nodes);
   const uint32_t id_cnn = graph->num_nodes++;
-  const uint32_t tile_size_x = DT_CNN_TILE_WD - 2*DT_CNN_BORDER;
-  const uint32_t tile_size_y = DT_CNN_TILE_HT - 2*DT_CNN_BORDER;
+  // use cooperative matrices (tensor cores) if we can, they come with larger tiles
+  // the coop kernel is not built by default yet, see flat.mk
+  const int coop = graph->coopmat_supported && dt_pipe_shader_exists(dt_token("cnn"), dt_token("coop"));
+  const uint32_t tile_size_x = coop ? DT_CNN_COOP_TILE_WD - 2*DT_CNN_COOP_BORDER : DT_CNN_TILE_WD - 2*DT_CNN_BORDER;
+  const uint32_t tile_size_y = coop ? DT_CNN_COOP_TILE_HT - 2*DT_CNN_COOP_BORDER : DT_CNN_TILE_HT - 2*DT_CNN_BORDER;
   const uint32_t num_tiles_x = (module->connector[0].roi.wd + tile_size_x - 1)/tile_size_x;
   const uint32_t num_tiles_y = (module->connector[0].roi.ht + tile_size_y - 1)/tile_size_y;
   const uint32_t wd = num_tiles_x * DT_LOCAL_SIZE_X;
   const uint32_t ht = num_tiles_y * DT_LOCAL_SIZE_Y;
   graph->node[id_cnn] = (dt_node_t) {
     .name   = dt_token("cnn"),
-    .kernel = dt_token("cnn"),
+    .kernel = coop ? dt_token("coop") : dt_token("cnn"),
     .module = module,
     .wd     = wd,
     .ht     = ht,
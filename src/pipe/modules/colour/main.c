@@ -55,8 +55,23 @@ kernel(const float *x, const float *y)
   return r2 * logf(r2);
 }
 
+// the factorisation of the rbf system only depends on the source points,
+// so dragging targets around only needs the back substitutions. we keep the
+// last solution too, commit_params() runs again for unrelated parameters.
+typedef struct colour_rbf_t
+{
+  int    N;                 // number of patches of the cached system, -1 if none
+  int    singular;          // system matrix for src was singular
+  float  src[72], tgt[72];  // source and target points of the cached system and solution
+  double A[27*27];          // triangular factorisation of the system matrix
+  int    pivot[27];
+  float  coef[12+4*24];     // coefficients for src/tgt
+}
+colour_rbf_t;
+
 static inline void
 compute_coefficients(
+  colour_rbf_t *rbf,      // cache of the last system
   const int    N,        // number of patches
   const float *source,   // N 3d source coordinates
   const float *target,   // N 3d target coordinates
@@ -80,6 +95,9 @@ compute_coefficients(
       we work in 2D xy chromaticity space.
       our P is a 3x3 matrix (no constant part, we want to keep black black)
       (split into one 1x3 row per solve, as we solve for every output dimension subsequently)
+
+      the system is a saddle point problem and not positive definite, so it
+      stays with partial pivoting instead of a cholesky factorisation.
   */
   const int N2 = N+3;
   switch(N) // N is the number of patches, i.e. we have N+2 constraints in the matrix
@@ -91,65 +109,49 @@ compute_coefficients(
     for(int co=0;co<3;co++) coef[co*4+co] = target[co] / source[co];
     break;
   default: // fully generic case, N patches
-  { // setup linear system of equations
-    double *A = malloc(sizeof(*A) * N2 * N2);
-    double *b = malloc(sizeof(*b) * N2);
-    // coefficients from nonlinear radial kernel functions
-    for(int j=0;j<N;j++)
-      for(int i=j;i<N;i++)
-        A[j*N2+i] = A[i*N2+j] = kernel(source + 3*i, source + 3*j);
-    // coefficients from (constant and) linear functions
-    for(int i=0;i<N;i++) A[i*N2+N+0] = A[(N+0)*N2+i] = source[3*i+0];
-    for(int i=0;i<N;i++) A[i*N2+N+1] = A[(N+1)*N2+i] = source[3*i+1];
-    for(int i=0;i<N;i++) A[i*N2+N+2] = A[(N+2)*N2+i] = source[3*i+2];
-    // lower-right zero block
-    for(int j=N;j<N2;j++)
-      for(int i=N;i<N2;i++)
-        A[j*N2+i] = 0;
-    // make coefficient matrix triangular
-    int *pivot = malloc(sizeof(*pivot)*N2);
-    if (gauss_make_triangular(A, pivot, N2))
-    { // calculate coefficients for r channel
-      for(int i=0;i<N; i++) b[i] = target[3*i];
-      for(int i=N;i<N2;i++) b[i] = 0;
-      gauss_solve_triangular(A, pivot, b, N2);
-      for(int i=0;i<N;i++) coef[12 + 4*i + 0] = b[i];
-      for(int i=0;i<3;i++) coef[4*i + 0] = b[N+i];
-      // calculate coefficients for g channel
-      for(int i=0;i<N; i++) b[i] = target[3*i+1];
-      for(int i=N;i<N2;i++) b[i] = 0;
-      gauss_solve_triangular(A, pivot, b, N2);
-      for(int i=0;i<N;i++) coef[12 + 4*i + 1] = b[i];
-      for(int i=0;i<3;i++) coef[4*i + 1] = b[N+i];
-      // calculate coefficients for b channel
-      for(int i=0;i<N; i++) b[i] = target[3*i+2];
-      for(int i=N;i<N2;i++) b[i] = 0;
-      gauss_solve_triangular(A, pivot, b, N2);
-      for(int i=0;i<N;i++) coef[12 + 4*i + 2] = b[i];
-      for(int i=0;i<3;i++) coef[4*i + 2] = b[N+i];
+  {
+    const int same_src = rbf->N == N && !memcmp(rbf->src, source, sizeof(float)*3*N);
+    if(same_src && !memcmp(rbf->tgt, target, sizeof(float)*3*N))
+    { // nothing changed
+      memcpy(coef, rbf->coef, sizeof(rbf->coef));
+      return;
     }
-    else
-    { // yes, really, we should have continued to use the svd/pseudoinverse for exactly such cases.
-      // i might bring it back at some point.
-#if 0
-      fprintf(stderr, "[colour] fuck, matrix was singular or something!\n");
-      fprintf(stderr, "[colour] N=%d\n", N);
-      for(int k=0;k<N;k++)
-        fprintf(stderr, "[colour] src = %g %g %g --> %g %g %g\n",
-            source[3*k+0], source[3*k+1], source[3*k+2],
-            target[3*k+0], target[3*k+1], target[3*k+2]);
-      fprintf(stderr, "[colour] A = \n");
-      for(int j=0;j<N2;j++)
+    double *A = rbf->A;
+    if(!same_src)
+    { // setup linear system of equations
+      // coefficients from nonlinear radial kernel functions
+      for(int j=0;j<N;j++)
+        for(int i=j;i<N;i++)
+          A[j*N2+i] = A[i*N2+j] = kernel(source + 3*i, source + 3*j);
+      // coefficients from (constant and) linear functions
+      for(int i=0;i<N;i++) A[i*N2+N+0] = A[(N+0)*N2+i] = source[3*i+0];
+      for(int i=0;i<N;i++) A[i*N2+N+1] = A[(N+1)*N2+i] = source[3*i+1];
+      for(int i=0;i<N;i++) A[i*N2+N+2] = A[(N+2)*N2+i] = source[3*i+2];
+      // lower-right zero block
+      for(int j=N;j<N2;j++)
+        for(int i=N;i<N2;i++)
+          A[j*N2+i] = 0;
+      // make coefficient matrix triangular
+      rbf->singular = !gauss_make_triangular(A, rbf->pivot, N2);
+      rbf->N = N;
+      memcpy(rbf->src, source, sizeof(float)*3*N);
+    }
+    memcpy(rbf->tgt, target, sizeof(float)*3*N);
+    if(!rbf->singular)
+    { // calculate coefficients for the r, g, and b channels
+      double b[27];
+      for(int co=0;co<3;co++)
       {
-        for(int i=0;i<N2;i++)
-          fprintf(stderr, "%.2f\t", A[j*N2+i]);
-        fprintf(stderr, "\n");
+        for(int i=0;i<N; i++) b[i] = target[3*i+co];
+        for(int i=N;i<N2;i++) b[i] = 0;
+        gauss_solve_triangular(A, rbf->pivot, b, N2);
+        for(int i=0;i<N;i++) coef[12 + 4*i + co] = b[i];
+        for(int i=0;i<3;i++) coef[4*i + co] = b[N+i];
       }
-#endif
     }
-    free(pivot);
-    free(b);
-    free(A);
+    // else: yes, really, we should have continued to use the svd/pseudoinverse for exactly such cases.
+    // i might bring it back at some point.
+    memcpy(rbf->coef, coef, sizeof(rbf->coef));
   }
   }
 }
@@ -247,7 +249,7 @@ void commit_params(dt_graph_t *graph, dt_module_t *module)
       f[off + 4*k + 2] = src[3*k+2];
       f[off + 4*k + 3] = 0.0f;
     }
-    compute_coefficients(N, src, tgt, f + 20);
+    compute_coefficients(module->data, N, src, tgt, f + 20);
   }
   else
   { // mode == 0 (or default): "parametric" mode
@@ -258,9 +260,18 @@ void commit_params(dt_graph_t *graph, dt_module_t *module)
 int init(dt_module_t *mod)
 {
   mod->committed_param_size = sizeof(float)*(4+12+4+12+4*24+4*24+5);
+  colour_rbf_t *rbf = calloc(1, sizeof(*rbf));
+  rbf->N = -1;
+  mod->data = rbf;
   return 0;
 }
 
+void cleanup(dt_module_t *mod)
+{
+  free(mod->data);
+  mod->data = 0;
+}
+
 void create_nodes(
     dt_graph_t  *graph,
     dt_module_t *module)
@@ -3,8 +3,10 @@
 #include "modules/localsize.h"
 
 // this is an initial implementation of some simplistic iterative, non-blind R/L deconvolution.
+// all iterations run in shared memory inside one dispatch, tile by tile. tiles stop
+// iterating once their largest relative update drops below the convergence threshold.
+// optionally a half resolution pass provides the initial estimate for the full res one.
 // it has a lot of problems because i didn't spend time on it:
-// - hardcoded iteration count
 // - the division kernel has an epsilon safeguard num/max(den, eps) which i'm not sure about.
 
 dt_graph_run_t
@@ -13,23 +15,20 @@ check_params(
     uint32_t     parid,
     void        *oldval)
 {
-  // yea sorry we're stupid and need push constants which we diligently don't update
-  // until we recreate the nodes. should change that i suppose.
-  // options:
-  // - secretly pick up parameter in the api blur call
-  // - make blurs a custom node without api wrapping and access params
-  // - implement commit_params() to alter the push constant
-  return s_graph_run_all;
+  // sigma, iterations and convergence are uniforms, only the number of scales changes nodes
+  if(parid == dt_module_get_param(module->so, dt_token("scales")))
+    return s_graph_run_all;
+  return s_graph_run_record_cmd_buf;
 }
 
-void
-create_nodes(
-    dt_graph_t  *graph,
-    dt_module_t *module)
+static int
+add_deconv(
+    dt_graph_t     *graph,
+    dt_module_t    *module,
+    const dt_roi_t *roi,
+    float           scale, // sigma multiplier for this resolution
+    int             init)  // read an initial estimate from the init connector
 {
-  const dt_roi_t *roi = &module->connector[0].roi;
-  assert(graph->num_nodes < graph->max_nodes);
-  const uint32_t id_deconv = graph->num_nodes++;
   // for dimensions, reverse
   // (wd + DT_LOCAL_SIZE_X - 1) / DT_LOCAL_SIZE_X
   // such that it'll result in our required number of thread blocks.
@@ -40,29 +39,40 @@ create_nodes(
   const uint32_t num_tiles_y = (roi->ht + tile_size_y - 1)/tile_size_y;
   const uint32_t wd = num_tiles_x * DT_LOCAL_SIZE_X;
   const uint32_t ht = num_tiles_y * DT_LOCAL_SIZE_Y;
-  graph->node[id_deconv] = (dt_node_t) {
-    .name   = dt_token("deconv"),
-    .kernel = dt_token("deconv"),
-    .module = module,
-    .wd     = wd,
-    .ht     = ht,
-    .dp     = 1,
-    .num_connectors = 2,
-    .connector = {{
-      .name   = dt_token("input"),
-      .type   = dt_token("read"),
-      .chan   = dt_token("rgba"),
-      .format = dt_token("f16"),
-      .roi    = *roi,
-      .connected_mi = -1,
-    },{
-      .name   = dt_token("output"),
-      .type   = dt_token("write"),
-      .chan   = dt_token("rgba"),
-      .format = dt_token("f16"),
-      .roi    = *roi,
-    }},
-  };
+  uint32_t pc[] = { 0, init };
+  memcpy(pc, &scale, sizeof(float));
+  const int id = dt_node_add(graph, module, "deconv", "deconv",
+      wd, ht, 1, sizeof(pc), (const int *)pc, 3,
+      "input",  "read",  "rgba", "f16", roi,
+      "init",   "read",  "rgba", "f16", roi,
+      "output", "write", "rgba", "f16", roi);
+  graph->node[id].connector[1].flags = s_conn_smooth;
+  return id;
+}
+
+void
+create_nodes(
+    dt_graph_t  *graph,
+    dt_module_t *module)
+{
+  const dt_roi_t *roi = &module->connector[0].roi;
+  const int scales = dt_module_param_int(module, dt_module_get_param(module->so, dt_token("scales")))[0];
+  if(scales > 1 && roi->wd > 2*DT_DECONV_TILE_WD && roi->ht > 2*DT_DECONV_TILE_HT)
+  { // coarse to fine: deconvolve at half resolution first and start from there
+    int id_down;
+    dt_api_pyramid(graph, module, -1, 0, "f16", 1, &id_down);
+    const dt_roi_t roic = graph->node[id_down].connector[1].roi;
+    const int id_coarse = add_deconv(graph, module, &roic, 0.5f, 0);
+    const int id_fine   = add_deconv(graph, module, roi, 1.0f, 1);
+    CONN(dt_node_connect(graph, id_down,   1, id_coarse, 0));
+    CONN(dt_node_connect(graph, id_down,   1, id_coarse, 1)); // unused
+    CONN(dt_node_connect(graph, id_coarse, 2, id_fine,   1));
+    dt_connector_copy(graph, module, 0, id_fine, 0);
+    dt_connector_copy(graph, module, 1, id_fine, 2);
+    return;
+  }
+  const int id_deconv = add_deconv(graph, module, roi, 1.0f, 0);
   dt_connector_copy(graph, module, 0, id_deconv, 0);
-  dt_connector_copy(graph, module, 1, id_deconv, 1);
+  dt_connector_copy(graph, module, 0, id_deconv, 1); // unused
+  dt_connector_copy(graph, module, 1, id_deconv, 2);
 }
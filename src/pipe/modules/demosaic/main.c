@@ -51,6 +51,7 @@ create_nodes(
   if(!img_param) return; // must have disconnected input somewhere
   const int block = img_param->filters == 9u ? 3 : 2;
   module->img_param.filters = 0u; // after we're done there won't be any more mosaic
+  module->connector[1].flags |= s_conn_compact; // camera rgb, alpha is unused downstream
   const int wd = module->connector[0].roi.wd, ht = module->connector[0].roi.ht;
   dt_roi_t roi_full = module->connector[0].roi;
   dt_roi_t roi_half = module->connector[0].roi;
@@ -60,14 +61,16 @@ create_nodes(
   roi_half.ht /= block;
   int *wbi = (int *)img_param->whitebalance;
   const int pc[] = { wbi[0], wbi[1], wbi[2], wbi[3], img_param->filters };
-  if(module->connector[1].roi.scale >= block)
+  // previews which are scaled down at all don't need the full resolution buffer
+  const float scale = module->connector[1].roi.scale;
+  if(scale >= block || (scale > 1.0f && dt_graph_preview(graph)))
   { // half size
     const int id_half = dt_node_add(graph, module, "demosaic", "halfsize",
         roi_half.wd, roi_half.ht, 1, sizeof(pc), pc, 2,
         "input",  "read",  "rggb", "*",   -1ul,
         "output", "write", "rgba", "f16", &roi_half);
     dt_connector_copy(graph, module, 0, id_half, 0);
-    if(block != module->connector[1].roi.scale)
+    if(block != scale)
     { // resample to get to the rest of the resolution, only if block != scale!
       const int id_resample = dt_node_add(graph, module, "shared", "resample",
           module->connector[1].roi.wd, module->connector[1].roi.ht, 1, 0, 0, 2,
@@ -143,10 +143,20 @@ create_nodes(
   const int wd = roi_half.wd;
   const int ht = roi_half.ht;
 
-  // wire 4 scales of downsample + assembly node
+  // rgba input comes at the resolution of the output. when that is scaled
+  // down, the finest bands of the full image have been averaged away already
+  // and our first band is band log2(scale) of the full image. we only run the
+  // levels which remain, so the preview costs less and looks like 1:1.
+  // mosaic input is always full resolution and keeps all levels.
+  int skip = 0;
+  if(block == 1)
+    while(skip < 3 && module->connector[1].roi.scale >= (2 << skip)) skip++;
+  const int levels = 4 - skip;
+
+  // wire up to 4 scales of downsample + assembly node
   int id_down[4] = {0};
 
-  for(int i=0;i<4;i++)
+  for(int i=0;i<levels;i++)
   {
     int cov = (module->connector[0].chan == dt_token("rggb")) && (i==0);
     assert(graph->num_nodes < graph->max_nodes);
@@ -191,11 +201,11 @@ create_nodes(
         (i == 0 && block == 1) ? crop_aabb[2] : 0,
         (i == 0 && block == 1) ? crop_aabb[3] : 0,
         noisei[0], noisei[1],
-        i, block },
+        i + skip, block },
     };
   }
   // wire inputs:
-  for(int i=1;i<4;i++)
+  for(int i=1;i<levels;i++)
     CONN(dt_node_connect(graph, id_down[i-1], 1, id_down[i], 0));
 
   // assemble
@@ -251,7 +261,7 @@ create_nodes(
       .format = dt_token("f16"),
       .roi    = roi_half,
     }},
-    .push_constant_size = 19*sizeof(uint32_t),
+    .push_constant_size = 20*sizeof(uint32_t),
     .push_constant = {
       wbi[0], wbi[1], wbi[2], wbi[3],
       blacki[0], blacki[1], blacki[2], blacki[3],
@@ -261,14 +271,12 @@ create_nodes(
       block == 1 ? crop_aabb[2] : 0,
       block == 1 ? crop_aabb[3] : 0,
       noisei[0], noisei[1],
-      img_param->filters },
+      img_param->filters, skip },
   };
 
-  // wire downsampled to assembly stage:
-  CONN(dt_node_connect(graph, id_down[0], 1, id_assemble, 1));
-  CONN(dt_node_connect(graph, id_down[1], 1, id_assemble, 2));
-  CONN(dt_node_connect(graph, id_down[2], 1, id_assemble, 3));
-  CONN(dt_node_connect(graph, id_down[3], 1, id_assemble, 4));
+  // wire downsampled to assembly stage, missing coarse scales read the last one:
+  for(int i=0;i<4;i++)
+    CONN(dt_node_connect(graph, id_down[MIN(i, levels-1)], 1, id_assemble, 1+i));
 
   if(module->connector[0].chan == dt_token("rggb"))
   { // raw data. need to wrap into mosaic-aware nodes:
@@ -1,5 +1,25 @@
 #include "modules/api.h"
 #include <stdio.h>
+#include <stdlib.h>
+
+// the mask is kept in protected memory and only the strokes appended since the
+// last upload are rasterised into it. we remember which vertices are in there.
+typedef struct draw_t
+{
+  int       node;  // id of the graphics node
+  uint32_t  cnt;   // number of vertices drawn into the mask
+  uint32_t *vert;  // copy of these vertices, two words each
+}
+draw_t;
+
+static dt_node_t *
+draw_node(dt_module_t *mod)
+{
+  draw_t *d = mod->data;
+  if(d->node < 0 || d->node >= (int)mod->graph->num_nodes) return 0;
+  dt_node_t *node = mod->graph->node + d->node;
+  return node->module == mod ? node : 0;
+}
 
 void commit_params(dt_graph_t *graph, dt_module_t *module)
 {
@@ -13,9 +33,23 @@ void commit_params(dt_graph_t *graph, dt_module_t *module)
 int init(dt_module_t *mod)
 {
   mod->committed_param_size = sizeof(float)*3;
+  const int pi = dt_module_get_param(mod->so, dt_token("draw"));
+  draw_t *d = calloc(sizeof(*d), 1);
+  d->node = -1;
+  d->vert = malloc(sizeof(uint32_t)*mod->so->param[pi]->cnt);
+  mod->data = d;
   return 0;
 }
 
+void cleanup(dt_module_t *mod)
+{
+  draw_t *d = mod->data;
+  if(!d) return;
+  free(d->vert);
+  free(d);
+  mod->data = 0;
+}
+
 dt_graph_run_t
 check_params(
     dt_module_t *module,
@@ -26,20 +60,58 @@ check_params(
   // set flag on this module that we want to run read_source again!
   if(parid == pi)
     module->flags |= s_module_request_read_source;
+  else
+  { // global opacity, radius or hardness change all strokes
+    draw_t *d = module->data;
+    dt_node_t *node = draw_node(module);
+    d->cnt = 0;
+    if(node) node->draw_beg = 0;
+  }
   return s_graph_run_record_cmd_buf; // minimal parameter upload to uniforms
 }
 
-// TODO: check_params to support incremental updates (store on struct here and
-// memcpy only what's needed in read_source)
-
 int read_source(
     dt_module_t *mod,
     void *mapped)
 {
+  draw_t *d = mod->data;
   const int pi = dt_module_get_param(mod->so, dt_token("draw"));
   const uint32_t *p_draw = dt_module_param_uint32(mod, pi);
-  const int num_verts = p_draw[0];
+  const uint32_t num_verts = p_draw[0];
   memcpy(mapped, p_draw+1, sizeof(uint32_t)*2*num_verts);
+
+  // if only strokes have been appended, start at the segment connecting to them
+  uint32_t beg = 0;
+  if(d->cnt && d->cnt <= num_verts && !memcmp(d->vert, p_draw+1, sizeof(uint32_t)*2*d->cnt))
+    beg = d->cnt - 1;
+  memcpy(d->vert, p_draw+1, sizeof(uint32_t)*2*num_verts);
+  d->cnt = num_verts;
+
+  dt_node_t *node = draw_node(mod);
+  if(node)
+  { // bounding box of the new segments in pixels, as expanded by the geometry shader
+    const int wd = node->connector[1].roi.wd, ht = node->connector[1].roi.ht;
+    const float radius = dt_module_param_float(mod, 1)[0];
+    float bb[4] = { wd, ht, 0, 0 };
+    for(uint32_t v=beg;v<num_verts;v++)
+    {
+      const float vr = 2.0f * (p_draw[2+2*v] & 0xffff) / 65535.0f;
+      if(vr == 0.0f) continue; // end of stroke, not drawn
+      const float x = ((p_draw[1+2*v] & 0xffff) / 65535.0f * 4.0f - 1.0f) * 0.5f * wd;
+      const float y = ((p_draw[1+2*v] >>   16) / 65535.0f * 4.0f - 1.0f) * 0.5f * ht;
+      const float r = radius * vr * wd + 2.0f;
+      bb[0] = MIN(bb[0], x - r); bb[1] = MIN(bb[1], y - r);
+      bb[2] = MAX(bb[2], x + r); bb[3] = MAX(bb[3], y + r);
+    }
+    const int x0 = CLAMP((int)bb[0], 0, wd), y0 = CLAMP((int)bb[1], 0, ht);
+    const int x1 = CLAMP((int)bb[2]+1, x0, wd), y1 = CLAMP((int)bb[3]+1, y0, ht);
+    node->draw_beg = beg;
+    node->draw_area[0] = x0;
+    node->draw_area[1] = y0;
+    node->draw_area[2] = x1 - x0;
+    node->draw_area[3] = y1 - y0;
+    if(beg && x1 <= x0) node->draw_beg = num_verts; // nothing new to draw
+  }
   mod->flags = 0; // yay, we uploaded.
   return 0;
 }
@@ -51,7 +123,7 @@ create_nodes(
 {
   // we will create two nodes: one graphics and one input.
   // the input node creates an ssbo source connector
-  // which is manually fed the params (TODO: update only necessary parts) in read_source above.
+  // which is manually fed the params in read_source above.
   const int wd = module->connector[0].roi.wd;
   const int ht = module->connector[0].roi.ht;
   const int dp = 1;
@@ -119,6 +191,11 @@ create_nodes(
     .push_constant_size = 2*sizeof(float),
     .push_constant = { aspecti, wd },
   };
+  // keep the mask around between runs, new strokes are drawn on top:
+  graph->node[id_draw].connector[1].flags |= s_conn_protected;
+  draw_t *d = module->data;
+  d->node = id_draw;
+  d->cnt  = 0; // fresh node, draw everything
   CONN(dt_node_connect(graph, id_source, 0, id_draw, 0));
   dt_connector_copy(graph, module, 0, id_draw, 1);
 }
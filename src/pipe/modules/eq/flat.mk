@@ -1,4 +1,3 @@
 MOD_LDFLAGS=-lm
 MOD_C=pipe/connector.c
 pipe/modules/eq/up.comp.spv:pipe/modules/shared.glsl
-pipe/modules/eq/down.comp.spv:pipe/modules/shared.glsl
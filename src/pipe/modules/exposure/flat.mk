@@ -0,0 +1 @@
+pipe/modules/exposure/main.comp.spv: pipe/modules/exposure/pointwise.glsl
@@ -0,0 +1,6 @@
+// per-pixel body, shared with the fused kernel in shared/fuse.comp
+vec3
+exposure_pointwise(vec3 rgb, float ev)
+{
+  return rgb * pow(2.0, ev);
+}
@@ -0,0 +1 @@
+pipe/modules/f2srgb/main.comp.spv: pipe/modules/f2srgb/pointwise.glsl
@@ -0,0 +1,29 @@
+// per-pixel body, shared with the fused kernel in shared/fuse.comp
+vec3
+f2srgb_pointwise(vec3 rgb, int usemat)
+{
+  if(usemat == 1)
+  { // convert linear rec2020 to linear rec709
+    const mat3 M = mat3(
+         1.66022677, -0.12455334, -0.01815514,
+        -0.58754761,  1.13292605, -0.10060303,
+        -0.07283825, -0.00834963,  1.11899817);
+    rgb = M * rgb;
+  }
+  else if(usemat == 2)
+  {
+    const mat3 rec2020_to_xyz = mat3(
+        6.36958048e-01, 2.62700212e-01, 4.20575872e-11,
+        1.44616904e-01, 6.77998072e-01, 2.80726931e-02,
+        1.68880975e-01, 5.93017165e-02, 1.06098506e+00);
+    rgb = rec2020_to_xyz * rgb;
+  }
+
+  if(usemat <= 1)
+  { // apply srgb tone curve
+    rgb.r = rgb.r <= 0.0031308 ? rgb.r * 12.92 : pow(rgb.r, 1.0/2.4)*(1+0.055)-0.055;
+    rgb.g = rgb.g <= 0.0031308 ? rgb.g * 12.92 : pow(rgb.g, 1.0/2.4)*(1+0.055)-0.055;
+    rgb.b = rgb.b <= 0.0031308 ? rgb.b * 12.92 : pow(rgb.b, 1.0/2.4)*(1+0.055)-0.055;
+  }
+  return rgb;
+}
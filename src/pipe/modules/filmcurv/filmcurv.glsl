@@ -0,0 +1,69 @@
+// the film curve as applied per pixel, shared by the main and the derivative kernel
+
+float
+weibull_cdf(
+    float x,  // input value (0, infty)
+    float il, // weibull 1.0/lambda, scale parameter (0, infty)
+    float k)  // weibull k, shape parameter          (0, infty)
+{
+  return 1.0 - exp(-pow(max(x, 1e-7)*il, k));
+}
+
+float // derivative of cdf:
+weibull_pdf(float x, float il, float k)
+{
+  x = max(x, 1e-7);
+  return k*il * pow(x*il, k-1.0) * exp(-pow(x*il, k));
+}
+vec3 // vector version
+weibull_cdf(vec3 x, float il, float k)
+{
+  return 1.0 - exp(-pow(max(x, 1e-7)*il, vec3(k)));
+}
+
+vec3
+filmcurv(
+    vec3  col0,       // scene referred rgb
+    float bias,       // offset added to the input
+    float il,         // weibull 1.0/lambda
+    float k,          // weibull k
+    int   colourmode) // colour reconstruction, as in the params
+{
+  col0 += bias;
+  vec3 col1 = weibull_cdf(col0, il, k);
+  if(colourmode == 0)
+  { // colour using aurelien's patented ucs:
+    const mat3 xyz_to_rec2020 = mat3(
+        1.7166511880, -0.6666843518, 0.0176398574, 
+        -0.3556707838, 1.6164812366, -0.0427706133, 
+        -0.2533662814, 0.0157685458, 0.9421031212);
+    vec3 xyz0 = inverse(xyz_to_rec2020) * col0;
+    vec3 xyz1 = inverse(xyz_to_rec2020) * col1;
+    vec3 xyY0 = vec3(xyz0.xy / max(1e-4, dot(vec3(1),xyz0)), xyz0.y);
+    vec3 xyY1 = vec3(xyz1.xy / max(1e-4, dot(vec3(1),xyz1)), xyz0.y);
+    const float L_white = 1.0;
+    vec3 jch0 = xyY_to_dt_UCS_JCH(xyY0, L_white);
+    vec3 jch1 = xyY_to_dt_UCS_JCH(xyY1, L_white);
+    jch1 = vec3(jch1.x, jch1.y, jch0.z);
+    xyY1 = dt_UCS_JCH_to_xyY(jch1, L_white);
+    xyz1 = vec3(xyY1.xy, 1.0-xyY1.x-xyY1.y) * xyz1.y / max(1e-4,xyY1.y);
+    col1 = xyz_to_rec2020 * xyz1;
+  }
+  else if(colourmode == 2)
+  { // colour reconstruction using munsell hue constancy.
+    vec3 xyY0 = rec2020_to_xyY(col0);
+    vec2 m0   = munsell_from_xy(xyY0.xy);
+    vec3 xyY1 = rec2020_to_xyY(col1);
+    vec2 m1   = munsell_from_xy(xyY1.xy);
+    xyY1.xy   = munsell_to_xy(vec2(m0.x, m1.y));
+    col1 = xyY_to_rec2020(xyY1);
+  }
+  else if(colourmode == 3)
+  { // simple rgb/hsv hack:
+    col1 = adjust_colour_dng(col0, col1);
+  }
+  else if(colourmode == 1)
+  { // apply per channel
+  }
+  return col1;
+}
@@ -1 +1,3 @@
-pipe/modules/filmcurv/main.comp.spv: pipe/modules/shared/dtucs.glsl
+pipe/modules/filmcurv/main.comp.spv: pipe/modules/shared/dtucs.glsl pipe/modules/filmcurv/filmcurv.glsl
+pipe/modules/filmcurv/deriv.comp.spv: pipe/modules/shared/dtucs.glsl pipe/modules/filmcurv/filmcurv.glsl
+MOD_C=pipe/connector.c
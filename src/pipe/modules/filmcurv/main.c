@@ -0,0 +1,41 @@
+#include "modules/api.h"
+
+int init(dt_module_t *mod)
+{ // the derivatives with respect to light, contrast and bias
+  mod->connector[3].array_length = 3;
+  return 0;
+}
+
+static int
+dout_connected(const dt_graph_t *graph, const dt_module_t *module)
+{ // is anybody asking for the derivatives (such as the loss module when fitting)?
+  const int mi = module - graph->module;
+  for(int m=0;m<graph->num_modules;m++)
+    for(int c=0;c<graph->module[m].num_connectors;c++)
+      if(dt_connector_input(graph->module[m].connector+c) &&
+         graph->module[m].connector[c].connected_mi == mi &&
+         graph->module[m].connector[c].connected_mc == 3)
+        return 1;
+  return 0;
+}
+
+void
+create_nodes(
+    dt_graph_t  *graph,
+    dt_module_t *module)
+{
+  const dt_roi_t *roi = &module->connector[1].roi;
+  const int id_main = dt_node_add(graph, module, "filmcurv", "main", roi->wd, roi->ht, 1, 0, 0, 3,
+      "input",  "read",  "rgba", "*",   &module->connector[0].roi,
+      "output", "write", "rgba", "f16", roi,
+      "dspy",   "write", "rgba", "f16", &module->connector[2].roi);
+  for(int c=0;c<3;c++) dt_connector_copy(graph, module, c, id_main, c);
+  if(!dout_connected(graph, module)) return;
+
+  const int id_deriv = dt_node_add(graph, module, "filmcurv", "deriv", roi->wd, roi->ht, 1, 0, 0, 2,
+      "input",  "read",  "rgba", "*",   &module->connector[0].roi,
+      "dout",   "write", "rgba", "f32", roi);
+  graph->node[id_deriv].connector[1].array_length = 3;
+  dt_connector_copy(graph, module, 0, id_deriv, 0);
+  dt_connector_copy(graph, module, 3, id_deriv, 1);
+}
@@ -0,0 +1 @@
+pipe/modules/grade/main.comp.spv: pipe/modules/grade/pointwise.glsl
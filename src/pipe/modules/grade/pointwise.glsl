@@ -0,0 +1,7 @@
+// per-pixel body, shared with the fused kernel in shared/fuse.comp
+vec3
+grade_pointwise(vec3 rgb, vec3 lift, vec3 gamma, vec3 gain)
+{
+  rgb = gain * rgb + lift;
+  return pow(max(rgb, vec3(0)), 1.0/gamma);
+}
@@ -0,0 +1,7 @@
+#pragma once
+// every workgroup of the collect kernel bins one histogram column of this many input rows
+#define DT_HIST_STRIP 512
+// histogram heights up to this size are binned in shared memory first
+#define DT_HIST_MAX_BINS 1024
+// never skip more than this many pixels in either direction
+#define DT_HIST_MAX_STRIDE 8
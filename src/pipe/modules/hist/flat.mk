@@ -1,2 +1,4 @@
 MOD_LDFLAGS=-lm
 MOD_C=pipe/connector.c
+pipe/modules/hist/collect.comp.spv:pipe/modules/hist/config.h
+pipe/modules/hist/libhist.so    :pipe/modules/hist/config.h
@@ -1,4 +1,5 @@
 #include "modules/api.h"
+#include "config.h"
 
 void modify_roi_out(
     dt_graph_t *graph,
@@ -35,6 +36,11 @@ create_nodes(
     .flags  = s_conn_clear,
   };
 
+  // bin with one workgroup per output column and strip of input rows. looking
+  // at two input pixels per output column is plenty for display:
+  const dt_roi_t *ri = &module->connector[0].roi, *ro = &module->connector[1].roi;
+  const uint32_t stride = CLAMP(ri->wd / (2*MAX(1, ro->wd)), 1, DT_HIST_MAX_STRIDE);
+
   assert(graph->num_nodes < graph->max_nodes);
   const int id_collect = graph->num_nodes++;
   dt_node_t *node_collect = graph->node + id_collect;
@@ -42,13 +48,15 @@ create_nodes(
     .name   = dt_token("hist"),
     .kernel = dt_token("collect"),
     .module = module,
-    .wd     = module->connector[0].roi.wd,
-    .ht     = module->connector[0].roi.ht,
+    .wd     = ro->wd * DT_LOCAL_SIZE_X,
+    .ht     = (ri->ht + DT_HIST_STRIP-1) / DT_HIST_STRIP * DT_LOCAL_SIZE_Y,
     .dp     = 1,
     .num_connectors = 2,
     .connector = {
       ci, co,
     },
+    .push_constant_size = sizeof(uint32_t),
+    .push_constant      = { stride },
   };
   ci.roi    = co.roi;
   ci.chan   = dt_token("r");
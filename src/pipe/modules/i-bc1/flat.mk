@@ -1 +1,2 @@
 MOD_LDFLAGS=-lz
+pipe/modules/i-bc1/libi-bc1.so:pipe/modules/o-bc1/bc1.h
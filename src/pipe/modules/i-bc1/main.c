@@ -1,4 +1,5 @@
 #include "modules/api.h"
+#include "../o-bc1/bc1.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -20,8 +21,8 @@ void modify_roi_out(
     fprintf(stderr, "[i-bc1] %s: can't open file!\n", filename);
     if(f) gzclose(f);
   }
-  // checks: magic != dt_token("bc1z") || version != 1
-  if(header[0] != dt_token("bc1z") || header[1] != 1)
+  // checks: magic != dt_token("bc1z") || unknown version. we only read level 0 of the mip chain
+  if(header[0] != dt_token("bc1z") || header[1] < 1 || header[1] > DT_BC1_VERSION)
   {
     fprintf(stderr, "[i-bc1] %s: wrong magic number or version!\n", filename);
     gzclose(f);
@@ -47,8 +48,8 @@ int read_source(
     if(f) gzclose(f);
     return 1;
   }
-  // checks: magic != dt_token("bc1z") || version != 1
-  if(header[0] != dt_token("bc1z") || header[1] != 1)
+  // checks: magic != dt_token("bc1z") || unknown version. we only read level 0 of the mip chain
+  if(header[0] != dt_token("bc1z") || header[1] < 1 || header[1] > DT_BC1_VERSION)
   {
     fprintf(stderr, "[i-bc1] %s: wrong magic number or version!\n", filename);
     gzclose(f);
@@ -3,6 +3,18 @@
 #include "core/core.h"
 
 #include <zlib.h>
+extern "C" {
+#include "core/threads.h"
+}
+// decode the chunks on our thread pool instead of spawning threads for every image
+template<typename F> static void
+exr_worker(uint32_t begin, uint32_t end, void *data)
+{
+  for(uint32_t i=begin;i<end;i++) (*(F*)data)();
+}
+#define TINYEXR_NUM_THREADS() threads_num()
+#define TINYEXR_RUN_WORKERS(num_threads, worker) \
+  threads_parallel_for(0, (num_threads), 1, exr_worker<decltype(worker)>, &(worker))
 #define TINYEXR_USE_THREAD (1)
 #define TINYEXR_USE_OPENMP (0)
 #define TINYEXR_USE_MINIZ (0)
@@ -119,6 +131,64 @@ static int get_cid(EXRHeader *h, int c)
 
 
 
+typedef struct exr_copy_t
+{
+  const EXRHeader *hdr;
+  const EXRImage  *img;
+  uint16_t        *out;
+  int              wd, ht, nc; // output dimensions and channels
+}
+exr_copy_t;
+
+// interleave rows of the decoded channels into the staging buffer
+static void
+copy_rows(uint32_t begin, uint32_t end, void *data)
+{
+  const exr_copy_t *d = (const exr_copy_t *)data;
+  const uint16_t one = float_to_half(1.0f);
+  for(uint32_t y=begin;y<end;y++)
+  {
+    uint16_t *out = d->out + d->nc*(size_t)d->wd*y;
+    if(d->nc == 4) for(int x=0;x<d->wd;x++) out[4*x+3] = one; // opaque alpha
+    for(int c=0;c<d->hdr->num_channels;c++)
+    {
+      const int co = get_cid((EXRHeader *)d->hdr, c);
+      if(co >= d->nc) continue;
+      const uint16_t *src = (const uint16_t *)(d->img->images[c]) + d->wd*(size_t)y;
+      for(int x=0;x<d->wd;x++) out[d->nc*x+co] = src[x];
+    }
+  }
+}
+
+// same for tiles, one tile after another
+static void
+copy_tiles(uint32_t begin, uint32_t end, void *data)
+{
+  const exr_copy_t *d = (const exr_copy_t *)data;
+  const uint16_t one = float_to_half(1.0f);
+  for(uint32_t t=begin;t<end;t++)
+  {
+    const EXRTile *tile = d->img->tiles + t;
+    if(tile->level_x || tile->level_y) continue;
+    const int sx = tile->offset_x * d->hdr->tile_size_x;
+    const int sy = tile->offset_y * d->hdr->tile_size_y;
+    const int ex = MIN(sx + tile->width,  d->wd);
+    const int ey = MIN(sy + tile->height, d->ht);
+    for(int y=sy;y<ey;y++)
+    {
+      uint16_t *out = d->out + d->nc*((size_t)d->wd*y + sx);
+      if(d->nc == 4) for(int x=0;x<ex-sx;x++) out[4*x+3] = one;
+      for(int c=0;c<d->hdr->num_channels;c++)
+      {
+        const int co = get_cid((EXRHeader *)d->hdr, c);
+        if(co >= d->nc) continue;
+        const uint16_t *src = (const uint16_t *)(tile->images[c]) + (y - sy) * d->hdr->tile_size_x;
+        for(int x=0;x<ex-sx;x++) out[d->nc*x+co] = src[x];
+      }
+    }
+  }
+}
+
 static int
 read_plain(
     dt_module_t    *mod,
@@ -130,55 +200,27 @@ read_plain(
   char fname[2*PATH_MAX+10];
   if(dt_graph_get_resource_filename(mod, filename, id+mod->graph->frame, fname, sizeof(fname)))
     return 1;
-  if(LoadEXRImageFromFile(&exr->img, &exr->hdr, fname, 0) < 0)
-    return 1;
-
-  uint16_t one = float_to_half(1.0f);
-  const int wd = mod->connector[0].roi.wd;
-  const int ht = mod->connector[0].roi.ht;
-
-  for (int y = 0; y < ht; y++)
-    for (int x = 0; x < wd; x++)
-      out[4*(y * wd + x)+3] = one; // opaque alpha
 
   for(int c=0;c<exr->hdr.num_channels;c++) if(exr->hdr.pixel_types[c] != TINYEXR_PIXELTYPE_HALF)
   { // TODO: support FLOAT and UINT too
     fprintf(stderr, "[i-exr] %s: sorry only support half type so far\n", fname);
     return 1;
   }
-  if(exr->img.tiles)
-  {
-    const EXRTile *tiles = exr->img.tiles;
-    int num_tiles = exr->img.num_tiles;
-    for (int tile_idx = 0; tile_idx < num_tiles; tile_idx++)
-    {
-      int sx = tiles[tile_idx].offset_x * exr->hdr.tile_size_x;
-      int sy = tiles[tile_idx].offset_y * exr->hdr.tile_size_y;
-      int ex = tiles[tile_idx].offset_x * exr->hdr.tile_size_x + tiles[tile_idx].width;
-      int ey = tiles[tile_idx].offset_y * exr->hdr.tile_size_y + tiles[tile_idx].height;
+  if(LoadEXRImageFromFile(&exr->img, &exr->hdr, fname, 0) < 0)
+    return 1;
 
-      for (int c = 0; c < exr->hdr.num_channels; c++)
-      {
-        int co = get_cid(&exr->hdr, c);
-        const uint16_t* src = (const uint16_t*)(exr->img.tiles[tile_idx].images[c]);
-        for (int y = 0; y < ey - sy; y++)
-          for (int x = 0; x < ex - sx; x++)
-            out[4*((y + sy) * wd + (x + sx))+co] =
-                src[y * exr->hdr.tile_size_x + x];
-      }
-    }
-  }
+  exr_copy_t d = {
+    .hdr = &exr->hdr,
+    .img = &exr->img,
+    .out = out,
+    .wd  = (int)mod->connector[0].roi.wd,
+    .ht  = (int)mod->connector[0].roi.ht,
+    .nc  = mod->connector[0].chan == dt_token("y") ? 1 : 4,
+  };
+  if(exr->img.tiles)
+    threads_parallel_for(0, exr->img.num_tiles, 1, copy_tiles, &d);
   else if(exr->img.images)
-  {
-    for (int c = 0; c < exr->hdr.num_channels; c++)
-    {
-      int co = get_cid(&exr->hdr, c);
-      const uint16_t* src = (const uint16_t*)(exr->img.images[c]);
-      for (int y = 0; y < ht; y++)
-        for (int x = 0; x < wd; x++)
-          out[4*(y * wd + x)+co] = src[y * wd + x];
-    }
-  }
+    threads_parallel_for(0, d.ht, 32, copy_rows, &d);
   FreeEXRImage(&exr->img);
   memset(&exr->img, 0, sizeof(exr->img));
   return 0;
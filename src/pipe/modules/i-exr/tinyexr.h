@@ -648,6 +648,17 @@ extern int LoadEXRFromMemory(float **out_rgba, int *width, int *height,
 #if TINYEXR_USE_THREAD
 #include <atomic>
 #include <thread>
+// the decoders and encoders run the same worker function on a number of threads at once.
+// these hooks allow to use an external thread pool instead of spawning threads:
+#ifndef TINYEXR_NUM_THREADS
+#define TINYEXR_NUM_THREADS() int(std::thread::hardware_concurrency())
+#endif
+#ifndef TINYEXR_RUN_WORKERS
+#define TINYEXR_RUN_WORKERS(num_threads, worker) do { \
+    std::vector<std::thread> workers; \
+    for (int t = 0; t < (num_threads); t++) workers.emplace_back(std::thread(worker)); \
+    for (auto &t : workers) t.join(); } while(0)
+#endif
 #endif
 
 #else  // __cplusplus > 199711L
@@ -4926,16 +4937,15 @@ static int DecodeTiledLevel(EXRImage* exr_image, const EXRHeader* exr_header,
     calloc(sizeof(EXRTile), static_cast<size_t>(num_tiles)));
 
 #if TINYEXR_HAS_CXX11 && (TINYEXR_USE_THREAD > 0)
-  std::vector<std::thread> workers;
   std::atomic<int> tile_count(0);
 
-  int num_threads = std::max(1, int(std::thread::hardware_concurrency()));
+  int num_threads = std::max(1, TINYEXR_NUM_THREADS());
   if (num_threads > int(num_tiles)) {
     num_threads = int(num_tiles);
   }
 
-  for (int t = 0; t < num_threads; t++) {
-    workers.emplace_back(std::thread([&]()
+  {
+    auto worker = [&]()
       {
         int tile_idx = 0;
         while ((tile_idx = tile_count++) < num_tiles) {
@@ -5033,12 +5043,9 @@ static int DecodeTiledLevel(EXRImage* exr_image, const EXRHeader* exr_header,
 
 #if TINYEXR_HAS_CXX11 && (TINYEXR_USE_THREAD > 0)
   }
-        }));
-    }  // num_thread loop
-
-    for (auto& t : workers) {
-      t.join();
-    }
+        };
+    TINYEXR_RUN_WORKERS(num_threads, worker);
+  }
 
 #else
   } // parallel for
@@ -5282,16 +5289,15 @@ static int DecodeChunk(EXRImage *exr_image, const EXRHeader *exr_header,
     }
 
 #if TINYEXR_HAS_CXX11 && (TINYEXR_USE_THREAD > 0)
-    std::vector<std::thread> workers;
     std::atomic<int> y_count(0);
 
-    int num_threads = std::max(1, int(std::thread::hardware_concurrency()));
+    int num_threads = std::max(1, TINYEXR_NUM_THREADS());
     if (num_threads > int(num_blocks)) {
       num_threads = int(num_blocks);
     }
 
-    for (int t = 0; t < num_threads; t++) {
-      workers.emplace_back(std::thread([&]() {
+    {
+      auto worker = [&]() {
         int y = 0;
         while ((y = y_count++) < int(num_blocks)) {
 
@@ -5384,11 +5390,8 @@ static int DecodeChunk(EXRImage *exr_image, const EXRHeader *exr_header,
 
 #if TINYEXR_HAS_CXX11 && (TINYEXR_USE_THREAD > 0)
         }
-      }));
-    }
-
-    for (auto &t : workers) {
-      t.join();
+      };
+      TINYEXR_RUN_WORKERS(num_threads, worker);
     }
 #else
     }  // omp parallel
@@ -7264,16 +7267,15 @@ static int EncodeTiledLevel(const EXRImage* level_image, const EXRHeader* exr_he
 #endif
 
 #if TINYEXR_HAS_CXX11 && (TINYEXR_USE_THREAD > 0)
-  std::vector<std::thread> workers;
   std::atomic<int> tile_count(0);
 
-  int num_threads = std::max(1, int(std::thread::hardware_concurrency()));
+  int num_threads = std::max(1, TINYEXR_NUM_THREADS());
   if (num_threads > int(num_tiles)) {
     num_threads = int(num_tiles);
   }
 
-  for (int t = 0; t < num_threads; t++) {
-    workers.emplace_back(std::thread([&]() {
+  {
+    auto worker = [&]() {
       int i = 0;
       while ((i = tile_count++) < num_tiles) {
 
@@ -7337,12 +7339,9 @@ static int EncodeTiledLevel(const EXRImage* level_image, const EXRHeader* exr_he
 
 #if TINYEXR_HAS_CXX11 && (TINYEXR_USE_THREAD > 0)
   }
-}));
-    }
-
-    for (auto &t : workers) {
-      t.join();
-    }
+};
+    TINYEXR_RUN_WORKERS(num_threads, worker);
+  }
 #else
     }  // omp parallel
 #endif
@@ -7513,13 +7512,12 @@ static int EncodeChunk(const EXRImage* exr_image, const EXRHeader* exr_header,
 
 #if TINYEXR_HAS_CXX11 && (TINYEXR_USE_THREAD > 0)
     std::atomic<bool> invalid_data(false);
-    std::vector<std::thread> workers;
     std::atomic<int> block_count(0);
 
-    int num_threads = std::min(std::max(1, int(std::thread::hardware_concurrency())), num_blocks);
+    int num_threads = std::min(std::max(1, TINYEXR_NUM_THREADS()), num_blocks);
 
-    for (int t = 0; t < num_threads; t++) {
-      workers.emplace_back(std::thread([&]() {
+    {
+      auto worker = [&]() {
         int i = 0;
         while ((i = block_count++) < num_blocks) {
 
@@ -7571,11 +7569,8 @@ static int EncodeChunk(const EXRImage* exr_image, const EXRHeader* exr_header,
       swap4(reinterpret_cast<int*>(&data_list[i][4]));
 #if TINYEXR_HAS_CXX11 && (TINYEXR_USE_THREAD > 0)
         }
-                                       }));
-    }
-
-    for (auto &t : workers) {
-      t.join();
+      };
+      TINYEXR_RUN_WORKERS(num_threads, worker);
     }
 #else
     }  // omp parallel
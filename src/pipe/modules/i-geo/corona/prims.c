@@ -102,7 +102,8 @@ int prims_load_with_flags(
   }
   p->shape[shapeid].data_size = lseek(p->shape[shapeid].fd, 0, SEEK_END);
   lseek(p->shape[shapeid].fd, 0, SEEK_SET);
-  readahead(p->shape[shapeid].fd, 0, p->shape[shapeid].data_size);
+  // no readahead of the whole file: the pages are streamed in when the
+  // geometry is copied to the gpu, see prims_advise().
   p->shape[shapeid].data = mmap(0, p->shape[shapeid].data_size, mmap_flags, MAP_SHARED,
                                p->shape[shapeid].fd, 0);
   close(p->shape[shapeid].fd);
@@ -115,6 +116,7 @@ int prims_load_with_flags(
     return 1;
   }
 
+  madvise(p->shape[shapeid].data, p->shape[shapeid].data_size, MADV_SEQUENTIAL);
   const prims_header_t *header = (const prims_header_t *)p->shape[shapeid].data;
   if(header->magic != GEO_MAGIC)
   {
@@ -141,4 +143,14 @@ int prims_load_with_flags(
   return 0;
 }
 
+void prims_advise(const prims_t *p, uint32_t shapeid, const void *beg, size_t size, int advice)
+{
+  const uintptr_t page = sysconf(_SC_PAGESIZE);
+  const uintptr_t lo = (uintptr_t)p->shape[shapeid].data, hi = lo + p->shape[shapeid].data_size;
+  uintptr_t b = (uintptr_t)beg & ~(page-1), e = (uintptr_t)beg + size;
+  if(b < lo) b = lo;
+  if(e > hi) e = hi;
+  if(e > b) madvise((void *)b, e - b, advice);
+}
+
 #undef common_alloc
@@ -94,6 +94,10 @@ typedef struct prims_t
 }
 prims_t;
 
+// madvise() the page aligned range [beg, beg+size) of the mapping of the shape,
+// clipped to the mapping. used to stream large shapes through memory in chunks.
+void prims_advise(const prims_t *p, uint32_t shapeid, const void *beg, size_t size, int advice);
+
 static inline uint64_t
 prims_get_shape_vtx_cnt(const prims_t *p, uint32_t shapeid)
 {
@@ -4,6 +4,11 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/mman.h>
+
+// vertices are copied to the staging buffers in chunks of this many, the next
+// chunk is read ahead and the pages of the last one are dropped from our mapping.
+#define IGEO_CHUNK (1<<16)
 
 typedef struct geo_t
 {
@@ -203,6 +208,11 @@ int read_geo(
   for(int s=0;s<geo->prims.num_shapes;s++)
   {
     const uint32_t prm_cnt = geo->prims.shape[s].num_prims;
+    if(s+1 < geo->prims.num_shapes)
+    { // read the index data of the next shape while we work on this one
+      const prims_shape_t *next = geo->prims.shape + s + 1;
+      prims_advise(&geo->prims, s+1, next->primid, (uint8_t *)next->vtx - (uint8_t *)next->primid, MADV_WILLNEED);
+    }
     for(uint32_t p=0;i<idx_cnt&&p<prm_cnt;p++)
     {
       // TODO: should check mb!
@@ -226,14 +236,23 @@ int read_geo(
   vtx_off = 0;
   for(int s=0;s<geo->prims.num_shapes;s++)
   {
+    const prims_shape_t *shape = geo->prims.shape + s;
+    // the index data has been read above, vertices come next
+    prims_advise(&geo->prims, s, shape->primid, (uint8_t *)shape->vtx - (uint8_t *)shape->primid, MADV_DONTNEED);
     uint32_t vc = prims_get_shape_vtx_cnt(&geo->prims, s);
-    for(uint32_t v=0;v<vc;v++)
+    prims_advise(&geo->prims, s, shape->vtx, sizeof(prims_vtx_t)*MIN(vc, IGEO_CHUNK), MADV_WILLNEED);
+    for(uint32_t c=0;c<vc;c+=IGEO_CHUNK)
     {
-      pm->vtx[3*(vtx_off+v)+0] = geo->prims.shape[s].vtx[v].v[0];
-      pm->vtx[3*(vtx_off+v)+1] = geo->prims.shape[s].vtx[v].v[1];
-      pm->vtx[3*(vtx_off+v)+2] = geo->prims.shape[s].vtx[v].v[2];
+      const uint32_t ce = MIN(vc, c+IGEO_CHUNK);
+      if(ce < vc) prims_advise(&geo->prims, s, shape->vtx + ce, sizeof(prims_vtx_t)*MIN(vc-ce, IGEO_CHUNK), MADV_WILLNEED);
+      for(uint32_t v=c;v<ce;v++)
+      {
+        pm->vtx[3*(vtx_off+v)+0] = shape->vtx[v].v[0];
+        pm->vtx[3*(vtx_off+v)+1] = shape->vtx[v].v[1];
+        pm->vtx[3*(vtx_off+v)+2] = shape->vtx[v].v[2];
+      }
+      prims_advise(&geo->prims, s, shape->vtx + c, sizeof(prims_vtx_t)*(ce-c), MADV_DONTNEED);
     }
-    // memcpy(vtx, geo->prims.shape[s].vtx, sizeof(float)*3*vtx_cnt);
     vtx_off += vc;
   }
   return 0;
@@ -0,0 +1,233 @@
+#pragma once
+// decode jpeg straight into 8-bit rgba rows, i.e. the staging buffer. no
+// intermediate row buffer: libjpeg-turbo writes rgba itself, plain libjpeg
+// writes rgb to the start of the row which is then expanded in place.
+//
+// large jpegs with restart markers decode in strips on the thread pool. a
+// strip is a number of mcu rows starting at a restart marker, and is turned
+// into a jpeg of its own in memory: the original headers with the height of
+// the strip, its entropy coded segments, renumbered restart markers and eoi.
+// strips decode one restart period more above and below, so that chroma
+// upsampling sees the same neighbours as a serial decode and the seams are
+// exact. anything unusual (progressive, several scans, no restart markers,
+// broken data) falls back to the serial decode.
+#include "core/threads.h"
+
+#include <stdio.h>
+#include <jpeglib.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct jpgerr_t
+{
+  struct jpeg_error_mgr pub;
+  jmp_buf setjmp_buffer;
+}
+jpgerr_t;
+
+static void
+error_exit(j_common_ptr cinfo)
+{
+  jpgerr_t *myerr = (jpgerr_t *)cinfo->err;
+  (*cinfo->err->output_message)(cinfo);
+  longjmp(myerr->setjmp_buffer, 1);
+}
+
+// set the output colour space, call before jpeg_calc_output_dimensions() or jpeg_start_decompress()
+static inline void
+jpg_decode_setup(struct jpeg_decompress_struct *d)
+{
+#ifdef JCS_EXTENSIONS
+  d->out_color_space = JCS_EXT_RGBX; // libjpeg-turbo fills the fourth byte with 0xff
+#else
+  d->out_color_space = JCS_RGB;
+#endif
+}
+
+// decode the output rows up to end into out. rows before beg are only decoded
+// for context and land in row beg, which is overwritten later.
+static inline int
+jpg_decode_rows(
+    struct jpeg_decompress_struct *d,
+    uint8_t                       *out,
+    size_t                         stride, // in bytes
+    uint32_t                       beg,
+    uint32_t                       end)
+{
+  JSAMPROW row[16];
+  while(d->output_scanline < end)
+  {
+    const uint32_t y = d->output_scanline, cnt = MIN(16, end - y);
+    for(uint32_t i=0;i<cnt;i++) row[i] = out + stride * MAX(beg, y+i);
+    const uint32_t got = jpeg_read_scanlines(d, row, cnt);
+    if(!got) return 1;
+#ifndef JCS_EXTENSIONS
+    const int ac = d->out_color_components;
+    for(uint32_t j=0;j<got;j++)
+      for(int i=d->output_width-1;i>=0;i--)
+      { // back to front, the packed pixels are at the start of the row
+        const uint8_t r = row[j][ac*i], g = row[j][ac*i+MIN(1,ac-1)], b = row[j][ac*i+MIN(2,ac-1)];
+        row[j][4*i+0] = r;
+        row[j][4*i+1] = g;
+        row[j][4*i+2] = b;
+        row[j][4*i+3] = 255;
+      }
+#endif
+  }
+  return 0;
+}
+
+typedef struct jpg_strips_t
+{
+  const uint8_t *buf;        // the whole jpeg
+  uint32_t       sof_pos;    // frame header, to patch the height
+  uint32_t       sos_end;    // end of the headers, the entropy coded data starts here
+  uint32_t      *pos;        // marker ending each segment: restart or eoi for the last
+  uint32_t       nseg;       // number of entropy coded segments
+  uint32_t       interval;   // mcus per segment
+  uint32_t       mpr, rows;  // mcus per row, mcu rows
+  uint32_t       mcu_ht, height;
+  uint32_t       step;       // mcu rows such that strips start at a restart marker
+  uint32_t       units, cnt; // steps in the image, number of strips
+  uint32_t       denom;      // dct scaling
+  uint8_t       *out;
+  size_t         stride;
+  uint32_t       out_ht;
+  int            err;
+}
+jpg_strips_t;
+
+static inline int
+_jpg_strip_decode(jpg_strips_t *s, uint32_t j)
+{
+  const uint32_t ub = j*s->units/s->cnt, ue = (j+1)*s->units/s->cnt;
+  const uint32_t a = ub*s->step, b = MIN(ue*s->step, s->rows);
+  const uint32_t a0 = a ? a - s->step : 0, b0 = MIN(b + s->step, s->rows); // with context
+  const uint32_t s0 = (uint64_t)a0 * s->mpr / s->interval;
+  const uint32_t s1 = b0 == s->rows ? s->nseg : (uint64_t)b0 * s->mpr / s->interval;
+  const uint32_t ht = MIN(b0*s->mcu_ht, s->height) - a0*s->mcu_ht;
+  const size_t dat_beg = s0 ? s->pos[s0-1] + 2 : s->sos_end, dat_end = s->pos[s1-1];
+  size_t len = s->sos_end + dat_end - dat_beg;
+  uint8_t *jpg = malloc(len + 2);
+  memcpy(jpg, s->buf, s->sos_end);
+  jpg[s->sof_pos+5] = ht >> 8;
+  jpg[s->sof_pos+6] = ht & 0xff;
+  memcpy(jpg + s->sos_end, s->buf + dat_beg, dat_end - dat_beg);
+  for(uint32_t k=s0;k+1<s1;k++) // restart markers count from zero in every strip
+    jpg[s->sos_end + s->pos[k] - dat_beg + 1] = 0xd0 + ((k - s0) & 7);
+  jpg[len++] = 0xff;
+  jpg[len++] = 0xd9;
+
+  // output rows, relative to the first one of the strip with context
+  const uint32_t o0 = a0*s->mcu_ht/s->denom;
+  const uint32_t ob = a*s->mcu_ht/s->denom - o0;
+  const uint32_t oe = (b == s->rows ? s->out_ht : b*s->mcu_ht/s->denom) - o0;
+
+  struct jpeg_decompress_struct d;
+  jpgerr_t err;
+  volatile int res = 1;
+  d.err = jpeg_std_error(&err.pub);
+  err.pub.error_exit = error_exit;
+  if(setjmp(err.setjmp_buffer)) goto error;
+  jpeg_create_decompress(&d);
+  jpeg_mem_src(&d, jpg, len);
+  jpeg_read_header(&d, TRUE);
+  jpg_decode_setup(&d);
+  d.scale_num   = 1;
+  d.scale_denom = s->denom;
+  (void)jpeg_start_decompress(&d);
+  if(d.output_height >= oe) // stop after our rows, the rest is context
+    res = jpg_decode_rows(&d, s->out + s->stride * o0, s->stride, ob, oe);
+error:
+  jpeg_destroy_decompress(&d);
+  free(jpg);
+  return res;
+}
+
+static void
+_jpg_strips(uint32_t beg, uint32_t end, void *data)
+{
+  jpg_strips_t *s = data;
+  for(uint32_t j=beg;j<end;j++)
+    if(_jpg_strip_decode(s, j)) __atomic_store_n(&s->err, 1, __ATOMIC_RELAXED);
+}
+
+// decode the jpeg in buf in strips on the thread pool. returns non-zero if
+// that's not possible or not worth it, the caller decodes serially then.
+static inline int
+jpg_decode_parallel(
+    const uint8_t *buf,
+    size_t         len,
+    uint32_t       denom,  // dct scaling as in scale_denom
+    uint8_t       *out,
+    size_t         stride, // in bytes
+    uint32_t       out_ht) // output_height of the whole image
+{
+  if(threads_num() <= 1 || len < 4 || len >= UINT32_MAX || buf[0] != 0xff || buf[1] != 0xd8) return 1;
+  jpg_strips_t s = { .buf = buf, .denom = MAX(1, denom), .out = out, .stride = stride, .out_ht = out_ht };
+  uint32_t p = 2, ncomp = 0, hmax = 1, vmax = 1, width = 0;
+  while(p + 4 <= len)
+  { // walk the headers up to the first scan
+    if(buf[p] != 0xff) return 1;
+    const uint8_t m = buf[p+1];
+    if(m == 0xff) { p++; continue; } // fill byte
+    const uint32_t l = (buf[p+2] << 8) | buf[p+3];
+    if(l < 2 || p + 2 + l > len) return 1;
+    if(m == 0xc0 || m == 0xc1)
+    { // huffman sequential, 8 bits
+      if(l < 8 || buf[p+4] != 8) return 1;
+      s.sof_pos = p;
+      s.height  = (buf[p+5] << 8) | buf[p+6];
+      width     = (buf[p+7] << 8) | buf[p+8];
+      ncomp     = buf[p+9];
+      if(l < 8 + 3*ncomp) return 1;
+      for(uint32_t c=0;c<ncomp;c++)
+      {
+        hmax = MAX(hmax, buf[p+11+3*c] >> 4);
+        vmax = MAX(vmax, buf[p+11+3*c] & 0xf);
+      }
+    }
+    else if(m >= 0xc2 && m <= 0xcf && m != 0xc4 && m != 0xc8 && m != 0xcc) return 1; // progressive, lossless, arithmetic
+    else if(m == 0xdd && l >= 4) s.interval = (buf[p+4] << 8) | buf[p+5];
+    else if(m == 0xda)
+    { // one scan with all components
+      if(!s.sof_pos || buf[p+4] != ncomp) return 1;
+      s.sos_end = p + 2 + l;
+      break;
+    }
+    else if(m == 0xd9) return 1;
+    p += 2 + l;
+  }
+  if(!s.sos_end || !s.interval || !s.height || !width) return 1;
+  if((uint64_t)width * s.height < (1u<<22)) return 1; // small images decode faster in one go
+
+  const uint32_t mcu_wd = ncomp == 1 ? 8 : 8*hmax;
+  s.mcu_ht = ncomp == 1 ? 8 : 8*vmax;
+  s.mpr    = (width    + mcu_wd   - 1) / mcu_wd;
+  s.rows   = (s.height + s.mcu_ht - 1) / s.mcu_ht;
+  s.nseg   = ((uint64_t)s.mpr * s.rows + s.interval - 1) / s.interval;
+  uint32_t g = s.interval, h = s.mpr; // gcd
+  while(h) { const uint32_t t = g % h; g = h; h = t; }
+  s.step   = s.interval / g;
+  s.units  = (s.rows + s.step - 1) / s.step;
+  s.cnt    = MIN(threads_num(), s.units / 4); // context is small compared to the strips
+  if(s.cnt < 2) return 1;
+
+  s.pos = malloc(sizeof(uint32_t) * s.nseg);
+  uint32_t k = 0;
+  for(uint32_t i=s.sos_end;i+1<len;i++)
+  { // find the restart markers in the entropy coded data
+    if(buf[i] != 0xff) continue;
+    const uint8_t m = buf[i+1];
+    if(m == 0x00) { i++; continue; } // stuffed zero
+    if(m == 0xff) continue;          // fill byte
+    if(m >= 0xd0 && m <= 0xd7 && k+1 < s.nseg) { s.pos[k++] = i++; continue; }
+    if(m == 0xd9 && k+1 == s.nseg) s.pos[k++] = i;
+    break; // eoi, or a marker we don't expect (more scans)
+  }
+  if(k == s.nseg) threads_parallel_for(0, s.cnt, 1, _jpg_strips, &s);
+  free(s.pos);
+  return k != s.nseg || s.err;
+}
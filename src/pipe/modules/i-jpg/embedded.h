@@ -0,0 +1,120 @@
+#pragma once
+// locate the largest baseline jpeg preview embedded in a raw file. this walks
+// the ifd chain and sub ifds of tiff based containers (cr2 nef arw dng pef orf
+// rw2 ..) and reads the preview pointer in the header of fuji raf. cr3 (bmff)
+// is not supported. nothing is decoded here, libjpeg will do that later.
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+static inline uint32_t
+_jpg_emb_read(FILE *f, int be, int bytes)
+{
+  uint8_t b[4] = {0};
+  if(fread(b, 1, bytes, f) != (size_t)bytes) return 0;
+  if(bytes == 2) return be ? (b[0]<<8)|b[1] : b[0]|(b[1]<<8);
+  return be ? ((uint32_t)b[0]<<24)|(b[1]<<16)|(b[2]<<8)|b[3]
+            : b[0]|(b[1]<<8)|(b[2]<<16)|((uint32_t)b[3]<<24);
+}
+
+static inline int // 1 if the stream at offset is a jpeg libjpeg can decode (not lossless raw data)
+_jpg_emb_baseline(FILE *f, uint64_t offset, uint64_t length)
+{
+  if(length < 4 || fseek(f, offset, SEEK_SET)) return 0;
+  if(fgetc(f) != 0xff || fgetc(f) != 0xd8) return 0;
+  for(int seg=0;seg<64;seg++)
+  {
+    if(fgetc(f) != 0xff) return 0;
+    int m = fgetc(f);
+    while(m == 0xff) m = fgetc(f); // fill bytes
+    if(m == 0xc0 || m == 0xc1 || m == 0xc2) return 1; // huffman sequential or progressive
+    if(m >= 0xc3 && m <= 0xcf && m != 0xc4 && m != 0xc8 && m != 0xcc) return 0; // lossless, arithmetic, ..
+    if(m < 0 || m == 0xd9 || m == 0xda) return 0; // no frame header before scan
+    uint32_t len = _jpg_emb_read(f, 1, 2);
+    if(len < 2 || fseek(f, len-2, SEEK_CUR)) return 0;
+  }
+  return 0;
+}
+
+static inline int // return 0 if a preview has been found
+jpg_find_embedded(
+    FILE     *f,
+    uint64_t *offset,       // output: file offset of the jpeg stream
+    uint64_t *length,       // output: byte length of the jpeg stream
+    int      *orientation)  // output: exif orientation of ifd0, or 0 if unknown
+{
+  *offset = *length = 0;
+  *orientation = 0;
+  uint8_t hdr[92];
+  if(fseek(f, 0, SEEK_END)) return 1;
+  const uint64_t filesize = ftell(f);
+  if(fseek(f, 0, SEEK_SET) || fread(hdr, 1, sizeof(hdr), f) != sizeof(hdr)) return 1;
+
+  if(!memcmp(hdr, "FUJIFILMCCD-RAW", 15))
+  { // raf stores offset and length of the preview big endian in the header
+    uint64_t o = ((uint32_t)hdr[84]<<24)|(hdr[85]<<16)|(hdr[86]<<8)|hdr[87];
+    uint64_t l = ((uint32_t)hdr[88]<<24)|(hdr[89]<<16)|(hdr[90]<<8)|hdr[91];
+    if(o + l > filesize || !_jpg_emb_baseline(f, o, l)) return 1;
+    *offset = o;
+    *length = l;
+    return 0;
+  }
+
+  int be;
+  if     (hdr[0] == 'I' && hdr[1] == 'I') be = 0;
+  else if(hdr[0] == 'M' && hdr[1] == 'M') be = 1;
+  else return 1; // the magic number (42, or something else for orf and rw2) is ignored
+  if(fseek(f, 4, SEEK_SET)) return 1;
+
+  uint32_t ifd[32];
+  int ifd_cnt = 0;
+  ifd[ifd_cnt++] = _jpg_emb_read(f, be, 4);
+  for(int visited=0;ifd_cnt && visited<32;visited++)
+  {
+    const uint32_t pos = ifd[--ifd_cnt];
+    if(!pos || pos + 2 > filesize || fseek(f, pos, SEEK_SET)) continue;
+    const uint32_t num = _jpg_emb_read(f, be, 2);
+    if(num > 1000 || pos + 2 + 12*num + 4 > filesize) continue;
+    uint32_t jpg_off = 0, jpg_len = 0, strip_off = 0, strip_len = 0, compression = 0;
+    for(uint32_t i=0;i<num;i++)
+    {
+      fseek(f, pos + 2 + 12*i, SEEK_SET);
+      const uint32_t tag  = _jpg_emb_read(f, be, 2);
+      const uint32_t type = _jpg_emb_read(f, be, 2);
+      const uint32_t cnt  = _jpg_emb_read(f, be, 4);
+      const uint32_t val  = (type == 3 && cnt == 1) ? _jpg_emb_read(f, be, 2) : _jpg_emb_read(f, be, 4);
+      switch(tag)
+      {
+        case 0x0103: compression = val; break;
+        case 0x0111: if(cnt == 1) strip_off = val; break;
+        case 0x0117: if(cnt == 1) strip_len = val; break;
+        case 0x0112: if(visited == 0) *orientation = val; break;
+        case 0x0201: jpg_off = val; break;
+        case 0x0202: jpg_len = val; break;
+        case 0x014a: // sub ifds are stored inline if there is only one
+          if(cnt == 1) { if(ifd_cnt < 32) ifd[ifd_cnt++] = val; }
+          else for(uint32_t k=0;k<cnt && k<8 && ifd_cnt<32;k++)
+          {
+            if(fseek(f, val + 4*k, SEEK_SET)) break;
+            ifd[ifd_cnt++] = _jpg_emb_read(f, be, 4);
+          }
+          break;
+        default: break;
+      }
+    }
+    fseek(f, pos + 2 + 12*num, SEEK_SET);
+    const uint32_t next = _jpg_emb_read(f, be, 4);
+    if(next && ifd_cnt < 32) ifd[ifd_cnt++] = next;
+
+    uint64_t cand_off[2] = { jpg_off, strip_off }, cand_len[2] = { jpg_len, strip_len };
+    if(compression != 6 && compression != 7) cand_len[1] = 0; // strips are only jpeg with these
+    for(int c=0;c<2;c++)
+      if(cand_len[c] > *length && cand_off[c] + cand_len[c] <= filesize &&
+         _jpg_emb_baseline(f, cand_off[c], cand_len[c]))
+      {
+        *offset = cand_off[c];
+        *length = cand_len[c];
+      }
+  }
+  return *length == 0;
+}
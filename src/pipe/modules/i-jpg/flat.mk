@@ -1,3 +1,3 @@
 MOD_CFLAGS=$(shell pkg-config --cflags libjpeg)
 MOD_LDFLAGS=$(shell pkg-config --libs libjpeg)
-pipe/modules/i-jpg/libi-jpg.so:pipe/modules/i-jpg/jpegexiforient.h
+pipe/modules/i-jpg/libi-jpg.so:pipe/modules/i-jpg/jpegexiforient.h pipe/modules/i-jpg/embedded.h pipe/modules/i-jpg/decode.h
@@ -1,35 +1,31 @@
 #include "modules/api.h"
 #include "jpegexiforient.h"
+#include "embedded.h"
+#include "decode.h"
 
-#include <jpeglib.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <limits.h>
-#include <setjmp.h>
 
 typedef struct jpginput_buf_t
 {
   char filename[PATH_MAX];
   uint32_t frame;
-  uint32_t width, height;
+  uint32_t width, height;   // output dimensions, possibly scaled down
+  uint32_t scale;           // dct scaling denominator, see dt_graph_input_lod()
   struct jpeg_decompress_struct dinfo;
-  FILE *f;
+  uint8_t *data;            // the jpeg stream in memory, libjpeg and the strips read from here
+  size_t   data_len;
 }
 jpginput_buf_t;
 
-typedef struct jpgerr_t
-{
-  struct jpeg_error_mgr pub;
-  jmp_buf setjmp_buffer;
-}
-jpgerr_t;
-
 static void
-error_exit(j_common_ptr cinfo)
+close_jpg(jpginput_buf_t *jpg)
 {
-  jpgerr_t *myerr = (jpgerr_t *)cinfo->err;
-  (*cinfo->err->output_message)(cinfo);
-  longjmp(myerr->setjmp_buffer, 1);
+  jpeg_destroy_decompress(&(jpg->dinfo));
+  free(jpg->data);
+  jpg->data = 0;
+  jpg->filename[0] = 0;
 }
 
 static int 
@@ -43,40 +39,56 @@ read_header(
     return 0; // already loaded
   assert(jpg); // this should be inited in init()
 
-  if(jpg->f)
-  {
-    fclose(jpg->f);
-    jpeg_destroy_decompress(&(jpg->dinfo));
-    jpg->f = 0;
-  }
-  jpg->f = dt_graph_open_resource(mod->graph, frame, filename, "rb");
-  if(!jpg->f)
+  close_jpg(jpg);
+  FILE *f = dt_graph_open_resource(mod->graph, frame, filename, "rb");
+  if(!f)
   {
     jpg->filename[0] = 0;
     return 1;
   }
+  // not a jpeg? try to find a preview embedded in a raw file:
+  uint64_t emb_offset = 0, emb_length = 0;
+  int emb_orientation = 0, embedded = 0;
+  if(fgetc(f) != 0xff || fgetc(f) != 0xd8)
+  {
+    if(jpg_find_embedded(f, &emb_offset, &emb_length, &emb_orientation))
+    {
+      fclose(f);
+      jpg->filename[0] = 0;
+      return 1;
+    }
+    embedded = 1;
+  }
+  else
+  {
+    fseek(f, 0, SEEK_END);
+    emb_length = ftell(f);
+  }
+  fseek(f, emb_offset, SEEK_SET);
+  jpg->data = malloc(emb_length);
+  jpg->data_len = jpg->data ? fread(jpg->data, 1, emb_length, f) : 0;
+  fclose(f);
 
   jpgerr_t err;
   jpg->dinfo.err = jpeg_std_error(&err.pub);
   err.pub.error_exit = error_exit;
   if(setjmp(err.setjmp_buffer))
   {
-    jpeg_destroy_decompress(&(jpg->dinfo));
-    fclose(jpg->f);
-    jpg->f = 0;
-    jpg->filename[0] = 0;
+    close_jpg(jpg);
     return 1;
   }
   jpeg_create_decompress(&(jpg->dinfo));
-  jpeg_stdio_src(&(jpg->dinfo), jpg->f);
+  jpeg_mem_src(&(jpg->dinfo), jpg->data, jpg->data_len);
   // setup_read_exif(&(jpg->dinfo));
   // setup_read_icc_profile(&(jpg->dinfo));
   // jpg->dinfo.buffered_image = TRUE;
   jpeg_read_header(&(jpg->dinfo), TRUE);
-  jpg->dinfo.out_color_space = JCS_RGB;
-  jpg->dinfo.out_color_components = 3;
-  jpg->width  = jpg->dinfo.image_width;
-  jpg->height = jpg->dinfo.image_height;
+  jpg_decode_setup(&(jpg->dinfo));
+  jpg->dinfo.scale_num   = 1;
+  jpg->dinfo.scale_denom = MAX(1, jpg->scale);
+  jpeg_calc_output_dimensions(&(jpg->dinfo));
+  jpg->width  = jpg->dinfo.output_width;
+  jpg->height = jpg->dinfo.output_height;
 
   for(int k=0;k<4;k++)
   {
@@ -86,8 +98,13 @@ read_header(
   }
   mod->img_param.filters = 0;
 
-  FILE *f2 = dt_graph_open_resource(mod->graph, frame, filename, "rb");
-  mod->img_param.orientation = jpg_read_orientation(f2);
+  if(embedded && emb_orientation) mod->img_param.orientation = emb_orientation;
+  else
+  {
+    FILE *f2 = dt_graph_open_resource(mod->graph, frame, filename, "rb");
+    if(f2) fseek(f2, emb_offset, SEEK_SET);
+    mod->img_param.orientation = jpg_read_orientation(f2);
+  }
 
   snprintf(jpg->filename, sizeof(jpg->filename), "%s", filename);
   jpg->frame = frame;
@@ -95,60 +112,31 @@ read_header(
 }
 
 static int
-read_plain(
+jpeg_read(
     jpginput_buf_t *jpg, uint8_t *out)
 {
-  JSAMPROW row_pointer[1];
-  int ac = jpg->dinfo.out_color_components;
-  row_pointer[0] = malloc(jpg->dinfo.output_width * (uint64_t)ac);
-  uint8_t *tmp = out;
-  while(jpg->dinfo.output_scanline < jpg->dinfo.image_height)
+  const size_t stride = 4 * (size_t)jpg->width;
+  if(!jpg_decode_parallel(jpg->data, jpg->data_len, MAX(1, jpg->scale), out, stride, jpg->height))
   {
-    if(jpeg_read_scanlines(&(jpg->dinfo), row_pointer, 1) != 1)
-    {
-      jpeg_destroy_decompress(&(jpg->dinfo));
-      free(row_pointer[0]);
-      fclose(jpg->f);
-      jpg->f = 0;
-      jpg->filename[0] = 0;
-      return 1;
-    }
-    for(unsigned int i = 0; i < jpg->dinfo.image_width; i++)
-    {
-      for(int k = 0; k < 3; k++) tmp[4 * i + k] = row_pointer[0][ac * i + MIN(k,ac-1)];
-      tmp[4*i+3] = 255;
-    }
-    tmp += 4 * jpg->width;
+    close_jpg(jpg);
+    return 0;
   }
-  free(row_pointer[0]);
-  return 0;
-}
 
-static int
-jpeg_read(
-    jpginput_buf_t *jpg, uint8_t *out)
-{
   jpgerr_t err;
   jpg->dinfo.err = jpeg_std_error(&err.pub);
   err.pub.error_exit = error_exit;
   if(setjmp(err.setjmp_buffer))
   {
-    jpeg_destroy_decompress(&(jpg->dinfo));
-    fclose(jpg->f);
-    jpg->f = 0;
-    jpg->filename[0] = 0;
+    close_jpg(jpg);
     return 1;
   }
 
   (void)jpeg_start_decompress(&(jpg->dinfo));
-  read_plain(jpg, out);
+  jpg_decode_rows(&(jpg->dinfo), out, stride, 0, jpg->height);
   (void)jpeg_finish_decompress(&(jpg->dinfo));
   // i think libjpeg doesn't want us to retain the state, at least not the way
   // by splitting here. so we'll just clean it all up:
-  jpeg_destroy_decompress(&(jpg->dinfo));
-  fclose(jpg->f);
-  jpg->f = 0;
-  jpg->filename[0] = 0;
+  close_jpg(jpg);
   return 0;
 }
 
@@ -164,12 +152,7 @@ void cleanup(dt_module_t *mod)
 {
   if(!mod->data) return;
   jpginput_buf_t *jpg = mod->data;
-  jpeg_destroy_decompress(&(jpg->dinfo));
-  if(jpg->filename[0])
-  {
-    if(jpg->f) fclose(jpg->f);
-    jpg->filename[0] = 0;
-  }
+  close_jpg(jpg);
   free(jpg);
   mod->data = 0;
 }
@@ -187,6 +170,17 @@ void modify_roi_out(
     mod->flags = s_module_request_read_source;
   if(read_header(mod, id+graph->frame, filename)) return;
   jpginput_buf_t *jpg = mod->data;
+  // thumbnails may decode directly at reduced size, libjpeg scales by up to 1/8 in the dct
+  const uint32_t scale = dt_graph_input_lod(graph, jpg->dinfo.image_width, jpg->dinfo.image_height, 8);
+  if(scale != MAX(1, jpg->scale))
+  {
+    jpg->scale = scale;
+    jpg->dinfo.scale_num   = 1;
+    jpg->dinfo.scale_denom = scale;
+    jpeg_calc_output_dimensions(&(jpg->dinfo));
+    jpg->width  = jpg->dinfo.output_width;
+    jpg->height = jpg->dinfo.output_height;
+  }
   mod->connector[0].roi.full_wd = jpg->width;
   mod->connector[0].roi.full_ht = jpg->height;
 }
@@ -1,2 +1,3 @@
 MOD_CFLAGS=$(shell pkg-config --cflags libjpeg)
 MOD_LDFLAGS=$(shell pkg-config --libs libjpeg)
+pipe/modules/i-jpglst/libi-jpglst.so:pipe/modules/i-jpg/decode.h
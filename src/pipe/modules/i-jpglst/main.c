@@ -1,11 +1,28 @@
 #include "modules/api.h"
+#include "core/threads.h"
+#include "../i-jpg/decode.h"
 
-#include <jpeglib.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <limits.h>
-#include <setjmp.h>
+#include <pthread.h>
+
+// in streaming mode only a window of images around the current frame is on
+// the array connector. decoded images are kept in slots, and the images
+// coming up next are decoded on the thread pool ahead of time. when loading
+// all images at once, the next few array elements are decoded ahead the same
+// way while the graph copies the current one, as far as LST_AHEAD_MEM allows.
+#define LST_AHEAD 4
+#define LST_AHEAD_MEM (256ul<<20)
+
+typedef struct lst_slot_t
+{
+  int      idx;    // image in the list decoded into this slot, or -1
+  int      state;  // 0 free, 1 decoding, 2 done
+  uint8_t *buf;    // max_wd x max_ht rgba
+}
+lst_slot_t;
 
 typedef struct lst_t
 {
@@ -13,23 +30,18 @@ typedef struct lst_t
   const char **filename; // pointers to lines
   int          cnt;      // number of files in list
   uint32_t    *dim;      // dimensions of the images
-}
-lst_t;
-
-typedef struct jpgerr_t
-{
-  struct jpeg_error_mgr pub;
-  jmp_buf setjmp_buffer;
-}
-jpgerr_t;
 
-static void
-error_exit(j_common_ptr cinfo)
-{
-  jpgerr_t *myerr = (jpgerr_t *)cinfo->err;
-  (*cinfo->err->output_message)(cinfo);
-  longjmp(myerr->setjmp_buffer, 1);
+  dt_module_t    *mod;
+  int             window;  // streaming: images before and after the current frame, or 0 to load all
+  uint32_t        max_wd, max_ht;
+  lst_slot_t     *slot;
+  int             slot_cnt;
+  int             ahead_slot[LST_AHEAD];
+  int             ahead_pending;
+  pthread_mutex_t mutex;
+  pthread_cond_t  cond;
 }
+lst_t;
 
 static void
 read_header(
@@ -62,46 +74,182 @@ static void
 read_full(
     dt_module_t *mod,
     const char  *filename,
-    uint8_t     *out)
+    uint8_t     *out,
+    uint32_t     stride)  // in pixels, 0 for tightly packed
 {
   FILE *f = dt_graph_open_resource(mod->graph, 0, filename, "rb");
   if(!f) return;
+  fseek(f, 0, SEEK_END);
+  const size_t size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  uint8_t *buf = malloc(size);
+  const size_t len = buf ? fread(buf, 1, size, f) : 0;
+  fclose(f);
 
   struct jpeg_decompress_struct dinfo;
   jpgerr_t err;
   dinfo.err = jpeg_std_error(&err.pub);
   err.pub.error_exit = error_exit;
-  if(setjmp(err.setjmp_buffer)) goto error;
+  if(setjmp(err.setjmp_buffer)) goto done;
   jpeg_create_decompress(&dinfo);
-  jpeg_stdio_src(&dinfo, f);
+  jpeg_mem_src(&dinfo, buf, len);
   jpeg_read_header(&dinfo, TRUE);
-  dinfo.out_color_space = JCS_RGB;
-  dinfo.out_color_components = 3;
+  jpg_decode_setup(&dinfo);
 
+  if(!stride) stride = dinfo.image_width;
+  if(!jpg_decode_parallel(buf, len, 1, out, 4*(size_t)stride, dinfo.image_height)) goto done;
   (void)jpeg_start_decompress(&dinfo);
-  JSAMPROW row_pointer[1] = { malloc(dinfo.output_width * (uint64_t)dinfo.num_components) };
-  uint8_t *tmp = out;
-  while(dinfo.output_scanline < dinfo.image_height)
+  if(!jpg_decode_rows(&dinfo, out, 4*(size_t)stride, 0, dinfo.output_height))
+    (void)jpeg_finish_decompress(&dinfo);
+done:
+  jpeg_destroy_decompress(&dinfo);
+  free(buf);
+}
+
+// streaming pads all images to the max size, else the slots are tightly packed like the array elements
+static inline uint32_t
+slot_stride(const lst_t *lst)
+{
+  return lst->window ? lst->max_wd : 0;
+}
+
+static void
+ahead_work(uint32_t item, void *data)
+{
+  lst_t *lst = data;
+  lst_slot_t *s = lst->slot + lst->ahead_slot[item];
+  read_full(lst->mod, lst->filename[s->idx], s->buf, slot_stride(lst));
+  pthread_mutex_lock(&lst->mutex);
+  s->state = 2;
+  lst->ahead_pending--;
+  pthread_cond_broadcast(&lst->cond);
+  pthread_mutex_unlock(&lst->mutex);
+}
+
+static void
+slots_reset(lst_t *lst)
+{
+  pthread_mutex_lock(&lst->mutex);
+  while(lst->ahead_pending) pthread_cond_wait(&lst->cond, &lst->mutex);
+  for(int i=0;i<lst->slot_cnt;i++) free(lst->slot[i].buf);
+  free(lst->slot);
+  lst->slot = 0;
+  lst->slot_cnt = 0;
+  pthread_mutex_unlock(&lst->mutex);
+}
+
+// find a slot to recycle, preferring ones outside the window [beg, end]. call with mutex held
+static int
+slot_victim(lst_t *lst, int beg, int end, int frame)
+{
+  int s = -1, dist = -1;
+  for(int i=0;i<lst->slot_cnt;i++)
   {
-    if(jpeg_read_scanlines(&dinfo, row_pointer, 1) != 1) goto error;
-    for(unsigned int i = 0; i < dinfo.image_width; i++)
-    {
-      for(int k = 0; k < 3; k++) tmp[4 * i + k] = row_pointer[0][3 * i + k];
-      tmp[4*i+3] = 255;
+    if(lst->slot[i].state == 1) continue;
+    if(lst->slot[i].idx < 0) return i;
+    const int d = abs(lst->slot[i].idx - frame);
+    if(lst->slot[i].idx >= beg && lst->slot[i].idx <= end) continue;
+    if(d > dist) { dist = d; s = i; }
+  }
+  return s;
+}
+
+// the slot holding the decoded image idx, or 0. waits if it is being decoded
+// ahead right now. call with mutex held
+static lst_slot_t*
+find_slot(lst_t *lst, int idx)
+{
+  while(1)
+  {
+    int s = -1;
+    for(int i=0;i<lst->slot_cnt&&s<0;i++) if(lst->slot[i].idx == idx) s = i;
+    if(s < 0) return 0;
+    if(lst->slot[s].state == 2) return lst->slot + s;
+    pthread_cond_wait(&lst->cond, &lst->mutex);
+  }
+}
+
+// return the slot holding the decoded image idx, decode it now if needed
+static lst_slot_t*
+get_slot(lst_t *lst, int idx, int frame)
+{
+  pthread_mutex_lock(&lst->mutex);
+  lst_slot_t *sl = find_slot(lst, idx);
+  if(sl)
+  {
+    pthread_mutex_unlock(&lst->mutex);
+    return sl;
+  }
+  const int s = slot_victim(lst, frame - lst->window, frame + lst->window, frame);
+  if(s < 0)
+  {
+    pthread_mutex_unlock(&lst->mutex);
+    return 0;
+  }
+  sl = lst->slot + s;
+  sl->idx   = idx;
+  sl->state = 1;
+  pthread_mutex_unlock(&lst->mutex);
+  if(lst->dim[2*idx] != lst->max_wd || lst->dim[2*idx+1] != lst->max_ht)
+    memset(sl->buf, 0, 4*(size_t)lst->max_wd*lst->max_ht);
+  read_full(lst->mod, lst->filename[idx], sl->buf, slot_stride(lst));
+  pthread_mutex_lock(&lst->mutex);
+  sl->state = 2;
+  pthread_cond_broadcast(&lst->cond);
+  pthread_mutex_unlock(&lst->mutex);
+  return sl;
+}
+
+// queue decoding of the images entering the window after the given frame
+static void
+ahead_schedule(lst_t *lst, int frame)
+{
+  pthread_mutex_lock(&lst->mutex);
+  if(lst->ahead_pending || threads_num() <= 1)
+  {
+    pthread_mutex_unlock(&lst->mutex);
+    return;
+  }
+  const int beg = frame - lst->window, end = frame + lst->window + LST_AHEAD;
+  int cnt = 0;
+  for(int idx=frame+lst->window+1;idx<=end && idx<lst->cnt;idx++)
+  {
+    int have = 0;
+    for(int i=0;i<lst->slot_cnt&&!have;i++) if(lst->slot[i].idx == idx) have = 1;
+    if(have) continue;
+    const int s = slot_victim(lst, beg, end, frame);
+    if(s < 0) break;
+    if(lst->window && (lst->dim[2*idx] != lst->max_wd || lst->dim[2*idx+1] != lst->max_ht))
+      memset(lst->slot[s].buf, 0, 4*(size_t)lst->max_wd*lst->max_ht);
+    lst->slot[s].idx   = idx;
+    lst->slot[s].state = 1;
+    lst->ahead_slot[cnt++] = s;
+  }
+  if(cnt)
+  {
+    lst->ahead_pending = cnt;
+    int taskid = -1;
+    for(int k=0;k<cnt;k++)
+    { // one thread per image
+      int res = threads_task("jpglst", cnt, taskid, lst, ahead_work, 0);
+      if(res < 0) break;
+      taskid = res;
+    }
+    if(taskid < 0)
+    { // no pool, decode on demand
+      for(int k=0;k<cnt;k++) lst->slot[lst->ahead_slot[k]].idx = -1, lst->slot[lst->ahead_slot[k]].state = 0;
+      lst->ahead_pending = 0;
     }
-    tmp += 4 * dinfo.image_width;
   }
-  free(row_pointer[0]);
-  (void)jpeg_finish_decompress(&dinfo);
-error:
-  jpeg_destroy_decompress(&dinfo);
-  fclose(f);
-  return;
+  pthread_mutex_unlock(&lst->mutex);
 }
 
 int init(dt_module_t *mod)
 {
   lst_t *lst = calloc(sizeof(lst_t), 1);
+  lst->mod = mod;
+  pthread_mutex_init(&lst->mutex, 0);
+  pthread_cond_init(&lst->cond, 0);
   mod->data = lst;
   return 0;
 }
@@ -110,6 +258,9 @@ void cleanup(dt_module_t *mod)
 {
   if(!mod->data) return;
   lst_t *lst = mod->data;
+  slots_reset(lst);
+  pthread_mutex_destroy(&lst->mutex);
+  pthread_cond_destroy(&lst->cond);
   if(lst->data)     free(lst->data);
   if(lst->dim)      free(lst->dim);
   if(lst->filename) free(lst->filename);
@@ -128,6 +279,7 @@ void modify_roi_out(
   const char *filename = dt_module_param_string(mod, 0);
   FILE *f = dt_graph_open_resource(mod->graph, 0, filename, "rb");
   if(!f) return;
+  slots_reset(lst); // the decoder threads use the list
   fseek(f, 0, SEEK_END);
   uint64_t size = ftell(f);
   fseek(f, 0, SEEK_SET);
@@ -169,6 +321,29 @@ void modify_roi_out(
   mod->connector[0].array_length = cnt;
   // instruct the connector that we have an array with different image resolution for every element:
   mod->connector[0].array_dim = lst->dim;
+  lst->max_wd = max_wd;
+  lst->max_ht = max_ht;
+  lst->window = MAX(0, dt_module_param_int(mod, 1)[0]);
+  if(lst->window && 2*lst->window+1 < cnt)
+  { // streaming: a window around the current frame, all elements padded to the max size
+    mod->connector[0].array_length = 2*lst->window+1;
+    mod->connector[0].array_dim = 0;
+    mod->flags = s_module_request_read_source;
+    lst->slot_cnt = 2*lst->window+1 + LST_AHEAD;
+  }
+  else
+  { // all at once: slots for decoding ahead, if there are threads to do it
+    lst->window = 0;
+    const size_t size = MAX(1, 4*(size_t)max_wd*max_ht);
+    lst->slot_cnt = threads_num() > 1 && cnt > 1 ? MIN(2*LST_AHEAD+1, LST_AHEAD_MEM / size) : 0;
+    if(lst->slot_cnt < 2) lst->slot_cnt = 0;
+  }
+  lst->slot = lst->slot_cnt ? calloc(sizeof(lst_slot_t), lst->slot_cnt) : 0;
+  for(int i=0;i<lst->slot_cnt;i++)
+  {
+    lst->slot[i].idx = -1;
+    lst->slot[i].buf = calloc(4*(size_t)max_wd, max_ht);
+  }
   for(int k=0;k<4;k++)
   {
     mod->img_param.black[k]        = 0.0f;
@@ -184,6 +359,28 @@ int read_source(
     dt_read_source_params_t *p)
 {
   lst_t *lst = mod->data;
-  read_full(mod, lst->filename[p->a], mapped);
+  if(lst->window)
+  { // element a of the window is image frame - window + a, repeated at the ends
+    const int frame = mod->graph->frame;
+    const int idx = CLAMP(frame - lst->window + (int)p->a, 0, lst->cnt-1);
+    lst_slot_t *s = get_slot(lst, idx, frame);
+    if(!s) return 1;
+    memcpy(mapped, s->buf, 4*(size_t)lst->max_wd*lst->max_ht);
+    if(p->a == mod->connector[0].array_length-1) ahead_schedule(lst, frame);
+    return 0;
+  }
+  if(lst->slot_cnt)
+  { // copy if it has been decoded ahead, and queue the next ones
+    pthread_mutex_lock(&lst->mutex);
+    lst_slot_t *s = find_slot(lst, p->a);
+    pthread_mutex_unlock(&lst->mutex);
+    ahead_schedule(lst, p->a);
+    if(s)
+    {
+      memcpy(mapped, s->buf, 4*(size_t)lst->dim[2*p->a]*lst->dim[2*p->a+1]);
+      return 0;
+    }
+  }
+  read_full(mod, lst->filename[p->a], mapped, 0);
   return 0;
 }
@@ -1,17 +1,83 @@
 #include "modules/api.h"
 #include "core/strexpand.h"
 #include "core/lut.h"
+#include "db/hash.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <limits.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// the .lut files are mapped read only and the mappings are shared between all
+// instances of this module in all graphs of the process (the thumbnail
+// workers all load the same big spectral tables). the data is copied straight
+// from the mapping to the staging buffer.
+typedef struct lut_map_t
+{
+  dev_t    dev;
+  ino_t    ino;
+  int64_t  mtime;
+  size_t   size;
+  uint8_t *data;
+  int      ref;
+}
+lut_map_t;
+
+#define LUT_MAP_MAX 64
+static lut_map_t       lut_map[LUT_MAP_MAX];
+static pthread_mutex_t lut_map_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static lut_map_t *
+lut_map_acquire(FILE *f)
+{
+  struct stat sb;
+  if(fstat(fileno(f), &sb) || sb.st_size < (off_t)sizeof(dt_lut_header_t)) return 0;
+  const int64_t mtime = sb.st_mtim.tv_sec * 1000000000ll + sb.st_mtim.tv_nsec;
+  lut_map_t *m = 0;
+  pthread_mutex_lock(&lut_map_mutex);
+  for(int i=0;i<LUT_MAP_MAX;i++)
+  {
+    if(lut_map[i].data && lut_map[i].dev == sb.st_dev && lut_map[i].ino == sb.st_ino &&
+       lut_map[i].mtime == mtime && lut_map[i].size == (size_t)sb.st_size)
+    {
+      m = lut_map + i;
+      break;
+    }
+    if(!m && !lut_map[i].data) m = lut_map + i; // remember free slot
+  }
+  if(m && !m->data)
+  {
+    void *data = mmap(0, sb.st_size, PROT_READ, MAP_SHARED, fileno(f), 0);
+    if(data == MAP_FAILED) m = 0;
+    else *m = (lut_map_t){
+      .dev = sb.st_dev, .ino = sb.st_ino, .mtime = mtime,
+      .size = sb.st_size, .data = data };
+  }
+  if(m) m->ref++;
+  pthread_mutex_unlock(&lut_map_mutex);
+  return m;
+}
+
+static void
+lut_map_release(lut_map_t *m)
+{
+  if(!m) return;
+  pthread_mutex_lock(&lut_map_mutex);
+  if(--m->ref == 0)
+  {
+    munmap(m->data, m->size);
+    m->data = 0;
+  }
+  pthread_mutex_unlock(&lut_map_mutex);
+}
 
 typedef struct lutinput_buf_t
 {
   char filename[PATH_MAX];
   dt_lut_header_t header;
-  size_t data_begin;
-  FILE *f;
+  lut_map_t *map;
 }
 lutinput_buf_t;
 
@@ -32,17 +98,24 @@ read_header(
     return 0; // already loaded
   assert(lut); // this should be inited in init()
 
-  lut->f = dt_graph_open_resource(mod->graph, 0, filename, "rb");
-  if(!lut->f) goto error;
+  lut_map_release(lut->map);
+  lut->map = 0;
+  FILE *f = dt_graph_open_resource(mod->graph, 0, filename, "rb");
+  if(!f) goto error;
+  lut->map = lut_map_acquire(f);
+  fclose(f); // the mapping stays valid
+  if(!lut->map) goto error;
 
-  if(fread(&lut->header, sizeof(dt_lut_header_t), 1, lut->f) != 1 || lut->header.version != 2)
+  memcpy(&lut->header, lut->map->data, sizeof(dt_lut_header_t));
+  const size_t sz = lut->header.datatype == dt_lut_header_f16 ? sizeof(uint16_t) : sizeof(float);
+  if(lut->header.version != 2 || lut->map->size < sizeof(dt_lut_header_t) +
+      lut->header.wd*(uint64_t)lut->header.ht*lut->header.channels*sz)
   {
-    fclose(lut->f);
+    lut_map_release(lut->map);
+    lut->map = 0;
     goto error;
   }
 
-  lut->data_begin = ftell(lut->f);
-
   for(int k=0;k<4;k++)
   {
     mod->img_param.black[k]        = 0.0f;
@@ -64,10 +137,10 @@ read_plain(
     lutinput_buf_t *lut,
     uint16_t       *out)
 {
-  if(!lut->f) return 1;
-  fseek(lut->f, lut->data_begin, SEEK_SET);
+  if(!lut->map) return 1;
   size_t sz = lut->header.datatype == dt_lut_header_f16 ? sizeof(uint16_t) : sizeof(float);
-  fread(out, lut->header.wd*(uint64_t)lut->header.ht*(uint64_t)lut->header.channels, sz, lut->f);
+  memcpy(out, lut->map->data + sizeof(dt_lut_header_t),
+      lut->header.wd*(uint64_t)lut->header.ht*(uint64_t)lut->header.channels*sz);
   return 0;
 }
 
@@ -83,11 +156,8 @@ void cleanup(dt_module_t *mod)
 {
   if(!mod->data) return;
   lutinput_buf_t *lut = mod->data;
-  if(lut->filename[0])
-  {
-    if(lut->f) fclose(lut->f);
-    lut->filename[0] = 0;
-  }
+  lut_map_release(lut->map);
+  lut->filename[0] = 0;
   free(lut);
   mod->data = 0;
 }
@@ -129,3 +199,21 @@ int read_source(
   lutinput_buf_t *lut = mod->data;
   return read_plain(lut, mapped);
 }
+
+// the data only depends on the mapped file, so it can stay resident on the device
+uint64_t source_key(
+    dt_module_t             *mod,
+    dt_read_source_params_t *p)
+{
+  const char *filename = dt_module_param_string(mod, 0);
+  if(read_header(mod, filename)) return 0;
+  lutinput_buf_t *lut = mod->data;
+  const lut_map_t *m = lut->map;
+  dt_hash_t h;
+  dt_hash_init(&h, m->ino);
+  dt_hash_update_u64(&h, m->dev);
+  dt_hash_update_u64(&h, m->mtime);
+  dt_hash_update_u64(&h, m->size);
+  const uint64_t key = dt_hash_final(&h);
+  return key ? key : 1;
+}
@@ -0,0 +1,42 @@
+#include "modules/api.h"
+
+// the pixels are written straight into the staging memory by the host
+// application, see lib/api.h: vkdt_graph_map_input(). there is nothing to read.
+
+dt_graph_run_t
+check_params(
+    dt_module_t *module,
+    uint32_t     parid,
+    void        *oldval)
+{
+  return s_graph_run_all; // size changed, need to reallocate staging
+}
+
+void modify_roi_out(
+    dt_graph_t  *graph,
+    dt_module_t *mod)
+{
+  for(int k=0;k<4;k++)
+  {
+    mod->img_param.black[k]        = 0.0f;
+    mod->img_param.white[k]        = 1.0f;
+    mod->img_param.whitebalance[k] = 1.0f;
+  }
+  const int wd = MAX(1, dt_module_param_int(mod, 0)[0]);
+  const int ht = MAX(1, dt_module_param_int(mod, 1)[0]);
+  mod->img_param.crop_aabb[0] = 0;
+  mod->img_param.crop_aabb[1] = 0;
+  mod->img_param.crop_aabb[2] = wd;
+  mod->img_param.crop_aabb[3] = ht;
+  mod->img_param.filters = 0;
+  mod->connector[0].roi.full_wd = wd;
+  mod->connector[0].roi.full_ht = ht;
+}
+
+int read_source(
+    dt_module_t             *mod,
+    void                    *mapped,
+    dt_read_source_params_t *p)
+{
+  return 0;
+}
@@ -1,6 +1,7 @@
 #include "modules/api.h"
 #include "connector.h"
 #include "core/core.h"
+#include "core/threads.h"
 #include "adobe_coeff.h"
 
 #include <stdio.h>
@@ -16,13 +17,106 @@
 
 #include "video_mlv.c"
 
+// during playback the next frames are decoded on the thread pool into a ring
+// of slots, one frame per work item. lj92 frames can't be split, but frames
+// are independent.
+#define MLV_RING 8
+
+typedef struct mlv_slot_t
+{
+  int       frame;  // frame decoded into this slot, or -1
+  int       state;  // 0 free, 1 decoding, 2 done, 3 failed
+  uint8_t  *buf;
+}
+mlv_slot_t;
+
 typedef struct buf_t
 {
   char         filename[256]; // opened mlv if any
   mlv_header_t video;
+
+  mlv_slot_t      slot[MLV_RING];
+  size_t          frame_bytes;
+  size_t          packed_bytes;     // uncompressed clips upload the bit packed frames, see unpack.comp
+  int             last_frame;       // last frame read, to detect playback
+  int             ahead_slot[MLV_RING];
+  int             ahead_pending;    // work items of the read-ahead job still running
+  pthread_mutex_t mutex;
+  pthread_cond_t  cond;
 }
 buf_t;
 
+static void
+ahead_work(uint32_t item, void *data)
+{
+  buf_t *dat = data;
+  mlv_slot_t *s = dat->slot + dat->ahead_slot[item];
+  int err = dat->packed_bytes ?
+    mlv_get_frame_packed(&dat->video, s->frame, s->buf) :
+    mlv_get_frame(&dat->video, s->frame, (uint16_t *)s->buf);
+  pthread_mutex_lock(&dat->mutex);
+  s->state = err ? 3 : 2;
+  dat->ahead_pending--;
+  pthread_cond_broadcast(&dat->cond);
+  pthread_mutex_unlock(&dat->mutex);
+}
+
+static void
+ahead_wait(buf_t *dat)
+{ // wait for the read-ahead job to finish, call with mutex held
+  while(dat->ahead_pending) pthread_cond_wait(&dat->cond, &dat->mutex);
+}
+
+static void
+ahead_reset(buf_t *dat)
+{
+  pthread_mutex_lock(&dat->mutex);
+  ahead_wait(dat);
+  for(int i=0;i<MLV_RING;i++)
+  {
+    free(dat->slot[i].buf);
+    dat->slot[i] = (mlv_slot_t){ .frame = -1 };
+  }
+  dat->last_frame = -2;
+  pthread_mutex_unlock(&dat->mutex);
+}
+
+static void // queue decoding of the frames after the given one, call with mutex held
+ahead_schedule(buf_t *dat, int frame)
+{
+  if(dat->ahead_pending || threads_num() <= 1) return;
+  const int ahead = MIN(MLV_RING-1, threads_num());
+  int cnt = 0;
+  for(int f=frame+1;f<=frame+ahead && f<(int)dat->video.MLVI.videoFrameCount;f++)
+  {
+    int have = 0, s = -1;
+    for(int i=0;i<MLV_RING&&!have;i++)
+      if(dat->slot[i].frame == f && dat->slot[i].state != 3) have = 1;
+    if(have) continue;
+    for(int i=0;i<MLV_RING&&s<0;i++) // recycle anything outside the window
+      if(dat->slot[i].frame < frame || dat->slot[i].frame > frame+ahead) s = i;
+    if(s < 0) break;
+    if(!dat->slot[s].buf) dat->slot[s].buf = malloc(dat->frame_bytes);
+    dat->slot[s].frame = f;
+    dat->slot[s].state = 1;
+    dat->ahead_slot[cnt++] = s;
+  }
+  if(!cnt) return;
+  dat->ahead_pending = cnt;
+  int taskid = -1;
+  for(int k=0;k<cnt;k++)
+  { // one thread per frame
+    int res = threads_task("mlv", cnt, taskid, dat, ahead_work, 0);
+    if(res < 0) break;
+    taskid = res;
+  }
+  if(taskid < 0)
+  { // no pool, decode on demand
+    for(int k=0;k<cnt;k++) dat->slot[dat->ahead_slot[k]] = (mlv_slot_t){ .frame = -1, .buf = dat->slot[dat->ahead_slot[k]].buf };
+    dat->ahead_pending = 0;
+  }
+}
+
 int mat3inv(float *const dst, const float *const src)
 {
 #define A(y, x) src[(y - 1) * 3 + (x - 1)]
@@ -81,8 +175,14 @@ open_file(
     fclose(f);
   }
 
+  ahead_reset(dat);
+  if(dat->filename[0]) mlv_header_cleanup(&dat->video);
+  dat->filename[0] = 0;
   if(mlv_open_clip(&dat->video, filename, 0))//MLV_OPEN_PREVIEW)
     return 1;
+  dat->packed_bytes = mlv_packed_size(&dat->video);
+  dat->frame_bytes = dat->packed_bytes ? dat->packed_bytes :
+    sizeof(uint16_t) * dat->video.RAWI.xRes * dat->video.RAWI.yRes;
 
   snprintf(dat->filename, sizeof(dat->filename), "%s", fname);
   return 0;
@@ -95,14 +195,39 @@ read_frame(
 {
   buf_t *dat = mod->data;
   int frame = MIN(mod->graph->frame, dat->video.MLVI.videoFrameCount-1);
-  return mlv_get_frame(
-    &dat->video, frame, mapped);
+  int err = -1;
+  pthread_mutex_lock(&dat->mutex);
+  for(int i=0;i<MLV_RING;i++)
+  {
+    mlv_slot_t *s = dat->slot + i;
+    if(s->frame != frame) continue;
+    while(s->state == 1) pthread_cond_wait(&dat->cond, &dat->mutex);
+    if(s->frame == frame && s->state == 2)
+    {
+      memcpy(mapped, s->buf, dat->frame_bytes);
+      err = 0;
+    }
+    break;
+  }
+  const int playing = frame == dat->last_frame + 1;
+  dat->last_frame = frame;
+  if(playing) ahead_schedule(dat, frame);
+  pthread_mutex_unlock(&dat->mutex);
+  if(playing) mlv_prefetch(&dat->video, frame + MLV_RING); // the disk works while the ring decodes
+  if(err) err = dat->packed_bytes ?
+    mlv_get_frame_packed(&dat->video, frame, mapped) :
+    mlv_get_frame(&dat->video, frame, mapped);
+  return err;
 }
 
 int init(dt_module_t *mod)
 {
   buf_t *dat = malloc(sizeof(*dat));
   memset(dat, 0, sizeof(*dat));
+  pthread_mutex_init(&dat->mutex, 0);
+  pthread_cond_init(&dat->cond, 0);
+  for(int i=0;i<MLV_RING;i++) dat->slot[i].frame = -1;
+  dat->last_frame = -2;
   mod->data = dat;
   mod->flags = s_module_request_read_source;
   return 0;
@@ -112,11 +237,14 @@ void cleanup(dt_module_t *mod)
 {
   if(!mod->data) return;
   buf_t *dat= mod->data;
+  ahead_reset(dat);
   if(dat->filename[0])
   {
     mlv_header_cleanup(&dat->video);
     dat->filename[0] = 0;
   }
+  pthread_mutex_destroy(&dat->mutex);
+  pthread_cond_destroy(&dat->cond);
   free(dat);
   mod->data = 0;
 }
@@ -168,22 +296,11 @@ void modify_roi_out(
   mod->graph->frame_rate = dat->video.frame_rate;
 
   // load noise profile:
-  char pname[512];
-  snprintf(pname, sizeof(pname), "data/nprof/%s-%s-%d.nprof",
-      mod->img_param.maker,
-      mod->img_param.model,
-      (int)mod->img_param.iso);
-  FILE *f = dt_graph_open_resource(graph, 0, pname, "rb");
-  if(f)
+  float noise_a = 0.0f, noise_b = 0.0f;
+  if(!dt_pipe_noise_profile(mod->img_param.maker, mod->img_param.model, (int)mod->img_param.iso, &noise_a, &noise_b))
   {
-    float a = 0.0f, b = 0.0f;
-    int num = fscanf(f, "%g %g", &a, &b);
-    if(num == 2)
-    {
-      mod->img_param.noise_a = a;
-      mod->img_param.noise_b = b;
-    }
-    fclose(f);
+    mod->img_param.noise_a = noise_a;
+    mod->img_param.noise_b = noise_b;
   }
   
   // load colour matrix
@@ -218,6 +335,32 @@ void modify_roi_out(
     mod->img_param.cam_to_rec2020[k] = cam_to_rec2020[k];
 }
 
+void
+create_nodes(
+    dt_graph_t  *graph,
+    dt_module_t *module)
+{
+  buf_t *dat = module->data;
+  dt_roi_t *roi = &module->connector[0].roi;
+  if(!dat->filename[0] || !dat->packed_bytes)
+  { // compressed or 16 bits: decoded on the cpu, straight into the image
+    const int id_source = dt_node_add(graph, module, "i-mlv", "source", roi->wd, roi->ht, 1, 0, 0, 1,
+        "output", "source", "rggb", "ui16", roi);
+    dt_connector_copy(graph, module, 0, id_source, 0);
+    return;
+  }
+  // upload 10/12/14 bits per pixel as they are in the file, unpack on the gpu
+  dt_roi_t proi = (dt_roi_t){ .wd = (dat->packed_bytes+3)/4, .ht = 1 };
+  const int pc[] = { roi->wd, dat->video.RAWI.raw_info.bits_per_pixel };
+  const int id_source = dt_node_add(graph, module, "i-mlv", "source", 1, 1, 1, 0, 0, 1,
+      "packed", "source", "ssbo", "u32", &proi);
+  const int id_unpack = dt_node_add(graph, module, "i-mlv", "unpack", roi->wd, roi->ht, 1, sizeof(pc), pc, 2,
+      "packed", "read",  "ssbo", "u32",  -1ul,
+      "output", "write", "rggb", "ui16", roi);
+  dt_node_connect(graph, id_source, 0, id_unpack, 0);
+  dt_connector_copy(graph, module, 0, id_unpack, 1);
+}
+
 int read_source(
     dt_module_t             *mod,
     void                    *mapped,
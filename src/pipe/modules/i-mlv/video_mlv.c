@@ -6,8 +6,14 @@
 #include <math.h>
 #include <time.h>
 #include <stdint.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "video_mlv.h"
+#include "core/fs.h"
+#include "db/hash.h"
 
 /* Lossless decompression */
 #include "liblj92/lj92.h"
@@ -170,6 +176,148 @@ static void close_all_chunks(FILE ** files, int entries)
   if(files) free(files);
 }
 
+/* Map all chunks, frames are then read straight from the page cache */
+static void map_all_chunks(mlv_header_t *video)
+{
+  video->map = calloc(video->filenum, sizeof(uint8_t *));
+  video->map_size = calloc(video->filenum, sizeof(uint64_t));
+  for(int i = 0; i < video->filenum; i++)
+  {
+    struct stat sb;
+    if(fstat(fileno(video->file[i]), &sb) || !sb.st_size) continue;
+    void *m = mmap(0, sb.st_size, PROT_READ, MAP_SHARED, fileno(video->file[i]), 0);
+    if(m == MAP_FAILED) continue; // pread instead
+    madvise(m, sb.st_size, MADV_SEQUENTIAL);
+    video->map[i] = m;
+    video->map_size[i] = sb.st_size;
+  }
+}
+
+static void unmap_all_chunks(mlv_header_t *video)
+{
+  for(int i = 0; video->map && i < video->filenum; i++)
+    if(video->map[i]) munmap(video->map[i], video->map_size[i]);
+  free(video->map);
+  free(video->map_size);
+}
+
+/* Mapped data of a frame including some padding, or 0 if it isn't mapped */
+static const uint8_t *frame_map(mlv_header_t *video, uint64_t frame_index, uint64_t size)
+{
+  const mlv_frame_index_t *f = video->video_index + frame_index;
+  if(!video->map || !video->map[f->chunk_num]) return 0;
+  if(f->frame_offset + size > video->map_size[f->chunk_num]) return 0;
+  return video->map[f->chunk_num] + f->frame_offset;
+}
+
+void mlv_prefetch(mlv_header_t *video, uint64_t frame_index)
+{
+  if(frame_index >= video->frames) return;
+  const mlv_frame_index_t *f = video->video_index + frame_index;
+  if(!video->map || !video->map[f->chunk_num]) return;
+  const uint64_t page = sysconf(_SC_PAGESIZE);
+  const uint64_t beg = f->frame_offset & ~(page-1);
+  const uint64_t end = MIN(f->frame_offset + MAX(f->frame_size, video->frame_size), video->map_size[f->chunk_num]);
+  if(end > beg) madvise(video->map[f->chunk_num] + beg, end - beg, MADV_WILLNEED);
+}
+
+/* The block index of a clip is kept in <cachedir>/mlv/<hash of the path>.idx,
+ * so big clips don't scan all block headers every time they are opened. The
+ * file starts with a stamp, a hash of the path and the sizes and mtimes of all
+ * chunks, followed by the header struct and the video, audio and VERS index. */
+#define MLV_INDEX_VERSION 1
+
+static uint64_t mlv_index_stamp(mlv_header_t *video, const char *path)
+{
+  dt_hash_t h;
+  dt_hash_init(&h, MLV_INDEX_VERSION);
+  dt_hash_update_u64(&h, sizeof(mlv_header_t));
+  dt_hash_update_u64(&h, sizeof(mlv_frame_index_t));
+  dt_hash_update(&h, path, strlen(path));
+  for(int i = 0; i < video->filenum; i++)
+  {
+    struct stat sb;
+    int64_t st[3] = {0};
+    if(!fstat(fileno(video->file[i]), &sb)) st[0] = sb.st_mtim.tv_sec, st[1] = sb.st_mtim.tv_nsec, st[2] = sb.st_size;
+    dt_hash_update(&h, st, sizeof(st));
+  }
+  return dt_hash_final(&h);
+}
+
+static void mlv_index_filename(const char *path, char *filename, size_t size)
+{
+  char cachedir[PATH_MAX];
+  fs_cachedir(cachedir, sizeof(cachedir));
+  snprintf(filename, size, "%s/mlv/%016lx.idx", cachedir, hash64(path));
+}
+
+/* Fill the index from the cache, returns non-zero if it is missing or stale */
+static int mlv_index_read(mlv_header_t *video, const char *path, uint64_t stamp)
+{
+  char filename[PATH_MAX+40];
+  mlv_index_filename(path, filename, sizeof(filename));
+  FILE *f = fopen(filename, "rb");
+  if(!f) return 1;
+  uint64_t s = 0;
+  mlv_header_t h;
+  if(fread(&s, sizeof(s), 1, f) != 1 || s != stamp || fread(&h, sizeof(h), 1, f) != 1 || !h.frames)
+  {
+    fclose(f);
+    return 1;
+  }
+  const uint32_t cnt[] = { h.frames, h.audios, h.vers_blocks };
+  mlv_frame_index_t *idx[3] = {0};
+  int err = 0;
+  for(int k = 0; k < 3; k++)
+  {
+    if(!cnt[k]) continue;
+    idx[k] = malloc(sizeof(mlv_frame_index_t) * cnt[k]);
+    err |= fread(idx[k], sizeof(mlv_frame_index_t), cnt[k], f) != cnt[k];
+    for(uint32_t i = 0; !err && i < cnt[k]; i++)
+      err |= idx[k][i].chunk_num >= video->filenum;
+  }
+  fclose(f);
+  if(err)
+  {
+    for(int k = 0; k < 3; k++) free(idx[k]);
+    return 1;
+  }
+  h.filenum     = video->filenum;
+  h.is_active   = video->is_active;
+  h.file        = video->file;
+  h.map         = 0;
+  h.map_size    = 0;
+  h.video_index = idx[0];
+  h.audio_index = idx[1];
+  h.vers_index  = idx[2];
+  h.audio_data  = 0;
+  *video = h;
+  return 0;
+}
+
+static void mlv_index_write(mlv_header_t *video, const char *path, uint64_t stamp)
+{
+  char filename[PATH_MAX+40], tmpname[PATH_MAX+50];
+  fs_cachedir(filename, sizeof(filename));
+  fs_mkdir(filename, 0755); // may exist already
+  strcat(filename, "/mlv");
+  fs_mkdir(filename, 0755);
+  mlv_index_filename(path, filename, sizeof(filename));
+  snprintf(tmpname, sizeof(tmpname), "%s.XXXXXX", filename);
+  const int fd = mkstemp(tmpname);
+  if(fd == -1) return;
+  FILE *f = fdopen(fd, "wb");
+  if(!f) { close(fd); unlink(tmpname); return; }
+  fwrite(&stamp, sizeof(stamp), 1, f);
+  fwrite(video, sizeof(*video), 1, f); // the pointers are replaced when reading
+  fwrite(video->video_index, sizeof(mlv_frame_index_t), video->frames, f);
+  if(video->audios)      fwrite(video->audio_index, sizeof(mlv_frame_index_t), video->audios, f);
+  if(video->vers_blocks) fwrite(video->vers_index,  sizeof(mlv_frame_index_t), video->vers_blocks, f);
+  int err = ferror(f);
+  err |= fclose(f);
+  if(err || rename(tmpname, filename)) unlink(tmpname);
+}
+
 // TODO: replace by qsort
 static void frame_index_sort(mlv_frame_index_t *frame_index, uint32_t entries)
 {
@@ -207,26 +355,21 @@ int mlv_get_frame(
   int chunk = video->video_index[frame_index].chunk_num;
   uint32_t frame_size = video->video_index[frame_index].frame_size;
   uint64_t frame_offset = video->video_index[frame_index].frame_offset;
-  uint64_t frame_header_offset = video->video_index[frame_index].block_offset;
 
   /* How many bytes is RAW frame */
   int raw_frame_size = (width * height * bitdepth) / 8;
-  /* Memory buffer for original RAW data */
-  uint8_t *raw_frame = malloc(raw_frame_size + 4); // additional 4 bytes for safety
+  const int compressed = video->MLVI.videoClass & MLV_VIDEO_CLASS_FLAG_LJ92;
+  /* Read straight from the mapped file if we can, else into a buffer */
+  const uint8_t *mapped = frame_map(video, frame_index, (compressed ? frame_size : raw_frame_size) + 4); // additional 4 bytes for safety
+  uint8_t *raw_frame = mapped ? 0 : malloc(MAX(raw_frame_size, frame_size) + 4);
 
-  FILE *file = video->file[chunk];
+  // use pread on the descriptor and leave the FILE alone, so several frames
+  // can be decoded in parallel
+  const int fd = fileno(video->file[chunk]);
 
-  fseek(file, frame_header_offset, SEEK_SET);
-  if(fread(&video->VIDF, sizeof(mlv_vidf_hdr_t), 1, file) != 1)
+  if (compressed)
   {
-    free(raw_frame);
-    return 1;
-  }
-
-  fseek(file, frame_offset, SEEK_SET);
-  if (video->MLVI.videoClass & MLV_VIDEO_CLASS_FLAG_LJ92)
-  {
-    if(fread(raw_frame, frame_size, 1, file) != 1)
+    if(!mapped && pread(fd, raw_frame, frame_size, frame_offset) != (ssize_t)frame_size)
     { // frame data read error
       free(raw_frame);
       return 1;
@@ -234,7 +377,7 @@ int mlv_get_frame(
 
     int components = 1;
     lj92 decoder_object;
-    int ret = lj92_open(&decoder_object, raw_frame, frame_size, &width, &height, &bitdepth, &components);
+    int ret = lj92_open(&decoder_object, (uint8_t *)(mapped ? mapped : raw_frame), frame_size, &width, &height, &bitdepth, &components);
     if(ret != LJ92_ERROR_NONE)
     { // lj92 decoding failed
       free(raw_frame);
@@ -253,12 +396,13 @@ int mlv_get_frame(
   }
   else /* If not compressed just unpack to 16bit */
   {
-    if(fread(raw_frame, raw_frame_size, 1, file) != 1)
+    if(!mapped && pread(fd, raw_frame, raw_frame_size, frame_offset) != raw_frame_size)
     { // can't read frame data
       free(raw_frame);
       return 1;
     }
 
+    const uint8_t *raw = mapped ? mapped : raw_frame;
     uint32_t mask = (1 << bitdepth) - 1;
 #pragma omp parallel for
     for (int i = 0; i < pixel_cnt; ++i)
@@ -267,7 +411,8 @@ int mlv_get_frame(
       uint32_t bits_address = bits_offset / 16;
       uint32_t bits_shift = bits_offset % 16;
       uint32_t rotate_value = 16 + ((32 - bitdepth) - bits_shift);
-      uint32_t uncorrected_data = *((uint32_t *)&((uint16_t *)raw_frame)[bits_address]);
+      uint32_t uncorrected_data;
+      memcpy(&uncorrected_data, raw + 2*bits_address, sizeof(uncorrected_data)); // the mapping may not be aligned
       uint32_t data = ROR32(uncorrected_data, rotate_value);
       unpackedFrame[i] = ((uint16_t)(data & mask));
     }
@@ -277,6 +422,36 @@ int mlv_get_frame(
   return 0;
 }
 
+size_t mlv_packed_size(const mlv_header_t *video)
+{
+  const int bitdepth = video->RAWI.raw_info.bits_per_pixel;
+  if((video->MLVI.videoClass & MLV_VIDEO_CLASS_FLAG_LJ92) || bitdepth <= 0 || bitdepth >= 16) return 0;
+  // the unpacking reads 32 bits at 16-bit word addresses, pad by one word
+  return (video->RAWI.xRes * (size_t)video->RAWI.yRes * bitdepth) / 8 + 4;
+}
+
+int mlv_get_frame_packed(
+    mlv_header_t *video,
+    uint64_t      frame_index,
+    uint8_t      *packedFrame)
+{
+  const size_t size = mlv_packed_size(video);
+  if(!size) return 1;
+  const int chunk = video->video_index[frame_index].chunk_num;
+  const uint64_t frame_offset = video->video_index[frame_index].frame_offset;
+  const ssize_t raw_frame_size = size - 4;
+  memset(packedFrame + raw_frame_size, 0, 4);
+  const uint8_t *mapped = frame_map(video, frame_index, raw_frame_size);
+  if(mapped)
+  {
+    memcpy(packedFrame, mapped, raw_frame_size);
+    return 0;
+  }
+  if(pread(fileno(video->file[chunk]), packedFrame, raw_frame_size, frame_offset) != raw_frame_size)
+    return 1;
+  return 0;
+}
+
 void mlv_header_init(mlv_header_t *video)
 {
   memset(video, 0, sizeof(*video));
@@ -286,6 +461,7 @@ void mlv_header_init(mlv_header_t *video)
 void mlv_header_cleanup(mlv_header_t *video)
 {
   /* Close all MLV file chunks */
+  unmap_all_chunks(video);
   if(video->file) close_all_chunks(video->file, video->filenum);
   /* Free all memory */
   free(video->video_index);
@@ -303,6 +479,16 @@ int mlv_open_clip(
   video->file = load_all_chunks(filename, &video->filenum);
   if(!video->file) return MLV_ERR_OPEN; // can not open file
 
+  char path[PATH_MAX];
+  if(!realpath(filename, path)) snprintf(path, sizeof(path), "%s", filename);
+  const uint64_t stamp = open_mode == MLV_OPEN_FULL ? mlv_index_stamp(video, path) : 0;
+  if(open_mode == MLV_OPEN_FULL && !mlv_index_read(video, path, stamp))
+  { // no need to scan the blocks
+    mlv_read_audio(video);
+    map_all_chunks(video);
+    return MLV_ERR_NONE;
+  }
+
   uint64_t block_num = 0; /* Number of blocks in file */
   mlv_hdr_t block_header; /* Basic MLV block header */
   uint64_t video_frames = 0; /* Number of frames in video */
@@ -630,5 +816,8 @@ preview_out:
   video->frame_size = video->RAWI.xRes * video->RAWI.yRes * video->RAWI.raw_info.bits_per_pixel / 8;
   video->frame_rate = (double)(video->MLVI.sourceFpsNom / (double)video->MLVI.sourceFpsDenom);
 
+  if(open_mode == MLV_OPEN_FULL) mlv_index_write(video, path, stamp);
+  map_all_chunks(video);
+
   return MLV_ERR_NONE;
 }
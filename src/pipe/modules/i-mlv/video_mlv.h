@@ -27,6 +27,9 @@ typedef struct
 
   /* MLV/Lite file(s) */
   FILE ** file;
+  /* The chunks mapped into memory, or 0 where mmap failed */
+  uint8_t  ** map;
+  uint64_t  * map_size;
 
   /* For access to MLV headers */
   mlv_file_hdr_t    MLVI;
@@ -91,7 +94,21 @@ int mlv_open_clip(
 
 void mlv_header_init(mlv_header_t *video);
 void mlv_header_cleanup(mlv_header_t *video);
+// decode one frame. this only reads the index and may be called from several
+// threads at once for different frames.
 int mlv_get_frame(
     mlv_header_t *video,
     uint64_t      frame_index,
     uint16_t     *unpackedFrame);
+// read the bit packed data of an uncompressed frame as is, to be unpacked on
+// the gpu. packedFrame needs mlv_packed_size() bytes.
+int mlv_get_frame_packed(
+    mlv_header_t *video,
+    uint64_t      frame_index,
+    uint8_t      *packedFrame);
+// size of the packed frames or 0 if the clip is compressed or not packed
+size_t mlv_packed_size(const mlv_header_t *video);
+// ask the kernel to read the data of this frame ahead of time
+void mlv_prefetch(
+    mlv_header_t *video,
+    uint64_t      frame_index);
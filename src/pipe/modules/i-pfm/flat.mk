@@ -1 +1 @@
-pipe/modules/i-pfm/libi-pfm.so: core/half.h
+pipe/modules/i-pfm/libi-pfm.so: core/half.h core/threads.h
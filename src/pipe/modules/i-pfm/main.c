@@ -1,10 +1,14 @@
 #include "modules/api.h"
 #include "core/half.h"
 #include "core/core.h"
+#include "core/threads.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <limits.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 typedef struct pfminput_buf_t
 {
@@ -90,20 +94,80 @@ error:
   return 1;
 }
 
+// convert one scanline, which has been copied to the end of row, to half
+// floats in out. expands to rgba in place.
+static inline void
+convert_row(
+    const pfminput_buf_t *pfm,
+    float                *row,
+    uint16_t             *out)
+{
+  const int stride = pfm->channels == 1 ? 1 : 4;
+  const float *in = row + (stride - pfm->channels)*pfm->width;
+  for(int64_t i=0;i<pfm->width;i++)
+  {
+    float px[3];
+    for(int c=0;c<pfm->channels;c++) px[c] = CLAMP(in[pfm->channels*i+c], -65000.0, 65000.0);
+    for(int c=0;c<pfm->channels;c++) row[stride*i+c] = px[c];
+    if(stride == 4) row[stride*i+3] = 1.0f;
+  }
+  float_to_half_n(row, out, stride*pfm->width);
+}
+
+typedef struct pfm_rows_t
+{
+  const pfminput_buf_t *pfm;
+  const uint8_t        *in;  // the mapped pixel data
+  uint16_t             *out;
+}
+pfm_rows_t;
+
+static void
+convert_rows(uint32_t beg, uint32_t end, void *data)
+{
+  const pfm_rows_t *r = data;
+  const pfminput_buf_t *pfm = r->pfm;
+  const int stride = pfm->channels == 1 ? 1 : 4;
+  const size_t row_bytes = sizeof(float)*pfm->channels*pfm->width;
+  float *row = malloc(sizeof(float)*stride*pfm->width);
+  for(uint32_t j=beg;j<end;j++)
+  { // the copy also takes care of alignment, the header may have any length
+    memcpy(row + (stride - pfm->channels)*pfm->width, r->in + row_bytes*j, row_bytes);
+    convert_row(pfm, row, r->out + stride*pfm->width*(size_t)j);
+  }
+  free(row);
+}
+
 static int
 read_plain(
     pfminput_buf_t *pfm, uint16_t *out)
 {
-  fseek(pfm->f, pfm->data_begin, SEEK_SET);
-  uint16_t one = float_to_half(1.0f);
   const int stride = pfm->channels == 1 ? 1 : 4;
-  for(int64_t k=0;k<pfm->width*(int64_t)pfm->height;k++)
+  const size_t size = sizeof(float)*pfm->channels*pfm->width*(size_t)pfm->height;
+  struct stat sb;
+  if(!fstat(fileno(pfm->f), &sb) && (size_t)sb.st_size >= pfm->data_begin + size)
+  { // convert from the mapped file straight into the staging buffer, in parallel
+    void *m = mmap(0, sb.st_size, PROT_READ, MAP_PRIVATE, fileno(pfm->f), 0);
+    if(m != MAP_FAILED)
+    {
+      madvise(m, sb.st_size, MADV_SEQUENTIAL);
+      pfm_rows_t r = { .pfm = pfm, .in = (const uint8_t *)m + pfm->data_begin, .out = out };
+      threads_parallel_for(0, pfm->height, 16, convert_rows, &r);
+      munmap(m, sb.st_size);
+      return 0;
+    }
+  }
+  // short file or no mmap: read a scanline at a time and convert it in one go
+  fseek(pfm->f, pfm->data_begin, SEEK_SET);
+  float *row = malloc(sizeof(float)*4*pfm->width);
+  for(int64_t j=0;j<pfm->height;j++)
   {
-    float in[3];
-    fread(in, pfm->channels, sizeof(float), pfm->f);
-    for(int i=0;i<pfm->channels;i++) out[stride*k+i] = float_to_half(CLAMP(in[i], -65000.0, 65000.0));
-    if(stride == 4) out[stride*k+3] = one;
+    float *in = row + (stride - pfm->channels)*pfm->width; // expand in place to rgba below
+    if(fread(in, sizeof(float)*pfm->channels, pfm->width, pfm->f) != (size_t)pfm->width)
+      memset(in, 0, sizeof(float)*pfm->channels*pfm->width);
+    convert_row(pfm, row, out + stride*pfm->width*j);
   }
+  free(row);
   return 0;
 }
 
@@ -101,6 +101,9 @@ void modify_roi_out(
   { // reading a sequence of raws as a timelapse animation
     mod->flags = s_module_request_read_source;
   }
+  // a burst of consecutive raws from the sequence goes into an array, for burst merging:
+  const int burst = dt_module_param_int(mod, 4)[0];
+  mod->connector[0].array_length = strstr(fname, "%") && burst > 1 ? burst : 0;
   
   if(load_raw(mod, id + graph->frame, filename)) return;
   rawinput_buf_t *mod_data = (rawinput_buf_t *)mod->data;
@@ -124,22 +127,11 @@ void modify_roi_out(
   float *noise_b = (float*)dt_module_param_float(mod, 2);
   if(noise_a[0] == 0.0f && noise_b[0] == 0.0f)
   {
-    char pname[512];
-    snprintf(pname, sizeof(pname), "nprof/%s-%s-%d.nprof",
-        mod->img_param.maker,
-        mod->img_param.model,
-        (int)mod->img_param.iso);
-    FILE *f = dt_graph_open_resource(graph, id, pname, "rb");
-    if(f)
+    float a = 0.0f, b = 0.0f;
+    if(!dt_pipe_noise_profile(mod->img_param.maker, mod->img_param.model, (int)mod->img_param.iso, &a, &b))
     {
-      float a = 0.0f, b = 0.0f;
-      int num = fscanf(f, "%g %g", &a, &b);
-      if(num == 2)
-      {
-        noise_a[0] = mod->img_param.noise_a = a;
-        noise_b[0] = mod->img_param.noise_b = b;
-      }
-      fclose(f);
+      noise_a[0] = mod->img_param.noise_a = a;
+      noise_b[0] = mod->img_param.noise_b = b;
     }
   }
   else
@@ -198,9 +190,10 @@ int read_source(
   const int   id    = dt_module_param_int(mod, 3)[0];
   const char *fname = dt_module_param_string(mod, 0);
   char        filename[2*PATH_MAX+10];
-  if(dt_graph_get_resource_filename(mod, fname, id + mod->graph->frame, filename, sizeof(filename)))
+  const int   a     = mod->connector[0].array_length > 1 ? p->a : 0; // element of the burst
+  if(dt_graph_get_resource_filename(mod, fname, id + mod->graph->frame + a, filename, sizeof(filename)))
     return 1;
-  int err = load_raw(mod, id + mod->graph->frame, filename);
+  int err = load_raw(mod, id + mod->graph->frame + a, filename);
   if(err) return 1;
   // TODO: if img.data_type == 1 it's a f32 buffer instead.
   uint16_t *buf = (uint16_t *)mapped;
@@ -209,6 +202,11 @@ int read_source(
   rawinput_buf_t *mod_data = (rawinput_buf_t *)mod->data;
   int wd = mod_data->img.width;
   int ht = mod_data->img.height;
+  if(wd != mod->connector[0].roi.full_wd || ht != mod->connector[0].roi.full_ht)
+  {
+    dt_log(s_log_err, "[i-raw] %s does not match the size of the first image!", filename);
+    return 1;
+  }
 
   int ox = mod_data->img.cfa_off_x;
   int oy = mod_data->img.cfa_off_y;
@@ -4,7 +4,10 @@
 #include <omp.h>
 #include <unistd.h>
 #include <mutex>
-#include <ctime>
+#include <list>
+#include <algorithm>
+#include <string>
+#include <sys/stat.h>
 #include <math.h>
 #ifdef VKDT_USE_EXIV2
 #include "exif.h"
@@ -13,9 +16,14 @@
 extern "C" {
 #include "modules/api.h"
 #include "core/log.h"
+#include "core/core.h"
+#include "core/threads.h"
 
 static rawspeed::CameraMetaData *meta = 0;
 
+// rawspeed asks this for the number of openmp threads to decode the slices of
+// compressed raws with. loads run on our thread pool, which is busy with other
+// images only during batch work, so use all cores for the one image.
 int rawspeed_get_number_of_processor_cores()
 {
   return sysconf(_SC_NPROCESSORS_ONLN);
@@ -23,7 +31,7 @@ int rawspeed_get_number_of_processor_cores()
 
 typedef struct rawinput_buf_t
 {
-  std::unique_ptr<rawspeed::RawDecoder> d;
+  std::shared_ptr<rawspeed::RawDecoder> d; // may be shared with other graphs via the raw cache
   char filename[PATH_MAX] = {0};
   int ox, oy;
 }
@@ -31,6 +39,35 @@ rawinput_buf_t;
 
 namespace {
 
+// copy rows out of the pitched rawspeed buffer into staging memory on the
+// thread pool, one core doesn't saturate the memory bandwidth for 100MB.
+typedef struct raw_copy_t
+{
+  uint8_t       *dst;
+  const uint8_t *src;
+  size_t         dst_pitch, src_pitch, row_bytes;
+}
+raw_copy_t;
+
+void
+copy_rows(uint32_t begin, uint32_t end, void *data)
+{
+  const raw_copy_t *d = (const raw_copy_t *)data;
+  for(uint32_t j=begin;j<end;j++)
+    memcpy(d->dst + d->dst_pitch*j, d->src + d->src_pitch*j, d->row_bytes);
+}
+
+// contiguous copy in chunks of 1MB
+void
+copy_parallel(void *dst, const void *src, size_t bytes)
+{
+  const size_t chunk = 1ul<<20;
+  raw_copy_t d = { (uint8_t *)dst, (const uint8_t *)src, chunk, chunk, chunk };
+  const uint32_t cnt = bytes / chunk;
+  threads_parallel_for(0, cnt, 4, copy_rows, &d);
+  memcpy(d.dst + chunk*cnt, d.src + chunk*cnt, bytes - chunk*cnt);
+}
+
 inline int
 FC(const size_t row, const size_t col, const uint32_t filters)
 {
@@ -70,6 +107,53 @@ rawspeed_load_meta(const dt_module_t *mod)
   }
 }
 
+// decoded raws are kept in a small lru cache shared by all graphs of the
+// process, so switching back and forth between images in darkroom or opening an
+// image right after its thumbnail has been created does not decode it again.
+struct raw_cache_entry_t
+{
+  std::string filename;
+  int64_t     mtime;
+  off_t       size;
+  size_t      bytes;  // of the decoded buffer
+  std::shared_ptr<rawspeed::RawDecoder> d;
+};
+std::mutex                   raw_cache_lock;
+std::list<raw_cache_entry_t> raw_cache;   // most recently used first
+size_t                       raw_cache_bytes = 0;
+const size_t                 raw_cache_max   = 512ul<<20;
+
+std::shared_ptr<rawspeed::RawDecoder>
+raw_cache_get(const char *filename, const struct stat &sb)
+{
+  const int64_t mtime = sb.st_mtim.tv_sec * 1000000000ll + sb.st_mtim.tv_nsec;
+  std::lock_guard<std::mutex> guard(raw_cache_lock);
+  for(auto it = raw_cache.begin(); it != raw_cache.end(); it++)
+  {
+    if(it->filename != filename || it->mtime != mtime || it->size != sb.st_size) continue;
+    raw_cache.splice(raw_cache.begin(), raw_cache, it);
+    return it->d;
+  }
+  return nullptr;
+}
+
+void
+raw_cache_put(const char *filename, const struct stat &sb, const std::shared_ptr<rawspeed::RawDecoder> &d)
+{
+  const int64_t mtime = sb.st_mtim.tv_sec * 1000000000ll + sb.st_mtim.tv_nsec;
+  const size_t bytes = (size_t)d->mRaw->pitch * d->mRaw->getUncroppedDim().y;
+  std::lock_guard<std::mutex> guard(raw_cache_lock);
+  for(auto &e : raw_cache) // someone was faster
+    if(e.filename == filename && e.mtime == mtime && e.size == sb.st_size) return;
+  raw_cache.push_front({filename, mtime, sb.st_size, bytes, d});
+  raw_cache_bytes += bytes;
+  while(raw_cache.size() > 1 && raw_cache_bytes > raw_cache_max)
+  { // entries still in use by a graph stay alive until that releases them
+    raw_cache_bytes -= raw_cache.back().bytes;
+    raw_cache.pop_back();
+  }
+}
+
 void
 free_raw(dt_module_t *mod)
 { // free auto pointers
@@ -82,7 +166,7 @@ load_raw(
     dt_module_t *mod,
     const char *filename)
 {
-  clock_t beg = clock();
+  const double beg = dt_time();
   rawinput_buf_t *mod_data = (rawinput_buf_t *)mod->data;
   if(mod_data)
   {
@@ -95,6 +179,21 @@ load_raw(
     assert(0); // this should be inited in init()
   }
 
+  // timelapse sequences would only flush the cache
+  const int cached = !(mod->flags & s_module_request_read_source);
+  struct stat sb;
+  if(cached && !stat(filename, &sb))
+  {
+    mod_data->d = raw_cache_get(filename, sb);
+    if(mod_data->d.get())
+    {
+      snprintf(mod_data->filename, sizeof(mod_data->filename), "%s", filename);
+      dt_log(s_log_perf, "[rawspeed] load %s from cache", filename);
+      return 0;
+    }
+  }
+  else sb.st_size = -1;
+
   rawspeed::FileReader f(filename);
 
   try
@@ -113,6 +212,8 @@ load_raw(
     mod_data->d->decodeRaw();
     mod_data->d->decodeMetaData(meta);
     rawspeed::RawImage r = mod_data->d->mRaw;
+    // do this once here, the decoder may be shared between threads later on
+    if(r->blackLevelSeparate[0] == -1) r->calculateBlackAreas();
 
     const auto errors = r->getErrors();
     for(const auto &error : errors) dt_log(s_log_err, "[i-raw] (%s) %s\n", filename, error.c_str());
@@ -136,9 +237,9 @@ load_raw(
     dt_log(s_log_err, "[i-raw] unhandled exception");
     return 1;
   }
-  clock_t end = clock();
+  if(sb.st_size >= 0) raw_cache_put(filename, sb, mod_data->d);
   snprintf(mod_data->filename, sizeof(mod_data->filename), "%s", filename);
-  dt_log(s_log_perf, "[rawspeed] load %s in %3.0fms", filename, 1000.0*(end-beg)/CLOCKS_PER_SEC);
+  dt_log(s_log_perf, "[rawspeed] load %s in %3.0fms", filename, 1000.0*(dt_time()-beg));
   return 0;
 }
 
@@ -200,6 +301,9 @@ void modify_roi_out(
   { // reading a sequence of raws as a timelapse animation
     mod->flags = s_module_request_read_source;
   }
+  // a burst of consecutive raws from the sequence goes into an array, for burst merging:
+  const int burst = dt_module_param_int(mod, 4)[0];
+  mod->connector[0].array_length = strstr(fname, "%") && burst > 1 ? burst : 0;
   
   if(load_raw(mod, filename)) return;
   rawinput_buf_t *mod_data = (rawinput_buf_t *)mod->data;
@@ -227,22 +331,11 @@ void modify_roi_out(
   mod->img_param.iso = mod_data->d->mRaw->metadata.isoSpeed;
   if(noise_a[0] == 0.0f && noise_b[0] == 0.0f)
   {
-    char pname[512];
-    snprintf(pname, sizeof(pname), "nprof/%s-%s-%d.nprof",
-        mod->img_param.maker,
-        mod->img_param.model,
-        (int)mod->img_param.iso);
-    FILE *f = dt_graph_open_resource(graph, id, pname, "rb");
-    if(f)
+    float a = 0.0f, b = 0.0f;
+    if(!dt_pipe_noise_profile(mod->img_param.maker, mod->img_param.model, (int)mod->img_param.iso, &a, &b))
     {
-      float a = 0.0f, b = 0.0f;
-      int num = fscanf(f, "%g %g", &a, &b);
-      if(num == 2)
-      {
-        noise_a[0] = mod->img_param.noise_a = a;
-        noise_b[0] = mod->img_param.noise_b = b;
-      }
-      fclose(f);
+      noise_a[0] = mod->img_param.noise_a = a;
+      noise_b[0] = mod->img_param.noise_b = b;
     }
   }
   else
@@ -259,8 +352,6 @@ void modify_roi_out(
   mod->img_param.crop_aabb[2] = cropTL.x + dimCropped.x;
   mod->img_param.crop_aabb[3] = cropTL.y + dimCropped.y;
 
-  if(mod_data->d->mRaw->blackLevelSeparate[0] == -1)
-    mod_data->d->mRaw->calculateBlackAreas();
   for(int k=0;k<4;k++)
   {
     mod->img_param.black[k]        = mod_data->d->mRaw->blackLevelSeparate[k];
@@ -388,6 +479,10 @@ void modify_roi_out(
   // round down to full block size:
   ro->full_wd = (ro->full_wd/block)*block;
   ro->full_ht = (ro->full_ht/block)*block;
+  // have the upload pick the cropped image out of the pitched rawspeed buffer:
+  // (arrays share one staging buffer and are uploaded compact, see read_source)
+  mod->connector[0].staging_row_length = mod->connector[0].array_length > 1 ? 0 : mod_data->d->mRaw->pitch / sizeof(uint16_t);
+  mod->connector[0].staging_skip       = mod->connector[0].array_length > 1 ? 0 : oy * mod->connector[0].staging_row_length + ox;
 }
 
 int read_source(
@@ -398,7 +493,8 @@ int read_source(
   const int   id    = dt_module_param_int(mod, 3)[0];
   const char *fname = dt_module_param_string(mod, 0);
   char        filename[2*PATH_MAX+10];
-  if(dt_graph_get_resource_filename(mod, fname, id + mod->graph->frame, filename, sizeof(filename)))
+  const int   a     = mod->connector[0].array_length > 1 ? p->a : 0; // element of the burst
+  if(dt_graph_get_resource_filename(mod, fname, id + mod->graph->frame + a, filename, sizeof(filename)))
     return 1;
   int err = load_raw(mod, filename);
   if(err) return 1;
@@ -418,22 +514,37 @@ int read_source(
   const int block = mod->img_param.filters == 9u ? 3 : 2;
   wd = (wd/block)*block;
   ht = (ht/block)*block;
+  if(a && (wd != (int)mod->connector[0].roi.full_wd || ht != (int)mod->connector[0].roi.full_ht))
+  {
+    dt_log(s_log_err, "[i-raw] %s does not match the size of the first image!", filename);
+    return 1;
+  }
   // TODO: make sure the roi we get on the connector agrees with this!
   const size_t bufsize_compact = (size_t)wd * ht * sizeof(uint16_t); // mod_data->d->mRaw->getBpp();
   const size_t bufsize_rawspeed = (size_t)mod_data->d->mRaw->pitch * dim_uncropped.y;
-  if(bufsize_compact == bufsize_rawspeed)
+  const dt_connector_t *c = p->node->connector + p->c;
+  if(c->staging_row_length && c->staging_row_length * sizeof(uint16_t) == (size_t)mod_data->d->mRaw->pitch)
+  { // staging is pitched like our buffer, copy everything up to the last pixel in one go
+    const size_t bufsize = sizeof(uint16_t) * (c->staging_skip + (size_t)c->staging_row_length * (c->roi.ht - 1) + c->roi.wd);
+    copy_parallel(buf,
+        &(mod_data->d->mRaw->getU16DataAsUncroppedArray2DRef()(0,0)),
+        std::min(bufsize, bufsize_rawspeed));
+    return 0;
+  }
+  else if(bufsize_compact == bufsize_rawspeed)
   {
-    memcpy(buf,
+    copy_parallel(buf,
         &(mod_data->d->mRaw->getU16DataAsUncroppedArray2DRef()(0,0)),
         bufsize_compact);
     return 0;
   }
   else
   {
-    for(int j=0;j<ht;j++)
-      memcpy(buf + j*wd,
-          &(mod_data->d->mRaw->getU16DataAsUncroppedArray2DRef()(j+oy,ox)),
-          sizeof(uint16_t)*wd);
+    raw_copy_t d = {
+      (uint8_t *)buf,
+      (const uint8_t *)&(mod_data->d->mRaw->getU16DataAsUncroppedArray2DRef()(oy,ox)),
+      sizeof(uint16_t)*wd, (size_t)mod_data->d->mRaw->pitch, sizeof(uint16_t)*wd };
+    threads_parallel_for(0, ht, 64, copy_rows, &d);
     return 0;
   }
 }
@@ -1,2 +1,4 @@
 MOD_C=pipe/connector.c
-
+MOD_CFLAGS=$(shell pkg-config --cflags libjpeg)
+MOD_LDFLAGS=$(shell pkg-config --libs libjpeg)
+pipe/modules/i-v4l2/libi-v4l2.so:pipe/modules/i-jpg/decode.h
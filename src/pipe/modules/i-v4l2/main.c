@@ -1,5 +1,6 @@
 #include "modules/api.h"
 #include "connector.h"
+#include "../i-jpg/decode.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -29,17 +30,37 @@ typedef struct buf_t
   io_method_t        io_method;   // userptr or mmap
   void              *buffer;      // memory mapped buffer or 0
   size_t             buffer_len;
+  int                dmabuf;      // mmap buffer exported as dma-buf, or -1
+  int                mjpeg;       // mjpeg was allowed when opening the device
 }
 buf_t;
 
+static inline void
+close_device(
+    dt_module_t *mod)
+{
+  buf_t *dat = mod->data;
+  enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  ioctl(dat->fd, VIDIOC_STREAMOFF, &type);
+  if(dat->buffer) munmap(dat->buffer, dat->buffer_len);
+  dat->buffer = 0;
+  if(dat->dmabuf >= 0) close(dat->dmabuf);
+  dat->dmabuf = -1;
+  if(dat->fd != -1) close(dat->fd);
+  dat->fd = -1;
+  dat->device[0] = 0;
+}
+
 static inline int
 open_device(
     dt_module_t *mod,
     const char *device)
 {
   buf_t *dat = mod->data;
-  if(dat && !strcmp(dat->device, device))
+  const int mjpeg = dt_module_param_int(mod, 1)[0];
+  if(dat && !strcmp(dat->device, device) && dat->mjpeg == mjpeg)
     return 0; // already open
+  if(dat->device[0]) close_device(mod);
 
   if((dat->fd = open(device, O_RDWR)) < 0)
   {
@@ -66,26 +87,36 @@ open_device(
     goto error;
   }
 
+  // most usb cameras deliver high resolutions at full frame rate only as mjpeg:
+  dat->mjpeg = mjpeg;
   dat->format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-  dat->format.fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
+  dat->format.fmt.pix.pixelformat = V4L2_PIX_FMT_MJPEG;
   // request away, we'll get the next supported res anyways:
-  dat->format.fmt.pix.width  = 1920;
-  dat->format.fmt.pix.height = 1080;
-
-  if(ioctl(dat->fd, VIDIOC_S_FMT, &dat->format) < 0)
-  { // does not support YUYV, try YUV420
+  dat->format.fmt.pix.width  = 3840;
+  dat->format.fmt.pix.height = 2160;
+  if(!mjpeg || ioctl(dat->fd, VIDIOC_S_FMT, &dat->format) < 0 ||
+     dat->format.fmt.pix.pixelformat != V4L2_PIX_FMT_MJPEG)
+  { // uncompressed
     dat->format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    dat->format.fmt.pix.pixelformat = V4L2_PIX_FMT_YUV420;
+    dat->format.fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
     dat->format.fmt.pix.width  = 1920;
     dat->format.fmt.pix.height = 1080;
+
     if(ioctl(dat->fd, VIDIOC_S_FMT, &dat->format) < 0)
-    { // last try GREY
+    { // does not support YUYV, try YUV420
       dat->format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-      dat->format.fmt.pix.pixelformat = V4L2_PIX_FMT_GREY;
+      dat->format.fmt.pix.pixelformat = V4L2_PIX_FMT_YUV420;
+      dat->format.fmt.pix.width  = 1920;
+      dat->format.fmt.pix.height = 1080;
       if(ioctl(dat->fd, VIDIOC_S_FMT, &dat->format) < 0)
-      {
-        perror("[i-v4l2] VIDIOC_S_FMT");
-        goto error;
+      { // last try GREY
+        dat->format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        dat->format.fmt.pix.pixelformat = V4L2_PIX_FMT_GREY;
+        if(ioctl(dat->fd, VIDIOC_S_FMT, &dat->format) < 0)
+        {
+          perror("[i-v4l2] VIDIOC_S_FMT");
+          goto error;
+        }
       }
     }
   }
@@ -96,13 +127,40 @@ open_device(
 
   // now wd and ht may have changed
 
+  // packed rows are needed to hand the capture buffer to the device as is.
+  // compressed frames have varying size and are decoded on the cpu, so they
+  // always go through memory mapped driver buffers.
+  const int compressed = dat->format.fmt.pix.pixelformat == V4L2_PIX_FMT_MJPEG;
+  const uint32_t bpl = dat->format.fmt.pix.width *
+    (dat->format.fmt.pix.pixelformat == V4L2_PIX_FMT_YUYV ? 2 : 1);
+  dat->dmabuf = -1;
   struct v4l2_requestbuffers bufrequest = {
+    .type   = V4L2_BUF_TYPE_VIDEO_CAPTURE,
+    .memory = V4L2_MEMORY_MMAP,
+    .count  = 1,
+  };
+  if(!compressed && dat->format.fmt.pix.bytesperline == bpl && ioctl(dat->fd, VIDIOC_REQBUFS, &bufrequest) >= 0)
+  { // prefer driver buffers that can be exported as dma-buf, for zero copy import
+    struct v4l2_exportbuffer expbuf = {
+      .type  = V4L2_BUF_TYPE_VIDEO_CAPTURE,
+      .index = 0,
+      .flags = O_RDONLY | O_CLOEXEC,
+    };
+    if(ioctl(dat->fd, VIDIOC_EXPBUF, &expbuf) >= 0) dat->dmabuf = expbuf.fd;
+    else
+    { // release the buffers again and go the usual way
+      bufrequest.count = 0;
+      ioctl(dat->fd, VIDIOC_REQBUFS, &bufrequest);
+    }
+  }
+  bufrequest = (struct v4l2_requestbuffers) {
     .type   = V4L2_BUF_TYPE_VIDEO_CAPTURE,
     .memory = V4L2_MEMORY_USERPTR,
     .count  = 1,
   };
   dat->io_method = s_io_method_userptr;
-  if(ioctl(dat->fd, VIDIOC_REQBUFS, &bufrequest) < 0)
+  if(dat->dmabuf >= 0) dat->io_method = s_io_method_mmap;
+  else if(compressed || ioctl(dat->fd, VIDIOC_REQBUFS, &bufrequest) < 0)
   { // failed userptr, try mmap
     struct v4l2_requestbuffers bufrequest = {
       .type   = V4L2_BUF_TYPE_VIDEO_CAPTURE,
@@ -134,8 +192,10 @@ open_device(
     if(dat->buffer == MAP_FAILED)
     {
       perror("[i-v4l2] memory mapping failed");
+      dat->buffer = 0;
       goto error;
     }
+    dat->buffer_len = bufferinfo.length;
   }
   else dat->buffer = 0;
 
@@ -151,15 +211,49 @@ open_device(
   snprintf(dat->device, sizeof(dat->device), "%s", device);
   return 0;
 error:
+  if(dat->dmabuf >= 0) close(dat->dmabuf);
+  dat->dmabuf = -1;
   close(dat->fd);
   dat->fd = -1;
   return 1;
 }
 
+// decode a motion jpeg frame from the capture buffer into the rgba staging
+// buffer. libjpeg does entropy decoding, idct and colour conversion in one go,
+// on the thread pool in strips if the camera writes restart markers.
+static inline int
+decode_mjpeg(
+    buf_t   *dat,
+    uint8_t *out,
+    size_t   len)
+{
+  const uint32_t wd = dat->format.fmt.pix.width, ht = dat->format.fmt.pix.height;
+  const size_t stride = 4 * (size_t)wd;
+  if(!jpg_decode_parallel(dat->buffer, len, 1, out, stride, ht)) return 0;
+
+  struct jpeg_decompress_struct d;
+  jpgerr_t err;
+  volatile int res = 1;
+  d.err = jpeg_std_error(&err.pub);
+  err.pub.error_exit = error_exit;
+  if(setjmp(err.setjmp_buffer)) goto error;
+  jpeg_create_decompress(&d);
+  jpeg_mem_src(&d, dat->buffer, len);
+  jpeg_read_header(&d, TRUE);
+  jpg_decode_setup(&d);
+  (void)jpeg_start_decompress(&d);
+  if(d.output_width == wd && d.output_height == ht)
+    res = jpg_decode_rows(&d, out, stride, 0, ht);
+error:
+  jpeg_destroy_decompress(&d);
+  return res;
+}
+
 static inline int
 read_frame(
     dt_module_t *mod,
-    void        *mapped)
+    void        *mapped,
+    int          external) // the device reads the dma-buf directly
 {
   buf_t *dat = mod->data;
 
@@ -196,31 +290,23 @@ read_frame(
     return 1;
   }
 
-  if(dat->io_method == s_io_method_mmap)
+  if(dat->format.fmt.pix.pixelformat == V4L2_PIX_FMT_MJPEG)
+  { // keep streaming if the camera sends a broken frame every now and then
+    if(decode_mjpeg(dat, mapped, buf.bytesused))
+      fprintf(stderr, "[i-v4l2] could not decode mjpeg frame!\n");
+  }
+  else if(dat->io_method == s_io_method_mmap && !external)
     memcpy(mapped, dat->buffer, buf.bytesused);
 
   return 0;
 }
 
-static inline void
-close_device(
-    dt_module_t *mod)
-{
-  buf_t *dat = mod->data;
-  enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-  ioctl(dat->fd, VIDIOC_STREAMOFF, &type);
-  if(dat->buffer) munmap(dat->buffer, dat->buffer_len);
-  dat->buffer = 0;
-  if(dat->fd != -1) close(dat->fd);
-  dat->fd = -1;
-  dat->device[0] = 0;
-}
-
 int init(dt_module_t *mod)
 {
   buf_t *dat = malloc(sizeof(*dat));
   memset(dat, 0, sizeof(*dat));
   dat->fd = -1;
+  dat->dmabuf = -1;
   mod->data = dat;
   mod->flags = s_module_request_read_source;
   return 0;
@@ -265,7 +351,18 @@ int read_source(
 {
   const char *device = dt_module_param_string(mod, 0);
   if(open_device(mod, device)) return 1;
-  return read_frame(mod, mapped);
+  return read_frame(mod, mapped, p->node->connector[p->c].mem_external != 0);
+}
+
+int source_dmabuf(
+    dt_module_t             *mod,
+    dt_read_source_params_t *p,
+    uint64_t                *size)
+{
+  buf_t *dat = mod->data;
+  if(!dat || dat->dmabuf < 0) return -1;
+  *size = dat->buffer_len;
+  return dat->dmabuf;
 }
 
 void
@@ -274,11 +371,15 @@ create_nodes(
     dt_module_t *module)
 {
   buf_t *dat = module->data;
-  if(dat->format.fmt.pix.pixelformat == V4L2_PIX_FMT_YUYV)
-  {
+  const int yuyv = dat->format.fmt.pix.pixelformat == V4L2_PIX_FMT_YUYV;
+  if(yuyv || dat->format.fmt.pix.pixelformat == V4L2_PIX_FMT_MJPEG)
+  { // 8-bit rgba: two yuyv pixels per texel, or decoded mjpeg
     dt_roi_t roi2 = module->connector[0].roi;
-    roi2.full_wd /= 2;
-    roi2.wd /= 2;
+    if(yuyv)
+    {
+      roi2.full_wd /= 2;
+      roi2.wd /= 2;
+    }
     assert(graph->num_nodes < graph->max_nodes);
     const int id_in = graph->num_nodes++;
     graph->node[id_in] = (dt_node_t) {
@@ -323,7 +424,7 @@ create_nodes(
         .roi    = module->connector[0].roi,
       }},
       .push_constant_size = sizeof(uint32_t),
-      .push_constant = { 0 },
+      .push_constant = { yuyv ? 0 : 3 },
     };
 
     // interconnect nodes:
@@ -8,11 +8,20 @@
 #include <libavformat/avio.h>
 #include <libavcodec/avcodec.h>
 #include <libavcodec/bsf.h>
+#include <inttypes.h>
 #include <limits.h>
+#include <math.h>
 #include <stdint.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <pthread.h>
+
+// decoded frames are queued by a decoder thread, which runs ahead of
+// read_source() by this many frames:
+#define VID_QUEUE 4
+// audio packets that did not fit the audio decoder yet:
+#define VID_APKT  32
 
 typedef struct vid_data_t
 {
@@ -33,6 +42,24 @@ typedef struct vid_data_t
 
   int p_chroma;
   int p_bits;
+
+  pthread_t             thread;       // decoder thread, owns fmtc, vctx, and the packets
+  int                   running;
+  int                   quit;
+  pthread_mutex_t       mutex;        // protects the queue and the requests below
+  pthread_cond_t        cond;
+  AVFrame              *queue[VID_QUEUE];
+  int64_t               queue_frame[VID_QUEUE];
+  int                   queue_beg, queue_cnt;
+  int64_t               next_frame;   // index of the next frame the thread decodes
+  int64_t               seek_frame;   // request to seek here, or -1
+  int64_t               seek_dts;
+  double                fps;          // graph frames per second, to number the decoded frames
+  int                   still;        // single frame wanted, don't decode ahead
+  int                   error;        // eof or decoding error, the thread waits for a seek
+  pthread_mutex_t       amutex;       // protects actx and the pending audio packets
+  AVPacket             *apkt[VID_APKT];
+  int                   apkt_cnt;
 }
 vid_data_t;
 
@@ -229,6 +256,64 @@ parse_parameters(
   d->p_bits   = p_bits[0];
 }
 
+// timestamp in the time base of the video stream of the given graph frame
+static inline int64_t
+frame_to_ts(vid_data_t *d, int64_t frame)
+{
+  const AVStream *s = d->fmtc->streams[d->video_idx];
+  const int64_t start = s->start_time == AV_NOPTS_VALUE ? 0 : s->start_time;
+  return start + llrint(frame / (d->fps * av_q2d(s->time_base)));
+}
+
+// graph frame of a decoded frame, or -1 if it has no timestamp
+static inline int64_t
+ts_to_frame(vid_data_t *d, const AVFrame *f)
+{
+  const AVStream *s = d->fmtc->streams[d->video_idx];
+  const int64_t start = s->start_time == AV_NOPTS_VALUE ? 0 : s->start_time;
+  if(f->best_effort_timestamp == AV_NOPTS_VALUE) return -1;
+  return MAX(0, llrint((f->best_effort_timestamp - start) * av_q2d(s->time_base) * d->fps));
+}
+
+static inline void
+close_stream(vid_data_t *d)
+{
+  if(!d) return;
+  if(!d->filename[0]) return;
+
+  if(d->running)
+  {
+    pthread_mutex_lock(&d->mutex);
+    d->quit = 1;
+    pthread_cond_broadcast(&d->cond);
+    pthread_mutex_unlock(&d->mutex);
+    pthread_join(d->thread, 0);
+  }
+  for(int i=0;i<VID_QUEUE;i++) av_frame_free(d->queue+i);
+  for(int i=0;i<d->apkt_cnt;i++) av_packet_free(d->apkt+i);
+  pthread_mutex_destroy(&d->mutex);
+  pthread_mutex_destroy(&d->amutex);
+  pthread_cond_destroy(&d->cond);
+
+  av_frame_free(&d->aframe);
+  av_frame_free(&d->vframe);
+  if(d->pkt0->data) av_packet_unref(d->pkt0);
+  if(d->pkt1->data) av_packet_unref(d->pkt1); 
+  if(d->pktf->data) av_packet_unref(d->pktf);
+  av_packet_free(&d->pkt0);
+  av_packet_free(&d->pkt1);
+  av_packet_free(&d->pktf);
+
+  avformat_close_input(&d->fmtc);
+  if(d->mp4) av_bsf_free(&d->vbsfc);
+  if(d->mp4) av_bsf_free(&d->absfc);
+  avcodec_close(d->vctx); // will clean up codec, not context
+  avcodec_free_context(&d->vctx);
+  avcodec_close(d->actx);
+  avcodec_free_context(&d->actx);
+  memset(d, 0, sizeof(*d));
+}
+
 static inline int
 open_stream(
     vid_data_t  *d,
@@ -236,7 +321,12 @@ open_stream(
     const char  *filename)
 {
   if(!strcmp(d->filename, filename)) return 0; // already opened this stream
+  close_stream(d); // stops the decoder thread of the previous stream
   memset(d, 0, sizeof(*d));
+  pthread_mutex_init(&d->mutex, 0);
+  pthread_mutex_init(&d->amutex, 0);
+  pthread_cond_init(&d->cond, 0);
+  d->seek_frame = -1;
 
   int ret = 0;
   fprintf(stderr, "[i-vid] trying to open %s\n", filename);
@@ -312,6 +402,8 @@ open_stream(
   const AVCodec *v_codec = avcodec_find_decoder(vcodec);
   d->vctx = avcodec_alloc_context3(v_codec);
   if((ret = avcodec_parameters_to_context(d->vctx, d->fmtc->streams[d->video_idx]->codecpar)) < 0) goto error;
+  d->vctx->thread_count = 0; // let the codec use frame/slice threads as it sees fit
+  d->vctx->thread_type  = FF_THREAD_FRAME | FF_THREAD_SLICE;
   if((ret = avcodec_open2(d->vctx, v_codec, &opts)) < 0) goto error;
   if(d->audio_idx >= 0)
   {
@@ -344,31 +436,6 @@ int init(dt_module_t *mod)
   return 0;
 }
 
-static inline void
-close_stream(vid_data_t *d)
-{
-  if(!d) return;
-  if(!d->filename[0]) return;
-
-  av_frame_free(&d->aframe);
-  av_frame_free(&d->vframe);
-  if(d->pkt0->data) av_packet_unref(d->pkt0);
-  if(d->pkt1->data) av_packet_unref(d->pkt1); 
-  if(d->pktf->data) av_packet_unref(d->pktf);
-  av_packet_free(&d->pkt0);
-  av_packet_free(&d->pkt1);
-  av_packet_free(&d->pktf);
-
-  avformat_close_input(&d->fmtc);
-  if(d->mp4) av_bsf_free(&d->vbsfc);
-  if(d->mp4) av_bsf_free(&d->absfc);
-  avcodec_close(d->vctx); // will clean up codec, not context
-  avcodec_free_context(&d->vctx);
-  avcodec_close(d->actx);
-  avcodec_free_context(&d->actx);
-  memset(d, 0, sizeof(*d));
-}
-
 void cleanup(dt_module_t *mod)
 {
   vid_data_t *d = mod->data;
@@ -435,6 +502,238 @@ void modify_roi_out(
   mod->connector[0].format = d->p_bits > 0 ? dt_token("ui16") : dt_token("ui8");
 }
 
+// hand an audio packet to the decoder, or keep it for later if its buffer is full.
+// call with amutex held.
+static inline int
+send_audio(vid_data_t *d, AVPacket *pkt)
+{
+  int ret = 0;
+  while(d->apkt_cnt)
+  { // older packets first
+    if((ret = avcodec_send_packet(d->actx, d->apkt[0])) == AVERROR(EAGAIN)) break;
+    av_packet_free(&d->apkt[0]);
+    memmove(d->apkt, d->apkt+1, sizeof(d->apkt[0])*--d->apkt_cnt);
+    if(ret < 0) return ret;
+  }
+  if(!pkt) return 0;
+  if(!d->apkt_cnt && (ret = avcodec_send_packet(d->actx, pkt)) != AVERROR(EAGAIN)) return ret;
+  if(d->apkt_cnt < VID_APKT) d->apkt[d->apkt_cnt++] = av_packet_clone(pkt);
+  return 0; // else drop it, nobody is listening
+}
+
+// decode the next video frame, feeding audio packets to the audio decoder on the way
+static inline int
+decode_frame(
+    vid_data_t *d,
+    AVFrame    *frame)
+{
+  int ret = 0;
+  AVPacket *curr = d->pkt0;
+  do {
+    if(d->pkt0->data) av_packet_unref(d->pkt0);
+    if(d->pkt1->data) av_packet_unref(d->pkt1);
+    if((ret = avcodec_receive_frame(d->vctx, frame)) < 0)
+    {
+      if(ret == AVERROR(EAGAIN))
+      { // receive frame needs moar packets!
+        if((ret = av_read_frame(d->fmtc, curr)) < 0)
+        { // this would have to be EOF hopefully
+          if(ret == AVERROR_EOF)
+          { // flush the decoder to get the last frames
+            if((ret = avcodec_send_packet(d->vctx, 0)) < 0) return ret;
+            continue;
+          }
+          return ret;
+        }
+        if(curr->stream_index == d->video_idx)
+        {
+          AVPacket *pk = curr;
+          if(d->mp4)
+          {
+            if(d->pktf->data) av_packet_unref(d->pktf);
+            if((ret = av_bsf_send_packet   (d->vbsfc, curr))    < 0) return ret;
+            if((ret = av_bsf_receive_packet(d->vbsfc, d->pktf)) < 0) return ret;
+            pk = d->pktf;
+          }
+          if((ret = avcodec_send_packet(d->vctx, pk)) < 0)
+            return ret; // EAGAIN would mean the internal buffer is full, we should have picked it up first.
+        }
+        if(curr->stream_index == d->audio_idx && d->actx)
+        {
+          pthread_mutex_lock(&d->amutex);
+          ret = send_audio(d, curr);
+          pthread_mutex_unlock(&d->amutex);
+          if(ret < 0) return ret;
+        }
+        continue; // go on receive a frame now
+      }
+      return ret; // eof or seems to be broken indeed.
+    }
+    return 0; // got frame
+  } while(1);
+}
+
+static void*
+decoder_thread(void *arg)
+{
+  vid_data_t *d = arg;
+  pthread_mutex_lock(&d->mutex);
+  while(1)
+  {
+    while(!d->quit && d->seek_frame < 0 && (d->error || d->queue_cnt == (d->still ? 1 : VID_QUEUE)))
+      pthread_cond_wait(&d->cond, &d->mutex);
+    if(d->quit) break;
+    if(d->seek_frame >= 0)
+    { // drop the queue and seek
+      for(int i=0;i<d->queue_cnt;i++) av_frame_unref(d->queue[(d->queue_beg+i)%VID_QUEUE]);
+      d->queue_cnt = 0;
+      d->next_frame = d->seek_frame;
+      d->seek_frame = -1;
+      d->error = 0;
+      const int64_t dts = d->seek_dts;
+      pthread_mutex_unlock(&d->mutex);
+      // go to the keyframe at or before the target, the frames up to it are
+      // decoded and dropped below. this moves the whole demuxer, audio included.
+      int ret = av_seek_frame(d->fmtc, d->video_idx, dts, AVSEEK_FLAG_BACKWARD);
+      avcodec_flush_buffers(d->vctx);
+      if(d->actx)
+      {
+        pthread_mutex_lock(&d->amutex);
+        avcodec_flush_buffers(d->actx);
+        for(int i=0;i<d->apkt_cnt;i++) av_packet_free(d->apkt+i);
+        d->apkt_cnt = 0;
+        d->snd_lag = 0;
+        pthread_mutex_unlock(&d->amutex);
+      }
+      pthread_mutex_lock(&d->mutex);
+      if(ret < 0)
+      {
+        fprintf(stderr, "[i-vid] error seeking (%s)\n", av_err2str(ret));
+        d->error = 1;
+        pthread_cond_broadcast(&d->cond);
+      }
+      continue;
+    }
+    const int slot = (d->queue_beg + d->queue_cnt) % VID_QUEUE;
+    pthread_mutex_unlock(&d->mutex);
+    int ret = decode_frame(d, d->queue[slot]);
+    pthread_mutex_lock(&d->mutex);
+    if(d->seek_frame >= 0)
+    { // outdated
+      av_frame_unref(d->queue[slot]);
+      continue;
+    }
+    if(ret < 0)
+    {
+      if(ret != AVERROR_EOF) fprintf(stderr, "[i-vid] error during decoding (%s)\n", av_err2str(ret));
+      d->error = 1;
+    }
+    else
+    {
+      const int64_t idx = ts_to_frame(d, d->queue[slot]);
+      if(idx >= 0 && idx < d->next_frame)
+      { // between the keyframe and the seek target, or a frame the graph rate skips
+        av_frame_unref(d->queue[slot]);
+        continue;
+      }
+      d->queue_frame[slot] = idx >= 0 ? idx : d->next_frame;
+      d->next_frame = d->queue_frame[slot] + 1;
+      d->queue_cnt++;
+    }
+    pthread_cond_broadcast(&d->cond);
+  }
+  pthread_mutex_unlock(&d->mutex);
+  return 0;
+}
+
+// fetch the frame with given index from the decoder thread into d->vframe
+static inline int
+fetch_frame(
+    vid_data_t *d,
+    int64_t     frame,
+    double      fps,
+    int         still)
+{
+  pthread_mutex_lock(&d->mutex);
+  d->fps   = fps > 0.0 ? fps : 24.0; // no fixed frame rate, number them somehow
+  d->still = still;
+  if(!d->running)
+  {
+    for(int i=0;i<VID_QUEUE;i++) d->queue[i] = av_frame_alloc();
+    d->seek_frame = frame ? frame : -1; // fresh stream starts at zero
+    d->seek_dts   = frame_to_ts(d, frame);
+    if(pthread_create(&d->thread, 0, decoder_thread, d))
+    {
+      pthread_mutex_unlock(&d->mutex);
+      return 1;
+    }
+    d->running = 1;
+  }
+  // drop frames before the one we want, seek if it's not coming up soon
+  while(d->queue_cnt && d->queue_frame[d->queue_beg] < frame)
+  {
+    av_frame_unref(d->queue[d->queue_beg]);
+    d->queue_beg = (d->queue_beg + 1) % VID_QUEUE;
+    d->queue_cnt--;
+  }
+  const int64_t upcoming = d->seek_frame >= 0 ? d->seek_frame :
+    d->queue_cnt ? d->queue_frame[d->queue_beg] : d->next_frame;
+  if(upcoming > frame || upcoming + VID_QUEUE < frame)
+  {
+    d->seek_frame = frame;
+    d->seek_dts   = frame_to_ts(d, frame);
+  }
+  pthread_cond_broadcast(&d->cond);
+  int err = 0;
+  while(1)
+  {
+    if(d->seek_frame >= 0)
+    { // the queue is stale until the decoder thread picked up the seek
+      pthread_cond_wait(&d->cond, &d->mutex);
+      continue;
+    }
+    if(d->queue_cnt && d->queue_frame[d->queue_beg] == frame) break;
+    if(d->queue_cnt && d->queue_frame[d->queue_beg] < frame)
+    { // catching up after a short skip
+      av_frame_unref(d->queue[d->queue_beg]);
+      d->queue_beg = (d->queue_beg + 1) % VID_QUEUE;
+      d->queue_cnt--;
+      pthread_cond_broadcast(&d->cond);
+      continue;
+    }
+    if(d->queue_cnt && d->queue_frame[d->queue_beg] > frame)
+    { // inexact seek landed behind us, take what we have
+      break;
+    }
+    if(d->error) { err = 1; break; }
+    pthread_cond_wait(&d->cond, &d->mutex);
+  }
+  if(!err)
+  {
+    av_frame_unref(d->vframe);
+    av_frame_move_ref(d->vframe, d->queue[d->queue_beg]);
+    d->queue_beg = (d->queue_beg + 1) % VID_QUEUE;
+    d->queue_cnt--;
+    pthread_cond_broadcast(&d->cond);
+  }
+  pthread_mutex_unlock(&d->mutex);
+  return err;
+}
+
+// the frame to show when rendering a single still, such as a thumbnail
+static inline int64_t
+poster_frame(
+    dt_module_t *mod,
+    vid_data_t  *d)
+{
+  const int p = dt_module_param_int(mod, dt_module_get_param(mod->so, dt_token("poster")))[0];
+  const double fps = mod->graph->frame_rate;
+  const double len = d->fmtc->duration == AV_NOPTS_VALUE ? 0.0 : d->fmtc->duration / (double)AV_TIME_BASE;
+  const int64_t cnt = MAX(1, (int64_t)(len * fps));
+  if(p >= 0) return MIN(p, cnt-1);
+  return MIN(cnt/10, (int64_t)(10*fps)); // past fades from black, but close to the start
+}
+
 #if 0 // TODO
 int read_vid(
     dt_module_t          *mod,
@@ -449,91 +748,16 @@ int read_source(
   vid_data_t *d = mod->data;
   if(!d->filename[0]) return 1; // not open
 
-  int ret = 0;
-
   if(p->a == 0)
-  { // first channel, new frame. parse + decode + handle audio:
-    const double tbn = 1.0/av_q2d(d->fmtc->streams[d->video_idx]->time_base);
-    int rate = tbn/mod->graph->frame_rate; // some obscure sampling rate vs frames per second number
-    // fprintf(stderr, "frames %d %ld %d %d\n", mod->graph->frame, d->frame, d->vctx->frame_num, vfidx);//d->vframe->pts);
-#if 1
-    // if(mod->graph->frame != d->frame)
-    if(mod->graph->frame + 1 != d->vctx->frame_num) // zero vs 1 based
-    { // seek
-      // XXX ??? can't seek in our own output (maybe it's the mov? try mkv instead)
-      // old api. passing -1 converts the timestamp to something even more obscure.
-      // passing video idx seeks to somewhere about the right place (+10 frames or so)
-      int64_t dts = mod->graph->frame * rate;
-      if((ret = av_seek_frame(d->fmtc, d->video_idx, dts, AVSEEK_FLAG_ANY)) < 0) goto error;
-      if(d->actx)
-      if((ret = av_seek_frame(d->fmtc, d->audio_idx, dts, AVSEEK_FLAG_ANY)) < 0) goto error;
-      avcodec_flush_buffers(d->vctx);
-      if(d->actx) avcodec_flush_buffers(d->actx);
-      d->snd_lag = 0;
+  { // first channel, new frame. the decoder thread parses + decodes + handles audio:
+    const int still = dt_module_param_int(mod, dt_module_get_param(mod->so, dt_token("still")))[0];
+    const int64_t frame = still ? poster_frame(mod, d) : mod->graph->frame;
+    d->frame = frame+1; // this would be the next one we read
+    if(fetch_frame(d, frame, mod->graph->frame_rate, still))
+    {
+      fprintf(stderr, "[i-vid] no frame %"PRId64"\n", frame);
+      return 1;
     }
-#endif
-    d->frame = mod->graph->frame+1; // this would be the next one we read
-
-    AVPacket *curr = d->pkt0;
-    do {
-      if(d->pkt0->data) av_packet_unref(d->pkt0);
-      if(d->pkt1->data) av_packet_unref(d->pkt1);
-      if((ret = avcodec_receive_frame(d->vctx, d->vframe)) < 0)
-      {
-        if(ret == AVERROR(EAGAIN))
-        { // receive frame needs moar packets!
-          if((ret = av_read_frame(d->fmtc, curr)) < 0)
-          { // this would have to be EOF hopefully
-            if(ret == AVERROR_EOF) break;
-            goto error;
-          }
-          if(curr->stream_index == d->video_idx)
-          {
-            AVPacket *pk = curr;
-            if(d->mp4)
-            {
-              if(d->pktf->data) av_packet_unref(d->pktf);
-              if((ret = av_bsf_send_packet   (d->vbsfc, curr))    < 0) goto error;
-              if((ret = av_bsf_receive_packet(d->vbsfc, d->pktf)) < 0) goto error;
-              pk = d->pktf;
-            }
-            if((ret = avcodec_send_packet(d->vctx, pk)) < 0)
-            {
-              if(ret == AVERROR(EAGAIN)) {} // internal buffer is full, stop sending! first pick it up.
-              goto error;
-            }
-          }
-          if(curr->stream_index == d->audio_idx)
-          {
-#if 0
-            AVPacket *pk = curr;
-            if(d->mp4)
-            {
-              if(d->pktf->data) av_packet_unref(d->pktf);
-              if((ret = av_bsf_send_packet   (d->absfc, curr))    < 0) goto error;
-              if((ret = av_bsf_receive_packet(d->absfc, d->pktf)) < 0) goto error;
-              pk = d->pktf;
-            }
-#endif
-            if(d->actx && ((ret = avcodec_send_packet(d->actx, curr)) < 0))
-            {
-              if(ret == AVERROR(EAGAIN)) {} // all good, buffer full already
-              else goto error;
-            }
-          }
-          continue; // go on receive a frame now
-        }
-        else if(ret == AVERROR_EOF)
-        { // receive frame says EOF, flush empty packet
-          if((ret = avcodec_send_packet(d->vctx, 0)) < 0) goto error;
-          continue;
-        }
-        goto error; // seems to be broken indeed.
-      }
-      break; // got frame, exit loop
-    } while(1);
-    // int64_t vfidx = d->vframe->pts;//  / rate;
-    // fprintf(stderr, "frames %d %ld %d %ld\n", mod->graph->frame, d->frame, d->vctx->frame_num, vfidx);//d->vframe->pts);
   }
 
   // write the frame data to output file
@@ -569,9 +793,6 @@ int read_source(
   if(p->a == 2) av_frame_unref(d->vframe);
 
   return 0;
-error:
-  fprintf(stderr, "[i-vid] error during decoding (%s)\n", av_err2str(ret));
-  return 1;
 }
 
 int audio(
@@ -587,11 +808,13 @@ int audio(
   int num_samples = -1;
   int need_samples = -1;
   *samples = (uint8_t *)d->sndbuf;
+  pthread_mutex_lock(&d->amutex); // the decoder thread sends packets
   do {
+    send_audio(d, 0); // packets that didn't fit into the decoder before
     if(d->actx && ((ret = avcodec_receive_frame(d->actx, d->aframe)) < 0))
     {
-      if(ret == AVERROR(EAGAIN)) { } // receive frame needs moar packets! but sorry the main loop is in read_source()
-      return written; // got zero samples in the last round
+      if(ret == AVERROR(EAGAIN)) { } // receive frame needs moar packets! but sorry the main loop is in the decoder thread
+      break; // got zero samples in the last round
     }
 #if 0
       fprintf(stderr, "frame %d, lag %ld got audio with %d channels, lay %lu, %d samples, %s format, rate %d\n",
@@ -617,7 +840,7 @@ int audio(
     if(num_samples == -1)
     {
       float frame_rate = mod->graph->frame_rate;
-      if(frame_rate < 1) return 0; // no fixed frame rate no sound
+      if(frame_rate < 1) { written = 0; break; } // no fixed frame rate no sound
       num_samples = d->aframe->sample_rate / mod->graph->frame_rate + 0.5; // how many per one video frame?
       // num_samples = 44100 / mod->graph->frame_rate + 0.5; // how many per one video frame?
       need_samples = num_samples - d->snd_lag; // how many do we need to also compensate the lag?
@@ -641,6 +864,7 @@ int audio(
     written += d->aframe->nb_samples;
     d->snd_lag = written - need_samples;
   } while(d->snd_lag < 0);
+  pthread_mutex_unlock(&d->amutex);
   return written;
 }
 
@@ -1,2 +1,8 @@
 // how many laplacian pyramids? seems with 6 we start to get artifacts:
 #define NUM_GAMMA 10
+// fewer curve samples when working on a downscaled preview (roi scale >= 2):
+#define NUM_GAMMA_LOD 8
+// levels up to this size are processed by a single workgroup of the coarse kernel.
+// NUM_GAMMA+1 pyramids of 16x16+8x8+4x4+2x2+1 texels need to fit into 16k shared memory:
+#define LLAP_TAIL 16
+#define LLAP_TAIL_TEXELS 341
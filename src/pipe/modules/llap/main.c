@@ -10,6 +10,7 @@ create_nodes(
 {
   const int wd = module->connector[0].roi.wd;
   const int ht = module->connector[0].roi.ht;
+  const dt_token_t fmt = dt_token(dt_api_precision(graph));
   const int dp = 1;
 
   // input
@@ -24,8 +25,12 @@ create_nodes(
   //           C                C -> resample context buf + large scale tone curve/log (one level deeper than the others)
   //
   //      assemble  on all levels, with inputs all buffers from corresponding level
+  //
+  // once a level is small enough, all coarser levels are reduced and assembled
+  // by a single workgroup of the coarse kernel instead.
 
-  const int num_gamma = NUM_GAMMA;
+  // a downscaled preview doesn't need the full set of curve samples
+  const int num_gamma = module->connector[0].roi.scale >= 2.0f ? NUM_GAMMA_LOD : NUM_GAMMA;
 
   assert(graph->num_nodes < graph->max_nodes);
   const int id_curve = graph->num_nodes++;
@@ -41,14 +46,14 @@ create_nodes(
       .name   = dt_token("input"),
       .type   = dt_token("read"),
       .chan   = dt_token("rgba"),
-      .format = dt_token("f16"),
+      .format = fmt,
       .roi    = module->connector[0].roi,
       .connected_mi = -1,
     },{
       .name   = dt_token("output"),
       .type   = dt_token("write"),
       .chan   = dt_token("y"),
-      .format = dt_token("f16"),
+      .format = fmt,
       .roi    = module->connector[0].roi,
       .array_length = num_gamma + 1,
     }},
@@ -68,6 +73,7 @@ create_nodes(
   int id_reduce[12] = {-1};
   id_reduce[0] = id_curve;
   int id_assemble[12] = {-1};
+  int id_coarse = -1;
   for(int l=1;l<nl;l++)
   { // for all coarseness levels
     assert(graph->num_nodes < graph->max_nodes);
@@ -85,7 +91,7 @@ create_nodes(
         .name   = dt_token("inhi"),
         .type   = dt_token("read"),
         .chan   = dt_token("y"),
-        .format = dt_token("f16"),
+        .format = fmt,
         .roi    = rf,
         .flags  = s_conn_smooth,
         .connected_mi = -1,
@@ -94,7 +100,7 @@ create_nodes(
         .name   = dt_token("outlo"),
         .type   = dt_token("write"),
         .chan   = dt_token("y"),
-        .format = dt_token("f16"),
+        .format = fmt,
         .roi    = rc,
         .array_length = num_gamma + 1,
       }},
@@ -123,7 +129,7 @@ create_nodes(
         .name   = dt_token("coarse"),
         .type   = dt_token("read"),
         .chan   = dt_token("y"),
-        .format = dt_token("f16"),
+        .format = fmt,
         .roi    = rc,
         .flags  = s_conn_smooth,
         .connected_mi = -1,
@@ -131,7 +137,7 @@ create_nodes(
         .name   = dt_token("currlo"),
         .type   = dt_token("read"),
         .chan   = dt_token("y"),
-        .format = dt_token("f16"),
+        .format = fmt,
         .roi    = rc,
         .flags  = s_conn_smooth,
         .connected_mi = -1,
@@ -140,7 +146,7 @@ create_nodes(
         .name   = dt_token("currhi"),
         .type   = dt_token("read"),
         .chan   = dt_token("y"),
-        .format = dt_token("f16"),
+        .format = fmt,
         .roi    = rf,
         .flags  = s_conn_smooth,
         .connected_mi = -1,
@@ -149,7 +155,7 @@ create_nodes(
         .name   = dt_token("fine"),
         .type   = dt_token("write"),
         .chan   = dt_token("y"),
-        .format = dt_token("f16"),
+        .format = fmt,
         .roi    = rf,
       }},
       .push_constant_size = 2*sizeof(uint32_t),
@@ -171,11 +177,48 @@ create_nodes(
       nl = l+1;
       break;
     }
+    if(rf.wd <= LLAP_TAIL && rf.ht <= LLAP_TAIL)
+    { // all remaining levels are tiny, do them in one go
+      nl = l+1;
+      assert(graph->num_nodes < graph->max_nodes);
+      id_coarse = graph->num_nodes++;
+      graph->node[id_coarse] = (dt_node_t) {
+        .name   = dt_token("llap"),
+        .kernel = dt_token("coarse"),
+        .module = module,
+        .wd     = 1, // a single workgroup
+        .ht     = 1,
+        .dp     = 1,
+        .num_connectors = 2,
+        .connector = {{
+          .name   = dt_token("input"),
+          .type   = dt_token("read"),
+          .chan   = dt_token("y"),
+          .format = fmt,
+          .roi    = rf,
+          .connected_mi = -1,
+          .array_length = num_gamma + 1,
+        },{
+          .name   = dt_token("output"),
+          .type   = dt_token("write"),
+          .chan   = dt_token("y"),
+          .format = fmt,
+          .roi    = rf,
+        }},
+        .push_constant_size = sizeof(uint32_t),
+        .push_constant = { num_gamma },
+      };
+      CONN(dt_node_connect(graph, id_reduce[l], 1, id_coarse, 0));
+      CONN(dt_node_connect(graph, id_coarse, 1, id_assemble[l], 0));
+      break;
+    }
+  }
+  if(id_coarse < 0)
+  { // id_assemble[l] now has unconnected [0] because no more coarser
+    // bind dummy and let kernel know where to find real data:
+    graph->node[id_assemble[nl-1]].push_constant[1] = 1;
+    CONN(dt_node_connect(graph, id_curve, 1, id_assemble[nl-1], 0));
   }
-  // id_assemble[l] now has unconnected [0] because no more coarser
-  // bind dummy and let kernel know where to find real data:
-  graph->node[id_assemble[nl-1]].push_constant[1] = 1;
-  CONN(dt_node_connect(graph, id_curve, 1, id_assemble[nl-1], 0));
 
   // wire into recolouration node:
   assert(graph->num_nodes < graph->max_nodes);
@@ -192,21 +235,21 @@ create_nodes(
       .name   = dt_token("lum"),
       .type   = dt_token("read"),
       .chan   = dt_token("y"),
-      .format = dt_token("f16"),
+      .format = fmt,
       .roi    = module->connector[0].roi,
       .connected_mi = -1,
     },{
       .name   = dt_token("input"),
       .type   = dt_token("read"),
       .chan   = dt_token("rgba"),
-      .format = dt_token("f16"),
+      .format = fmt,
       .roi    = module->connector[0].roi,
       .connected_mi = -1,
     },{
     .name   = dt_token("output"),
     .type   = dt_token("write"),
     .chan   = dt_token("rgba"),
-    .format = dt_token("f16"),
+    .format = fmt,
     .roi    = module->connector[0].roi,
     }},
   };
@@ -2,4 +2,8 @@
 #define DT_LOCAL_SIZE_H
 #define DT_LOCAL_SIZE_X 8
 #define DT_LOCAL_SIZE_Y 8
+// kernels which only use gl_GlobalInvocationID (no shared memory, local ids or
+// subgroups) can declare their work group size this way instead. it is then a
+// specialisation constant picked per device, see vkdt-cli --autotune.
+#define DT_LOCAL_SIZE_TUNABLE layout(local_size_x_id = 0, local_size_y_id = 1, local_size_z = 1) in;
 #endif
@@ -1,6 +1,29 @@
 #include "modules/api.h"
 #include "core/half.h"
+#include "core/log.h"
 #include <math.h>
+#include <stdlib.h>
+
+// the loss is followed by this many entries of the gradient, if derivative images are connected
+#define LOSS_MAX_GRAD 8
+
+typedef struct loss_t
+{
+  int num_grad; // number of gradient entries in the sink buffer
+}
+loss_t;
+
+int init(dt_module_t *mod)
+{
+  mod->data = calloc(1, sizeof(loss_t));
+  return 0;
+}
+
+void cleanup(dt_module_t *mod)
+{
+  free(mod->data);
+  mod->data = 0;
+}
 
 void modify_roi_in(
     dt_graph_t *graph,
@@ -114,6 +137,50 @@ create_nodes(
     conn = 1;
   }
 
+  // forward mode derivatives of the input with respect to some parameters
+  // (one array element each) are turned into the gradient of the loss:
+  loss_t *dat = module->data;
+  dat->num_grad = 0;
+  const dt_connector_t *cd = module->connector+3;
+  if(cd->connected_mi >= 0)
+  {
+    if(cd->connected_mi != module->connector[0].connected_mi ||
+       cd->roi.wd != module->connector[0].roi.wd || cd->roi.ht != module->connector[0].roi.ht)
+      dt_log(s_log_pipe|s_log_err, "[loss] derivatives have to come from the module connected to the input, ignoring them");
+    else
+      dat->num_grad = MIN(LOSS_MAX_GRAD, MAX(1, cd->array_length));
+  }
+  if(dat->num_grad)
+  {
+    dt_roi_t roi_grad = { .wd = dat->num_grad, .ht = 1, .full_wd = dat->num_grad, .full_ht = 1, .scale = 1.0f };
+    const int pc_grad[] = { dat->num_grad };
+    const int id_grad = dt_node_add(graph, module, "loss", "grad",
+        module->connector[0].roi.wd, module->connector[0].roi.ht, 1, sizeof(pc_grad), pc_grad, 4,
+        "input",  "read",  "*",    "*",   &module->connector[0].roi,
+        "orig",   "read",  "*",    "*",   &module->connector[1].roi,
+        "dinput", "read",  "rgba", "f32", &cd->roi,
+        "grad",   "write", "r",    "ui32", &roi_grad);
+    dt_connector_copy(graph, module, 0, id_grad, 0);
+    dt_connector_copy(graph, module, 1, id_grad, 1);
+    dt_connector_copy(graph, module, 3, id_grad, 2);
+    graph->node[id_grad].connector[3].flags = s_conn_clear;
+
+    const float norm = 1.0f / MAX(1, module->connector[0].roi.wd * module->connector[0].roi.ht);
+    uint32_t pc_gather[2] = { dat->num_grad };
+    memcpy(pc_gather+1, &norm, sizeof(float));
+    dt_roi_t roi_out = { .wd = dat->num_grad+1, .ht = 1, .full_wd = dat->num_grad+1, .full_ht = 1, .scale = 1.0f };
+    const int id_gather = dt_node_add(graph, module, "loss", "gather",
+        roi_out.wd, 1, 1, sizeof(pc_gather), (const int *)pc_gather, 3,
+        "loss",   "read",  "rg", "f32",  &roi,
+        "grad",   "read",  "r",  "ui32", &roi_grad,
+        "output", "write", "rg", "f32",  &roi_out);
+    CONN(dt_node_connect(graph, node,    conn, id_gather, 0));
+    CONN(dt_node_connect(graph, id_grad, 3,    id_gather, 1));
+    node = id_gather;
+    conn = 2;
+    roi  = roi_out;
+  }
+
   assert(graph->num_nodes < graph->max_nodes);
   const int id_sink = graph->num_nodes++;
   graph->node[id_sink] = (dt_node_t) {
@@ -156,12 +223,17 @@ void write_sink(
     dt_module_t *module,
     void *buf)
 {
-  float *loss = 0;
+  float *loss = 0, *grad = 0;
   for(int p=0;p<module->so->num_params;p++)
     if(module->so->param[p]->name == dt_token("loss"))
       loss = (float *)(module->param + module->so->param[p]->offset);
+    else if(module->so->param[p]->name == dt_token("grad"))
+      grad = (float *)(module->param + module->so->param[p]->offset);
   if(!loss) return;
 
   float *b = buf;
   loss[0] = b[0];
+  const loss_t *dat = module->data;
+  if(grad) for(int k=0;k<dat->num_grad;k++)
+    grad[k] = b[2*(k+1)];
 }
@@ -0,0 +1,2 @@
+pipe/modules/lut3d/main.comp.spv: pipe/modules/lut3d/shaper.glsl
+pipe/modules/lut3d/lattice.comp.spv: pipe/modules/lut3d/shaper.glsl
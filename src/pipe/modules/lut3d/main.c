@@ -0,0 +1,78 @@
+#include "modules/api.h"
+#include "core/log.h"
+
+#include <stdio.h>
+
+// mode 0 applies the lut from the second input, mode 1 writes the lattice
+// points to bake the pointwise modules downstream into a lut (see o-lut).
+
+void modify_roi_out(
+    dt_graph_t  *graph,
+    dt_module_t *module)
+{
+  const int mode = dt_module_param_int(module, 0)[0];
+  const int n    = CLAMP(dt_module_param_int(module, 1)[0], 2, 64);
+  dt_roi_t *ri = &module->connector[0].roi;
+  dt_roi_t *ro = &module->connector[2].roi;
+  ro->full_wd = mode == 1 ? n*n : ri->full_wd;
+  ro->full_ht = mode == 1 ? n   : ri->full_ht;
+}
+
+void modify_roi_in(
+    dt_graph_t  *graph,
+    dt_module_t *module)
+{
+  const int mode = dt_module_param_int(module, 0)[0];
+  dt_roi_t *ri = &module->connector[0].roi;
+  dt_roi_t *rl = &module->connector[1].roi;
+  dt_roi_t *ro = &module->connector[2].roi;
+  if(mode == 1)
+  { // the lattice doesn't look at the pixels, only pass on the image metadata
+    ri->scale = MAX(1.0f, ri->full_wd / 64.0f);
+    ri->wd    = ri->full_wd / ri->scale;
+    ri->ht    = ri->full_ht / ri->scale;
+  }
+  else
+  {
+    ri->wd    = ro->wd;
+    ri->ht    = ro->ht;
+    ri->scale = ro->scale;
+  }
+  rl->wd    = rl->full_wd;
+  rl->ht    = rl->full_ht;
+  rl->scale = 1.0f;
+}
+
+void
+create_nodes(
+    dt_graph_t  *graph,
+    dt_module_t *module)
+{
+  const int mode = dt_module_param_int(module, 0)[0];
+  dt_roi_t *ro = &module->connector[2].roi;
+  if(mode == 1)
+  {
+    const int n = CLAMP(dt_module_param_int(module, 1)[0], 2, 64);
+    if(ro->wd != n*n || ro->ht != n)
+      dt_log(s_log_pipe|s_log_err, "[lut3d] lattice needs to be written at full resolution %dx%d!", n*n, n);
+    const int pc[] = { n };
+    const int id_lattice = dt_node_add(graph, module, "lut3d", "lattice",
+        ro->wd, ro->ht, 1, sizeof(pc), pc, 1,
+        "output", "write", "rgba", "f16", ro);
+    dt_connector_copy(graph, module, 2, id_lattice, 0);
+    return;
+  }
+  const dt_roi_t *rl = &module->connector[1].roi;
+  if(!dt_connected(module->connector+1) || rl->full_ht < 2 || rl->full_wd != rl->full_ht * rl->full_ht)
+  {
+    dt_log(s_log_pipe|s_log_err, "[lut3d] lut input needs to be a lattice of n*n x n pixels!");
+    return;
+  }
+  const int pc[] = { rl->full_ht };
+  const int id_main = dt_node_add(graph, module, "lut3d", "main",
+      ro->wd, ro->ht, 1, sizeof(pc), pc, 3,
+      "input",  "read",  "rgba", "f16", -1ul,
+      "lut",    "read",  "rgba", "*",   -1ul,
+      "output", "write", "rgba", "f16", ro);
+  for(int k=0;k<3;k++) dt_connector_copy(graph, module, k, id_main, k);
+}
@@ -0,0 +1,13 @@
+// lattice coordinates of rgb: x/(1+x) to cover the range of scene referred
+// values into [0,1], normalised such that range maps to one.
+vec3 lut3d_encode(vec3 rgb, float range)
+{
+  rgb = max(rgb, vec3(0.0));
+  return clamp(rgb / (1.0 + rgb) * ((1.0 + range) / range), 0.0, 1.0);
+}
+
+vec3 lut3d_decode(vec3 t, float range)
+{
+  vec3 s = t * (range / (1.0 + range));
+  return s / (1.0 - s);
+}
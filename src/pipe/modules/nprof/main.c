@@ -59,6 +59,7 @@ void ui_callback(
     r = snprintf(fhome, sizeof(fhome), "%s/nprof/%s", dt_pipe.homedir, filename);
     if(r >= sizeof(fhome)) return;
     fs_copy(fhome, filename);
+    dt_pipe_noise_profile_reset(); // pick it up in the next graph
     r = snprintf(msg, sizeof(msg), "installing noise profile to %s\n", fhome);
     if(r >= sizeof(msg)) return;
     module->graph->gui_msg = msg;
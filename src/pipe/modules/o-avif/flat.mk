@@ -0,0 +1,3 @@
+MOD_CFLAGS=$(shell pkg-config --cflags libavif)
+MOD_LDFLAGS=$(shell pkg-config --libs libavif) -lm
+pipe/modules/o-avif/libo-avif.so: core/half.h
@@ -0,0 +1,122 @@
+#include "modules/api.h"
+#include "core/fs.h"
+#include "core/core.h"
+#include "core/threads.h"
+#include "core/half.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <avif/avif.h>
+
+// the half float input is linear rec2020. av1 wants integers, so the rows are
+// encoded with the srgb curve to 10 bits on our thread pool and tagged as such
+// (cicp 9/13/9). the av1 encoder runs its own threads, we only tell it how many.
+typedef struct avif_rows_t
+{
+  const uint16_t *rgba;
+  uint16_t       *rgb;
+  uint32_t        rgb_stride;  // in uint16
+  uint32_t        width;
+  uint16_t        lut[1<<15];  // positive half floats to 10 bit srgb
+}
+avif_rows_t;
+
+static inline float
+srgb_encode(float x)
+{
+  return x <= 0.0031308f ? 12.92f * x : 1.055f * powf(x, 1.0f/2.4f) - 0.055f;
+}
+
+static void
+avif_lut(uint32_t begin, uint32_t end, void *data)
+{
+  avif_rows_t *p = data;
+  for(uint32_t h=begin;h<end;h++)
+  {
+    const float x = half_to_float(h);
+    p->lut[h] = isfinite(x) ? (uint16_t)(1023.0f * srgb_encode(CLAMP(x, 0.0f, 1.0f)) + 0.5f) : 1023;
+  }
+}
+
+static void
+avif_rows(uint32_t begin, uint32_t end, void *data)
+{
+  avif_rows_t *p = data;
+  for(uint32_t j=begin;j<end;j++)
+  {
+    const uint16_t *in = p->rgba + 4ul * p->width * j;
+    uint16_t *out = p->rgb + (size_t)p->rgb_stride * j;
+    for(uint32_t i=0;i<p->width;i++) for(int c=0;c<3;c++)
+    { // negative values clamp to zero
+      const uint16_t h = in[4*i+c];
+      out[3*i+c] = h & 0x8000 ? 0 : p->lut[h];
+    }
+  }
+}
+
+// called after pipeline finished up to here.
+// our input buffer will come in memory mapped.
+void write_sink(
+    dt_module_t *module,
+    void *buf)
+{
+  const char *basename = dt_module_param_string(module, 0);
+  const float quality  = dt_module_param_float(module, 1)[0];
+  const int   speed    = dt_module_param_int(module, 2)[0];
+  fprintf(stderr, "[o-avif] writing '%s'\n", basename);
+
+  const int width  = module->connector[0].roi.wd;
+  const int height = module->connector[0].roi.ht;
+
+  char dir[512];
+  snprintf(dir, sizeof(dir), "%s", basename);
+  if(fs_dirname(dir)) fs_mkdir(dir, 0755);
+  char filename[512];
+  snprintf(filename, sizeof(filename), "%s.avif", basename);
+
+  avifRWData out = AVIF_DATA_EMPTY;
+  avifRGBImage rgb;
+  memset(&rgb, 0, sizeof(rgb));
+  avifEncoder *enc = 0;
+  avif_rows_t *p = 0;
+  FILE *f = 0;
+  // full chroma resolution for high quality, as o-jpg does
+  avifImage *img = avifImageCreate(width, height, 10, quality > 90 ? AVIF_PIXEL_FORMAT_YUV444 : AVIF_PIXEL_FORMAT_YUV420);
+  if(!img) goto error;
+  img->colorPrimaries          = AVIF_COLOR_PRIMARIES_BT2020;
+  img->transferCharacteristics = AVIF_TRANSFER_CHARACTERISTICS_SRGB;
+  img->matrixCoefficients      = AVIF_MATRIX_COEFFICIENTS_BT2020_NCL;
+  img->yuvRange                = AVIF_RANGE_FULL;
+
+  avifRGBImageSetDefaults(&rgb, img);
+  rgb.format = AVIF_RGB_FORMAT_RGB;
+  rgb.depth  = 10;
+  if(avifRGBImageAllocatePixels(&rgb) != AVIF_RESULT_OK) goto error;
+  if(!(p = malloc(sizeof(*p)))) goto error;
+  p->rgba       = buf;
+  p->rgb        = (uint16_t *)rgb.pixels;
+  p->rgb_stride = rgb.rowBytes / sizeof(uint16_t);
+  p->width      = width;
+  threads_parallel_for(0, 1<<15, 1024, avif_lut, p);
+  threads_parallel_for(0, height, 16, avif_rows, p);
+  if(avifImageRGBToYUV(img, &rgb) != AVIF_RESULT_OK) goto error;
+
+  if(!(enc = avifEncoderCreate())) goto error;
+  enc->maxThreads = threads_num();
+  enc->quality    = CLAMP((int)quality, AVIF_QUALITY_WORST, AVIF_QUALITY_BEST);
+  enc->speed      = CLAMP(speed, AVIF_SPEED_SLOWEST, AVIF_SPEED_FASTEST);
+  if(avifEncoderWrite(enc, img, &out) != AVIF_RESULT_OK) goto error;
+  if(!(f = fopen(filename, "wb")) || fwrite(out.data, out.size, 1, f) != 1) goto error;
+  goto done;
+error:
+  fprintf(stderr, "[o-avif] failed to write '%s'\n", filename);
+done:
+  if(f) fclose(f);
+  if(enc) avifEncoderDestroy(enc);
+  avifRWDataFree(&out);
+  avifRGBImageFreePixels(&rgb);
+  if(img) avifImageDestroy(img);
+  free(p);
+}
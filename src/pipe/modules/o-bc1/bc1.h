@@ -0,0 +1,33 @@
+#pragma once
+#include <stdint.h>
+
+// layout of the gzipped bc1z files written by o-bc1:
+// header: magic dt_token("bc1z"), version, width, height (four uint32)
+// version 1: the 8-byte blocks of the image, row by row
+// version 2: the same, followed by the mip chain. level l has
+//            dt_bc1_blocks(b, l) blocks in either dimension, down to one
+//            block. readers which only want the image stop after level 0.
+#define DT_BC1_VERSION 2
+
+static inline uint32_t // blocks of mip level l in a dimension with b blocks at level 0
+dt_bc1_blocks(uint32_t b, int l)
+{
+  return (b + (1u<<l) - 1) >> l;
+}
+
+static inline int // number of levels stored in a file
+dt_bc1_levels(uint32_t bx, uint32_t by, uint32_t version)
+{
+  if(version < 2 || !bx || !by) return 1;
+  int l = 1;
+  while(dt_bc1_blocks(bx, l-1) > 1 || dt_bc1_blocks(by, l-1) > 1) l++;
+  return l;
+}
+
+static inline uint64_t // bytes of the first levels
+dt_bc1_size(uint32_t bx, uint32_t by, int levels)
+{
+  uint64_t size = 0;
+  for(int l=0;l<levels;l++) size += 8ul * dt_bc1_blocks(bx, l) * dt_bc1_blocks(by, l);
+  return size;
+}
@@ -1,3 +1,5 @@
 MOD_LDFLAGS=-lz
-# actually unused currently:
-#MOD_CFLAGS=-fopenmp
+MOD_C=pipe/connector.c
+pipe/modules/o-bc1/encode.comp.spv: pipe/modules/shared.glsl
+SPV_PENDING+=pipe/modules/o-bc1/encode.comp.spv
+pipe/modules/o-bc1/libo-bc1.so:pipe/modules/o-bc1/bc1.h pipe/modules/o-bc1/stb_dxt.h
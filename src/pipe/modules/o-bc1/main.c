@@ -1,5 +1,7 @@
 #include "modules/api.h"
 #include "core/core.h"
+#include "core/threads.h"
+#include "bc1.h"
 #define STB_DXT_IMPLEMENTATION
 #include "stb_dxt.h"
 
@@ -9,51 +11,189 @@
 #include <string.h>
 #include <zlib.h>
 
-// called after pipeline finished up to here.
-// our input buffer will come in memory mapped.
+typedef struct bc1_job_t
+{
+  const uint8_t *in;
+  uint8_t       *out;
+  uint32_t       wd, ht; // input image
+  uint32_t       bx;     // blocks in a row of this level
+  int            l;      // mip level
+}
+bc1_job_t;
+
+static void // compress rows of blocks [beg, end) of one level
+compress_rows(uint32_t beg, uint32_t end, void *data)
+{
+  const bc1_job_t *job = data;
+  const int n = 1<<job->l, s = MIN(n, 4), stride = n / s; // same footprint as encode.comp
+  for(uint32_t j=beg;j<end;j++)
+  {
+    for(uint32_t i=0;i<job->bx;i++)
+    { // swizzle block data together, averaging the footprint on the mip levels:
+      uint8_t block[64];
+      for(int jj=0;jj<4;jj++) for(int ii=0;ii<4;ii++)
+      {
+        const uint32_t ox = (4*i+ii)*n + stride/2, oy = (4*j+jj)*n + stride/2;
+        uint32_t c[4] = {0};
+        for(int b=0;b<s;b++) for(int a=0;a<s;a++)
+        {
+          const uint32_t x = MIN(ox + stride*a, job->wd-1), y = MIN(oy + stride*b, job->ht-1);
+          for(int k=0;k<4;k++) c[k] += job->in[4*(job->wd*(size_t)y+x)+k];
+        }
+        for(int k=0;k<4;k++) block[4*(4*jj+ii)+k] = (c[k] + s*s/2) / (s*s);
+      }
+      stb_compress_dxt_block(
+          job->out + 8*(job->bx*(size_t)j+i), block, 0,
+          0); // or slower: STB_DXT_HIGHQUAL
+    }
+  }
+}
+
+static int
+use_gpu(dt_module_t *module)
+{ // the encode kernel is not built by default yet, see flat.mk
+  return dt_module_param_int(module, 1)[0] &&
+    dt_pipe_shader_exists(dt_token("o-bc1"), dt_token("encode"));
+}
+
+dt_graph_run_t
+check_params(
+    dt_module_t *module,
+    uint32_t     parid,
+    void        *oldval)
+{
+  if(parid == 1)
+  { // gpu: the nodes are different
+    int oldgpu = *(int*)oldval;
+    int newgpu = dt_module_param_int(module, parid)[0];
+    if(oldgpu != newgpu) return s_graph_run_all;
+  }
+  return s_graph_run_record_cmd_buf;
+}
+
+void
+create_nodes(
+    dt_graph_t  *graph,
+    dt_module_t *module)
+{
+  if(!use_gpu(module))
+  { // download the 8-bit image and compress with stb_dxt in write_sink
+    const int id_sink = dt_node_add(graph, module, "o-bc1", "main", 0, 0, 1, 0, 0, 1,
+        "input", "sink", "rgba", "ui8", -1ul);
+    dt_connector_copy(graph, module, 0, id_sink, 0);
+    return;
+  }
+  // compress on the gpu, one thread per block, so the sink only downloads the blocks.
+  // the mip levels go below the image, so the output is a few rows taller:
+  const uint32_t bx = module->connector[0].roi.wd/4, by = module->connector[0].roi.ht/4;
+  const int levels = dt_bc1_levels(bx, by, DT_BC1_VERSION);
+  uint32_t rows = 0;
+  for(int l=0;l<levels;l++) rows += dt_bc1_blocks(by, l);
+  const dt_roi_t roi_bc1 = {
+    .full_wd = bx, .full_ht = rows,
+    .wd      = bx, .ht      = rows,
+    .scale   = 1.0f };
+  assert(graph->num_nodes < graph->max_nodes);
+  const int id_enc = graph->num_nodes++;
+  graph->node[id_enc] = (dt_node_t) {
+    .name   = dt_token("o-bc1"),
+    .kernel = dt_token("encode"),
+    .module = module,
+    .wd     = roi_bc1.wd,
+    .ht     = roi_bc1.ht,
+    .dp     = 1,
+    .num_connectors = 2,
+    .connector = {{
+      .name   = dt_token("input"),
+      .type   = dt_token("read"),
+      .chan   = dt_token("rgba"),
+      .format = dt_token("ui8"),
+      .roi    = module->connector[0].roi,
+      .connected_mi = -1,
+    },{
+      .name   = dt_token("output"),
+      .type   = dt_token("write"),
+      .chan   = dt_token("rg"),
+      .format = dt_token("ui32"),
+      .roi    = roi_bc1,
+    }},
+  };
+  assert(graph->num_nodes < graph->max_nodes);
+  const int id_sink = graph->num_nodes++;
+  graph->node[id_sink] = (dt_node_t) {
+    .name   = dt_token("o-bc1"),
+    .kernel = dt_token("sink"),
+    .module = module,
+    .wd     = roi_bc1.wd,
+    .ht     = roi_bc1.ht,
+    .dp     = 1,
+    .num_connectors = 1,
+    .connector = {{
+      .name   = dt_token("input"),
+      .type   = dt_token("sink"),
+      .chan   = dt_token("rg"),
+      .format = dt_token("ui32"),
+      .roi    = roi_bc1,
+      .connected_mi = -1,
+    }},
+  };
+  dt_connector_copy(graph, module, 0, id_enc, 0);
+  dt_node_connect  (graph, id_enc, 1, id_sink, 0);
+}
+
+// called after pipeline finished up to here. our input buffer will come in
+// memory mapped, either the 8-bit image or already compressed to 8 bytes per
+// block by the encode kernel.
 void write_sink(
     dt_module_t *module,
     void *buf)
 {
   const char *filename = dt_module_param_string(module, 0);
+  const int   p_gpu    = use_gpu(module);
   // fprintf(stderr, "[o-bc1] writing '%s'\n", filename);
 
   const uint32_t wd = module->connector[0].roi.wd;
   const uint32_t ht = module->connector[0].roi.ht;
-  const uint8_t *in = (const uint8_t *)buf;
-
-  // go through all 4x4 blocks
-  // parallelise via our thread pool or openmp or what?
-  // probably usually bc1 thumbnails are too small to warrant a good speedup.
-  const int bx = wd/4, by = ht/4;
-  size_t num_blocks = bx * (uint64_t)by;
-  uint8_t *out = (uint8_t *)malloc(sizeof(uint8_t)*8*num_blocks);
-// #pragma omp parallel for collapse(2) schedule(static)
-  for(int j=0;j<4*by;j+=4)
-  {
-    for(int i=0;i<4*bx;i+=4)
-    { // swizzle block data together:
-      uint8_t block[64];
-      for(int jj=0;jj<4;jj++)
-        for(int ii=0;ii<4;ii++)
-          for(int c=0;c<4;c++)
-            block[4*(4*jj+ii)+c] = in[4*(wd*(j+jj)+(i+ii))+c];
-
-      stb_compress_dxt_block(
-          out + 8*(bx*(j/4)+(i/4)), block, 0,
-          0); // or slower: STB_DXT_HIGHQUAL
-    }
-  }
+  const uint32_t bx = wd/4, by = ht/4;
+  const int levels = dt_bc1_levels(bx, by, DT_BC1_VERSION);
 
   char tmpfile[1024];
   snprintf(tmpfile, sizeof(tmpfile), "%s.temp", filename);
   gzFile f = gzopen(tmpfile, "wb");
   // write magic, version, width, height
-  uint32_t header[4] = { dt_token("bc1z"), 1, bx*4, by*4 };
+  uint32_t header[4] = { dt_token("bc1z"), DT_BC1_VERSION, bx*4, by*4 };
   gzwrite(f, header, sizeof(uint32_t)*4);
-  gzwrite(f, out, sizeof(uint8_t)*8*num_blocks);
+  if(p_gpu)
+  {
+    const uint8_t *out = (const uint8_t *)buf;
+    gzwrite(f, out, sizeof(uint8_t)*8*bx*by);
+    out += 8ul*bx*by;
+    for(int l=1;l<levels;l++)
+    { // rows of the mip level are as wide as level 0 in the buffer
+      const uint32_t lx = dt_bc1_blocks(bx, l), ly = dt_bc1_blocks(by, l);
+      for(uint32_t j=0;j<ly;j++,out+=8ul*bx)
+        gzwrite(f, out, sizeof(uint8_t)*8*lx);
+    }
+  }
+  else
+  { // go through all 4x4 blocks of all levels. thumbnails are usually rendered
+    // by a few threads at a time already, so this only gets help from idle workers.
+    const uint64_t size = dt_bc1_size(bx, by, levels);
+    uint8_t *out = (uint8_t *)malloc(size);
+    bc1_job_t job = { .in = (const uint8_t *)buf, .out = out, .wd = wd, .ht = ht };
+    for(int l=0;l<levels;l++)
+    {
+      const uint32_t ly = dt_bc1_blocks(by, l);
+      job.l  = l;
+      job.bx = dt_bc1_blocks(bx, l);
+      if(!l && ly > 0) compress_rows(0, 1, &job); // stb_dxt initialises its tables lazily on the first block
+      threads_parallel_for(l ? 0 : 1, ly, 16, compress_rows, &job);
+      job.out += 8ul * job.bx * ly;
+    }
+    gzwrite(f, out, size);
+    free(out);
+  }
   gzclose(f);
-  free(out);
   // atomically create filename only when we're quite done writing:
   unlink(filename); // just to be sure the link will work
   link(tmpfile, filename);
@@ -0,0 +1,2 @@
+MOD_LDFLAGS=-lz
+pipe/modules/o-exr/libo-exr.so: pipe/modules/i-exr/tinyexr.h core/half.h
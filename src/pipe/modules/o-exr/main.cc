@@ -0,0 +1,114 @@
+#include "modules/api.h"
+
+#include <zlib.h>
+extern "C" {
+#include "core/threads.h"
+}
+// compress the scanline blocks on our thread pool
+template<typename F> static void
+exr_worker(uint32_t begin, uint32_t end, void *data)
+{
+  for(uint32_t i=begin;i<end;i++) (*(F*)data)();
+}
+#define TINYEXR_NUM_THREADS() threads_num()
+#define TINYEXR_RUN_WORKERS(num_threads, worker) \
+  threads_parallel_for(0, (num_threads), 1, exr_worker<decltype(worker)>, &(worker))
+#define TINYEXR_USE_THREAD (1)
+#define TINYEXR_USE_OPENMP (0)
+#define TINYEXR_USE_MINIZ (0)
+#define TINYEXR_IMPLEMENTATION
+#include "../i-exr/tinyexr.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+extern "C" {
+
+typedef struct planes_t
+{
+  const uint16_t *rgba;
+  uint16_t       *plane[3]; // b, g, r as sorted in the file
+  size_t          cnt;
+}
+planes_t;
+
+static void
+deinterleave(uint32_t begin, uint32_t end, void *data)
+{
+  planes_t *p = (planes_t *)data;
+  const size_t b = begin * (size_t)4096, e = std::min(p->cnt, end * (size_t)4096);
+  for(size_t k=b;k<e;k++)
+  {
+    p->plane[0][k] = p->rgba[4*k+2];
+    p->plane[1][k] = p->rgba[4*k+1];
+    p->plane[2][k] = p->rgba[4*k+0];
+  }
+}
+
+// called after pipeline finished up to here.
+// our input buffer will come in memory mapped.
+void write_sink(
+    dt_module_t *module,
+    void *buf)
+{
+  const char *basename = dt_module_param_string(module, 0);
+  const int compression = dt_module_param_int(module, 1)[0];
+  fprintf(stderr, "[o-exr] writing '%s'\n", basename);
+
+  const int width  = module->connector[0].roi.wd;
+  const int height = module->connector[0].roi.ht;
+  const size_t cnt = width * (size_t)height;
+
+  planes_t p = { (const uint16_t *)buf, {0}, cnt };
+  uint16_t *mem = (uint16_t *)malloc(sizeof(uint16_t) * 3 * cnt);
+  if(!mem) return;
+  for(int c=0;c<3;c++) p.plane[c] = mem + c * cnt;
+  threads_parallel_for(0, (cnt + 4095) / 4096, 16, deinterleave, &p);
+
+  EXRHeader header;
+  InitEXRHeader(&header);
+  EXRImage image;
+  InitEXRImage(&image);
+  image.num_channels = 3;
+  image.images       = (unsigned char **)p.plane;
+  image.width        = width;
+  image.height       = height;
+
+  EXRChannelInfo channels[3];
+  int pixel_types[3] = { TINYEXR_PIXELTYPE_HALF, TINYEXR_PIXELTYPE_HALF, TINYEXR_PIXELTYPE_HALF };
+  memset(channels, 0, sizeof(channels));
+  strcpy(channels[0].name, "B");
+  strcpy(channels[1].name, "G");
+  strcpy(channels[2].name, "R");
+  header.num_channels          = 3;
+  header.channels              = channels;
+  header.pixel_types           = pixel_types;
+  header.requested_pixel_types = pixel_types;
+  header.compression_type      =
+    compression == 1 ? TINYEXR_COMPRESSIONTYPE_PIZ :
+    compression == 2 ? TINYEXR_COMPRESSIONTYPE_NONE :
+                       TINYEXR_COMPRESSIONTYPE_ZIP;
+
+  // linear rec2020: red, green, blue and white (d65) xy
+  float chromaticities[8] = { 0.708f, 0.292f, 0.170f, 0.797f, 0.131f, 0.046f, 0.3127f, 0.3290f };
+  EXRAttribute attr;
+  memset(&attr, 0, sizeof(attr));
+  strcpy(attr.name, "chromaticities");
+  strcpy(attr.type, "chromaticities");
+  attr.value = (unsigned char *)chromaticities;
+  attr.size  = sizeof(chromaticities);
+  header.num_custom_attributes = 1;
+  header.custom_attributes     = &attr;
+
+  char filename[512];
+  snprintf(filename, sizeof(filename), "%s.exr", basename);
+  const char *err = 0;
+  if(SaveEXRImageToFile(&image, &header, filename, &err) != TINYEXR_SUCCESS)
+  {
+    fprintf(stderr, "[o-exr] error writing %s: %s\n", filename, err);
+    FreeEXRErrorMessage(err);
+  }
+  free(mem);
+}
+
+} // extern "C"
@@ -1 +1,5 @@
-# nothing specific needed
+MOD_C=pipe/connector.c
+ifeq ($(VKDT_USE_FFMPEG),1)
+MOD_CFLAGS=-DVKDT_USE_FFMPEG $(shell pkg-config --cflags libavformat --cflags libavcodec --cflags libavutil)
+MOD_LDFLAGS=$(shell pkg-config --libs libavformat --libs libavcodec --libs libavutil)
+endif
@@ -4,13 +4,248 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef VKDT_USE_FFMPEG
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/opt.h>
+#endif
 
 typedef struct buf_t
 {
+#ifdef VKDT_USE_FFMPEG
+  AVFormatContext *fmtc;
+  AVCodecContext  *ctx;
+  AVStream        *st;
+  AVFrame         *frame;
+  AVPacket        *pkt;
+#else
   FILE *f;
+#endif
 }
 buf_t;
 
+// the shared yuv kernel converts to the output colour space and chroma
+// subsampling on the gpu, so we only download the planes that go into the encoder:
+static inline dt_api_yuv_t
+get_yuv(dt_module_t *mod)
+{
+  const int p_codec  = dt_module_param_int(mod, 2)[0];
+  const int p_colour = dt_module_param_int(mod, 4)[0];
+  if(p_codec == 0) // prores: 10 bit rec2020 hlg, 422 or 444
+    return (dt_api_yuv_t) { .primaries = 1, .trc = 2, .bits = 10, .chroma = p_colour ? 2 : 1 };
+  // h264: 8 bit rec709, 420. nvenc takes nv12 natively
+  return (dt_api_yuv_t) { .primaries = 0, .trc = 0, .bits = 8, .chroma = 0, .nv = p_codec == 2 };
+}
+
+// point to the planes in the downloaded buffer, all with the same pitch.
+// h264 requires width and height to be divisible by 2.
+static inline size_t
+get_planes(
+    dt_module_t *mod,
+    uint8_t     *buf,
+    uint8_t     *data[3],
+    int          dim[6])
+{
+  const dt_api_yuv_t yuv = get_yuv(mod);
+  size_t offset[3];
+  const size_t pitch = dt_api_yuv_planes(&yuv,
+      mod->connector[0].roi.wd & ~1, mod->connector[0].roi.ht & ~1, offset, dim);
+  for(int k=0;k<3;k++) data[k] = dim[2*k] ? buf + offset[k] : 0;
+  return pitch;
+}
+
+#ifdef VKDT_USE_FFMPEG
+// pass encoded packets on to the muxer
+static inline int
+write_packets(buf_t *dat)
+{
+  int ret;
+  while((ret = avcodec_receive_packet(dat->ctx, dat->pkt)) >= 0)
+  {
+    av_packet_rescale_ts(dat->pkt, dat->ctx->time_base, dat->st->time_base);
+    dat->pkt->stream_index = dat->st->index;
+    if((ret = av_interleaved_write_frame(dat->fmtc, dat->pkt)) < 0) return ret;
+  }
+  return (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) ? 0 : ret;
+}
+
+static inline void
+close_stream(buf_t *dat)
+{
+  if(dat->frame)
+  { // header has been written, flush the encoder and finish the file
+    avcodec_send_frame(dat->ctx, 0);
+    write_packets(dat);
+    av_write_trailer(dat->fmtc);
+  }
+  if(dat->fmtc && !(dat->fmtc->oformat->flags & AVFMT_NOFILE)) avio_closep(&dat->fmtc->pb);
+  avformat_free_context(dat->fmtc);
+  avcodec_free_context(&dat->ctx);
+  av_frame_free(&dat->frame);
+  av_packet_free(&dat->pkt);
+  memset(dat, 0, sizeof(*dat));
+}
+
+static inline int
+open_stream(
+    dt_module_t *mod,
+    buf_t       *dat)
+{
+  const char *basename  = dt_module_param_string(mod, 0);
+  const float p_quality = dt_module_param_float(mod, 1)[0];
+  const int   p_codec   = dt_module_param_int  (mod, 2)[0];
+  const int   p_profile = dt_module_param_int  (mod, 3)[0];
+  const dt_api_yuv_t yuv = get_yuv(mod);
+
+  const int width  = mod->connector[0].roi.wd & ~1;
+  const int height = mod->connector[0].roi.ht & ~1;
+  const float rate = mod->graph->frame_rate > 0.0f ? mod->graph->frame_rate : 24;
+  if(width <= 0 || height <= 0) return 1;
+
+  char filename[512];
+  snprintf(filename, sizeof(filename), "%s.%s", basename, p_codec == 0 ? "mov" : "mp4");
+
+  const AVCodec *codec = 0;
+  if(p_codec == 2 && !(codec = avcodec_find_encoder_by_name("h264_nvenc")))
+    fprintf(stderr, "[o-ffmpeg] no h264_nvenc encoder, falling back to libx264\n");
+  if(!codec) codec = avcodec_find_encoder_by_name(p_codec == 0 ? "prores_ks" : "libx264");
+  if(!codec) codec = avcodec_find_encoder(p_codec == 0 ? AV_CODEC_ID_PRORES : AV_CODEC_ID_H264);
+  if(!codec)
+  {
+    fprintf(stderr, "[o-ffmpeg] could not find encoder!\n");
+    return 1;
+  }
+
+  int ret = 0;
+  if((ret = avformat_alloc_output_context2(&dat->fmtc, 0, 0, filename)) < 0) goto error;
+  if(!(dat->ctx = avcodec_alloc_context3(codec))) goto error;
+  AVCodecContext *ctx = dat->ctx;
+  const AVRational fr = av_d2q(rate, 100000);
+  ctx->width        = width;
+  ctx->height       = height;
+  ctx->framerate    = fr;
+  ctx->time_base    = av_inv_q(fr);
+  ctx->thread_count = 0;
+  ctx->color_range  = AVCOL_RANGE_MPEG;
+  if(yuv.primaries == 0)
+  {
+    ctx->pix_fmt         = yuv.nv ? AV_PIX_FMT_NV12 : AV_PIX_FMT_YUV420P;
+    ctx->color_primaries = AVCOL_PRI_BT709;
+    ctx->color_trc       = AVCOL_TRC_BT709;
+    ctx->colorspace      = AVCOL_SPC_BT709;
+    const int q = CLAMP(51-p_quality*51.0/100.0, 0, 51);
+    if(!strcmp(codec->name, "h264_nvenc"))
+    {
+      av_opt_set    (ctx->priv_data, "preset", "p1",  0);
+      av_opt_set    (ctx->priv_data, "rc",     "vbr", 0);
+      av_opt_set_int(ctx->priv_data, "cq",     q,     0);
+    }
+    else
+    {
+      av_opt_set    (ctx->priv_data, "preset", "ultrafast", 0);
+      av_opt_set_int(ctx->priv_data, "crf",    q,           0);
+    }
+  }
+  else
+  {
+    ctx->pix_fmt         = yuv.chroma == 2 ? AV_PIX_FMT_YUV444P10LE : AV_PIX_FMT_YUV422P10LE;
+    ctx->color_primaries = AVCOL_PRI_BT2020;
+    ctx->color_trc       = AVCOL_TRC_ARIB_STD_B67;
+    ctx->colorspace      = AVCOL_SPC_BT2020_NCL;
+    ctx->profile         = yuv.chroma == 2 ? 4 : CLAMP(p_profile, 0, 3); // proxy lt sq hq 4444
+    ctx->flags          |= AV_CODEC_FLAG_QSCALE; // 2--31, lower qs -> higher bitrate
+    ctx->global_quality  = FF_QP2LAMBDA * (int)CLAMP(31-p_quality*30/100.0, 1, 31);
+    av_opt_set(ctx->priv_data, "vendor", "apl0", 0);
+  }
+  if(dat->fmtc->oformat->flags & AVFMT_GLOBALHEADER) ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+  if((ret = avcodec_open2(ctx, codec, 0)) < 0) goto error;
+
+  if(!(dat->st = avformat_new_stream(dat->fmtc, 0))) goto error;
+  dat->st->time_base = ctx->time_base;
+  if((ret = avcodec_parameters_from_context(dat->st->codecpar, ctx)) < 0) goto error;
+  if(!(dat->fmtc->oformat->flags & AVFMT_NOFILE) &&
+     (ret = avio_open(&dat->fmtc->pb, filename, AVIO_FLAG_WRITE)) < 0) goto error;
+  if((ret = avformat_write_header(dat->fmtc, 0)) < 0) goto error;
+
+  dat->frame = av_frame_alloc();
+  dat->pkt   = av_packet_alloc();
+  dat->frame->format = ctx->pix_fmt;
+  dat->frame->width  = width;
+  dat->frame->height = height;
+  dat->frame->pts    = 0;
+  fprintf(stderr, "[o-ffmpeg] writing %s with %s %dx%d\n", filename, codec->name, width, height);
+  return 0;
+error:
+  fprintf(stderr, "[o-ffmpeg] error opening %s (%s)\n", filename, av_err2str(ret));
+  close_stream(dat);
+  return 1;
+}
+#else
+static inline void
+close_stream(buf_t *dat)
+{
+  if(dat->f) pclose(dat->f);
+  dat->f = 0;
+}
+
+static inline int
+open_stream(
+    dt_module_t *mod,
+    buf_t       *dat)
+{
+  const char *basename  = dt_module_param_string(mod, 0);
+  const float p_quality = dt_module_param_float(mod, 1)[0];
+  const int   p_codec   = dt_module_param_int  (mod, 2)[0];
+  const int   p_profile = dt_module_param_int  (mod, 3)[0];
+  const dt_api_yuv_t yuv = get_yuv(mod);
+
+  const int width  = mod->connector[0].roi.wd & ~1;
+  const int height = mod->connector[0].roi.ht & ~1;
+  const float rate = mod->graph->frame_rate > 0.0f ? mod->graph->frame_rate : 24;
+  if(width <= 0 || height <= 0) return 1;
+
+  // establish pipe to ffmpeg binary, the planes come in converted already
+  char cmdline[1024], filename[512];
+  if(p_codec == 0)
+  { // apple prores encoding, 10 bit output
+    const char *pix_fmt = yuv.chroma == 2 ? "yuv444p10le" : "yuv422p10le";
+    snprintf(filename, sizeof(filename), "%s.mov", basename);
+    snprintf(cmdline, sizeof(cmdline),
+        "ffmpeg -y -probesize 5000000 -f rawvideo "
+        "-colorspace bt2020nc -color_trc arib-std-b67 -color_primaries bt2020 -color_range tv "
+        "-pix_fmt %s -s %dx%d -r %g -i - "
+        "-threads 0 " // after input, so it'll affect the ouput encoding
+        "-c:v prores_ks -profile:v %d " // 0 1 2 3 for Proxy LT SQ HQ, 4 for 4444
+        "-qscale:v %d " // is this our quality parameter: 2--31, lower qs -> higher bitrate
+        "-vendor apl0 -pix_fmt %s "
+        "\"%s\"",
+        pix_fmt, width, height, rate,
+        yuv.chroma == 2 ? 4 : CLAMP(p_profile, 0, 3),
+        (int)CLAMP(31-p_quality*30/100.0, 1, 31),
+        pix_fmt, filename);
+  }
+  else
+  { // h264, 8-bit
+    const int q = CLAMP(51-p_quality*51.0/100.0, 0, 51);
+    char encoder[64];
+    if(yuv.nv) snprintf(encoder, sizeof(encoder), "h264_nvenc -preset p1 -rc vbr -cq %d", q);
+    else       snprintf(encoder, sizeof(encoder), "libx264 -preset ultrafast -crf %d", q);
+    snprintf(filename, sizeof(filename), "%s.mp4", basename);
+    snprintf(cmdline, sizeof(cmdline),
+        "ffmpeg -threads 0 -y -f rawvideo "
+        "-colorspace bt709 -color_trc bt709 -color_primaries bt709 -color_range tv "
+        "-pix_fmt %s -s %dx%d -r %g -i - "
+        "-c:v %s "
+        "-pix_fmt yuv420p "
+        "\"%s\"",
+        yuv.nv ? "nv12" : "yuv420p", width, height, rate, encoder, filename);
+  }
+  fprintf(stderr, "[o-ffmpeg] running `%s'\n", cmdline);
+  dat->f = popen(cmdline, "w");
+  return !dat->f;
+}
+#endif
+
 int init(dt_module_t *mod)
 {
   buf_t *dat = malloc(sizeof(*dat));
@@ -24,11 +259,7 @@ void cleanup(dt_module_t *mod)
 {
   if(!mod->data) return;
   buf_t *dat= mod->data;
-  if(dat->f)
-  {
-    pclose(dat->f);
-    dat->f = 0;
-  }
+  close_stream(dat);
   free(dat);
   mod->data = 0;
 }
@@ -38,9 +269,37 @@ void modify_roi_out(
     dt_module_t *mod)
 {
   if(graph->frame_cnt <= 1) return;
-  buf_t *buf = mod->data;
-  if(buf->f) pclose(buf->f);
-  buf->f = 0; // de-init
+  close_stream(mod->data); // de-init
+}
+
+void
+create_nodes(
+    dt_graph_t  *graph,
+    dt_module_t *module)
+{ // convert to yuv planes on the gpu, so the sink only downloads what goes to the encoder
+  const dt_api_yuv_t yuv = get_yuv(module);
+  const int id_yuv = dt_api_yuv(graph, module, -1, 0, &yuv);
+  const dt_connector_t *c = graph->node[id_yuv].connector + 1;
+  assert(graph->num_nodes < graph->max_nodes);
+  const int id_sink = graph->num_nodes++;
+  graph->node[id_sink] = (dt_node_t) {
+    .name   = dt_token("o-ffmpeg"),
+    .kernel = dt_token("sink"),
+    .module = module,
+    .wd     = c->roi.wd,
+    .ht     = c->roi.ht,
+    .dp     = 1,
+    .num_connectors = 1,
+    .connector = {{
+      .name   = dt_token("input"),
+      .type   = dt_token("sink"),
+      .chan   = c->chan,
+      .format = c->format,
+      .roi    = c->roi,
+      .connected_mi = -1,
+    }},
+  };
+  dt_node_connect(graph, id_yuv, 1, id_sink, 0);
 }
 
 void write_sink(
@@ -48,114 +307,33 @@ void write_sink(
     void        *buf)
 {
   buf_t *dat = mod->data;
-  if(!dat->f)
-  { // init if not done before
-    const char *basename  = dt_module_param_string(mod, 0);
-    const float p_quality = dt_module_param_float(mod, 1)[0];
-    const int   p_codec   = dt_module_param_int  (mod, 2)[0];
-    const int   p_profile = dt_module_param_int  (mod, 3)[0];
-    const int   p_colour  = dt_module_param_int  (mod, 4)[0];
-
-    const int width  = mod->connector[0].roi.wd & ~1;
-    const int height = mod->connector[0].roi.ht & ~1;
-    const float rate = mod->graph->frame_rate > 0.0f ? mod->graph->frame_rate : 24;
-    if(width <= 0 || height <= 0) return;
-
-    // establish pipe to ffmpeg binary
-    char cmdline[1024], filename[512];
-#if 1
-    if(p_codec == 0)
-    { // apple prores encoding, 10 bit output
-      snprintf(filename, sizeof(filename), "%s.mov", basename);
-      snprintf(cmdline, sizeof(cmdline),
-        "ffmpeg -y -probesize 5000000 -f rawvideo "
-        "-threads 0 "
-        "-colorspace bt2020nc -color_trc linear -color_primaries bt2020 -color_range pc "
-        "-pix_fmt rgbaf16le -s %dx%d -r %g -i - "
-//        "-vf 'colorspace=all=bt2020:trc=bt2020-10:iall=bt2020:itrc=linear' "
-//        "-vf 'zscale=rangein=full:range=limited:primaries=2020:matrix=2020_ncl:primariesin=2020:transferin=linear:transfer=smpte2084' "
-        "-vf 'zscale=rangein=full:range=limited:primaries=2020:matrix=2020_ncl:primariesin=2020:transferin=linear:transfer=arib-std-b67' "
-        "-threads 0 " // after input, so it'll affect the ouput encoding
-        "-color_trc smpte2084 "
-//        "-color_trc arib-std-b67 "
-        "-c:v prores -profile:v %d " // 0 1 2 3 for Proxy LT SQ HQ // prores_ks has slice level threading
-        "-qscale:v %d " // is this our quality parameter: 2--31, lower qs -> higher bitrate
-        "-vendor apl0 -pix_fmt %s " // yuv422p10le or yuva444p10le for 4444
-        "\"%s\"",
-        width, height, rate,
-        CLAMP(p_profile, 0, 3),
-        (int)CLAMP(31-p_quality*30/100.0, 1, 31),
-        p_colour == 0 ? "yuv422p10le" : "yuva444p10le",
-        filename);
-    }
+#ifdef VKDT_USE_FFMPEG
+  if(!dat->ctx && open_stream(mod, dat)) return;
+  uint8_t *data[3];
+  int dim[6];
+  const size_t pitch = get_planes(mod, buf, data, dim);
+  for(int k=0;k<3;k++)
+  { // the encoder copies non-refcounted frames when it needs to keep them
+    dat->frame->data[k]     = data[k];
+    dat->frame->linesize[k] = data[k] ? pitch : 0;
+  }
+  int ret = avcodec_send_frame(dat->ctx, dat->frame);
+  dat->frame->pts++;
+  if(ret >= 0) ret = write_packets(dat);
+  if(ret < 0) fprintf(stderr, "[o-ffmpeg] error encoding frame (%s)\n", av_err2str(ret));
 #else
-    if(p_codec == 0)
-    {
-      // https://stackoverflow.com/questions/69251960/how-can-i-encode-rgb-images-into-hdr10-videos-in-ffmpeg-command-line
-      snprintf(filename, sizeof(filename), "%s.mov", basename);
-      snprintf(cmdline, sizeof(cmdline),
-        "ffmpeg -threads 0 -y -probesize 5000000 -f rawvideo "
-        "-hide_banner "
-        "-loglevel verbose "
-        "-sws_flags print_info+accurate_rnd+bitexact+full_chroma_int "
-        "-color_range pc "
-        "-color_trc linear "
-        "-color_primaries bt2020 "
-        "-colorspace bt2020nc "
-        "-pix_fmt rgba64le -s %dx%d -r %g -i - "
-        // "-vf zscale=rangein=full:range=limited " // XXX this needs explicit conversion to yuv422p10le i think
-        "-vf format=yuv422p10le,zscale=rangein=full:range=limited:transferin=linear:transfer=smpte2084 " // XXX this needs explicit conversion to yuv422p10le i think
-        "-c:v libx265 "
-        "-color_range tv "
-        "-color_trc smpte2084 "
-        "-color_primaries bt2020 "
-        "-colorspace bt2020nc "
-        "-pix_fmt %s "
-        "-sws_flags print_info+accurate_rnd+bitexact+full_chroma_int "
-        "-x265-params \"hdr-opt=1:colorprim=bt2020:transfer=smpte2084:colormatrix=bt2020nc:range=limited:master-display=G(13250,34500)B(7500,3000)R(34000,16000)WP(15635,16450)L(10000000,1):max-cll=1000,400\" "
-        "\"%s\"",
-        width, height, rate,
-        // CLAMP(p_profile, 0, 3),
-        // (int)CLAMP(31-p_quality*30/100.0, 1, 31),
-        p_colour == 0 ? "yuv422p10le" : "yuva444p10le",
-        filename);
-    }
-#endif
-    // TODO: try something like this too
-    // -c:v libx265 -x265-params hdr-opt=1:repeat-headers=1:colorprim=bt2020:transfer=smpte2084:colormatrix=bt2020nc:master
-    else
-    { // h264, 8-bit
-      snprintf(filename, sizeof(filename), "%s.mp4", basename);
-      snprintf(cmdline, sizeof(cmdline),
-          "ffmpeg -threads 0 -y -f rawvideo "
-          "-colorspace bt2020nc -color_trc linear -color_primaries bt2020 -color_range pc "
-          "-pix_fmt rgbaf16le -s %dx%d -r %g -i - "
-          "-vf 'colorspace=all=bt709:trc=bt709:iall=bt2020:itrc=linear' "
-          "-c:v libx264 -preset ultrafast "
-//          "-c:v h264_nvenc -preset llhp " // -preset llhp/fast
-//          "-c:v rawvideo -pix_fmt rgb24 -f mpegts "
-          "-pix_fmt yuv420p " // -level:v 3 " // -b:v 2500 " -profile:v baseline
-//          "-qp 0 "
-          "-crf %d "
-          // "-v error "
-          "\"%s\"",
-          width, height, rate, (int)CLAMP(51-p_quality*51.0/100.0, 0, 51), filename);
-    }
-    fprintf(stderr, "[o-ffmpeg] running `%s'\n", cmdline);
-
-    if(dat->f) pclose(dat->f);
-    dat->f = popen(cmdline, "w");
+  if(!dat->f && open_stream(mod, dat)) return;
+  uint8_t *data[3];
+  int dim[6];
+  const size_t pitch = get_planes(mod, buf, data, dim);
+  const size_t bps = get_yuv(mod).bits > 8 ? 2 : 1;
+  for(int k=0;k<3;k++)
+  {
+    if(!data[k]) continue;
+    if(bps * dim[2*k] == pitch)
+      fwrite(data[k], pitch, dim[2*k+1], dat->f);
+    else for(int j=0;j<dim[2*k+1];j++)
+      fwrite(data[k] + j*pitch, bps, dim[2*k], dat->f);
   }
-  if(!dat->f) return;
-  // uint32_t *p32 = buf; // our input buf is rgba ui8
-  uint16_t *p16 = buf; // our input buf is rgba f16
-
-  // h264 requires width and height to be divisible by 2:
-  const int width  = mod->connector[0].roi.wd & ~1;
-  const int height = mod->connector[0].roi.ht & ~1;
-  const int stride = 4*mod->connector[0].roi.wd;
-
-  for(int j=0;j<height;j++)
-    // fwrite(p32 + j*stride, sizeof(uint32_t), width, dat->f);
-    fwrite(p16 + j*stride, sizeof(uint16_t)*4, width, dat->f);
+#endif
 }
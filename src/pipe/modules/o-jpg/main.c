@@ -1,5 +1,7 @@
 #include "modules/api.h"
 #include "core/fs.h"
+#include "core/core.h"
+#include "core/threads.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -25,47 +27,55 @@ error_exit(j_common_ptr cinfo)
   longjmp(myerr->setjmp_buffer, 1);
 }
 
-// called after pipeline finished up to here.
-// our input buffer will come in memory mapped.
-void write_sink(
-    dt_module_t *module,
-    void *buf)
+// one horizontal strip of the image, encoded to memory. when the image is split
+// into several strips, they all use the same standard huffman tables and one
+// restart interval per strip, so they can be stitched into one jfif stream.
+typedef struct jpg_strip_t
 {
-  const char *basename = dt_module_param_string(module, 0);
-  fprintf(stderr, "[o-jpg] writing '%s'\n", basename);
-
-  const int width  = module->connector[0].roi.wd;
-  const int height = module->connector[0].roi.ht;
-  const uint8_t *in = buf;
-
-  char dir[512];
-  snprintf(dir, sizeof(dir), "%s", basename);
-  if(fs_dirname(dir)) fs_mkdir(dir, 0755);
-
-  char filename[512];
-  snprintf(filename, sizeof(filename), "%s.jpg", basename);
+  const uint8_t *in;        // rgba input, first row of the strip
+  int            width;
+  int            height;
+  float          quality;
+  unsigned int   restart;   // restart interval in mcus, 0 for a single strip
+  unsigned char *out;       // compressed stream from jpeg_mem_dest()
+  unsigned long  size;
+}
+jpg_strip_t;
 
+static void
+encode_strip(jpg_strip_t *s)
+{
   jpgerr_t jerr;
   struct jpeg_compress_struct cinfo;
 
   cinfo.err = jpeg_std_error(&jerr.pub);
   jerr.pub.error_exit = error_exit;
+  uint8_t *volatile row = 0;
   if(setjmp(jerr.setjmp_buffer))
   {
     jpeg_destroy_compress(&cinfo);
+    free(row);
+    free(s->out);
+    s->out  = 0;
+    s->size = 0;
     return;
   }
   jpeg_create_compress(&cinfo);
-  FILE *f = fopen(filename, "wb");
-  if(!f) return;
-  jpeg_stdio_dest(&cinfo, f);
+  s->out  = 0;
+  s->size = 0;
+  jpeg_mem_dest(&cinfo, &s->out, &s->size);
 
-  cinfo.image_width  = width;
-  cinfo.image_height = height;
+  cinfo.image_width  = s->width;
+  cinfo.image_height = s->height;
+#ifdef JCS_EXTENSIONS
+  cinfo.input_components = 4; // libjpeg-turbo reads our rgba directly
+  cinfo.in_color_space = JCS_EXT_RGBX;
+#else
   cinfo.input_components = 3;
   cinfo.in_color_space = JCS_RGB;
+#endif
   jpeg_set_defaults(&cinfo);
-  const float quality = dt_module_param_float(module, 1)[0];
+  const float quality = s->quality;
   jpeg_set_quality(&cinfo, quality, TRUE);
   // same quality tradeoff as darktable
   if(quality > 90) cinfo.comp_info[0].v_samp_factor = 1;
@@ -75,25 +85,123 @@ void write_sink(
   if(quality < 80) cinfo.smoothing_factor = 20;
   if(quality < 60) cinfo.smoothing_factor = 40;
   if(quality < 40) cinfo.smoothing_factor = 60;
-  cinfo.optimize_coding = 1;
+  cinfo.optimize_coding = !s->restart; // strips need to share the tables
+  cinfo.restart_interval = s->restart;
   cinfo.density_unit = 1;
   cinfo.X_density = 300;
   cinfo.Y_density = 300;
 
   jpeg_start_compress(&cinfo, TRUE);
 
-  uint8_t *row = malloc((size_t)3 * width * sizeof(uint8_t));
+#ifndef JCS_EXTENSIONS
+  row = malloc((size_t)3 * s->width * sizeof(uint8_t));
+#endif
   while(cinfo.next_scanline < cinfo.image_height)
   {
     JSAMPROW tmp[1];
-    const uint8_t *buf = in + (size_t)cinfo.next_scanline * cinfo.image_width * 4;
-    for(int i = 0; i < width; i++)
+    const uint8_t *buf = s->in + (size_t)cinfo.next_scanline * cinfo.image_width * 4;
+#ifdef JCS_EXTENSIONS
+    tmp[0] = (JSAMPROW)buf;
+#else
+    for(int i = 0; i < s->width; i++)
       for(int k = 0; k < 3; k++) row[3 * i + k] = buf[4 * i + k];
     tmp[0] = row;
+#endif
     jpeg_write_scanlines(&cinfo, tmp, 1);
   }
   jpeg_finish_compress(&cinfo);
   free(row);
   jpeg_destroy_compress(&cinfo);
-  fclose(f);
+}
+
+static void
+encode_strips(uint32_t begin, uint32_t end, void *data)
+{
+  jpg_strip_t *s = data;
+  for(uint32_t i=begin;i<end;i++) encode_strip(s + i);
+}
+
+// return the offset of the entropy coded data after the scan header, and patch
+// the frame header to the full image height.
+static inline size_t
+scan_offset(unsigned char *b, size_t size, int height)
+{
+  size_t i = 2; // skip soi
+  while(i + 4 <= size && b[i] == 0xff)
+  {
+    const int marker = b[i+1];
+    const size_t len = (b[i+2] << 8) | b[i+3];
+    if(marker == 0xc0 && height) { b[i+5] = height >> 8; b[i+6] = height & 0xff; }
+    if(marker == 0xda) return i + 2 + len;
+    i += 2 + len;
+  }
+  return 0;
+}
+
+// called after pipeline finished up to here.
+// our input buffer will come in memory mapped.
+void write_sink(
+    dt_module_t *module,
+    void *buf)
+{
+  const char *basename = dt_module_param_string(module, 0);
+  fprintf(stderr, "[o-jpg] writing '%s'\n", basename);
+
+  const int width  = module->connector[0].roi.wd;
+  const int height = module->connector[0].roi.ht;
+  const uint8_t *in = buf;
+  const float quality = dt_module_param_float(module, 1)[0];
+
+  char dir[512];
+  snprintf(dir, sizeof(dir), "%s", basename);
+  if(fs_dirname(dir)) fs_mkdir(dir, 0755);
+
+  char filename[512];
+  snprintf(filename, sizeof(filename), "%s.jpg", basename);
+
+  // split into strips of whole mcu rows, one restart interval each (at most 16 bits)
+  const int mcu_wd = quality > 92 ? 8 : 16, mcu_ht = quality > 90 ? 8 : 16;
+  const int mcu_cols = (width + mcu_wd - 1) / mcu_wd, mcu_rows = (height + mcu_ht - 1) / mcu_ht;
+  int strip_cnt = MIN(threads_num(), mcu_rows / 8);  // small images are not worth it
+  if(strip_cnt > 1) strip_cnt = MAX(strip_cnt, (mcu_rows * mcu_cols + 65534) / 65535);
+  if(strip_cnt < 1) strip_cnt = 1;
+  const int strip_rows = (mcu_rows + strip_cnt - 1) / strip_cnt;
+  strip_cnt = (mcu_rows + strip_rows - 1) / strip_rows;
+
+  jpg_strip_t *strip = calloc(strip_cnt, sizeof(jpg_strip_t));
+  for(int i=0;i<strip_cnt;i++)
+  {
+    const int y = i * strip_rows * mcu_ht;
+    strip[i] = (jpg_strip_t) {
+      .in      = in + (size_t)4 * width * y,
+      .width   = width,
+      .height  = MIN(height - y, strip_rows * mcu_ht),
+      .quality = quality,
+      .restart = strip_cnt > 1 ? strip_rows * mcu_cols : 0,
+    };
+  }
+  if(strip_cnt > 1) threads_parallel_for(0, strip_cnt, 1, encode_strips, strip);
+  else encode_strip(strip);
+
+  FILE *f = 0;
+  for(int i=0;i<strip_cnt;i++) if(!strip[i].out || strip[i].size < 4) goto done;
+  if(!(f = fopen(filename, "wb"))) goto done;
+  if(strip_cnt == 1)
+  {
+    fwrite(strip[0].out, strip[0].size, 1, f);
+    goto done;
+  }
+  for(int i=0;i<strip_cnt;i++)
+  { // headers of the first strip, then the scans separated by restart markers
+    const size_t beg = scan_offset(strip[i].out, strip[i].size, i ? 0 : height);
+    if(!beg) goto done;
+    if(i == 0) fwrite(strip[0].out, beg, 1, f);
+    else fwrite((uint8_t[]){0xff, 0xd0 + ((i-1) & 7)}, 2, 1, f);
+    fwrite(strip[i].out + beg, strip[i].size - beg - 2, 1, f); // strip eoi
+  }
+  fwrite((uint8_t[]){0xff, 0xd9}, 2, 1, f);
+done:
+  if(f) fclose(f);
+  for(int i=0;i<strip_cnt;i++) free(strip[i].out);
+  free(strip);
 }
@@ -0,0 +1,2 @@
+MOD_CFLAGS=$(shell pkg-config --cflags libjxl)
+MOD_LDFLAGS=$(shell pkg-config --libs libjxl)
@@ -0,0 +1,164 @@
+#include "modules/api.h"
+#include "core/fs.h"
+#include "core/core.h"
+#include "core/threads.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <jxl/encode.h>
+
+// libjxl parallelises through a runner callback. we run its ranges on our
+// thread pool. the thread ids it wants are indices into its per thread scratch,
+// so every chunk borrows one of the slots for as long as it runs. there are
+// never more chunks in flight than threads in the pool plus the caller.
+typedef struct jxl_pool_t
+{
+  void                   *opaque;
+  JxlParallelRunFunction  func;
+  uint64_t                busy;   // bit mask of slots in use
+  uint32_t                slots;
+}
+jxl_pool_t;
+
+static void
+jxl_work(uint32_t begin, uint32_t end, void *data)
+{
+  jxl_pool_t *p = data;
+  const uint64_t all = p->slots == 64 ? ~0ul : (1ul << p->slots) - 1;
+  uint64_t busy = __atomic_load_n(&p->busy, __ATOMIC_RELAXED);
+  uint32_t slot = 0;
+  while(1)
+  { // claim a free slot
+    const uint64_t idle = ~busy & all;
+    if(!idle) { busy = __atomic_load_n(&p->busy, __ATOMIC_RELAXED); continue; }
+    slot = __builtin_ctzll(idle);
+    if(__atomic_compare_exchange_n(&p->busy, &busy, busy | (1ul << slot), 0,
+          __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) break;
+  }
+  for(uint32_t i=begin;i<end;i++) p->func(p->opaque, i, slot);
+  __atomic_and_fetch(&p->busy, ~(1ul << slot), __ATOMIC_RELEASE);
+}
+
+static JxlParallelRetCode
+jxl_runner(
+    void                   *runner_opaque,
+    void                   *jpegxl_opaque,
+    JxlParallelRunInit      init,
+    JxlParallelRunFunction  func,
+    uint32_t                start_range,
+    uint32_t                end_range)
+{
+  (void)runner_opaque;
+  jxl_pool_t p = {
+    .opaque = jpegxl_opaque,
+    .func   = func,
+    .slots  = MIN(64, threads_num() + 1),
+  };
+  const JxlParallelRetCode ret = init(jpegxl_opaque, p.slots);
+  if(ret) return ret;
+  threads_parallel_for(start_range, end_range, 1, jxl_work, &p);
+  return 0;
+}
+
+typedef struct jxl_rgb_t
+{
+  const uint16_t *rgba;
+  uint16_t       *rgb;
+  size_t          cnt;
+}
+jxl_rgb_t;
+
+static void
+drop_alpha(uint32_t begin, uint32_t end, void *data)
+{
+  jxl_rgb_t *p = data;
+  const size_t b = begin * (size_t)4096, e = MIN(p->cnt, end * (size_t)4096);
+  for(size_t k=b;k<e;k++)
+  {
+    p->rgb[3*k+0] = p->rgba[4*k+0];
+    p->rgb[3*k+1] = p->rgba[4*k+1];
+    p->rgb[3*k+2] = p->rgba[4*k+2];
+  }
+}
+
+// called after pipeline finished up to here.
+// our input buffer will come in memory mapped.
+void write_sink(
+    dt_module_t *module,
+    void *buf)
+{
+  const char *basename = dt_module_param_string(module, 0);
+  const float quality  = dt_module_param_float(module, 1)[0];
+  const int   effort   = dt_module_param_int(module, 2)[0];
+  fprintf(stderr, "[o-jxl] writing '%s'\n", basename);
+
+  const int width  = module->connector[0].roi.wd;
+  const int height = module->connector[0].roi.ht;
+  const size_t cnt = width * (size_t)height;
+
+  char dir[512];
+  snprintf(dir, sizeof(dir), "%s", basename);
+  if(fs_dirname(dir)) fs_mkdir(dir, 0755);
+  char filename[512];
+  snprintf(filename, sizeof(filename), "%s.jxl", basename);
+
+  // half floats straight from the download buffer, without the alpha channel
+  jxl_rgb_t p = { .rgba = buf, .rgb = malloc(sizeof(uint16_t) * 3 * cnt), .cnt = cnt };
+  uint8_t *out = 0;
+  FILE *f = 0;
+  JxlEncoder *enc = JxlEncoderCreate(0);
+  if(!p.rgb || !enc) goto error;
+  threads_parallel_for(0, (cnt + 4095) / 4096, 16, drop_alpha, &p);
+
+  if(JxlEncoderSetParallelRunner(enc, jxl_runner, 0) != JXL_ENC_SUCCESS) goto error;
+  JxlBasicInfo info;
+  JxlEncoderInitBasicInfo(&info);
+  info.xsize                    = width;
+  info.ysize                    = height;
+  info.bits_per_sample          = 16;
+  info.exponent_bits_per_sample = 5;
+  info.num_color_channels       = 3;
+  info.uses_original_profile    = JXL_FALSE; // lossy in xyb
+  if(JxlEncoderSetBasicInfo(enc, &info) != JXL_ENC_SUCCESS) goto error;
+  // the pipeline works in linear rec2020
+  JxlColorEncoding col = {
+    .color_space       = JXL_COLOR_SPACE_RGB,
+    .white_point       = JXL_WHITE_POINT_D65,
+    .primaries         = JXL_PRIMARIES_2100,
+    .transfer_function = JXL_TRANSFER_FUNCTION_LINEAR,
+    .rendering_intent  = JXL_RENDERING_INTENT_PERCEPTUAL,
+  };
+  if(JxlEncoderSetColorEncoding(enc, &col) != JXL_ENC_SUCCESS) goto error;
+
+  JxlEncoderFrameSettings *fs = JxlEncoderFrameSettingsCreate(enc, 0);
+  JxlEncoderSetFrameDistance(fs, JxlEncoderDistanceFromQuality(CLAMP(quality, 0.0f, 100.0f)));
+  JxlEncoderFrameSettingsSetOption(fs, JXL_ENC_FRAME_SETTING_EFFORT, CLAMP(effort, 1, 9));
+  const JxlPixelFormat format = { 3, JXL_TYPE_FLOAT16, JXL_NATIVE_ENDIAN, 0 };
+  if(JxlEncoderAddImageFrame(fs, &format, p.rgb, sizeof(uint16_t) * 3 * cnt) != JXL_ENC_SUCCESS) goto error;
+  JxlEncoderCloseInput(enc);
+
+  size_t size = 1<<20, pos = 0;
+  JxlEncoderStatus res = JXL_ENC_NEED_MORE_OUTPUT;
+  while(res == JXL_ENC_NEED_MORE_OUTPUT)
+  {
+    uint8_t *grow = realloc(out, size);
+    if(!grow) goto error;
+    out = grow;
+    uint8_t *next = out + pos;
+    size_t avail = size - pos;
+    res = JxlEncoderProcessOutput(enc, &next, &avail);
+    pos = next - out;
+    size *= 2;
+  }
+  if(res != JXL_ENC_SUCCESS) goto error;
+  if(!(f = fopen(filename, "wb")) || fwrite(out, pos, 1, f) != 1) goto error;
+  goto done;
+error:
+  fprintf(stderr, "[o-jxl] failed to write '%s'\n", filename);
+done:
+  if(f) fclose(f);
+  if(enc) JxlEncoderDestroy(enc);
+  free(out);
+  free(p.rgb);
+}
@@ -1,7 +1,27 @@
 #include "modules/api.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// pixels are converted to rgb in chunks of this many bytes, each goes to disk
+// with one write() straight from there, no stdio buffering in between
+#define PFM_CHUNK (16u<<20)
+
+static int
+write_all(int fd, const void *buf, size_t len)
+{
+  const uint8_t *p = buf;
+  while(len)
+  {
+    const ssize_t w = write(fd, p, len);
+    if(w <= 0) return 1;
+    p += w; len -= w;
+  }
+  return 0;
+}
 
 // called after pipeline finished up to here.
 // our input buffer will come in memory mapped.
@@ -11,31 +31,34 @@ void write_sink(
 {
   const char *basename = dt_module_param_string(module, 0);
   fprintf(stderr, "[o-pfm] writing '%s'\n", basename);
-  float *pf = buf;
+  const float *pf = buf;
 
   const int width  = module->connector[0].roi.wd;
   const int height = module->connector[0].roi.ht;
 
   char filename[512];
   snprintf(filename, sizeof(filename), "%s.pfm", basename);
-  FILE* f = fopen(filename, "wb");
-  if(f)
+  const int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if(fd == -1) return;
+
+  // align pfm header to sse, assuming the file will
+  // be mmapped to page boundaries.
+  char header[1024];
+  size_t len = snprintf(header, 1000, "PF\n%d %d\n-1.0", width, height);
+  while((len + 1) & 0xf) header[len++] = '0';
+  header[len++] = '\n';
+  int err = write_all(fd, header, len);
+
+  const size_t cnt = width*(uint64_t)height, px = PFM_CHUNK / (3*sizeof(float));
+  float *rgb = malloc(3*sizeof(float)*MIN(px, cnt));
+  for(size_t k=0;k<cnt && !err;k+=px)
   {
-    // align pfm header to sse, assuming the file will
-    // be mmapped to page boundaries.
-    char header[1024];
-    snprintf(header, 1024, "PF\n%d %d\n-1.0", width, height);
-    size_t len = strlen(header);
-    fprintf(f, "PF\n%d %d\n-1.0", width, height);
-    ssize_t off = 0;
-    while((len + 1 + off) & 0xf) off++;
-    while(off-- > 0) fprintf(f, "0");
-    fprintf(f, "\n");
-    for(size_t k=0;k<width*(uint64_t)height;k++)
-    {
-      float p32[3] = {pf[4*k+0], pf[4*k+1], pf[4*k+2]};
-      fwrite(p32, sizeof(float), 3ul, f);
-    }
-    fclose(f);
+    const size_t n = MIN(px, cnt-k);
+    for(size_t i=0;i<n;i++)
+      for(int c=0;c<3;c++) rgb[3*i+c] = pf[4*(k+i)+c];
+    err = write_all(fd, rgb, 3*sizeof(float)*n);
   }
+  free(rgb);
+  if(err) fprintf(stderr, "[o-pfm] failed to write '%s'\n", filename);
+  close(fd);
 }
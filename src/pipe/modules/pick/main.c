@@ -111,6 +111,7 @@ create_nodes(
       .chan   = dt_token("r"),
       .format = dt_token("atom"),
       .roi    = module->connector[3].roi,
+      .flags  = s_conn_deferred, // live picking doesn't need to stall the pipeline
       .connected_mi = -1,
     }},
   };
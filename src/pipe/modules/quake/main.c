@@ -33,7 +33,7 @@ typedef struct qs_data_t
   uint32_t     tex_dim[2*MAX_GLTEXTURES]; // resolutions of textures for modify_roi_out
   uint8_t      tex_req[MAX_GLTEXTURES];   // dynamic texture request flag: replace this slot by new upload
   int32_t      tex_cnt;                   // current number of textures
-  uint32_t     tex_maxw, tex_maxh;        // maximum texture size, to allocate staging upload buffer
+  uint32_t     tex_maxw, tex_maxh;        // maximum texture size, the staging buffer dirty textures are batched into
   uint32_t     skybox[6];                 // 6 cubemap skybox texture ids
   uint32_t     tex_explosion;             // something emissive for particles
   uint32_t     tex_blood;                 // for blood particles
@@ -957,7 +957,7 @@ void commit_params(
 
   // hijacked for performance counter rendering
   float *p_duration = (float *)dt_module_param_float(module, dt_module_get_param(module->so, dt_token("spp")));
-  p_duration[0] = graph->query[(graph->frame+1)%2].last_frame_duration;
+  p_duration[0] = graph->query[graph->ring_done].last_frame_duration;
 
   // set sv_player. this has to be done if we're not calling Host_Frame after a map reload
   client_t *host_client = svs.clients;
@@ -1164,7 +1164,7 @@ create_nodes(
     .wd     = 1,
     .ht     = 1,
     .dp     = 1,
-    .flags  = s_module_request_read_geo,
+    .flags  = s_module_request_read_geo | s_module_geo_dynamic, // entities and particles change topology, no refits
     .num_connectors = 1,
     .connector = {{
       .name   = dt_token("dyngeo"),
@@ -42,6 +42,19 @@ int init(dt_module_t *mod)
   return 0;
 }
 
+static int
+data_connected(const dt_graph_t *graph, const dt_module_t *module)
+{ // does anybody read the raw statistics, or is this display only?
+  const int mi = module - graph->module;
+  for(int m=0;m<graph->num_modules;m++)
+    for(int c=0;c<graph->module[m].num_connectors;c++)
+      if(dt_connector_input(graph->module[m].connector+c) &&
+         graph->module[m].connector[c].connected_mi == mi &&
+         graph->module[m].connector[c].connected_mc == 2)
+        return 1;
+  return 0;
+}
+
 void
 create_nodes(
     dt_graph_t  *graph,
@@ -50,14 +63,20 @@ create_nodes(
   const dt_image_params_t *img_param = dt_module_get_input_img_param(graph, module, dt_token("input"));
   if(!img_param) return;
   const int block = img_param->filters == 9u ? 3 : 2;
+  // the display alone does not need every block, about a megapixel is plenty.
+  // noise profiling reads the data connector and gets all of them:
+  const dt_roi_t *ri = &module->connector[0].roi;
+  const int stride = data_connected(graph, module) ? 1 :
+    MAX(1, (int)sqrtf(ri->wd * (float)ri->ht / (block*block) * 1e-6f));
+  const int pc[] = { stride };
 
   // input -> collect -> map -> output
   dt_roi_t roi_buf = module->connector[2].roi;
 
   const int id_collect = dt_node_add(graph, module, "rawhist",
       graph->float_atomics_supported ? "collect" : "coldumb",
-    module->connector[0].roi.wd/block, module->connector[0].roi.ht/block, 1,
-    0, 0, 2,
+    ri->wd/block/stride, ri->ht/block/stride, 1,
+    sizeof(pc), pc, 2,
     "input",  "read",  "rggb", "ui16",   &module->connector[0].roi,
     "output", "write", "r",    "atomic", &roi_buf);
   const int id_map = dt_node_add(graph, module, "rawhist", "map",
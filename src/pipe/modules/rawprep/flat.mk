@@ -0,0 +1,2 @@
+MOD_C=pipe/connector.c
+SPV_PENDING+=pipe/modules/rawprep/main.comp.spv
@@ -0,0 +1,128 @@
+#include "modules/api.h"
+
+void modify_roi_in(
+    dt_graph_t *graph,
+    dt_module_t *module)
+{ // request the full uncropped thing, we crop the borders ourselves
+  module->connector[0].roi.wd = module->connector[0].roi.full_wd;
+  module->connector[0].roi.ht = module->connector[0].roi.full_ht;
+  module->connector[0].roi.scale = 1.0f;
+}
+
+void modify_roi_out(
+    dt_graph_t *graph,
+    dt_module_t *module)
+{
+  const dt_image_params_t *img_param = dt_module_get_input_img_param(graph, module, dt_token("input"));
+  if(!img_param) return; // input chain disconnected
+  const uint32_t *b = img_param->crop_aabb;
+  module->connector[1].roi = module->connector[0].roi;
+  module->connector[1].roi.full_wd = b[2] - b[0];
+  module->connector[1].roi.full_ht = b[3] - b[1];
+}
+
+dt_graph_run_t
+check_params(
+    dt_module_t *module,
+    uint32_t     parid,
+    void        *oldval)
+{
+  if(parid == 0 && !dt_pipe_shader_exists(dt_token("rawprep"), dt_token("main")))
+  { // thrs switches the hotpx pass of the fallback on or off
+    float oldthrs = *(float*)oldval;
+    float newthrs = dt_module_param_float(module, 0)[0];
+    if((oldthrs <= 0.0f && newthrs >  0.0f) ||
+       (oldthrs >  0.0f && newthrs <= 0.0f))
+    return s_graph_run_all;
+  }
+  return s_graph_run_record_cmd_buf;
+}
+
+void
+create_nodes(
+    dt_graph_t  *graph,
+    dt_module_t *module)
+{
+  const dt_image_params_t *img_param = dt_module_get_input_img_param(graph, module, dt_token("input"));
+  if(!img_param) return;
+  // same as denoise: downstream sees cropped data scaled to [0,1]
+  for(int k=0;k<4;k++)
+  {
+    module->img_param.black[k] = 0.0;
+    module->img_param.white[k] = 1.0;
+  }
+  module->img_param.crop_aabb[0] = 0;
+  module->img_param.crop_aabb[1] = 0;
+  module->img_param.crop_aabb[2] = module->connector[1].roi.full_wd;
+  module->img_param.crop_aabb[3] = module->connector[1].roi.full_ht;
+
+  float black[4], white[4];
+  const uint32_t *blacki = (uint32_t *)black;
+  const uint32_t *whitei = (uint32_t *)white;
+  for(int k=0;k<4;k++) black[k] = img_param->black[k]/65535.0f;
+  for(int k=0;k<4;k++) white[k] = img_param->white[k]/65535.0f;
+  const uint32_t *crop_aabb = img_param->crop_aabb;
+
+  if(!dt_pipe_shader_exists(dt_token("rawprep"), dt_token("main")))
+  { // the kernel is not built by default yet (see flat.mk), do the same in
+    // two passes: crop and scale with the noop kernel of denoise, then remove
+    // stuck pixels with the kernel of hotpx, which reads our thrs parameter.
+    const int hotpx = dt_module_param_float(module, 0)[0] > 0.0f && img_param->filters != 9;
+    const uint32_t pc_noop[] = {
+      crop_aabb[0], crop_aabb[1], crop_aabb[2], crop_aabb[3],
+      blacki[0], blacki[1], blacki[2], blacki[3],
+      whitei[0], whitei[1], whitei[2], whitei[3] };
+    const int id_noop = dt_node_add(graph, module, "denoise", "noop",
+        module->connector[1].roi.wd, module->connector[1].roi.ht, 1,
+        sizeof(pc_noop), (const int *)pc_noop, 2,
+        "input",  "read",  "rggb", "*",   -1ul,
+        "output", "write", "rggb", "f16", &module->connector[1].roi);
+    dt_connector_copy(graph, module, 0, id_noop, 0);
+    if(!hotpx)
+    {
+      dt_connector_copy(graph, module, 1, id_noop, 1);
+      return;
+    }
+    const int id_hotpx = dt_node_add(graph, module, "hotpx", "main",
+        module->connector[1].roi.wd, module->connector[1].roi.ht, 1, 0, 0, 2,
+        "input",  "read",  "rggb", "f16", -1ul,
+        "output", "write", "rggb", "f16", &module->connector[1].roi);
+    CONN(dt_node_connect(graph, id_noop, 1, id_hotpx, 0));
+    dt_connector_copy(graph, module, 1, id_hotpx, 1);
+    return;
+  }
+
+  assert(graph->num_nodes < graph->max_nodes);
+  const uint32_t id_main = graph->num_nodes++;
+  graph->node[id_main] = (dt_node_t) {
+    .name   = dt_token("rawprep"),
+    .kernel = dt_token("main"),
+    .module = module,
+    .wd     = module->connector[1].roi.wd,
+    .ht     = module->connector[1].roi.ht,
+    .dp     = 1,
+    .num_connectors = 2,
+    .connector = {{
+      .name   = dt_token("input"),
+      .type   = dt_token("read"),
+      .chan   = dt_token("rggb"),
+      .format = dt_token("ui16"), // will be overwritten soon
+      .roi    = module->connector[0].roi,
+      .connected_mi = -1,
+    },{
+      .name   = dt_token("output"),
+      .type   = dt_token("write"),
+      .chan   = dt_token("rggb"),
+      .format = dt_token("f16"), // will be overwritten soon
+      .roi    = module->connector[1].roi,
+    }},
+    .push_constant_size = 12*sizeof(uint32_t),
+    .push_constant = {
+      crop_aabb[0], crop_aabb[1], img_param->filters, 0,
+      blacki[0], blacki[1], blacki[2], blacki[3],
+      whitei[0], whitei[1], whitei[2], whitei[3],
+    },
+  };
+  dt_connector_copy(graph, module, 0, id_main, 0);
+  dt_connector_copy(graph, module, 1, id_main, 1);
+}
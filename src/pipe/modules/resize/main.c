@@ -13,26 +13,96 @@ void modify_roi_in(
   module->connector[0].roi.scale = 1.0f;
 }
 
+// downscaling first averages blocks of pixels by an integer factor, leaving
+// at least two times the output resolution, and then runs a separable lanczos
+// filter. the filter weights only depend on the sizes, they are computed here
+// and uploaded when the nodes are created.
+#define RESIZE_LOBES 3
+
+typedef struct resize_t
+{
+  int wd[2], ht[2]; // input (after the box reduction) and output size
+  int taps[2];      // weights per output pixel in x and y
+}
+resize_t;
+
+static inline int
+resize_taps(int n_in, int n_out)
+{
+  const double s = MAX(1.0, n_in / (double)n_out);
+  return 2*(int)ceil(RESIZE_LOBES * s) + 1;
+}
+
+static inline double
+resize_lanczos(double x)
+{
+  if(fabs(x) < 1e-8) return 1.0;
+  if(fabs(x) >= RESIZE_LOBES) return 0.0;
+  const double px = M_PI * x;
+  return RESIZE_LOBES * sin(px) * sin(px / RESIZE_LOBES) / (px * px);
+}
+
+static void
+resize_weights(float *w, int n_in, int n_out, int taps)
+{
+  const double s = n_in / (double)n_out, f = MAX(1.0, s);
+  for(int o=0;o<n_out;o++)
+  {
+    const double c = (o + 0.5) * s - 0.5; // center in input pixels
+    const int beg = (int)floor(c - RESIZE_LOBES * f) + 1;
+    float *wo = w + o * (taps+1);
+    double sum = 0.0;
+    for(int k=0;k<taps;k++) sum += resize_lanczos((beg + k - c) / f);
+    wo[0] = beg;
+    for(int k=0;k<taps;k++) wo[1+k] = resize_lanczos((beg + k - c) / f) / sum;
+  }
+}
+
+int init(dt_module_t *mod)
+{
+  mod->data = calloc(sizeof(resize_t), 1);
+  return 0;
+}
+
+void cleanup(dt_module_t *mod)
+{
+  free(mod->data);
+  mod->data = 0;
+}
+
+int read_source(
+    dt_module_t             *mod,
+    void                    *mapped,
+    dt_read_source_params_t *p)
+{
+  const resize_t *r = mod->data;
+  float *w = mapped;
+  resize_weights(w, r->wd[0], r->wd[1], r->taps[0]);
+  resize_weights(w + r->wd[1]*(r->taps[0]+1), r->ht[0], r->ht[1], r->taps[1]);
+  return 0;
+}
+
 void
 create_nodes(
     dt_graph_t  *graph,
     dt_module_t *module)
 {
-  if(module->connector[0].roi.wd == module->connector[1].roi.wd &&
-     module->connector[0].roi.ht == module->connector[1].roi.ht)
+  const dt_roi_t *ri = &module->connector[0].roi, *ro = &module->connector[1].roi;
+  if(ri->wd == ro->wd && ri->ht == ro->ht)
   {
     dt_connector_bypass(graph, module, 0, 1);
+    return;
   }
-  else
-  {
+  if(ro->wd > ri->wd || ro->ht > ri->ht)
+  { // magnify in one go
     assert(graph->num_nodes < graph->max_nodes);
     const int nodeid = graph->num_nodes++;
     graph->node[nodeid] = (dt_node_t) {
       .name   = module->name,
       .kernel = dt_token("main"),
       .module = module,
-      .wd     = module->connector[1].roi.wd,
-      .ht     = module->connector[1].roi.ht,
+      .wd     = ro->wd,
+      .ht     = ro->ht,
       .dp     = 1,
       .num_connectors = 2,
       .connector = {{
@@ -40,18 +110,76 @@ create_nodes(
         .type   = dt_token("read"),
         .chan   = dt_token("rgba"), // will be overwritten soon
         .format = dt_token("f16"),
-        .roi    = module->connector[0].roi,
+        .roi    = *ri,
         .connected_mi = -1,
       },{
         .name   = dt_token("output"),
         .type   = dt_token("write"),
         .chan   = dt_token("rgba"), // will be overwritten soon
         .format = dt_token("f16"),
-        .roi    = module->connector[1].roi,
+        .roi    = *ro,
       }},
     };
     dt_connector_copy(graph, module, 0, nodeid, 0);
     dt_connector_copy(graph, module, 1, nodeid, 1);
+    return;
   }
-}
 
+  const char *chan = dt_token_str(module->connector[0].chan);
+  const char *fmt  = dt_api_precision(graph);
+  resize_t *r = module->data;
+  const int fx = MAX(1, ri->wd / ro->wd / 2), fy = MAX(1, ri->ht / ro->ht / 2);
+  dt_roi_t rb = *ri;
+  rb.wd = (ri->wd + fx - 1) / fx;
+  rb.ht = (ri->ht + fy - 1) / fy;
+  int id_in = -1, conn_in = -1;
+  if(fx > 1 || fy > 1)
+  {
+    const int pc[] = { fx, fy };
+    id_in = dt_node_add(graph, module, "resize", "box", rb.wd, rb.ht, 1, sizeof(pc), pc, 2,
+        "input",  "read",  chan, "*", -1ul,
+        "output", "write", chan, fmt, &rb);
+    dt_connector_copy(graph, module, 0, id_in, 0);
+    conn_in = 1;
+  }
+  r->wd[0] = rb.wd; r->wd[1] = ro->wd;
+  r->ht[0] = rb.ht; r->ht[1] = ro->ht;
+  r->taps[0] = resize_taps(rb.wd, ro->wd);
+  r->taps[1] = resize_taps(rb.ht, ro->ht);
+  const int words = ro->wd * (r->taps[0]+1) + ro->ht * (r->taps[1]+1);
+
+  assert(graph->num_nodes < graph->max_nodes);
+  const int id_weights = graph->num_nodes++;
+  graph->node[id_weights] = (dt_node_t) {
+    .name   = module->name,
+    .kernel = dt_token("weights"),
+    .module = module,
+    .num_connectors = 1,
+    .connector = {{
+      .name   = dt_token("source"),
+      .type   = dt_token("source"),
+      .chan   = dt_token("ssbo"),
+      .format = dt_token("f32"),
+      .roi    = { .full_wd = words, .wd = words, .full_ht = 1, .ht = 1, .scale = 1.0 },
+    }},
+  };
+
+  dt_roi_t rh = rb;
+  rh.wd = ro->wd;
+  const int pch[] = { r->taps[0], 0, 0 };
+  const int id_h = dt_node_add(graph, module, "resize", "lanczos", ro->wd, rb.ht, 1, sizeof(pch), pch, 3,
+      "input",   "read",  chan,   "*",   -1ul,
+      "weights", "read",  "ssbo", "f32", -1ul,
+      "output",  "write", chan,   fmt,   &rh);
+  const int pcv[] = { r->taps[1], ro->wd * (r->taps[0]+1), 1 };
+  const int id_v = dt_node_add(graph, module, "resize", "lanczos", ro->wd, ro->ht, 1, sizeof(pcv), pcv, 3,
+      "input",   "read",  chan,   "*",   -1ul,
+      "weights", "read",  "ssbo", "f32", -1ul,
+      "output",  "write", chan,   "f16", ro);
+  if(id_in >= 0) CONN(dt_node_connect(graph, id_in, conn_in, id_h, 0));
+  else dt_connector_copy(graph, module, 0, id_h, 0);
+  CONN(dt_node_connect(graph, id_weights, 0, id_h, 1));
+  CONN(dt_node_connect(graph, id_weights, 0, id_v, 1));
+  CONN(dt_node_connect(graph, id_h, 2, id_v, 0));
+  dt_connector_copy(graph, module, 1, id_v, 2);
+}
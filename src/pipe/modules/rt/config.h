@@ -0,0 +1,10 @@
+// wavefront mode: one path per pixel lives in a queue of rays between the
+// kernels. uints per element of the ray queue, written by gen and extend:
+//   key (sort key), id (pixel), x[3] (origin/hit point), w[3] (direction),
+//   seed (rng state), t (hit distance), prim (primitive id)
+#define RT_RAY 11
+// uints per element of the occlusion queue, written by shade for connect:
+//   id, x[3], n[3], seed, diffcol[3], L[3] (transmittance to the sky)
+#define RT_OCC 14
+// work group size of the one dimensional queue kernels
+#define RT_WG 32
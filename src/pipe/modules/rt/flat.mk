@@ -1 +1,9 @@
 MOD_LDFLAGS=-lm
+pipe/modules/rt/gen.comp.spv:     pipe/modules/rt/rt.glsl pipe/modules/rt/config.h
+pipe/modules/rt/extend.comp.spv:  pipe/modules/rt/config.h
+pipe/modules/rt/live.comp.spv:    pipe/modules/rt/config.h
+pipe/modules/rt/shade.comp.spv:   pipe/modules/rt/config.h
+pipe/modules/rt/connect.comp.spv: pipe/modules/rt/rt.glsl pipe/modules/rt/config.h
+pipe/modules/rt/librt.so:         pipe/modules/rt/config.h
+SPV_PENDING+=pipe/modules/rt/gen.comp.spv pipe/modules/rt/extend.comp.spv pipe/modules/rt/live.comp.spv
+SPV_PENDING+=pipe/modules/rt/shade.comp.spv pipe/modules/rt/connect.comp.spv pipe/modules/rt/resolve.comp.spv
@@ -1,4 +1,5 @@
 #include "quat.h"
+#include "config.h"
 #include "modules/api.h"
 #include <inttypes.h>
 
@@ -89,6 +90,107 @@ void commit_params(dt_graph_t *graph, dt_module_t *mod)
   if(rt->move & (1<<5)) for(int k=0;k<3;k++) p_cam[k] -= vel * top[k];
 }
 
+dt_graph_run_t
+check_params(
+    dt_module_t *module,
+    uint32_t     parid,
+    void        *oldval)
+{
+  if(parid == 2)
+  { // wave: switching between megakernel and wavefront needs other nodes
+    int oldwave = *(int*)oldval;
+    int newwave = dt_module_param_int(module, parid)[0];
+    if(oldwave != newwave) return s_graph_run_all;
+  }
+  return s_graph_run_record_cmd_buf; // minimal parameter upload to uniforms
+}
+
+void
+create_nodes(
+    dt_graph_t  *graph,
+    dt_module_t *module)
+{
+  const int p_wave = dt_module_param_int(module, dt_module_get_param(module->so, dt_token("wave")))[0];
+  const dt_roi_t *roi = &module->connector[1].roi;
+  const uint32_t n = roi->wd * roi->ht; // one path per pixel in the queue
+  // the radix sort looks at 4 bits per pass, as many passes as the ray count needs.
+  // the top bit of the sorted range marks dead rays, see extend.comp
+  const uint32_t kb = 4*((32 - __builtin_clz(MAX(n, 1)))/4);
+  // the wavefront kernels are not built by default yet, see flat.mk
+  int have_wave = 1;
+  static const char *wave_kernel[] = { "gen", "extend", "live", "shade", "connect", "resolve" };
+  for(int k=0;k<6;k++)
+    have_wave &= dt_pipe_shader_exists(dt_token("rt"), dt_token(wave_kernel[k]));
+  if(!p_wave || !have_wave || kb < 4)
+  { // megakernel: one thread per pixel traces all samples
+    const int id_main = dt_node_add(graph, module, "rt", "main", roi->wd, roi->ht, 1, 0, 0, 5,
+        "geo",    "read",  "ssbo", "geo", -1ul,
+        "output", "write", "rgba", "f16", roi,
+        "blue",   "read",  "*",    "*",   -1ul,
+        "tex",    "read",  "*",    "*",   -1ul,
+        "aov",    "write", "rgba", "f16", roi);
+    for(int c=0;c<5;c++) dt_connector_copy(graph, module, c, id_main, c);
+    return;
+  }
+
+  // wavefront: generate, extend, sort, shade, connect, and resolve to the images.
+  // the one dimensional kernels run RT_WG threads per work group.
+  const int wg = (n + RT_WG - 1)/RT_WG * DT_LOCAL_SIZE_X;
+  const int pc_img[] = { roi->wd, roi->ht };
+  const int pc_key[] = { n, kb };
+  const dt_roi_t roi_rays = { .wd = n, .ht = RT_RAY, .full_wd = n, .full_ht = RT_RAY };
+  const dt_roi_t roi_occl = { .wd = n, .ht = RT_OCC, .full_wd = n, .full_ht = RT_OCC };
+  const dt_roi_t roi_acc  = { .wd = n, .ht = 8, .full_wd = n, .full_ht = 8 }; // two vec4 per pixel
+  const dt_roi_t roi_cnt  = { .wd = 1, .ht = 1, .full_wd = 1, .full_ht = 1 };
+  const int id_gen = dt_node_add(graph, module, "rt", "gen", wg, 1, 1, sizeof(pc_img), pc_img, 2,
+      "blue",   "read",  "*",    "*",    -1ul,
+      "rays",   "write", "ssbo", "ui32", &roi_rays);
+  const int id_ext = dt_node_add(graph, module, "rt", "extend", wg, 1, 1, sizeof(pc_key), pc_key, 5,
+      "rays",   "read",  "ssbo", "ui32", -1ul,
+      "geo",    "read",  "ssbo", "geo",  -1ul,
+      "tex",    "read",  "*",    "*",    -1ul,
+      "output", "write", "ssbo", "ui32", &roi_rays,
+      "env",    "write", "ssbo", "f32",  &roi_acc);
+  // sorting by material and direction also compacts: dead rays go to the tail
+  const int id_sort = dt_api_radix_sort(graph, module, id_ext, 3, 0, 0, RT_RAY, n);
+  const int id_live = dt_node_add(graph, module, "rt", "live", wg, 1, 1, sizeof(pc_key), pc_key, 2,
+      "rays",   "read",  "ssbo", "ui32", -1ul,
+      "count",  "write", "ssbo", "ui32", &roi_cnt);
+  const int id_shade = dt_node_add(graph, module, "rt", "shade", wg, 1, 1, 0, 0, 4,
+      "rays",   "read",  "ssbo", "ui32", -1ul,
+      "count",  "read",  "ssbo", "ui32", -1ul,
+      "tex",    "read",  "*",    "*",    -1ul,
+      "occl",   "write", "ssbo", "ui32", &roi_occl);
+  const int id_conn = dt_node_add(graph, module, "rt", "connect", wg, 1, 1, sizeof(pc_img), pc_img, 4,
+      "occl",   "read",  "ssbo", "ui32", -1ul,
+      "count",  "read",  "ssbo", "ui32", -1ul,
+      "blue",   "read",  "*",    "*",    -1ul,
+      "hit",    "write", "ssbo", "f32",  &roi_acc);
+  const int id_res = dt_node_add(graph, module, "rt", "resolve", roi->wd, roi->ht, 1, 0, 0, 4,
+      "env",    "read",  "ssbo", "f32",  -1ul,
+      "hit",    "read",  "ssbo", "f32",  -1ul,
+      "output", "write", "rgba", "f16",  roi,
+      "aov",    "write", "rgba", "f16",  roi);
+  dt_connector_copy(graph, module, 2, id_gen,   0); // blue noise
+  dt_connector_copy(graph, module, 0, id_ext,   1); // geo
+  dt_connector_copy(graph, module, 3, id_ext,   2); // textures
+  dt_connector_copy(graph, module, 3, id_shade, 2);
+  dt_connector_copy(graph, module, 2, id_conn,  2);
+  dt_connector_copy(graph, module, 1, id_res,   2); // output
+  dt_connector_copy(graph, module, 4, id_res,   3); // aov
+  CONN(dt_node_connect_named(graph, id_gen,   "rays",   id_ext,   "rays"));
+  CONN(dt_node_connect      (graph, id_sort,  3,        id_live,  0));
+  CONN(dt_node_connect      (graph, id_sort,  3,        id_shade, 0));
+  CONN(dt_node_connect_named(graph, id_live,  "count",  id_shade, "count"));
+  CONN(dt_node_connect_named(graph, id_live,  "count",  id_conn,  "count"));
+  CONN(dt_node_connect_named(graph, id_shade, "occl",   id_conn,  "occl"));
+  CONN(dt_node_connect_named(graph, id_ext,   "env",    id_res,   "env"));
+  CONN(dt_node_connect_named(graph, id_conn,  "hit",    id_res,   "hit"));
+  // shade and connect only run the work groups covering live rays
+  dt_api_dispatch_indirect(graph, module, id_live, 1, id_shade, RT_WG, n);
+  dt_api_dispatch_indirect(graph, module, id_live, 1, id_conn,  RT_WG, n);
+}
+
 int init(dt_module_t *mod)
 {
   rt_t *rt = calloc(sizeof(rt_t), 1);
@@ -0,0 +1,76 @@
+// helpers of the wavefront kernels (gen, extend, shade, connect), the same as
+// in the megakernel (main). xrand() reads the blue noise texture, the
+// including kernel declares it as img_blue.
+
+#if 0
+// uniformly sample the unit sphere, p = 1/4pi
+static inline void sample_sphere(float *x, float *y, float *z, const float x1, const float x2)
+{
+  *z = 1.f - 2.f*x1;
+  const float r = sqrtf(1.f - *z**z);
+  const float phi = 2.f*M_PI*x2;
+  *x = r * cosf(phi);
+  *y = r * sinf(phi);
+}
+
+// sample hemisphere uniformly, p = 1/2pi
+static inline void sample_hemisphere(float *x, float *y, float *z, const float x1, const float x2)
+{
+  *z = 1.f - x1;
+  const float r = sqrtf(1.f - *z**z);
+  const float phi = 2.f*M_PI*x2;
+  *x = r * cosf(phi);
+  *y = r * sinf(phi);
+}
+
+// sample hemisphere, cos^k lobe, p = cos^k(theta) (k+1)/2pi
+static inline void sample_cos_k(float *x, float *y, float *z, const float k, const float x1, const float x2)
+{
+  const float r1 = x1 * 2.0f * M_PI;
+  const float cos_theta = powf(1.0f - x2, 1.0f/(k+1));
+  const float sin_theta = sqrtf(MAX(0.0f, 1.0f - cos_theta*cos_theta));
+  *x = cosf(r1) * sin_theta;
+  *y = sinf(r1) * sin_theta;
+  *z = cos_theta;
+}
+#endif
+
+// sample hemisphere, cos lobe, p = cos(theta)/pi
+vec3 sample_cos(vec2 x)
+{
+  float su = sqrt(x.x);
+  return vec3(su*cos(2.0*3.1415*x.y), su*sin(2.0*3.1415*x.y), sqrt(1.0 - x.x));
+}
+
+float mrand(inout uint seed)
+{ // Algorithm "xor" from p. 4 of Marsaglia, "Xorshift RNGs"
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed / 4294967296.0;
+}
+
+vec4 xrand(inout uint seed, ivec2 p)
+{
+  // cp shift based on seed
+  return mod(texelFetch(img_blue, p, 0) + vec4(mrand(seed), mrand(seed), mrand(seed), mrand(seed)), vec4(1.0));
+}
+
+// primary ray direction through pixel ipos + jitter for a camera looking along f
+vec3 camera_dir(vec3 f, vec2 ipos, ivec2 size)
+{
+  vec3 up = vec3(0, 0, 1);
+  vec3 r = normalize(cross(f, up));
+  vec3 t = normalize(cross(f, r)) * float(size.y)/float(size.x);
+  vec2 uv = ipos/size - 0.5;
+  return normalize(0.45*f + r*uv.x + t*uv.y);
+}
+
+// tangent frame around the normal n, for the ambient occlusion rays
+void tangent_frame(vec3 n, out vec3 du, out vec3 dv)
+{
+  vec3 up = vec3(1,0,0);
+  if(abs(n.x) > abs(n.y)) up = vec3(0,1,0);
+  du = normalize(cross(up, n));
+  dv = normalize(cross(du, n));
+}
@@ -0,0 +1,62 @@
+// shared memory cache for scatter plots and histograms with many bins (such
+// as ciediag): every workgroup accumulates the counts of its pixels in a
+// small hash table in shared memory and adds every non-empty entry to the
+// global bin with one atomic at the end. neighbouring pixels mostly fall into
+// few bins, so this turns thousands of contended global atomics into a few
+// dozen. keys which don't find a free slot are to be added globally right
+// away by the caller.
+//
+// define DT_BINS_LOG2 (size of the table) before including this, use:
+//   dt_bins_init(); barrier();
+//   if(!dt_bins_add(key, w)) imageAtomicAdd(..global bin of key.., w);
+//   barrier();
+//   for(uint i=gl_LocalInvocationIndex;i<DT_BINS_SIZE;i+=nth)
+//     if(dt_bins_cnt[i] > 0) imageAtomicAdd(..global bin of dt_bins_key[i].., dt_bins_cnt[i]);
+#ifndef DT_BINS_LOG2
+#define DT_BINS_LOG2 9
+#endif
+#define DT_BINS_SIZE (1u<<DT_BINS_LOG2)
+#define DT_BINS_PROBES 4
+#define DT_BINS_EMPTY 0xffffffffu
+
+shared uint dt_bins_key[DT_BINS_SIZE];
+shared uint dt_bins_cnt[DT_BINS_SIZE];
+
+void
+dt_bins_init()
+{
+  const uint nth = gl_WorkGroupSize.x*gl_WorkGroupSize.y*gl_WorkGroupSize.z;
+  for(uint i=gl_LocalInvocationIndex;i<DT_BINS_SIZE;i+=nth)
+  {
+    dt_bins_key[i] = DT_BINS_EMPTY;
+    dt_bins_cnt[i] = 0;
+  }
+}
+
+bool // false if the table is too crowded around the key
+dt_bins_add(uint key, uint w)
+{
+  const uint h = (key * 2654435761u) >> (32 - DT_BINS_LOG2);
+  for(uint p=0;p<DT_BINS_PROBES;p++)
+  {
+    const uint slot = (h + p) & (DT_BINS_SIZE-1);
+    const uint old = atomicCompSwap(dt_bins_key[slot], DT_BINS_EMPTY, key);
+    if(old == DT_BINS_EMPTY || old == key)
+    {
+      atomicAdd(dt_bins_cnt[slot], w);
+      return true;
+    }
+  }
+  return false;
+}
+
+// stochastic subsampling: one pixel at a random (but fixed) position in every
+// block of stride x stride pixels, to be counted stride^2 times. unlike a
+// regular grid this does not alias with patterns in the image.
+ivec2
+dt_bins_jitter(ivec2 block, int stride)
+{
+  uint h = uint(block.x) * 0x8da6b343u ^ uint(block.y) * 0xd8163841u;
+  h ^= h >> 16; h *= 0x7feb352du; h ^= h >> 15;
+  return block * stride + ivec2(h % stride, (h >> 16) % stride);
+}
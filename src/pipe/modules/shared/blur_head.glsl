@@ -14,3 +14,7 @@ layout(push_constant, std140) uniform push_t
 {
   float radius;
 } push;
+
+// largest footprint of the shared memory separable kernels blurth/blurtv,
+// larger radii take another path. keep in sync with DT_API_BLUR_SEP_MAX in api.h.
+#define DT_BLUR_SEP_MAX 16
@@ -1,3 +1,17 @@
 pipe/modules/shared/resample.comp.spv:pipe/modules/shared.glsl
 pipe/modules/shared/blur.comp.spv:pipe/modules/shared.glsl
 
+pipe/modules/shared/yuv.comp.spv:pipe/modules/shared.glsl
+pipe/modules/shared/blurh.comp.spv:pipe/modules/shared/blur_head.glsl
+pipe/modules/shared/blurv.comp.spv:pipe/modules/shared/blur_head.glsl
+pipe/modules/shared/blurth.comp.spv:pipe/modules/shared/blur_head.glsl
+pipe/modules/shared/blurtv.comp.spv:pipe/modules/shared/blur_head.glsl
+pipe/modules/shared/iir.comp.spv:pipe/modules/shared.glsl
+SPV_PENDING+=pipe/modules/shared/blurth.comp.spv pipe/modules/shared/blurtv.comp.spv pipe/modules/shared/iir.comp.spv
+pipe/modules/shared/box.comp.spv:pipe/modules/shared.glsl
+pipe/modules/shared/fuse.comp.spv:pipe/modules/exposure/pointwise.glsl pipe/modules/grade/pointwise.glsl pipe/modules/vignette/pointwise.glsl pipe/modules/f2srgb/pointwise.glsl
+SPV_PENDING+=pipe/modules/shared/fuse.comp.spv
+pipe/modules/shared/down.comp.spv:pipe/modules/shared.glsl
+pipe/modules/shared/pull.comp.spv:pipe/modules/shared.glsl
+pipe/modules/shared/push.comp.spv:pipe/modules/shared.glsl
+pipe/modules/shared/warp.comp.spv:pipe/modules/shared.glsl
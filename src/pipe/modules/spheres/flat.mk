@@ -0,0 +1,2 @@
+pipe/modules/spheres/main.comp.spv: pipe/modules/spheres/scene.glsl
+pipe/modules/spheres/scene.comp.spv: pipe/modules/spheres/scene.glsl
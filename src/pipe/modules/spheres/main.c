@@ -0,0 +1,19 @@
+#include "modules/api.h"
+
+#define SCENE_N 64 // keep in sync with scene.glsl
+
+void
+create_nodes(
+    dt_graph_t  *graph,
+    dt_module_t *module)
+{ // one pass to animate and cull the scene, one to trace the pixels
+  dt_roi_t sroi = (dt_roi_t){ .wd = 4*4, .ht = 1 + SCENE_N*SCENE_N }; // header + one instance per cell
+  const int id_scene = dt_node_add(graph, module, "spheres", "scene", SCENE_N, SCENE_N, 1, 0, 0, 1,
+      "scene",  "write", "ssbo", "f32", &sroi);
+  const int id_main = dt_node_add(graph, module, "spheres", "main",
+      module->connector[0].roi.wd, module->connector[0].roi.ht, 1, 0, 0, 2,
+      "scene",  "read",  "ssbo", "f32",  -1ul,
+      "output", "write", "rgba", "f16",  &module->connector[0].roi);
+  dt_node_connect(graph, id_scene, 0, id_main, 0);
+  dt_connector_copy(graph, module, 0, id_main, 1);
+}
@@ -0,0 +1,30 @@
+// scene description shared by the scene and main kernels. the spheres live in
+// a grid of cells around the camera, one instance per cell with its two
+// spheres and their colours, preceded by the camera frame:
+//   v[0] = camera position, w: x of the first cell of the window
+//   v[1] = camera right,    w: z of the first cell of the window
+//   v[2] = camera up,       v[3] = camera forward
+//   v[4+4*i+{0,1}] = centres of the spheres, w = 0 if the cell is culled
+//   v[4+4*i+{2,3}] = colours of the spheres
+#define SCENE_N 64 // cells per side of the window, needs to cover MAXDISTANCE
+#define SCENE_HEADER 4
+
+#define EPSILON 0.001
+#define MAXDISTANCE 180.
+#define GRIDSIZE 8.
+#define GRIDSIZESMALL 5.9
+#define MAXHEIGHT 30.
+#define SPEED 0.5
+
+float hash( const float n ) {
+	return fract(sin(n)*43758.54554213);
+}
+vec2 hash2( const float n ) {
+	return fract(sin(vec2(n,n+1.))*vec2(43758.5453123));
+}
+vec2 hash2( const vec2 n ) {
+	return fract(sin(vec2( n.x*n.y, n.x+n.y))*vec2(25.1459123,312.3490423));
+}
+vec3 hash3( const vec2 n ) {
+	return fract(sin(vec3(n.x, n.y, n+2.0))*vec3(36.5453123,43.1459123,11234.3490423));
+}
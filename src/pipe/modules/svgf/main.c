@@ -52,11 +52,11 @@ create_nodes(
       .format = dt_token("f32"),
       .roi    = module->connector[0].roi,
       .connected_mi = -1,
-    },{ // 5
+    },{ // 5, also the history for the next frame, f16 is plenty for irradiance
       .name   = dt_token("output"),
       .type   = dt_token("write"),
       .chan   = dt_token("rgba"),
-      .format = dt_token("f32"),
+      .format = dt_token("f16"),
       .roi    = module->connector[0].roi,
     }},
   };
@@ -100,11 +100,11 @@ create_nodes(
       .format = dt_token("*"),
       .roi    = module->connector[0].roi,
       .connected_mi = -1,
-    },{ // 4
+    },{ // 4, also the taa history for the next frame
       .name   = dt_token("output"),
       .type   = dt_token("write"),
       .chan   = dt_token("rgba"),
-      .format = dt_token("f32"),
+      .format = dt_token("f16"),
       .roi    = module->connector[0].roi,
     }},
   };
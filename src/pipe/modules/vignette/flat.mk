@@ -0,0 +1 @@
+pipe/modules/vignette/main.comp.spv: pipe/modules/vignette/pointwise.glsl
@@ -0,0 +1,10 @@
+#include "modules/api.h"
+
+// no falloff in either direction leaves the image as it is
+int
+identity(dt_module_t *module)
+{
+  const float *c0 = dt_module_param_float(module, dt_module_get_param(module->so, dt_token("coef0")));
+  const float *c1 = dt_module_param_float(module, dt_module_get_param(module->so, dt_token("coef1")));
+  return c0[0] == 0.0f && c0[1] == 0.0f && c1[0] == 0.0f && c1[1] == 0.0f;
+}
@@ -0,0 +1,37 @@
+// per-pixel body, shared with the fused kernel in shared/fuse.comp
+float
+vignette_poly(vec2 c, float x)
+{
+  float x2 = x*x, x4 = x2*x2;
+  return - c.x * x2 - c.y * x4;
+}
+
+float
+vignette_sigmoid(float x)
+{
+  return exp(x);
+  // return 0.5 * x / sqrt(1.0 + x * x) + 0.5;
+}
+
+// evaluates the vignetting function at a point x
+// given the parameters p
+float
+vignette(vec2 x, vec2 center, vec2 cx, vec2 cy, float angle)
+{
+  x -= center; // subtract center
+  const float sa = sin(radians(angle)), ca = cos(radians(angle));
+  mat2 rot = mat2(ca, sa, -sa, ca);
+  x = rot * x;
+  // separable sigmoid of polynomial/attenuation factor in both dimensions
+  float ax = vignette_sigmoid(vignette_poly(cx, x.x));
+  float ay = vignette_sigmoid(vignette_poly(cy, x.y));
+  return ax * ay;
+}
+
+vec3
+vignette_pointwise(vec3 rgb, ivec2 ipos, ivec2 size, vec2 center, vec2 cx, vec2 cy, float angle)
+{
+  vec2 tc = 2.0 * (ipos + 0.5)/size - 1.0;
+  tc.y *= size.y/float(size.x);
+  return rgb * vignette(tc, center, cx, cy, angle);
+}
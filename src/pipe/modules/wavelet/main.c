@@ -8,6 +8,7 @@ create_nodes(
 {
   const int wd = module->connector[0].roi.wd;
   const int ht = module->connector[0].roi.ht;
+  const dt_token_t fmt = dt_token(dt_api_precision(graph));
 
   // wire 4 scales of downsample + assembly node
   int id_down[4] = {0};
@@ -28,14 +29,14 @@ create_nodes(
         .name   = dt_token("input"),
         .type   = dt_token("read"),
         .chan   = dt_token("rgba"),
-        .format = dt_token("f16"),
+        .format = fmt,
         .roi    = module->connector[0].roi,
         .connected_mi = -1,
       },{
         .name   = dt_token("output"),
         .type   = dt_token("write"),
         .chan   = dt_token("rgba"),
-        .format = dt_token("f16"),
+        .format = fmt,
         .roi    = module->connector[0].roi,
       }},
     };
@@ -59,49 +60,49 @@ create_nodes(
       .name   = dt_token("s0"),
       .type   = dt_token("read"),
       .chan   = dt_token("rgba"),
-      .format = dt_token("f16"),
+      .format = fmt,
       .roi    = module->connector[0].roi,
       .connected_mi = -1,
     },{
       .name   = dt_token("s1"),
       .type   = dt_token("read"),
       .chan   = dt_token("rgba"),
-      .format = dt_token("f16"),
+      .format = fmt,
       .roi    = module->connector[0].roi,
       .connected_mi = -1,
     },{
       .name   = dt_token("s2"),
       .type   = dt_token("read"),
       .chan   = dt_token("rgba"),
-      .format = dt_token("f16"),
+      .format = fmt,
       .roi    = module->connector[0].roi,
       .connected_mi = -1,
     },{
       .name   = dt_token("s3"),
       .type   = dt_token("read"),
       .chan   = dt_token("rgba"),
-      .format = dt_token("f16"),
+      .format = fmt,
       .roi    = module->connector[0].roi,
       .connected_mi = -1,
     },{
       .name   = dt_token("s4"),
       .type   = dt_token("read"),
       .chan   = dt_token("rgba"),
-      .format = dt_token("f16"),
+      .format = fmt,
       .roi    = module->connector[0].roi,
       .connected_mi = -1,
     },{
       .name   = dt_token("mask"),
       .type   = dt_token("read"),
       .chan   = dt_token("y"),
-      .format = dt_token("f16"),
+      .format = fmt,
       .roi    = module->connector[0].roi,
       .connected_mi = -1,
     },{
       .name   = dt_token("output"),
       .type   = dt_token("write"),
       .chan   = dt_token("rgba"),
-      .format = dt_token("f16"),
+      .format = fmt,
       .roi    = module->connector[0].roi,
     }},
   };
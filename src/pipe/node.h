@@ -29,18 +29,34 @@ typedef struct dt_node_t
 
   VkPipeline            pipeline;
   VkPipelineLayout      pipeline_layout;
-  VkDescriptorSet       uniform_dset[DT_GRAPH_MAX_FRAMES]; // uniform data is const per frame
+  VkDescriptorSet       uniform_dset[DT_GRAPH_MAX_RING];   // uniform data is const per command buffer
   VkDescriptorSet       dset[DT_GRAPH_MAX_FRAMES];         // one descriptor set for every frame
   VkDescriptorSetLayout dset_layout;                       // they all share the same layout
+  int                   push_dset;                         // descriptors are pushed during recording, dset[] is unused
 
   VkRenderPass          draw_render_pass; // needed for raster kernels
   VkFramebuffer         draw_framebuffer; // 
+  uint32_t              draw_beg;         // raster kernels with protected output: first vertex to draw, the rest is kept
+  int32_t               draw_area[4];     // render area x, y, wd, ht of the vertices from draw_beg on
+  uint32_t              draw_beg_rec;     // draw_beg as it is being recorded, 0 if drawing from scratch
+  int32_t               dirty_support;    // 1 + radius of input pixels read per output pixel if dirty regions are supported, else 0
+  int32_t               dirty_rect[4];    // region x, y, wd, ht of the outputs written in this run, wd == 0 if unchanged
+  int32_t               need_rect[4];     // region x, y, wd, ht of the outputs read by the nodes downstream in this run
+  uint32_t              local_size[2];    // work group size of compute kernels, see dt_pipe_localsize()
+  int32_t               dispatch_indirect; // 1 + storage buffer input holding the work group count, see dt_api_dispatch_indirect()
+  uint32_t              spec_cnt;         // specialisation constants the pipeline was created with, see dt_pipe_shader_spec()
+  uint32_t              spec_id[DT_PIPE_MAX_SPEC];
+  uint32_t              spec[DT_PIPE_MAX_SPEC];   // parameter values, int or float bits
+  uint32_t              level;            // nodes of one level run without barriers in between, see graph-barrier.h
+  int                   async;            // runs on the side queue, see graph-async.h
 
   dt_raytrace_node_t    rt[2];
 
   dt_node_type_t        type;             // indicates whether we need a render pass and framebuffer
 
   dt_module_flags_t     flags;            // fine grained request for source/sink reading
+  int                   srccache;         // 1 + index into graph->srccache if this source is cached, else 0
+  int                   modcache;         // 1 + index into graph->modcache if the module output written here is cached, else 0
 
   uint32_t wd, ht, dp;  // dimensions of kernel to be run
 
@@ -8,16 +8,26 @@ int dt_raytrace_present(dt_graph_t *graph)
   return qvk.raytracing_supported && (graph->rt[graph->frame%2].nid_cnt > 0);
 }
 
+int dt_raytrace_compact_pending(dt_graph_t *graph)
+{
+  return qvk.raytracing_supported && (graph->rt[graph->frame%2].compact_cnt > 0);
+}
+
 void dt_raytrace_graph_reset(dt_graph_t *graph)
 {
-  graph->rt[0].nid_cnt = 0;
-  graph->rt[0].staging_memory_type_bits = -1u;
-  graph->rt[0].scratch_memory_type_bits = -1u;
-  graph->rt[0].accel_memory_type_bits   = -1u;
-  graph->rt[1].nid_cnt = 0;
-  graph->rt[1].staging_memory_type_bits = -1u;
-  graph->rt[1].scratch_memory_type_bits = -1u;
-  graph->rt[1].accel_memory_type_bits   = -1u;
+  for(int f=0;f<2;f++)
+  {
+    graph->rt[f].nid_cnt = 0;
+    graph->rt[f].compact_cnt = 0;
+    graph->rt[f].staging_memory_type_bits   = -1u;
+    graph->rt[f].scratch_memory_type_bits   = -1u;
+    graph->rt[f].accel_memory_type_bits     = -1u;
+    graph->rt[f].accel_stc_memory_type_bits = -1u;
+    graph->rt[f].scratch_end   = 0;
+    graph->rt[f].staging_end   = 0;
+    graph->rt[f].accel_end     = 0;
+    graph->rt[f].accel_stc_end = 0;
+  }
 }
 
 void
@@ -53,11 +63,13 @@ dt_raytrace_graph_cleanup(
       qvkDestroyAccelerationStructureKHR(qvk.device, graph->rt[f].accel, VK_NULL_HANDLE);
     }
     if(graph->rt[f].buf_accel)     vkDestroyBuffer(qvk.device, graph->rt[f].buf_accel,   VK_NULL_HANDLE);
-    if(graph->rt[f].buf_scratch)   vkDestroyBuffer(qvk.device, graph->rt[f].buf_scratch, VK_NULL_HANDLE);
-    if(graph->rt[f].buf_staging)   vkDestroyBuffer(qvk.device, graph->rt[f].buf_staging, VK_NULL_HANDLE);
-    if(graph->rt[f].vkmem_scratch) vkFreeMemory   (qvk.device, graph->rt[f].vkmem_scratch, 0);
-    if(graph->rt[f].vkmem_staging) vkFreeMemory   (qvk.device, graph->rt[f].vkmem_staging, 0);
-    if(graph->rt[f].vkmem_accel)   vkFreeMemory   (qvk.device, graph->rt[f].vkmem_accel,   0);
+    if(graph->rt[f].buf_scratch)     vkDestroyBuffer(qvk.device, graph->rt[f].buf_scratch, VK_NULL_HANDLE);
+    if(graph->rt[f].buf_staging)     vkDestroyBuffer(qvk.device, graph->rt[f].buf_staging, VK_NULL_HANDLE);
+    if(graph->rt[f].vkmem_staging)   vkFreeMemory   (qvk.device, graph->rt[f].vkmem_staging,   0);
+    if(graph->rt[f].vkmem_accel)     vkFreeMemory   (qvk.device, graph->rt[f].vkmem_accel,     0);
+    if(graph->rt[f].vkmem_accel_stc) vkFreeMemory   (qvk.device, graph->rt[f].vkmem_accel_stc, 0);
+    if(graph->rt[f].vkmem_compact)   vkFreeMemory   (qvk.device, graph->rt[f].vkmem_compact,   0);
+    if(graph->rt[f].query_pool)      vkDestroyQueryPool(qvk.device, graph->rt[f].query_pool, 0);
     if(graph->rt[f].dset_layout)   vkDestroyDescriptorSetLayout(qvk.device, graph->rt[f].dset_layout, 0);
     memset(&graph->rt[f], 0, sizeof(graph->rt[f]));
   }
@@ -87,6 +99,8 @@ dt_raytrace_graph_cleanup(
     VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT)
 #define CREATE_ACCEL_BUF_R(SZ, BUF) CREATE_BUF_R(accel, SZ, BUF,\
     VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_SHADER_BINDING_TABLE_BIT_KHR | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR)
+#define CREATE_ACCEL_STC_BUF_R(SZ, BUF) CREATE_BUF_R(accel_stc, SZ, BUF,\
+    VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR)
     // VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR)
 
 #define ALLOC_MEM_R(TYPE, BITS, memory_allocate_flags) do { \
@@ -94,6 +108,7 @@ dt_raytrace_graph_cleanup(
     if(graph->rt[f].vkmem_##TYPE ) {\
       QVKLR(&qvk.queue_mutex, vkDeviceWaitIdle(qvk.device));\
       vkFreeMemory(qvk.device, graph->rt[f].vkmem_##TYPE, 0);\
+      graph->rt[f].vkmem_##TYPE = 0;\
     }\
     VkMemoryAllocateFlagsInfo allocation_flags = {\
       .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO,\
@@ -146,10 +161,14 @@ dt_raytrace_node_init(
       }},
     // .flags             = VK_GEOMETRY_OPAQUE_BIT_KHR,
   };
+  // static geometry is built once and traced often, dynamic geometry is built
+  // every frame and may be refit instead if only the vertices move
   node->rt[f].build_info = (VkAccelerationStructureBuildGeometryInfoKHR) {
     .sType         = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR,
     .type          = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR,
-    .flags         = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR,
+    .flags         = (node->flags & s_module_geo_dynamic) ?
+      VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_BUILD_BIT_KHR | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR :
+      VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR,
     .mode          = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR,
     .geometryCount = 1,
     .pGeometries   = &node->rt[f].geometry,
@@ -160,8 +179,15 @@ dt_raytrace_node_init(
       &node->rt[f].build_info, &node->rt[f].tri_cnt, &accel_size);
 
   // create scratch buffer and accel struct backing buffer
-  CREATE_SCRATCH_BUF_R(accel_size.buildScratchSize, node->rt[f].buf_scratch);
-  CREATE_ACCEL_BUF_R(accel_size.accelerationStructureSize, node->rt[f].buf_accel);
+  CREATE_SCRATCH_BUF_R(MAX(accel_size.buildScratchSize, accel_size.updateScratchSize), node->rt[f].buf_scratch);
+  node->rt[f].built_vtx_cnt = node->rt[f].built_tri_cnt = 0;
+  node->rt[f].compact_query = node->rt[f].compacted = node->rt[f].rebuild = 0;
+  node->rt[f].accel_size = accel_size.accelerationStructureSize;
+  // static accels live in their own memory, which is released once they are compacted
+  if(node->flags & s_module_geo_dynamic)
+    CREATE_ACCEL_BUF_R(accel_size.accelerationStructureSize, node->rt[f].buf_accel);
+  else
+    CREATE_ACCEL_STC_BUF_R(accel_size.accelerationStructureSize, node->rt[f].buf_accel);
 
   // create acceleration struct
   QVK_LOAD(vkCreateAccelerationStructureKHR);
@@ -243,11 +269,63 @@ dt_raytrace_graph_init(
     if(graph->rt[f].dset_layout) vkDestroyDescriptorSetLayout(qvk.device, graph->rt[f].dset_layout, 0);
     QVKR(vkCreateDescriptorSetLayout(qvk.device, &dset_layout_info, 0, &graph->rt[f].dset_layout));
     for(int i=0;i<graph->rt[f].nid_cnt;i++)
-      dt_raytrace_node_init(graph, graph->node + graph->rt[f].nid[i], f);
+      QVKR(dt_raytrace_node_init(graph, graph->node + graph->rt[f].nid[i], f));
+
+    // get top-level acceleration structure size + scratch mem requirements.
+    // the scratch size needs to be known before the graph plans its ssbo memory.
+    VkAccelerationStructureBuildSizesInfoKHR accel_size = {
+      .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR };
+    graph->rt[f].geometry = (VkAccelerationStructureGeometryKHR) {
+      .sType               = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR,
+      .geometryType        = VK_GEOMETRY_TYPE_INSTANCES_KHR,
+      .geometry            = {
+        .instances         = {
+          .sType           = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR,
+          .arrayOfPointers = VK_FALSE,
+        }},
+      // .flags               = VK_GEOMETRY_OPAQUE_BIT_KHR,
+    };
+    graph->rt[f].build_info = (VkAccelerationStructureBuildGeometryInfoKHR) {
+      .sType         = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR,
+      .type          = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR,
+      .flags         = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR,
+      .mode          = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR,
+      .geometryCount = 1,
+      .pGeometries   = &graph->rt[f].geometry,
+    };
+    QVK_LOAD(vkGetAccelerationStructureBuildSizesKHR);
+    qvkGetAccelerationStructureBuildSizesKHR(
+        qvk.device, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR,
+        &graph->rt[f].build_info, &graph->rt[f].nid_cnt, &accel_size);
+    CREATE_SCRATCH_BUF_R(accel_size.buildScratchSize, graph->rt[f].buf_scratch);
+    graph->rt[f].accel_size = accel_size.accelerationStructureSize;
+
+    VkQueryPoolCreateInfo query_info = {
+      .sType      = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+      .queryType  = VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR,
+      .queryCount = graph->rt[f].nid_cnt,
+    };
+    if(graph->rt[f].query_pool) vkDestroyQueryPool(qvk.device, graph->rt[f].query_pool, 0);
+    QVKR(vkCreateQueryPool(qvk.device, &query_info, 0, &graph->rt[f].query_pool));
   }
   return VK_SUCCESS;
 }
 
+void
+dt_raytrace_graph_plan_scratch(
+    dt_graph_t *graph)
+{
+  if(!qvk.raytracing_supported || graph->rt[0].nid_cnt == 0) return;
+  // the builds of both frames are serialised by a barrier, so they can share the
+  // scratch region. align generously, the offsets of the buffers inside the
+  // region are aligned relative to its start.
+  const uint64_t align = MAX(4096, qvk.raytracing_acc_min_align);
+  const uint64_t offset = (graph->heap_ssbo.vmsize + align-1) & ~(align-1);
+  graph->heap_ssbo.vmsize = offset + MAX(graph->rt[0].scratch_end, graph->rt[1].scratch_end);
+  graph->memory_type_bits_ssbo &= graph->rt[0].scratch_memory_type_bits & graph->rt[1].scratch_memory_type_bits;
+  graph->rt[0].scratch_offset = graph->rt[1].scratch_offset = offset;
+}
+
 // allocates memory, creates and binds rtgeo node buffers too
 VkResult
 dt_raytrace_graph_alloc(
@@ -269,48 +347,33 @@ dt_raytrace_graph_alloc(
     QVKR(vkBindBufferMemory(qvk.device, graph->node[graph->rt[f].nid[i]].rt[f].buf_ext, graph->rt[f].vkmem_staging, graph->node[graph->rt[f].nid[i]].rt[f].buf_ext_offset));
   }
 
-  // get top-level acceleration structure size + scratch mem requirements.
-  VkAccelerationStructureBuildSizesInfoKHR accel_size = {
-    .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR };
-  graph->rt[f].geometry = (VkAccelerationStructureGeometryKHR) {
-    .sType               = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR,
-    .geometryType        = VK_GEOMETRY_TYPE_INSTANCES_KHR,
-    .geometry            = {
-      .instances         = {
-        .sType           = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR,
-        .arrayOfPointers = VK_FALSE,
-      }},
-    // .flags               = VK_GEOMETRY_OPAQUE_BIT_KHR,
-  };
-  graph->rt[f].build_info = (VkAccelerationStructureBuildGeometryInfoKHR) {
-    .sType         = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR,
-    .type          = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR,
-    .flags         = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR,
-    .mode          = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR,
-    .geometryCount = 1,
-    .pGeometries   = &graph->rt[f].geometry,
-  };
-  QVK_LOAD(vkGetAccelerationStructureBuildSizesKHR);
-  qvkGetAccelerationStructureBuildSizesKHR(
-      qvk.device, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR,
-      &graph->rt[f].build_info, &graph->rt[f].nid_cnt, &accel_size);
-
-  CREATE_SCRATCH_BUF_R(accel_size.buildScratchSize, graph->rt[f].buf_scratch);
-  ALLOC_MEM_R(scratch, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT_KHR); // HEAP ?? // VK_MEMORY_HEAP_DEVICE_LOCAL_BIT
-
-  // bind scratch buffers to the allocation
-  QVKR(vkBindBufferMemory(qvk.device, graph->rt[f].buf_scratch, graph->rt[f].vkmem_scratch, graph->rt[f].buf_scratch_offset));
+  // bind scratch buffers to the region reserved in the graph's ssbo memory
+  const size_t scratch = graph->rt[f].scratch_offset;
+  QVKR(vkBindBufferMemory(qvk.device, graph->rt[f].buf_scratch, graph->vkmem_ssbo, scratch + graph->rt[f].buf_scratch_offset));
   for(int i=0;i<graph->rt[f].nid_cnt;i++)
-    QVKR(vkBindBufferMemory(qvk.device, graph->node[graph->rt[f].nid[i]].rt[f].buf_scratch, graph->rt[f].vkmem_scratch, graph->node[graph->rt[f].nid[i]].rt[f].buf_scratch_offset));
+    QVKR(vkBindBufferMemory(qvk.device, graph->node[graph->rt[f].nid[i]].rt[f].buf_scratch, graph->vkmem_ssbo, scratch + graph->node[graph->rt[f].nid[i]].rt[f].buf_scratch_offset));
 
   // create acceleration structure buffer
-  CREATE_ACCEL_BUF_R(accel_size.accelerationStructureSize, graph->rt[f].buf_accel);
+  CREATE_ACCEL_BUF_R(graph->rt[f].accel_size, graph->rt[f].buf_accel);
   ALLOC_MEM_R(accel, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0);
+  if(graph->rt[f].accel_stc_end) ALLOC_MEM_R(accel_stc, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0);
+  if(graph->rt[f].vkmem_compact)
+  { // the compacted accels have been replaced by new ones in dt_raytrace_node_init
+    QVKLR(&qvk.queue_mutex, vkDeviceWaitIdle(qvk.device));
+    vkFreeMemory(qvk.device, graph->rt[f].vkmem_compact, 0);
+    graph->rt[f].vkmem_compact = 0;
+  }
 
   // bind accel buffers to the allocation
   QVKR(vkBindBufferMemory(qvk.device, graph->rt[f].buf_accel, graph->rt[f].vkmem_accel, graph->rt[f].buf_accel_offset));
   for(int i=0;i<graph->rt[f].nid_cnt;i++)
-    QVKR(vkBindBufferMemory(qvk.device, graph->node[graph->rt[f].nid[i]].rt[f].buf_accel, graph->rt[f].vkmem_accel, graph->node[graph->rt[f].nid[i]].rt[f].buf_accel_offset));
+  {
+    dt_node_t *node = graph->node + graph->rt[f].nid[i];
+    if(node->rt[f].tri_cnt == 0) continue;
+    QVKR(vkBindBufferMemory(qvk.device, node->rt[f].buf_accel,
+          (node->flags & s_module_geo_dynamic) ? graph->rt[f].vkmem_accel : graph->rt[f].vkmem_accel_stc,
+          node->rt[f].buf_accel_offset));
+  }
 
   // now create the top-level acceleration structure
   QVK_LOAD(vkCreateAccelerationStructureKHR);
@@ -320,7 +383,7 @@ dt_raytrace_graph_alloc(
     .sType  = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR,
     .buffer = graph->rt[f].buf_accel,
     .offset = 0,
-    .size   = accel_size.accelerationStructureSize,
+    .size   = graph->rt[f].accel_size,
     .type   = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR,
   };
   QVKR(qvkCreateAccelerationStructureKHR(qvk.device, &create_info, NULL, &graph->rt[f].accel));
@@ -395,8 +458,254 @@ dt_raytrace_graph_alloc(
 #undef CREATE_SCRATCH_BUF_R
 #undef CREATE_STAGING_BUF_R
 #undef CREATE_ACCEL_BUF_R
+#undef CREATE_ACCEL_STC_BUF_R
 #undef ALLOC_MEM_R
 
+// fill build info and range for the bottom level accel of the node. refits
+// instead of building from scratch if the geometry only deformed since the
+// last build of the same frame.
+static inline void
+dt_raytrace_node_record_build(
+    dt_node_t                                   *node,
+    const int                                    f,
+    const int                                    deform,
+    VkAccelerationStructureBuildGeometryInfoKHR *build_info,
+    VkAccelerationStructureBuildRangeInfoKHR    *build_range)
+{
+  const int refit = (node->flags & s_module_geo_dynamic) && deform &&
+    node->rt[f].built_vtx_cnt == node->rt[f].vtx_cnt &&
+    node->rt[f].built_tri_cnt == node->rt[f].tri_cnt &&
+    node->rt[f].refit_cnt < DT_RAYTRACE_REFIT_MAX;
+  node->rt[f].refit_cnt     = refit ? node->rt[f].refit_cnt + 1 : 0;
+  node->rt[f].built_vtx_cnt = node->rt[f].vtx_cnt;
+  node->rt[f].built_tri_cnt = node->rt[f].tri_cnt;
+
+  VkBufferDeviceAddressInfo address_info[] = {{
+    .sType  = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+    .buffer = node->rt[f].buf_scratch,
+  },{
+    .sType  = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+    .buffer = node->rt[f].buf_vtx,
+  },{
+    .sType  = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+    .buffer = node->rt[f].buf_idx,
+  }};
+  node->rt[f].build_info.mode = refit ?
+    VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR :
+    VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
+  node->rt[f].build_info.srcAccelerationStructure  = refit ? node->rt[f].accel : VK_NULL_HANDLE;
+  node->rt[f].build_info.dstAccelerationStructure  = node->rt[f].accel;
+  node->rt[f].build_info.scratchData.deviceAddress = vkGetBufferDeviceAddress(qvk.device, address_info+0);
+  node->rt[f].geometry.geometry.triangles = (VkAccelerationStructureGeometryTrianglesDataKHR) {
+    .sType         = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR,
+    .maxVertex     = node->rt[f].vtx_cnt-1,
+    .vertexStride  = 3*sizeof(float),
+    .transformData = {0},
+    .indexType     = VK_INDEX_TYPE_UINT32,
+    .vertexFormat  = VK_FORMAT_R32G32B32_SFLOAT,
+    .vertexData    = { .deviceAddress = vkGetBufferDeviceAddress(qvk.device, address_info+1)},
+    .indexData     = { .deviceAddress = vkGetBufferDeviceAddress(qvk.device, address_info+2)},
+  };
+  *build_range = (VkAccelerationStructureBuildRangeInfoKHR) { .primitiveCount = node->rt[f].tri_cnt };
+  *build_info  = node->rt[f].build_info;
+}
+
+// copy the static bottom level accels of frame f to compacted ones, once the
+// sizes queried after their last build are available and no static node reads
+// geometry any more. returns 1 if accels have been replaced and the top level
+// needs a rebuild.
+static inline int
+dt_raytrace_compact(
+    dt_graph_t *graph,
+    const int   f)
+{
+  dt_raytrace_graph_t *rt = graph->rt + f;
+  if(!rt->compact_cnt || rt->vkmem_compact) return 0;
+  VkDeviceSize *size = alloca(sizeof(VkDeviceSize)*rt->nid_cnt);
+  VkDeviceMemory mem = 0;
+  int cnt = 0;
+  for(int i=0;i<rt->nid_cnt;i++)
+  {
+    dt_node_t *node = graph->node + rt->nid[i];
+    size[i] = 0;
+    if(node->flags & s_module_geo_dynamic) continue;
+    // wait until all static geometry is done
+    if(node->rt[f].force_read_geo || (node->flags & s_module_request_read_geo)) return 0;
+    if(!node->rt[f].compact_query) continue;
+    // don't wait, just check whether a result is there (it may be a stale one)
+    if(vkGetQueryPoolResults(qvk.device, rt->query_pool, i, 1, sizeof(size[i]), size+i,
+          sizeof(size[i]), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) return 0;
+    cnt++;
+  }
+  if(!cnt) return 0;
+
+  // now make sure the results are the ones of the last build and nothing uses the old accels
+  QVKL(&qvk.queue_mutex, vkDeviceWaitIdle(qvk.device));
+  QVK_LOAD(vkCreateAccelerationStructureKHR);
+  QVK_LOAD(vkDestroyAccelerationStructureKHR);
+  QVK_LOAD(vkCmdCopyAccelerationStructureKHR);
+  VkBuffer *buf = alloca(sizeof(VkBuffer)*rt->nid_cnt);
+  memset(buf, 0, sizeof(VkBuffer)*rt->nid_cnt);
+  VkDeviceSize *offset = alloca(sizeof(VkDeviceSize)*rt->nid_cnt);
+  VkDeviceSize end = 0, size_old = rt->accel_stc_end;
+  uint32_t memory_type_bits = -1u;
+  for(int i=0;i<rt->nid_cnt;i++)
+  {
+    if(!size[i]) continue;
+    if(vkGetQueryPoolResults(qvk.device, rt->query_pool, i, 1, sizeof(size[i]), size+i,
+          sizeof(size[i]), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT) != VK_SUCCESS) goto error;
+    VkBufferCreateInfo buf_info = {
+      .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+      .size  = size[i],
+      .usage = VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR,
+    };
+    if(vkCreateBuffer(qvk.device, &buf_info, 0, buf+i) != VK_SUCCESS) goto error;
+    VkMemoryRequirements mr;
+    vkGetBufferMemoryRequirements(qvk.device, buf[i], &mr);
+    memory_type_bits &= mr.memoryTypeBits;
+    mr.alignment = MAX(mr.alignment, qvk.raytracing_acc_min_align);
+    offset[i] = (end + (mr.alignment-1)) & ~(mr.alignment-1);
+    end = offset[i] + mr.size;
+  }
+  VkMemoryAllocateFlagsInfo allocation_flags = {
+    .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO,
+    .flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT,
+  };
+  VkMemoryAllocateInfo mem_alloc_info = {
+    .sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+    .pNext           = &allocation_flags,
+    .allocationSize  = end,
+    .memoryTypeIndex = qvk_get_memory_type(memory_type_bits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT),
+  };
+  if(vkAllocateMemory(qvk.device, &mem_alloc_info, 0, &mem) != VK_SUCCESS) goto error;
+
+  VkCommandBuffer cmd_buf;
+  VkCommandBufferAllocateInfo cmd_buf_info = {
+    .sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+    .commandPool        = graph->command_pool,
+    .level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+    .commandBufferCount = 1,
+  };
+  if(vkAllocateCommandBuffers(qvk.device, &cmd_buf_info, &cmd_buf) != VK_SUCCESS) goto error;
+  VkCommandBufferBeginInfo begin_info = {
+    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+    .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+  };
+  vkBeginCommandBuffer(cmd_buf, &begin_info);
+  VkAccelerationStructureKHR *accel = alloca(sizeof(VkAccelerationStructureKHR)*rt->nid_cnt);
+  for(int i=0;i<rt->nid_cnt;i++)
+  {
+    accel[i] = 0;
+    if(!buf[i]) continue;
+    dt_node_t *node = graph->node + rt->nid[i];
+    vkBindBufferMemory(qvk.device, buf[i], mem, offset[i]);
+    VkAccelerationStructureCreateInfoKHR create_info = {
+      .sType  = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR,
+      .buffer = buf[i],
+      .size   = size[i],
+      .type   = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR,
+    };
+    qvkCreateAccelerationStructureKHR(qvk.device, &create_info, NULL, accel+i);
+    VkCopyAccelerationStructureInfoKHR copy_info = {
+      .sType = VK_STRUCTURE_TYPE_COPY_ACCELERATION_STRUCTURE_INFO_KHR,
+      .src   = node->rt[f].accel,
+      .dst   = accel[i],
+      .mode  = VK_COPY_ACCELERATION_STRUCTURE_MODE_COMPACT_KHR,
+    };
+    qvkCmdCopyAccelerationStructureKHR(cmd_buf, &copy_info);
+  }
+  vkEndCommandBuffer(cmd_buf);
+  VkSubmitInfo submit = {
+    .sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+    .commandBufferCount = 1,
+    .pCommandBuffers    = &cmd_buf,
+  };
+  QVKL(graph->queue_mutex, vkQueueSubmit(graph->queue, 1, &submit, VK_NULL_HANDLE));
+  QVKL(graph->queue_mutex, vkQueueWaitIdle(graph->queue));
+  vkFreeCommandBuffers(qvk.device, graph->command_pool, 1, &cmd_buf);
+
+  for(int i=0;i<rt->nid_cnt;i++)
+  {
+    if(!buf[i]) continue;
+    dt_node_t *node = graph->node + rt->nid[i];
+    qvkDestroyAccelerationStructureKHR(qvk.device, node->rt[f].accel, VK_NULL_HANDLE);
+    vkDestroyBuffer(qvk.device, node->rt[f].buf_accel, 0);
+    node->rt[f].accel     = accel[i];
+    node->rt[f].buf_accel = buf[i];
+    node->rt[f].compacted = 1;
+    node->rt[f].compact_query = 0;
+  }
+  rt->compact_cnt = 0;
+  // static nodes which have not been compacted hold nothing, the memory can go
+  if(rt->vkmem_accel_stc) vkFreeMemory(qvk.device, rt->vkmem_accel_stc, 0);
+  rt->vkmem_accel_stc = 0;
+  rt->accel_stc_max = 0;
+  rt->vkmem_compact = mem;
+  dt_log(s_log_perf, "[rt] compacted %d static accels, %g MB -> %g MB",
+      cnt, size_old/(1024.0*1024.0), end/(1024.0*1024.0));
+  return 1;
+error:
+  for(int i=0;i<rt->nid_cnt;i++) if(buf[i]) vkDestroyBuffer(qvk.device, buf[i], 0);
+  if(mem) vkFreeMemory(qvk.device, mem, 0);
+  dt_log(s_log_err, "[rt] failed to compact static accels!");
+  return 0;
+}
+
+// static geometry is read again after it has been compacted: go back to the
+// full size accels in their own memory and build all of them again from the
+// geometry that is still in the staging buffers.
+static inline VkResult
+dt_raytrace_uncompact(
+    dt_graph_t *graph,
+    const int   f)
+{
+  dt_raytrace_graph_t *rt = graph->rt + f;
+  QVKLR(&qvk.queue_mutex, vkDeviceWaitIdle(qvk.device));
+  QVK_LOAD(vkCreateAccelerationStructureKHR);
+  QVK_LOAD(vkDestroyAccelerationStructureKHR);
+  VkMemoryAllocateFlagsInfo allocation_flags = {
+    .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO,
+    .flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT,
+  };
+  VkMemoryAllocateInfo mem_alloc_info = {
+    .sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+    .pNext           = &allocation_flags,
+    .allocationSize  = rt->accel_stc_end,
+    .memoryTypeIndex = qvk_get_memory_type(rt->accel_stc_memory_type_bits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT),
+  };
+  QVKR(vkAllocateMemory(qvk.device, &mem_alloc_info, 0, &rt->vkmem_accel_stc));
+  rt->accel_stc_max = rt->accel_stc_end;
+  for(int i=0;i<rt->nid_cnt;i++)
+  {
+    dt_node_t *node = graph->node + rt->nid[i];
+    if(!node->rt[f].compacted) continue;
+    qvkDestroyAccelerationStructureKHR(qvk.device, node->rt[f].accel, VK_NULL_HANDLE);
+    vkDestroyBuffer(qvk.device, node->rt[f].buf_accel, 0);
+    node->rt[f].accel = 0;
+    node->rt[f].buf_accel = 0;
+    VkBufferCreateInfo buf_info = {
+      .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+      .size  = node->rt[f].accel_size,
+      .usage = VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR,
+    };
+    QVKR(vkCreateBuffer(qvk.device, &buf_info, 0, &node->rt[f].buf_accel));
+    QVKR(vkBindBufferMemory(qvk.device, node->rt[f].buf_accel, rt->vkmem_accel_stc, node->rt[f].buf_accel_offset));
+    VkAccelerationStructureCreateInfoKHR create_info = {
+      .sType  = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR,
+      .buffer = node->rt[f].buf_accel,
+      .size   = node->rt[f].accel_size,
+      .type   = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR,
+    };
+    QVKR(qvkCreateAccelerationStructureKHR(qvk.device, &create_info, NULL, &node->rt[f].accel));
+    node->rt[f].compacted     = 0;
+    node->rt[f].built_tri_cnt = 0;
+    node->rt[f].rebuild       = 1;
+  }
+  vkFreeMemory(qvk.device, rt->vkmem_compact, 0);
+  rt->vkmem_compact = 0;
+  return VK_SUCCESS;
+}
+
 // call this from graph_run once command buffer is ready:
 VkResult
 dt_raytrace_record_command_buffer_accel_build(
@@ -407,6 +716,19 @@ dt_raytrace_record_command_buffer_accel_build(
   if(!qvk.raytracing_supported || graph->rt[f].nid_cnt == 0) return VK_SUCCESS;
   QVK_LOAD(vkGetAccelerationStructureDeviceAddressKHR);
   QVK_LOAD(vkCmdBuildAccelerationStructuresKHR);
+  QVK_LOAD(vkCmdWriteAccelerationStructuresPropertiesKHR);
+  VkCommandBuffer cmd_buf = graph->command_buffer[graph->ring_slot];
+
+  int tlas_dirty = dt_raytrace_compact(graph, f);
+  for(int i=0;i<graph->rt[f].nid_cnt;i++)
+  {
+    dt_node_t *node = graph->node + graph->rt[f].nid[i];
+    if(node->rt[f].compacted && (node->rt[f].force_read_geo || (node->flags & s_module_request_read_geo)))
+    {
+      QVKR(dt_raytrace_uncompact(graph, f));
+      break;
+    }
+  }
 
   VkAccelerationStructureBuildGeometryInfoKHR *build_info = alloca(sizeof(build_info[0])*graph->rt[f].nid_cnt);
   VkAccelerationStructureBuildRangeInfoKHR *build_range = alloca(sizeof(build_range[0])*graph->rt[f].nid_cnt);
@@ -417,28 +739,49 @@ dt_raytrace_record_command_buffer_accel_build(
   VkAccelerationStructureInstanceKHR *instance =
     (VkAccelerationStructureInstanceKHR *)(mapped_staging + graph->rt[f].buf_staging_offset);
   int rebuild_cnt = 0;
+  uint32_t *query = alloca(sizeof(uint32_t)*graph->rt[f].nid_cnt);
   for(int i=0;i<graph->rt[f].nid_cnt;i++)
   { // check all nodes for ray tracing geometry
     dt_node_t *node = graph->node + graph->rt[f].nid[i];
-    if(!node->rt[f].force_read_geo && !(node->flags & s_module_request_read_geo)) continue;
-    dt_read_geo_params_t p = (dt_read_geo_params_t) {
-      .node   = node,
-      .vtx    = (float    *)(mapped_staging + node->rt[f].buf_vtx_offset),
-      .idx    = (uint32_t *)(mapped_staging + node->rt[f].buf_idx_offset),
-      .ext    = (int16_t  *)(mapped_staging + node->rt[f].buf_ext_offset),
-    };
-    if(node->module->so->read_geo) node->module->so->read_geo(node->module, &p);
-    // flag has been cleared, node says it's done! need to make sure the other frame buffer knows the static geo too!
-    if(!(node->flags & s_module_request_read_geo) && !node->rt[f].force_read_geo) node->rt[fp].force_read_geo = 1;
-    node->rt[f].force_read_geo = 0; // we are done now
-    if(node->rt[f].vtx_cnt == 0) continue;
+    const int read = node->rt[f].force_read_geo || (node->flags & s_module_request_read_geo);
+    if(read || node->rt[f].rebuild)
+    {
+      dt_read_geo_params_t p = (dt_read_geo_params_t) {
+        .node   = node,
+        .vtx    = (float    *)(mapped_staging + node->rt[f].buf_vtx_offset),
+        .idx    = (uint32_t *)(mapped_staging + node->rt[f].buf_idx_offset),
+        .ext    = (int16_t  *)(mapped_staging + node->rt[f].buf_ext_offset),
+      };
+      if(read)
+      {
+        if(node->module->so->read_geo) node->module->so->read_geo(node->module, &p);
+        // flag has been cleared, node says it's done! need to make sure the other frame buffer knows the static geo too!
+        if(!(node->flags & s_module_request_read_geo) && !node->rt[f].force_read_geo) node->rt[fp].force_read_geo = 1;
+        node->rt[f].force_read_geo = 0; // we are done now
+        // the other frame's accel was built from the previous topology, it can't be refit to this one
+        if(!p.deform) node->rt[fp].refit_cnt = DT_RAYTRACE_REFIT_MAX;
+      }
+      node->rt[f].rebuild = 0;
+      if(node->rt[f].vtx_cnt == 0)
+      {
+        node->rt[f].built_vtx_cnt = node->rt[f].built_tri_cnt = 0;
+      }
+      else
+      {
+        const int ii = rebuild_cnt++;
+        dt_raytrace_node_record_build(node, f, p.deform, build_info + ii, build_range + ii);
+        p_build_range[ii] = build_range + ii;
+        if(!(node->flags & s_module_geo_dynamic)) query[ii] = i; // static: query compacted size
+        else query[ii] = -1u;
+      }
+    }
 
+    // the instances of all nodes, the top level accel is built from all of them
     VkAccelerationStructureDeviceAddressInfoKHR address_request = {
       .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR,
       .accelerationStructure = node->rt[f].accel,
     };
-    int ii = rebuild_cnt++;
-    instance[ii] = (VkAccelerationStructureInstanceKHR) {
+    instance[i] = (VkAccelerationStructureInstanceKHR) {
       .transform = { .matrix = {
         {1.0f, 0.0f, 0.0f, 0.0f},
         {0.0f, 1.0f, 0.0f, 0.0f},
@@ -447,57 +790,50 @@ dt_raytrace_record_command_buffer_accel_build(
       .mask  = 0xFF,
       // .flags = // VK_GEOMETRY_INSTANCE_FORCE_OPAQUE_BIT_KHR |
         // VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR,
-      .accelerationStructureReference = qvkGetAccelerationStructureDeviceAddressKHR(qvk.device, &address_request),
-    };
-    VkBufferDeviceAddressInfo address_info[] = {{
-      .sType  = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
-      .buffer = node->rt[f].buf_scratch,
-    },{
-      .sType  = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
-      .buffer = node->rt[f].buf_vtx,
-    },{
-      .sType  = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
-      .buffer = node->rt[f].buf_idx,
-    }};
-    node->rt[f].build_info.dstAccelerationStructure  = node->rt[f].accel;
-    node->rt[f].build_info.scratchData.deviceAddress = vkGetBufferDeviceAddress(qvk.device, address_info+0);
-    node->rt[f].geometry.geometry.triangles = (VkAccelerationStructureGeometryTrianglesDataKHR) {
-      .sType         = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR,
-      .maxVertex     = node->rt[f].vtx_cnt-1,
-      .vertexStride  = 3*sizeof(float),
-      .transformData = {0},
-      .indexType     = VK_INDEX_TYPE_UINT32,
-      .vertexFormat  = VK_FORMAT_R32G32B32_SFLOAT,
-      .vertexData    = { .deviceAddress = vkGetBufferDeviceAddress(qvk.device, address_info+1)},
-      .indexData     = { .deviceAddress = vkGetBufferDeviceAddress(qvk.device, address_info+2)},
+      .accelerationStructureReference = node->rt[f].built_tri_cnt ? // inactive instance if there is nothing
+        qvkGetAccelerationStructureDeviceAddressKHR(qvk.device, &address_request) : 0,
     };
-    build_range  [ii] = (VkAccelerationStructureBuildRangeInfoKHR) { .primitiveCount = node->rt[f].tri_cnt };
-    p_build_range[ii] = build_range + ii;
-    build_info   [ii] = node->rt[f].build_info;
   }
   vkUnmapMemory(qvk.device, graph->rt[f].vkmem_staging);
-  if(!rebuild_cnt) return VK_SUCCESS; // nothing to do, yay
+  if(!rebuild_cnt && !tlas_dirty) return VK_SUCCESS; // nothing to do, yay
+  // the scratch memory is shared with the builds of the other frame, which may
+  // still be running from the previous submission
   VkMemoryBarrier barrier = {
     .sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
-    .srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+    .srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR,
     .dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR,
   };
-  vkCmdPipelineBarrier(graph->command_buffer[f],
-      VK_PIPELINE_STAGE_TRANSFER_BIT,
+  vkCmdPipelineBarrier(cmd_buf,
+      VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
       VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
       0, 1, &barrier, 0, NULL, 0, NULL);
-  qvkCmdBuildAccelerationStructuresKHR(graph->command_buffer[f], rebuild_cnt, build_info, p_build_range);
+  if(rebuild_cnt)
+  {
+    qvkCmdBuildAccelerationStructuresKHR(cmd_buf, rebuild_cnt, build_info, p_build_range);
 
-  // barrier before top level is starting to build
-  barrier = (VkMemoryBarrier){
-    .sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
-    .srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR,
-    .dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR,
-  };
-  vkCmdPipelineBarrier(graph->command_buffer[f],
-      VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
-      VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
-      0, 1, &barrier, 0, NULL, 0, NULL);
+    // barrier before top level is starting to build
+    barrier = (VkMemoryBarrier){
+      .sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+      .srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR,
+      .dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR,
+    };
+    vkCmdPipelineBarrier(cmd_buf,
+        VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+        VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+        0, 1, &barrier, 0, NULL, 0, NULL);
+
+    // query compacted sizes of the static accels, they are compacted once all static geometry is done
+    for(int ii=0;ii<rebuild_cnt;ii++)
+    {
+      if(query[ii] == -1u) continue;
+      dt_node_t *node = graph->node + graph->rt[f].nid[query[ii]];
+      vkCmdResetQueryPool(cmd_buf, graph->rt[f].query_pool, query[ii], 1);
+      qvkCmdWriteAccelerationStructuresPropertiesKHR(cmd_buf, 1, &node->rt[f].accel,
+          VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR, graph->rt[f].query_pool, query[ii]);
+      if(!node->rt[f].compact_query) graph->rt[f].compact_cnt++;
+      node->rt[f].compact_query = 1;
+    }
+  }
 
   // build top level accel
   VkBufferDeviceAddressInfo scratch_adress_info = {
@@ -516,7 +852,8 @@ dt_raytrace_record_command_buffer_accel_build(
     .data            = { .deviceAddress = vkGetBufferDeviceAddress(qvk.device, &index_address) },
   };
   build_range[0] = (VkAccelerationStructureBuildRangeInfoKHR) { .primitiveCount = graph->rt[f].nid_cnt };
-  qvkCmdBuildAccelerationStructuresKHR(graph->command_buffer[f], 1, &graph->rt[f].build_info, p_build_range);
+  p_build_range[0] = build_range;
+  qvkCmdBuildAccelerationStructuresKHR(cmd_buf, 1, &graph->rt[f].build_info, p_build_range);
 
   // push another barrier
   barrier = (VkMemoryBarrier){
@@ -524,7 +861,7 @@ dt_raytrace_record_command_buffer_accel_build(
     .srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR,
     .dstAccessMask = VK_ACCESS_SHADER_READ_BIT
   };
-  vkCmdPipelineBarrier(graph->command_buffer[f],
+  vkCmdPipelineBarrier(cmd_buf,
       VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
       VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
       0, 1, &barrier, 0, NULL, 0, NULL);
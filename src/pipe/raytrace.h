@@ -16,15 +16,22 @@ typedef struct dt_raytrace_graph_t
   off_t                                       buf_staging_offset;
 	VkAccelerationStructureGeometryKHR          geometry;
   VkAccelerationStructureBuildGeometryInfoKHR build_info;
-  VkDeviceMemory                              vkmem_scratch;
+  VkDeviceSize                                accel_size;     // size of the top level accel
   VkDeviceMemory                              vkmem_staging;  // memory for our instance array + all nodes vtx, idx data, ext data
-  VkDeviceMemory                              vkmem_accel;    // memory for our top level accel + all nodes bottom level accel
+  VkDeviceMemory                              vkmem_accel;    // memory for our top level accel + all dynamic nodes bottom level accel
+  VkDeviceMemory                              vkmem_accel_stc;// bottom level accels of static nodes until they are compacted
+  VkDeviceMemory                              vkmem_compact;  // compacted bottom level accels of static nodes
+  VkQueryPool                                 query_pool;     // compacted sizes, one query per node
   uint32_t                                    staging_memory_type_bits;
   uint32_t                                    scratch_memory_type_bits;
   uint32_t                                    accel_memory_type_bits;
-  size_t                                      scratch_end, scratch_max;
-  size_t                                      staging_end, staging_max;
-  size_t                                      accel_end,   accel_max;
+  uint32_t                                    accel_stc_memory_type_bits;
+  size_t                                      scratch_end;    // scratch is shared by both frames, lives in the graph's ssbo memory
+  size_t                                      scratch_offset; // at this offset in vkmem_ssbo
+  size_t                                      staging_end,   staging_max;
+  size_t                                      accel_end,     accel_max;
+  size_t                                      accel_stc_end, accel_stc_max;
+  uint32_t                                    compact_cnt;    // number of nodes with a pending compacted size query
   uint32_t                                   *nid;
   uint32_t                                    nid_cnt, nid_max;
   VkDescriptorSet                             dset;              // one descriptor set for every frame (the whole struct is per frame)
@@ -52,15 +59,31 @@ typedef struct dt_raytrace_node_t
   uint32_t                                    idx_cnt;        // number of indices provided by this node
   uint32_t                                    tri_cnt;        // number of indices provided by this node, i.e. idx_cnt/3
   int                                         force_read_geo; // override for static geo in odd frames
+  uint32_t                                    built_vtx_cnt;  // counts of the last build, zero if the accel holds nothing valid
+  uint32_t                                    built_tri_cnt;
+  uint32_t                                    refit_cnt;      // number of refits since the last full build
+  int                                         compact_query;  // compacted size has been queried after the last build
+  int                                         compacted;      // accel has been compacted, can't be built again in place
+  int                                         rebuild;        // build from the staged geometry without reading it again
+  VkDeviceSize                                accel_size;     // size of the accel before compaction
 }
 dt_raytrace_node_t;
 
+// dynamic geometry is refit at most this many times before it is built again
+// from scratch, refits degrade the quality of the bvh.
+#define DT_RAYTRACE_REFIT_MAX 16
+
 // run this on the graph for first initialisation, after roi_out (read the header of the geo files)
 VkResult dt_raytrace_graph_init(
     dt_graph_t *graph,         // the graph to init ray tracing for
     uint32_t   *nid,           // dead-code eliminated list of nodes to scan for rtgeo
     uint32_t    nid_cnt);
 
+// run this after the graph's buffers have been planned. reserves the scratch
+// memory for the accel builds at the end of the ssbo heap, both frames use the
+// same region.
+void dt_raytrace_graph_plan_scratch(dt_graph_t *graph);
+
 // run this after the nodes have run alloc_outputs, i.e. the dset pool is inited
 VkResult dt_raytrace_graph_alloc(dt_graph_t *graph);
 
@@ -68,6 +91,10 @@ VkResult dt_raytrace_graph_alloc(dt_graph_t *graph);
 // this also calls the read_geo() callback on the geo input nodes.
 VkResult dt_raytrace_record_command_buffer_accel_build(dt_graph_t *graph);
 
+// return 1 if compaction of static bottom level accels is pending, i.e. the
+// accel build needs to be recorded even if no geometry changed.
+int dt_raytrace_compact_pending(dt_graph_t *graph);
+
 // cleans up node resources.
 void dt_raytrace_node_cleanup(dt_node_t *node);
 
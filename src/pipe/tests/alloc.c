@@ -3,10 +3,11 @@
 #include <stdlib.h>
 #include <assert.h>
 
-int main(int argc, char *arg[])
+static void
+test_alloc(dt_vkalloc_type_t type)
 {
   dt_vkalloc_t a;
-  dt_vkalloc_init(&a);
+  dt_vkalloc_init(&a, 100, 1ul<<40, type);
   // alloc a few test things with known outcome
 
   dt_vkmem_t *test[70] = {0};
@@ -22,7 +23,6 @@ int main(int argc, char *arg[])
     err = dt_vkalloc_check(&a);
     assert(!err);
   }
-  // TODO: random order!
   for(int i=0;i<70;i+=2)
   {
     dt_vkfree(&a, test[i]);
@@ -35,7 +35,47 @@ int main(int argc, char *arg[])
     err = dt_vkalloc_check(&a);
     assert(!err);
   }
+  assert(a.rss == 0);
+
+  // random order with alignment and feedback buffers in between:
+  srand(666);
+  dt_vkalloc_nuke(&a);
+  for(int i=0;i<70;i++) test[i] = 0;
+  for(int it=0;it<2000;it++)
+  {
+    const int i = rand() % 70;
+    if(test[i])
+    {
+      dt_vkfree(&a, test[i]);
+      test[i] = 0;
+    }
+    else
+    {
+      uint64_t size = 1 + rand() % 100000;
+      uint64_t align = 1ul << (rand() % 9);
+      if(rand() % 50 == 0) test[i] = dt_vkalloc_feedback(&a, size, align);
+      else                 test[i] = dt_vkalloc(&a, size, align);
+      assert(test[i]);
+      assert(!(test[i]->offset & (align-1)));
+      assert(test[i]->size == size);
+    }
+    err = dt_vkalloc_check(&a);
+    assert(!err);
+  }
+  uint64_t free_bytes, largest_free;
+  dt_vkalloc_stats(&a, &free_bytes, &largest_free);
+  assert(largest_free <= free_bytes);
+  assert(free_bytes + a.rss <= a.vmsize);
+  for(int i=0;i<70;i++) if(test[i]) dt_vkfree(&a, test[i]);
+  assert(!dt_vkalloc_check(&a));
+  assert(a.rss == 0);
 
   dt_vkalloc_cleanup(&a);
+}
+
+int main(int argc, char *arg[])
+{
+  test_alloc(s_vkalloc_linear);
+  test_alloc(s_vkalloc_tlsf);
   exit(0);
 }
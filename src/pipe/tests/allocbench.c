@@ -0,0 +1,211 @@
+#include "../alloc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+
+// replay allocation traces against both allocator flavours and report
+// latency, peak rss vs vmsize and fragmentation. traces are recorded by
+// running vkdt with -d mem, they end up in ~/.cache/vkdt/vkalloc-*.txt. one
+// line per call, blocks are identified by their slot in the recording pool:
+//   a <slot> <size> <alignment>   dt_vkalloc()
+//   b <slot> <size> <alignment>   dt_vkalloc_feedback()
+//   f <slot>                      dt_vkfree() that released the block
+//   n                             dt_vkalloc_nuke()
+// without arguments, a synthetic stress trace is generated and replayed.
+
+#define POOL 40000 // slots, for replay and recording
+
+typedef struct op_t
+{
+  char     op;
+  uint32_t slot;
+  uint64_t size, align;
+}
+op_t;
+
+typedef struct result_t
+{
+  double   alloc_ns, free_ns; // average per call
+  uint64_t peak_rss, vmsize;
+  double   frag;              // worst 1-largest/free seen right after a nuke or at the end
+}
+result_t;
+
+static inline double
+now_ns()
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+static op_t *
+read_trace(const char *filename, int *cnt)
+{
+  FILE *f = fopen(filename, "rb");
+  if(!f) return 0;
+  int max = 1024;
+  op_t *op = malloc(sizeof(op_t)*max);
+  *cnt = 0;
+  char line[256];
+  while(fgets(line, sizeof(line), f))
+  {
+    if(*cnt == max) op = realloc(op, sizeof(op_t)*(max *= 2));
+    op_t *o = op + *cnt;
+    memset(o, 0, sizeof(*o));
+    unsigned long long size = 0, align = 0;
+    if(sscanf(line, "%c %u %llu %llu", &o->op, &o->slot, &size, &align) < 1) continue;
+    if(o->slot >= POOL) continue;
+    o->size = size; o->align = align;
+    if(o->op == 'a' || o->op == 'b' || o->op == 'f' || o->op == 'n') (*cnt)++;
+  }
+  fclose(f);
+  return op;
+}
+
+// graph like pattern: a few images per frame with power of two alignments,
+// some live across frames, the heap is nuked every couple of frames
+static op_t *
+synth_trace(int *cnt)
+{
+  const int max = 400000;
+  op_t *op = malloc(sizeof(op_t)*max);
+  uint8_t *live = calloc(POOL, 1);
+  *cnt = 0;
+  srand(666);
+  for(int frame=0;*cnt<max-2000;frame++)
+  {
+    const int n = 50 + rand() % 500;
+    if(frame % 8 == 0)
+    {
+      op[(*cnt)++] = (op_t){ .op = 'n' };
+      memset(live, 0, POOL);
+    }
+    for(int i=0;i<n && *cnt<max-1;i++)
+    {
+      const uint32_t slot = rand() % 4000;
+      if(live[slot])
+      {
+        op[(*cnt)++] = (op_t){ .op = 'f', .slot = slot };
+        live[slot] = 0;
+      }
+      else
+      {
+        const uint64_t wd = 64 + rand() % 4000, ht = 64 + rand() % 3000;
+        const uint64_t bpp = (rand() % 3 == 0) ? 16 : (rand() % 2 ? 8 : 2);
+        op[(*cnt)++] = (op_t){ .op = rand() % 64 ? 'a' : 'b', .slot = slot,
+          .size = wd * ht * bpp / (rand() % 4 ? 16 : 1), .align = 1ul << (8 + rand() % 9) };
+        live[slot] = 1;
+      }
+    }
+  }
+  free(live);
+  return op;
+}
+
+static void
+stats_frag(dt_vkalloc_t *a, result_t *r)
+{
+  uint64_t free_bytes, largest_free;
+  dt_vkalloc_stats(a, &free_bytes, &largest_free);
+  assert(largest_free <= free_bytes);
+  if(free_bytes)
+  {
+    const double frag = 1.0 - largest_free/(double)free_bytes;
+    if(frag > r->frag) r->frag = frag;
+  }
+}
+
+static result_t
+replay(const op_t *op, int cnt, dt_vkalloc_type_t type, int check)
+{
+  result_t r = {0};
+  dt_vkalloc_t a;
+  dt_vkalloc_init(&a, 3*POOL, 1ul<<40, type);
+  dt_vkmem_t **slot = calloc(POOL, sizeof(dt_vkmem_t *));
+  double t_alloc = 0.0, t_free = 0.0;
+  int n_alloc = 0, n_free = 0;
+  for(int i=0;i<cnt;i++)
+  {
+    const op_t *o = op + i;
+    if(o->op == 'n')
+    {
+      stats_frag(&a, &r);
+      if(a.peak_rss > r.peak_rss) r.peak_rss = a.peak_rss;
+      if(a.vmsize   > r.vmsize)   r.vmsize   = a.vmsize;
+      dt_vkalloc_nuke(&a);
+      memset(slot, 0, POOL*sizeof(dt_vkmem_t *));
+    }
+    else if(o->op == 'f')
+    {
+      if(!slot[o->slot]) continue; // trace started in the middle
+      const double beg = now_ns();
+      dt_vkfree(&a, slot[o->slot]);
+      t_free += now_ns() - beg;
+      n_free++;
+      slot[o->slot] = 0;
+    }
+    else
+    {
+      if(slot[o->slot]) dt_vkfree(&a, slot[o->slot]); // missed a free, don't leak
+      const double beg = now_ns();
+      slot[o->slot] = o->op == 'b' ?
+        dt_vkalloc_feedback(&a, o->size, o->align) :
+        dt_vkalloc(&a, o->size, o->align);
+      t_alloc += now_ns() - beg;
+      n_alloc++;
+      assert(slot[o->slot]);
+      assert(!(slot[o->slot]->offset & (o->align-1)));
+    }
+    if(check && (i % 1000) == 0) assert(!dt_vkalloc_check(&a));
+  }
+  stats_frag(&a, &r);
+  if(a.peak_rss > r.peak_rss) r.peak_rss = a.peak_rss;
+  if(a.vmsize   > r.vmsize)   r.vmsize   = a.vmsize;
+  assert(!dt_vkalloc_check(&a));
+  r.alloc_ns = n_alloc ? t_alloc / n_alloc : 0.0;
+  r.free_ns  = n_free  ? t_free  / n_free  : 0.0;
+  free(slot);
+  dt_vkalloc_cleanup(&a);
+  return r;
+}
+
+static void
+report(const char *name, const op_t *op, int cnt)
+{
+  const char *tname[] = {"linear", "tlsf"};
+  for(int t=0;t<2;t++)
+  {
+    result_t r = replay(op, cnt, t, 1); // consistency under stress
+    r = replay(op, cnt, t, 0);          // timing without the checks
+    printf("%-40s %-7s %8d ops %9.1f ns/alloc %9.1f ns/free  peak rss %9.1f MB  vmsize %9.1f MB (%5.1f%%)  frag %5.1f%%\n",
+        name, tname[t], cnt, r.alloc_ns, r.free_ns,
+        r.peak_rss/(1024.0*1024.0), r.vmsize/(1024.0*1024.0),
+        r.peak_rss ? 100.0*r.vmsize/r.peak_rss : 0.0, 100.0*r.frag);
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  int cnt = 0;
+  if(argc < 2)
+  {
+    op_t *op = synth_trace(&cnt);
+    report("synthetic", op, cnt);
+    free(op);
+  }
+  for(int i=1;i<argc;i++)
+  {
+    op_t *op = read_trace(argv[i], &cnt);
+    if(!op)
+    {
+      fprintf(stderr, "could not read %s\n", argv[i]);
+      continue;
+    }
+    report(argv[i], op, cnt);
+    free(op);
+  }
+  exit(0);
+}
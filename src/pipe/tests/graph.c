@@ -71,6 +71,8 @@ int main(int argc, char *argv[])
   fprintf(stdout, "}\n");
 
   dt_graph_cleanup(&graph);
+  dt_pipe_shader_cleanup();
+  dt_pipe_staging_cleanup();
   dt_pipe_global_cleanup();
   qvk_cleanup();
   exit(0);
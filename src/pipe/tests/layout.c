@@ -0,0 +1,53 @@
+#include "pipe/graph-layout.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// lay out a random dag and check that edges point right and nothing overlaps
+int main(int argc, char *argv[])
+{
+  const int n = argc > 1 ? atoi(argv[1]) : 200;
+  srand(666);
+  dt_graph_layout_t l;
+  dt_graph_layout_alloc(&l, n, 2*n);
+  for(int v=1;v<n;v++)
+  {
+    for(int k=0;k<1+(rand()%2);k++)
+    { // one or two inputs from earlier vertices
+      l.edge[2*l.num_edges+0] = rand() % v;
+      l.edge[2*l.num_edges+1] = v;
+      l.num_edges++;
+    }
+    l.wd[v] = 1.0f + (rand()%3);
+    l.ht[v] = 1.0f + (rand()%4);
+  }
+  l.skip[n/2] = 1;
+  for(int e=0;e<l.num_edges;e++) // removed vertices don't have edges
+    if(l.edge[2*e] == n/2 || l.edge[2*e+1] == n/2) l.edge[2*e] = l.edge[2*e+1] = 0;
+  dt_graph_layout_run(&l);
+
+  int err = 0;
+  for(int e=0;e<l.num_edges;e++)
+  {
+    const int s = l.edge[2*e], d = l.edge[2*e+1];
+    if(s == d) continue;
+    if(l.x[d] < l.x[s] + l.wd[s])
+    {
+      fprintf(stderr, "edge %d -> %d points left\n", s, d);
+      err = 1;
+    }
+  }
+  for(int a=0;a<n;a++) for(int b=a+1;b<n;b++)
+  {
+    if(l.skip[a] || l.skip[b]) continue;
+    if(l.x[a] != l.x[b]) continue;
+    if(l.y[a] < l.y[b] + l.ht[b] && l.y[b] < l.y[a] + l.ht[a])
+    {
+      fprintf(stderr, "vertices %d and %d overlap\n", a, b);
+      err = 1;
+    }
+  }
+  dt_graph_layout_cleanup(&l);
+  if(!err) fprintf(stdout, "layout of %d vertices ok\n", n);
+  exit(err);
+}
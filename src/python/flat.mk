@@ -0,0 +1,3 @@
+PY_O=python/vkdt.o
+PY_CFLAGS=$(shell python3-config --includes 2>/dev/null)
+PY_LDFLAGS=
@@ -0,0 +1,373 @@
+// python bindings for the public api in lib/api.h.
+//
+//   import vkdt, numpy
+//   vkdt.init()
+//   g = vkdt.Graph("image.raw.cfg")
+//   job = g.submit()           # returns right away
+//   job.wait()
+//   img = numpy.asarray(job)   # zero copy view of the mapped output, h x w x 4
+//
+// the view stays valid as long as it is referenced, but its contents are
+// overwritten by the next job submitted to the same graph.
+//
+// graphs with an i-mem source take their input from the host:
+//   g = vkdt.Graph("mem.cfg")
+//   numpy.asarray(g.input(w, h))[:] = tensor  # write into the staging memory
+//   job = g.submit()
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include "lib/api.h"
+
+typedef struct
+{
+  PyObject_HEAD
+  vkdt_graph_t *graph;
+}
+py_graph_t;
+
+typedef struct
+{
+  PyObject_HEAD
+  vkdt_job_t *job;
+  PyObject   *graph;    // keep the graph alive while we are
+  Py_ssize_t  shape[3], strides[3];
+}
+py_job_t;
+
+typedef struct
+{
+  PyObject_HEAD
+  PyObject   *graph;
+  void       *px;
+  Py_ssize_t  shape[3], strides[3], len;
+  char        format[2];
+}
+py_input_t;
+
+static PyTypeObject py_job_type, py_input_type;
+
+// fill shape and strides of an h x w x c view
+static Py_ssize_t
+py_image_layout(const vkdt_image_t *img, Py_ssize_t *shape, Py_ssize_t *strides)
+{
+  shape[0]   = img->height;
+  shape[1]   = img->width;
+  shape[2]   = img->channels;
+  strides[0] = img->stride;
+  strides[1] = img->channels * img->bytes;
+  strides[2] = img->bytes;
+  return img->stride * img->height;
+}
+
+static const char *
+py_image_format(const vkdt_image_t *img)
+{
+  return !strcmp(img->format, "f32") ? "f" : !strcmp(img->format, "f16") ? "e" :
+         !strcmp(img->format, "ui16") ? "H" : "B";
+}
+
+static int
+py_graph_init(py_graph_t *self, PyObject *args, PyObject *kw)
+{
+  const char *cfg = 0;
+  if(!PyArg_ParseTuple(args, "|s", &cfg)) return -1;
+  self->graph = vkdt_graph_create();
+  if(cfg && vkdt_graph_load(self->graph, cfg))
+  {
+    PyErr_Format(PyExc_IOError, "could not load %s", cfg);
+    return -1;
+  }
+  return 0;
+}
+
+static void
+py_graph_dealloc(py_graph_t *self)
+{
+  vkdt_graph_destroy(self->graph);
+  Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static PyObject *
+py_graph_load(py_graph_t *self, PyObject *args)
+{
+  const char *cfg;
+  if(!PyArg_ParseTuple(args, "s", &cfg)) return 0;
+  if(vkdt_graph_load(self->graph, cfg)) return PyErr_Format(PyExc_IOError, "could not load %s", cfg);
+  Py_RETURN_NONE;
+}
+
+static PyObject *
+py_graph_set(py_graph_t *self, PyObject *args)
+{
+  const char *line;
+  if(!PyArg_ParseTuple(args, "s", &line)) return 0;
+  if(vkdt_graph_set_line(self->graph, line)) return PyErr_Format(PyExc_ValueError, "could not apply '%s'", line);
+  Py_RETURN_NONE;
+}
+
+static PyObject *
+py_graph_set_param(py_graph_t *self, PyObject *args)
+{
+  const char *mod, *inst, *param;
+  PyObject *val;
+  if(!PyArg_ParseTuple(args, "sssO", &mod, &inst, &param, &val)) return 0;
+  float f[64];
+  int cnt = 0;
+  PyObject *seq = PySequence_Check(val) ? PySequence_Fast(val, "expected floats") : 0;
+  if(seq)
+  {
+    cnt = PySequence_Fast_GET_SIZE(seq);
+    if(cnt > 64) cnt = 64;
+    for(int i=0;i<cnt;i++) f[i] = PyFloat_AsDouble(PySequence_Fast_GET_ITEM(seq, i));
+    Py_DECREF(seq);
+  }
+  else f[cnt++] = PyFloat_AsDouble(val);
+  if(PyErr_Occurred()) return 0;
+  if(vkdt_graph_set_param_float(self->graph, mod, inst, param, f, cnt))
+    return PyErr_Format(PyExc_ValueError, "no float parameter %s:%s:%s", mod, inst, param);
+  Py_RETURN_NONE;
+}
+
+static PyObject *
+py_graph_set_max_size(py_graph_t *self, PyObject *args)
+{
+  int wd, ht;
+  if(!PyArg_ParseTuple(args, "ii", &wd, &ht)) return 0;
+  vkdt_graph_set_max_size(self->graph, wd, ht);
+  Py_RETURN_NONE;
+}
+
+static PyObject *
+py_graph_submit(py_graph_t *self, PyObject *unused)
+{
+  vkdt_job_t *job;
+  Py_BEGIN_ALLOW_THREADS // may wait for the previous job
+  job = vkdt_graph_submit(self->graph);
+  Py_END_ALLOW_THREADS
+  if(!job) return PyErr_Format(PyExc_RuntimeError, "graph has no output");
+  py_job_t *res = PyObject_New(py_job_t, &py_job_type);
+  res->job   = job;
+  res->graph = (PyObject *)self;
+  Py_INCREF(self);
+  return (PyObject *)res;
+}
+
+static PyObject *
+py_graph_input(py_graph_t *self, PyObject *args)
+{
+  int wd, ht;
+  const char *inst = 0;
+  if(!PyArg_ParseTuple(args, "ii|s", &wd, &ht, &inst)) return 0;
+  vkdt_image_t img;
+  void *px;
+  Py_BEGIN_ALLOW_THREADS // may wait for the previous job and allocate
+  px = vkdt_graph_map_input(self->graph, inst, wd, ht, &img);
+  Py_END_ALLOW_THREADS
+  if(!px) return PyErr_Format(PyExc_RuntimeError, "graph has no i-mem:%s input", inst ? inst : "main");
+  py_input_t *res = PyObject_New(py_input_t, &py_input_type);
+  res->px  = px;
+  res->len = py_image_layout(&img, res->shape, res->strides);
+  snprintf(res->format, sizeof(res->format), "%s", py_image_format(&img));
+  res->graph = (PyObject *)self;
+  Py_INCREF(self);
+  return (PyObject *)res;
+}
+
+static PyMethodDef py_graph_methods[] = {
+  {"load",         (PyCFunction)py_graph_load,         METH_VARARGS, "load(cfg): read a graph cfg or an image"},
+  {"set",          (PyCFunction)py_graph_set,          METH_VARARGS, "set(line): apply one cfg line"},
+  {"set_param",    (PyCFunction)py_graph_set_param,    METH_VARARGS, "set_param(module, instance, param, value(s)): set float parameter"},
+  {"set_max_size", (PyCFunction)py_graph_set_max_size, METH_VARARGS, "set_max_size(width, height): bound the output size"},
+  {"input",        (PyCFunction)py_graph_input,        METH_VARARGS, "input(width, height[, instance]): writable view of the i-mem staging memory"},
+  {"submit",       (PyCFunction)py_graph_submit,       METH_NOARGS,  "submit(): process the graph asynchronously, returns a Job"},
+  {0}
+};
+
+static PyTypeObject py_graph_type = {
+  PyVarObject_HEAD_INIT(0, 0)
+  .tp_name      = "vkdt.Graph",
+  .tp_basicsize = sizeof(py_graph_t),
+  .tp_flags     = Py_TPFLAGS_DEFAULT,
+  .tp_doc       = "Graph([cfg]): a processing graph",
+  .tp_new       = PyType_GenericNew,
+  .tp_init      = (initproc)py_graph_init,
+  .tp_dealloc   = (destructor)py_graph_dealloc,
+  .tp_methods   = py_graph_methods,
+};
+
+static void
+py_job_dealloc(py_job_t *self)
+{
+  Py_BEGIN_ALLOW_THREADS
+  vkdt_job_release(self->job);
+  Py_END_ALLOW_THREADS
+  Py_DECREF(self->graph);
+  Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static PyObject *
+py_job_poll(py_job_t *self, PyObject *unused)
+{
+  const int res = vkdt_job_poll(self->job);
+  if(res < 0) return PyErr_Format(PyExc_RuntimeError, "job failed");
+  return PyBool_FromLong(res);
+}
+
+static PyObject *
+py_job_wait(py_job_t *self, PyObject *unused)
+{
+  int res;
+  Py_BEGIN_ALLOW_THREADS
+  res = vkdt_job_wait(self->job);
+  Py_END_ALLOW_THREADS
+  if(res) return PyErr_Format(PyExc_RuntimeError, "job failed");
+  Py_RETURN_NONE;
+}
+
+static PyMethodDef py_job_methods[] = {
+  {"poll", (PyCFunction)py_job_poll, METH_NOARGS, "poll(): true if the job is done"},
+  {"wait", (PyCFunction)py_job_wait, METH_NOARGS, "wait(): block until the job is done"},
+  {0}
+};
+
+static int
+py_job_getbuffer(py_job_t *self, Py_buffer *view, int flags)
+{
+  vkdt_image_t img;
+  int res;
+  Py_BEGIN_ALLOW_THREADS
+  res = vkdt_job_wait(self->job);
+  Py_END_ALLOW_THREADS
+  const void *px = res ? 0 : vkdt_job_map_output(self->job, &img);
+  if(!px)
+  {
+    PyErr_SetString(PyExc_BufferError, "job has no output (failed, or the graph has run again)");
+    view->obj = 0;
+    return -1;
+  }
+  if(flags & PyBUF_WRITABLE)
+  {
+    PyErr_SetString(PyExc_BufferError, "output is read only");
+    view->obj = 0;
+    return -1;
+  }
+  view->buf        = (void *)px;
+  view->obj        = (PyObject *)self;
+  view->len        = py_image_layout(&img, self->shape, self->strides);
+  view->readonly   = 1;
+  view->itemsize   = img.bytes;
+  view->format     = (flags & PyBUF_FORMAT) ? (char *)py_image_format(&img) : 0;
+  view->ndim       = 3;
+  view->shape      = (flags & PyBUF_ND)      ? self->shape   : 0;
+  view->strides    = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? self->strides : 0;
+  view->suboffsets = 0;
+  view->internal   = 0;
+  Py_INCREF(self);
+  return 0;
+}
+
+static PyBufferProcs py_job_buffer = {
+  .bf_getbuffer = (getbufferproc)py_job_getbuffer,
+};
+
+static PyTypeObject py_job_type = {
+  PyVarObject_HEAD_INIT(0, 0)
+  .tp_name      = "vkdt.Job",
+  .tp_basicsize = sizeof(py_job_t),
+  .tp_flags     = Py_TPFLAGS_DEFAULT,
+  .tp_doc       = "a submitted graph run. supports the buffer protocol to view the output",
+  .tp_dealloc   = (destructor)py_job_dealloc,
+  .tp_methods   = py_job_methods,
+  .tp_as_buffer = &py_job_buffer,
+};
+
+static void
+py_input_dealloc(py_input_t *self)
+{
+  Py_DECREF(self->graph);
+  Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static int
+py_input_getbuffer(py_input_t *self, Py_buffer *view, int flags)
+{
+  view->buf        = self->px;
+  view->obj        = (PyObject *)self;
+  view->len        = self->len;
+  view->readonly   = 0;
+  view->itemsize   = self->strides[2];
+  view->format     = (flags & PyBUF_FORMAT) ? self->format : 0;
+  view->ndim       = 3;
+  view->shape      = (flags & PyBUF_ND)      ? self->shape   : 0;
+  view->strides    = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? self->strides : 0;
+  view->suboffsets = 0;
+  view->internal   = 0;
+  Py_INCREF(self);
+  return 0;
+}
+
+static PyBufferProcs py_input_buffer = {
+  .bf_getbuffer = (getbufferproc)py_input_getbuffer,
+};
+
+// the memory belongs to the graph and is valid until it is reallocated, i.e.
+// the next load or change of size. write to it only while no job is running.
+static PyTypeObject py_input_type = {
+  PyVarObject_HEAD_INIT(0, 0)
+  .tp_name      = "vkdt.Input",
+  .tp_basicsize = sizeof(py_input_t),
+  .tp_flags     = Py_TPFLAGS_DEFAULT,
+  .tp_doc       = "staging memory of an i-mem source. supports the buffer protocol to write the input",
+  .tp_dealloc   = (destructor)py_input_dealloc,
+  .tp_as_buffer = &py_input_buffer,
+};
+
+static int py_inited = 0;
+
+static void
+py_cleanup(void)
+{
+  vkdt_cleanup();
+}
+
+static PyObject *
+py_init(PyObject *self, PyObject *args)
+{
+  const char *gpu_name = 0;
+  int gpu_id = -1;
+  if(!PyArg_ParseTuple(args, "|zi", &gpu_name, &gpu_id)) return 0;
+  if(py_inited) Py_RETURN_NONE;
+  if(vkdt_init(gpu_name, gpu_id)) return PyErr_Format(PyExc_RuntimeError, "could not init vulkan");
+  py_inited = 1;
+  Py_AtExit(py_cleanup);
+  Py_RETURN_NONE;
+}
+
+static PyMethodDef py_methods[] = {
+  {"init", py_init, METH_VARARGS, "init([gpu_name, gpu_id]): init the device and thread pool"},
+  {0}
+};
+
+static struct PyModuleDef py_module = {
+  PyModuleDef_HEAD_INIT,
+  .m_name    = "vkdt",
+  .m_doc     = "vkdt processing graphs",
+  .m_size    = -1,
+  .m_methods = py_methods,
+};
+
+PyMODINIT_FUNC
+PyInit_vkdt(void)
+{
+  if(PyType_Ready(&py_graph_type) < 0 || PyType_Ready(&py_job_type) < 0 ||
+     PyType_Ready(&py_input_type) < 0) return 0;
+  PyObject *m = PyModule_Create(&py_module);
+  if(!m) return 0;
+  Py_INCREF(&py_graph_type);
+  Py_INCREF(&py_job_type);
+  Py_INCREF(&py_input_type);
+  PyModule_AddObject(m, "Graph", (PyObject *)&py_graph_type);
+  PyModule_AddObject(m, "Job",   (PyObject *)&py_job_type);
+  PyModule_AddObject(m, "Input", (PyObject *)&py_input_type);
+  return m;
+}
@@ -19,6 +19,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "qvk.h"
 #include "core/log.h"
+#include "core/fs.h"
 
 #include <vulkan/vulkan.h>
 
@@ -26,6 +27,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <limits.h>
 #include <assert.h>
 #ifndef NDEBUG
 #ifdef __linux__
@@ -105,6 +107,124 @@ vk_debug_callback(
   return VK_FALSE;
 }
 
+// our own little header in front of the driver blob, so we can discard the
+// file if the device or the driver changed. the driver checks its own header
+// too, but it has no notion of the driver version.
+typedef struct qvk_pipeline_cache_header_t
+{
+  uint32_t magic;
+  uint32_t vendor_id;
+  uint32_t device_id;
+  uint32_t driver_version;
+  uint8_t  uuid[VK_UUID_SIZE];
+  uint64_t size;
+}
+qvk_pipeline_cache_header_t;
+#define QVK_PIPELINE_CACHE_MAGIC 0x6376706bu // 'kpvc'
+
+static void
+qvk_pipeline_cache_header(qvk_pipeline_cache_header_t *h)
+{
+  VkPhysicalDeviceProperties prop;
+  vkGetPhysicalDeviceProperties(qvk.physical_device, &prop);
+  memset(h, 0, sizeof(*h));
+  h->magic          = QVK_PIPELINE_CACHE_MAGIC;
+  h->vendor_id      = prop.vendorID;
+  h->device_id      = prop.deviceID;
+  h->driver_version = prop.driverVersion;
+  memcpy(h->uuid, prop.pipelineCacheUUID, VK_UUID_SIZE);
+}
+
+static inline void
+qvk_pipeline_cache_filename(char *filename, size_t maxlen)
+{
+  char cachedir[PATH_MAX];
+  fs_cachedir(cachedir, sizeof(cachedir));
+  snprintf(filename, maxlen, "%s/pipeline.bin", cachedir);
+}
+
+// create the global pipeline cache, seeded with data from disk if it matches our device
+static VkResult
+qvk_pipeline_cache_init()
+{
+  char filename[PATH_MAX+20];
+  qvk_pipeline_cache_filename(filename, sizeof(filename));
+  qvk_pipeline_cache_header_t hdr, want;
+  qvk_pipeline_cache_header(&want);
+  void *data = 0;
+  size_t size = 0;
+  FILE *f = fopen(filename, "rb");
+  if(f)
+  {
+    if(fread(&hdr, sizeof(hdr), 1, f) == 1 &&
+        hdr.magic == want.magic &&
+        hdr.vendor_id == want.vendor_id &&
+        hdr.device_id == want.device_id &&
+        hdr.driver_version == want.driver_version &&
+        !memcmp(hdr.uuid, want.uuid, VK_UUID_SIZE) &&
+        hdr.size < (1ul<<30))
+    {
+      data = malloc(hdr.size);
+      if(fread(data, 1, hdr.size, f) == hdr.size) size = hdr.size;
+      else { free(data); data = 0; }
+    }
+    fclose(f);
+    if(!size) dt_log(s_log_qvk, "discarding stale pipeline cache %s", filename);
+  }
+  VkPipelineCacheCreateInfo info = {
+    .sType           = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+    .initialDataSize = size,
+    .pInitialData    = data,
+  };
+  VkResult res = vkCreatePipelineCache(qvk.device, &info, 0, &qvk.pipeline_cache);
+  if(res != VK_SUCCESS && size)
+  { // driver didn't like the blob, start from scratch
+    info.initialDataSize = 0;
+    info.pInitialData    = 0;
+    res = vkCreatePipelineCache(qvk.device, &info, 0, &qvk.pipeline_cache);
+  }
+  free(data);
+  if(res != VK_SUCCESS) qvk.pipeline_cache = VK_NULL_HANDLE; // will just work without
+  else dt_log(s_log_qvk, "pipeline cache initialised with %zu bytes", size);
+  return VK_SUCCESS;
+}
+
+// write the pipeline cache back to disk and destroy it
+static void
+qvk_pipeline_cache_cleanup()
+{
+  if(!qvk.pipeline_cache) return;
+  size_t size = 0;
+  void *data = 0;
+  if(vkGetPipelineCacheData(qvk.device, qvk.pipeline_cache, &size, 0) == VK_SUCCESS && size)
+  {
+    data = malloc(size);
+    if(vkGetPipelineCacheData(qvk.device, qvk.pipeline_cache, &size, data) == VK_SUCCESS)
+    {
+      char filename[PATH_MAX+20], tmpname[PATH_MAX+30];
+      qvk_pipeline_cache_filename(filename, sizeof(filename));
+      snprintf(tmpname, sizeof(tmpname), "%s.%d", filename, getpid());
+      char dir[PATH_MAX+20];
+      snprintf(dir, sizeof(dir), "%s", filename);
+      fs_dirname(dir);
+      fs_mkdir(dir, 0755); // may exist already
+      qvk_pipeline_cache_header_t hdr;
+      qvk_pipeline_cache_header(&hdr);
+      hdr.size = size;
+      FILE *f = fopen(tmpname, "wb");
+      if(f)
+      { // write to temporary file and rename, so concurrent processes don't see half a cache
+        int ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1 && fwrite(data, 1, size, f) == size;
+        fclose(f);
+        if(!ok || rename(tmpname, filename)) unlink(tmpname);
+      }
+    }
+    free(data);
+  }
+  vkDestroyPipelineCache(qvk.device, qvk.pipeline_cache, 0);
+  qvk.pipeline_cache = VK_NULL_HANDLE;
+}
+
 static VkResult
 qvkCreateDebugUtilsMessengerEXT(
     VkInstance instance,
@@ -165,9 +285,21 @@ qvk_create_swapchain()
     VK_FORMAT_R8G8B8_UNORM, VK_FORMAT_B8G8R8_UNORM,
   };
 
+  if(qvk.hdr && qvk.swapchain_colorspace_supported)
+  { // linear extended srgb (scRGB): 1.0 is sdr white, the compositor maps the rest to the display
+    for(int j = 0; j < num_formats; j++)
+      if(avail_surface_formats[j].format     == VK_FORMAT_R16G16B16A16_SFLOAT &&
+         avail_surface_formats[j].colorSpace == VK_COLOR_SPACE_EXTENDED_SRGB_LINEAR_EXT) {
+        qvk.surf_format = avail_surface_formats[j];
+        dt_log(s_log_qvk, "using hdr swapchain in extended linear srgb");
+        goto out;
+      }
+    dt_log(s_log_qvk, "hdr requested but the surface does not support extended linear srgb");
+  }
   for(int i = 0; i < LENGTH(acceptable_formats); i++) {
     for(int j = 0; j < num_formats; j++)
-      if(acceptable_formats[i] == avail_surface_formats[j].format) {
+      if(acceptable_formats[i] == avail_surface_formats[j].format &&
+         avail_surface_formats[j].colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
         qvk.surf_format = avail_surface_formats[j];
         dt_log(s_log_qvk, "colour space: %u", qvk.surf_format.colorSpace);
         goto out;
@@ -180,6 +312,15 @@ out:;
   VkPresentModeKHR *avail_present_modes = alloca(sizeof(VkPresentModeKHR) * num_present_modes);
   vkGetPhysicalDeviceSurfacePresentModesKHR(qvk.physical_device, qvk.surface, &num_present_modes, avail_present_modes);
   qvk.present_mode = VK_PRESENT_MODE_FIFO_KHR; // guaranteed to be there, but has vsync frame time jitter
+  if(qvk.low_latency)
+  { // mailbox replaces the queued image instead of blocking, immediate may tear
+    const VkPresentModeKHR pref[] = { VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR };
+    for(int i = 0; i < LENGTH(pref) && qvk.present_mode == VK_PRESENT_MODE_FIFO_KHR; i++)
+      for(int j = 0; j < num_present_modes; j++)
+        if(avail_present_modes[j] == pref[i]) qvk.present_mode = pref[i];
+  }
+  dt_log(s_log_qvk, "present mode: %s", qvk.present_mode == VK_PRESENT_MODE_MAILBOX_KHR ? "mailbox" :
+      qvk.present_mode == VK_PRESENT_MODE_IMMEDIATE_KHR ? "immediate" : "fifo");
 
   if(surf_capabilities.currentExtent.width != ~0u)
   {
@@ -201,6 +342,7 @@ out:;
   qvk.win_height = qvk.extent.height;
 
   uint32_t num_images = surf_capabilities.minImageCount;
+  if(qvk.present_mode == VK_PRESENT_MODE_MAILBOX_KHR) num_images++; // one to show, one queued, one to render to
   if(surf_capabilities.maxImageCount > 0)
     num_images = MIN(num_images, surf_capabilities.maxImageCount);
 
@@ -260,18 +402,24 @@ VkResult
 qvk_init(const char *preferred_device_name, int preferred_device_id)
 {
   threads_mutex_init(&qvk.queue_mutex, 0);
+  threads_mutex_init(&qvk.budget_mutex, 0);
   threads_mutex_init(&qvk.queue_work0_mutex, 0);
   threads_mutex_init(&qvk.queue_work1_mutex, 0);
   /* layers */
   get_vk_layer_list(&qvk.num_layers, &qvk.layers);
 
   /* instance extensions */
+  get_vk_extension_list(NULL, &qvk.num_extensions, &qvk.extensions);
   int num_inst_ext_combined = qvk.num_glfw_extensions + LENGTH(vk_requested_instance_extensions);
-  char **ext = alloca(sizeof(char *) * num_inst_ext_combined);
+  char **ext = alloca(sizeof(char *) * (num_inst_ext_combined + 1));
   memcpy(ext, qvk.glfw_extensions, qvk.num_glfw_extensions * sizeof(*qvk.glfw_extensions));
   memcpy(ext + qvk.num_glfw_extensions, vk_requested_instance_extensions, sizeof(vk_requested_instance_extensions));
-
-  get_vk_extension_list(NULL, &qvk.num_extensions, &qvk.extensions);
+  if(qvk.window && qvk.hdr) for(int k=0;k<qvk.num_extensions;k++)
+    if(!strcmp(qvk.extensions[k].extensionName, VK_EXT_SWAPCHAIN_COLOR_SPACE_EXTENSION_NAME))
+    { // extended colour spaces for the swapchain
+      ext[num_inst_ext_combined++] = VK_EXT_SWAPCHAIN_COLOR_SPACE_EXTENSION_NAME;
+      qvk.swapchain_colorspace_supported = 1;
+    }
 
   /* create instance */
   VkInstanceCreateInfo inst_create_info = {
@@ -337,6 +485,7 @@ qvk_init(const char *preferred_device_name, int preferred_device_id)
         dev_properties.limits.maxImageDimension2D, dev_properties.limits.maxImageDimension2D);
     dt_log(s_log_qvk, "max uniform buffer range %u", dev_properties.limits.maxUniformBufferRange);
     uint32_t num_ext;
+    int present_id = 0, present_wait = 0;
     vkEnumerateDeviceExtensionProperties(devices[i], NULL, &num_ext, NULL);
 
     VkExtensionProperties *ext_properties = malloc(sizeof(VkExtensionProperties) * num_ext);
@@ -348,11 +497,32 @@ qvk_init(const char *preferred_device_name, int preferred_device_id)
     { // vendor ids are: nvidia 0x10de, intel 0x8086
       qvk.ticks_to_nanoseconds = dev_properties.limits.timestampPeriod;
       qvk.uniform_alignment    = dev_properties.limits.minUniformBufferOffsetAlignment;
+      // a device picked earlier in this loop may have set some of these:
+      qvk.raytracing_supported = qvk.float_atomics_supported = qvk.dmabuf_supported = 0;
+      qvk.coopmat_supported = qvk.push_descriptor_supported = qvk.memory_budget_supported = 0;
+      qvk.synchronization2_supported = qvk.calibrated_timestamps_supported = 0;
       for(int k=0;k<num_ext;k++)
         if (!strcmp(ext_properties[k].extensionName, VK_KHR_RAY_QUERY_EXTENSION_NAME))
           qvk.raytracing_supported = 1;
         else if (!strcmp(ext_properties[k].extensionName, VK_EXT_SHADER_ATOMIC_FLOAT_EXTENSION_NAME))
           qvk.float_atomics_supported = 1;
+        else if (!strcmp(ext_properties[k].extensionName, VK_EXT_EXTERNAL_MEMORY_DMA_BUF_EXTENSION_NAME))
+          qvk.dmabuf_supported = 1;
+        else if (!strcmp(ext_properties[k].extensionName, VK_KHR_COOPERATIVE_MATRIX_EXTENSION_NAME))
+          qvk.coopmat_supported = 1;
+        else if (!strcmp(ext_properties[k].extensionName, VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME))
+          qvk.push_descriptor_supported = 1;
+        else if (!strcmp(ext_properties[k].extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME))
+          qvk.memory_budget_supported = 1;
+        else if (!strcmp(ext_properties[k].extensionName, VK_KHR_PRESENT_ID_EXTENSION_NAME))
+          present_id = 1;
+        else if (!strcmp(ext_properties[k].extensionName, VK_KHR_PRESENT_WAIT_EXTENSION_NAME))
+          present_wait = 1;
+        else if (!strcmp(ext_properties[k].extensionName, VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME))
+          qvk.synchronization2_supported = 1;
+        else if (!strcmp(ext_properties[k].extensionName, VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME))
+          qvk.calibrated_timestamps_supported = 1;
+      qvk.present_wait_supported = qvk.window && present_id && present_wait;
       picked_device = i;
       if(preferred_device_name)
         dt_log(s_log_qvk, "selecting device %s by explicit request", preferred_device_name);
@@ -369,6 +539,18 @@ qvk_init(const char *preferred_device_name, int preferred_device_id)
   }
 
   qvk.physical_device = devices[picked_device];
+  if(qvk.calibrated_timestamps_supported)
+  { // we need the device and CLOCK_MONOTONIC domains to put gpu timestamps on the cpu time axis
+    PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT get_domains = (PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT)
+      vkGetInstanceProcAddr(qvk.instance, "vkGetPhysicalDeviceCalibrateableTimeDomainsEXT");
+    VkTimeDomainEXT domain[8];
+    uint32_t domain_cnt = LENGTH(domain);
+    int have = 0;
+    if(get_domains && get_domains(qvk.physical_device, &domain_cnt, domain) >= 0)
+      for(uint32_t k=0;k<domain_cnt;k++)
+        if(domain[k] == VK_TIME_DOMAIN_DEVICE_EXT || domain[k] == VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT) have++;
+    qvk.calibrated_timestamps_supported = have == 2;
+  }
   VkPhysicalDeviceFeatures dev_features; // be sure that corresponds to what we picked
   vkGetPhysicalDeviceFeatures(qvk.physical_device, &dev_features);
 
@@ -427,6 +609,7 @@ qvk_init(const char *preferred_device_name, int preferred_device_id)
     .runtimeDescriptorArray                    = VK_TRUE,
     .shaderSampledImageArrayNonUniformIndexing = VK_TRUE,
     .bufferDeviceAddress                       = VK_TRUE,
+    .timelineSemaphore                         = VK_TRUE,
   };
   VkPhysicalDeviceShaderAtomicFloatFeaturesEXT atomic_features = {
     .sType                       = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_ATOMIC_FLOAT_FEATURES_EXT,
@@ -438,31 +621,95 @@ qvk_init(const char *preferred_device_name, int preferred_device_id)
   //   .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_SIZE_CONTROL_FEATURES,
   //   .pNext = &atomic_features,
   // };
+  VkPhysicalDeviceCooperativeMatrixFeaturesKHR coopmat_features = {
+    .sType             = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_COOPERATIVE_MATRIX_FEATURES_KHR,
+    .pNext             = &atomic_features,
+    .cooperativeMatrix = VK_TRUE,
+  };
   VkPhysicalDeviceVulkan11Features v11f = {
     .sType                  = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES,
     .samplerYcbcrConversion = 1,
     // .pNext                  = &sub_features,
-    .pNext                  = &atomic_features,
+    .pNext                  = qvk.coopmat_supported ? (void *)&coopmat_features : (void *)&atomic_features,
   };
   // vk 1.3 stuff:
   // VkPhysicalDeviceMaintenance4Features maintenance4 = {
   //   .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MAINTENANCE_4_FEATURES,
   //   .pNext = &v11f,
   // };
+  VkPhysicalDeviceSynchronization2FeaturesKHR sync2_features = {
+    .sType            = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR,
+    .pNext            = &v11f,
+    .synchronization2 = VK_TRUE,
+  };
+  void *features_next = qvk.synchronization2_supported ? (void *)&sync2_features : (void *)&v11f;
+  VkPhysicalDevicePresentIdFeaturesKHR present_id_features = {
+    .sType     = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR,
+    .pNext     = features_next,
+    .presentId = VK_TRUE,
+  };
+  VkPhysicalDevicePresentWaitFeaturesKHR present_wait_features = {
+    .sType       = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR,
+    .pNext       = &present_id_features,
+    .presentWait = VK_TRUE,
+  };
   VkPhysicalDeviceFeatures2 device_features = {
     .sType    = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
     .features = dev_features,
     // .pNext    = &maintenance4,
-    .pNext = &v11f,
+    .pNext = qvk.present_wait_supported ? (void *)&present_wait_features : features_next,
   };
   vkGetPhysicalDeviceFeatures2(qvk.physical_device, &device_features);
+  if(qvk.present_wait_supported && !(present_id_features.presentId && present_wait_features.presentWait))
+  { // extensions are there but the driver doesn't do it for this device
+    qvk.present_wait_supported = 0;
+    device_features.pNext = features_next;
+  }
+  if(qvk.synchronization2_supported && !sync2_features.synchronization2)
+  { // leave it out of the chain, barriers fall back to vkCmdPipelineBarrier
+    qvk.synchronization2_supported = 0;
+    present_id_features.pNext = &v11f;
+    if(device_features.pNext == &sync2_features) device_features.pNext = &v11f;
+  }
+  qvk.pipeline_stats_supported = device_features.features.pipelineStatisticsQuery;
   // now find out whether we *really* support 32-bit floating point atomic adds:
   if(atomic_features.shaderImageFloat32AtomicAdd == VK_FALSE)
     qvk.float_atomics_supported = 0;
+  // cooperative matrices are only useful to us for 16x16x16 f16 subgroup products:
+  if(qvk.coopmat_supported)
+  {
+    qvk.coopmat_supported = 0;
+    QVK_LOAD(vkGetPhysicalDeviceCooperativeMatrixPropertiesKHR);
+    uint32_t cnt = 0;
+    if(coopmat_features.cooperativeMatrix && v12f.shaderFloat16 && qvkGetPhysicalDeviceCooperativeMatrixPropertiesKHR &&
+       qvkGetPhysicalDeviceCooperativeMatrixPropertiesKHR(qvk.physical_device, &cnt, 0) == VK_SUCCESS && cnt)
+    {
+      VkCooperativeMatrixPropertiesKHR *prop = calloc(cnt, sizeof(*prop));
+      for(int k=0;k<cnt;k++) prop[k].sType = VK_STRUCTURE_TYPE_COOPERATIVE_MATRIX_PROPERTIES_KHR;
+      qvkGetPhysicalDeviceCooperativeMatrixPropertiesKHR(qvk.physical_device, &cnt, prop);
+      for(int k=0;k<cnt;k++)
+        if(prop[k].MSize == 16 && prop[k].NSize == 16 && prop[k].KSize == 16 &&
+           prop[k].AType == VK_COMPONENT_TYPE_FLOAT16_KHR && prop[k].BType == VK_COMPONENT_TYPE_FLOAT16_KHR &&
+           prop[k].CType == VK_COMPONENT_TYPE_FLOAT16_KHR && prop[k].ResultType == VK_COMPONENT_TYPE_FLOAT16_KHR &&
+           prop[k].scope == VK_SCOPE_SUBGROUP_KHR)
+          qvk.coopmat_supported = 1;
+      free(prop);
+    }
+    if(!qvk.coopmat_supported) v11f.pNext = &atomic_features; // don't enable the extension
+  }
+
+  { // packed float images are storage images on most but not all devices
+    VkFormatProperties pk;
+    vkGetPhysicalDeviceFormatProperties(qvk.physical_device, VK_FORMAT_B10G11R11_UFLOAT_PACK32, &pk);
+    const VkFormatFeatureFlags req = VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT |
+      VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT | VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT;
+    qvk.packed_float_supported = (pk.optimalTilingFeatures & req) == req;
+  }
 
-  dt_log(s_log_qvk, "picked device %d %s ray tracing and %s float atomics support", picked_device,
+  dt_log(s_log_qvk, "picked device %d %s ray tracing, %s float atomics, and %s cooperative matrix support", picked_device,
       qvk.raytracing_supported ? "with" : "without",
-      qvk.float_atomics_supported ? "with" : "without");
+      qvk.float_atomics_supported ? "with" : "without",
+      qvk.coopmat_supported ? "with" : "without");
 
   const char *requested_device_extensions[30] = {
     // ray tracing
@@ -479,10 +726,25 @@ qvk_init(const char *preferred_device_name, int preferred_device_id)
   };
   int len = (qvk.raytracing_supported ? 7 : 0);
   if(qvk.float_atomics_supported) requested_device_extensions[len++] = VK_EXT_SHADER_ATOMIC_FLOAT_EXTENSION_NAME;
+  if(qvk.coopmat_supported)       requested_device_extensions[len++] = VK_KHR_COOPERATIVE_MATRIX_EXTENSION_NAME;
+  if(qvk.push_descriptor_supported) requested_device_extensions[len++] = VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME;
+  if(qvk.memory_budget_supported)   requested_device_extensions[len++] = VK_EXT_MEMORY_BUDGET_EXTENSION_NAME;
+  if(qvk.synchronization2_supported) requested_device_extensions[len++] = VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME;
+  if(qvk.calibrated_timestamps_supported) requested_device_extensions[len++] = VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME;
 #ifdef QVK_ENABLE_VALIDATION
   requested_device_extensions[len++] = VK_EXT_DEBUG_MARKER_EXTENSION_NAME;
 #endif
   if(qvk.window) requested_device_extensions[len++] = VK_KHR_SWAPCHAIN_EXTENSION_NAME;
+  if(qvk.present_wait_supported)
+  { // frame pacing for the low latency present modes
+    requested_device_extensions[len++] = VK_KHR_PRESENT_ID_EXTENSION_NAME;
+    requested_device_extensions[len++] = VK_KHR_PRESENT_WAIT_EXTENSION_NAME;
+  }
+  if(qvk.dmabuf_supported)
+  { // zero copy import of camera buffers
+    requested_device_extensions[len++] = VK_KHR_EXTERNAL_MEMORY_FD_EXTENSION_NAME;
+    requested_device_extensions[len++] = VK_EXT_EXTERNAL_MEMORY_DMA_BUF_EXTENSION_NAME;
+  }
 
   VkDeviceCreateInfo dev_create_info = {
     .sType                   = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
@@ -506,9 +768,28 @@ qvk_init(const char *preferred_device_name, int preferred_device_id)
     if(!q##a) { dt_log(s_log_qvk|s_log_err, "could not load function %s. do you have validation layers setup correctly?", #a); return VK_INCOMPLETE; }
   _VK_EXTENSION_LIST
 #undef _VK_EXTENSION_DO
-
+  if(qvk.dmabuf_supported)
+    qvk.GetMemoryFdPropertiesKHR = (PFN_vkGetMemoryFdPropertiesKHR)vkGetDeviceProcAddr(qvk.device, "vkGetMemoryFdPropertiesKHR");
+  if(!qvk.GetMemoryFdPropertiesKHR) qvk.dmabuf_supported = 0;
+  if(qvk.push_descriptor_supported)
+    qvk.CmdPushDescriptorSetKHR = (PFN_vkCmdPushDescriptorSetKHR)vkGetDeviceProcAddr(qvk.device, "vkCmdPushDescriptorSetKHR");
+  if(!qvk.CmdPushDescriptorSetKHR) qvk.push_descriptor_supported = 0;
+  if(qvk.present_wait_supported)
+    qvk.WaitForPresentKHR = (PFN_vkWaitForPresentKHR)vkGetDeviceProcAddr(qvk.device, "vkWaitForPresentKHR");
+  if(!qvk.WaitForPresentKHR) qvk.present_wait_supported = 0;
+  if(qvk.synchronization2_supported)
+    qvk.CmdPipelineBarrier2KHR = (PFN_vkCmdPipelineBarrier2KHR)vkGetDeviceProcAddr(qvk.device, "vkCmdPipelineBarrier2KHR");
+  if(!qvk.CmdPipelineBarrier2KHR) qvk.synchronization2_supported = 0;
+  if(qvk.calibrated_timestamps_supported)
+    qvk.GetCalibratedTimestampsEXT = (PFN_vkGetCalibratedTimestampsEXT)vkGetDeviceProcAddr(qvk.device, "vkGetCalibratedTimestampsEXT");
+  if(!qvk.GetCalibratedTimestampsEXT) qvk.calibrated_timestamps_supported = 0;
+
+  VkPhysicalDevicePushDescriptorPropertiesKHR devprop_push = {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PUSH_DESCRIPTOR_PROPERTIES_KHR,
+  };
   VkPhysicalDeviceAccelerationStructurePropertiesKHR devprop_acc = {
     .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_PROPERTIES_KHR,
+    .pNext = &devprop_push,
   };
   VkPhysicalDeviceProperties2 devprop = {
     .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
@@ -516,6 +797,9 @@ qvk_init(const char *preferred_device_name, int preferred_device_id)
   };
   vkGetPhysicalDeviceProperties2(qvk.physical_device, &devprop);
   qvk.raytracing_acc_min_align = devprop_acc.minAccelerationStructureScratchOffsetAlignment;
+  qvk.max_push_descriptors = qvk.push_descriptor_supported ? devprop_push.maxPushDescriptors : 0;
+  dt_log(s_log_qvk, "push descriptors %s (%u per set)",
+      qvk.push_descriptor_supported ? "supported" : "not supported", qvk.max_push_descriptors);
 
   // create texture samplers
   VkSamplerCreateInfo sampler_info = {
@@ -595,6 +879,8 @@ qvk_init(const char *preferred_device_name, int preferred_device_id)
   // initialise a safe fallback for cli mode ("dspy" format is going to look here):
   qvk.surf_format.format = VK_FORMAT_R8G8B8A8_UNORM;
 
+  QVKR(qvk_pipeline_cache_init());
+
   return VK_SUCCESS;
 }
 
@@ -613,12 +899,14 @@ qvk_cleanup()
 {
   QVKL(&qvk.queue_mutex, vkDeviceWaitIdle(qvk.device));
   threads_mutex_destroy(&qvk.queue_mutex);
+  threads_mutex_destroy(&qvk.budget_mutex);
   threads_mutex_destroy(&qvk.queue_work0_mutex);
   threads_mutex_destroy(&qvk.queue_work1_mutex);
   vkDestroySampler(qvk.device, qvk.tex_sampler, 0);
   vkDestroySampler(qvk.device, qvk.tex_sampler_nearest, 0);
   vkDestroySampler(qvk.device, qvk.tex_sampler_yuv, 0);
   vkDestroySamplerYcbcrConversion(qvk.device, qvk.yuv_conversion, 0);
+  qvk_pipeline_cache_cleanup();
 
   if(qvk.window)  destroy_swapchain();
   if(qvk.surface) vkDestroySurfaceKHR(qvk.instance, qvk.surface, NULL);
@@ -638,3 +926,72 @@ qvk_cleanup()
 
   return 0;
 }
+
+void
+qvk_memory_budget(
+    uint32_t  heap,
+    uint64_t *budget,
+    uint64_t *usage)
+{
+  *budget = qvk.mem_properties.memoryHeaps[heap].size;
+  *usage  = 0;
+  if(!qvk.memory_budget_supported) return;
+  VkPhysicalDeviceMemoryBudgetPropertiesEXT mem_budget = {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT,
+  };
+  VkPhysicalDeviceMemoryProperties2 mem_prop = {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2,
+    .pNext = &mem_budget,
+  };
+  vkGetPhysicalDeviceMemoryProperties2(qvk.physical_device, &mem_prop);
+  *budget = mem_budget.heapBudget[heap];
+  *usage  = mem_budget.heapUsage[heap];
+}
+
+int
+qvk_budget_register(
+    void (*release)(void *data, uint32_t heap, uint64_t size),
+    void  *data)
+{
+  int res = 1;
+  threads_mutex_lock(&qvk.budget_mutex);
+  for(int i=0;i<QVK_MAX_BUDGET_USERS;i++) if(!qvk.budget_release[i])
+  {
+    qvk.budget_release[i] = release;
+    qvk.budget_data[i]    = data;
+    res = 0;
+    break;
+  }
+  threads_mutex_unlock(&qvk.budget_mutex);
+  return res;
+}
+
+void
+qvk_budget_unregister(void *data)
+{
+  threads_mutex_lock(&qvk.budget_mutex);
+  for(int i=0;i<QVK_MAX_BUDGET_USERS;i++) if(qvk.budget_data[i] == data)
+  {
+    qvk.budget_release[i] = 0;
+    qvk.budget_data[i]    = 0;
+  }
+  threads_mutex_unlock(&qvk.budget_mutex);
+}
+
+int
+qvk_budget_reserve(
+    uint32_t heap,
+    uint64_t size)
+{
+  uint64_t budget, usage;
+  qvk_memory_budget(heap, &budget, &usage);
+  if(usage + size <= budget) return 1;
+  const uint64_t need = usage + size - budget;
+  dt_log(s_log_mem, "%g MB over the budget of %g MB on heap %u, asking for memory",
+      need/(1024.0*1024.0), budget/(1024.0*1024.0), heap);
+  threads_mutex_lock(&qvk.budget_mutex);
+  for(int i=0;i<QVK_MAX_BUDGET_USERS;i++)
+    if(qvk.budget_release[i]) qvk.budget_release[i](qvk.budget_data[i], heap, need);
+  threads_mutex_unlock(&qvk.budget_mutex);
+  return 0;
+}
@@ -67,6 +67,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
   } while(0)
 
 #define QVK_MAX_FRAMES_IN_FLIGHT 2
+#define QVK_MAX_BUDGET_USERS 8
 #define QVK_MAX_SWAPCHAIN_IMAGES 4
 
 #define QVK_LOAD(FUNCTION_NAME) PFN_##FUNCTION_NAME q##FUNCTION_NAME = (PFN_##FUNCTION_NAME) vkGetInstanceProcAddr(qvk.instance, #FUNCTION_NAME)
@@ -106,6 +107,8 @@ typedef struct qvk_t
   VkSampler                   tex_sampler_yuv;
   VkSamplerYcbcrConversion    yuv_conversion;
 
+  VkPipelineCache             pipeline_cache; // shared by all graphs, persisted in ~/.cache/vkdt/pipeline.bin
+
   uint32_t                    num_extensions;
   VkExtensionProperties       *extensions;
 
@@ -130,6 +133,29 @@ typedef struct qvk_t
 
   int                         raytracing_supported;
   int                         float_atomics_supported;
+  int                         dmabuf_supported;
+  int                         coopmat_supported;  // 16x16x16 f16 cooperative matrices
+  int                         packed_float_supported; // b10g11r11 ufloat storage images, for s_conn_compact
+  int                         push_descriptor_supported;
+  uint32_t                    max_push_descriptors;
+  int                         memory_budget_supported;
+  int                         pipeline_stats_supported; // VK_QUERY_TYPE_PIPELINE_STATISTICS
+  PFN_vkGetMemoryFdPropertiesKHR GetMemoryFdPropertiesKHR;
+  PFN_vkCmdPushDescriptorSetKHR  CmdPushDescriptorSetKHR;
+  PFN_vkWaitForPresentKHR        WaitForPresentKHR;
+  PFN_vkCmdPipelineBarrier2KHR   CmdPipelineBarrier2KHR;
+  PFN_vkGetCalibratedTimestampsEXT GetCalibratedTimestampsEXT;
+  int                         present_wait_supported; // VK_KHR_present_id and VK_KHR_present_wait
+  int                         swapchain_colorspace_supported; // VK_EXT_swapchain_colorspace
+  int                         synchronization2_supported; // VK_KHR_synchronization2
+  int                         calibrated_timestamps_supported; // VK_EXT_calibrated_timestamps with device and CLOCK_MONOTONIC domains
+  int                         low_latency; // set before qvk_create_swapchain(): prefer mailbox or immediate over fifo
+  int                         hdr;         // set before qvk_init(): prefer an extended linear srgb swapchain
+
+  // users of large device memory blocks that can give some of it back under pressure
+  threads_mutex_t             budget_mutex;
+  void                      (*budget_release[QVK_MAX_BUDGET_USERS])(void *data, uint32_t heap, uint64_t size);
+  void                       *budget_data[QVK_MAX_BUDGET_USERS];
 }
 qvk_t;
 
@@ -152,3 +178,18 @@ VkResult qvk_init(const char *preferred_device_name, int preferred_device_id);
 VkResult qvk_cleanup();
 
 VkResult qvk_create_swapchain();
+
+// current budget and usage of the given device memory heap, in bytes. this is
+// shared with other processes. without VK_EXT_memory_budget this returns the
+// heap size and zero usage.
+void qvk_memory_budget(uint32_t heap, uint64_t *budget, uint64_t *usage);
+
+// register a callback that releases memory on the given heap if asked to.
+// it may be called from any thread, so it should only flag the request and
+// give the memory back from the thread that owns it.
+int  qvk_budget_register(void (*release)(void *data, uint32_t heap, uint64_t size), void *data);
+void qvk_budget_unregister(void *data);
+
+// check whether size more bytes fit the budget of the heap. if not, ask all
+// registered users to release memory and return 0.
+int  qvk_budget_reserve(uint32_t heap, uint64_t size);
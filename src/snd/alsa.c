@@ -4,14 +4,68 @@
 #include "snd/snd.h"
 
 #include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
 #include <alsa/asoundlib.h>
 
+#define DT_SND_CHUNK 256 // sample frames per write, about 5ms
+
+static void
+dt_snd_alsa_update_clock(dt_snd_t *snd, uint64_t tail)
+{
+  snd_pcm_sframes_t delay = 0;
+  if(snd_pcm_delay(snd->handle, &delay) < 0 || delay < 0) delay = 0;
+  __atomic_store_n(&snd->clock, tail - MIN((uint64_t)delay, tail), __ATOMIC_RELAXED);
+}
+
+// drain the ring to the device. the writes block until there is room, so this
+// paces itself by the device and keeps the gui thread out of it.
+static void*
+dt_snd_alsa_thread(void *arg)
+{
+  dt_snd_t *snd = arg;
+  snd_pcm_t *pcm = snd->handle;
+  uint64_t tail = snd->ring_tail;
+  while(__atomic_load_n(&snd->running, __ATOMIC_ACQUIRE))
+  {
+    const uint64_t head = __atomic_load_n(&snd->ring_head, __ATOMIC_ACQUIRE);
+    if(head == tail)
+    { // underrun or just not started
+      dt_snd_alsa_update_clock(snd, tail);
+      usleep(2000);
+      continue;
+    }
+    const uint64_t pos = tail & (snd->ring_size - 1);
+    const uint64_t cnt = MIN(MIN(head - tail, snd->ring_size - pos), DT_SND_CHUNK);
+    snd_pcm_sframes_t err = snd_pcm_writei(pcm, snd->ring + pos * snd->frame_size, cnt);
+    if(err == -EAGAIN) continue;
+    if(err < 0)
+    {
+      dt_log(s_log_snd, "audio underrun: %s", snd_strerror(err));
+      snd_pcm_recover(pcm, err, 1);
+      continue;
+    }
+    tail += err;
+    __atomic_store_n(&snd->ring_tail, tail, __ATOMIC_RELEASE);
+    dt_snd_alsa_update_clock(snd, tail);
+  }
+  return 0;
+}
+
 static void
 dt_snd_alsa_cleanup(dt_snd_t *snd)
 {
+  if(snd->running)
+  {
+    __atomic_store_n(&snd->running, 0, __ATOMIC_RELEASE);
+    pthread_join(snd->thread, 0);
+  }
   snd_pcm_t *pcm = snd->handle;
   if(pcm) snd_pcm_close(pcm);
   snd->handle = 0;
+  free(snd->ring);
+  snd->ring = 0;
 }
 
 static int
@@ -56,6 +110,21 @@ dt_snd_alsa_init(
 
   snd_pcm_hw_params_free(hwparams);
   snd_pcm_sw_params_free(swparams);
+  hwparams = 0;
+  swparams = 0;
+
+  // about a second of queued audio
+  snd->frame_size = channels * snd_pcm_format_physical_width(format) / 8;
+  snd->ring_size = 1;
+  while(snd->ring_size < sample_rate) snd->ring_size <<= 1;
+  snd->ring = malloc(snd->ring_size * snd->frame_size);
+  if(snd->frame_size <= 0 || !snd->ring) { err = -ENOMEM; goto error; }
+  snd->running = 1;
+  if((err = -pthread_create(&snd->thread, 0, dt_snd_alsa_thread, snd)))
+  {
+    snd->running = 0;
+    goto error;
+  }
   dt_log(s_log_snd, "inited alsa device %s", pcm_device);
   return 0;
 
@@ -73,12 +142,21 @@ dt_snd_alsa_play(
     uint16_t *samples,
     int       sample_cnt)
 {
-  snd_pcm_t *pcm = snd->handle;
-  if(!pcm) return 0;
-  int err = snd_pcm_writei(pcm, samples, sample_cnt);
-  if(err == -EAGAIN) return 0;
-  if(err < 0) snd_pcm_prepare(pcm);
-  return err > 0 ? err : 0;
+  if(!snd->handle || !snd->running) return 0;
+  const uint64_t head = snd->ring_head;
+  const uint64_t tail = __atomic_load_n(&snd->ring_tail, __ATOMIC_ACQUIRE);
+  const uint64_t cnt  = MIN((uint64_t)MAX(sample_cnt, 0), snd->ring_size - (head - tail));
+  const uint8_t *src  = (const uint8_t *)samples;
+  for(uint64_t done=0;done<cnt;)
+  { // copy in up to two contiguous pieces
+    const uint64_t pos = (head + done) & (snd->ring_size - 1);
+    const uint64_t len = MIN(cnt - done, snd->ring_size - pos);
+    memcpy(snd->ring + pos * snd->frame_size, src + done * snd->frame_size, len * snd->frame_size);
+    done += len;
+  }
+  __atomic_store_n(&snd->ring_head, head + cnt, __ATOMIC_RELEASE);
+  if(cnt < sample_cnt) dt_log(s_log_snd, "audio queue full, dropping %d samples", sample_cnt - (int)cnt);
+  return cnt;
 }
 
 void dt_snd_cleanup(dt_snd_t *snd)
@@ -102,3 +180,15 @@ int dt_snd_play(
 {
   return dt_snd_alsa_play(snd, samples, sample_cnt);
 }
+
+int dt_snd_queued(dt_snd_t *snd)
+{
+  if(!snd->running) return 0;
+  return snd->ring_head - __atomic_load_n(&snd->ring_tail, __ATOMIC_ACQUIRE);
+}
+
+double dt_snd_time(dt_snd_t *snd)
+{
+  if(!snd->running || !snd->sample_rate) return -1.0;
+  return __atomic_load_n(&snd->clock, __ATOMIC_RELAXED) / (double)snd->sample_rate;
+}
@@ -20,3 +20,13 @@ int dt_snd_play(
 {
   return 0;
 }
+
+int dt_snd_queued(dt_snd_t *snd)
+{
+  return 0;
+}
+
+double dt_snd_time(dt_snd_t *snd)
+{
+  return -1.0;
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include <stdint.h>
+#include <pthread.h>
 
 // wrapper for potential different backends
 
@@ -8,6 +9,16 @@ typedef struct dt_snd_t
   void *handle;
   int sample_rate;
   int channels;
+  int frame_size;       // bytes per sample frame (all channels)
+  // dt_snd_play() queues samples in this ring, an audio thread writes them to
+  // the device. single producer, single consumer, no locks.
+  uint8_t  *ring;
+  uint64_t  ring_size;  // in sample frames, power of two
+  uint64_t  ring_head;  // sample frames queued (written by the producer)
+  uint64_t  ring_tail;  // sample frames handed to the device (written by the audio thread)
+  uint64_t  clock;      // sample frames heard so far, ring_tail minus the device delay
+  pthread_t thread;
+  int       running;
 }
 dt_snd_t;
 
@@ -19,7 +30,16 @@ int dt_snd_init(
     int       channels,
     int       format);
 
+// queue samples for playback, returns the number of sample frames accepted.
+// does not block, the samples are written to the device by the audio thread.
 int dt_snd_play(
     dt_snd_t *snd,
     uint16_t *samples,
     int       sample_cnt);
+
+// number of sample frames queued but not yet handed to the device
+int dt_snd_queued(dt_snd_t *snd);
+
+// playback position in seconds since dt_snd_init(), as heard on the device,
+// or -1 if there is no audio playing. use this as clock for a/v sync.
+double dt_snd_time(dt_snd_t *snd);
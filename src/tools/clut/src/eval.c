@@ -10,6 +10,7 @@
 #include "spectrum.h"
 #include "cfa.h"
 #include "upsample.h"
+#include "core/threads.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -64,61 +65,90 @@ error:
   return clut;
 }
 
-// bilinear lookup
+// bilinear lookup as the gpu does it for the clut sampler: float precision,
+// texel centers at half integers, clamp to edge per tap
 static inline void
 texture(
-    const double   *tc,     // texture coordinates
+    const float    *tc,     // texture coordinates
     const uint16_t *tex,    // texture data
     const int       wd,     // width of texture
     const int       ht,     // height of texture
-    double         *out)    // bilinear lookup will end up here
+    float          *out)    // bilinear lookup will end up here
 {
-  out[0] = out[1] = 0.0;
-  double xf = tc[0]*wd - 0.5, yf = tc[1]*ht - 0.5;
-  int x0 = (int)CLAMP(xf,   0, wd-1), y0 = (int)CLAMP(yf,   0, ht-1);
-  int x1 = (int)CLAMP(x0+1, 0, wd-1), y1 = (int)CLAMP(y0+1, 0, ht-1);
-  int dx = x1 - x0, dy = y1 - y0;
-  double u = xf - x0, v = yf - y0;
-  const uint16_t *c = tex + 2*(y0*wd + x0);
-  for(int k=0;k<2;k++) out[k] += (1.0-u)*(1.0-v)*half_to_float(c[k]);
-  for(int k=0;k<2;k++) out[k] += (    u)*(1.0-v)*half_to_float(c[k + 2*dx]);
-  for(int k=0;k<2;k++) out[k] += (1.0-u)*(    v)*half_to_float(c[k + 2*wd*dy]);
-  for(int k=0;k<2;k++) out[k] += (    u)*(    v)*half_to_float(c[k + 2*(wd*dy+dx)]);
+  const float xf = tc[0]*wd - 0.5f, yf = tc[1]*ht - 0.5f;
+  const float fx = floorf(xf), fy = floorf(yf);
+  const float u = xf - fx, v = yf - fy;
+  const int x0 = CLAMP((int)fx,   0, wd-1), y0 = CLAMP((int)fy,   0, ht-1);
+  const int x1 = CLAMP((int)fx+1, 0, wd-1), y1 = CLAMP((int)fy+1, 0, ht-1);
+  for(int k=0;k<2;k++) out[k] =
+    (1.0f-u)*(1.0f-v)*half_to_float(tex[2*(y0*wd + x0)+k]) +
+    (     u)*(1.0f-v)*half_to_float(tex[2*(y0*wd + x1)+k]) +
+    (1.0f-u)*(     v)*half_to_float(tex[2*(y1*wd + x0)+k]) +
+    (     u)*(     v)*half_to_float(tex[2*(y1*wd + x1)+k]);
 }
 
+// the temperature blend weight as colour/main.c:commit_params() computes it
+static inline float
+clut_temp(float T)
+{ // T between 2856(A) and 6504(D65)
+  return 1.0f - CLAMP(tanf(asinhf(46.3407f+T))+(-0.0287128f*cosf(0.000798585f*(714.855f-T)))+0.942275f, 0.0f, 1.0f);
+}
+
+// the same as process_clut() in colour/main.comp, line by line
 void
 process_clut(
     const dt_lut_header_t *clut_header,
     const uint16_t        *clut,
     const float           *rgb,  // camera rgb
     float                 *out,  // rec2020 rgb
-    float                  T)    // colour temperature between 2856(A) and 6504(D65)
+    float                  temp) // blend weight between the illuminants, see clut_temp()
 {
-  // convert colour temperature T to
-  // temperature normalised between 0 and 1 to blend between two illuminants in profile
-  // T between 2856 and 6504
-  // TODO: also try the dng spec inverse linear interpolation
-  // double temp = (1.0/T - 1.0/2856.0)/(1.0/6504.0-1.0/2856.0);
-  double temp = 1.0f - CLAMP(tanf(asinhf(46.3407f+T))+(-0.0287128f*cosf(0.000798585f*(714.855f-T)))+0.942275f, 0.0f, 1.0f);
-  double b = rgb[0]+rgb[1]+rgb[2];
-  double tc[] = {rgb[0]/b, rgb[2]/b};
-  tri2quad(tc, tc+1);
-  tc[0] /= 3.0;
-  double rbrb[4], L2[2];
+  const float b = rgb[0]+rgb[1]+rgb[2];
+  float tc[] = {rgb[0]/b, rgb[2]/b};
+  tc[1] = tc[1] / (1.0f-tc[0]); // tri2quad
+  tc[0] = (1.0f-tc[0])*(1.0f-tc[0]);
+  tc[0] /= 3.0f;
+  float rbrb[4], L2[2];
   texture(tc, clut, clut_header->wd, clut_header->ht, rbrb);
-  tc[0] += 1.0/3.0;
-  texture(tc, clut, clut_header->wd, clut_header->ht, L2);
-  tc[0] += 1.0/3.0;
-  texture(tc, clut, clut_header->wd, clut_header->ht, rbrb+2);
-  double L = mix(L2[0], L2[1], temp);
-  double rb[2] = {
+  float tcL[] = {tc[0] + 1.0f/3.0f, tc[1]}, tc2[] = {tc[0] + 2.0f/3.0f, tc[1]};
+  texture(tc2, clut, clut_header->wd, clut_header->ht, rbrb+2);
+  texture(tcL, clut, clut_header->wd, clut_header->ht, L2);
+  const float L = mix(L2[0], L2[1], temp);
+  const float rb[2] = {
     mix(rbrb[0], rbrb[2], temp),
     mix(rbrb[1], rbrb[3], temp)};
-  out[0] =  rb[0]            * L * b;
-  out[1] = (1.0-rb[0]-rb[1]) * L * b;
-  out[2] =  rb[1]            * L * b;
+  out[0] =  rb[0]             * L * b;
+  out[1] = (1.0f-rb[0]-rb[1]) * L * b;
+  out[2] =  rb[1]             * L * b;
+}
+
+typedef struct eval_clut_job_t
+{
+  const dt_lut_header_t *header;
+  const uint16_t        *clut;
+  float                  temp;
+  const float           *cam_rgb;
+  float                 *xyz;
+}
+eval_clut_job_t;
+
+static void
+eval_clut_work(uint32_t beg, uint32_t end, void *arg)
+{
+  const eval_clut_job_t *job = arg;
+  for(int k=beg;k<end;k++)
+  {
+    float rec2020[3];
+    process_clut(job->header, job->clut, job->cam_rgb+3*k, rec2020, job->temp);
+    float *xyz = job->xyz + 3*k;
+    xyz[0] = xyz[1] = xyz[2] = 0.0f;
+    for(int j=0;j<3;j++)
+      for(int i=0;i<3;i++)
+        xyz[j] += rec2020_to_xyz[j][i] * rec2020[i];
+  }
 }
 
+// evaluate the whole batch of samples at once, in parallel
 void
 eval_clut(
     const char  *filename,
@@ -130,21 +160,14 @@ eval_clut(
   dt_lut_header_t header;
   uint16_t *clut = load_clut(filename, &header);
   if(!clut) return;
-
-  for(int k=0;k<num;k++)
-  {
-    float rec2020[3];
-    process_clut(&header, clut, cam_rgb+3*k, rec2020, T);
-    xyz[3*k+0] = xyz[3*k+1] = xyz[3*k+2] = 0.0f;
-    for(int j=0;j<3;j++)
-      for(int i=0;i<3;i++)
-        xyz[3*k+j] += rec2020_to_xyz[j][i] * rec2020[i];
-    // fprintf(stderr, "out xyz %g %g %g\n", xyz[3*k+0], xyz[3*k+1], xyz[3*k+2]);
-    // fprintf(stderr, "cam rgb vs xyz %g %g %g -- %g %g %g\n",
-    //     cam_rgb[3*k+0], cam_rgb[3*k+1], cam_rgb[3*k+2],
-    //     xyz[3*k+0], xyz[3*k+1], xyz[3*k+2]);
-    // fprintf(stderr, "rec 2020: %g %g %g\n", rec2020[0], rec2020[1], rec2020[2]);
-  }
+  eval_clut_job_t job = {
+    .header  = &header,
+    .clut    = clut,
+    .temp    = clut_temp(T),
+    .cam_rgb = cam_rgb,
+    .xyz     = xyz,
+  };
+  threads_parallel_for(0, num, 1024, eval_clut_work, &job);
   free(clut);
 }
 
@@ -175,18 +198,24 @@ eval_dcp(
   dng_cleanup(&p);
 }
 
-static inline int
-test_dataset_cc24(
-    const char   *ssf_filename,
-    const double *ill,          // for instance cie_d65 or cie_a
-    float       **cam_rgb,      // illuminant * cc24 * camera ssf
-    float       **xyz)          // d65 * cc24 * cie cmf (since the built-in wb is meant for rec2020 which is d65)
+// the parts of the integrands which are the same for every sample of a
+// dataset: the reference illuminant times the cie cmf, and the test
+// illuminant times the camera ssf.
+typedef struct eval_weights_t
 {
-  *xyz     = malloc(sizeof(float)*3*24);
-  *cam_rgb = malloc(sizeof(float)*3*24);
-  float (*res)[3] = (float (*)[3])*cam_rgb;
-  float (*ref)[3] = (float (*)[3])*xyz;
+  double lambda[CIE2_SAMPLES];
+  double ref[CIE2_SAMPLES][3];
+  double cam[CIE2_SAMPLES][3];
+  double norm; // integration step
+}
+eval_weights_t;
 
+static inline void
+eval_weights_init(
+    eval_weights_t *w,
+    const char     *ssf_filename,
+    const double   *ill)           // for instance cie_d65 or cie_a
+{
   double *dat = malloc(sizeof(double)*1000*4);
   double (*cfa_spec)[4] = (double (*)[4])dat;
   int cfa_spec_cnt = spectrum_load(ssf_filename, cfa_spec);
@@ -196,44 +225,78 @@ test_dataset_cc24(
     exit(2);
   }
   const double *ref_ill = cie_d65; // dcp goes d50, our lut goes d65/rec2020
-  for(int s=0;s<24;s++) res[s][0] = res[s][1] = res[s][2] = 0.0;
-  for(int s=0;s<24;s++) ref[s][0] = ref[s][1] = ref[s][2] = 0.0;
   const int cnt = CIE2_SAMPLES;
   for(int i=0;i<cnt;i++)
   {
-    double wavelength = CIE2_LAMBDA_MIN + ((CIE2_LAMBDA_MAX-CIE2_LAMBDA_MIN) * i)/cnt;
-    for(int s=0;s<24;s++)
+    const double wavelength = CIE2_LAMBDA_MIN + ((CIE2_LAMBDA_MAX-CIE2_LAMBDA_MIN) * i)/cnt;
+    w->lambda[i] = wavelength;
+    w->ref[i][0] = cie_interp(ref_ill, wavelength) * cie_interp(cie_x, wavelength);
+    w->ref[i][1] = cie_interp(ref_ill, wavelength) * cie_interp(cie_y, wavelength);
+    w->ref[i][2] = cie_interp(ref_ill, wavelength) * cie_interp(cie_z, wavelength);
+    for(int k=0;k<3;k++)
+      w->cam[i][k] = cie_interp(ill, wavelength) * spectrum_interp(cfa_spec, cfa_spec_cnt, k, wavelength);
+  }
+  free(dat);
+  w->norm = (cc24_wavelengths[cc24_nwavelengths-1] - cc24_wavelengths[0]) / (double)cnt;
+}
+
+static inline int
+test_dataset_cc24(
+    const char   *ssf_filename,
+    const double *ill,          // for instance cie_d65 or cie_a
+    float       **cam_rgb,      // illuminant * cc24 * camera ssf
+    float       **xyz)          // d65 * cc24 * cie cmf (since the built-in wb is meant for rec2020 which is d65)
+{
+  *xyz     = malloc(sizeof(float)*3*24);
+  *cam_rgb = malloc(sizeof(float)*3*24);
+  float (*res)[3] = (float (*)[3])*cam_rgb;
+  float (*ref)[3] = (float (*)[3])*xyz;
+
+  eval_weights_t w;
+  eval_weights_init(&w, ssf_filename, ill);
+  for(int s=0;s<24;s++)
+  {
+    double r[3] = {0.0}, c[3] = {0.0};
+    for(int i=0;i<CIE2_SAMPLES;i++)
     {
-       ref[s][0] += cc24_interp(cc24_spectra[s], wavelength)
-         * cie_interp(ref_ill, wavelength)
-         * cie_interp(cie_x,   wavelength);
-       ref[s][1] += cc24_interp(cc24_spectra[s], wavelength)
-         * cie_interp(ref_ill, wavelength)
-         * cie_interp(cie_y,   wavelength);
-       ref[s][2] += cc24_interp(cc24_spectra[s], wavelength)
-         * cie_interp(ref_ill, wavelength)
-         * cie_interp(cie_z,   wavelength);
-       res[s][0] += cc24_interp(cc24_spectra[s], wavelength)
-         * cie_interp(ill, wavelength)
-         * spectrum_interp(cfa_spec, cfa_spec_cnt, 0, wavelength);
-       res[s][1] += cc24_interp(cc24_spectra[s], wavelength)
-         * cie_interp(ill, wavelength)
-         * spectrum_interp(cfa_spec, cfa_spec_cnt, 1, wavelength);
-       res[s][2] += cc24_interp(cc24_spectra[s], wavelength)
-         * cie_interp(ill, wavelength)
-         * spectrum_interp(cfa_spec, cfa_spec_cnt, 2, wavelength);
+      const double refspec = cc24_interp(cc24_spectra[s], w.lambda[i]);
+      for(int k=0;k<3;k++) r[k] += refspec * w.ref[i][k];
+      for(int k=0;k<3;k++) c[k] += refspec * w.cam[i][k];
     }
+    for(int k=0;k<3;k++) ref[s][k] = r[k] * w.norm;
+    for(int k=0;k<3;k++) res[s][k] = c[k] * w.norm;
   }
-  free(dat);
-  for(int s=0;s<24;s++) for(int k=0;k<3;k++)
-    res[s][k] *= (cc24_wavelengths[cc24_nwavelengths-1] - cc24_wavelengths[0]) /
-      (double)cnt;
-  for(int s=0;s<24;s++) for(int k=0;k<3;k++)
-    ref[s][k] *= (cc24_wavelengths[cc24_nwavelengths-1] - cc24_wavelengths[0]) /
-      (double)cnt;
   return 24;
 }
 
+typedef struct test_sig_job_t
+{
+  const eval_weights_t *w;
+  const double         *cf;  // sigmoid coefficients per sample
+  float               (*ref)[3];
+  float               (*res)[3];
+}
+test_sig_job_t;
+
+static void
+test_sig_work(uint32_t beg, uint32_t end, void *arg)
+{
+  const test_sig_job_t *job = arg;
+  const eval_weights_t *w = job->w;
+  for(int s=beg;s<end;s++)
+  {
+    double r[3] = {0.0}, c[3] = {0.0};
+    for(int i=0;i<CIE2_SAMPLES;i++)
+    {
+      const double refspec = sigmoid(poly(job->cf+3*s, w->lambda[i], 3));
+      for(int k=0;k<3;k++) r[k] += refspec * w->ref[i][k];
+      for(int k=0;k<3;k++) c[k] += refspec * w->cam[i][k];
+    }
+    for(int k=0;k<3;k++) job->ref[s][k] = r[k] * w->norm;
+    for(int k=0;k<3;k++) job->res[s][k] = c[k] * w->norm;
+  }
+}
+
 static inline int
 test_dataset_sig(
     const char   *ssf_filename,
@@ -257,69 +320,37 @@ test_dataset_sig(
   const int num = num_s * num_t;
   *xyz     = malloc(sizeof(float)*3*num);
   *cam_rgb = malloc(sizeof(float)*3*num);
-  float (*res)[3] = (float (*)[3])*cam_rgb;
-  float (*ref)[3] = (float (*)[3])*xyz;
 
-  double *dat = malloc(sizeof(double)*1000*4);
-  double (*cfa_spec)[4] = (double (*)[4])dat;
-  int cfa_spec_cnt = spectrum_load(ssf_filename, cfa_spec);
-  if(!cfa_spec_cnt)
+  eval_weights_t wgt;
+  eval_weights_init(&wgt, ssf_filename, ill);
+  double *cf = malloc(sizeof(double)*3*num);
+  for(int s=0;s<num_s;s++) for(int t=0;t<num_t;t++)
   {
-    fprintf(stderr, "[eval-profile] could not open %s.txt!\n", ssf_filename);
-    exit(2);
-  }
-  const double *ref_ill = cie_d65; // dcp goes d50, our lut goes d65/rec2020
-  for(int s=0;s<num;s++) res[s][0] = res[s][1] = res[s][2] = 0.0;
-  for(int s=0;s<num;s++) ref[s][0] = ref[s][1] = ref[s][2] = 0.0;
-  const int cnt = CIE2_SAMPLES;
-  for(int i=0;i<cnt;i++)
-  {
-    double wavelength = CIE2_LAMBDA_MIN + ((CIE2_LAMBDA_MAX-CIE2_LAMBDA_MIN) * i)/cnt;
-    for(int s=0;s<num_s;s++) for(int t=0;t<num_t;t++)
-    {
-      int idx = s*num_t + t;
-      const float w[] = {1.0/3.0, 1.0/3.0}; // illuminant E white
-      float alpha = 2.0*M_PI*(s+0.5)/num_s;
-      float out[2] = { w[0] + cosf(alpha), w[1] + sinf(alpha) };
-      const int cnt = sizeof(dt_spectrum_clip)/2/sizeof(dt_spectrum_clip[0]);
-      dt_spectrum_clip_poly(dt_spectrum_clip, cnt, w, out);
-      // now "out" is on the spectral locus
-      double xy[2] = {out[0], out[1]};
+    int idx = s*num_t + t;
+    const float w[] = {1.0/3.0, 1.0/3.0}; // illuminant E white
+    float alpha = 2.0*M_PI*(s+0.5)/num_s;
+    float out[2] = { w[0] + cosf(alpha), w[1] + sinf(alpha) };
+    const int cnt = sizeof(dt_spectrum_clip)/2/sizeof(dt_spectrum_clip[0]);
+    dt_spectrum_clip_poly(dt_spectrum_clip, cnt, w, out);
+    // now "out" is on the spectral locus
+    double xy[2] = {out[0], out[1]};
 
-      double tt = num_t == 1 ? 0.9 : (t+0.5)/num_t; // part of way to fall off the spectral locus
-      xy[0] = tt * xy[0] + (1.0-tt) * 1.0/3.0;
-      xy[1] = tt * xy[1] + (1.0-tt) * 1.0/3.0;
-      double cf[3]; // look up the coeffs for the sampled colour spectrum
-      fetch_coeffi(xy, sp_buf, sp_header.wd, sp_header.ht, cf); // nearest
-      double refspec = sigmoid(poly(cf, wavelength, 3));
-      // if(!s) refspec = 1.0; // some reference white to adjust exposure/wb
-      ref[idx][0] += refspec
-        * cie_interp(ref_ill, wavelength)
-        * cie_interp(cie_x,   wavelength);
-      ref[idx][1] += refspec
-        * cie_interp(ref_ill, wavelength)
-        * cie_interp(cie_y,   wavelength);
-      ref[idx][2] += refspec
-        * cie_interp(ref_ill, wavelength)
-        * cie_interp(cie_z,   wavelength);
-      res[idx][0] += refspec
-        * cie_interp(ill, wavelength)
-        * spectrum_interp(cfa_spec, cfa_spec_cnt, 0, wavelength);
-      res[idx][1] += refspec
-        * cie_interp(ill, wavelength)
-        * spectrum_interp(cfa_spec, cfa_spec_cnt, 1, wavelength);
-      res[idx][2] += refspec
-        * cie_interp(ill, wavelength)
-        * spectrum_interp(cfa_spec, cfa_spec_cnt, 2, wavelength);
-    }
+    double tt = num_t == 1 ? 0.9 : (t+0.5)/num_t; // part of way to fall off the spectral locus
+    xy[0] = tt * xy[0] + (1.0-tt) * 1.0/3.0;
+    xy[1] = tt * xy[1] + (1.0-tt) * 1.0/3.0;
+    // look up the coeffs for the sampled colour spectrum
+    fetch_coeffi(xy, sp_buf, sp_header.wd, sp_header.ht, cf+3*idx); // nearest
   }
-  free(dat);
-  for(int s=0;s<num;s++) for(int k=0;k<3;k++)
-    res[s][k] *= (cc24_wavelengths[cc24_nwavelengths-1] - cc24_wavelengths[0]) /
-      (double)cnt;
-  for(int s=0;s<num;s++) for(int k=0;k<3;k++)
-    ref[s][k] *= (cc24_wavelengths[cc24_nwavelengths-1] - cc24_wavelengths[0]) /
-      (double)cnt;
+  free(sp_buf);
+
+  test_sig_job_t job = {
+    .w   = &wgt,
+    .cf  = cf,
+    .ref = (float (*)[3])*xyz,
+    .res = (float (*)[3])*cam_rgb,
+  };
+  threads_parallel_for(0, num, 256, test_sig_work, &job);
+  free(cf);
   return num;
 }
 
@@ -382,6 +413,7 @@ int main(int argc, char *argv[])
   // if(temp0 > 0) init_blackbody(illbb, temp0); // XXX TODO: init from blackbody
   // XXX parse!
 
+  threads_global_init();
   const int num_sets = print_extra ? 3 : 2;
   for(int set=0;set<num_sets;set++)
   { // create ground truth datasets:
@@ -468,6 +500,7 @@ int main(int argc, char *argv[])
     free(cam_rgb);
     free(xyz);
   }
+  threads_global_cleanup();
 
   exit(0);
 }
@@ -7,6 +7,7 @@
 #include "core/fs.h"
 #include "core/half.h"
 #include "core/inpaint.h"
+#include "core/threads.h"
 
 #if 0
 // XXX DEBUG write just the matrix from xyz to rec2020 for precision checks:
@@ -47,6 +48,72 @@ create_chroma_lut_DEBUG(
 }
 #endif
 
+// spectral integration of one sample of the spectra.lut grid
+typedef struct clut_sample_t
+{
+  double u0, u1;     // camera rgb chromaticity, quad coordinates
+  double rec2020[2]; // reference rec2020 chromaticity (second pass)
+  double L;          // reference over camera brightness (second pass)
+  float  sat;        // saturation of the sampled xy
+  int    valid;      // inside the spectral locus
+}
+clut_sample_t;
+
+typedef struct clut_job_t
+{
+  const float           *spectra;
+  const dt_lut_header_t *sh;
+  const double         (*cfa_spec)[4];
+  int                    cfa_spec_cnt;
+  const double         (*cie_spec)[4];
+  int                    cie_spec_cnt;
+  double                 ref_L;
+  int                    pass;  // 0: nearest coefficients, camera rgb only. 1: interpolated, with reference
+  clut_sample_t         *smp;   // sh->wd * sh->ht results
+}
+clut_job_t;
+
+// integrate rows [beg, end) of the sample grid. the samples are independent,
+// everything that depends on the order of the samples is done afterwards.
+static void
+clut_work(uint32_t beg, uint32_t end, void *arg)
+{
+  const clut_job_t *job = arg;
+  const int swd = job->sh->wd, sht = job->sh->ht;
+  for(int j=beg;j<end;j++) for(int i=0;i<swd;i++)
+  {
+    clut_sample_t *smp = job->smp + j*swd + i;
+    double xy[2] = {(i+0.5)/swd, (j+0.5)/sht};
+    quad2tri(xy+0, xy+1);
+    double cf[3]; // look up the coeffs for the sampled colour spectrum
+    if(job->pass) fetch_coeff (xy, job->spectra, swd, sht, cf); // interpolate
+    else          fetch_coeffi(xy, job->spectra, swd, sht, cf); // nearest
+    smp->valid = cf[0] != 0; // discard out of spectral locus
+    if(!smp->valid) continue;
+
+    double cam_rgb_spec[3]; // camera rgb by processing spectrum * cfa spectrum
+    spectrum_integrate3(job->cfa_spec, job->cfa_spec_cnt, cf, 3, cam_rgb_spec);
+    const double cam_rgb_L1 = normalise1(cam_rgb_spec);
+    if(job->pass)
+    {
+      double xyz_spec[3];
+      spectrum_integrate3(job->cie_spec, job->cie_spec_cnt, cf, 3, xyz_spec);
+      double rec2020[3];
+      mat3_mulv(xyz_to_rec2020, xyz_spec, rec2020);
+      const double rec2020_L1 = normalise1(rec2020) * job->ref_L;
+      smp->rec2020[0] = rec2020[0];
+      smp->rec2020[1] = rec2020[2];
+      smp->L = rec2020_L1 / cam_rgb_L1;
+    }
+    float fxy[] = {xy[0], xy[1]}, white[] = {1.0f/3.0f, 1.0f/3.0f};
+    smp->sat = dt_spectrum_saturation(fxy, white);
+    // convert tri t to quad u:
+    smp->u0 = cam_rgb_spec[0];
+    smp->u1 = cam_rgb_spec[2];
+    tri2quad(&smp->u0, &smp->u1);
+  }
+}
+
 // create 2.5D chroma lut
 static inline float*
 create_chroma_lut(
@@ -68,98 +135,76 @@ create_chroma_lut(
   // do two passes over the data
   // get illum E white point (lowest saturation) in camera rgb and quad param:
   const double wcf[] = {0.0, 0.0, 100000.0}; // illuminant E
-  double white_cam_rgb[3] = {
-    spectrum_integrate(cfa_spec, 0, cfa_spec_cnt, wcf, 3),
-    spectrum_integrate(cfa_spec, 1, cfa_spec_cnt, wcf, 3),
-    spectrum_integrate(cfa_spec, 2, cfa_spec_cnt, wcf, 3)};
+  double white_cam_rgb[3];
+  spectrum_integrate3(cfa_spec, cfa_spec_cnt, wcf, 3, white_cam_rgb);
   const double white_cam_rgb_L1 = normalise1(white_cam_rgb);
   tri2quad(white_cam_rgb, white_cam_rgb+2);
-  double xyz_spec[3] = {0.0};
-  for(int k=0;k<3;k++)
-    xyz_spec[k] = spectrum_integrate(cie_spec, k, cie_spec_cnt, wcf, 3);
+  double xyz_spec[3];
+  spectrum_integrate3(cie_spec, cie_spec_cnt, wcf, 3, xyz_spec);
   double rec2020[3];
   mat3_mulv(xyz_to_rec2020, xyz_spec, rec2020);
   const double white_rec2020_L1 = normalise1(rec2020);
   const double ref_L = white_cam_rgb_L1 / white_rec2020_L1;
 
+  // the spectral integration of the samples runs in parallel, the
+  // order dependent binning and splatting below stays serial.
+  clut_job_t job = {
+    .spectra      = spectra,
+    .sh           = sh,
+    .cfa_spec     = cfa_spec,
+    .cfa_spec_cnt = cfa_spec_cnt,
+    .cie_spec     = cie_spec,
+    .cie_spec_cnt = cie_spec_cnt,
+    .ref_L        = ref_L,
+    .smp          = calloc(sizeof(clut_sample_t), swd*(uint64_t)sht),
+  };
+
   // first pass: get rough idea about max deviation from white and the saturation we got there
   double *angular_ds = calloc(sizeof(double), 360*2);
-  int sample_wd = swd, sample_ht = sht;
-  for(int j=0;j<sample_ht;j++) for(int i=0;i<sample_wd;i++)
+  threads_parallel_for(0, sht, 1, clut_work, &job);
+  for(int k=0;k<swd*sht;k++)
   {
-    double xy[2] = {(i+0.5)/sample_wd, (j+0.5)/sample_ht};
-    quad2tri(xy+0, xy+1);
-    double cf[3]; // look up the coeffs for the sampled colour spectrum
-    fetch_coeffi(xy, spectra, sh->wd, sh->ht, cf); // nearest
-    if(cf[0] == 0) continue; // discard out of spectral locus
-    double cam_rgb_spec[3] = {0.0}; // camera rgb by processing spectrum * cfa spectrum
-    for(int k=0;k<3;k++)
-      cam_rgb_spec[k] = spectrum_integrate(cfa_spec, k, cfa_spec_cnt, cf, 3);
-    normalise1(cam_rgb_spec);
-    double u0 = cam_rgb_spec[0], u1 = cam_rgb_spec[2];
-    tri2quad(&u0, &u1);
-    float fxy[] = {xy[0], xy[1]}, white[] = {1.0f/3.0f, 1.0f/3.0f};
-    float sat = dt_spectrum_saturation(fxy, white);
+    const clut_sample_t *smp = job.smp + k;
+    if(!smp->valid) continue;
     // find angular max dist + sat
-    int bin = CLAMP(180.0/M_PI * (M_PI + atan2(u1-white_cam_rgb[2], u0-white_cam_rgb[0])), 0, 359);
+    int bin = CLAMP(180.0/M_PI * (M_PI + atan2(smp->u1-white_cam_rgb[2], smp->u0-white_cam_rgb[0])), 0, 359);
     double dist2 =
-      (u1-white_cam_rgb[2])*(u1-white_cam_rgb[2])+
-      (u0-white_cam_rgb[0])*(u0-white_cam_rgb[0]);
+      (smp->u1-white_cam_rgb[2])*(smp->u1-white_cam_rgb[2])+
+      (smp->u0-white_cam_rgb[0])*(smp->u0-white_cam_rgb[0]);
     if(dist2 > angular_ds[2*bin])
     {
       angular_ds[2*bin+0] = dist2;
-      angular_ds[2*bin+1] = sat;
+      angular_ds[2*bin+1] = smp->sat;
     }
   }
 
   // 2nd pass:
-// #pragma omp parallel for schedule(dynamic) collapse(2) default(shared)
-  for(int j=0;j<sht;j++) for(int i=0;i<swd;i++)
+  job.pass = 1;
+  threads_parallel_for(0, sht, 1, clut_work, &job);
+  for(int k=0;k<swd*sht;k++)
   {
-    double xy[2] = {(i+0.5)/swd, (j+0.5)/sht};
-    quad2tri(xy+0, xy+1);
-
-    double cf[3]; // look up the coeffs for the sampled colour spectrum
-    fetch_coeff(xy, spectra, sh->wd, sh->ht, cf); // interpolate
-    // fetch_coeffi(xy, spectra, sh->wd, sh->ht, cf); // nearest
-    if(cf[0] == 0) continue; // discard out of spectral locus
-
-    double cam_rgb_spec[3] = {0.0}; // camera rgb by processing spectrum * cfa spectrum
-    for(int k=0;k<3;k++)
-      cam_rgb_spec[k] = spectrum_integrate(cfa_spec, k, cfa_spec_cnt, cf, 3);
-    const double cam_rgb_L1 = normalise1(cam_rgb_spec);
-    double xyz_spec[3] = {0.0}; // camera rgb by processing spectrum * cfa spectrum
-    for(int k=0;k<3;k++)
-      xyz_spec[k] = spectrum_integrate(cie_spec, k, cie_spec_cnt, cf, 3);
-    double rec2020[3];
-    mat3_mulv(xyz_to_rec2020, xyz_spec, rec2020);
-    const double rec2020_L1 = normalise1(rec2020) * ref_L;
-
-    float fxy[] = {xy[0], xy[1]}, white[2] = {1.0f/3.0f, 1.0f/3.0f};
-    float sat = dt_spectrum_saturation(fxy, white);
-
-    // convert tri t to quad u:
-    double u0 = cam_rgb_spec[0], u1 = cam_rgb_spec[2];
-    tri2quad(&u0, &u1);
-
+    const clut_sample_t *smp = job.smp + k;
+    if(!smp->valid) continue;
+    const double u0 = smp->u0, u1 = smp->u1;
     int bin = CLAMP(180.0/M_PI * (M_PI + atan2(u1-white_cam_rgb[2], u0-white_cam_rgb[0])), 0, 359);
     double dist2 =
       (u1-white_cam_rgb[2])*(u1-white_cam_rgb[2])+
       (u0-white_cam_rgb[0])*(u0-white_cam_rgb[0]);
-    if(dist2 < angular_ds[2*bin] && sat > angular_ds[2*bin+1])
+    if(dist2 < angular_ds[2*bin] && smp->sat > angular_ds[2*bin+1])
       continue; // discard higher xy sat for lower rgb sat
-    if(dist2 < 0.8*0.8*angular_ds[2*bin] && sat > 0.95*angular_ds[2*bin+1])
+    if(dist2 < 0.8*0.8*angular_ds[2*bin] && smp->sat > 0.95*angular_ds[2*bin+1])
       continue; // be harsh to values straddling our bounds
 
     // sort this into rb/sum(rgb) map in camera rgb
     int ii = CLAMP(u0 * wd + 0.5, 0, wd-1);
     int jj = CLAMP(u1 * ht + 0.5, 0, ht-1);
 
-    buf[3*(jj*wd + ii)+0] = rec2020[0];
-    buf[3*(jj*wd + ii)+1] = rec2020[2];
-    buf[3*(jj*wd + ii)+2] = rec2020_L1 / cam_rgb_L1;
+    buf[3*(jj*wd + ii)+0] = smp->rec2020[0];
+    buf[3*(jj*wd + ii)+1] = smp->rec2020[1];
+    buf[3*(jj*wd + ii)+2] = smp->L;
   }
   free(angular_ds);
+  free(job.smp);
 
   *wd_out = wd;
   *ht_out = ht;
@@ -240,6 +285,7 @@ int main(int argc, char *argv[])
     exit(1);
   }
 
+  threads_global_init();
   dt_lut_header_t sp_header;
   char filename[PATH_MAX+30], basedir[PATH_MAX];
   fs_basedir(basedir, sizeof(basedir));
@@ -336,6 +382,7 @@ int main(int argc, char *argv[])
   free(sp_buf);
   free(clut0);
   free(clut1);
+  threads_global_cleanup();
 
   exit(0);
 }
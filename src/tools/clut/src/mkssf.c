@@ -2,6 +2,7 @@
 #include "core/solve.h"
 #include "core/lut.h"
 #include "core/fs.h"
+#include "core/threads.h"
 #include "cie1931.h"
 #include "cc24.h"
 #include "sigmoid.h"
@@ -155,23 +156,25 @@ void integrate_cfa_upsample(
     const double *cfa_p,      // opaque parameters to cfa subsystem
     const double *ill)        // pass cie_a or cie_d65 here
 {
+  double c[upsample_cnt][3]; // sigmoid coefficients don't depend on the wavelength
   for(int s=0;s<upsample_cnt;s++)
+  {
+    fetch_coeff(upsample_xy[s], lut_buf, lut_header.wd, lut_header.ht, c[s]);
     res[s][0] = res[s][1] = res[s][2] = 0.0;
+  }
   for(int i=0;i<cc24_nwavelengths;i++)
-  {
+  { // illuminant times cfa once per wavelength, the inner loop over samples is plain arithmetic
+    const double lambda = cc24_wavelengths[i];
+    const double e = cie_interp(ill, lambda);
+    const double w0 = e * cfa_red  (cfa_model, cfa_num_coeff, cfa_p+0*cfa_num_coeff, lambda);
+    const double w1 = e * cfa_green(cfa_model, cfa_num_coeff, cfa_p+1*cfa_num_coeff, lambda);
+    const double w2 = e * cfa_blue (cfa_model, cfa_num_coeff, cfa_p+2*cfa_num_coeff, lambda);
     for(int s=0;s<upsample_cnt;s++)
     {
-      double c[3];
-      fetch_coeff(upsample_xy[s], lut_buf, lut_header.wd, lut_header.ht, c);
-      res[s][0] += sigmoid(poly(c, cc24_wavelengths[i], 3)) *
-        cie_interp(ill, cc24_wavelengths[i]) *
-        cfa_red  (cfa_model, cfa_num_coeff, cfa_p+0*cfa_num_coeff, cc24_wavelengths[i]);
-      res[s][1] += sigmoid(poly(c, cc24_wavelengths[i], 3)) *
-        cie_interp(ill, cc24_wavelengths[i]) *
-        cfa_green(cfa_model, cfa_num_coeff, cfa_p+1*cfa_num_coeff, cc24_wavelengths[i]);
-      res[s][2] += sigmoid(poly(c, cc24_wavelengths[i], 3)) *
-        cie_interp(ill, cc24_wavelengths[i]) *
-        cfa_blue (cfa_model, cfa_num_coeff, cfa_p+2*cfa_num_coeff, cc24_wavelengths[i]);
+      const double v = sigmoid(poly(c[s], lambda, 3));
+      res[s][0] += v * w0;
+      res[s][1] += v * w1;
+      res[s][2] += v * w2;
     }
   }
   for(int s=0;s<upsample_cnt;s++) for(int k=0;k<3;k++)
@@ -189,17 +192,16 @@ void integrate_cfa(
     res[s][0] = res[s][1] = res[s][2] = 0.0;
   for(int i=0;i<cc24_nwavelengths;i++)
   {
+    const double lambda = cc24_wavelengths[i];
+    const double e = cie_interp(ill, lambda);
+    const double w0 = e * cfa_red  (cfa_model, cfa_num_coeff, cfa_p+0*cfa_num_coeff, lambda);
+    const double w1 = e * cfa_green(cfa_model, cfa_num_coeff, cfa_p+1*cfa_num_coeff, lambda);
+    const double w2 = e * cfa_blue (cfa_model, cfa_num_coeff, cfa_p+2*cfa_num_coeff, lambda);
     for(int s=0;s<24;s++)
     {
-       res[s][0] += cc24_spectra[s][i] * 
-         cie_interp(ill, cc24_wavelengths[i]) *
-         cfa_red  (cfa_model, cfa_num_coeff, cfa_p+0*cfa_num_coeff, cc24_wavelengths[i]);
-       res[s][1] += cc24_spectra[s][i] *
-         cie_interp(ill, cc24_wavelengths[i]) *
-         cfa_green(cfa_model, cfa_num_coeff, cfa_p+1*cfa_num_coeff, cc24_wavelengths[i]);
-       res[s][2] += cc24_spectra[s][i] *
-         cie_interp(ill, cc24_wavelengths[i]) *
-         cfa_blue (cfa_model, cfa_num_coeff, cfa_p+2*cfa_num_coeff, cc24_wavelengths[i]);
+      res[s][0] += cc24_spectra[s][i] * w0;
+      res[s][1] += cc24_spectra[s][i] * w1;
+      res[s][2] += cc24_spectra[s][i] * w2;
     }
   }
   for(int s=0;s<24;s++) for(int k=0;k<3;k++)
@@ -331,6 +333,53 @@ double objective(double *p, void *data)
   return err;
 }
 
+typedef void (*loss_fn_t)(double *p, double *x, int m, int n, void *data);
+
+typedef struct fd_job_t
+{
+  loss_fn_t     loss;
+  const double *p;   // point to differentiate at
+  const double *h;   // step size per parameter
+  double       *jac; // output, one entry per parameter
+  int           m;
+  void         *data;
+}
+fd_job_t;
+
+static void
+loss_fd_work(uint32_t beg, uint32_t end, void *arg)
+{
+  const fd_job_t *job = arg;
+  const int m = job->m;
+  for(int j=beg;j<end;j++)
+  {
+    double X1, X2, p2[m];
+    memcpy(p2, job->p, sizeof(p2));
+    p2[j] += job->h[j];
+    job->loss(p2, &X1, m, 1, job->data);
+    memcpy(p2, job->p, sizeof(p2));
+    p2[j] -= job->h[j];
+    job->loss(p2, &X2, m, 1, job->data);
+    job->jac[j] = (X1 - X2) / (2.0*job->h[j]);
+  }
+}
+
+// central differences, one parameter per task. the loss functions only read
+// global state, the random step sizes are drawn up front to keep the sequence.
+static void
+loss_fd(
+    loss_fn_t loss,
+    double   *p,
+    double   *jac,
+    int       m,
+    void     *data)
+{
+  double h[m];
+  for(int j=0;j<m;j++) h[j] = 1e-4 + xrand()*1e-5;
+  fd_job_t job = { .loss = loss, .p = p, .h = h, .jac = jac, .m = m, .data = data };
+  threads_parallel_for(0, m, 1, loss_fd_work, &job);
+}
+
 void loss_dif(
     double *p,   // parameters
     double *jac, // output: derivative dx / dp (n x m entries, n-major, i.e. (dx[0]/dp[0], dx[0]/dp[1], ..)
@@ -338,18 +387,7 @@ void loss_dif(
     int     n,   // number of data points (=1)
     void   *data)
 {
-  for(int j=0;j<m;j++)
-  {
-    double X1, X2, p2[m];
-    const double h = 1e-4 + xrand()*1e-5;
-    memcpy(p2, p, sizeof(p2));
-    p2[j] += h;
-    loss(p2, &X1, m, n, data);
-    memcpy(p2, p, sizeof(p2));
-    p2[j] -= h;
-    loss(p2, &X2, m, n, data);
-    jac[j] = (X1 - X2) / (2.0*h);
-  }
+  loss_fd(loss, p, jac, m, data);
 }
 
 void loss_pictures_dif(
@@ -359,18 +397,7 @@ void loss_pictures_dif(
     int     n,   // number of data points (=1)
     void   *data)
 {
-  for(int j=0;j<m;j++)
-  {
-    double X1, X2, p2[m];
-    const double h = 1e-4 + xrand()*1e-5;
-    memcpy(p2, p, sizeof(p2));
-    p2[j] += h;
-    loss_pictures(p2, &X1, m, n, data);
-    memcpy(p2, p, sizeof(p2));
-    p2[j] -= h;
-    loss_pictures(p2, &X2, m, n, data);
-    jac[j] = (X1 - X2) / (2.0*h);
-  }
+  loss_fd(loss_pictures, p, jac, m, data);
 }
 
 void loss_upsample_dif(
@@ -380,23 +407,13 @@ void loss_upsample_dif(
     int     n,   // number of data points (=1)
     void   *data)
 {
-  for(int j=0;j<m;j++)
-  {
-    double X1, X2, p2[m];
-    const double h = 1e-4 + xrand()*1e-5;
-    memcpy(p2, p, sizeof(p2));
-    p2[j] += h;
-    loss_upsample(p2, &X1, m, n, data);
-    memcpy(p2, p, sizeof(p2));
-    p2[j] -= h;
-    loss_upsample(p2, &X2, m, n, data);
-    jac[j] = (X1 - X2) / (2.0*h);
-  }
+  loss_fd(loss_upsample, p, jac, m, data);
 }
 
 
 int main(int argc, char *argv[])
 {
+  threads_global_init();
   // warm up random number generator
   for(int k=0;k<10;k++) xrand();
 
@@ -634,4 +651,5 @@ int main(int argc, char *argv[])
   fprintf(pd, "set output '%s.png'\n", profile_a.model);
   fprintf(pd, "plot '%s' u 1:2 w l lw 5 t 'red', '' u 1:3 w l lw 5 t 'green', '' u 1:4 w l lw 5 t 'blue'\n", datfile);
   pclose(pd);
+  threads_global_cleanup();
 }
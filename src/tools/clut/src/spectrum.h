@@ -23,6 +23,30 @@ spectrum_integrate(
   return out * (cfa_spec[cnt-1][0] - cfa_spec[0][0]) / (double) cnt;
 }
 
+// same as three calls to spectrum_integrate() for the channels 0..2, but
+// evaluates the upsampled spectrum only once per wavelength.
+static inline void
+spectrum_integrate3(
+    const double (*cfa_spec)[4],
+    const int      cnt,
+    const double  *cf,
+    const int      cf_cnt,
+    double        *out)
+{
+  double o0 = 0.0, o1 = 0.0, o2 = 0.0;
+  for(int i=0;i<cnt;i++)
+  {
+    const double s = sigmoid(poly(cf, cfa_spec[i][0], cf_cnt));
+    o0 += s*cfa_spec[i][1];
+    o1 += s*cfa_spec[i][2];
+    o2 += s*cfa_spec[i][3];
+  }
+  const double norm = (cfa_spec[cnt-1][0] - cfa_spec[0][0]) / (double) cnt;
+  out[0] = o0 * norm;
+  out[1] = o1 * norm;
+  out[2] = o2 * norm;
+}
+
 static inline double
 spectrum_interp(
     const double (*spec)[4],
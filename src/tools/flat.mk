@@ -13,23 +13,25 @@ MKSSF_DEPS=tools/clut/src/dngproc.h\
         tools/clut/src/cfa-plain.h\
         tools/clut/src/cfa-sigmoid.h\
         tools/clut/src/cfa-legendre.h\
-        tools/clut/src/cfa-gauss.h
+        tools/clut/src/cfa-gauss.h\
+        core/threads.h
 
 MKCLUT_DEPS=core/inpaint.h \
      core/solve.h \
-     core/clip.h
+     core/clip.h \
+     core/threads.h
 
 ../bin/vkdt-mkssf: tools/clut/src/mkssf.c ${MKSSF_DEPS} Makefile
-	$(CC) $(CFLAGS) $(EXE_CFLAGS) $(OPT_CFLAGS) $(ADD_CFLAGS) $< -o $@ $(LDFLAGS) $(ADD_LDFLAGS)
+	$(CC) $(CFLAGS) $(EXE_CFLAGS) $(OPT_CFLAGS) $(ADD_CFLAGS) $< core/threads.c core/trace.c -o $@ $(LDFLAGS) $(ADD_LDFLAGS) -pthread
 
 ../bin/vkdt-mkclut: tools/clut/src/mkclut.c ${MKCLUT_DEPS} Makefile
-	$(CC) $(CFLAGS) $(EXE_CFLAGS) $(OPT_CFLAGS) $(ADD_CFLAGS) $< -o $@ $(LDFLAGS) $(ADD_LDFLAGS)
+	$(CC) $(CFLAGS) $(EXE_CFLAGS) $(OPT_CFLAGS) $(ADD_CFLAGS) $< core/threads.c core/trace.c -o $@ $(LDFLAGS) $(ADD_LDFLAGS) -pthread
 
 ../bin/vkdt-lutinfo: tools/clut/src/lutinfo.c core/lut.h Makefile
 	$(CC) $(CFLAGS) $(EXE_CFLAGS) $(OPT_CFLAGS) $(ADD_CFLAGS) $< -o $@ $(LDFLAGS) $(ADD_LDFLAGS)
 
 ../bin/vkdt-eval-profile: tools/clut/src/eval.c ${MKSSF_DEPS} Makefile
-	$(CC) $(CFLAGS) $(EXE_CFLAGS) $(OPT_CFLAGS) $(ADD_CFLAGS) $< -o $@ $(LDFLAGS) $(ADD_LDFLAGS)
+	$(CC) $(CFLAGS) $(EXE_CFLAGS) $(OPT_CFLAGS) $(ADD_CFLAGS) $< core/threads.c core/trace.c -o $@ $(LDFLAGS) $(ADD_LDFLAGS) -pthread
 
 ../bin/data/spectra.lut: mkabney macadam.lut Makefile
 	@echo "[tools] precomputing rgb to spectrum upsampling table.."
@@ -39,9 +41,9 @@ MKCLUT_DEPS=core/inpaint.h \
 macadam.lut: macadam
 	./macadam
 
-macadam: tools/spec/macadam.c core/threads.c Makefile
+macadam: tools/spec/macadam.c core/threads.c core/trace.c Makefile
 	@echo "[tools] precomputing max theoretical reflectance brightness.."
-	$(CC) $(CFLAGS) $(OPT_CFLAGS) $(EXE_CFLAGS) $(ADD_CFLAGS) $< core/threads.c -o $@ $(LDFLAGS) $(ADD_LDFLAGS) -pthread
+	$(CC) $(CFLAGS) $(OPT_CFLAGS) $(EXE_CFLAGS) $(ADD_CFLAGS) $< core/threads.c core/trace.c -o $@ $(LDFLAGS) $(ADD_LDFLAGS) -pthread
 
-mkabney: tools/spec/createlut.c core/threads.c Makefile
-	$(CC) $(CFLAGS) $(OPT_CFLAGS) $(EXE_CFLAGS) $(ADD_CFLAGS) $< core/threads.c -o $@ $(LDFLAGS) $(ADD_LDFLAGS) -pthread
+mkabney: tools/spec/createlut.c core/threads.c core/trace.c Makefile
+	$(CC) $(CFLAGS) $(OPT_CFLAGS) $(EXE_CFLAGS) $(ADD_CFLAGS) $< core/threads.c core/trace.c -o $@ $(LDFLAGS) $(ADD_LDFLAGS) -pthread
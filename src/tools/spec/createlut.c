@@ -361,89 +361,133 @@ double max_dist(double theta)
   else return 0.0; // XXX
 }
 
+typedef struct parallel_cell_t
+{
+  float x, y;       // chromaticity of the cell
+  float lamc, satc; // continuous position in the lambda/saturation buffer
+  int   lami, sati; // bin in the lambda/saturation buffer, lami < 0 if outside the spectral locus
+}
+parallel_cell_t;
+
 typedef struct parallel_shared_t
 {
   float *out, *max_b;
   float *lsbuf;
+  parallel_cell_t *cell;
   int max_w, max_h, res;
 }
 parallel_shared_t;
 
-void parallel_run(uint32_t item, void *data)
+// solve rows [beg, end) of the lut. the cells of a row are solved left to
+// right and start from the coefficients of the left neighbour, which are much
+// closer than init_coeffs(). if that doesn't converge, start over from scratch
+// and keep the better fit. binning into the lambda/saturation buffer depends on
+// the order of the cells and is done afterwards in parallel_bin().
+void parallel_run(uint32_t beg, uint32_t end, void *data)
 {
   const parallel_shared_t *const d = data;
-  const int j = item / d->res;
-  const int i = item - j * d->res;
   const int lsres = d->res;
-  if(i == 0)
+  for(int j=beg;j<end;j++)
   {
     printf(".");
     fflush(stdout);
-  }
+    double prev[3];
+    int warm = 0;
+    for(int i=0;i<d->res;i++)
+    {
+      const int idx = j*d->res + i;
+      d->cell[idx].lami = -1;
 
-  double x = (i) / (double)d->res;
-  double y = (j) / (double)d->res;
-  quad2tri(&x, &y);
-  double rgb[3];
-  double coeffs[3];
-  init_coeffs(coeffs);
-  // normalise to max(rgb)=1
-  rgb[0] = x;
-  rgb[1] = y;
-  rgb[2] = 1.0-x-y;
-  if(check_gamut(rgb)) return;
-
-  int ii = (int)fmin(d->max_w - 1, fmax(0, x * d->max_w + 0.5));
-  int jj = (int)fmin(d->max_h - 1, fmax(0, y * d->max_h + 0.5));
-  double m = fmax(0.001, 0.5*d->max_b[ii + d->max_w * jj]);
-  double rgbm[3] = {rgb[0] * m, rgb[1] * m, rgb[2] * m};
-  double resid = gauss_newton(rgbm, coeffs);
+      double x = (i) / (double)d->res;
+      double y = (j) / (double)d->res;
+      quad2tri(&x, &y);
+      double rgb[3];
+      // normalise to max(rgb)=1
+      rgb[0] = x;
+      rgb[1] = y;
+      rgb[2] = 1.0-x-y;
+      if(check_gamut(rgb)) { warm = 0; continue; }
 
-  double c0yl[3];
-  cvt_c012_c0yl(coeffs, c0yl);
-
-  (void)resid;
-  int idx = j*d->res + i;
-  d->out[5*idx + 0] = coeffs[0];
-  d->out[5*idx + 1] = coeffs[1];
-  d->out[5*idx + 2] = coeffs[2];
-
-  float white[2] = {.3127266, .32902313}; // D65
-  // something circular (should be elliptical, says munsell) but smooth:
-  float sat = pow(3.0 * ((x-white[0])*(x-white[0])+(y-white[1])*(y-white[1])), 0.25);
-
-  // bin into lambda/saturation buffer
-  float satc = (lsres-2) * sat; // keep two columns for gamut limits
-  // normalise to extended range:
-  float norm = (c0yl[2] - 400.0)/(700.0-400.0);
-  // float lamc = 1.0/(1.0+exp(-2.0*(2.0*norm-1.0))) * lsres / 2; // center deriv=1
-  // float fx = norm*norm*norm+norm;
-  float fx = norm-0.5;
-  // fx = fx*fx*fx+fx; // worse
-  float lamc = (0.5 + 0.5 * fx / sqrt(fx*fx+0.25)) * lsres / 2;
-  int lami = fmaxf(0, fminf(lsres/2-1, lamc));
-  int sati = satc;
-  if(c0yl[0] > 0) lami += lsres/2;
-  lami = fmaxf(0, fminf(lsres-1, lami));
-  sati = fmaxf(0, fminf(lsres-3, sati));
+      int ii = (int)fmin(d->max_w - 1, fmax(0, x * d->max_w + 0.5));
+      int jj = (int)fmin(d->max_h - 1, fmax(0, y * d->max_h + 0.5));
+      double m = fmax(0.001, 0.5*d->max_b[ii + d->max_w * jj]);
+      double rgbm[3] = {rgb[0] * m, rgb[1] * m, rgb[2] * m};
+      double coeffs[3], resid = 666.0;
+      if(warm)
+      {
+        memcpy(coeffs, prev, sizeof(coeffs));
+        resid = gauss_newton(rgbm, coeffs);
+      }
+      if(!(resid < 1e-3))
+      {
+        double cold[3];
+        init_coeffs(cold);
+        const double rc = gauss_newton(rgbm, cold);
+        if(!(resid <= rc))
+        {
+          memcpy(coeffs, cold, sizeof(coeffs));
+          resid = rc;
+        }
+      }
+      warm = resid < 1e-3;
+      memcpy(prev, coeffs, sizeof(coeffs));
+
+      double c0yl[3];
+      cvt_c012_c0yl(coeffs, c0yl);
+
+      d->out[5*idx + 0] = coeffs[0];
+      d->out[5*idx + 1] = coeffs[1];
+      d->out[5*idx + 2] = coeffs[2];
+
+      float white[2] = {.3127266, .32902313}; // D65
+      // something circular (should be elliptical, says munsell) but smooth:
+      float sat = pow(3.0 * ((x-white[0])*(x-white[0])+(y-white[1])*(y-white[1])), 0.25);
+
+      // bin into lambda/saturation buffer
+      float satc = (lsres-2) * sat; // keep two columns for gamut limits
+      // normalise to extended range:
+      float norm = (c0yl[2] - 400.0)/(700.0-400.0);
+      // float lamc = 1.0/(1.0+exp(-2.0*(2.0*norm-1.0))) * lsres / 2; // center deriv=1
+      // float fx = norm*norm*norm+norm;
+      float fx = norm-0.5;
+      // fx = fx*fx*fx+fx; // worse
+      float lamc = (0.5 + 0.5 * fx / sqrt(fx*fx+0.25)) * lsres / 2;
+      int lami = fmaxf(0, fminf(lsres/2-1, lamc));
+      int sati = satc;
+      if(c0yl[0] > 0) lami += lsres/2;
+      lami = fmaxf(0, fminf(lsres-1, lami));
+      sati = fmaxf(0, fminf(lsres-3, sati));
+      d->cell[idx] = (parallel_cell_t) {
+        .x = x, .y = y, .lamc = lamc, .satc = satc, .lami = lami, .sati = sati };
+      d->out[5*idx + 3] = (lami+0.5f) / (float)lsres;
+      d->out[5*idx + 4] = (sati+0.5f) / (float)lsres;
+    }
+  }
+}
+
+// keep the cell closest to the center of each lambda/saturation bin
+void parallel_bin(uint32_t idx, const parallel_shared_t *d)
+{
+  const int lsres = d->res;
+  const parallel_cell_t *c = d->cell + idx;
+  if(c->lami < 0) return;
+  const int lami = c->lami, sati = c->sati;
   float olamc = d->lsbuf[5*(lami*lsres + sati)+3];
   float osatc = d->lsbuf[5*(lami*lsres + sati)+4];
   float odist = 
     (olamc - lami - 0.5f)*(olamc - lami - 0.5f)+
     (osatc - sati - 0.5f)*(osatc - sati - 0.5f);
   float  dist = 
-    ( lamc - lami - 0.5f)*( lamc - lami - 0.5f)+
-    ( satc - sati - 0.5f)*( satc - sati - 0.5f);
+    ( c->lamc - lami - 0.5f)*( c->lamc - lami - 0.5f)+
+    ( c->satc - sati - 0.5f)*( c->satc - sati - 0.5f);
   if(dist < odist)
   {
-    d->lsbuf[5*(lami*lsres + sati)+0] = x;
-    d->lsbuf[5*(lami*lsres + sati)+1] = y;
-    d->lsbuf[5*(lami*lsres + sati)+2] = 1.0-x-y;
-    d->lsbuf[5*(lami*lsres + sati)+3] = lamc;
-    d->lsbuf[5*(lami*lsres + sati)+4] = satc;
+    d->lsbuf[5*(lami*lsres + sati)+0] = c->x;
+    d->lsbuf[5*(lami*lsres + sati)+1] = c->y;
+    d->lsbuf[5*(lami*lsres + sati)+2] = 1.0-c->x-c->y;
+    d->lsbuf[5*(lami*lsres + sati)+3] = c->lamc;
+    d->lsbuf[5*(lami*lsres + sati)+4] = c->satc;
   }
-  d->out[5*idx + 3] = (lami+0.5f) / (float)lsres;
-  d->out[5*idx + 4] = (sati+0.5f) / (float)lsres;
 }
 
 
@@ -481,8 +525,7 @@ int main(int argc, char **argv)
     uint16_t *half = calloc(sizeof(float), max_w*(uint64_t)max_h);
     fread(half, header.wd*(uint64_t)header.ht, sizeof(uint16_t), f);
     fclose(f);
-    for(uint64_t k=0;k<header.wd*(uint64_t)header.ht;k++)
-      max_b[k] = half_to_float(half[k]);
+    half_to_float_n(half, max_b, header.wd*(uint64_t)header.ht);
     free(half);
     if(0)
     {
@@ -593,6 +636,7 @@ mac_error:
   parallel_shared_t par = (parallel_shared_t) {
     .out   = out,
     .lsbuf = lsbuf,
+    .cell  = calloc(sizeof(parallel_cell_t), res*res),
     .max_b = max_b,
     .max_w = max_w,
     .max_h = max_h,
@@ -600,16 +644,10 @@ mac_error:
   };
 
   threads_global_init();
-#if 0 // note that with proper atomics this is slower than single thread:
-  const int nt = threads_num();
-  int taskid = -1;
-  for(int i=0;i<nt;i++)
-    taskid = threads_task("mkabney", res*res, taskid, &par, parallel_run, 0);
-  threads_wait(taskid);
-#else
+  threads_parallel_for(0, res, 1, parallel_run, &par);
   for(int k=0;k<res*res;k++)
-    parallel_run(k, &par);
-#endif
+    parallel_bin(k, &par);
+  free(par.cell);
 
   { // scope write abney map on (lambda, saturation)
     dt_inpaint_buf_t inpaint_buf = {
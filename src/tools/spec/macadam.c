@@ -26,14 +26,39 @@ const int res = 1024;
 const int max_l = CIE_SAMPLES*2;
 const int incres = 8.0;//64.0;
 
-void parallel_run(uint32_t item, void *data)
+// one box spectrum, rasterised into the map at idx (or -1 if it isn't)
+typedef struct box_t
 {
+  float b, lambda0, lambda1;
+  int   idx;
+}
+box_t;
+
+typedef struct parallel_shared_t
+{
+  box_t    *box;
+  uint64_t *off; // first box of every rising edge iw0
+}
+parallel_shared_t;
+
+static inline int
+box_cnt(int iw0)
+{ // number of falling edges for a rising edge
+  return incres*(max_l-2) - iw0;
+}
+
+// integrate the box spectra of the rising edges [beg, end). these are
+// independent, writing them to the map depends on the order and is done
+// afterwards in main().
+void parallel_run(uint32_t beg, uint32_t end, void *data)
+{
+  const parallel_shared_t *d = data;
   // enumerate all possible box spectra in the sense of [MacAdam 1935],
   // all wavelengths l: l0 <= l <= l1 are s(l) = 1, 0 else:
-  const int iw0 = item;
-  float *buf = data;
+  for(int iw0=beg;iw0<end;iw0++)
   for(int iw1=iw0+1;iw1<=incres*(max_l-2);iw1++)
   {
+    box_t *box = d->box + d->off[iw0] + iw1-iw0-1;
     const float w0 = iw0/(float)incres;
     const float w1 = iw1/(float)incres;
     // compute xy chromaticities:
@@ -67,21 +92,13 @@ void parallel_run(uint32_t item, void *data)
     const float b = X+Y+Z;
     const float x = X/b;
     const float y = Y/b;
+    *box = (box_t){ .b = b, .lambda0 = lambda0, .lambda1 = lambda1, .idx = -1 };
     // rasterize into map
     if(b > 1e-4f && x > 0 && y > 0)
     {
       const int i = x*res+0.5f, j = y*res+0.5f;
       if(i>=0&&i<res&&j>=0&&j<res)
-      {
-        float *v = buf + 4*(j*res+i);
-        // const float n = v[3];
-        // const float t0 = n/(n+1.0), t1 = 1.0/(n+1.0);
-        const float t0 = 0.0f, t1 = 1.0f;
-        v[0] = t0*v[0] + t1*b;
-        v[1] = t0*v[1] + t1*lambda0;
-        v[2] = t0*v[2] + t1*lambda1;
-        v[3] ++ ;
-      }
+        box->idx = j*res+i;
     }
   }
 }
@@ -92,16 +109,28 @@ int main(int argc, char *argv[])
 
   threads_global_init();
   const uint32_t work_item_cnt = incres * (max_l/2-1)+1;
-#if 0
-  const int nt = threads_num();
-  int taskid = -1;
-  for(int i=0;i<nt;i++)
-    taskid = threads_task("macadam", work_item_cnt, taskid, buf, parallel_run, 0);
-  threads_wait(taskid);
-#else // single threaded version:
+  parallel_shared_t par = { .off = calloc(sizeof(uint64_t), work_item_cnt+1) };
   for(int k=0;k<work_item_cnt;k++)
-    parallel_run(k, buf);
-#endif
+    par.off[k+1] = par.off[k] + box_cnt(k);
+  par.box = calloc(sizeof(box_t), par.off[work_item_cnt]);
+  threads_parallel_for(0, work_item_cnt, 1, parallel_run, &par);
+
+  // write to the map in the order of enumeration, the last box wins:
+  for(uint64_t k=0;k<par.off[work_item_cnt];k++)
+  {
+    const box_t *box = par.box + k;
+    if(box->idx < 0) continue;
+    float *v = buf + 4*box->idx;
+    // const float n = v[3];
+    // const float t0 = n/(n+1.0), t1 = 1.0/(n+1.0);
+    const float t0 = 0.0f, t1 = 1.0f;
+    v[0] = t0*v[0] + t1*box->b;
+    v[1] = t0*v[1] + t1*box->lambda0;
+    v[2] = t0*v[2] + t1*box->lambda1;
+    v[3] ++ ;
+  }
+  free(par.box);
+  free(par.off);
 
   // inpaint/hole filling
   dt_inpaint_buf_t inpaint_buf = {
@@ -144,8 +173,7 @@ int main(int argc, char *argv[])
   // write 1 channel half lut:
   uint32_t size = sizeof(uint16_t)*res*res;
   uint16_t *b16 = malloc(size);
-  for(int k=0;k<res*res;k++)
-    b16[k] = float_to_half(smooth[k]);
+  float_to_half_n(smooth, b16, res*res);
   typedef struct header_t
   {
     uint32_t magic;